@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+
+# Compares perf trace files written by "poedit --trace=FILE" (see
+# src/perf_trace.h) with a baseline trace recorded from the same actions
+# (e.g. opening, saving and pre-translating the same large file) and fails
+# on significant slowdowns.
+#
+# Usage: compare-perf-traces.py [--tolerance=PCT] [--min-ms=MS] BASELINE CURRENT
+#
+# Events with the same name are summed up in each trace. Events that took
+# less than --min-ms in the baseline are too noisy to compare and are only
+# reported. Speedups are reported too, but never fail the comparison.
+
+import argparse
+import json
+import sys
+from collections import defaultdict
+
+
+def load_totals(filename):
+    """Returns dict of event name -> (total duration in ms, count)."""
+    with open(filename, encoding='utf-8') as f:
+        data = json.load(f)
+    totals = defaultdict(lambda: [0.0, 0])
+    for e in data.get('traceEvents', []):
+        if e.get('ph') != 'X' or e.get('name') == 'task':
+            continue
+        t = totals[e['name']]
+        t[0] += e.get('dur', 0) / 1000.0
+        t[1] += 1
+    return totals
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare Poedit perf traces against a baseline.')
+    parser.add_argument('baseline')
+    parser.add_argument('current')
+    parser.add_argument('--tolerance', type=float, default=20.0,
+                        help='allowed slowdown in percent (default: %(default)s)')
+    parser.add_argument('--min-ms', type=float, default=10.0,
+                        help='ignore events faster than this in the baseline (default: %(default)s)')
+    args = parser.parse_args()
+
+    baseline = load_totals(args.baseline)
+    current = load_totals(args.current)
+
+    regressions = 0
+    for name in sorted(set(baseline) | set(current)):
+        if name not in current:
+            print(f'  {name}: missing in current trace')
+            continue
+        if name not in baseline:
+            print(f'  {name}: new, {current[name][0]:.1f} ms')
+            continue
+
+        base_ms, cur_ms = baseline[name][0], current[name][0]
+        change = (cur_ms - base_ms) / base_ms * 100.0 if base_ms > 0 else 0.0
+        status = ' '
+        if base_ms >= args.min_ms and change > args.tolerance:
+            status = '!'
+            regressions += 1
+        print(f'{status} {name}: {base_ms:.1f} ms -> {cur_ms:.1f} ms ({change:+.1f}%)')
+
+    if regressions:
+        print(f'{regressions} event(s) slower by more than {args.tolerance:g}%', file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+
+# Generates large, deterministic translation files for performance testing
+# and reproducing bug reports: PO, XLIFF 1.2 and JSON catalogs and TMX
+# translation memories.
+#
+# The same arguments always produce the same output. Texts are made of
+# pseudo-words with a realistic length distribution (mostly short UI
+# strings, some long paragraphs) and contain placeholders, markup,
+# contexts and plural forms in roughly the proportions seen in real files.
+#
+# Usage examples:
+#   generate-test-corpus.py --format=po --entries=100000 --lang=cs -o big.po
+#   generate-test-corpus.py --format=tmx --entries=500000 --lang=de,fr,ja -o tm.tmx
+
+import argparse
+import json
+import random
+import sys
+from xml.sax.saxutils import escape, quoteattr
+
+
+# plural forms for supported target languages
+PLURAL_FORMS = {
+    'ar': (6, 'n==0 ? 0 : n==1 ? 1 : n==2 ? 2 : n%100>=3 && n%100<=10 ? 3 : n%100>=11 ? 4 : 5'),
+    'cs': (3, '(n==1) ? 0 : (n>=2 && n<=4) ? 1 : 2'),
+    'de': (2, '(n != 1)'),
+    'es': (2, '(n != 1)'),
+    'fr': (2, '(n > 1)'),
+    'ja': (1, '0'),
+    'pl': (3, '(n==1 ? 0 : n%10>=2 && n%10<=4 && (n%100<10 || n%100>=20) ? 1 : 2)'),
+    'ru': (3, '(n%10==1 && n%100!=11 ? 0 : n%10>=2 && n%10<=4 && (n%100<10 || n%100>=20) ? 1 : 2)'),
+    'zh_CN': (1, '0'),
+}
+
+# alphabets used for pseudo-translations, to exercise non-ASCII text
+ALPHABETS = {
+    'ar': 'ابتثجحخدذرزسشصضطظعغفقكلمنهوي',
+    'cs': 'abcdeéěfghiíjklmnňoóprřsštťuúůvyýzž',
+    'ja': 'あいうえおかきくけこさしすせそたちつてとなにぬねのアイウエオ',
+    'ru': 'абвгдежзийклмнопрстуфхцчшщыэюя',
+    'zh_CN': '的一是不了人我在有他这中大来上国个到说们为子和你地出道也时年',
+}
+LATIN = 'abcdefghijklmnopqrstuvwxyz'
+
+PLACEHOLDERS = ['%s', '%d', '%1$s', '%2$d', '{name}', '{count}', '%(file)s']
+MARKUP = [('<b>', '</b>'), ('<a href="https://example.com">', '</a>'), ('<em>', '</em>')]
+
+
+class Generator:
+    def __init__(self, seed, placeholders, markup, plurals, contexts, comments):
+        self.rnd = random.Random(seed)
+        self.placeholders = placeholders
+        self.markup = markup
+        self.plurals = plurals
+        self.contexts = contexts
+        self.comments = comments
+
+    def word_count(self):
+        # UI strings are mostly a few words long, with a long tail of
+        # sentences and paragraphs
+        return max(1, min(300, int(self.rnd.lognormvariate(1.2, 0.9))))
+
+    def word(self, alphabet):
+        length = max(1, min(14, int(self.rnd.gauss(5, 2.5))))
+        return ''.join(self.rnd.choice(alphabet) for _ in range(length))
+
+    def text(self, alphabet=LATIN, words=None):
+        words = [self.word(alphabet) for _ in range(words or self.word_count())]
+        if self.rnd.random() < self.placeholders:
+            words.insert(self.rnd.randrange(len(words) + 1), self.rnd.choice(PLACEHOLDERS))
+        if len(words) > 1 and self.rnd.random() < self.markup:
+            start, end = MARKUP[self.rnd.randrange(len(MARKUP))]
+            i = self.rnd.randrange(len(words) - 1)
+            words[i] = start + words[i]
+            words[i + 1] = words[i + 1] + end
+        s = ' '.join(words)
+        s = s[0].upper() + s[1:]
+        if len(words) > 6:
+            s += '.'
+        return s
+
+    def translate(self, source, lang):
+        # pseudo-translation keeping placeholders and markup intact, with
+        # roughly the same length as the source
+        alphabet = ALPHABETS.get(lang, LATIN)
+        out = []
+        for w in source.split(' '):
+            if '%' in w or '{' in w or '<' in w:
+                out.append(w)
+            else:
+                out.append(self.word(alphabet))
+        return ' '.join(out)
+
+    def entries(self, count):
+        """Yields dicts with source entries."""
+        seen = set()
+        for i in range(count):
+            e = {'id': i}
+            while True:
+                e['source'] = self.text()
+                e['context'] = self.text(words=2) if self.rnd.random() < self.contexts else None
+                key = (e['context'], e['source'])
+                if key not in seen:
+                    seen.add(key)
+                    break
+            e['plural'] = self.text(words=len(e['source'].split(' '))) if self.rnd.random() < self.plurals else None
+            e['comment'] = self.text(words=8) if self.rnd.random() < self.comments else None
+            e['reference'] = 'src/%s/%s.c:%d' % (self.word(LATIN), self.word(LATIN), self.rnd.randrange(1, 3000))
+            yield e
+
+
+def po_string(keyword, s, out):
+    out.write('%s "%s"\n' % (keyword, s.replace('\\', '\\\\').replace('"', '\\"')))
+
+
+def write_po(gen, args, out):
+    lang = args.lang[0]
+    nplurals, plural = PLURAL_FORMS.get(lang, (2, '(n != 1)'))
+    out.write('msgid ""\nmsgstr ""\n'
+              '"Project-Id-Version: Generated test corpus\\n"\n'
+              '"Language: %s\\n"\n'
+              '"MIME-Version: 1.0\\n"\n'
+              '"Content-Type: text/plain; charset=UTF-8\\n"\n'
+              '"Content-Transfer-Encoding: 8bit\\n"\n'
+              '"Plural-Forms: nplurals=%d; plural=%s;\\n"\n\n' % (lang, nplurals, plural))
+    for e in gen.entries(args.entries):
+        if e['comment']:
+            out.write('#. %s\n' % e['comment'])
+        out.write('#: %s\n' % e['reference'])
+        translated = gen.rnd.random() < args.translated
+        if translated and gen.rnd.random() < args.fuzzy:
+            out.write('#, fuzzy\n')
+        if e['context']:
+            po_string('msgctxt', e['context'], out)
+        po_string('msgid', e['source'], out)
+        if e['plural']:
+            po_string('msgid_plural', e['plural'], out)
+            for n in range(nplurals):
+                po_string('msgstr[%d]' % n, gen.translate(e['plural'] if n else e['source'], lang) if translated else '', out)
+        else:
+            po_string('msgstr', gen.translate(e['source'], lang) if translated else '', out)
+        out.write('\n')
+
+
+def write_xliff(gen, args, out):
+    lang = args.lang[0]
+    out.write('<?xml version="1.0" encoding="UTF-8"?>\n'
+              '<xliff xmlns="urn:oasis:names:tc:xliff:document:1.2" version="1.2">\n'
+              '  <file original="generated" source-language="%s" target-language="%s" datatype="plaintext">\n'
+              '    <body>\n' % (args.source_lang, lang))
+    for e in gen.entries(args.entries):
+        # XLIFF has no plurals, so plural entries are just more units
+        out.write('      <trans-unit id="unit%d">\n' % e['id'])
+        out.write('        <source>%s</source>\n' % escape(e['source']))
+        if gen.rnd.random() < args.translated:
+            out.write('        <target>%s</target>\n' % escape(gen.translate(e['source'], lang)))
+        if e['comment']:
+            out.write('        <note>%s</note>\n' % escape(e['comment']))
+        out.write('      </trans-unit>\n')
+    out.write('    </body>\n  </file>\n</xliff>\n')
+
+
+def write_json(gen, args, out):
+    lang = args.lang[0]
+    data = {}
+    for e in gen.entries(args.entries):
+        key = 'key%d_%s' % (e['id'], gen.word(LATIN))
+        data[key] = gen.translate(e['source'], lang) if gen.rnd.random() < args.translated else e['source']
+    json.dump(data, out, ensure_ascii=False, indent=2)
+    out.write('\n')
+
+
+def write_tmx(gen, args, out):
+    out.write('<?xml version="1.0" encoding="UTF-8"?>\n'
+              '<tmx version="1.4">\n'
+              '  <header creationtool="generate-test-corpus.py" creationtoolversion="1.0" datatype="plaintext"'
+              ' segtype="sentence" adminlang="en" srclang=%s o-tmf="generated"/>\n'
+              '  <body>\n' % quoteattr(args.source_lang))
+    for e in gen.entries(args.entries):
+        lang = args.lang[e['id'] % len(args.lang)]
+        out.write('    <tu creationdate="20230101T%06dZ">\n' % (e['id'] % 240000))
+        out.write('      <tuv xml:lang=%s><seg>%s</seg></tuv>\n' % (quoteattr(args.source_lang), escape(e['source'])))
+        out.write('      <tuv xml:lang=%s><seg>%s</seg></tuv>\n' % (quoteattr(lang.replace('_', '-')), escape(gen.translate(e['source'], lang))))
+        out.write('    </tu>\n')
+    out.write('  </body>\n</tmx>\n')
+
+
+WRITERS = {'po': write_po, 'xliff': write_xliff, 'json': write_json, 'tmx': write_tmx}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate deterministic translation files for testing.')
+    parser.add_argument('--format', choices=sorted(WRITERS), required=True)
+    parser.add_argument('--entries', type=int, default=1000)
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--source-lang', default='en')
+    parser.add_argument('--lang', default='cs',
+                        help='comma-separated target language(s); TMX alternates between them')
+    parser.add_argument('--translated', type=float, default=0.8, help='fraction of translated entries')
+    parser.add_argument('--fuzzy', type=float, default=0.1, help='fraction of translated PO entries marked fuzzy')
+    parser.add_argument('--plurals', type=float, default=0.05, help='fraction of PO entries with plural forms')
+    parser.add_argument('--contexts', type=float, default=0.1, help='fraction of entries with context')
+    parser.add_argument('--comments', type=float, default=0.2, help='fraction of entries with extracted comments')
+    parser.add_argument('--placeholders', type=float, default=0.3, help='fraction of texts with placeholders')
+    parser.add_argument('--markup', type=float, default=0.1, help='fraction of texts with HTML markup')
+    parser.add_argument('-o', '--output', help='output file (default: stdout)')
+    args = parser.parse_args()
+    args.lang = [l.strip() for l in args.lang.split(',') if l.strip()]
+
+    gen = Generator(args.seed, args.placeholders, args.markup, args.plurals, args.contexts, args.comments)
+    if args.output:
+        with open(args.output, 'w', encoding='utf-8', newline='\n') as out:
+            WRITERS[args.format](gen, args, out)
+    else:
+        WRITERS[args.format](gen, args, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,341 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2023 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "cache_registry.h"
+
+#include "concurrency.h"
+
+#include <wx/log.h>
+
+#include <algorithm>
+
+#if defined(__WXOSX__)
+    #include <dispatch/dispatch.h>
+#elif defined(__WXMSW__)
+    #include <wx/msw/wrapwin.h>
+    #include <thread>
+#elif defined(__linux__)
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <unistd.h>
+    #include <cerrno>
+    #include <cstring>
+    #include <thread>
+#endif
+
+namespace
+{
+
+const char *PressureName(CacheRegistry::Pressure pressure)
+{
+    return pressure == CacheRegistry::Pressure::Critical ? "critical" : "warning";
+}
+
+#if defined(__WXMSW__) || defined(__linux__)
+// Called on the monitoring thread
+void OnMemoryPressure(CacheRegistry::Pressure pressure)
+{
+    dispatch::on_main([pressure]{ CacheRegistry::Get().ReleaseMemory(pressure); });
+}
+
+// Notifications that keep coming while memory is low are ignored for this
+// long after releasing memory, because there's little left to free then.
+const int NOTIFICATIONS_INTERVAL_MS = 10000;
+#endif
+
+} // anonymous namespace
+
+
+#if defined(__WXOSX__)
+
+// libdispatch's memory pressure source, delivered on the main queue
+class CacheRegistry::Monitor
+{
+public:
+    Monitor()
+    {
+        m_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                          DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                          dispatch_get_main_queue());
+        if (!m_source)
+            return;
+        dispatch_set_context(m_source, m_source);
+        dispatch_source_set_event_handler_f(m_source, &Monitor::OnEvent);
+        dispatch_resume(m_source);
+    }
+
+    ~Monitor()
+    {
+        if (!m_source)
+            return;
+        dispatch_source_cancel(m_source);
+        dispatch_release(m_source);
+    }
+
+private:
+    static void OnEvent(void *context)
+    {
+        auto source = static_cast<dispatch_source_t>(context);
+        auto level = dispatch_source_get_data(source);
+        CacheRegistry::Get().ReleaseMemory((level & DISPATCH_MEMORYPRESSURE_CRITICAL) ? Pressure::Critical : Pressure::Warning);
+    }
+
+    dispatch_source_t m_source;
+};
+
+#elif defined(__WXMSW__)
+
+// Windows only signals that the system is low on memory, as a whole; waiting
+// for it is done on a dedicated thread. Low memory that persists after
+// releasing memory once is treated as critical.
+class CacheRegistry::Monitor
+{
+public:
+    Monitor()
+    {
+        m_notification = CreateMemoryResourceNotification(LowMemoryResourceNotification);
+        m_stop = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (m_notification && m_stop)
+            m_thread = std::thread([this]{ Run(); });
+    }
+
+    ~Monitor()
+    {
+        if (m_thread.joinable())
+        {
+            SetEvent(m_stop);
+            m_thread.join();
+        }
+        if (m_notification)
+            CloseHandle(m_notification);
+        if (m_stop)
+            CloseHandle(m_stop);
+    }
+
+private:
+    void Run()
+    {
+        const HANDLE handles[] = { m_stop, m_notification };
+        auto pressure = Pressure::Warning;
+        for (;;)
+        {
+            if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+                return;
+
+            OnMemoryPressure(pressure);
+
+            // the notification stays signaled for as long as memory is low:
+            if (WaitForSingleObject(m_stop, NOTIFICATIONS_INTERVAL_MS) != WAIT_TIMEOUT)
+                return;
+
+            BOOL low = FALSE;
+            if (QueryMemoryResourceNotification(m_notification, &low) && low)
+                pressure = Pressure::Critical;
+            else
+                pressure = Pressure::Warning;
+        }
+    }
+
+    HANDLE m_notification;
+    HANDLE m_stop;
+    std::thread m_thread;
+};
+
+#elif defined(__linux__)
+
+// Pressure Stall Information triggers (see the kernel's Documentation/
+// accounting/psi.rst): the kernel notifies us when tasks were stalled
+// waiting for memory longer than the threshold within the time window.
+// Unprivileged processes may only use windows that are multiples of 2s.
+// Not available on older kernels or if PSI is disabled, in which case
+// there's simply no monitoring.
+class CacheRegistry::Monitor
+{
+public:
+    Monitor() : m_stop{-1, -1}, m_triggers{-1, -1}
+    {
+        static const char *TRIGGERS[] =
+        {
+            "some 150000 2000000",  // Pressure::Warning
+            "full 100000 2000000"   // Pressure::Critical
+        };
+
+        for (int i = 0; i < 2; i++)
+        {
+            int fd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+            if (fd < 0)
+                return;
+            m_triggers[i] = fd;
+            if (write(fd, TRIGGERS[i], strlen(TRIGGERS[i]) + 1) < 0)
+            {
+                wxLogTrace("poedit.memory", "PSI trigger not available: %s", strerror(errno));
+                return;
+            }
+        }
+
+        if (pipe2(m_stop, O_CLOEXEC) != 0)
+            return;
+
+        m_thread = std::thread([this]{ Run(); });
+    }
+
+    ~Monitor()
+    {
+        if (m_thread.joinable())
+        {
+            char c = 0;
+            if (write(m_stop[1], &c, 1) < 0)
+                wxLogTrace("poedit.memory", "failed to stop PSI monitoring");
+            m_thread.join();
+        }
+        for (int fd: {m_stop[0], m_stop[1], m_triggers[0], m_triggers[1]})
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+    }
+
+private:
+    void Run()
+    {
+        pollfd fds[3];
+        fds[0] = {m_stop[0], POLLIN, 0};
+        fds[1] = {m_triggers[0], POLLPRI, 0};
+        fds[2] = {m_triggers[1], POLLPRI, 0};
+
+        for (;;)
+        {
+            int n = poll(fds, 3, -1);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 || fds[0].revents)
+                return;
+            if ((fds[1].revents | fds[2].revents) & (POLLERR | POLLNVAL))
+            {
+                wxLogTrace("poedit.memory", "PSI monitoring failed, stopping");
+                return;
+            }
+
+            OnMemoryPressure((fds[2].revents & POLLPRI) ? Pressure::Critical : Pressure::Warning);
+
+            // wait before responding to further events, but remain stoppable:
+            do
+            {
+                n = poll(fds, 1, NOTIFICATIONS_INTERVAL_MS);
+            } while (n < 0 && errno == EINTR);
+            if (n != 0)
+                return;
+        }
+    }
+
+    int m_stop[2];
+    int m_triggers[2];
+    std::thread m_thread;
+};
+
+#else
+
+// no memory pressure notifications on this platform
+class CacheRegistry::Monitor
+{
+};
+
+#endif
+
+
+CacheRegistry::Registration::Registration(const char *name, UsageFunc usage, ReleaseFunc release)
+    : m_name(name), m_usage(std::move(usage)), m_release(std::move(release))
+{
+    auto& registry = CacheRegistry::Get();
+    std::lock_guard<std::mutex> lock(registry.m_mutex);
+    registry.m_caches.push_back(this);
+}
+
+
+CacheRegistry::Registration::~Registration()
+{
+    auto& registry = CacheRegistry::Get();
+    std::lock_guard<std::mutex> lock(registry.m_mutex);
+    auto& caches = registry.m_caches;
+    caches.erase(std::remove(caches.begin(), caches.end(), this), caches.end());
+}
+
+
+CacheRegistry::CacheRegistry()
+{
+}
+
+
+CacheRegistry& CacheRegistry::Get()
+{
+    // Intentionally leaked: caches are often static objects themselves and
+    // may be destroyed during static destruction in any order.
+    static CacheRegistry *s_instance = new CacheRegistry;
+    return *s_instance;
+}
+
+
+size_t CacheRegistry::GetTotalMemoryUsage()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t total = 0;
+    for (auto c: m_caches)
+        total += c->m_usage();
+    return total;
+}
+
+
+void CacheRegistry::ReleaseMemory(Pressure pressure)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t before = 0, after = 0;
+    for (auto c: m_caches)
+    {
+        const size_t usage = c->m_usage();
+        c->m_release(pressure);
+        const size_t remaining = c->m_usage();
+        wxLogTrace("poedit.memory", "%s: %zu -> %zu bytes", c->m_name, usage, remaining);
+        before += usage;
+        after += remaining;
+    }
+
+    wxLogTrace("poedit.memory", "memory pressure (%s): caches trimmed from %zu to %zu bytes",
+               PressureName(pressure), before, after);
+}
+
+
+void CacheRegistry::StartMonitoring()
+{
+    auto& registry = Get();
+    if (!registry.m_monitor)
+        registry.m_monitor.reset(new Monitor);
+}
+
+
+void CacheRegistry::StopMonitoring()
+{
+    Get().m_monitor.reset();
+}
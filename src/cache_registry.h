@@ -0,0 +1,117 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2023 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_cache_registry_h
+#define Poedit_cache_registry_h
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+/**
+    Registry of in-memory caches, so that they can be trimmed when the system
+    is running low on memory.
+
+    Caches register themselves with a Registration object that reports how
+    much memory they use and frees some or all of it on request. Once
+    StartMonitoring() is called, the OS's memory pressure notifications (see
+    cache_registry.cpp) make the registry ask all caches to release memory.
+ */
+class CacheRegistry
+{
+public:
+    /// How severe the memory shortage is
+    enum class Pressure
+    {
+        Warning,  ///< drop the least valuable part of the cache (e.g. LRU tail)
+        Critical  ///< drop everything that can be recomputed
+    };
+
+    /**
+        Registers a cache for as long as the object exists.
+
+        Both functions are called on the main thread, with the registry
+        locked, and must not (un)register any caches. They must be safe to
+        call at any time the Registration exists, so it should be declared
+        as the last member of the owning object, i.e. destroyed first.
+     */
+    class Registration
+    {
+    public:
+        typedef std::function<size_t()> UsageFunc;
+        typedef std::function<void(Pressure)> ReleaseFunc;
+
+        /**
+            @param name    Name of the cache, used for diagnostics.
+            @param usage   Returns (approximate) number of bytes used.
+            @param release Frees memory according to pressure level.
+         */
+        Registration(const char *name, UsageFunc usage, ReleaseFunc release);
+        ~Registration();
+
+        Registration(const Registration&) = delete;
+        Registration& operator=(const Registration&) = delete;
+
+    private:
+        friend class CacheRegistry;
+
+        const char *m_name;
+        UsageFunc m_usage;
+        ReleaseFunc m_release;
+    };
+
+    /// Returns singleton instance; it is never destroyed.
+    static CacheRegistry& Get();
+
+    /// Returns total memory used by all caches. Main thread only.
+    size_t GetTotalMemoryUsage();
+
+    /**
+        Asks all caches to release memory.
+
+        Is called automatically on memory pressure notifications once
+        monitoring is started. Main thread only.
+     */
+    void ReleaseMemory(Pressure pressure);
+
+    /// Starts listening to the OS's memory pressure notifications.
+    static void StartMonitoring();
+
+    /// Stops the monitoring, must be called on app shutdown.
+    static void StopMonitoring();
+
+private:
+    CacheRegistry();
+
+    class Monitor;
+
+    std::mutex m_mutex;
+    std::vector<Registration*> m_caches;
+    std::unique_ptr<Monitor> m_monitor;
+};
+
+#endif // Poedit_cache_registry_h
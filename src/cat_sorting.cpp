@@ -95,80 +95,109 @@ CatalogItemsComparator::CatalogItemsComparator(const Catalog& catalog, const Sor
             break;
     }
 
-    // Prepare cache for faster comparison. ICU uses UTF-16 internally, we can significantly
-    // speed up comparisons by doing string conversion in advance, in O(n) time and space, if
-    // the platform's native representation is UTF-32 or -8 (which it is on non-Windows).
-    // Moreover, the additional processing of removing accelerators is also done only once
-    // on all platforms, resulting in massive speedups on Windows too.
-    switch (m_order.by)
+    // Prepare binary sort keys for all items, in O(n) time and space, so that
+    // sorting only needs to compare bytes instead of running full collation
+    // for each of the O(n log n) comparisons. The additional processing of
+    // removing accelerators is also done only once this way.
+    const bool needsSortKeys = (m_order.by != SortOrder::By_FileOrder);
+    const size_t count = m_catalog.GetCount();
+
+    m_buckets.reserve(count);
+    if (needsSortKeys)
+        m_sortKeys.reserve(count);
+    if (m_order.groupByContext)
+        m_contextKeys.reserve(count);
+
+    for (auto& i: m_catalog.items())
     {
-        case SortOrder::By_Source:
-            m_sortKeys.reserve(m_catalog.GetCount());
-            for (auto& i: m_catalog.items())
-                m_sortKeys.push_back(ConvertToSortKey(i->GetString()));
-            break;
-
-        case SortOrder::By_Translation:
-            m_sortKeys.reserve(m_catalog.GetCount());
-            for (auto& i: m_catalog.items())
-                m_sortKeys.push_back(ConvertToSortKey(i->GetTranslation()));
-            break;
-
-        case SortOrder::By_FileOrder:
-            break;
+        m_buckets.push_back(ComputeBucket(*i));
+        if (needsSortKeys)
+            m_sortKeys.push_back(ComputeSortKey(*i));
+        if (m_order.groupByContext)
+            m_contextKeys.push_back(ComputeContextKey(*i));
     }
 }
 
 
-bool CatalogItemsComparator::operator()(int i, int j) const
+void CatalogItemsComparator::Update(int index)
 {
-    const CatalogItem& a = Item(i);
-    const CatalogItem& b = Item(j);
+    const CatalogItem& item = Item(index);
 
-    if ( m_order.errorsFirst )
+    m_buckets[index] = ComputeBucket(item);
+    if (!m_sortKeys.empty())
+        m_sortKeys[index] = ComputeSortKey(item);
+    if (!m_contextKeys.empty())
+        m_contextKeys[index] = ComputeContextKey(item);
+}
+
+
+uint8_t CatalogItemsComparator::ComputeBucket(const CatalogItem& item) const
+{
+    // Grouping criteria, in order of decreasing precedence, with bits set for
+    // items that go later:
+    uint8_t bucket = 0;
+    if (m_order.errorsFirst)
     {
         // hard errors always go first:
-        if ( a.HasError() && !b.HasError() )
-            return true;
-        else if ( !a.HasError() && b.HasError() )
-            return false;
-
+        if (!item.HasError())
+            bucket |= 0x10;
         // warnings are more nuanced and should only be considered on non-fuzzy
         // entries (see https://github.com/vslavik/poedit/issues/611 for discussion):
-        auto const a_shouldWarn = a.HasIssue() && !a.IsFuzzy();
-        auto const b_shouldWarn = b.HasIssue() && !b.IsFuzzy();
-        if ( a_shouldWarn && !b_shouldWarn )
-            return true;
-        else if ( !a_shouldWarn && b_shouldWarn )
-            return false;
+        if (!(item.HasIssue() && !item.IsFuzzy()))
+            bucket |= 0x08;
+    }
+    if (m_order.untransFirst)
+    {
+        if (item.IsTranslated())
+            bucket |= 0x04;
+        if (!item.IsFuzzy())
+            bucket |= 0x02;
+    }
+    if (m_order.groupByContext)
+    {
+        if (!item.HasContext())
+            bucket |= 0x01;
     }
+    return bucket;
+}
+
 
-    if ( m_order.untransFirst )
+unicode::Collator::sort_key_type CatalogItemsComparator::ComputeSortKey(const CatalogItem& item) const
+{
+    switch (m_order.by)
     {
-        if ( !a.IsTranslated() && b.IsTranslated() )
-            return true;
-        else if ( a.IsTranslated() && !b.IsTranslated() )
-            return false;
-
-        if ( a.IsFuzzy() && !b.IsFuzzy() )
-            return true;
-        else if ( !a.IsFuzzy() && b.IsFuzzy() )
-            return false;
+        case SortOrder::By_Source:
+            return m_collator->sort_key(PrepareForCollation(item.GetString()));
+        case SortOrder::By_Translation:
+            return m_collator->sort_key(PrepareForCollation(item.GetTranslation()));
+        case SortOrder::By_FileOrder:
+            break;
     }
+    return unicode::Collator::sort_key_type();
+}
+
+
+unicode::Collator::sort_key_type CatalogItemsComparator::ComputeContextKey(const CatalogItem& item) const
+{
+    // we don't want to apply translation string pre-processing to contexts:
+    if (item.HasContext())
+        return m_collator->sort_key(item.GetContext());
+    else
+        return unicode::Collator::sort_key_type();
+}
+
+
+bool CatalogItemsComparator::operator()(int i, int j) const
+{
+    if ( m_buckets[i] != m_buckets[j] )
+        return m_buckets[i] < m_buckets[j];
 
+    // same bucket, so either both or neither have context (and empty keys):
     if ( m_order.groupByContext )
     {
-        if ( a.HasContext() && !b.HasContext() )
-            return true;
-        else if ( !a.HasContext() && b.HasContext() )
-            return false;
-        else if ( a.HasContext() && b.HasContext() )
-        {
-            // we don't want to apply translation string pre-processing to contexts, use collator directly
-            auto r = m_collator->compare(a.GetContext(), b.GetContext());
-            if ( r != 0 )
-                return r < 0;
-        }
+        auto r = m_contextKeys[i].compare(m_contextKeys[j]);
+        if ( r != 0 )
+            return r < 0;
     }
 
     switch ( m_order.by )
@@ -181,7 +210,7 @@ bool CatalogItemsComparator::operator()(int i, int j) const
         case SortOrder::By_Source:
         case SortOrder::By_Translation:
         {
-            auto r = m_collator->compare(m_sortKeys[i], m_sortKeys[j]);
+            auto r = m_sortKeys[i].compare(m_sortKeys[j]);
             if ( r != 0 )
                 return r < 0;
             break;
@@ -30,6 +30,7 @@
 #include "unicode_helpers.h"
 
 #include <memory>
+#include <vector>
 
 /// Sort order information
 struct SortOrder
@@ -65,6 +66,11 @@ struct SortOrder
 
 /**
     Comparator for sorting catalog items by different criteria.
+
+    All sorting data are computed upfront in the constructor, so that the
+    comparator is cheap to call and can be used from multiple threads
+    concurrently. It reflects the items' state at the time of construction
+    or of the last Update() call.
  */
 class CatalogItemsComparator
 {
@@ -79,14 +85,23 @@ public:
 
     bool operator()(int i, int j) const;
 
+    /**
+        Recomputes sorting data for the item at @a index after it changed
+        (e.g. was translated or its QA issue was updated), so that its new
+        position can be found without recreating the comparator.
+
+        Must not be called while the comparator is in use by other threads.
+     */
+    void Update(int index);
+
 protected:
     const CatalogItem& Item(int i) const { return *m_catalog[i]; }
 
-    // Pre-process given string and return it in a form efficient for comparing
-    // with ICU collator. This does two things:
+    // Pre-process given string and return it in a form suitable for passing
+    // to ICU collator. This does two things:
     //  1. Converts to UTF-16 (matters on non-Windows platforms where wchar_t is UTF-32)
     //  2. Perform substitution of accelerator characters in the string
-    static str::UCharBuffer ConvertToSortKey(const wxString& a)
+    static str::UCharBuffer PrepareForCollation(const wxString& a)
     {
         if (a.find_first_of(L"&_") == wxString::npos)
         {
@@ -107,10 +122,18 @@ protected:
     }
 
 private:
+    uint8_t ComputeBucket(const CatalogItem& item) const;
+    unicode::Collator::sort_key_type ComputeSortKey(const CatalogItem& item) const;
+    unicode::Collator::sort_key_type ComputeContextKey(const CatalogItem& item) const;
+
     const Catalog& m_catalog;
     SortOrder m_order;
     std::unique_ptr<unicode::Collator> m_collator;
-    std::vector<str::UCharBuffer> m_sortKeys;
+    // Per-item key prefix with errors/untranslated/context grouping packed
+    // into bits, so that grouping is done with a single comparison:
+    std::vector<uint8_t> m_buckets;
+    // ICU binary sort keys of the sorted-by text and of contexts, per item:
+    std::vector<unicode::Collator::sort_key_type> m_sortKeys, m_contextKeys;
 };
 
 
@@ -27,18 +27,26 @@
 
 #include "errors.h"
 #include "extractors/extractor.h"
+#include "perf_trace.h"
 #include "progressinfo.h"
 #include "utility.h"
 
 #include <wx/config.h>
 #include <wx/dialog.h>
+#include <wx/fswatcher.h>
 #include <wx/intl.h>
 #include <wx/listbox.h>
 #include <wx/log.h>
 #include <wx/msgdlg.h>
 #include <wx/stattext.h>
+#include <wx/timer.h>
 #include <wx/xrc/xmlres.h>
 
+#include <algorithm>
+#include <set>
+#include <string_view>
+#include <unordered_map>
+
 
 namespace
 {
@@ -123,10 +131,103 @@ inline wxString ItemMergeSummary(const CatalogItemPtr& item)
     return s;
 }
 
+namespace
+{
+
+inline void hash_combine(size_t& seed, size_t value)
+{
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+inline size_t hash_string(const wxString& s)
+{
+    return std::hash<std::wstring_view>()(std::wstring_view(s.wc_str(), s.length()));
+}
+
+// Hash of the (context, msgid, plural) key that identifies items in merging
+size_t ItemMergeKeyHash(const CatalogItem& item)
+{
+    size_t h = hash_string(item.GetString());
+    hash_combine(h, item.HasPlural() ? hash_string(item.GetPluralString()) : 0);
+    hash_combine(h, item.HasContext() ? hash_string(item.GetContext()) + 1 : 0);
+    return h;
+}
+
+bool ItemMergeKeysEqual(const CatalogItem& a, const CatalogItem& b)
+{
+    return a.GetString() == b.GetString() &&
+           a.HasPlural() == b.HasPlural() && (!a.HasPlural() || a.GetPluralString() == b.GetPluralString()) &&
+           a.HasContext() == b.HasContext() && (!a.HasContext() || a.GetContext() == b.GetContext());
+}
+
+
+// Finds items of one catalog by their merge key
+class MergeKeyIndex
+{
+public:
+    MergeKeyIndex(const CatalogItemArray& items, const std::vector<size_t>& hashes) : m_items(items)
+    {
+        m_index.reserve(items.size());
+        for (size_t i = 0; i < items.size(); i++)
+            m_index.emplace(hashes[i], i);
+    }
+
+    bool Contains(const CatalogItem& item, size_t hash) const
+    {
+        auto range = m_index.equal_range(hash);
+        for (auto i = range.first; i != range.second; ++i)
+        {
+            if (ItemMergeKeysEqual(*m_items[i->second], item))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    const CatalogItemArray& m_items;
+    std::unordered_multimap<size_t, size_t> m_index;
+};
+
+const size_t MERGE_SUMMARY_GRAIN = 2000;
+
+std::vector<size_t> ComputeMergeKeyHashes(const CatalogItemArray& items)
+{
+    std::vector<size_t> hashes(items.size());
+    dispatch::parallel_for(items.size(), MERGE_SUMMARY_GRAIN, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+            hashes[i] = ItemMergeKeyHash(*items[i]);
+    });
+    return hashes;
+}
+
+// Adds formatted summaries of @a items not present in @a other to @a out
+void AddMissingItems(const CatalogItemArray& items, const std::vector<size_t>& hashes,
+                     const MergeKeyIndex& other, wxArrayString& out)
+{
+    std::vector<char> missing(items.size(), false);
+    dispatch::parallel_for(items.size(), MERGE_SUMMARY_GRAIN, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+            missing[i] = !other.Contains(*items[i], hashes[i]);
+    });
+
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        if (missing[i])
+            out.Add(ItemMergeSummary(items[i]));
+    }
+}
+
+} // anonymous namespace
+
 /** Returns list of strings that are new in reference catalog
     (compared to this one) and that are not present in \a refcat
     (i.e. are obsoleted).
 
+    Items are compared by their hashed (context, msgid) keys, in parallel,
+    and only the differing ones are formatted for display.
+
     \see ShowMergeSummary
  */
 void GetMergeSummary(CatalogPtr po, CatalogPtr refcat,
@@ -135,24 +236,21 @@ void GetMergeSummary(CatalogPtr po, CatalogPtr refcat,
     wxASSERT( snew.empty() );
     wxASSERT( sobsolete.empty() );
 
-    std::set<wxString> strsThis, strsRef;
+    perf::ScopedTimer timer("merge summary");
 
-    for (auto& i: po->items())
-        strsThis.insert(ItemMergeSummary(i));
-    for (auto& i: refcat->items())
-        strsRef.insert(ItemMergeSummary(i));
+    auto& itemsThis = po->items();
+    auto& itemsRef = refcat->items();
 
-    for (auto& i: strsThis)
-    {
-        if (strsRef.find(i) == strsRef.end())
-            sobsolete.Add(i);
-    }
+    const auto hashesThis = ComputeMergeKeyHashes(itemsThis);
+    const auto hashesRef = ComputeMergeKeyHashes(itemsRef);
 
-    for (auto& i: strsRef)
-    {
-        if (strsThis.find(i) == strsThis.end())
-            snew.Add(i);
-    }
+    MergeKeyIndex indexThis(itemsThis, hashesThis);
+    MergeKeyIndex indexRef(itemsRef, hashesRef);
+
+    AddMissingItems(itemsThis, hashesThis, indexRef, sobsolete);
+    AddMissingItems(itemsRef, hashesRef, indexThis, snew);
+
+    timer.SetItemsCount(itemsThis.size() + itemsRef.size());
 }
 
 /** Shows a dialog with merge summary.
@@ -181,12 +279,12 @@ bool ShowMergeSummary(wxWindow *parent, CatalogPtr po, CatalogPtr refcat, bool *
         return true;
 }
 
-POCatalogPtr ExtractPOTFromSources(POCatalogPtr catalog, UpdateResultReason& reason)
-{
-    Progress progress(1);
+} // anonymous namespace
 
-    reason = UpdateResultReason::Unspecified;
 
+POCatalogPtr ExtractPOTFromSources(POCatalogPtr catalog, UpdateResultReason& reason,
+                                   dispatch::cancellation_token_ptr cancellationToken)
+{
     auto spec = catalog->GetSourceCodeSpec();
     if (!spec)
     {
@@ -194,36 +292,75 @@ POCatalogPtr ExtractPOTFromSources(POCatalogPtr catalog, UpdateResultReason& rea
         return nullptr;
     }
 
-    progress.message(_(L"Collecting source files…"));
+    return ExtractPOTFromSources(*spec, reason, cancellationToken);
+}
+
+
+POCatalogPtr ExtractPOTFromSources(const SourceCodeSpec& spec, UpdateResultReason& reason,
+                                   dispatch::cancellation_token_ptr cancellationToken)
+{
+    perf::ScopedTimer timer("extraction from sources");
+
+    // rough relative durations of the stages:
+    const int COLLECT_WEIGHT = 5, EXTRACT_WEIGHT = 80, MERGE_WEIGHT = 15;
+    Progress progress(COLLECT_WEIGHT + EXTRACT_WEIGHT + MERGE_WEIGHT);
+
+    reason = UpdateResultReason::Unspecified;
 
     try
     {
-        auto files = Extractor::CollectAllFiles(*spec);
+        Extractor::FilesList files;
+        {
+            Progress subtask(1, progress, COLLECT_WEIGHT);
+            subtask.message(_(L"Collecting source files…"));
+            perf::ScopedTimer stageTimer("collecting source files");
+
+            // only collect files that some extractor will actually use:
+            auto filter = Extractor::SupportedFilesFilter(Extractor::CreateAllExtractors(spec));
+            files = Extractor::CollectAllFiles(spec, filter, cancellationToken);
+            stageTimer.SetItemsCount(files.size());
+        }
 
-        progress.message(_(L"Extracting translatable strings…"));
+        if (files.empty())
+        {
+            reason = UpdateResultReason::NoSourcesFound;
+            return nullptr;
+        }
 
-        if (!files.empty())
+        TempDirectory tmpdir;
+        std::vector<wxString> subPots;
         {
-            TempDirectory tmpdir;
-            auto potFile = Extractor::ExtractWithAll(tmpdir, *spec, files);
-            if (!potFile.empty())
-            {
-                try
-                {
-                    auto pot = POCatalog::Create(potFile, Catalog::CreationFlag_IgnoreHeader);
-                    return pot;
-                }
-                catch (...)
-                {
-                    wxLogError(_("Failed to load file with extracted translations."));
-                    reason = UpdateResultReason::Unspecified;
-                    return nullptr;
-                }
-            }
+            Progress subtask(1, progress, EXTRACT_WEIGHT);
+            subtask.message(wxString::Format(wxPLURAL(L"Extracting translatable strings from %d file…",
+                                                      L"Extracting translatable strings from %d files…",
+                                                      (int)files.size()),
+                                             (int)files.size()));
+            perf::ScopedTimer stageTimer("extracting strings");
+            stageTimer.SetItemsCount(files.size());
+            subPots = Extractor::ExtractSubPOTs(tmpdir, spec, files, cancellationToken);
         }
-        else
+
+        if (cancellationToken && cancellationToken->is_cancelled())
         {
-            reason = UpdateResultReason::NoSourcesFound;
+            reason = UpdateResultReason::CancelledByUser;
+            return nullptr;
+        }
+
+        Progress subtask(1, progress, MERGE_WEIGHT);
+        subtask.message(_(L"Merging extracted strings…"));
+        try
+        {
+            perf::ScopedTimer stageTimer("merging extracted strings");
+            // merged in-process, without running msgcat and reparsing its output:
+            auto pot = POCatalog::CreateByConcatenating(subPots);
+            if (pot)
+                stageTimer.SetItemsCount(pot->GetCount());
+            return pot;
+        }
+        catch (...)
+        {
+            wxLogError(_("Failed to load file with extracted translations."));
+            reason = UpdateResultReason::Unspecified;
             return nullptr;
         }
     }
@@ -240,6 +377,9 @@ POCatalogPtr ExtractPOTFromSources(POCatalogPtr catalog, UpdateResultReason& rea
             case ExtractionError::PermissionDenied:
                 reason = UpdateResultReason::PermissionDenied;
                 break;
+            case ExtractionError::Cancelled:
+                reason = UpdateResultReason::CancelledByUser;
+                break;
         }
         reason.file = e.file;
         return nullptr;
@@ -248,7 +388,6 @@ POCatalogPtr ExtractPOTFromSources(POCatalogPtr catalog, UpdateResultReason& rea
     return nullptr;
 }
 
-} // anonymous namespace
 
 bool PerformUpdateFromSources(POCatalogPtr catalog, UpdateResultReason& reason)
 {
@@ -271,17 +410,26 @@ bool PerformUpdateFromSources(POCatalogPtr catalog, UpdateResultReason& reason)
 bool PerformUpdateFromSourcesWithUI(wxWindow *parent,
                                     POCatalogPtr catalog,
                                     UpdateResultReason& reason,
-                                    int flags)
+                                    int flags,
+                                    POCatalogPtr extractedPOT)
 {
     const bool skipSummary = (flags & Update_DontShowSummary);
 
-    POCatalogPtr pot;
+    POCatalogPtr pot = extractedPOT;
+    bool succ = true;
 
-    bool succ = ProgressWindow::RunCancellableTask(parent, _("Updating translations"),
-    [&reason,&pot,catalog](dispatch::cancellation_token_ptr /*cancellationToken*/)
+    if (!pot)
     {
-        pot = ExtractPOTFromSources(catalog, reason);
-    });
+        succ = ProgressWindow::RunCancellableTask(parent, _("Updating translations"),
+        [&reason,&pot,catalog](dispatch::cancellation_token_ptr cancellationToken)
+        {
+            pot = ExtractPOTFromSources(catalog, reason, cancellationToken);
+        });
+    }
+    else
+    {
+        wxLogTrace("poedit.extractor", "using strings extracted in the background");
+    }
 
     if (!succ)
     {
@@ -305,6 +453,148 @@ bool PerformUpdateFromSourcesWithUI(wxWindow *parent,
 }
 
 
+bool PerformProjectUpdateFromSourcesWithUI(wxWindow *parent, const std::vector<wxString>& files)
+{
+    // catalogs sharing the same source code configuration:
+    struct SourceTree
+    {
+        std::shared_ptr<SourceCodeSpec> spec;
+        std::vector<POCatalogPtr> catalogs;
+        POCatalogPtr pot;
+    };
+
+    std::vector<SourceTree> trees;
+    std::set<wxString> snew, sobsolete;
+    const bool showSummary = wxConfig::Get()->ReadBool("show_summary", false);
+
+    bool succ = ProgressWindow::RunCancellableTask(parent, _("Updating translations"),
+    [&](dispatch::cancellation_token_ptr cancellationToken)
+    {
+        // rough relative durations of the stages:
+        const int LOAD_WEIGHT = 10, EXTRACT_WEIGHT = 90;
+        Progress progress(LOAD_WEIGHT + EXTRACT_WEIGHT);
+
+        std::vector<POCatalogPtr> catalogs;
+        {
+            Progress subtask((int)files.size(), progress, LOAD_WEIGHT);
+            subtask.message(_(L"Loading translation files…"));
+
+            std::vector<dispatch::future<POCatalogPtr>> loading;
+            for (auto& f: files)
+            {
+                loading.push_back(dispatch::async([f,&subtask]
+                {
+                    // suppress error messages, files that can't be loaded are just skipped
+                    wxLogNull nullLog;
+                    POCatalogPtr cat;
+                    try
+                    {
+                        cat = POCatalog::Create(f);
+                    }
+                    catch (...) {}
+                    subtask.increment();
+                    return cat;
+                }));
+            }
+            for (auto& l: loading)
+            {
+                auto cat = l.get();
+                if (cat && cat->HasSourcesAvailable())
+                    catalogs.push_back(cat);
+            }
+        }
+
+        for (auto& cat: catalogs)
+        {
+            auto spec = cat->GetSourceCodeSpec();
+            auto tree = std::find_if(trees.begin(), trees.end(), [&](const SourceTree& t){ return *t.spec == *spec; });
+            if (tree == trees.end())
+                tree = trees.insert(trees.end(), SourceTree{spec, {}, nullptr});
+            tree->catalogs.push_back(cat);
+        }
+
+        Progress subtask((int)trees.size(), progress, EXTRACT_WEIGHT);
+        for (auto& t: trees)
+        {
+            if (cancellationToken->is_cancelled())
+                return;
+
+            Progress treeProgress(1, subtask, 1);
+            UpdateResultReason reason;
+            t.pot = ExtractPOTFromSources(*t.spec, reason, cancellationToken);
+
+            if (t.pot && showSummary)
+            {
+                for (auto& cat: t.catalogs)
+                {
+                    wxArrayString catNew, catObsolete;
+                    GetMergeSummary(cat, t.pot, catNew, catObsolete);
+                    snew.insert(catNew.begin(), catNew.end());
+                    sobsolete.insert(catObsolete.begin(), catObsolete.end());
+                }
+            }
+        }
+    });
+
+    if (!succ)
+        return false;
+
+    if (showSummary)
+    {
+        MergeSummaryDialog sdlg(parent);
+        wxArrayString anew, aobsolete;
+        for (auto& s: snew)
+            anew.Add(s);
+        for (auto& s: sobsolete)
+            aobsolete.Add(s);
+        sdlg.TransferTo(anew, aobsolete);
+        if (sdlg.ShowModal() != wxID_OK)
+            return false;
+    }
+
+    int count = 0;
+    for (auto& t: trees)
+    {
+        if (t.pot)
+            count += (int)t.catalogs.size();
+    }
+
+    return ProgressWindow::RunCancellableTask(parent, _("Updating translations"),
+    [&trees,count](dispatch::cancellation_token_ptr cancellationToken)
+    {
+        Progress progress(count);
+        progress.message(_(L"Merging differences…"));
+
+        // Merging and saving of individual files is independent, so do it in
+        // parallel; Merge() itself is single-threaded off the main thread.
+        std::vector<dispatch::future<void>> jobs;
+        for (auto& t: trees)
+        {
+            if (!t.pot)
+                continue;
+            for (auto& cat: t.catalogs)
+            {
+                jobs.push_back(dispatch::async([cat,pot=t.pot,cancellationToken,&progress]
+                {
+                    if (cancellationToken->is_cancelled())
+                        return;
+                    if (cat->UpdateFromPOT(pot))
+                    {
+                        Catalog::ValidationResults validation_results;
+                        Catalog::CompilationStatus mo_status;
+                        cat->Save(cat->GetFileName(), false, validation_results, mo_status);
+                    }
+                    progress.increment();
+                }));
+            }
+        }
+
+        for (auto& j: jobs)
+            j.get();
+    });
+}
+
+
 bool PerformUpdateFromPOTWithUI(wxWindow *parent,
                                 POCatalogPtr catalog,
                                 const wxString& pot_file,
@@ -346,3 +636,193 @@ bool PerformUpdateFromPOTWithUI(wxWindow *parent,
         return false;
     }
 }
+
+
+class SourcesWatcher::Impl : public std::enable_shared_from_this<SourcesWatcher::Impl>
+{
+public:
+    Impl(const SourceCodeSpec& spec)
+        : m_spec(spec),
+          m_cancellationToken(std::make_shared<dispatch::cancellation_token>()),
+          m_generation(0), m_extracting(false), m_rerunPending(false)
+    {
+        m_filter = Extractor::SupportedFilesFilter(Extractor::CreateAllExtractors(spec));
+        m_timer.Bind(wxEVT_TIMER, [=](wxTimerEvent&){ StartExtraction(); });
+    }
+
+    ~Impl()
+    {
+        m_cancellationToken->cancel();
+    }
+
+    void Start()
+    {
+        m_watcher = std::make_unique<wxFileSystemWatcher>();
+        m_watcher->Bind(wxEVT_FSWATCHER, &Impl::OnFileSystemEvent, this);
+
+        // failures to watch (e.g. because of too many directories) shouldn't be
+        // reported to the user, the sources are extracted on update anyway:
+        wxLogNull noLog;
+        for (auto& path: m_spec.SearchPaths)
+        {
+            const wxString fullpath = m_spec.BasePath + path;
+            if (wxFileName::DirExists(fullpath))
+                m_watcher->AddTree(wxFileName::DirName(fullpath), WATCHED_EVENTS);
+            else if (wxFileName::FileExists(fullpath))
+                m_watcher->Add(wxFileName::DirName(wxFileName(fullpath).GetPath()), WATCHED_EVENTS);
+        }
+
+        // do the initial extraction once things settle down after opening the file:
+        m_timer.StartOnce(INITIAL_DELAY);
+    }
+
+    bool Matches(const SourceCodeSpec& spec) const { return spec == m_spec; }
+
+    POCatalogPtr TakeExtractedPOT(const SourceCodeSpec& spec)
+    {
+        if (!m_pot || !Matches(spec))
+            return nullptr;
+
+        auto pot = m_pot;
+        m_pot.reset();
+        // keep a fresh copy ready for the next update:
+        m_timer.StartOnce(DEBOUNCE_DELAY);
+        return pot;
+    }
+
+private:
+    static const int WATCHED_EVENTS = wxFSW_EVENT_CREATE | wxFSW_EVENT_DELETE | wxFSW_EVENT_RENAME |
+                                      wxFSW_EVENT_MODIFY | wxFSW_EVENT_WARNING;
+    static const int INITIAL_DELAY = 3000;  // ms
+    static const int DEBOUNCE_DELAY = 1000; // ms
+
+    void OnFileSystemEvent(wxFileSystemWatcherEvent& event)
+    {
+        const int type = event.GetChangeType();
+
+        if (type == wxFSW_EVENT_WARNING)
+        {
+            // some events may have been lost, e.g. due to overflow
+            SourcesChanged();
+            return;
+        }
+
+        if (type == wxFSW_EVENT_CREATE && event.GetPath().DirExists())
+        {
+            // newly created directories need to be watched too:
+            wxLogNull noLog;
+            m_watcher->AddTree(wxFileName::DirName(event.GetPath().GetFullPath()), WATCHED_EVENTS);
+            SourcesChanged();
+            return;
+        }
+
+        if (IsRelevant(event.GetPath()) || (type == wxFSW_EVENT_RENAME && IsRelevant(event.GetNewPath())))
+            SourcesChanged();
+    }
+
+    bool IsRelevant(const wxFileName& fn) const
+    {
+        if (!fn.IsOk())
+            return false;
+
+        wxString path = fn.GetFullPath();
+        if (!path.StartsWith(m_spec.BasePath, &path))
+            return false;
+#ifdef __WXMSW__
+        path.Replace("\\", "/");
+#endif
+
+        // ignore hidden files, VCS directories and such:
+        if (path.starts_with(".") || path.Contains("/."))
+            return false;
+
+        // deletions or renames of directories affect all files in them:
+        if (!fn.HasExt() && !wxFileName::FileExists(fn.GetFullPath()))
+            return true;
+
+        return !m_filter || m_filter(path);
+    }
+
+    void SourcesChanged()
+    {
+        m_generation++;
+        m_pot.reset();
+        m_timer.StartOnce(DEBOUNCE_DELAY);
+    }
+
+    void StartExtraction()
+    {
+        if (m_extracting)
+        {
+            m_rerunPending = true;
+            return;
+        }
+
+        wxLogTrace("poedit.extractor", "extracting changed sources in the background");
+
+        m_extracting = true;
+        m_rerunPending = false;
+        const int generation = m_generation;
+        std::weak_ptr<Impl> weakSelf = shared_from_this();
+
+        dispatch::async(dispatch::priority::bulk, [spec = m_spec, token = m_cancellationToken]
+        {
+            // errors are reported when the user updates explicitly, not at random times:
+            wxLogNull noLog;
+            UpdateResultReason reason;
+            return ExtractPOTFromSources(spec, reason, token);
+        })
+        .then_on_main([weakSelf, generation](POCatalogPtr pot)
+        {
+            if (auto self = weakSelf.lock())
+                self->OnExtracted(pot, generation);
+        })
+        .catch_all([weakSelf](dispatch::exception_ptr)
+        {
+            if (auto self = weakSelf.lock())
+                self->OnExtracted(nullptr, -1);
+        });
+    }
+
+    void OnExtracted(POCatalogPtr pot, int generation)
+    {
+        m_extracting = false;
+        if (generation == m_generation)
+            m_pot = pot;
+
+        if (m_rerunPending)
+            StartExtraction();
+    }
+
+    SourceCodeSpec m_spec;
+    Extractor::FileFilter m_filter;
+    dispatch::cancellation_token_ptr m_cancellationToken;
+
+    std::unique_ptr<wxFileSystemWatcher> m_watcher;
+    wxTimer m_timer;
+
+    int m_generation;  // incremented on every change
+    bool m_extracting, m_rerunPending;
+    POCatalogPtr m_pot;
+};
+
+
+SourcesWatcher::SourcesWatcher(const SourceCodeSpec& spec)
+    : m_impl(std::make_shared<Impl>(spec))
+{
+    m_impl->Start();
+}
+
+SourcesWatcher::~SourcesWatcher()
+{
+}
+
+bool SourcesWatcher::Matches(const SourceCodeSpec& spec) const
+{
+    return m_impl->Matches(spec);
+}
+
+POCatalogPtr SourcesWatcher::TakeExtractedPOT(const SourceCodeSpec& spec)
+{
+    return m_impl->TakeExtractedPOT(spec);
+}
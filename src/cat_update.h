@@ -28,6 +28,9 @@
 
 #include "catalog_po.h"
 
+#include <memory>
+#include <vector>
+
 class WXDLLIMPEXP_FWD_CORE wxWindow;
 
 
@@ -53,16 +56,51 @@ enum UpdateFlags
     Update_DontShowSummary = 1
 };
 
+/**
+    Extracts strings from source code configured in @a catalog into a new
+    POT catalog. Returns nullptr on failure, with @a reason set.
+
+    Progress of the individual stages (collecting files, extracting, merging)
+    is reported through the current Progress. If @a cancellationToken is
+    cancelled, extraction stops as soon as possible, with @a reason set to
+    UpdateResultReason::CancelledByUser.
+ */
+POCatalogPtr ExtractPOTFromSources(POCatalogPtr catalog, UpdateResultReason& reason,
+                                   dispatch::cancellation_token_ptr cancellationToken = dispatch::cancellation_token_ptr());
+
+/// Like above, but extracts from explicitly provided @a spec; safe to call from any thread.
+POCatalogPtr ExtractPOTFromSources(const SourceCodeSpec& spec, UpdateResultReason& reason,
+                                   dispatch::cancellation_token_ptr cancellationToken = dispatch::cancellation_token_ptr());
+
 /**
     Update catalog from source code, if configured, and provide UI
     during the operation.
  */
 bool PerformUpdateFromSources(POCatalogPtr catalog, UpdateResultReason& reason);
 
+/**
+    Like PerformUpdateFromSources(), with UI. If @a extractedPOT is provided,
+    it is used instead of extracting strings from the sources again.
+ */
 bool PerformUpdateFromSourcesWithUI(wxWindow *parent,
                                     POCatalogPtr catalog,
                                     UpdateResultReason& reason,
-                                    int flags = 0);
+                                    int flags = 0,
+                                    POCatalogPtr extractedPOT = POCatalogPtr());
+
+/**
+    Updates all catalog @a files from source code, with UI, and saves them.
+
+    Strings are extracted only once for all catalogs that share the same
+    source code configuration. The catalogs are then merged and saved in
+    parallel. If enabled, a single summary of changes for all files is shown
+    before they are modified.
+
+    Files that can't be loaded or don't have sources configured are skipped.
+
+    @return false if cancelled by the user, true otherwise
+ */
+bool PerformProjectUpdateFromSourcesWithUI(wxWindow *parent, const std::vector<wxString>& files);
 
 /**
     Similarly for updating from a POT file.
@@ -73,4 +111,36 @@ bool PerformUpdateFromPOTWithUI(wxWindow *parent,
                                 UpdateResultReason& reason);
 
 
+
+/**
+    Watches source code described by SourceCodeSpec for changes and keeps
+    strings extracted from it up to date in the background, so that updating
+    from sources can be done without any scanning or extraction.
+
+    Must be used on the main thread only.
+ */
+class SourcesWatcher
+{
+public:
+    /// Starts watching; must be called when the event loop is already running.
+    explicit SourcesWatcher(const SourceCodeSpec& spec);
+    ~SourcesWatcher();
+
+    /// Does this watcher watch sources described by @a spec?
+    bool Matches(const SourceCodeSpec& spec) const;
+
+    /**
+        Returns POT extracted from the current state of sources described by
+        @a spec, or nullptr if it's not available (yet) or doesn't match.
+
+        The returned catalog is handed over to the caller and sources are then
+        extracted again soon.
+     */
+    POCatalogPtr TakeExtractedPOT(const SourceCodeSpec& spec);
+
+private:
+    class Impl;
+    std::shared_ptr<Impl> m_impl;
+};
+
 #endif // Poedit_cat_update_h
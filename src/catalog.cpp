@@ -28,16 +28,19 @@
 #include "catalog_po.h"
 #include "catalog_xliff.h"
 #include "catalog_json.h"
+#include "catalog_mo.h"
 
 #include "configuration.h"
 #include "errors.h"
 #include "extractors/extractor.h"
 #include "gexecute.h"
+#include "perf_trace.h"
 #include "qa_checks.h"
 #include "str_helpers.h"
 #include "utility.h"
 #include "version.h"
 #include "language.h"
+#include "concurrency.h"
 
 #include <stdio.h>
 #include <wx/utils.h>
@@ -51,9 +54,14 @@
 #include <wx/strconv.h>
 #include <wx/memtext.h>
 #include <wx/filename.h>
+#include <wx/thread.h>
 
 #include <algorithm>
+#include <iomanip>
+#include <mutex>
 #include <set>
+#include <sstream>
+#include <unordered_map>
 #include <regex>
 
 
@@ -468,6 +476,7 @@ Catalog::HeaderData::Find(const wxString& key) const
 // ----------------------------------------------------------------------
 
 Catalog::Catalog(Type type)
+    : m_sourcesAvailability(std::make_shared<SourcesAvailabilityCache>())
 {
     m_fileType = type;
     m_header.BasePath = wxEmptyString;
@@ -537,18 +546,98 @@ CatalogItemPtr Catalog::FindItemByLine(int lineno)
     return i == -1 ? CatalogItemPtr() : m_items[i];
 }
 
+struct Catalog::ItemsIndex
+{
+    // used to detect (most) changes to m_items that weren't accompanied by
+    // InvalidateItemsIndex() call:
+    const CatalogItemPtr *data;
+    size_t size;
+
+    std::vector<std::pair<int, int>> byLine;  // (line number, index), sorted
+    std::unordered_map<std::wstring, int> byString;
+};
+
+
+Catalog::ItemsIndex& Catalog::GetItemsIndex()
+{
+    if (m_itemsIndex && m_itemsIndex->data == m_items.data() && m_itemsIndex->size == m_items.size())
+        return *m_itemsIndex;
+
+    auto index = std::make_shared<ItemsIndex>();
+    index->data = m_items.data();
+    index->size = m_items.size();
+
+    index->byLine.reserve(m_items.size());
+    index->byString.reserve(m_items.size());
+    for (size_t i = 0; i < m_items.size(); i++)
+    {
+        index->byLine.emplace_back(m_items[i]->GetLineNumber(), int(i));
+        index->byString.emplace(m_items[i]->GetLookupKey(), int(i));  // keeps the first of duplicates
+    }
+    // stable sort keeps items on the same line in their order:
+    std::stable_sort(index->byLine.begin(), index->byLine.end(),
+                     [](const auto& a, const auto& b){ return a.first < b.first; });
+
+    m_itemsIndex = index;
+    return *index;
+}
+
+
 int Catalog::FindItemIndexByLine(int lineno)
 {
-    int last = -1;
+    // Finds the last item that starts at or before the line:
+    auto find = [=](const ItemsIndex& index)
+    {
+        return std::upper_bound(index.byLine.begin(), index.byLine.end(), lineno,
+                                [](int line, const auto& i){ return line < i.first; });
+    };
+    auto isCurrent = [=](const std::pair<int, int>& i)
+    {
+        return m_items[i.second]->GetLineNumber() == i.first;
+    };
 
-    for (auto& i: m_items)
+    auto* index = &GetItemsIndex();
+    auto pos = find(*index);
+
+    // Line numbers change when the file is saved, so check that they are
+    // still the same for the items that determine the result:
+    if ((pos != index->byLine.end() && !isCurrent(*pos)) ||
+        (pos != index->byLine.begin() && !isCurrent(*(pos - 1))))
     {
-        if (i->GetLineNumber() > lineno)
-            return last;
-        last++;
+        InvalidateItemsIndex();
+        index = &GetItemsIndex();
+        pos = find(*index);
     }
 
-    return last;
+    if (pos == index->byLine.begin())
+        return -1;
+    return (pos - 1)->second;
+}
+
+
+CatalogItemPtr Catalog::FindItemByString(const wxString& str, bool hasContext, const wxString& context)
+{
+    int i = FindItemIndexByString(str, hasContext, context);
+    return i == -1 ? CatalogItemPtr() : m_items[i];
+}
+
+
+int Catalog::FindItemIndexByString(const wxString& str, bool hasContext, const wxString& context)
+{
+    const auto key = CatalogItem::MakeLookupKey(str, hasContext, context);
+
+    auto& index = GetItemsIndex();
+    auto i = index.byString.find(key);
+    if (i == index.byString.end())
+        return -1;
+    if (m_items[i->second]->GetLookupKey() == key)
+        return i->second;
+
+    // the item was modified since the index was built:
+    InvalidateItemsIndex();
+    auto& newIndex = GetItemsIndex();
+    i = newIndex.byString.find(key);
+    return i == newIndex.byString.end() ? -1 : i->second;
 }
 
 
@@ -570,6 +659,8 @@ wxString MaskForType(Catalog::Type t)
         case Catalog::Type::JSON_FLUTTER:
             // TRANSLATORS: "Flutter" is proper noun, name of a developer tool
             return MaskForType("*.arb", _("Flutter Translation Files"));
+        case Catalog::Type::MO:
+            return MaskForType("*.mo", _("MO Compiled Translations"));
     }
     return ""; // silence stupid warning
 }
@@ -578,9 +669,9 @@ wxString MaskForType(Catalog::Type t)
 
 wxString Catalog::GetAllTypesFileMask()
 {
-    return MaskForType("*.po;*.pot;*.xlf;*.xliff;*.json;*.arb", _("All Translation Files"), /*showExt=*/false) +
+    return MaskForType("*.po;*.pot;*.po.gz;*.pot.gz;*.xlf;*.xliff;*.json;*.arb;*.mo", _("All Translation Files"), /*showExt=*/false) +
         "|" +
-        GetTypesFileMask({ Type::PO, Type::POT, Type::XLIFF, Type::JSON, Type::JSON_FLUTTER });
+        GetTypesFileMask({ Type::PO, Type::POT, Type::XLIFF, Type::JSON, Type::JSON_FLUTTER, Type::MO });
 }
 
 wxString Catalog::GetTypesFileMask(std::initializer_list<Type> types)
@@ -672,47 +763,142 @@ bool Catalog::HasSourcesConfigured() const
            !m_header.SearchPaths.empty();
 }
 
-bool Catalog::HasSourcesAvailable() const
+namespace
 {
-    if (!HasSourcesConfigured())
-        return false;
 
-    auto basepath = GetSourcesBasePath();
-    if (!wxFileName::DirExists(basepath))
-        return false;
+// Everything HasSourcesAvailable() depends on, computed without touching the
+// file system. Doubles as the key of the cached result.
+struct SourcesProbe
+{
+    wxString basepath;
+    wxString root;
+    wxArrayString searchPaths;
+    wxString wpfile;
 
-    for (auto& p: m_header.SearchPaths)
+    wxString Key() const
     {
-        auto fullp = wxIsAbsolutePath(p) ? p : basepath + p;
-        if (!wxFileName::Exists(fullp))
-            return false;
+        wxString key = basepath + '\n' + root + '\n' + wpfile;
+        for (auto& p: searchPaths)
+            key << '\n' << p;
+        return key;
     }
 
-    auto wpfile = m_header.GetHeader("X-Poedit-WPHeader");
-    if (!wpfile.empty())
+    bool Run() const
     {
-        // The following tests in this function are heuristics, so don't run
-        // them in presence of X-Poedit-WPHeader and consider the existence
-        // of that file a confirmation of correct setup (even though strictly
-        // speaking only its absence proves anything).
-        return wxFileName::FileExists(basepath + wpfile);
+        if (!wxFileName::DirExists(basepath))
+            return false;
+
+        for (auto& p: searchPaths)
+        {
+            auto fullp = wxIsAbsolutePath(p) ? p : basepath + p;
+            if (!wxFileName::Exists(fullp))
+                return false;
+        }
+
+        if (!wpfile.empty())
+        {
+            // The following tests in this function are heuristics, so don't run
+            // them in presence of X-Poedit-WPHeader and consider the existence
+            // of that file a confirmation of correct setup (even though strictly
+            // speaking only its absence proves anything).
+            return wxFileName::FileExists(basepath + wpfile);
+        }
+
+        if (searchPaths.size() == 1)
+        {
+            // A single path doesn't give us much in terms of detection. About the
+            // only thing we can do is to check if it is is a well known directory
+            // that is unlikely to be the root.
+            if (root == wxGetUserHome() ||
+                root == wxStandardPaths::Get().GetDocumentsDir() ||
+                root.ends_with(wxString(wxFILE_SEP_PATH) + "Desktop" + wxFILE_SEP_PATH))
+            {
+                return false;
+            }
+        }
+
+        return true;
     }
+};
 
-    if (m_header.SearchPaths.size() == 1)
+} // anonymous namespace
+
+struct Catalog::SourcesAvailabilityCache
+{
+    bool Get(const wxString& key, bool& available)
     {
-        // A single path doesn't give us much in terms of detection. About the
-        // only thing we can do is to check if it is is a well known directory
-        // that is unlikely to be the root.
-        auto root = GetSourcesRootPath();
-        if (root == wxGetUserHome() ||
-            root == wxStandardPaths::Get().GetDocumentsDir() ||
-            root.ends_with(wxString(wxFILE_SEP_PATH) + "Desktop" + wxFILE_SEP_PATH))
-        {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_valid || m_key != key)
             return false;
-        }
+        available = m_available;
+        return true;
     }
 
-    return true;
+    void Set(const wxString& key, bool available)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_key = key;
+        m_available = available;
+        m_valid = true;
+    }
+
+    void Invalidate()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_valid = false;
+    }
+
+private:
+    std::mutex m_mutex;
+    wxString m_key;
+    bool m_available = false;
+    bool m_valid = false;
+};
+
+bool Catalog::HasSourcesAvailable() const
+{
+    if (!HasSourcesConfigured())
+        return false;
+
+    SourcesProbe probe{GetSourcesBasePath(), GetSourcesRootPath(),
+                       m_header.SearchPaths, m_header.GetHeader("X-Poedit-WPHeader")};
+    auto key = probe.Key();
+
+    bool available;
+    if (m_sourcesAvailability->Get(key, available))
+        return available;
+
+    available = probe.Run();
+    m_sourcesAvailability->Set(key, available);
+    return available;
+}
+
+dispatch::future<bool> Catalog::HasSourcesAvailableAsync() const
+{
+    if (!HasSourcesConfigured())
+        return dispatch::make_ready_future(false);
+
+    SourcesProbe probe{GetSourcesBasePath(), GetSourcesRootPath(),
+                       m_header.SearchPaths, m_header.GetHeader("X-Poedit-WPHeader")};
+    auto key = probe.Key();
+
+    bool available;
+    if (m_sourcesAvailability->Get(key, available))
+        return dispatch::make_ready_future(std::move(available));
+
+    // copies are used so that the probe doesn't depend on the catalog's lifetime:
+    auto cache = m_sourcesAvailability;
+    return dispatch::async([cache, probe, key]
+    {
+        bool result = probe.Run();
+        cache->Set(key, result);
+        return result;
+    });
+}
+
+void Catalog::InvalidateSourcesAvailability()
+{
+    m_sourcesAvailability->Invalidate();
 }
 
 std::shared_ptr<SourceCodeSpec> Catalog::GetSourceCodeSpec() const
@@ -766,46 +952,77 @@ void Catalog::SetLanguage(Language lang)
 void Catalog::GetStatistics(int *all, int *fuzzy, int *badtokens,
                             int *untranslated, int *unfinished)
 {
-    if (all) *all = 0;
-    if (fuzzy) *fuzzy = 0;
-    if (badtokens) *badtokens = 0;
-    if (untranslated) *untranslated = 0;
-    if (unfinished) *unfinished = 0;
-
-    for (auto& i: m_items)
+    // Recount if m_items changed or if the items were attached to another
+    // catalog's counters in the meantime (checking the ends only is enough
+    // to catch wholesale reassignments):
+    if (!m_statsCounters ||
+        m_statsItemsData != m_items.data() || m_statsItemsSize != m_items.size() ||
+        (!m_items.empty() && (std::atomic_load(&m_items.front()->m_statsCounters) != m_statsCounters ||
+                              std::atomic_load(&m_items.back()->m_statsCounters) != m_statsCounters)))
     {
-        bool ok = true;
-
-        if (all)
-            (*all)++;
-
-        if (i->IsFuzzy())
-        {
-            if (fuzzy)
-                (*fuzzy)++;
-            ok = false;
-        }
-        if (i->HasError())
-        {
-            if (badtokens)
-                (*badtokens)++;
-            ok = false;
-        }
-        if (!i->IsTranslated())
+        auto counters = std::make_shared<CatalogStatsCounters>();
+        for (auto& i: m_items)
         {
-            if (untranslated)
-                (*untranslated)++;
-            ok = false;
+            std::atomic_store(&i->m_statsCounters, counters);
+
+            auto state = i->GetStatsState();
+            if (state & CatalogItem::Stats_Fuzzy)
+                counters->fuzzy++;
+            if (state & CatalogItem::Stats_Error)
+                counters->badtokens++;
+            if (state & CatalogItem::Stats_Untranslated)
+                counters->untranslated++;
+            if (state)
+                counters->unfinished++;
         }
 
-        if ( !ok && unfinished )
-            (*unfinished)++;
+        m_statsCounters = counters;
+        m_statsItemsData = m_items.data();
+        m_statsItemsSize = m_items.size();
     }
+
+    if (all) *all = (int)m_items.size();
+    if (fuzzy) *fuzzy = m_statsCounters->fuzzy;
+    if (badtokens) *badtokens = m_statsCounters->badtokens;
+    if (untranslated) *untranslated = m_statsCounters->untranslated;
+    if (unfinished) *unfinished = m_statsCounters->unfinished;
+}
+
+
+unsigned CatalogItem::GetStatsState() const
+{
+    unsigned state = 0;
+    if (m_isFuzzy)
+        state |= Stats_Fuzzy;
+    if (HasError())
+        state |= Stats_Error;
+    if (!m_isTranslated)
+        state |= Stats_Untranslated;
+    return state;
+}
+
+void CatalogItem::UpdateStatsCounters(unsigned oldState)
+{
+    auto newState = GetStatsState();
+    if (newState == oldState)
+        return;
+
+    auto counters = std::atomic_load(&m_statsCounters);
+    if (!counters)
+        return;
+
+    auto delta = [=](unsigned bit){ return int((newState & bit) != 0) - int((oldState & bit) != 0); };
+    counters->fuzzy += delta(Stats_Fuzzy);
+    counters->badtokens += delta(Stats_Error);
+    counters->untranslated += delta(Stats_Untranslated);
+    counters->unfinished += int(newState != 0) - int(oldState != 0);
 }
 
 
 void CatalogItem::SetFlags(const wxString& flags)
 {
+    StatsUpdate upd(*this);
+
     static const wxString flag_fuzzy(wxS(", fuzzy"));
 
     m_moreFlags = flags;
@@ -822,6 +1039,33 @@ void CatalogItem::SetFlags(const wxString& flags)
 }
 
 
+void CatalogItem::CopyContentFrom(const CatalogItem& other)
+{
+    m_id = other.m_id;
+    m_lineNum = other.m_lineNum;
+    m_hasPlural = other.m_hasPlural;
+    m_hasContext = other.m_hasContext;
+    m_isFuzzy = other.m_isFuzzy;
+    m_isTranslated = other.m_isTranslated;
+    m_isModified = other.m_isModified;
+    m_isPreTranslated = other.m_isPreTranslated;
+    m_string = other.m_string;
+    m_plural = other.m_plural;
+    m_context = other.m_context;
+    m_translations = other.m_translations;
+    m_extractedComments = other.m_extractedComments;
+    m_oldMsgid = other.m_oldMsgid;
+    m_moreFlags = other.m_moreFlags;
+    m_comment = other.m_comment;
+    m_issue = other.m_issue;
+    m_sideloaded = other.m_sideloaded;
+    m_tmSyncFingerprint = other.m_tmSyncFingerprint.load();
+    m_revision = other.m_revision;
+    m_qaFingerprint = other.m_qaFingerprint;
+    m_qaIssue = other.m_qaIssue;
+}
+
+
 wxString CatalogItem::GetFlags() const
 {
     if (m_isFuzzy)
@@ -857,6 +1101,8 @@ std::string CatalogItem::GetFormatFlag() const
 
 void CatalogItem::SetFuzzy(bool fuzzy)
 {
+    StatsUpdate upd(*this);
+
     if (!fuzzy && m_isFuzzy)
         m_oldMsgid.clear();
     m_isFuzzy = fuzzy;
@@ -874,6 +1120,8 @@ wxString CatalogItem::GetTranslation(unsigned idx) const
 
 void CatalogItem::SetTranslation(const wxString &t, unsigned idx)
 {
+    StatsUpdate upd(*this);
+
     while (idx >= m_translations.GetCount())
         m_translations.Add(wxEmptyString);
     m_translations[idx] = t;
@@ -890,11 +1138,14 @@ void CatalogItem::SetTranslation(const wxString &t, unsigned idx)
         }
     }
 
+    m_revision++;
     UpdateInternalRepresentation();
 }
 
 void CatalogItem::SetTranslations(const wxArrayString &t)
 {
+    StatsUpdate upd(*this);
+
     m_translations = t;
 
     ClearIssue();
@@ -909,11 +1160,14 @@ void CatalogItem::SetTranslations(const wxArrayString &t)
         }
     }
 
+    m_revision++;
     UpdateInternalRepresentation();
 }
 
 void CatalogItem::SetTranslationFromSource()
 {
+    StatsUpdate upd(*this);
+
     ClearIssue();
     m_isFuzzy = false;
     m_isPreTranslated = false;
@@ -939,11 +1193,14 @@ void CatalogItem::SetTranslationFromSource()
         }
     }
 
+    m_revision++;
     UpdateInternalRepresentation();
 }
 
 void CatalogItem::ClearTranslation()
 {
+    StatsUpdate upd(*this);
+
     m_isFuzzy = false;
     m_isPreTranslated = false;
     m_isTranslated = false;
@@ -954,6 +1211,7 @@ void CatalogItem::ClearTranslation()
         t.clear();
     }
 
+    m_revision++;
     UpdateInternalRepresentation();
 }
 
@@ -966,6 +1224,80 @@ unsigned CatalogItem::GetPluralFormsCount() const
     return trans - 1;
 }
 
+std::wstring CatalogItem::MakeLookupKey(const wxString& str, bool hasContext, const wxString& context)
+{
+    std::wstring key;
+    if (hasContext)
+    {
+        key = context.ToStdWstring();
+        key += L'\x04';
+    }
+    key += str.ToStdWstring();
+    return key;
+}
+
+void CatalogItem::AddMemoryUsage(CatalogMemoryUsage& usage) const
+{
+    usage.items += sizeof(CatalogItem);
+
+    usage.AddString(m_string);
+    usage.AddString(m_plural);
+    usage.AddString(m_context);
+    usage.AddStrings(m_translations);
+    usage.AddStrings(m_extractedComments);
+    usage.AddStrings(m_oldMsgid);
+    usage.AddString(m_moreFlags);
+    usage.AddString(m_comment);
+
+    for (auto issue: {m_issue.get(), m_qaIssue.get()})
+    {
+        if (issue)
+            usage.issues += sizeof(Issue) + CatalogMemoryUsage::StringBytes(issue->message);
+    }
+}
+
+
+size_t CatalogMemoryUsage::StringBytes(const wxString& s)
+{
+    // short strings fit into the string object itself in all
+    // implementations, longer ones have a terminated buffer:
+    const size_t length = s.length();
+    if (length < 8)
+        return 0;
+    return (length + 1) * sizeof(wxStringCharType);
+}
+
+
+void CatalogMemoryUsage::AddStrings(const wxArrayString& a)
+{
+    arrays += a.capacity() * sizeof(wxString);
+    for (auto& s: a)
+        AddString(s);
+}
+
+
+std::string CatalogMemoryUsage::Report() const
+{
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2);
+
+    auto line = [&ss, this](const char *name, size_t bytes)
+    {
+        const size_t total = Total();
+        ss << name << ": " << bytes / (1024.0 * 1024.0) << " MB"
+           << " (" << (total ? 100.0 * bytes / total : 0.0) << "%)\n";
+    };
+
+    ss << "total: " << Total() / (1024.0 * 1024.0) << " MB\n";
+    line("items", items);
+    line("strings", strings);
+    line("arrays", arrays);
+    line("issues", issues);
+    line("file data", fileData);
+    return ss.str();
+}
+
+
 wxString CatalogItem::GetOldMsgid() const
 {
     wxString s;
@@ -987,6 +1319,18 @@ wxString CatalogItem::GetOldMsgid() const
 }
 
 
+CatalogMemoryUsage Catalog::GetMemoryUsage() const
+{
+    CatalogMemoryUsage usage;
+    usage.arrays += m_items.capacity() * sizeof(CatalogItemPtr);
+    for (auto& i: m_items)
+        i->AddMemoryUsage(usage);
+    // note that reference files used as source of sideloaded data, if
+    // any, are shared by all catalogs and aren't included either
+    return usage;
+}
+
+
 Catalog::ValidationResults Catalog::Validate(const wxString& /*fileWithSameContent*/)
 {
     ValidationResults res;
@@ -1011,37 +1355,57 @@ Catalog::ValidationResults Catalog::Validate(const wxString& /*fileWithSameConte
 }
 
 
+namespace
+{
+
+Language DetectSourceLanguage(const CatalogItemArray& items)
+{
+    // plurals are ignored for simplicity, as we don't need 100% of the text:
+    return Language::TryDetectFromSample(items.size(), [&items](size_t i)
+    {
+        return str::to_utf8(std::regex_replace(items[i]->GetRawString().ToStdWstring(), RE_APPROXIMATE_MARKUP, L" "));
+    });
+}
+
+Language DetectTranslationLanguage(const CatalogItemArray& items)
+{
+    return Language::TryDetectFromSample(items.size(), [&items](size_t i)
+    {
+        auto& item = items[i];
+        return item->IsTranslated() ? str::to_utf8(item->GetTranslation()) : std::string();
+    });
+}
+
+} // anonymous namespace
+
+
 void Catalog::PostCreation()
 {
+    // Detecting the language from text takes a while with large files, so
+    // detection of the source language runs in the background while the
+    // translation's language is being determined. This is only done from the
+    // main thread, because background loads are already parallelized and
+    // blocking a pool thread on other pool jobs could starve the pool.
+    dispatch::future<Language> sourceLanguage;
+    bool detectingSourceLanguage = false;
+
     if (!m_sourceLanguage.IsValid())
     {
         if (!m_sourceIsSymbolicID)
             m_sourceIsSymbolicID = DetectUseOfSymbolicIDs(*this);
 
-        if (!m_sourceIsSymbolicID)
+        if (!m_sourceIsSymbolicID && !m_items.empty())
         {
-            // detect source language from the text (ignoring plurals for simplicity,
-            // as we don't need 100% of the text):
-            std::wstring allText;
-            for (auto& i: items())
-            {
-                auto withoutMarkup = std::regex_replace(i->GetRawString().ToStdWstring(), RE_APPROXIMATE_MARKUP, L" ");
-                allText.append(withoutMarkup);
-                allText += L' ';
-            }
-            if (!allText.empty())
-            {
-                m_sourceLanguage = Language::TryDetectFromText(str::to_utf8(allText));
-                wxLogTrace("poedit", "detected source language is '%s'", m_sourceLanguage.Code());
-            }
+            detectingSourceLanguage = true;
+            if (wxThread::IsMain())
+                sourceLanguage = dispatch::async([this]{ return DetectSourceLanguage(m_items); });
+            else
+                sourceLanguage = dispatch::make_ready_future(DetectSourceLanguage(m_items));
         }
     }
 
     // All the following fixups are for files that contain translations (i.e. not POTs)
-    if (!HasCapability(Cap::Translations))
-        return;
-
-    if (!GetLanguage().IsValid())
+    if (HasCapability(Cap::Translations) && !GetLanguage().IsValid())
     {
         Language lang;
         if (!m_fileName.empty())
@@ -1053,24 +1417,19 @@ void Catalog::PostCreation()
         if (!lang.IsValid())
         {
             // If all else fails, try to detect the language from content
-            wxString allText;
-            for (auto& i: items())
-            {
-                if (!i->IsTranslated())
-                    continue;
-                allText.append(i->GetTranslation());
-                allText.append('\n');
-            }
-            if (!allText.empty())
-            {
-                lang = Language::TryDetectFromText(str::to_utf8(allText));
-                wxLogTrace("poedit", "detected translation language is '%s'", GetLanguage().Code());
-            }
+            lang = DetectTranslationLanguage(m_items);
+            wxLogTrace("poedit", "detected translation language is '%s'", lang.Code());
         }
 
         if (lang.IsValid())
             SetLanguage(lang);
     }
+
+    if (detectingSourceLanguage)
+    {
+        m_sourceLanguage = sourceLanguage.get();
+        wxLogTrace("poedit", "detected source language is '%s'", m_sourceLanguage.Code());
+    }
 }
 
 
@@ -1088,7 +1447,8 @@ CatalogPtr Catalog::Create(Type type)
         case Type::XLIFF:
         case Type::JSON:
         case Type::JSON_FLUTTER:
-            wxFAIL_MSG("empty XLIFF/JSON creation not implemented");
+        case Type::MO:
+            wxFAIL_MSG("empty XLIFF/JSON/MO creation not implemented");
             return CatalogPtr();
     }
 
@@ -1097,12 +1457,14 @@ CatalogPtr Catalog::Create(Type type)
 
 CatalogPtr Catalog::Create(const wxString& filename, int flags)
 {
+    perf::ScopedTimer timer("Catalog::Create");
+
     wxString ext;
     wxFileName::SplitPath(filename, nullptr, nullptr, nullptr, &ext);
     ext.MakeLower();
 
     CatalogPtr cat;
-    if (POCatalog::CanLoadFile(ext))
+    if (POCatalog::CanLoadFile(ext) || POCatalog::IsCompressedFileName(filename))
     {
         cat.reset(new POCatalog(filename, flags));
         flags = 0; // don't do the stuff below that is already handled by POCatalog's parser
@@ -1115,6 +1477,10 @@ CatalogPtr Catalog::Create(const wxString& filename, int flags)
     {
         cat = JSONCatalog::Open(filename);
     }
+    else if (MOCatalog::CanLoadFile(ext))
+    {
+        cat = MOCatalog::Open(filename);
+    }
 
     if (!cat)
         throw Exception(_("The file is in a format not recognized by Poedit."));
@@ -1126,7 +1492,21 @@ CatalogPtr Catalog::Create(const wxString& filename, int flags)
     }
 
     cat->SetFileName(filename);
-    cat->PostCreation();
+    {
+        perf::ScopedTimer postCreationTimer("Catalog::PostCreation");
+        cat->PostCreation();
+    }
+
+    timer.SetItemsCount(cat->GetCount());
+    perf::RecordPeakMemoryUsage();
+
+    if (wxLog::IsAllowedTraceMask("poedit.perf"))
+    {
+        std::istringstream ss(cat->GetMemoryUsage().Report());
+        std::string line;
+        while (std::getline(ss, line))
+            wxLogTrace("poedit.perf", "memory used by %s: %s", wxFileName(filename).GetFullName(), line);
+    }
 
     return cat;
 }
@@ -1137,32 +1517,27 @@ bool Catalog::CanLoadFile(const wxString& extension_)
 
     return POCatalog::CanLoadFile(extension) ||
            XLIFFCatalog::CanLoadFile(extension) ||
-           JSONCatalog::CanLoadFile(extension);
+           JSONCatalog::CanLoadFile(extension) ||
+           MOCatalog::CanLoadFile(extension);
 }
 
 
-void Catalog::SideloadSourceDataFromReferenceFile(CatalogPtr ref)
+const wxString& CatalogItem::GetSideloadedPluralString() const
 {
-    std::map<wxString, CatalogItemPtr> refItems;
-
-    for (auto iref: ref->items())
-        refItems[iref->GetRawString()] = iref;
+    static const wxString s_empty;
+    auto& translations = m_sideloaded->m_translations;
+    return (m_sideloaded->HasPlural() && translations.size() > 1) ? translations[1] : s_empty;
+}
 
+void Catalog::SideloadSourceDataFromReferenceFile(CatalogPtr ref)
+{
     for (auto i: this->items())
     {
-        auto ri = refItems.find(i->GetRawString());
-        if (ri == refItems.end())
+        auto index = ref->FindItemIndexByString(i->GetRawString(), i->HasContext(), i->GetContext());
+        if (index == -1)
             continue;
 
-        auto& rdata = *ri->second;
-        auto d = std::make_shared<SideloadedItemData>();
-        d->source_string = rdata.GetTranslation();
-        if (rdata.HasPlural())
-            d->source_plural_string = rdata.GetTranslation(1);
-        if (rdata.HasExtractedComments())
-            d->extracted_comments = rdata.GetExtractedComments();
-
-        i->AttachSideloadedData(d);
+        i->AttachSideloadedData(ref->items()[index]);
     }
 
     m_sideloaded = std::make_shared<SideloadedCatalogData>();
@@ -1170,6 +1545,44 @@ void Catalog::SideloadSourceDataFromReferenceFile(CatalogPtr ref)
     m_sideloaded->source_language = ref->GetLanguage();
 }
 
+CatalogPtr Catalog::CreateSharedReferenceFile(const wxString& filename)
+{
+    struct CachedRef
+    {
+        std::weak_ptr<Catalog> catalog;
+        time_t mtime;
+    };
+    static std::mutex s_mutex;
+    static std::map<wxString, CachedRef> s_cache;
+
+    const auto path = wxFileName(filename).GetFullPath();
+    const auto mtime = wxFileModificationTime(path);
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    auto& cached = s_cache[path];
+    if (auto cat = cached.catalog.lock())
+    {
+        if (cached.mtime == mtime)
+            return cat;
+    }
+
+    auto cat = Create(path);
+    cached.catalog = cat;
+    cached.mtime = mtime;
+
+    // prune entries of no longer used files:
+    for (auto i = s_cache.begin(); i != s_cache.end(); )
+    {
+        if (i->second.catalog.expired())
+            i = s_cache.erase(i);
+        else
+            ++i;
+    }
+
+    return cat;
+}
+
 void Catalog::ClearSideloadedSourceData()
 {
     m_sideloaded.reset();
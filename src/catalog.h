@@ -26,16 +26,19 @@
 #ifndef Poedit_catalog_h
 #define Poedit_catalog_h
 
+#include "concurrency.h"
 #include "language.h"
 
 #include <wx/encconv.h>
 #include <wx/arrstr.h>
 #include <wx/textfile.h>
 
+#include <atomic>
 #include <initializer_list>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
 class CloudSyncDestination;
@@ -48,20 +51,36 @@ typedef std::shared_ptr<Catalog> CatalogPtr;
 
 
 /**
-    Optional data attached to CatalogItem.
+    Estimate of memory used by a catalog, in bytes, by category.
 
-    Used primarily in connection wiht UsesSymbolicIDsForSource() to provide
-    read source strings.
+    See Catalog::GetMemoryUsage(). The numbers are approximations that ignore
+    allocator overhead and spare capacity, but are good enough to compare
+    files and to see which parts of the data dominate.
  */
-struct SideloadedItemData
+struct CatalogMemoryUsage
 {
-    /// Source string replacement
-    wxString source_string, source_plural_string;
+    size_t items = 0;       ///< CatalogItem objects themselves
+    size_t strings = 0;     ///< strings' content (texts, translations, comments, ...)
+    size_t arrays = 0;      ///< storage of string arrays, excluding the strings
+    size_t issues = 0;      ///< validation and QA issues
+    size_t fileData = 0;    ///< format-specific data kept for saving (e.g. XML or JSON documents)
+
+    size_t Total() const { return items + strings + arrays + issues + fileData; }
+
+    /// Adds memory used by string's content
+    void AddString(const wxString& s) { strings += StringBytes(s); }
+
+    /// Adds memory used by string array, including its strings
+    void AddStrings(const wxArrayString& a);
 
-    /// Extracted comments / description (used by 
-    wxArrayString extracted_comments;
+    /// Returns estimate of memory used by string's content
+    static size_t StringBytes(const wxString& s);
+
+    /// Returns human-readable multiline report
+    std::string Report() const;
 };
 
+
 /**
     Optional data attached to Catalog.
 
@@ -75,6 +94,18 @@ struct SideloadedCatalogData
 };
 
 
+/**
+    Running counts of items in various states, shared by Catalog and its items.
+
+    Items update the counters as their state changes, so that
+    Catalog::GetStatistics() doesn't have to iterate over all of them.
+ */
+struct CatalogStatsCounters
+{
+    std::atomic<int> fuzzy {0}, badtokens {0}, untranslated {0}, unfinished {0};
+};
+
+
 /** This class holds information about one particular string.
     This includes source string and its occurrences in source code
     (so-called references), translation and translation's status
@@ -88,13 +119,14 @@ class CatalogItem
         /// Ctor. Initializes the object with source string and translation.
         CatalogItem()
                 : m_id(0),
+                  m_lineNum(0),
                   m_hasPlural(false),
                   m_hasContext(false),
                   m_isFuzzy(false),
                   m_isTranslated(false),
                   m_isModified(false),
                   m_isPreTranslated(false),
-                  m_lineNum(0)
+                  m_inStatsUpdate(false)
         {}
 
         CatalogItem(const CatalogItem&) = delete;
@@ -119,10 +151,10 @@ class CatalogItem
         bool HasSymbolicId() const { return !GetSymbolicId().empty(); }
 
         /// Returns the source string.
-        const wxString& GetString() const { return m_sideloaded ? m_sideloaded->source_string : GetRawString(); }
+        const wxString& GetString() const { return m_sideloaded ? m_sideloaded->GetTranslation() : GetRawString(); }
 
         /// Returns the plural string.
-        const wxString& GetPluralString() const { return m_sideloaded ? m_sideloaded->source_plural_string : GetRawPluralString(); }
+        const wxString& GetPluralString() const { return m_sideloaded ? GetSideloadedPluralString() : GetRawPluralString(); }
 
         /// Does this entry have a msgid_plural?
         bool HasPlural() const { return m_hasPlural; }
@@ -158,7 +190,7 @@ class CatalogItem
         const wxString& GetComment() const { return m_comment; }
 
         /// Returns array of all auto comments.
-        const wxArrayString& GetExtractedComments() const { return m_sideloaded ? m_sideloaded->extracted_comments : m_extractedComments; }
+        const wxArrayString& GetExtractedComments() const { return m_sideloaded ? m_sideloaded->m_extractedComments : m_extractedComments; }
 
         /// Convenience function: does this entry has a comment?
         bool HasComment() const { return !m_comment.empty(); }
@@ -187,6 +219,11 @@ class CatalogItem
         /// Get line number of this entry.
         int GetLineNumber() const { return m_lineNum; }
 
+        /// Returns key identifying the entry in the file, i.e. its context and
+        /// raw source string combined (like gettext's msgctxt\004msgid)
+        std::wstring GetLookupKey() const { return MakeLookupKey(m_string, m_hasContext, m_context); }
+        static std::wstring MakeLookupKey(const wxString& str, bool hasContext, const wxString& context);
+
         const wxArrayString& GetOldMsgidRaw() const { return m_oldMsgid; }
         wxString GetOldMsgid() const;
         bool HasOldMsgid() const { return !m_oldMsgid.empty(); }
@@ -213,14 +250,14 @@ class CatalogItem
         /// Sets fuzzy flag.
         void SetFuzzy(bool fuzzy);
         /// Sets translated flag.
-        void SetTranslated(bool t) { m_isTranslated = t; }
+        void SetTranslated(bool t) { StatsUpdate upd(*this); m_isTranslated = t; }
         /// Sets modified flag.
         void SetModified(bool modified) { m_isModified = modified; }
         /// Sets pre-translated translation flag.
         void SetPreTranslated(bool pre) { m_isPreTranslated = pre; }
 
         /// Sets the comment.
-        void SetComment(const wxString& c) { m_comment = c; }
+        void SetComment(const wxString& c) { m_comment = c; m_revision++; }
 
 
         // -------------------------------------------------------------------
@@ -246,14 +283,25 @@ class CatalogItem
         bool HasError() const { return m_issue && m_issue->severity == Issue::Error; }
         const std::shared_ptr<Issue>& GetIssue() const { return m_issue; }
 
-        void ClearIssue() { m_issue.reset(); }
-        void SetIssue(std::shared_ptr<Issue> issue) { m_issue = issue; }
-        void SetIssue(const Issue& issue) { m_issue = std::make_shared<Issue>(issue); }
-        void SetIssue(Issue::Severity severity, const wxString& message) { m_issue = std::make_shared<Issue>(severity, message); }
+        void ClearIssue() { StatsUpdate upd(*this); m_issue.reset(); }
+        void SetIssue(std::shared_ptr<Issue> issue) { StatsUpdate upd(*this); m_issue = issue; }
+        void SetIssue(const Issue& issue) { StatsUpdate upd(*this); m_issue = std::make_shared<Issue>(issue); }
+        void SetIssue(Issue::Severity severity, const wxString& message) { StatsUpdate upd(*this); m_issue = std::make_shared<Issue>(severity, message); }
 
-        void AttachSideloadedData(const std::shared_ptr<SideloadedItemData>& d) { m_sideloaded = d; }
+        /// Uses translation of @a ref item from a reference file as the source text
+        void AttachSideloadedData(const CatalogItemPtr& ref) { m_sideloaded = ref; }
         void ClearSideloadedData() { m_sideloaded.reset(); }
 
+        /// Counter incremented whenever the item's translations or comment change
+        unsigned GetRevision() const { return m_revision; }
+
+        /// Adds estimate of memory used by the item to @a usage.
+        virtual void AddMemoryUsage(CatalogMemoryUsage& usage) const;
+
+        /// Fingerprint of the content last stored into the translation memory (0 if none)
+        size_t GetTMSyncFingerprint() const { return m_tmSyncFingerprint; }
+        void SetTMSyncFingerprint(size_t fp) { m_tmSyncFingerprint = fp; }
+
     protected:
         // API for subclasses:
         virtual void UpdateInternalRepresentation() = 0;
@@ -290,6 +338,8 @@ class CatalogItem
             m_extractedComments.Add(com);
         }
 
+        void SetExtractedComments(const wxArrayString& comments) { m_extractedComments = comments; }
+
         void SetOldMsgid(const wxArrayString& data) { m_oldMsgid = data; }
 
         /** Sets gettext flags directly in string format. It may be
@@ -299,26 +349,93 @@ class CatalogItem
          */
         void SetFlags(const wxString& flags);
 
+        /// Copies all data except for statistics counters from @a other,
+        /// which must be a freshly created item (used for catalog snapshots).
+        void CopyContentFrom(const CatalogItem& other);
+
+    private:
+        // State bits counted in CatalogStatsCounters:
+        enum StatsState
+        {
+            Stats_Fuzzy         = 1,
+            Stats_Error         = 2,
+            Stats_Untranslated  = 4
+        };
+        unsigned GetStatsState() const;
+        void UpdateStatsCounters(unsigned oldState);
+
+        // Scope guard that updates attached statistics counters after a change
+        // to the item's state; only the outermost one of nested guards counts.
+        class StatsUpdate
+        {
+        public:
+            StatsUpdate(CatalogItem& item) : m_item(item.m_inStatsUpdate ? nullptr : &item)
+            {
+                if (m_item)
+                {
+                    m_item->m_inStatsUpdate = true;
+                    m_oldState = m_item->GetStatsState();
+                }
+            }
+            ~StatsUpdate()
+            {
+                if (m_item)
+                {
+                    m_item->m_inStatsUpdate = false;
+                    m_item->UpdateStatsCounters(m_oldState);
+                }
+            }
+
+        private:
+            CatalogItem *m_item;
+            unsigned m_oldState = 0;
+        };
+
+        friend class Catalog;
+        friend class QAChecker;
+
     protected:
+        // Note that the scalar members are grouped together and flags packed
+        // into bits to keep the size of the object (of which there may be
+        // hundreds of thousands) down.
         int m_id;
+        int m_lineNum;
 
-        wxString m_string, m_plural;
-        bool m_hasPlural;
+        bool m_hasPlural : 1;
+        bool m_hasContext : 1;
+        bool m_isFuzzy : 1;
+        bool m_isTranslated : 1;
+        bool m_isModified : 1;
+        bool m_isPreTranslated : 1;
+        bool m_inStatsUpdate : 1;
 
-        bool m_hasContext;
+        wxString m_string, m_plural;
         wxString m_context;
 
         wxArrayString m_translations;
 
         wxArrayString m_extractedComments;
         wxArrayString m_oldMsgid;
-        bool m_isFuzzy, m_isTranslated, m_isModified, m_isPreTranslated;
         wxString m_moreFlags;
         wxString m_comment;
-        int m_lineNum;
 
         std::shared_ptr<Issue> m_issue;
-        std::shared_ptr<SideloadedItemData> m_sideloaded;
+        // item of the reference file providing source text, see
+        // Catalog::SideloadSourceDataFromReferenceFile(); its strings are
+        // shared with the reference file rather than copied:
+        CatalogItemPtr m_sideloaded;
+        const wxString& GetSideloadedPluralString() const;
+        std::atomic<size_t> m_tmSyncFingerprint {0};
+        unsigned m_revision = 0;
+
+        // result of the last QA check and fingerprint of the content it was
+        // done for (0 if never checked), see QAChecker::Check():
+        size_t m_qaFingerprint = 0;
+        std::shared_ptr<Issue> m_qaIssue;
+
+        // accessed with std::atomic_load/store, because Catalog may attach
+        // counters while the item is being modified on another thread:
+        std::shared_ptr<CatalogStatsCounters> m_statsCounters;
 };
 
 
@@ -340,7 +457,8 @@ class Catalog
             POT,
             XLIFF,
             JSON,
-            JSON_FLUTTER
+            JSON_FLUTTER,
+            MO
         };
 
         /// Capabilities of the file type
@@ -484,14 +602,58 @@ class Catalog
          */
         virtual std::string SaveToBuffer() = 0;
 
+        /**
+            Creates a copy of the catalog with its current content, for use
+            by background jobs (e.g. Save() or SaveToBuffer() for uploading)
+            while this catalog continues to be edited on the main thread.
+
+            The snapshot doesn't share any mutable data with this catalog,
+            so it can be used on another thread without any locking. Only
+            one thread may use it at a time.
+
+            Must be called on the thread that modifies the catalog. Returns
+            nullptr if the format doesn't support snapshots.
+         */
+        virtual CatalogPtr CreateSnapshot() const { return CatalogPtr(); }
+
+        /**
+            Updates the catalog with changes done by Save() to @a snapshot,
+            which must have been created from it with CreateSnapshot(), such
+            as the header dates or validation results of items that weren't
+            modified in the meantime.
+         */
+        virtual void AdoptSavedSnapshot(const Catalog& snapshot) { (void)snapshot; }
+
+        /**
+            Returns estimate of memory used by the catalog and its items.
+
+            Must be called on the thread that modifies the catalog. Its cost
+            is proportional to the size of the catalog.
+         */
+        virtual CatalogMemoryUsage GetMemoryUsage() const;
+
         /// File mask for opening/saving this catalog's file type
         wxString GetFileMask() const { return GetTypesFileMask({m_fileType}); }
         /// File mask for opening/saving any supported file type
         static wxString GetTypesFileMask(std::initializer_list<Type> types);
         static wxString GetAllTypesFileMask();
 
+        /// Options for ExportToHTML()
+        struct HTMLExportOptions
+        {
+            /// The catalog only contains the first items of the file
+            /// (see POCatalog::CreatePreview()), note it in the output.
+            bool truncated;
+            /// Statistics of the whole file, used instead of the catalog's
+            /// own if @a all is not negative.
+            int all, fuzzy, untranslated;
+
+            HTMLExportOptions() : truncated(false), all(-1), fuzzy(0), untranslated(0) {}
+        };
+
         /// Exports the catalog to HTML format
-        void ExportToHTML(std::ostream& output);
+        void ExportToHTML(std::ostream& output) { ExportToHTML(output, HTMLExportOptions()); }
+        void ExportToHTML(std::ostream& output, const HTMLExportOptions& options);
 
         Type GetFileType() const { return m_fileType; }
 
@@ -520,9 +682,23 @@ class Catalog
 
         /**
             Returns true if the source code to update the PO from is available.
+
+            The result of probing the file system is cached, because the checks
+            can be slow (e.g. on network shares). It is reused until relevant
+            headers or the filename change or InvalidateSourcesAvailability()
+            is called.
          */
         bool HasSourcesAvailable() const;
 
+        /**
+            Asynchronous version of HasSourcesAvailable(), never blocks on
+            file system access. The result is cached in the same way.
+         */
+        dispatch::future<bool> HasSourcesAvailableAsync() const;
+
+        /// Forgets cached result of HasSourcesAvailable(), e.g. after changes on disk.
+        void InvalidateSourcesAvailability();
+
         std::shared_ptr<SourceCodeSpec> GetSourceCodeSpec() const;
 
         /// Returns the number of strings/translations in the catalog.
@@ -537,6 +713,9 @@ class Catalog
             Any argument may be NULL if the caller is not interested in
             given statistic value.
 
+            The counts are computed once and then kept up to date as items
+            change, so this is cheap to call.
+
             @note "untranslated" are entries without translation; "unfinished"
                   are entries with any problems
          */
@@ -581,6 +760,12 @@ class Catalog
         /// Finds catalog index by line number
         int FindItemIndexByLine(int lineno);
 
+        /// Finds item by its raw source string (or symbolic ID) and context
+        CatalogItemPtr FindItemByString(const wxString& str, bool hasContext = false, const wxString& context = wxString());
+
+        /// Finds catalog index by raw source string and context, returns -1 if not found
+        int FindItemIndexByString(const wxString& str, bool hasContext = false, const wxString& context = wxString());
+
 
         /// Validates correctness of the translation by running msgfmt
         /// Returns number of errors (i.e. 0 if no errors).
@@ -597,10 +782,23 @@ class Catalog
             return the ID, but will instead return as source text the translation from @a ref
             (typically you'll want that file to be for English).
 
-            Attaches data from the @a ref file to this one,
+            Attaches data from the @a ref file to this one, sharing it with
+            other catalogs that use the same @a ref.
          */
         void SideloadSourceDataFromReferenceFile(CatalogPtr ref);
 
+        /**
+            Loads reference file for SideloadSourceDataFromReferenceFile().
+
+            If the file is already loaded and used by another catalog (and
+            wasn't modified since), that instance is returned instead, so that
+            e.g. files for many languages of the same project share a single
+            copy of the source text data.
+
+            Throws on failure, like Create().
+         */
+        static CatalogPtr CreateSharedReferenceFile(const wxString& filename);
+
         /// Undo the effect of SideloadSourceDataFromReferenceFile()
         void ClearSideloadedSourceData();
 
@@ -614,6 +812,10 @@ class Catalog
         /// Perform post-creation processing to e.g. fixup issues, detect missing language etc.
         virtual void PostCreation();
 
+        /// Must be called after adding, removing or reordering items or changing
+        /// their source strings, so that lookup indexes and statistics are rebuilt.
+        void InvalidateItemsIndex() { m_itemsIndex.reset(); m_statsCounters.reset(); }
+
     protected:
         CatalogItemArray m_items;
 
@@ -625,6 +827,20 @@ class Catalog
 
         std::shared_ptr<CloudSyncDestination> m_cloudSync;
         std::shared_ptr<SideloadedCatalogData> m_sideloaded;
+
+        // Lazily built indexes for FindItemIndexByLine() and FindItemIndexByString():
+        struct ItemsIndex;
+        std::shared_ptr<ItemsIndex> m_itemsIndex;
+        ItemsIndex& GetItemsIndex();
+
+        // Cached result of HasSourcesAvailable(), shared with background probes:
+        struct SourcesAvailabilityCache;
+        std::shared_ptr<SourcesAvailabilityCache> m_sourcesAvailability;
+
+        // Counters for GetStatistics(), attached to all items in m_items:
+        std::shared_ptr<CatalogStatsCounters> m_statsCounters;
+        const CatalogItemPtr *m_statsItemsData = nullptr;
+        size_t m_statsItemsSize = 0;
 };
 
 #endif // Poedit_catalog_h
@@ -26,6 +26,7 @@
 #include "catalog_json.h"
 
 #include "configuration.h"
+#include "perf_trace.h"
 #include "str_helpers.h"
 #include "utility.h"
 
@@ -34,6 +35,8 @@
 
 #include <boost/algorithm/string.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <map>
 #include <memory>
@@ -43,19 +46,39 @@
 namespace
 {
 
+// Reads entire file into memory, so that it can be both parsed and inspected without re-reading
+std::string ReadFileContent(const wxString& filename)
+{
+    std::ifstream f(filename.fn_str(), std::ios::binary);
+    std::string data;
+    if (f.seekg(0, std::ios::end))
+    {
+        auto size = f.tellg();
+        if (size > 0)
+        {
+            data.resize((size_t)size);
+            f.seekg(0, std::ios::beg);
+            f.read(&data[0], size);
+            data.resize((size_t)f.gcount());
+        }
+    }
+    return data;
+}
+
 // Try to determine JSON file's formatting, i.e. line endings and identation, by inspecting the
 // beginning of the file.
-void DetectFileFormatting(std::ifstream& f, int& indent, char& indent_char, bool& dos_line_endings)
+void DetectFileFormatting(const std::string& data, int& indent, char& indent_char, bool& dos_line_endings)
 {
     // fallback defaults: compact representation with no indentation
     indent = -1;
     indent_char = ' ';
     dos_line_endings = false;
 
-    for (int counter = 0; counter < 100; ++counter)
+    const size_t len = std::min(data.size(), size_t(100));
+    for (size_t i = 0; i < len; ++i)
     {
-        auto c = f.get();
-        if (c == '\r' && f.peek() == '\n')
+        auto c = data[i];
+        if (c == '\r' && i + 1 < data.size() && data[i + 1] == '\n')
         {
             dos_line_endings = true;
         }
@@ -70,7 +93,7 @@ void DetectFileFormatting(std::ifstream& f, int& indent, char& indent_char, bool
             {
                 // we're past the newline, identifying whitespace leading to the first "
                 indent++;
-                indent_char = (char)c; // ignore weirdnesses like mixed whitespace
+                indent_char = c; // ignore weirdnesses like mixed whitespace
             }
         }
         else if  (c == '"')
@@ -81,6 +104,86 @@ void DetectFileFormatting(std::ifstream& f, int& indent, char& indent_char, bool
     }
 }
 
+
+inline void hash_combine(size_t& seed, size_t value)
+{
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+// Collects all scalar values in document order and computes hash of the
+// document's structure, i.e. everything except for string values
+void CollectValues(const JSONCatalog::json_t& node, size_t& shape, std::vector<const JSONCatalog::json_t*>& values)
+{
+    hash_combine(shape, (size_t)node.type());
+    if (node.is_object())
+    {
+        hash_combine(shape, node.size());
+        for (auto& el: node.items())
+        {
+            hash_combine(shape, std::hash<std::string>()(el.key()));
+            CollectValues(el.value(), shape, values);
+        }
+    }
+    else if (node.is_array())
+    {
+        hash_combine(shape, node.size());
+        for (auto& el: node)
+            CollectValues(el, shape, values);
+    }
+    else
+    {
+        if (!node.is_string())
+            hash_combine(shape, std::hash<std::string>()(node.dump()));
+        values.push_back(&node);
+    }
+}
+
+// Finds byte ranges of all scalar values (but not object keys) in JSON text,
+// in document order
+bool FindValueSpans(const std::string& data, std::vector<std::pair<size_t, size_t>>& spans)
+{
+    const size_t len = data.size();
+    size_t i = (data.compare(0, 3, "\xEF\xBB\xBF") == 0) ? 3 : 0;  // skip BOM
+    while (i < len)
+    {
+        switch (data[i])
+        {
+            case ' ': case '\t': case '\r': case '\n':
+            case ',': case ':': case '{': case '}': case '[': case ']':
+                i++;
+                break;
+
+            case '"':
+            {
+                const size_t begin = i++;
+                while (i < len && data[i] != '"')
+                    i += (data[i] == '\\') ? 2 : 1;
+                if (i >= len)
+                    return false;
+                i++;
+                // keys are followed by colon:
+                auto next = data.find_first_not_of(" \t\r\n", i);
+                if (next == std::string::npos || data[next] != ':')
+                    spans.emplace_back(begin, i);
+                break;
+            }
+
+            case '\0':
+                return false;
+
+            default:  // numbers and literals
+            {
+                const size_t begin = i;
+                while (i < len && !strchr(" \t\r\n,:{}[]\"", data[i]))
+                    i++;
+                spans.emplace_back(begin, i);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
 } // anonymous namespace
 
 
@@ -117,22 +220,25 @@ bool JSONCatalog::CanLoadFile(const wxString& extension)
 
 std::shared_ptr<JSONCatalog> JSONCatalog::Open(const wxString& filename)
 {
+    perf::ScopedTimer timer("JSONCatalog::Open");
     try
     {
         const auto ext = str::to_utf8(wxFileName(filename).GetExt().Lower());
-        std::ifstream f(filename.fn_str(), std::ios::binary);
-        auto data = json_t::parse(f);
+        // parsing from memory is much faster than from std::istream and lets us
+        // detect formatting without reading the file again:
+        auto content = ReadFileContent(filename);
+        auto data = json_t::parse(content);
 
         auto cat = CreateForJSON(std::move(data), ext);
         if (!cat)
             throw JSONUnrecognizedFileException();
 
-        f.clear();
-        f.seekg(0, std::ios::beg);
-        DetectFileFormatting(f, cat->m_formatting.indent, cat->m_formatting.indent_char, cat->m_formatting.dos_line_endings);
+        DetectFileFormatting(content, cat->m_formatting.indent, cat->m_formatting.indent_char, cat->m_formatting.dos_line_endings);
 
         cat->Parse();
+        cat->RememberContent(std::move(content));
 
+        timer.SetItemsCount(cat->GetCount());
         return cat;
     }
     catch (json::exception& e)
@@ -146,6 +252,9 @@ bool JSONCatalog::Save(const wxString& filename, bool /*save_mo*/,
                         ValidationResults& validation_results,
                         CompilationStatus& /*mo_compilation_status*/)
 {
+    perf::ScopedTimer timer("JSONCatalog::Save");
+    timer.SetItemsCount(m_items.size());
+
     if ( wxFileExists(filename) && !wxFile::Access(filename, wxFile::write) )
     {
         wxLogError(_(L"File “%s” is read-only and cannot be saved.\nPlease save it under different name."),
@@ -175,7 +284,14 @@ bool JSONCatalog::Save(const wxString& filename, bool /*save_mo*/,
 
 std::string JSONCatalog::SaveToBuffer()
 {
-    auto s = m_doc.dump(m_formatting.indent, m_formatting.indent_char, /*ensure_ascii=*/false);
+    perf::ScopedTimer timer("JSONCatalog::SaveToBuffer");
+    timer.SetItemsCount(m_items.size());
+
+    std::string s;
+    if (SaveWithOriginalLayout(s))
+        return s;
+
+    s = m_doc.dump(m_formatting.indent, m_formatting.indent_char, /*ensure_ascii=*/false);
     if (s.empty())
         return s; // shouldn't be possible...
 
@@ -187,10 +303,104 @@ std::string JSONCatalog::SaveToBuffer()
     {
         boost::replace_all(s, "\n", "\r\n");
     }
+
+    RememberContent(std::string(s));
     return s;
 }
 
 
+CatalogMemoryUsage JSONCatalog::GetMemoryUsage() const
+{
+    auto usage = Catalog::GetMemoryUsage();
+    // the parsed document isn't included, json doesn't report its memory use
+    usage.fileData += m_content.capacity() + m_valueSpans.capacity() * sizeof(ValueSpan);
+    return usage;
+}
+
+
+void JSONCatalog::RememberContent(std::string&& content)
+{
+    m_content.clear();
+    m_valueSpans.clear();
+    m_contentShape = 0;
+
+    size_t shape = 0;
+    std::vector<const json_t*> values;
+    CollectValues(m_doc, shape, values);
+
+    std::vector<std::pair<size_t, size_t>> spans;
+    spans.reserve(values.size());
+    // this fails e.g. if the file has duplicate keys, which the DOM merges:
+    if (!FindValueSpans(content, spans) || spans.size() != values.size())
+    {
+        wxLogTrace("poedit", "JSON file layout not recognized, will be saved reformatted");
+        return;
+    }
+
+    m_valueSpans.reserve(spans.size());
+    for (size_t i = 0; i < spans.size(); i++)
+    {
+        auto& v = *values[i];
+        const bool isString = content[spans[i].first] == '"';
+        if (isString != v.is_string())
+        {
+            m_valueSpans.clear();
+            return;
+        }
+        m_valueSpans.push_back({spans[i].first, spans[i].second,
+                                isString ? std::hash<std::string>()(v.get_ref<const std::string&>()) : 0});
+    }
+
+    m_content = std::move(content);
+    m_contentShape = shape;
+}
+
+
+bool JSONCatalog::SaveWithOriginalLayout(std::string& out)
+{
+    if (m_content.empty())
+        return false;
+
+    size_t shape = 0;
+    std::vector<const json_t*> values;
+    CollectValues(m_doc, shape, values);
+    if (shape != m_contentShape || values.size() != m_valueSpans.size())
+        return false;
+
+    out.clear();
+    out.reserve(m_content.size() + m_content.size() / 16);
+
+    size_t last = 0;
+    ptrdiff_t offset = 0;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        auto& span = m_valueSpans[i];
+        const size_t oldBegin = span.begin, oldEnd = span.end;
+        span.begin += offset;
+        span.end += offset;
+
+        if (!values[i]->is_string())
+            continue;  // unchanged, as the shape is the same
+        auto& value = values[i]->get_ref<const std::string&>();
+        auto hash = std::hash<std::string>()(value);
+        if (hash == span.hash)
+            continue;
+
+        out.append(m_content, last, oldBegin - last);
+        span.begin = out.size();
+        out.append(json_t(value).dump(-1, ' ', /*ensure_ascii=*/false));
+        span.end = out.size();
+        span.hash = hash;
+        offset += ptrdiff_t(span.end - span.begin) - ptrdiff_t(oldEnd - oldBegin);
+        last = oldEnd;
+    }
+    out.append(m_content, last, std::string::npos);
+
+    m_content = out;
+    return true;
+}
+
+
 class GenericJSONItem : public JSONCatalogItem
 {
 public:
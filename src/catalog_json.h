@@ -81,6 +81,8 @@ public:
 
     std::string SaveToBuffer() override;
 
+    CatalogMemoryUsage GetMemoryUsage() const override;
+
     Language GetLanguage() const override { return m_language; }
     void SetLanguage(Language lang) override { m_language = lang; }
 
@@ -96,6 +98,13 @@ protected:
 private:
     static std::shared_ptr<JSONCatalog> CreateForJSON(json_t&& doc, const std::string& extension);
 
+    /// Remembers serialized form of m_doc for SaveWithOriginalLayout().
+    void RememberContent(std::string&& content);
+
+    /// Saves by replacing only modified string values in the remembered
+    /// content; returns false if the document's structure changed.
+    bool SaveWithOriginalLayout(std::string& out);
+
 protected:
     json_t m_doc;
     Language m_language;
@@ -107,6 +116,17 @@ protected:
         bool dos_line_endings;
     };
     FormattingRules m_formatting;
+
+    // Content of the file as last loaded or saved, with locations of all its
+    // scalar values in document order (and hashes of string ones):
+    struct ValueSpan
+    {
+        size_t begin, end;
+        size_t hash;
+    };
+    std::string m_content;
+    std::vector<ValueSpan> m_valueSpans;
+    size_t m_contentShape = 0;
 };
 
 
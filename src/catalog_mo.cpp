@@ -0,0 +1,243 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2024 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "catalog_mo.h"
+
+#include "perf_trace.h"
+#include "str_helpers.h"
+#include "utility.h"
+
+#include <wx/filename.h>
+#include <wx/intl.h>
+#include <wx/log.h>
+#include <wx/strconv.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+
+namespace
+{
+
+const uint32_t MO_MAGIC = 0x950412de;
+const uint32_t MO_MAGIC_SWAPPED = 0xde120495;
+
+const char CONTEXT_SEPARATOR = '\004';
+
+
+/// Bounds-checked access to MO file content in either byte order.
+class MOReader
+{
+public:
+    MOReader(const char *data, size_t size) : m_data(data), m_size(size), m_swapped(false)
+    {
+        const uint32_t magic = U32(0);
+        if (magic == MO_MAGIC_SWAPPED)
+            m_swapped = true;
+        else if (magic != MO_MAGIC)
+            throw MOFileException(_("This is not a valid MO file."));
+    }
+
+    uint32_t U32(size_t offset) const
+    {
+        if (offset + 4 > m_size || offset + 4 < offset)
+            throw MOFileException(_("The MO file is damaged."));
+        uint32_t x;
+        memcpy(&x, m_data + offset, 4);
+        if (m_swapped)
+            x = ((x & 0xff) << 24) | ((x & 0xff00) << 8) | ((x >> 8) & 0xff00) | (x >> 24);
+        return x;
+    }
+
+    /// Returns string from the table at @a tableOffset as pointer and length (excluding terminating NUL).
+    std::pair<const char*, size_t> String(uint32_t tableOffset, uint32_t index) const
+    {
+        const size_t entry = (size_t)tableOffset + (size_t)index * 8;
+        const uint32_t len = U32(entry);
+        const uint32_t offset = U32(entry + 4);
+        if ((size_t)offset + len > m_size)
+            throw MOFileException(_("The MO file is damaged."));
+        return std::make_pair(m_data + offset, (size_t)len);
+    }
+
+private:
+    const char *m_data;
+    size_t m_size;
+    bool m_swapped;
+};
+
+
+class MOCatalogItem : public CatalogItem
+{
+public:
+    MOCatalogItem(int id, const wxMBConv& conv, const std::pair<const char*, size_t>& orig, const std::pair<const char*, size_t>& trans)
+    {
+        m_id = id;
+
+        const char *begin = orig.first;
+        const char *end = begin + orig.second;
+        auto ctxt = (const char*)memchr(begin, CONTEXT_SEPARATOR, end - begin);
+        if (ctxt)
+        {
+            m_hasContext = true;
+            m_context = Decode(conv, begin, ctxt);
+            begin = ctxt + 1;
+        }
+        auto plural = (const char*)memchr(begin, '\0', end - begin);
+        m_string = Decode(conv, begin, plural ? plural : end);
+        if (plural)
+        {
+            m_hasPlural = true;
+            m_plural = Decode(conv, plural + 1, end);
+        }
+
+        // translations of plural forms are separated by NULs:
+        const char *t = trans.first;
+        const char *tend = t + trans.second;
+        for (;;)
+        {
+            auto sep = (const char*)memchr(t, '\0', tend - t);
+            m_translations.push_back(Decode(conv, t, sep ? sep : tend));
+            if (!sep)
+                break;
+            t = sep + 1;
+        }
+
+        m_isTranslated = false;
+        for (auto& tr: m_translations)
+        {
+            if (!tr.empty())
+                m_isTranslated = true;
+        }
+    }
+
+    wxArrayString GetReferences() const override { return wxArrayString(); }
+
+protected:
+    void UpdateInternalRepresentation() override {} // read-only
+
+private:
+    static wxString Decode(const wxMBConv& conv, const char *begin, const char *end)
+    {
+        return begin == end ? wxString() : wxString(begin, conv, end - begin);
+    }
+};
+
+} // anonymous namespace
+
+
+bool MOCatalog::HasCapability(Catalog::Cap cap) const
+{
+    switch (cap)
+    {
+        case Cap::Translations:
+            return true;
+        case Cap::LanguageSetting:
+        case Cap::UserComments:
+        case Cap::FuzzyTranslations:
+            return false;
+    }
+    return false; // silence VC++ warning
+}
+
+
+bool MOCatalog::CanLoadFile(const wxString& extension)
+{
+    return extension == "mo";
+}
+
+
+std::shared_ptr<MOCatalog> MOCatalog::Open(const wxString& filename)
+{
+    perf::ScopedTimer timer("MOCatalog::Open");
+
+    MappedFile file(filename);
+    if (!file.IsOk())
+        throw MOFileException(_(L"Couldn’t load the file, it is probably damaged."));
+
+    std::shared_ptr<MOCatalog> cat(new MOCatalog);
+    cat->Parse(file.data(), file.size());
+
+    timer.SetItemsCount(cat->GetCount());
+    return cat;
+}
+
+
+void MOCatalog::Parse(const char *data, size_t size)
+{
+    MOReader r(data, size);
+    const uint32_t revision = r.U32(4);
+    if ((revision >> 16) > 1) // only major revisions 0 and 1 are defined
+        throw MOFileException(_("This MO file uses an unsupported format version."));
+    const uint32_t count = r.U32(8);
+    const uint32_t origTable = r.U32(12);
+    const uint32_t transTable = r.U32(16);
+    if (count > size / 16) // two 8 bytes long table entries per string
+        throw MOFileException(_("The MO file is damaged."));
+
+    // Strings are sorted, so the header (translation of empty string) comes
+    // first if present. Its charset is needed to decode the rest.
+    uint32_t first = 0;
+    std::pair<const char*, size_t> header;
+    if (count > 0 && r.String(origTable, 0).second == 0)
+    {
+        // decode as ISO-8859-1 first, which is enough to find the charset:
+        header = r.String(transTable, 0);
+        m_header.FromString(wxString(header.first, wxConvISO8859_1, header.second));
+        first = 1;
+    }
+
+    wxString charset = m_header.Charset;
+    if (charset.empty() || charset.CmpNoCase("CHARSET") == 0)
+        charset = "UTF-8";
+    std::unique_ptr<wxMBConv> conv;
+    if (charset.CmpNoCase("UTF-8") == 0 || charset.CmpNoCase("UTF8") == 0)
+        conv.reset(new wxMBConvUTF8);
+    else
+        conv.reset(new wxCSConv(charset));
+    if (!conv->IsOk())
+        throw MOFileException(wxString::Format(_("The MO file uses unsupported charset %s."), charset));
+
+    if (first == 1)
+        m_header.FromString(wxString(header.first, *conv, header.second));
+
+    m_items.reserve(count - first);
+    for (uint32_t i = first; i < count; i++)
+    {
+        m_items.push_back(std::make_shared<MOCatalogItem>(int(i - first + 1), *conv,
+                                                          r.String(origTable, i),
+                                                          r.String(transTable, i)));
+    }
+}
+
+
+bool MOCatalog::Save(const wxString& /*filename*/, bool /*save_mo*/,
+                     ValidationResults& /*validation_results*/,
+                     CompilationStatus& /*mo_compilation_status*/)
+{
+    wxLogError(_(L"Compiled MO files can’t be saved. Please open the PO file they were made from to make changes."));
+    return false;
+}
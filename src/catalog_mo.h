@@ -0,0 +1,77 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2023 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_catalog_mo_h
+#define Poedit_catalog_mo_h
+
+#include "catalog.h"
+#include "errors.h"
+
+
+class MOFileException : public Exception
+{
+public:
+    MOFileException(const wxString& what) : Exception(what) {}
+};
+
+
+/**
+    Read-only catalog of compiled gettext MO file.
+
+    The file is memory-mapped and its string tables are decoded directly
+    from the mapping, without decompiling it with msgunfmt first. This lets
+    deployed translations be viewed and searched, but they can't be saved
+    back, because MO files lack most of the information PO files have.
+ */
+class MOCatalog : public Catalog
+{
+public:
+    ~MOCatalog() {}
+
+    bool HasCapability(Cap cap) const override;
+
+    static bool CanLoadFile(const wxString& extension);
+    wxString GetPreferredExtension() const override { return "mo"; }
+
+    /// Loads MO file; throws Exception on failure.
+    static std::shared_ptr<MOCatalog> Open(const wxString& filename);
+
+    /// Always fails, MO files can't be edited.
+    bool Save(const wxString& filename, bool save_mo,
+              ValidationResults& validation_results,
+              CompilationStatus& mo_compilation_status) override;
+
+    std::string SaveToBuffer() override { return std::string(); }
+
+    bool HasDeletedItems() const override { return false; }
+    void RemoveDeletedItems() override {}
+
+protected:
+    MOCatalog() : Catalog(Type::MO) {}
+
+    void Parse(const char *data, size_t size);
+};
+
+#endif // Poedit_catalog_mo_h
@@ -25,10 +25,12 @@
 
 #include "catalog_po.h"
 
+#include "concurrency.h"
 #include "configuration.h"
 #include "errors.h"
 #include "extractors/extractor.h"
 #include "gexecute.h"
+#include "perf_trace.h"
 #include "str_helpers.h"
 #include "utility.h"
 #include "version.h"
@@ -45,10 +47,25 @@
 #include <wx/stdpaths.h>
 #include <wx/strconv.h>
 #include <wx/memtext.h>
+#include <wx/file.h>
 #include <wx/filename.h>
-
-#include <set>
+#include <wx/thread.h>
+#include <wx/wfstream.h>
+#include <wx/zstream.h>
+
+#include <string.h>
+#include <cstdint>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <string_view>
 #include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 #ifdef __WXOSX__
 #import <Foundation/Foundation.h>
@@ -115,47 +132,753 @@ bool ReadParam(const wxString& input, const wxString& pattern, wxString& output,
 }
 
 
-// Checks if the file was loaded correctly, i.e. that non-empty lines
-// ended up non-empty in memory, after doing charset conversion in
-// wxTextFile. This detects for example files that claim they are in UTF-8
-// while in fact they are not.
-bool VerifyFileCharset(const wxTextFile& f, const wxString& filename,
-                       const wxString& charset)
+/**
+    Table-driven converter for single-byte charsets (ISO-8859-x, CP125x,
+    KOI8-x), which are by far the most common non-UTF-8 charsets used in PO
+    files.
+
+    Converting through wxCSConv goes through iconv (or the OS equivalent)
+    for every line, which is several times slower than a plain table lookup.
+    The tables are built from wxCSConv itself, one byte at a time, so the
+    result is exactly the same as converting through it.
+ */
+class SingleByteCharset
 {
-    wxTextFile f2;
+public:
+    /// Returns converter for @a charset or nullptr if it is not a known single-byte charset.
+    static std::shared_ptr<const SingleByteCharset> Get(const wxString& charset)
+    {
+        const wxString name = charset.Upper();
+        if (!IsSingleByte(name))
+            return nullptr;
+
+        static std::mutex s_mutex;
+        static std::map<wxString, std::shared_ptr<const SingleByteCharset>> s_cache;
+        std::lock_guard<std::mutex> lock(s_mutex);
+        auto i = s_cache.find(name);
+        if (i != s_cache.end())
+            return i->second;
+
+        std::shared_ptr<SingleByteCharset> conv(new SingleByteCharset);
+        if (!conv->Init(name))
+            conv.reset();
+        s_cache[name] = conv;
+        return conv;
+    }
 
-    if (!f2.Open(filename, wxConvISO8859_1))
-        return false;
+    /// Decodes @a line; returns false if it contains bytes undefined in the charset.
+    bool Decode(const char *line, size_t len, wxString& out) const
+    {
+        std::wstring buf;
+        buf.resize(len);
+        for (size_t i = 0; i < len; i++)
+        {
+            const wchar_t c = m_decode[(unsigned char)line[i]];
+            if (c == UNDEFINED)
+                return false;
+            buf[i] = c;
+        }
+        out = buf;
+        return true;
+    }
 
-    if (f.GetLineCount() != f2.GetLineCount())
+    /**
+        Appends @a line encoded in the charset to @a out. Characters that
+        can't be represented are replaced with '?'.
+
+        @return false if some characters couldn't be encoded.
+     */
+    bool Encode(const wxString& line, std::string& out) const
     {
-        int linesCount = (int)f2.GetLineCount() - (int)f.GetLineCount();
-        wxLogError(wxPLURAL(L"%i line of file “%s” was not loaded correctly.",
-                            L"%i lines of file “%s” were not loaded correctly.",
-                            linesCount),
-                   linesCount,
-                   filename.c_str());
-        return false;
+        bool ok = true;
+        const size_t start = out.size();
+        out.resize(start + line.length());
+        char *dest = &out[start];
+        for (wxString::const_iterator i = line.begin(); i != line.end(); ++i)
+        {
+            const wxUniChar::value_type c = (*i).GetValue();
+            if (c < 0x80)
+            {
+                *dest++ = (char)c;
+                continue;
+            }
+            auto e = m_encode.find(c);
+            if (e != m_encode.end())
+            {
+                *dest++ = e->second;
+            }
+            else
+            {
+                *dest++ = '?';
+                ok = false;
+            }
+        }
+        out.resize(dest - out.data());
+        return ok;
+    }
+
+private:
+    static const wchar_t UNDEFINED = 0xFFFF; // noncharacter, never decoded from anything
+
+    SingleByteCharset() {}
+
+    static bool IsSingleByte(const wxString& name)
+    {
+        wxString rest;
+        if (name.StartsWith("ISO-8859-", &rest) || name.StartsWith("ISO8859-", &rest))
+            return rest.IsNumber();
+        if (name.StartsWith("CP125", &rest) || name.StartsWith("WINDOWS-125", &rest))
+            return rest.length() == 1 && wxIsdigit(rest[0]);
+        return name == "KOI8-R" || name == "KOI8-U" || name == "ASCII" || name == "US-ASCII";
+    }
+
+    bool Init(const wxString& charset)
+    {
+        wxCSConv conv(charset);
+        if (!conv.IsOk())
+            return false;
+
+        // all of the supported charsets are ASCII-compatible:
+        for (unsigned b = 0; b < 0x80; b++)
+            m_decode[b] = (wchar_t)b;
+
+        for (unsigned b = 0x80; b < 0x100; b++)
+        {
+            const char byte = (char)b;
+            wchar_t c = UNDEFINED;
+            wchar_t buf[2];
+            if (conv.ToWChar(buf, 2, &byte, 1) == 1)
+                c = buf[0];
+            m_decode[b] = c;
+            if (c != UNDEFINED && c >= 0x80)
+                m_encode.emplace(c, byte);
+        }
+        return true;
     }
 
-    bool ok = true;
-    size_t cnt = f.GetLineCount();
-    for (size_t i = 0; i < cnt; i++)
+    wchar_t m_decode[256];
+    std::unordered_map<wxUniChar::value_type, char> m_encode;
+};
+
+} // anonymous namespace
+
+
+/**
+    Content of a PO file, read into memory just once and decoded into lines
+    as needed.
+
+    Unlike wxTextFile, which decodes the whole file into a single string and
+    only then splits it into lines, this splits raw bytes and decodes each
+    line separately. This lets us detect the charset from just the header
+    without decoding the rest of the file and it reports lines that are not
+    valid in the file's charset without having to load the file again.
+ */
+class POFileData
+{
+public:
+    POFileData(const wxString& filename) : m_filename(filename), m_ok(false)
     {
-        if (f[i].empty() && !f2[i].empty()) // wxMBConv conversion failed
+        if (POCatalog::IsCompressedFileName(filename))
+        {
+            m_ok = ReadCompressed(filename);
+            return;
+        }
+
+        wxFile f;
         {
-            wxLogError(
-                _(L"Line %d of file “%s” is corrupted (not valid %s data)."),
-                int(i), filename.c_str(), charset.c_str());
-            ok = false;
+            wxLogNull null;
+            if (!f.Open(filename))
+                return;
         }
+        auto len = f.Length();
+        if (len < 0)
+            return;
+        m_data.resize((size_t)len);
+        if (len > 0 && f.Read(&m_data[0], (size_t)len) != (ssize_t)len)
+            return;
+        m_ok = true;
     }
 
-    return ok;
-}
+    /// Uses data already in memory, e.g. output of a gettext tool.
+    POFileData(std::string&& data, const wxString& filename)
+        : m_filename(filename), m_data(std::move(data)), m_ok(true)
+    {}
+
+    bool IsOk() const { return m_ok; }
+
+    /// Decodes the first entry of the file (i.e. the header) as ISO-8859-1,
+    /// which is enough to find out the charset it declares.
+    void DecodeHeader(wxMemoryText& out) const
+    {
+        bool seenContent = false;
+        ForEachLine([&](const char *line, size_t len, wxTextFileType type)
+        {
+            if (len == 0)
+                return !seenContent; // stop at the empty line ending the entry
+            seenContent = true;
+            out.AddLine(wxString(line, wxConvISO8859_1, len), type);
+            return true;
+        });
+    }
+
+    /**
+        Decodes all lines of the file using the @a conv charset converter,
+        or with a faster table lookup if @a charset is single-byte.
+
+        @return false if some lines couldn't be decoded; they are reported
+                with wxLogError and left empty.
+     */
+    bool Decode(wxMemoryText& out, const wxMBConv& conv, const wxString& charset) const
+    {
+        // Charset conversion is the most expensive part of loading large files
+        // and lines are independent of each other, so big files are split into
+        // chunks at line boundaries that are decoded in parallel and then
+        // concatenated in order. This is only done from the main thread, because
+        // background loads (e.g. bulk TM imports) are already parallelized and
+        // blocking a pool thread on other pool jobs could starve the pool.
+        auto table = SingleByteCharset::Get(charset);
+        std::vector<DecodedChunk> chunks;
+        const size_t count = (m_data.size() >= PARALLEL_DECODE_MIN_SIZE && wxThread::IsMain())
+                             ? std::max<size_t>(1, std::thread::hardware_concurrency())
+                             : 1;
+        if (count == 1)
+        {
+            chunks.push_back(DecodeChunk(m_data.data(), m_data.data() + m_data.size(), conv, table.get()));
+        }
+        else
+        {
+            std::vector<dispatch::future<DecodedChunk>> jobs;
+            const char *pos = m_data.data();
+            const char *end = pos + m_data.size();
+            for (size_t i = 0; i < count && pos < end; i++)
+            {
+                const char *chunkEnd = end;
+                if (i + 1 < count)
+                {
+                    chunkEnd = std::min(end, pos + m_data.size() / count);
+                    auto eol = (const char*)memchr(chunkEnd, '\n', end - chunkEnd);
+                    chunkEnd = eol ? eol + 1 : end;
+                }
+                // wxMBConv objects aren't safe to share between threads (tables are):
+                std::shared_ptr<wxMBConv> chunkConv(table ? nullptr : conv.Clone());
+                const wxMBConv *jobConv = chunkConv ? chunkConv.get() : &conv;
+                jobs.push_back(dispatch::async([=]{ return DecodeChunk(pos, chunkEnd, *jobConv, table.get()); }));
+                pos = chunkEnd;
+            }
+            for (auto& j: jobs)
+                chunks.push_back(j.get());
+        }
+
+        bool ok = true;
+        for (auto& chunk: chunks)
+        {
+            const size_t firstLine = out.GetLineCount();
+            for (auto& ln: chunk.lines)
+                out.AddLine(ln.first, ln.second);
+            for (auto i: chunk.corrupted)
+            {
+                wxLogError(_(L"Line %d of file “%s” is corrupted (not valid %s data)."),
+                           int(firstLine + i), m_filename.c_str(), charset.c_str());
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    /// Raw, undecoded content of the file.
+    const std::string& GetBytes() const { return m_data; }
+
+    /// Location of a PO entry in the file (see FindEntries()).
+    struct EntryRange
+    {
+        size_t begin, end;  // byte offsets, including line endings
+        int itemLine;       // 0-based index of msgid(_plural) line, as in the parser
+    };
+
+    /**
+        Finds the header and all (non-obsolete) entries in the file.
+
+        Entries are separated by empty lines and comment-only blocks belong
+        to the entry that follows them. Ranges don't include the empty lines
+        between entries.
+
+        @return false if the file isn't laid out regularly enough for the
+                entries to be reliably found this way (e.g. there are no
+                empty lines between them); POCatalogParser can still parse
+                such files, of course.
+     */
+    bool FindEntries(EntryRange& header, std::vector<EntryRange>& entries) const
+    {
+        struct Block
+        {
+            size_t begin = 0, end = 0;
+            int itemLine = -1;
+            bool empty = true;
+            bool obsolete = false;
+            bool context = false;
+            bool translation = false;
+            bool headerMsgid = false;
+        };
+
+        auto startsWith = [](const char *line, size_t len, const char *prefix)
+        {
+            const size_t plen = strlen(prefix);
+            return len >= plen && memcmp(line, prefix, plen) == 0;
+        };
+
+        Block block;
+        bool haveHeader = false;
+        bool ok = true;
+        int lineNum = -1;
+
+        auto finishBlock = [&]
+        {
+            if (block.itemLine == -1)
+            {
+                // Obsolete entries are kept as they are in the file. Comments
+                // without an entry belong to the next one, so keep them.
+                if (block.obsolete)
+                    block = Block();
+                return;
+            }
+            if (block.obsolete || !block.translation)
+            {
+                ok = false;
+            }
+            else if (block.headerMsgid && !block.context)
+            {
+                if (haveHeader || !entries.empty())
+                    ok = false;
+                header = {block.begin, block.end, block.itemLine};
+                haveHeader = true;
+            }
+            else
+            {
+                entries.push_back({block.begin, block.end, block.itemLine});
+            }
+            block = Block();
+        };
+
+        const char *data = m_data.data();
+        ForEachLine([&](const char *line, size_t len, wxTextFileType type)
+        {
+            lineNum++;
+            if (len == 0)
+            {
+                finishBlock();
+                return ok;
+            }
+
+            const size_t begin = line - data;
+            size_t end = begin + len;
+            if (type == wxTextFileType_Dos)
+                end += 2;
+            else if (type != wxTextFileType_None)
+                end += 1;
+
+            const bool wasEmptyMsgid = block.headerMsgid && block.itemLine == lineNum - 1;
+            if (block.empty)
+            {
+                block.begin = begin;
+                block.empty = false;
+            }
+            block.end = end;
+
+            size_t indent = 0;
+            while (indent < len && (line[indent] == ' ' || line[indent] == '\t'))
+                indent++;
+
+            if (line[0] == '"' || (indent && indent < len && line[indent] == '"'))
+            {
+                // continuation of a string
+                if (block.itemLine == -1 && !block.context)
+                    ok = false;
+                if (wasEmptyMsgid)
+                    block.headerMsgid = false;
+            }
+            else if (block.translation && !startsWith(line, len, "msgstr"))
+            {
+                // anything after msgstr means that the next entry follows
+                // without an empty line between them
+                ok = false;
+            }
+            else if (line[0] == '#')
+            {
+                if (block.itemLine != -1 || block.context)
+                    ok = false;
+                if (len >= 2 && line[1] == '~')
+                    block.obsolete = true;
+            }
+            else if (startsWith(line, len, "msgctxt "))
+            {
+                if (block.context || block.itemLine != -1)
+                    ok = false;
+                block.context = true;
+            }
+            else if (startsWith(line, len, "msgid "))
+            {
+                if (block.itemLine != -1)
+                    ok = false;
+                block.itemLine = lineNum;
+                block.headerMsgid = (len == 8 && memcmp(line, "msgid \"\"", 8) == 0);
+            }
+            else if (startsWith(line, len, "msgid_plural "))
+            {
+                if (block.itemLine == -1)
+                    ok = false;
+                block.itemLine = lineNum;
+            }
+            else if (startsWith(line, len, "msgstr"))
+            {
+                if (block.itemLine == -1)
+                    ok = false;
+                block.translation = true;
+            }
+            else
+            {
+                ok = false;
+            }
+            return ok;
+        });
+        if (ok)
+            finishBlock();
+
+        return ok && haveHeader;
+    }
+
+    /**
+        Computes basic statistics by looking only at the structure of the
+        file, without decoding it or creating any items.
+
+        @return false if the file doesn't look like a PO file that can be
+                reliably scanned this way (e.g. it's UTF-16 encoded).
+     */
+    bool ScanStatistics(POCatalog::FileStatistics& stats,
+                        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) const
+    {
+        if (m_data.find('\0') != std::string::npos)
+            return false;
+
+        auto startsWith = [](const char *line, size_t len, const char *prefix)
+        {
+            const size_t plen = strlen(prefix);
+            return len >= plen && memcmp(line, prefix, plen) == 0;
+        };
+
+        // Returns true if the line contains a nonempty string literal
+        auto hasText = [](const char *line, size_t len)
+        {
+            auto quote = (const char*)memchr(line, '"', len);
+            return quote && quote + 1 < line + len && quote[1] != '"';
+        };
+
+        enum class Field { None, Msgid, Other, Msgstr };
+
+        struct Entry
+        {
+            bool started = false;
+            bool fuzzy = false;
+            bool context = false;
+            bool emptyMsgid = true;
+            bool untranslated = false;
+            bool translationText = false;  // current msgstr[N] has text?
+            int translations = 0;
+        };
+
+        Entry entry;
+        Field field = Field::None;
+        bool haveHeader = false;
+
+        auto finishTranslation = [&]
+        {
+            if (field == Field::Msgstr && !entry.translationText)
+                entry.untranslated = true;
+        };
+
+        auto finishEntry = [&]
+        {
+            finishTranslation();
+            if (entry.started && entry.translations)
+            {
+                if (entry.emptyMsgid && !entry.context && !haveHeader)
+                {
+                    haveHeader = true;
+                }
+                else
+                {
+                    stats.all++;
+                    if (entry.fuzzy)
+                        stats.fuzzy++;
+                    if (entry.untranslated)
+                        stats.untranslated++;
+                }
+            }
+            entry = Entry();
+            field = Field::None;
+        };
+
+        bool inHeader = true;
+        bool ok = true;
+        unsigned lineCount = 0;
+        ForEachLine([&](const char *line, size_t len, wxTextFileType)
+        {
+            // checking the clock is relatively expensive, don't do it on every line:
+            if ((++lineCount & 0x3fff) == 0 && std::chrono::steady_clock::now() > deadline)
+            {
+                ok = false;
+                return false;
+            }
+
+            while (len && (*line == ' ' || *line == '\t'))
+            {
+                line++;
+                len--;
+            }
+            if (len == 0)
+                return true;
+
+            if (line[0] == '"')
+            {
+                if (!hasText(line, len))
+                    return true;
+                if (field == Field::Msgid)
+                    entry.emptyMsgid = false;
+                else if (field == Field::Msgstr)
+                    entry.translationText = true;
+
+                if (field == Field::Msgstr && inHeader && entry.emptyMsgid && !entry.context &&
+                    startsWith(line, len, "\"PO-Revision-Date:"))
+                {
+                    wxString value = wxString::FromUTF8(line + 18, len - 18);
+                    if (value.EndsWith("\""))
+                        value.RemoveLast();
+                    if (value.EndsWith("\\n"))
+                        value.RemoveLast(2);
+                    stats.revisionDate = value.Strip(wxString::both);
+                }
+                return true;
+            }
+
+            // anything but msgstr after a translation starts the next entry:
+            if (field == Field::Msgstr && !startsWith(line, len, "msgstr"))
+            {
+                finishEntry();
+                inHeader = false;
+            }
+
+            if (line[0] == '#')
+            {
+                if (len >= 2 && line[1] == '~')
+                    entry.fuzzy = false; // flags of an obsolete entry
+                else if (len >= 2 && line[1] == ',' && wxString::FromAscii(line, len).Contains("fuzzy"))
+                    entry.fuzzy = true;
+                return true;
+            }
+
+            entry.started = true;
+            if (startsWith(line, len, "msgctxt"))
+            {
+                entry.context = true;
+                field = Field::Other;
+            }
+            else if (startsWith(line, len, "msgid_plural"))
+            {
+                field = Field::Other;
+            }
+            else if (startsWith(line, len, "msgid"))
+            {
+                field = Field::Msgid;
+                entry.emptyMsgid = !hasText(line, len);
+            }
+            else if (startsWith(line, len, "msgstr"))
+            {
+                finishTranslation();
+                field = Field::Msgstr;
+                entry.translations++;
+                entry.translationText = hasText(line, len);
+            }
+            else
+            {
+                ok = false;  // not a PO file
+            }
+            return ok;
+        });
+
+        if (!ok)
+            return false;
+        finishEntry();
+        return true;
+    }
+
+    /**
+        Returns the size of the beginning of the file that contains the header
+        and the first @a maxEntries entries, i.e. of the part that needs to be
+        parsed to get them. Obsolete entries aren't counted.
+     */
+    size_t FindPreviewEnd(size_t maxEntries) const
+    {
+        size_t found = 0; // including the header
+        bool translation = false;
+        size_t end = m_data.size();
+        const char *data = m_data.data();
+        ForEachLine([&](const char *line, size_t len, wxTextFileType)
+        {
+            const char *lineStart = line;
+            while (len && (*line == ' ' || *line == '\t'))
+            {
+                line++;
+                len--;
+            }
+            const bool isMsgstr = len >= 6 && memcmp(line, "msgstr", 6) == 0;
+
+            // anything but msgstr or its continuation ends the entry:
+            if (translation && !isMsgstr && (len == 0 || line[0] != '"'))
+            {
+                translation = false;
+                if (++found > maxEntries)
+                {
+                    end = lineStart - data;
+                    return false;
+                }
+            }
+            if (isMsgstr)
+                translation = true;
+            return true;
+        });
+        return end;
+    }
+
+    /// Discards everything but the first @a size bytes of the file.
+    void Truncate(size_t size)
+    {
+        if (size < m_data.size())
+            m_data.resize(size);
+    }
+
+private:
+    bool ReadCompressed(const wxString& filename)
+    {
+        wxLogNull null;
+        wxFileInputStream fileStream(filename);
+        if (!fileStream.IsOk())
+            return false;
+        wxZlibInputStream zstream(fileStream, wxZLIB_GZIP);
+
+        // the uncompressed size isn't known upfront, but it's usually several times larger:
+        const auto compressedSize = fileStream.GetLength();
+        if (compressedSize > 0)
+            m_data.reserve((size_t)compressedSize * 4);
+
+        char buf[64 * 1024];
+        for (;;)
+        {
+            const size_t read = zstream.Read(buf, sizeof(buf)).LastRead();
+            m_data.append(buf, read);
+            if (zstream.Eof())
+                return true;
+            if (read == 0 || !zstream.IsOk())
+                return false;
+        }
+    }
+
+    // Minimum file size for parallel decoding to be worth the overhead.
+    static const size_t PARALLEL_DECODE_MIN_SIZE = 4 * 1024 * 1024;
+
+    struct DecodedChunk
+    {
+        std::vector<std::pair<wxString, wxTextFileType>> lines;
+        std::vector<size_t> corrupted; // indexes of lines that failed to decode
+    };
+
+    // Decodes using @a table if provided, @a conv otherwise.
+    static DecodedChunk DecodeChunk(const char *begin, const char *end, const wxMBConv& conv, const SingleByteCharset *table)
+    {
+        DecodedChunk chunk;
+        ForEachLine(begin, end, [&](const char *line, size_t len, wxTextFileType type)
+        {
+            wxString decoded;
+            if (len)
+            {
+                bool ok;
+                if (table)
+                {
+                    ok = table->Decode(line, len, decoded);
+                }
+                else
+                {
+                    decoded = wxString(line, conv, len);
+                    ok = !decoded.empty(); // wxMBConv conversion failed
+                }
+                if (!ok)
+                    chunk.corrupted.push_back(chunk.lines.size());
+            }
+            chunk.lines.emplace_back(std::move(decoded), type);
+            return true;
+        });
+        return chunk;
+    }
 
+    // Calls f(line, length, type) for every line, until it returns false.
+    template<typename F>
+    void ForEachLine(F&& f) const
+    {
+        ForEachLine(m_data.data(), m_data.data() + m_data.size(), std::forward<F>(f));
+    }
+
+    template<typename F>
+    static void ForEachLine(const char *pos, const char *end, F&& f)
+    {
+        while (pos < end)
+        {
+            auto eol = (const char*)memchr(pos, '\n', end - pos);
+            auto lineEnd = eol ? eol : end;
+
+            // lone CRs are line breaks too, as in wxTextFile:
+            auto cr = (const char*)memchr(pos, '\r', lineEnd - pos);
+            if (cr && cr + 1 < lineEnd)
+            {
+                if (!f(pos, size_t(cr - pos), wxTextFileType_Mac))
+                    return;
+                pos = cr + 1;
+                continue;
+            }
+
+            wxTextFileType type = wxTextFileType_None;
+            size_t len = lineEnd - pos;
+            if (eol)
+            {
+                if (cr)
+                {
+                    type = wxTextFileType_Dos;
+                    len--;
+                }
+                else
+                {
+                    type = wxTextFileType_Unix;
+                }
+            }
+            else if (cr)
+            {
+                type = wxTextFileType_Mac;
+                len--;
+            }
+
+            if (!f(pos, len, type))
+                return;
+            pos = eol ? eol + 1 : end;
+        }
+    }
+
+    wxString m_filename;
+    std::string m_data;
+    bool m_ok;
+};
 
-wxTextFileType GetFileCRLFFormat(wxTextFile& po_file)
+
+namespace
+{
+
+wxTextFileType GetFileCRLFFormat(wxTextBuffer& po_file)
 {
     wxLogNull null;
     auto crlf = po_file.GuessType();
@@ -586,7 +1309,7 @@ int POCatalogParser::GetWrappingWidth() const
 class POCharsetInfoFinder : public POCatalogParser
 {
     public:
-        POCharsetInfoFinder(wxTextFile *f)
+        POCharsetInfoFinder(wxTextBuffer *f)
                 : POCatalogParser(f), m_charset("UTF-8") {}
         wxString GetCharset() const { return m_charset; }
 
@@ -621,11 +1344,64 @@ class POCharsetInfoFinder : public POCatalogParser
 };
 
 
+namespace
+{
 
-class POLoadParser : public POCatalogParser
+// Returns language of msgids if specified in the header, invalid one otherwise
+Language GetSpecifiedMsgidLanguage(const Catalog::HeaderData& header)
 {
-    public:
-        POLoadParser(POCatalog& c, wxTextFile *f)
+    auto x_srclang = header.GetHeader("X-Source-Language");
+    if (x_srclang.empty())
+        x_srclang = header.GetHeader("X-Loco-Source-Locale");
+    if (!x_srclang.empty())
+    {
+        auto parsed = Language::TryParse(str::to_utf8(x_srclang));
+        if (parsed.IsValid())
+            return parsed;
+    }
+    return Language();
+}
+
+// Returns filename of the uncompressed file, i.e. without .gz suffix.
+wxString StripCompressionSuffix(const wxString& po_file)
+{
+    return POCatalog::IsCompressedFileName(po_file) ? po_file.substr(0, po_file.length() - 3) : po_file;
+}
+
+// Writes gzip-compressed content of @a src into @a dest.
+bool CompressFile(const wxString& src, const wxString& dest)
+{
+    wxFileInputStream in(src);
+    if (!in.IsOk())
+        return false;
+
+    TempOutputFileFor temp(dest);
+    {
+        wxFileOutputStream fileStream(temp.FileName());
+        if (!fileStream.IsOk())
+            return false;
+        wxZlibOutputStream zstream(fileStream, -1, wxZLIB_GZIP);
+        zstream.Write(in);
+        if (in.GetLastError() != wxSTREAM_EOF || !zstream.Close() || !fileStream.Close())
+            return false;
+    }
+    return temp.Commit();
+}
+
+Catalog::Type GetTypeFromFileName(const wxString& po_file)
+{
+    wxString ext;
+    wxFileName::SplitPath(StripCompressionSuffix(po_file), nullptr, nullptr, &ext);
+    return ext.CmpNoCase("pot") == 0 ? Catalog::Type::POT : Catalog::Type::PO;
+}
+
+} // anonymous namespace
+
+
+class POLoadParser : public POCatalogParser
+{
+    public:
+        POLoadParser(POCatalog& c, wxTextBuffer *f)
               : POCatalogParser(f),
                 FileIsValid(false),
                 m_catalog(c), m_nextId(1), m_seenHeaderAlready(false) {}
@@ -635,16 +1411,7 @@ class POLoadParser : public POCatalogParser
 
         Language GetSpecifiedMsgidLanguage()
         {
-            auto x_srclang = m_catalog.Header().GetHeader("X-Source-Language");
-            if (x_srclang.empty())
-                x_srclang = m_catalog.m_header.GetHeader("X-Loco-Source-Locale");
-            if (!x_srclang.empty())
-            {
-                auto parsed = Language::TryParse(str::to_utf8(x_srclang));
-                if (parsed.IsValid())
-                    return parsed;
-            }
-            return Language();
+            return ::GetSpecifiedMsgidLanguage(m_catalog.m_header);
         }
 
     protected:
@@ -727,21 +1494,42 @@ bool POLoadParser::OnEntry(const wxString& msgid,
         if (has_context)
             d->SetContext(context);
         d->SetTranslations(mtranslations);
-        d->SetComment(comment);
         d->SetLineNumber(lineNumber);
-        d->SetRawReferences(references);
 
-        for (auto i: extractedComments)
+        // Only the fields shown in the list are needed right away, so keep the
+        // rest in its raw form (references are only split into individual
+        // entries in GetReferences()) and skip empty ones entirely; most
+        // entries have no comments or old msgids.
+        if (!comment.empty())
+            d->SetComment(comment);
+        if (!references.empty())
+            d->SetRawReferences(references);
+        if (!msgid_old.empty())
+            d->SetOldMsgid(msgid_old);
+
+        if (!extractedComments.empty())
         {
             // Sometimes, msgcat produces conflicts in extracted comments; see the gory details:
             // https://groups.google.com/d/topic/poedit/j41KuvXtVUU/discussion
             // As a workaround, just filter them out.
             // FIXME: Fix this properly... but not using msgcat in the first place
-            if (i.starts_with(MSGCAT_CONFLICT_MARKER) && i.ends_with(MSGCAT_CONFLICT_MARKER))
-                continue;
-            d->AddExtractedComments(i);
+            auto isConflict = [](const wxString& i)
+            {
+                return i.starts_with(MSGCAT_CONFLICT_MARKER) && i.ends_with(MSGCAT_CONFLICT_MARKER);
+            };
+            if (std::none_of(extractedComments.begin(), extractedComments.end(), isConflict))
+            {
+                d->SetExtractedComments(extractedComments);
+            }
+            else
+            {
+                for (const auto& i: extractedComments)
+                {
+                    if (!isConflict(i))
+                        d->AddExtractedComments(i);
+                }
+            }
         }
-        d->SetOldMsgid(msgid_old);
         m_catalog.AddItem(d);
     }
     return true;
@@ -756,19 +1544,84 @@ bool POLoadParser::OnDeletedEntry(const wxArrayString& deletedLines,
 {
     FileIsValid = true;
 
-    POCatalogDeletedData d;
-    if (!flags.empty()) d.SetFlags(flags);
-    d.SetDeletedLines(deletedLines);
-    d.SetComment(comment);
+    // Obsolete entries are only stored as text and parsed when needed, see
+    // POCatalogDeletedData. Note that references are intentionally omitted.
+    wxString raw(comment);
+    for (auto& c: extractedComments)
+        raw << wxS("#. ") << c << wxS('\n');
+    if (!flags.empty())
+        raw << wxS('#') << flags << wxS('\n');
+    for (auto& line: deletedLines)
+        raw << line << wxS('\n');
+    raw.RemoveLast();
+
+    auto d = POCatalogDeletedData::FromRawText(raw);
     d.SetLineNumber(lineNumber);
-    for (size_t i = 0; i < extractedComments.GetCount(); i++)
-      d.AddExtractedComments(extractedComments[i]);
     m_catalog.AddDeletedItem(d);
 
     return true;
 }
 
 
+// ----------------------------------------------------------------------
+// POCatalogDeletedData class
+// ----------------------------------------------------------------------
+
+wxString POCatalogDeletedData::GetRawText() const
+{
+    if (!m_parsed || !m_raw.empty())
+        return m_raw;
+
+    wxString raw(m_comment);
+    if (!raw.empty() && raw.Last() != '\n')
+        raw += '\n';
+    for (auto& c: m_extractedComments)
+        raw << wxS("#. ") << c << wxS('\n');
+    for (auto& r: m_references)
+        raw << wxS("#: ") << r << wxS('\n');
+    if (!m_flags.empty())
+        raw << wxS('#') << m_flags << wxS('\n');
+    for (auto& line: m_deletedLines)
+        raw << line << wxS('\n');
+    if (!raw.empty())
+        raw.RemoveLast();
+    return raw;
+}
+
+
+void POCatalogDeletedData::Parse() const
+{
+    m_parsed = true;
+
+    for (auto& line: wxSplit(m_raw, '\n', '\0'))
+    {
+        if (line.StartsWith(wxS("#~")))
+            m_deletedLines.Add(line);
+        else if (line.StartsWith(wxS("#.")))
+            m_extractedComments.Add(line.StartsWith(wxS("#. ")) ? line.Mid(3) : line.Mid(2));
+        else if (line.StartsWith(wxS("#: ")))
+            m_references.Add(line.Mid(3));
+        else if (line.StartsWith(wxS("#,")))
+            m_flags = line.Mid(1);
+        else
+            m_comment << line << wxS('\n');
+    }
+}
+
+
+void POCatalogDeletedData::AddMemoryUsage(CatalogMemoryUsage& usage) const
+{
+    usage.AddString(m_raw);
+    if (m_parsed)
+    {
+        usage.AddStrings(m_deletedLines);
+        usage.AddStrings(m_references);
+        usage.AddStrings(m_extractedComments);
+        usage.AddString(m_comment);
+    }
+}
+
+
 // ----------------------------------------------------------------------
 // POCatalogItem class
 // ----------------------------------------------------------------------
@@ -828,6 +1681,23 @@ wxArrayString POCatalogItem::GetReferences() const
 }
 
 
+void POCatalogItem::AddMemoryUsage(CatalogMemoryUsage& usage) const
+{
+    CatalogItem::AddMemoryUsage(usage);
+    usage.items += sizeof(POCatalogItem) - sizeof(CatalogItem);
+    usage.AddStrings(m_references);
+}
+
+
+POCatalogItemPtr POCatalogItem::Clone() const
+{
+    auto copy = std::make_shared<POCatalogItem>();
+    copy->CopyContentFrom(*this);
+    copy->m_references = m_references;
+    return copy;
+}
+
+
 // ----------------------------------------------------------------------
 // POCatalog class
 // ----------------------------------------------------------------------
@@ -876,6 +1746,17 @@ bool POCatalog::CanLoadFile(const wxString& extension)
 }
 
 
+bool POCatalog::IsCompressedFileName(const wxString& filename)
+{
+    wxString base;
+    if (!filename.Lower().EndsWith(".gz", &base))
+        return false;
+    wxString ext;
+    wxFileName::SplitPath(base, nullptr, nullptr, &ext);
+    return CanLoadFile(ext);
+}
+
+
 wxString POCatalog::GetPreferredExtension() const
 {
     switch (m_fileType)
@@ -902,41 +1783,75 @@ static inline wxString GetCurrentTimeString()
 
 void POCatalog::Load(const wxString& po_file, int flags)
 {
-    wxTextFile f;
+    perf::ScopedTimer timer("POCatalog::Load");
 
     Clear();
     m_fileName = po_file;
     m_header.BasePath = wxEmptyString;
 
-    wxString ext;
-    wxFileName::SplitPath(po_file, nullptr, nullptr, &ext);
-    if (ext.CmpNoCase("pot") == 0)
-        m_fileType = Type::POT;
-    else
-        m_fileType = Type::PO;
+    m_fileType = GetTypeFromFileName(po_file);
 
     /* Load the .po file: */
 
-    if (!f.Open(po_file, wxConvISO8859_1))
+    // Large files may be cached from the last time they were opened:
+    wxDateTime modTime;
+    const bool useCache = (flags == 0) && wxFileName::FileExists(po_file) &&
+                          wxFileName(po_file).GetTimes(nullptr, &modTime, nullptr);
+    const size_t fileSize = useCache ? (size_t)wxFileName::GetSize(po_file).GetValue() : 0;
+    const wxInt64 mtime = useCache ? modTime.GetValue().GetValue() : 0;
+    if (useCache && LoadFromCache(po_file, fileSize, mtime))
+    {
+        FixupCommonIssues();
+        timer.SetItemsCount(m_items.size());
+        return;
+    }
+
+    POFileData data(po_file);
+    if (!data.IsOk())
     {
         throw Exception(_(L"Couldn’t load the file, it is probably damaged."));
     }
 
+    const bool decodedOk = ParseFileData(data, flags);
+
+    // Do this before fixups, so that they are written on next save:
+    if (useCache)
+    {
+        UpdateFileLayout(po_file, data, m_fileCRLF, /*updateLineNumbers=*/false);
+        // don't cache damaged files, so that the errors are reported every time
+        if (decodedOk && data.GetBytes().size() == fileSize)
+            WriteCache(po_file, fileSize, mtime);
+    }
+
+    FixupCommonIssues();
+
+    if ( flags & CreationFlag_IgnoreHeader )
+        CreateNewHeader();
+
+    timer.SetItemsCount(m_items.size());
+}
+
+
+bool POCatalog::ParseFileData(const POFileData& data, int flags)
+{
     {
         wxLogNull null; // don't report parsing errors from here, report them later
-        POCharsetInfoFinder charsetFinder(&f);
+        wxMemoryText header;
+        data.DecodeHeader(header);
+        POCharsetInfoFinder charsetFinder(&header);
         charsetFinder.Parse();
         m_header.Charset = charsetFinder.GetCharset();
     }
 
-    f.Close();
     wxCSConv encConv(m_header.Charset);
-    if (!f.Open(po_file, encConv))
+    if (!encConv.IsOk())
     {
         throw Exception(_(L"Couldn’t load the file, it is probably damaged."));
     }
 
-    if (!VerifyFileCharset(f, po_file, m_header.Charset))
+    wxMemoryText f;
+    const bool decodedOk = data.Decode(f, encConv, m_header.Charset);
+    if (!decodedOk)
     {
         wxLogError(_("There were errors when loading the file. Some data may be missing or corrupted as the result."));
     }
@@ -961,12 +1876,7 @@ void POCatalog::Load(const wxString& po_file, int flags)
         throw Exception(_(L"Couldn’t load the file, it is probably damaged."));
     }
 
-    f.Close();
-
-    FixupCommonIssues();
-
-    if ( flags & CreationFlag_IgnoreHeader )
-        CreateNewHeader();
+    return decodedOk;
 }
 
 
@@ -1041,39 +1951,117 @@ void POCatalog::Clear()
 
     // PO-specific fields:
     m_deletedItems.clear();
+    m_fileLayout.reset();
+    InvalidateItemsIndex();
 }
 
 
-// misc file-saving helpers
-namespace
-{
+/**
+    Destination of POCatalog::DoSaveOnly().
 
-inline bool CanEncodeStringToCharset(const wxString& s, wxMBConv& conv)
+    Lines are encoded into the target charset as they are added and written
+    out in large blocks, so the file is never held in memory as a whole (in
+    file mode) and encoding failures are detected in the same pass.
+ */
+class POOutput
 {
-    if (s.empty())
-        return true;
-    const wxCharBuffer converted(s.mb_str(conv));
-    if ( converted.length() == 0 )
-        return false;
-    return true;
-}
+public:
+    /// Writes into @a filename, or only into memory if it is empty.
+    POOutput(const wxString& filename, wxTextFileType crlf)
+        : m_filename(filename), m_lines(0), m_encodingOk(true), m_writeOk(true), m_utf8(true)
+    {
+        if (crlf == wxTextFileType_None)
+            crlf = wxTextBuffer::typeDefault;
+        m_eol = crlf == wxTextFileType_Dos ? "\r\n" : crlf == wxTextFileType_Mac ? "\r" : "\n";
+    }
 
-bool CanEncodeToCharset(const wxTextBuffer& f, const wxString& charset)
-{
-    if (charset.Lower() == "utf-8" || charset.Lower() == "utf8")
-        return true;
+    /// Starts writing (again) from scratch, in the given charset.
+    bool Start(const wxString& charset)
+    {
+        m_data.clear();
+        m_lines = 0;
+        m_encodingOk = m_writeOk = true;
+        m_utf8 = charset.Lower() == "utf-8" || charset.Lower() == "utf8";
+        m_table = m_utf8 ? nullptr : SingleByteCharset::Get(charset);
+        m_conv.reset(m_utf8 || m_table ? nullptr : new wxCSConv(charset));
+
+        if (m_filename.empty())
+            return true;
+        if (m_file.IsOpened())
+            m_file.Close();
+        return m_file.Create(m_filename, /*overwrite=*/true);
+    }
+
+    void AddLine(const wxString& line)
+    {
+        m_lines++;
+        if (!line.empty())
+        {
+            if (m_utf8)
+            {
+                const wxScopedCharBuffer buf(line.utf8_str());
+                m_data.append(buf.data(), buf.length());
+            }
+            else if (m_table)
+            {
+                if (!m_table->Encode(line, m_data))
+                    m_encodingOk = false;
+            }
+            else
+            {
+                const wxCharBuffer buf(line.mb_str(*m_conv));
+                if (buf.length() == 0)
+                    m_encodingOk = false; // can't be represented in the charset
+                m_data.append(buf.data(), buf.length());
+            }
+        }
+        m_data += m_eol;
+
+        if (m_file.IsOpened() && m_data.size() >= FLUSH_SIZE)
+            Flush();
+    }
 
-    wxCSConv conv(charset);
+    size_t GetLineCount() const { return m_lines; }
 
-    const size_t lines = f.GetLineCount();
-    for ( size_t i = 0; i < lines; i++ )
+    /// Returns false if some of the lines couldn't be encoded in the charset.
+    bool CanEncode() const { return m_encodingOk; }
+
+    /// Finishes writing into the file.
+    bool Finish()
     {
-        if ( !CanEncodeStringToCharset(f.GetLine(i), conv) )
-            return false;
+        if (!m_file.IsOpened())
+            return m_filename.empty();
+        Flush();
+        return m_file.Close() && m_writeOk;
     }
 
-    return true;
-}
+    /// Returns output encoded in memory (if not writing into a file).
+    std::string TakeData() { return std::move(m_data); }
+
+private:
+    static const size_t FLUSH_SIZE = 1024 * 1024;
+
+    void Flush()
+    {
+        if (m_file.Write(m_data.data(), m_data.size()) != m_data.size())
+            m_writeOk = false;
+        m_data.clear();
+    }
+
+    wxString m_filename;
+    wxFile m_file;
+    const char *m_eol;
+    std::string m_data;
+    size_t m_lines;
+    bool m_encodingOk, m_writeOk, m_utf8;
+    std::shared_ptr<const SingleByteCharset> m_table;
+    std::unique_ptr<wxCSConv> m_conv;
+};
+
+
+// misc file-saving helpers
+namespace
+{
 
 template<typename Func>
 inline void SplitIntoLines(const wxString& text, Func&& f)
@@ -1095,7 +2083,7 @@ inline void SplitIntoLines(const wxString& text, Func&& f)
         f(wxString(last, text.end()), true);
 }
 
-void SaveMultiLines(wxTextBuffer &f, const wxString& text)
+void SaveMultiLines(POOutput &f, const wxString& text)
 {
     SplitIntoLines(text, [&f](wxString&& s, bool)
     {
@@ -1147,6 +2135,8 @@ wxString FormatStringForFile(const wxString& text)
 bool POCatalog::Save(const wxString& po_file, bool save_mo,
                      ValidationResults& validation_results, CompilationStatus& mo_compilation_status)
 {
+    perf::ScopedTimer timer("POCatalog::Save");
+    timer.SetItemsCount(m_items.size());
     mo_compilation_status = CompilationStatus::NotDone;
 
     if ( wxFileExists(po_file) && !wxFile::Access(po_file, wxFile::write) )
@@ -1177,7 +2167,11 @@ bool POCatalog::Save(const wxString& po_file, bool save_mo,
             break;
     }
 
-    TempOutputFileFor po_file_temp_obj(po_file);
+    // Compressed files are written (and formatted and validated) uncompressed
+    // first and only compressed into the final file at the very end:
+    const bool compressed = IsCompressedFileName(po_file);
+
+    TempOutputFileFor po_file_temp_obj(StripCompressionSuffix(po_file));
     const wxString po_file_temp = po_file_temp_obj.FileName();
 
     wxTextFileType outputCrlf = GetDesiredCRLFFormat(m_fileCRLF);
@@ -1185,14 +2179,31 @@ bool POCatalog::Save(const wxString& po_file, bool save_mo,
     // reformat the file later. This is because msgcat cannot handle DOS
     // input particularly well.
 
-    if ( !DoSaveOnly(po_file_temp, wxTextFileType_Unix) )
+    // If the entries are still the same as at the last load or save (even
+    // if their content changed), only the changed ones are re-formatted and
+    // replaced in the existing file, which is much faster with large files
+    // than re-formatting all of it with msgcat.
+    // msgfmt is run on the result for validation if it can't be done
+    // natively, so only do this with line endings it can handle.
+    bool incremental;
     {
-        wxLogError(_(L"Couldn’t save file %s."), po_file.c_str());
-        return false;
+        perf::ScopedTimer serializationTimer("serialization");
+        incremental = !compressed &&
+                      (outputCrlf == wxTextFileType_Unix || CanValidateNatively()) &&
+                      SaveIncrementally(po_file, po_file_temp, outputCrlf);
+        if (incremental)
+            wxLogTrace("poedit", "saved only changed entries of %s", po_file);
+
+        if ( !incremental && !DoSaveOnly(po_file_temp, wxTextFileType_Unix) )
+        {
+            wxLogError(_(L"Couldn’t save file %s."), po_file.c_str());
+            return false;
+        }
     }
 
     try
     {
+        perf::ScopedTimer validationTimer("validation");
         validation_results = Validate(/*fileWithSameContent=*/po_file_temp);
     }
     catch (...)
@@ -1207,45 +2218,12 @@ bool POCatalog::Save(const wxString& po_file, bool save_mo,
     // proper preservation of formatting is implemented.
 
     int msgcat_ok = false;
+    if ( !incremental )
     {
-        int wrapping = DEFAULT_WRAPPING;
-        if (wxConfig::Get()->ReadBool("keep_crlf", true))
-            wrapping = m_fileWrappingWidth;
-
-        wxString wrappingFlag;
-        if (wrapping == DEFAULT_WRAPPING)
-        {
-            if (wxConfig::Get()->ReadBool("wrap_po_files", true))
-            {
-                wrapping = (int)wxConfig::Get()->ReadLong("wrap_po_files_width", 79);
-            }
-            else
-            {
-                wrapping = NO_WRAPPING;
-            }
-        }
-
-        if (wrapping == NO_WRAPPING)
-            wrappingFlag = " --no-wrap";
-        else if (wrapping != DEFAULT_WRAPPING)
-            wrappingFlag.Printf(" --width=%d", wrapping);
-
+        perf::ScopedTimer formattingTimer("msgcat formatting");
         TempOutputFileFor po_file_temp2_obj(po_file_temp);
         const wxString po_file_temp2 = po_file_temp2_obj.FileName();
-        auto msgcatCmd = wxString::Format("msgcat --force-po%s -o %s %s",
-                                          wrappingFlag,
-                                          QuoteCmdlineArg(po_file_temp2),
-                                          QuoteCmdlineArg(po_file_temp));
-        wxLogTrace("poedit", "formatting file with %s", msgcatCmd);
-
-        // Ignore msgcat errors output (but not exit code), because it
-        //   a) complains about things DoValidate() already complained above
-        //   b) issues warnings about source-extraction things (e.g. using non-ASCII
-        //      msgids) that, while correct, are not something a *translator* can
-        //      do anything about.
-        wxLogNull null;
-        msgcat_ok = ExecuteGettext(msgcatCmd) &&
-                    wxFileExists(po_file_temp2);
+        msgcat_ok = FormatWithMsgcat(po_file_temp, po_file_temp2);
 
         // msgcat always outputs Unix line endings, so we need to reformat the file
         if (msgcat_ok && outputCrlf == wxTextFileType_Dos)
@@ -1256,32 +2234,44 @@ bool POCatalog::Save(const wxString& po_file, bool save_mo,
                 finalFile.Write(outputCrlf, conv);
         }
 
-        if (!TempOutputFileFor::ReplaceFile(po_file_temp2, po_file))
+        if (compressed ? !CompressFile(po_file_temp2, po_file)
+                       : !TempOutputFileFor::ReplaceFile(po_file_temp2, po_file))
             msgcat_ok = false;
     }
 
+    bool saved_ok = true;
     if ( msgcat_ok )
     {
         wxRemoveFile(po_file_temp);
     }
     else
     {
-        if ( !po_file_temp_obj.Commit() )
+        if ( compressed ? !CompressFile(po_file_temp, po_file) : !po_file_temp_obj.Commit() )
         {
             wxLogError(_(L"Couldn’t save file %s."), po_file.c_str());
+            saved_ok = false;
         }
         else
         {
             // Only shows msgcat's failure warning if we don't also get
             // validation errors, because if we do, the cause is likely the
             // same.
-            if ( !validation_results.errors )
+            if ( !incremental && !validation_results.errors )
             {
                 wxLogWarning(_("There was a problem formatting the file nicely (but it was saved all right)."));
             }
         }
     }
 
+    // Remember the new layout of the file for the next incremental save:
+    m_fileLayout.reset();
+    if ( saved_ok && !compressed )
+    {
+        POFileData saved(po_file);
+        if (saved.IsOk())
+            UpdateFileLayout(po_file, saved, outputCrlf, /*updateLineNumbers=*/true);
+    }
+
     
     /* If the user wants it, compile .mo file right now: */
 
@@ -1289,8 +2279,11 @@ bool POCatalog::Save(const wxString& po_file, bool save_mo,
     if (!wxConfig::Get()->Read("compile_mo", (long)true))
         compileMO = false;
 
-    if (m_fileType == Type::PO && compileMO)
+    // msgfmt can't read compressed files and they are used for storage
+    // rather than deployment, so MO files are only made from plain ones:
+    if (m_fileType == Type::PO && compileMO && !compressed)
     {
+        perf::ScopedTimer compilationTimer("MO compilation");
         const wxString mo_file = wxFileName::StripExtension(po_file) + ".mo";
         TempOutputFileFor mo_file_temp_obj(mo_file);
         const wxString mo_file_temp = mo_file_temp_obj.FileName();
@@ -1379,188 +2372,373 @@ bool POCatalog::Save(const wxString& po_file, bool save_mo,
 
 std::string POCatalog::SaveToBuffer()
 {
-    class StringSerializer : public wxMemoryText
-    {
-    public:
-        bool OnWrite(wxTextFileType typeNew, const wxMBConv& conv) override
-        {
-            size_t cnt = GetLineCount();
-            for (size_t n = 0; n < cnt; n++)
-            {
-                auto ln = GetLine(n) +
-                          GetEOL(typeNew == wxTextFileType_None ? GetLineType(n) : typeNew);
-                auto buf = ln.mb_str(conv);
-                buffer.append(buf.data(), buf.length());
-            }
-            return true;
-        }
+    POOutput f(wxString(), wxTextFileType_Unix);
+    if (!DoSaveOnly(f))
+        return std::string();
+    return f.TakeData();
+}
 
-        std::string buffer;
-    };
 
-    StringSerializer f;
+CatalogMemoryUsage POCatalog::GetMemoryUsage() const
+{
+    auto usage = Catalog::GetMemoryUsage();
+
+    usage.arrays += m_deletedItems.capacity() * sizeof(POCatalogDeletedData);
+    for (auto& d: m_deletedItems)
+        d.AddMemoryUsage(usage);
 
-    if (!DoSaveOnly(f, wxTextFileType_Unix))
-        return std::string();
-    return f.buffer;
+    if (m_fileLayout)
+        usage.fileData += sizeof(FileLayout) + m_fileLayout->entries.capacity() * sizeof(FileLayout::Entry);
+
+    return usage;
 }
 
 
-bool POCatalog::CompileToMO(const wxString& mo_file,
-                            ValidationResults& validation_results,
-                            CompilationStatus& mo_compilation_status)
+CatalogPtr POCatalog::CreateSnapshot() const
 {
-    mo_compilation_status = CompilationStatus::NotDone;
+    perf::ScopedTimer timer("POCatalog::CreateSnapshot");
+
+    POCatalogPtr snapshot(new POCatalog(m_fileType));
+    snapshot->m_fileName = m_fileName;
+    snapshot->m_header = m_header;
+    snapshot->m_sourceLanguage = m_sourceLanguage;
+    snapshot->m_sourceIsSymbolicID = m_sourceIsSymbolicID;
+    snapshot->m_sideloaded = m_sideloaded;
+    snapshot->m_deletedItems = m_deletedItems;
+    snapshot->m_fileCRLF = m_fileCRLF;
+    snapshot->m_fileWrappingWidth = m_fileWrappingWidth;
+    snapshot->m_hasPluralItems = m_hasPluralItems;
+    // the layout is never modified, only replaced, so it can be shared:
+    snapshot->m_fileLayout = m_fileLayout;
+
+    snapshot->m_items.reserve(m_items.size());
+    for (auto& i: m_items)
+        snapshot->m_items.push_back(static_cast<const POCatalogItem&>(*i).Clone());
 
-    TempDirectory tmpdir;
-    if ( !tmpdir.IsOk() )
-        return false;
-    wxString po_file_temp = tmpdir.CreateFileName("output.po");
+    return snapshot;
+}
 
-    if ( !DoSaveOnly(po_file_temp, wxTextFileType_Unix) )
-    {
-        wxLogError(_(L"Couldn’t save file %s."), po_file_temp.c_str());
-        return false;
-    }
 
-    validation_results = Validate(/*fileWithSameContent=*/po_file_temp);
+void POCatalog::AdoptSavedSnapshot(const Catalog& snapshot_)
+{
+    auto& snapshot = static_cast<const POCatalog&>(snapshot_);
 
-    TempOutputFileFor mo_file_temp_obj(mo_file);
-    const wxString mo_file_temp = mo_file_temp_obj.FileName();
+    m_header.RevisionDate = snapshot.m_header.RevisionDate;
+    m_header.CreationDate = snapshot.m_header.CreationDate;
+    m_header.Charset = snapshot.m_header.Charset;
 
+    if (m_items.size() != snapshot.m_items.size())
     {
-        // Ignore msgfmt errors output (but not exit code), because it
-        // complains about things DoValidate() already complained above.
-        wxLogNull null;
-        ExecuteGettext(wxString::Format("msgfmt -o %s %s",
-                                        QuoteCmdlineArg(mo_file_temp),
-                                        QuoteCmdlineArg(po_file_temp)));
+        m_fileLayout.reset();
+        return;
     }
 
-    // Don't check return code:
-    // msgfmt has the ugly habit of sometimes returning non-zero
-    // exit code, reporting "fatal errors" and *still* producing a usable
-    // .mo file. If this happens, don't pretend the file wasn't created.
-    if (!wxFileName::FileExists(mo_file_temp))
-    {
-        mo_compilation_status = CompilationStatus::Error;
-        return false;
-    }
-    else
+    for (size_t i = 0; i < m_items.size(); i++)
     {
-        mo_compilation_status = CompilationStatus::Success;
+        auto& item = *m_items[i];
+        auto& saved = *snapshot.m_items[i];
+        if (item.GetId() != saved.GetId() || item.GetRawString() != saved.GetRawString())
+        {
+            // items were reordered or replaced while saving, line numbers
+            // aren't valid anymore and the file must be saved in full
+            m_fileLayout.reset();
+            return;
+        }
     }
 
-    if ( !mo_file_temp_obj.Commit() )
+    m_fileLayout = snapshot.m_fileLayout;
+
+    for (size_t i = 0; i < m_items.size(); i++)
     {
-        wxLogError(_(L"Couldn’t save file %s."), mo_file.c_str());
-        return false;
-    }
+        auto& item = static_cast<POCatalogItem&>(*m_items[i]);
+        auto& saved = *snapshot.m_items[i];
+        item.SetLineNumber(saved.GetLineNumber());
 
-    return true;
+        // validation results are only valid for content that was saved:
+        if (item.GetRevision() == saved.GetRevision() && item.IsFuzzy() == saved.IsFuzzy())
+        {
+            if (saved.GetIssue())
+                item.SetIssue(saved.GetIssue());
+            else
+                item.ClearIssue();
+        }
+    }
 }
 
 
-
-
-bool POCatalog::DoSaveOnly(const wxString& po_file, wxTextFileType crlf)
+namespace
 {
-    wxTextFile f;
-    if (!f.Create(po_file))
-        return false;
 
-    return DoSaveOnly(f, crlf);
-}
+/**
+    Writes compiled MO files directly, without going through msgfmt.
 
-bool POCatalog::DoSaveOnly(wxTextBuffer& f, wxTextFileType crlf)
+    The format is described in the gettext manual, "The Format of GNU MO
+    Files". Besides the sorted string tables, the hash table used by gettext
+    for fast lookups is written too, computed the same way msgfmt does it.
+ */
+class MOWriter
 {
-    /* Save .po file: */
-    if (!m_header.Charset || m_header.Charset == "CHARSET")
-        m_header.Charset = "UTF-8";
-
-    SaveMultiLines(f, m_header.Comment);
-    if (m_fileType == Type::POT)
-        f.AddLine(wxS("#, fuzzy"));
-    f.AddLine(wxS("msgid \"\""));
-    f.AddLine(wxS("msgstr \"\""));
-    wxString pohdr = wxString(wxS("\"")) + m_header.ToString(wxS("\"\n\""));
-    pohdr.RemoveLast();
-    SaveMultiLines(f, pohdr);
-    f.AddLine(wxEmptyString);
-
-    auto pluralsCount = GetPluralFormsCount();
-
-    for (auto& data_: m_items)
+public:
+    MOWriter(const wxString& charset) : m_conv(charset) {}
+
+    bool IsOk() const { return m_conv.IsOk(); }
+
+    /**
+        Adds a message. @a translations has more than one entry for plural
+        messages. Returns false if the texts can't be encoded in the charset.
+     */
+    bool Add(bool hasContext, const wxString& context,
+             const wxString& msgid, const wxString& msgidPlural,
+             const wxArrayString& translations)
     {
-        auto data = std::static_pointer_cast<POCatalogItem>(data_);
-
-        data->SetLineNumber(int(f.GetLineCount()+1));
-        SaveMultiLines(f, data->GetComment());
-        for (unsigned i = 0; i < data->GetExtractedComments().GetCount(); i++)
+        Message m;
+        if (hasContext)
         {
-            if (data->GetExtractedComments()[i].empty())
-              f.AddLine(wxS("#."));
-            else
-              f.AddLine(wxS("#. ") + data->GetExtractedComments()[i]);
+            if (!Encode(context, m.key))
+                return false;
+            m.key += '\x04';
         }
-        for (unsigned i = 0; i < data->GetRawReferences().GetCount(); i++)
-            f.AddLine(wxS("#: ") + data->GetRawReferences()[i]);
-        wxString dummy = data->GetFlags();
-        if (!dummy.empty())
-            f.AddLine(wxS("#") + dummy);
-        for (unsigned i = 0; i < data->GetOldMsgidRaw().GetCount(); i++)
-            f.AddLine(wxS("#| ") + data->GetOldMsgidRaw()[i]);
-        if ( data->HasContext() )
+        if (!Encode(msgid, m.key))
+            return false;
+        m.original = m.key;
+        if (!msgidPlural.empty())
         {
-            SaveMultiLines(f, wxS("msgctxt \"") + FormatStringForFile(data->GetContext()) + wxS("\""));
+            m.original += '\0';
+            if (!Encode(msgidPlural, m.original))
+                return false;
         }
-        dummy = FormatStringForFile(data->GetRawString());
-        SaveMultiLines(f, wxS("msgid \"") + dummy + wxS("\""));
-        if (data->HasPlural())
+        for (size_t i = 0; i < translations.size(); i++)
         {
-            dummy = FormatStringForFile(data->GetRawPluralString());
-            SaveMultiLines(f, wxS("msgid_plural \"") + dummy + wxS("\""));
+            if (i > 0)
+                m.translation += '\0';
+            if (!Encode(translations[i], m.translation))
+                return false;
+        }
+        m_messages.push_back(std::move(m));
+        return true;
+    }
 
-            for (unsigned i = 0; i < pluralsCount; i++)
-            {
-                dummy = FormatStringForFile(data->GetTranslation(i));
-                wxString hdr = wxString::Format(wxS("msgstr[%u] \""), i);
-                SaveMultiLines(f, hdr + dummy + wxS("\""));
-            }
+    bool Write(const wxString& filename)
+    {
+        std::stable_sort(m_messages.begin(), m_messages.end(),
+                         [](const Message& a, const Message& b){ return a.key < b.key; });
+        // msgfmt refuses duplicates; keep the first occurrence like gettext lookups would
+        m_messages.erase(std::unique(m_messages.begin(), m_messages.end(),
+                                     [](const Message& a, const Message& b){ return a.key == b.key; }),
+                         m_messages.end());
+
+        const uint32_t count = (uint32_t)m_messages.size();
+        const uint32_t hashSize = HashTableSize(count);
+        const uint32_t origTableOffset = 7 * 4;
+        const uint32_t transTableOffset = origTableOffset + count * 8;
+        const uint32_t hashTableOffset = transTableOffset + count * 8;
+        uint32_t stringsOffset = hashTableOffset + hashSize * 4;
+
+        std::string out;
+        out.reserve(stringsOffset);
+        Put(out, 0x950412de); // magic
+        Put(out, 0);          // revision
+        Put(out, count);
+        Put(out, origTableOffset);
+        Put(out, transTableOffset);
+        Put(out, hashSize);
+        Put(out, hashTableOffset);
+
+        std::string strings;
+        for (auto& m: m_messages)
+        {
+            Put(out, (uint32_t)m.original.size());
+            Put(out, stringsOffset + (uint32_t)strings.size());
+            strings.append(m.original.c_str(), m.original.size() + 1);
         }
-        else
+        for (auto& m: m_messages)
         {
-            dummy = FormatStringForFile(data->GetTranslation());
-            SaveMultiLines(f, wxS("msgstr \"") + dummy + wxS("\""));
+            Put(out, (uint32_t)m.translation.size());
+            Put(out, stringsOffset + (uint32_t)strings.size());
+            strings.append(m.translation.c_str(), m.translation.size() + 1);
         }
-        f.AddLine(wxEmptyString);
-    }
 
-    // Write back deleted items in the file so that they're not lost
-    for (unsigned itemIdx = 0; itemIdx < m_deletedItems.size(); itemIdx++)
-    {
-        if ( itemIdx != 0 )
-            f.AddLine(wxEmptyString);
+        std::vector<uint32_t> hashTable(hashSize, 0);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const uint32_t hval = HashString(m_messages[i].key);
+            uint32_t idx = hval % hashSize;
+            const uint32_t incr = 1 + (hval % (hashSize - 2));
+            while (hashTable[idx] != 0)
+                idx = (idx >= hashSize - incr) ? idx - (hashSize - incr) : idx + incr;
+            hashTable[idx] = i + 1;
+        }
+        for (auto h: hashTable)
+            Put(out, h);
 
-        POCatalogDeletedData& deletedItem = m_deletedItems[itemIdx];
-        deletedItem.SetLineNumber(int(f.GetLineCount()+1));
-        SaveMultiLines(f, deletedItem.GetComment());
-        for (unsigned i = 0; i < deletedItem.GetExtractedComments().GetCount(); i++)
-            f.AddLine(wxS("#. ") + deletedItem.GetExtractedComments()[i]);
-        for (unsigned i = 0; i < deletedItem.GetRawReferences().GetCount(); i++)
-            f.AddLine(wxS("#: ") + deletedItem.GetRawReferences()[i]);
-        wxString dummy = deletedItem.GetFlags();
-        if (!dummy.empty())
-            f.AddLine(wxS("#") + dummy);
+        out += strings;
 
-        for (size_t j = 0; j < deletedItem.GetDeletedLines().GetCount(); j++)
-            f.AddLine(deletedItem.GetDeletedLines()[j]);
+        wxFile f;
+        if (!f.Create(filename, /*overwrite=*/true))
+            return false;
+        return f.Write(out.data(), out.size()) == out.size() && f.Close();
     }
 
-    if (!CanEncodeToCharset(f, m_header.Charset))
+private:
+    struct Message
     {
-#if wxUSE_GUI
-        wxString msg;
+        std::string key;         // [msgctxt EOT] msgid, used for sorting and hashing
+        std::string original;    // key [NUL msgid_plural]
+        std::string translation; // NUL-separated plural forms
+    };
+
+    bool Encode(const wxString& text, std::string& out)
+    {
+        if (text.empty())
+            return true;
+        size_t len = 0;
+        auto buf = m_conv.cWC2MB(text.wc_str(), text.length(), &len);
+        if (!buf || len == wxCONV_FAILED)
+            return false;
+        out.append(buf.data(), len);
+        return true;
+    }
+
+    static void Put(std::string& out, uint32_t value)
+    {
+        // MO files are readable in either byte order, use little endian consistently
+        for (int i = 0; i < 4; i++)
+            out += char((value >> (8 * i)) & 0xFF);
+    }
+
+    // The "hashpjw" function used by gettext.
+    static uint32_t HashString(const std::string& str)
+    {
+        uint32_t hval = 0;
+        for (unsigned char c: str)
+        {
+            hval <<= 4;
+            hval += c;
+            uint32_t g = hval & ((uint32_t)0xf << 28);
+            if (g != 0)
+            {
+                hval ^= g >> 24;
+                hval ^= g;
+            }
+        }
+        return hval;
+    }
+
+    // Same as msgfmt: smallest odd prime larger than 4/3 of the count.
+    static uint32_t HashTableSize(uint32_t count)
+    {
+        auto isPrime = [](uint32_t n)
+        {
+            for (uint32_t d = 3; d * d <= n; d += 2)
+            {
+                if (n % d == 0)
+                    return false;
+            }
+            return true;
+        };
+        uint32_t size = std::max<uint32_t>(3, count * 4 / 3) | 1;
+        while (!isPrime(size))
+            size += 2;
+        return size;
+    }
+
+    wxCSConv m_conv;
+    std::vector<Message> m_messages;
+};
+
+} // anonymous namespace
+
+
+bool POCatalog::CompileToMO(const wxString& mo_file,
+                            ValidationResults& validation_results,
+                            CompilationStatus& mo_compilation_status)
+{
+    perf::ScopedTimer timer("POCatalog::CompileToMO");
+    timer.SetItemsCount(m_items.size());
+    mo_compilation_status = CompilationStatus::NotDone;
+
+    // Validate() only writes a temporary PO file if it has to use msgfmt:
+    validation_results = Validate();
+
+    TempOutputFileFor mo_file_temp_obj(mo_file);
+    const wxString mo_file_temp = mo_file_temp_obj.FileName();
+
+    // Compile the MO file in-process. Like msgfmt, only translated entries
+    // are included, fuzzy ones are omitted and the header always is.
+    MOWriter mo(m_header.Charset);
+    wxArrayString header;
+    header.push_back(UnescapeCString(m_header.ToString()));
+    bool mo_ok = mo.IsOk() && mo.Add(false, wxString(), wxString(), wxString(), header);
+    for (auto& item: m_items)
+    {
+        if (!mo_ok)
+            break;
+        if (!item->IsTranslated() || item->IsFuzzy())
+            continue;
+        mo_ok = mo.Add(item->HasContext(), item->GetContext(),
+                       item->GetRawString(),
+                       item->HasPlural() ? item->GetRawPluralString() : wxString(),
+                       item->GetTranslations());
+    }
+    if (!mo_ok || !mo.Write(mo_file_temp))
+    {
+        mo_compilation_status = CompilationStatus::Error;
+        return false;
+    }
+    else
+    {
+        mo_compilation_status = CompilationStatus::Success;
+    }
+
+    if ( !mo_file_temp_obj.Commit() )
+    {
+        wxLogError(_(L"Couldn’t save file %s."), mo_file.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+
+
+
+bool POCatalog::DoSaveOnly(const wxString& po_file, wxTextFileType crlf)
+{
+    POOutput f(po_file, crlf);
+    return DoSaveOnly(f) && f.Finish();
+}
+
+bool POCatalog::DoSaveOnly(POOutput& f)
+{
+    /* Save .po file: */
+    if (!m_header.Charset || m_header.Charset == "CHARSET")
+        m_header.Charset = "UTF-8";
+
+    if (!f.Start(m_header.Charset))
+        return false;
+
+    SaveHeader(f);
+
+    auto pluralsCount = GetPluralFormsCount();
+
+    for (auto& data: m_items)
+        SaveItem(f, static_cast<POCatalogItem&>(*data), pluralsCount);
+
+    // Write back deleted items in the file so that they're not lost
+    for (unsigned itemIdx = 0; itemIdx < m_deletedItems.size(); itemIdx++)
+    {
+        if ( itemIdx != 0 )
+            f.AddLine(wxEmptyString);
+
+        POCatalogDeletedData& deletedItem = m_deletedItems[itemIdx];
+        deletedItem.SetLineNumber(int(f.GetLineCount()+1));
+        SaveMultiLines(f, deletedItem.GetRawText());
+    }
+
+    if (!f.CanEncode())
+    {
+#if wxUSE_GUI
+        wxString msg;
         msg.Printf(_(L"The file couldn’t be saved in “%s” charset as specified in translation settings.\n\nIt was saved in UTF-8 instead and the setting was modified accordingly."),
                    m_header.Charset.c_str());
         wxMessageBox(msg, _("Error saving file"),
@@ -1568,13 +2746,756 @@ bool POCatalog::DoSaveOnly(wxTextBuffer& f, wxTextFileType crlf)
 #endif
         m_header.Charset = "UTF-8";
 
-        // Re-do the save again because we modified a header:
-        f.Clear();
-        return DoSaveOnly(f, crlf);
+        // Re-do the save again because we modified a header:
+        return DoSaveOnly(f);
+    }
+
+    return true;
+}
+
+
+void POCatalog::SaveHeader(POOutput& f)
+{
+    SaveMultiLines(f, m_header.Comment);
+    if (m_fileType == Type::POT)
+        f.AddLine(wxS("#, fuzzy"));
+    f.AddLine(wxS("msgid \"\""));
+    f.AddLine(wxS("msgstr \"\""));
+    wxString pohdr = wxString(wxS("\"")) + m_header.ToString(wxS("\"\n\""));
+    pohdr.RemoveLast();
+    SaveMultiLines(f, pohdr);
+    f.AddLine(wxEmptyString);
+}
+
+
+void POCatalog::SaveItem(POOutput& f, POCatalogItem& item, unsigned pluralsCount)
+{
+    item.SetLineNumber(int(f.GetLineCount()+1));
+    SaveMultiLines(f, item.GetComment());
+    for (unsigned i = 0; i < item.GetExtractedComments().GetCount(); i++)
+    {
+        if (item.GetExtractedComments()[i].empty())
+          f.AddLine(wxS("#."));
+        else
+          f.AddLine(wxS("#. ") + item.GetExtractedComments()[i]);
+    }
+    for (unsigned i = 0; i < item.GetRawReferences().GetCount(); i++)
+        f.AddLine(wxS("#: ") + item.GetRawReferences()[i]);
+    wxString dummy = item.GetFlags();
+    if (!dummy.empty())
+        f.AddLine(wxS("#") + dummy);
+    for (unsigned i = 0; i < item.GetOldMsgidRaw().GetCount(); i++)
+        f.AddLine(wxS("#| ") + item.GetOldMsgidRaw()[i]);
+    if ( item.HasContext() )
+    {
+        SaveMultiLines(f, wxS("msgctxt \"") + FormatStringForFile(item.GetContext()) + wxS("\""));
+    }
+    dummy = FormatStringForFile(item.GetRawString());
+    SaveMultiLines(f, wxS("msgid \"") + dummy + wxS("\""));
+    if (item.HasPlural())
+    {
+        dummy = FormatStringForFile(item.GetRawPluralString());
+        SaveMultiLines(f, wxS("msgid_plural \"") + dummy + wxS("\""));
+
+        for (unsigned i = 0; i < pluralsCount; i++)
+        {
+            dummy = FormatStringForFile(item.GetTranslation(i));
+            wxString hdr = wxString::Format(wxS("msgstr[%u] \""), i);
+            SaveMultiLines(f, hdr + dummy + wxS("\""));
+        }
+    }
+    else
+    {
+        dummy = FormatStringForFile(item.GetTranslation());
+        SaveMultiLines(f, wxS("msgstr \"") + dummy + wxS("\""));
+    }
+    f.AddLine(wxEmptyString);
+}
+
+
+wxString POCatalog::GetMsgcatWrappingFlag() const
+{
+    int wrapping = DEFAULT_WRAPPING;
+    if (wxConfig::Get()->ReadBool("keep_crlf", true))
+        wrapping = m_fileWrappingWidth;
+
+    if (wrapping == DEFAULT_WRAPPING)
+    {
+        if (wxConfig::Get()->ReadBool("wrap_po_files", true))
+        {
+            wrapping = (int)wxConfig::Get()->ReadLong("wrap_po_files_width", 79);
+        }
+        else
+        {
+            wrapping = NO_WRAPPING;
+        }
+    }
+
+    wxString wrappingFlag;
+    if (wrapping == NO_WRAPPING)
+        wrappingFlag = " --no-wrap";
+    else if (wrapping != DEFAULT_WRAPPING)
+        wrappingFlag.Printf(" --width=%d", wrapping);
+    return wrappingFlag;
+}
+
+
+bool POCatalog::FormatWithMsgcat(const wxString& po_file, const wxString& output_file) const
+{
+    auto msgcatCmd = wxString::Format("msgcat --force-po%s -o %s %s",
+                                      GetMsgcatWrappingFlag(),
+                                      QuoteCmdlineArg(output_file),
+                                      QuoteCmdlineArg(po_file));
+    wxLogTrace("poedit", "formatting file with %s", msgcatCmd);
+
+    // Ignore msgcat errors output (but not exit code), because it
+    //   a) complains about things DoValidate() already complained above
+    //   b) issues warnings about source-extraction things (e.g. using non-ASCII
+    //      msgids) that, while correct, are not something a *translator* can
+    //      do anything about.
+    wxLogNull null;
+    return ExecuteGettext(msgcatCmd) && wxFileExists(output_file);
+}
+
+
+bool POCatalog::FormatWithMsgcat(const std::string& po_data, std::string& output) const
+{
+    auto msgcatCmd = wxString::Format("msgcat --force-po%s -o - -", GetMsgcatWrappingFlag());
+    wxLogTrace("poedit", "formatting data with %s", msgcatCmd);
+
+    // see above for why errors are ignored
+    wxArrayString ignoredErrors;
+    return ExecuteGettextWithPipes(msgcatCmd, po_data, output, &ignoredErrors) && !output.empty();
+}
+
+
+struct POCatalog::FileLayout
+{
+    struct Entry
+    {
+        size_t fingerprint;
+        size_t begin, end;
+    };
+
+    wxString filename;
+    size_t fileSize;
+    size_t fileHash;
+    wxString charset;
+    wxTextFileType crlf;
+    unsigned pluralsCount;
+    size_t deletedCount;
+    size_t headerBegin, headerEnd;
+    std::vector<Entry> entries;
+};
+
+
+namespace
+{
+
+inline size_t HashBytes(const std::string& data)
+{
+    return std::hash<std::string_view>()(std::string_view(data));
+}
+
+} // anonymous namespace
+
+
+size_t POCatalog::GetItemFingerprint(const POCatalogItem& item)
+{
+    size_t seed = 0;
+    auto add = [&seed](size_t h)
+    {
+        seed ^= h + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    };
+    auto addStr = [&add](const wxString& s)
+    {
+        add(std::hash<std::wstring>()(s.ToStdWstring()));
+    };
+    auto addArray = [&add, &addStr](const wxArrayString& a)
+    {
+        add(a.size());
+        for (auto& s: a)
+            addStr(s);
+    };
+
+    addStr(item.GetRawString());
+    add(item.HasPlural());
+    if (item.HasPlural())
+        addStr(item.GetRawPluralString());
+    add(item.HasContext());
+    if (item.HasContext())
+        addStr(item.GetContext());
+    addArray(item.GetTranslations());
+    addStr(item.GetComment());
+    addArray(item.GetExtractedComments());
+    addArray(item.GetRawReferences());
+    addStr(item.GetFlags());
+    addArray(item.GetOldMsgidRaw());
+    return seed;
+}
+
+
+void POCatalog::UpdateFileLayout(const wxString& po_file, const POFileData& data,
+                                 wxTextFileType crlf, bool updateLineNumbers)
+{
+    m_fileLayout.reset();
+
+    POFileData::EntryRange header;
+    std::vector<POFileData::EntryRange> entries;
+    if (!data.FindEntries(header, entries) || entries.size() != m_items.size())
+    {
+        wxLogTrace("poedit", "layout of %s not recognized, it will be saved in full", po_file);
+        return;
+    }
+
+    auto layout = std::make_shared<FileLayout>();
+    layout->filename = po_file;
+    layout->fileSize = data.GetBytes().size();
+    layout->fileHash = HashBytes(data.GetBytes());
+    layout->charset = m_header.Charset;
+    layout->crlf = crlf;
+    layout->pluralsCount = GetPluralFormsCount();
+    layout->deletedCount = m_deletedItems.size();
+    layout->headerBegin = header.begin;
+    layout->headerEnd = header.end;
+    layout->entries.reserve(entries.size());
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        auto& item = static_cast<POCatalogItem&>(*m_items[i]);
+        if (updateLineNumbers)
+        {
+            item.SetLineNumber(entries[i].itemLine + 1);
+        }
+        else if (item.GetLineNumber() != entries[i].itemLine + 1)
+        {
+            // entries weren't matched to items correctly, don't risk it
+            wxLogTrace("poedit", "layout of %s doesn't match parsed entries", po_file);
+            return;
+        }
+        layout->entries.push_back({GetItemFingerprint(item), entries[i].begin, entries[i].end});
+    }
+
+    m_fileLayout = layout;
+}
+
+
+bool POCatalog::SaveIncrementally(const wxString& po_file, const wxString& output_file, wxTextFileType crlf)
+{
+    if (!m_fileLayout)
+        return false;
+    const FileLayout& layout = *m_fileLayout;
+
+    if (!m_header.Charset || m_header.Charset == "CHARSET")
+        m_header.Charset = "UTF-8";
+
+    const auto pluralsCount = GetPluralFormsCount();
+
+    if (layout.filename != po_file ||
+        layout.crlf != crlf ||
+        layout.charset != m_header.Charset ||
+        layout.pluralsCount != pluralsCount ||
+        layout.deletedCount != m_deletedItems.size() ||
+        layout.entries.size() != m_items.size())
+    {
+        return false;
+    }
+
+    // Items are compared by content rather than by their modification flag,
+    // which doesn't capture all changes (e.g. pre-translation, fixups done
+    // on load or source references changed by the user):
+    std::vector<size_t> changed;
+    for (size_t i = 0; i < m_items.size(); i++)
+    {
+        if (GetItemFingerprint(static_cast<POCatalogItem&>(*m_items[i])) != layout.entries[i].fingerprint)
+            changed.push_back(i);
+    }
+
+    // Note that this is done regardless of how many entries changed: only
+    // the changed ones are formatted by msgcat below, which is never slower
+    // than formatting the whole file, and unchanged entries are kept exactly
+    // as they are in the file, byte for byte, instead of being re-wrapped.
+
+    // The file must be exactly as we left it, not modified by somebody else:
+    POFileData original(po_file);
+    if (!original.IsOk() ||
+        original.GetBytes().size() != layout.fileSize ||
+        HashBytes(original.GetBytes()) != layout.fileHash)
+    {
+        return false;
+    }
+
+    // Format the header and changed entries the same way full save would,
+    // piping them through msgcat in memory:
+    std::string changedData, formattedData;
+    {
+        POOutput f(wxString(), wxTextFileType_Unix);
+        f.Start(m_header.Charset);
+        SaveHeader(f);
+        for (auto i: changed)
+            SaveItem(f, static_cast<POCatalogItem&>(*m_items[i]), pluralsCount);
+        if (!f.Finish() || !f.CanEncode())
+            return false;
+        changedData = f.TakeData();
+    }
+
+    if (!FormatWithMsgcat(changedData, formattedData))
+        return false;
+
+    // msgcat's exit code isn't known, but entries are checked below:
+    POFileData formatted(std::move(formattedData), output_file);
+    POFileData::EntryRange header;
+    std::vector<POFileData::EntryRange> entries;
+    if (!formatted.IsOk() || !formatted.FindEntries(header, entries) || entries.size() != changed.size())
+        return false;
+
+    // Replace old versions of changed entries with the new ones:
+    const std::string& src = original.GetBytes();
+    const std::string& repl = formatted.GetBytes();
+    std::string out;
+    out.reserve(src.size() + (repl.size() * 11 / 10));
+
+    size_t pos = 0;
+    auto replace = [&](size_t begin, size_t end, const POFileData::EntryRange& with)
+    {
+        out.append(src, pos, begin - pos);
+        if (crlf == wxTextFileType_Dos)
+        {
+            // msgcat always outputs Unix line endings
+            for (size_t i = with.begin; i < with.end; i++)
+            {
+                if (repl[i] == '\n')
+                    out += '\r';
+                out += repl[i];
+            }
+        }
+        else
+        {
+            out.append(repl, with.begin, with.end - with.begin);
+        }
+        pos = end;
+    };
+
+    replace(layout.headerBegin, layout.headerEnd, header);
+    for (size_t i = 0; i < changed.size(); i++)
+    {
+        auto& e = layout.entries[changed[i]];
+        replace(e.begin, e.end, entries[i]);
+    }
+    out.append(src, pos, std::string::npos);
+
+    wxFile file;
+    if (!file.Create(output_file, /*overwrite=*/true))
+        return false;
+    const bool ok = file.Write(out.data(), out.size()) == out.size();
+    return file.Close() && ok;
+}
+
+
+// ----------------------------------------------------------------------
+// Cache of parsed files
+// ----------------------------------------------------------------------
+
+namespace
+{
+
+wxString gs_catalogCacheDir;
+
+// Only files this big are cached, small ones are parsed fast enough:
+const size_t CACHE_MIN_FILE_SIZE = 1024 * 1024;
+
+// Increment when changing the format of cache files:
+const char CACHE_MAGIC[] = "PoeditPOCache";
+const uint32_t CACHE_VERSION = 2;
+
+// Writes cache data in a simple binary format with little-endian integers
+// and length-prefixed UTF-8 strings.
+class CacheWriter
+{
+public:
+    void U32(uint32_t v)
+    {
+        for (int i = 0; i < 4; i++)
+            m_data += char((v >> (8 * i)) & 0xFF);
+    }
+
+    void U64(uint64_t v)
+    {
+        U32(uint32_t(v & 0xFFFFFFFF));
+        U32(uint32_t(v >> 32));
+    }
+
+    void Str(const wxString& s)
+    {
+        const wxScopedCharBuffer buf(s.utf8_str());
+        U32((uint32_t)buf.length());
+        m_data.append(buf.data(), buf.length());
+    }
+
+    void Array(const wxArrayString& a)
+    {
+        U32((uint32_t)a.size());
+        for (auto& s: a)
+            Str(s);
+    }
+
+    void Raw(const char *data, size_t len) { m_data.append(data, len); }
+
+    std::string& Data() { return m_data; }
+
+private:
+    std::string m_data;
+};
+
+// Reads data written by CacheWriter. Reading past the end of data or
+// encountering other inconsistencies sets an error flag (see IsOk()).
+class CacheReader
+{
+public:
+    CacheReader(const std::string& data) : m_pos(data.data()), m_end(data.data() + data.size()), m_ok(true) {}
+
+    bool IsOk() const { return m_ok; }
+
+    uint32_t U32()
+    {
+        if (!Has(4))
+            return 0;
+        auto p = (const unsigned char*)m_pos;
+        m_pos += 4;
+        return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    uint64_t U64()
+    {
+        const uint64_t lo = U32();
+        return lo | (uint64_t(U32()) << 32);
+    }
+
+    wxString Str()
+    {
+        const uint32_t len = U32();
+        if (!Has(len))
+            return wxString();
+        auto s = wxString::FromUTF8(m_pos, len);
+        m_pos += len;
+        return s;
+    }
+
+    wxArrayString Array()
+    {
+        wxArrayString a;
+        const uint32_t count = U32();
+        if (!Has(count * size_t(4)))  // sanity check, every string is at least 4 bytes long
+            return a;
+        a.reserve(count);
+        for (uint32_t i = 0; i < count && m_ok; i++)
+            a.push_back(Str());
+        return a;
+    }
+
+    bool Raw(const char *expected, size_t len)
+    {
+        if (!Has(len) || memcmp(m_pos, expected, len) != 0)
+            return m_ok = false;
+        m_pos += len;
+        return true;
+    }
+
+private:
+    bool Has(size_t len)
+    {
+        if (m_ok && size_t(m_end - m_pos) >= len)
+            return true;
+        m_ok = false;
+        return false;
+    }
+
+    const char *m_pos, *m_end;
+    bool m_ok;
+};
+
+} // anonymous namespace
+
+
+void POCatalog::SetCacheDir(const wxString& dir)
+{
+    gs_catalogCacheDir = dir;
+}
+
+
+wxString POCatalog::GetCacheFileName(const wxString& po_file)
+{
+    if (gs_catalogCacheDir.empty())
+        return wxString();
+
+    wxFileName fn(po_file);
+    fn.Normalize(wxPATH_NORM_DOTS | wxPATH_NORM_ABSOLUTE);
+    const auto hash = std::hash<std::wstring>()(fn.GetFullPath().ToStdWstring());
+    return wxString::Format("%s%c%016llx.cache", gs_catalogCacheDir, wxFILE_SEP_PATH, (unsigned long long)hash);
+}
+
+
+bool POCatalog::ScanStatistics(const wxString& po_file, FileStatistics& stats)
+{
+    POFileData data(po_file);
+    if (!data.IsOk())
+        return false;
+
+    stats = FileStatistics();
+    return data.ScanStatistics(stats);
+}
+
+
+POCatalog::Preview POCatalog::CreatePreview(const wxString& po_file, size_t maxItems, std::chrono::milliseconds timeBudget)
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeBudget;
+
+    POFileData data(po_file);
+    if (!data.IsOk())
+    {
+        throw Exception(_(L"Couldn’t load the file, it is probably damaged."));
+    }
+
+    // Scanning is much faster than parsing, but it still takes a while with
+    // huge files, so give up on statistics if they take too long:
+    Preview preview;
+    preview.hasStatistics = data.ScanStatistics(preview.stats, deadline);
+
+    const size_t previewEnd = data.FindPreviewEnd(maxItems);
+    preview.truncated = preview.hasStatistics ? (size_t)preview.stats.all > maxItems
+                                              : previewEnd < data.GetBytes().size();
+    data.Truncate(previewEnd);
+
+    POCatalogPtr cat(new POCatalog(GetTypeFromFileName(po_file)));
+    cat->m_fileName = po_file;
+    {
+        wxLogNull null; // previews don't report errors
+        cat->ParseFileData(data, 0);
+    }
+    cat->FixupCommonIssues();
+    cat->PostCreation();
+
+    preview.catalog = cat;
+    return preview;
+}
+
+
+bool POCatalog::LoadFromCache(const wxString& po_file, size_t fileSize, wxInt64 mtime)
+{
+    if (fileSize < CACHE_MIN_FILE_SIZE)
+        return false;
+    const wxString cacheFile = GetCacheFileName(po_file);
+    if (cacheFile.empty() || !wxFileName::FileExists(cacheFile))
+        return false;
+
+    std::string data;
+    {
+        wxLogNull null;
+        wxFile f;
+        if (!f.Open(cacheFile))
+            return false;
+        const auto len = f.Length();
+        if (len <= 0)
+            return false;
+        data.resize((size_t)len);
+        if (f.Read(&data[0], (size_t)len) != (ssize_t)len)
+            return false;
+    }
+
+    CacheReader r(data);
+    if (!r.Raw(CACHE_MAGIC, sizeof(CACHE_MAGIC)) || r.U32() != CACHE_VERSION)
+        return false;
+    // It must be the same file and it must not have been modified since:
+    if (r.Str() != po_file || r.U64() != fileSize || r.U64() != (uint64_t)mtime || !r.IsOk())
+        return false;
+
+    wxString headerStr;
+    const uint32_t headerCount = r.U32();
+    for (uint32_t i = 0; i < headerCount && r.IsOk(); i++)
+    {
+        headerStr << r.Str() << ':';
+        headerStr << r.Str() << '\n';
+    }
+    const wxString headerComment = r.Str();
+    const wxString charset = r.Str();
+    const auto crlf = (wxTextFileType)r.U32();
+    const int wrapping = (int)r.U32();
+    const bool hasPluralItems = r.U32() != 0;
+
+    // sanity check of counts against the data size (an entry takes more than 16 bytes):
+    const uint32_t itemsCount = r.U32();
+    if (itemsCount > data.size() / 16)
+        return false;
+    CatalogItemArray items(itemsCount);
+    for (auto& i: items)
+    {
+        auto d = std::make_shared<POCatalogItem>();
+        d->SetId((int)r.U32());
+        d->SetLineNumber((int)r.U32());
+        const uint32_t bits = r.U32();
+        auto flags = r.Str();
+        if (!flags.empty())
+            d->SetFlags(flags);
+        d->SetString(r.Str());
+        auto plural = r.Str();
+        if (bits & 1)
+            d->SetPluralString(plural);
+        auto context = r.Str();
+        if (bits & 2)
+            d->SetContext(context);
+        d->SetTranslations(r.Array());
+        d->SetComment(r.Str());
+        d->SetRawReferences(r.Array());
+        d->SetExtractedComments(r.Array());
+        d->SetOldMsgid(r.Array());
+        if (!r.IsOk())
+            return false;
+        i = d;
+    }
+
+    const uint32_t deletedCount = r.U32();
+    if (deletedCount > data.size() / 16)
+        return false;
+    POCatalogDeletedDataArray deletedItems(deletedCount);
+    for (auto& d: deletedItems)
+    {
+        d = POCatalogDeletedData::FromRawText(r.Str());
+        d.SetLineNumber((int)r.U32());
+        if (!r.IsOk())
+            return false;
+    }
+
+    std::shared_ptr<FileLayout> layout;
+    if (r.U32())
+    {
+        layout = std::make_shared<FileLayout>();
+        layout->filename = po_file;
+        layout->fileSize = fileSize;
+        layout->fileHash = (size_t)r.U64();
+        layout->charset = charset;
+        layout->crlf = crlf;
+        layout->deletedCount = deletedItems.size();
+        layout->headerBegin = (size_t)r.U64();
+        layout->headerEnd = (size_t)r.U64();
+        layout->entries.resize(items.size());
+        for (size_t i = 0; i < items.size() && r.IsOk(); i++)
+        {
+            auto& e = layout->entries[i];
+            e.fingerprint = GetItemFingerprint(static_cast<POCatalogItem&>(*items[i]));
+            e.begin = (size_t)r.U64();
+            e.end = (size_t)r.U64();
+        }
+    }
+
+    if (!r.IsOk())
+        return false;
+
+    // Everything was read successfully, initialize the catalog:
+    {
+        wxLogNull null; // malformed lines were already reported when parsing the file
+        m_header.FromString(headerStr);
+    }
+    m_header.Comment = headerComment;
+    m_header.Charset = charset;
+    m_sourceLanguage = GetSpecifiedMsgidLanguage(m_header);
+    m_fileCRLF = crlf;
+    m_fileWrappingWidth = wrapping;
+    m_hasPluralItems = hasPluralItems;
+    m_items = std::move(items);
+    m_deletedItems = std::move(deletedItems);
+    InvalidateItemsIndex();
+    if (layout)
+    {
+        layout->pluralsCount = GetPluralFormsCount();
+        m_fileLayout = layout;
+    }
+
+    wxLogTrace("poedit", "loaded %s from cache", po_file);
+    return true;
+}
+
+
+void POCatalog::WriteCache(const wxString& po_file, size_t fileSize, wxInt64 mtime)
+{
+    if (fileSize < CACHE_MIN_FILE_SIZE)
+        return;
+    const wxString cacheFile = GetCacheFileName(po_file);
+    if (cacheFile.empty())
+        return;
+
+    // Take a snapshot of the data now, before the catalog is modified by the
+    // user, and only write it out in the background:
+    CacheWriter w;
+    w.Raw(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    w.U32(CACHE_VERSION);
+    w.Str(po_file);
+    w.U64(fileSize);
+    w.U64((uint64_t)mtime);
+
+    auto& headers = m_header.GetAllHeaders();
+    w.U32((uint32_t)headers.size());
+    for (auto& h: headers)
+    {
+        w.Str(h.Key);
+        w.Str(h.Value);
+    }
+    w.Str(m_header.Comment);
+    w.Str(m_header.Charset);
+    w.U32((uint32_t)m_fileCRLF);
+    w.U32((uint32_t)m_fileWrappingWidth);
+    w.U32(m_hasPluralItems);
+
+    w.U32((uint32_t)m_items.size());
+    for (auto& i: m_items)
+    {
+        auto& d = static_cast<POCatalogItem&>(*i);
+        w.U32((uint32_t)d.GetId());
+        w.U32((uint32_t)d.GetLineNumber());
+        w.U32((d.HasPlural() ? 1 : 0) | (d.HasContext() ? 2 : 0));
+        w.Str(d.GetFlags());
+        w.Str(d.GetRawString());
+        w.Str(d.GetRawPluralString());
+        w.Str(d.GetContext());
+        w.Array(d.GetTranslations());
+        w.Str(d.GetComment());
+        w.Array(d.GetRawReferences());
+        w.Array(d.GetExtractedComments());
+        w.Array(d.GetOldMsgidRaw());
     }
 
-    // Otherwise everything can be safely saved:
-    return f.Write(crlf, wxCSConv(m_header.Charset));
+    w.U32((uint32_t)m_deletedItems.size());
+    for (auto& d: m_deletedItems)
+    {
+        w.Str(d.GetRawText());
+        w.U32((uint32_t)d.GetLineNumber());
+    }
+
+    w.U32(m_fileLayout ? 1 : 0);
+    if (m_fileLayout)
+    {
+        w.U64(m_fileLayout->fileHash);
+        w.U64(m_fileLayout->headerBegin);
+        w.U64(m_fileLayout->headerEnd);
+        for (auto& e: m_fileLayout->entries)
+        {
+            w.U64(e.begin);
+            w.U64(e.end);
+        }
+    }
+
+    dispatch::async([cacheFile, data = std::move(w.Data())]
+    {
+        wxLogNull null;
+        wxFileName::Mkdir(wxFileName(cacheFile).GetPath(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+
+        TempOutputFileFor temp(cacheFile);
+        wxFile f;
+        if (!f.Create(temp.FileName(), /*overwrite=*/true))
+            return;
+        const bool ok = f.Write(data.data(), data.size()) == data.size();
+        if (f.Close() && ok)
+            temp.Commit();
+    });
 }
 
 void POCatalog::SetLanguage(Language lang)
@@ -1611,51 +3532,461 @@ bool POCatalog::HasWrongPluralFormsCount() const
 }
 
 
+namespace
+{
+
+// Appends items of @a from that aren't in @a to yet
+void MergeArrays(wxArrayString& to, const wxArrayString& from)
+{
+    for (auto& i: from)
+    {
+        if (to.Index(i) == wxNOT_FOUND)
+            to.push_back(i);
+    }
+}
+
+} // anonymous namespace
+
+
 bool POCatalog::HasDuplicateItems() const
 {
-    typedef std::pair<wxString, wxString> MsgId;
-    std::set<MsgId> ids;
+    std::unordered_set<std::wstring> ids;
+    ids.reserve(m_items.size());
     for (auto& item: m_items)
     {
-        if (!ids.emplace(std::make_pair(item->GetContext(), item->GetRawString())).second)
+        if (!ids.insert(item->GetLookupKey()).second)
             return true;
     }
     return false;
 }
 
-bool POCatalog::FixDuplicateItems()
+bool POCatalog::FixDuplicateItems()
+{
+    // Merge duplicates into their first occurrence, similarly to msguniq:
+    // references, extracted and translator's comments are combined and if
+    // the translations differ, the first one is kept, but marked as fuzzy.
+    std::unordered_map<std::wstring, size_t> firstOccurrence;
+    firstOccurrence.reserve(m_items.size());
+
+    CatalogItemArray unique;
+    unique.reserve(m_items.size());
+
+    for (auto& item: m_items)
+    {
+        auto found = firstOccurrence.emplace(item->GetLookupKey(), unique.size());
+        if (found.second)
+        {
+            unique.push_back(item);
+            continue;
+        }
+
+        auto& first = static_cast<POCatalogItem&>(*unique[found.first->second]);
+        auto& dupe = static_cast<POCatalogItem&>(*item);
+
+        wxArrayString refs = first.GetRawReferences();
+        MergeArrays(refs, dupe.GetRawReferences());
+        first.SetRawReferences(refs);
+
+        wxArrayString extracted = first.GetExtractedComments();
+        MergeArrays(extracted, dupe.GetExtractedComments());
+        first.SetExtractedComments(extracted);
+
+        if (!dupe.GetComment().empty() && !first.GetComment().Contains(dupe.GetComment()))
+            first.SetComment(first.GetComment() + dupe.GetComment());
+
+        if (dupe.GetTranslation(0).empty())
+            continue;
+
+        if (first.GetTranslation(0).empty())
+        {
+            // use the only available translation as it is
+            first.SetTranslations(dupe.GetTranslations());
+            first.SetFuzzy(dupe.IsFuzzy());
+            if (!first.HasOldMsgid())
+                first.SetOldMsgid(dupe.GetOldMsgidRaw());
+        }
+        else if (first.GetTranslations() != dupe.GetTranslations())
+        {
+            first.SetFuzzy(true);
+        }
+    }
+
+    if (unique.size() == m_items.size())
+        return true;
+
+    m_items = std::move(unique);
+    for (size_t i = 0; i < m_items.size(); i++)
+        static_cast<POCatalogItem&>(*m_items[i]).SetId(int(i + 1));
+    m_fileLayout.reset();
+    InvalidateItemsIndex();
+
+    return true;
+}
+
+
+namespace
+{
+
+/**
+    Format directives used in a format string, for the purpose of checking
+    that translations are compatible with the source text the same way
+    "msgfmt --check-format" does.
+
+    Arguments are identified either by position (0-based; numbered arguments
+    such as "%2$s" are stored at their position, possibly leaving unused
+    positions empty) or by name (Python's "%(name)s").
+ */
+struct FormatSpec
+{
+    std::vector<std::string> positional; // type class of each argument, empty if unused
+    std::map<std::string, std::string> named;
+
+    bool SetPositional(size_t index, const std::string& type)
+    {
+        if (positional.size() <= index)
+            positional.resize(index + 1);
+        if (!positional[index].empty() && positional[index] != type)
+            return false; // the same argument used with incompatible types
+        positional[index] = type;
+        return true;
+    }
+};
+
+inline bool IsOneOf(wxUniChar c, const char *chars)
+{
+    return c.IsAscii() && c != 0 && strchr(chars, (char)c.GetValue()) != nullptr;
+}
+
+// Format flags that CheckFormat() understands:
+bool IsNativelyCheckedFormat(const std::string& format)
+{
+    return format == "c" || format == "objc" || format == "php" || format == "python";
+}
+
+// Reads a decimal number at position i, if there's one; returns -1 if not.
+long ReadFormatNumber(const wxString& s, size_t& i)
+{
+    if (i >= s.length() || !wxIsdigit(s[i]))
+        return -1;
+    long n = 0;
+    while (i < s.length() && wxIsdigit(s[i]))
+        n = n * 10 + long(s[i++].GetValue() - '0');
+    return n;
+}
+
+// Parses C (and Objective-C) or PHP printf-style format string.
+bool ParsePrintfFormat(const wxString& s, bool php, FormatSpec& spec)
+{
+    size_t sequential = 0;
+    bool usesNumbered = false, usesSequential = false;
+
+    auto addArg = [&](long number, const std::string& type)
+    {
+        if (number > 0)
+            usesNumbered = true;
+        else
+            usesSequential = true;
+        if (usesNumbered && usesSequential)
+            return false; // mixing numbered and unnumbered arguments isn't allowed
+        return spec.SetPositional(number > 0 ? size_t(number - 1) : sequential++, type);
+    };
+
+    // reads "n$" argument number, if present
+    auto readArgNumber = [&s](size_t& i) -> long
+    {
+        size_t j = i;
+        long n = ReadFormatNumber(s, j);
+        if (n > 0 && j < s.length() && s[j] == '$')
+        {
+            i = j + 1;
+            return n;
+        }
+        return 0;
+    };
+
+    const size_t len = s.length();
+    for (size_t i = 0; i < len; i++)
+    {
+        if (s[i] != '%')
+            continue;
+        if (++i == len)
+            return false;
+        if (s[i] == '%')
+            continue;
+
+        long number = readArgNumber(i);
+
+        // flags:
+        while (i < len)
+        {
+            const wxUniChar c = s[i];
+            if (c == '-' || c == '+' || c == ' ' || c == '#' || c == '0' || (!php && (c == '\'' || c == 'I')))
+                i++;
+            else if (php && c == '\'' && i + 1 < len)
+                i += 2; // custom padding character
+            else
+                break;
+        }
+
+        // width:
+        if (i < len && s[i] == '*' && !php)
+        {
+            i++;
+            if (!addArg(readArgNumber(i), "i"))
+                return false;
+        }
+        else
+        {
+            ReadFormatNumber(s, i);
+        }
+
+        // precision:
+        if (i < len && s[i] == '.')
+        {
+            i++;
+            if (i < len && s[i] == '*' && !php)
+            {
+                i++;
+                if (!addArg(readArgNumber(i), "i"))
+                    return false;
+            }
+            else
+            {
+                ReadFormatNumber(s, i);
+            }
+        }
+
+        std::string type;
+        if (!php)
+        {
+            // size modifiers are significant, "%ld" is not compatible with "%d":
+            while (i < len && IsOneOf(s[i], "hlLqjzt"))
+                type += char(s[i++].GetValue());
+
+            // <inttypes.h> macros as written in PO files, e.g. "%<PRId64>":
+            if (i < len && s[i] == '<')
+            {
+                auto end = s.find('>', i);
+                if (end == wxString::npos)
+                    return false;
+                type += str::to_utf8(s.substr(i, end - i + 1));
+                if (!addArg(number, type))
+                    return false;
+                i = end;
+                continue;
+            }
+        }
+
+        if (i == len)
+            return false;
+
+        const wxUniChar conv = s[i];
+        const char *cls = nullptr;
+        if (php)
+        {
+            if (IsOneOf(conv, "bcdouxX"))
+                cls = "i";
+            else if (IsOneOf(conv, "eEfFgG"))
+                cls = "f";
+            else if (conv == 's')
+                cls = "s";
+        }
+        else
+        {
+            if (conv == 'd' || conv == 'i')
+                cls = "i";
+            else if (IsOneOf(conv, "ouxX"))
+                cls = "u";
+            else if (IsOneOf(conv, "eEfFgGaA"))
+                cls = "f";
+            else if (conv == 'c' || conv == 'C')
+                cls = (conv == 'C') ? "lc" : "c";
+            else if (conv == 's' || conv == 'S')
+                cls = (conv == 'S') ? "ls" : "s";
+            else if (conv == 'p')
+                cls = "p";
+            else if (conv == 'n')
+                cls = "n";
+            else if (conv == '@')
+                cls = "@"; // Objective-C object
+        }
+        if (!cls)
+            return false;
+
+        if (!addArg(number, type + cls))
+            return false;
+    }
+
+    return true;
+}
+
+// Parses Python %-style format string.
+bool ParsePythonFormat(const wxString& s, FormatSpec& spec)
+{
+    size_t sequential = 0;
+    const size_t len = s.length();
+    for (size_t i = 0; i < len; i++)
+    {
+        if (s[i] != '%')
+            continue;
+        if (++i == len)
+            return false;
+        if (s[i] == '%')
+            continue;
+
+        std::string name;
+        if (s[i] == '(')
+        {
+            auto end = s.find(')', i);
+            if (end == wxString::npos)
+                return false;
+            name = str::to_utf8(s.substr(i + 1, end - i - 1));
+            i = end + 1;
+        }
+
+        while (i < len && IsOneOf(s[i], "#0- +"))
+            i++;
+
+        if (i < len && s[i] == '*')
+        {
+            if (!name.empty())
+                return false;
+            spec.SetPositional(sequential++, "i");
+            i++;
+        }
+        else
+        {
+            ReadFormatNumber(s, i);
+        }
+
+        if (i < len && s[i] == '.')
+        {
+            i++;
+            if (i < len && s[i] == '*')
+            {
+                if (!name.empty())
+                    return false;
+                spec.SetPositional(sequential++, "i");
+                i++;
+            }
+            else
+            {
+                ReadFormatNumber(s, i);
+            }
+        }
+
+        while (i < len && IsOneOf(s[i], "hlL"))
+            i++;
+
+        if (i == len)
+            return false;
+
+        const wxUniChar conv = s[i];
+        const char *cls = nullptr;
+        if (IsOneOf(conv, "diouxX"))
+            cls = "i";
+        else if (IsOneOf(conv, "eEfFgG"))
+            cls = "f";
+        else if (conv == 'c')
+            cls = "c";
+        else if (conv == 's' || conv == 'r' || conv == 'a')
+            cls = "s";
+        if (!cls)
+            return false;
+
+        if (name.empty())
+        {
+            spec.SetPositional(sequential++, cls);
+        }
+        else
+        {
+            auto existing = spec.named.find(name);
+            if (existing != spec.named.end() && existing->second != cls)
+                return false;
+            spec.named[name] = cls;
+        }
+    }
+
+    // named and unnamed arguments can't be mixed:
+    return spec.named.empty() || spec.positional.empty();
+}
+
+bool ParseFormat(const std::string& format, const wxString& s, FormatSpec& spec)
 {
-    auto oldname = m_fileName;
+    if (format == "python")
+        return ParsePythonFormat(s, spec);
+    else
+        return ParsePrintfFormat(s, /*php=*/format == "php", spec);
+}
 
-    TempDirectory tmpdir;
-    if ( !tmpdir.IsOk() )
-        return false;
+/**
+    Checks that format directives in @a translation are compatible with
+    @a source. If @a allowMissing is true, arguments may be omitted from
+    the translation (as is common e.g. in singular plural forms).
 
-    wxString ext;
-    wxFileName::SplitPath(m_fileName, nullptr, nullptr, &ext);
-    wxString po_file_temp = tmpdir.CreateFileName("catalog." + ext);
-    wxString po_file_fixed = tmpdir.CreateFileName("fixed." + ext);
+    Returns error message or empty string if everything is OK.
+ */
+wxString CheckFormat(const std::string& format, const wxString& source, const wxString& translation, bool allowMissing)
+{
+    FormatSpec src, trans;
+    if (!ParseFormat(format, source, src))
+        return wxString(); // the source isn't a valid format string, can't check anything based on it
+    if (!ParseFormat(format, translation, trans))
+        return _(L"The translation isn’t a valid format string.");
 
-    if ( !DoSaveOnly(po_file_temp, wxTextFileType_Unix) )
+    for (auto& t: trans.named)
     {
-        wxLogError(_(L"Couldn’t save file %s."), po_file_temp.c_str());
-        return false;
+        auto s = src.named.find(t.first);
+        if (s == src.named.end())
+            return wxString::Format(_(L"Format specifier “%s” isn’t in the source text."), wxString::FromUTF8(t.first));
+        if (s->second != t.second)
+            return wxString::Format(_(L"Format specifier “%s” doesn’t match the source text."), wxString::FromUTF8(t.first));
+    }
+    if (!allowMissing)
+    {
+        for (auto& s: src.named)
+        {
+            if (trans.named.find(s.first) == trans.named.end())
+                return wxString::Format(_(L"Format specifier “%s” is missing from the translation."), wxString::FromUTF8(s.first));
+        }
     }
 
-    ExecuteGettext(wxString::Format("msguniq -o %s %s",
-                                    QuoteCmdlineArg(CliSafeFileName(po_file_fixed)),
-                                    QuoteCmdlineArg(CliSafeFileName(po_file_temp))));
-
-    if (!wxFileName::FileExists(po_file_fixed))
-        return false;
+    const size_t count = std::max(src.positional.size(), trans.positional.size());
+    for (size_t i = 0; i < count; i++)
+    {
+        const std::string none;
+        const auto& s = i < src.positional.size() ? src.positional[i] : none;
+        const auto& t = i < trans.positional.size() ? trans.positional[i] : none;
+        if (s == t)
+            continue;
+        if (s.empty())
+            return wxString::Format(_(L"The translation uses format argument %d, which isn’t in the source text."), int(i + 1));
+        if (t.empty())
+        {
+            if (allowMissing)
+                continue;
+            return wxString::Format(_(L"Format argument %d is missing from the translation."), int(i + 1));
+        }
+        return wxString::Format(_(L"Format specifiers for argument %d differ between the source text and the translation."), int(i + 1));
+    }
 
-    Load(po_file_fixed);
-    m_fileName = oldname;
-    PostCreation();
+    return wxString();
+}
 
-    return true;
+// Check for consistency of leading and trailing newlines (done by msgfmt too).
+wxString CheckNewlines(const wxString& source, const wxString& translation)
+{
+    if (translation.empty())
+        return wxString();
+    if (source.starts_with(wxS("\n")) != translation.starts_with(wxS("\n")))
+        return _(L"The source text and the translation don’t both begin with a newline.");
+    if (source.ends_with(wxS("\n")) != translation.ends_with(wxS("\n")))
+        return _(L"The source text and the translation don’t both end with a newline.");
+    return wxString();
 }
 
+} // anonymous namespace
+
 
 Catalog::ValidationResults POCatalog::Validate(const wxString& fileWithSameContent)
 {
@@ -1664,12 +3995,17 @@ Catalog::ValidationResults POCatalog::Validate(const wxString& fileWithSameConte
     if (!HasCapability(Catalog::Cap::Translations))
         return res;  // no errors in POT files
 
-    if (!fileWithSameContent.empty())
+    if (CanValidateNatively())
+    {
+        ValidateNatively(res);
+    }
+    else if (!fileWithSameContent.empty())
     {
         ValidateWithMsgfmt(res, fileWithSameContent);
     }
-    else
+    else if ( !ValidateWithMsgfmtPipe(res, SaveToBuffer()) )
     {
+        // fall back to using a temporary file if the data couldn't be piped
         TempDirectory tmpdir;
         if ( !tmpdir.IsOk() )
             return res;
@@ -1684,22 +4020,84 @@ Catalog::ValidationResults POCatalog::Validate(const wxString& fileWithSameConte
     return res;
 }
 
-void POCatalog::ValidateWithMsgfmt(Catalog::ValidationResults& res, const wxString& po_file)
+bool POCatalog::CanValidateNatively() const
+{
+    for (auto& i: m_items)
+    {
+        auto format = i->GetFormatFlag();
+        if (!format.empty() && !IsNativelyCheckedFormat(format))
+            return false;
+    }
+    return true;
+}
+
+void POCatalog::ValidateNatively(Catalog::ValidationResults& res)
+{
+    std::atomic<int> errors(0);
+
+    const bool hasPluralFormsHeader = m_header.HasHeader("Plural-Forms");
+    const unsigned nplurals = GetCountFromPluralFormsHeader(m_header);
+    if (m_hasPluralItems && !hasPluralFormsHeader)
+    {
+        wxLogError(_(L"The file contains plural forms, but its header doesn’t specify them (Plural-Forms is missing)."));
+        errors++;
+    }
+
+    auto checkItem = [&](const CatalogItemPtr& item)
+    {
+        if (!item->IsTranslated() || item->IsFuzzy())
+            return;
+
+        const auto& translations = item->GetTranslations();
+        const auto format = item->GetFormatFlag();
+        wxString error;
+
+        if (item->HasPlural() && hasPluralFormsHeader && translations.size() != nplurals)
+        {
+            error = wxString::Format(_(L"The translation has %d plural forms, but the file’s header specifies %d."),
+                                     (int)translations.size(), (int)nplurals);
+        }
+
+        for (size_t n = 0; n < translations.size() && error.empty(); n++)
+        {
+            const bool isPluralForm = item->HasPlural();
+            const auto& source = (isPluralForm && n > 0) ? item->GetRawPluralString() : item->GetRawString();
+            error = CheckNewlines(source, translations[n]);
+            if (error.empty() && !format.empty())
+                error = CheckFormat(format, isPluralForm ? item->GetRawPluralString() : source, translations[n],
+                                    /*allowMissing=*/isPluralForm);
+        }
+
+        if (!error.empty())
+        {
+            item->SetIssue(CatalogItem::Issue::Error, error);
+            errors++;
+        }
+    };
+
+    // Items are independent of each other, so check large catalogs in parallel:
+    static const size_t PARALLEL_VALIDATION_GRAIN = 1000;
+    dispatch::parallel_for(m_items.size(), PARALLEL_VALIDATION_GRAIN, [&](size_t start, size_t end)
+    {
+        for (size_t i = start; i < end; i++)
+            checkItem(m_items[i]);
+    });
+
+    res.errors += errors;
+}
+
+namespace
 {
-    GettextErrors err;
-    ExecuteGettextAndParseOutput
-    (
-        wxString::Format("msgfmt -o /dev/null -c %s", QuoteCmdlineArg(CliSafeFileName(po_file))),
-        err
-    );
 
+void ReportMsgfmtErrors(Catalog& catalog, Catalog::ValidationResults& res, const GettextErrors& err)
+{
     res.errors += (int)err.size();
 
     for ( GettextErrors::const_iterator i = err.begin(); i != err.end(); ++i )
     {
         if ( i->line != -1 )
         {
-            auto item = FindItemByLine(i->line);
+            auto item = catalog.FindItemByLine(i->line);
             if ( item )
             {
                 item->SetIssue(CatalogItem::Issue::Error, i->text);
@@ -1711,6 +4109,34 @@ void POCatalog::ValidateWithMsgfmt(Catalog::ValidationResults& res, const wxStri
     }
 }
 
+} // anonymous namespace
+
+void POCatalog::ValidateWithMsgfmt(Catalog::ValidationResults& res, const wxString& po_file)
+{
+    GettextErrors err;
+    ExecuteGettextAndParseOutput
+    (
+        wxString::Format("msgfmt -o /dev/null -c %s", QuoteCmdlineArg(CliSafeFileName(po_file))),
+        err
+    );
+
+    ReportMsgfmtErrors(*this, res, err);
+}
+
+bool POCatalog::ValidateWithMsgfmtPipe(Catalog::ValidationResults& res, const std::string& po_data)
+{
+    if (po_data.empty())
+        return false;
+
+    GettextErrors err;
+    std::string ignoredOutput;
+    if (!ExecuteGettextWithPipesAndParseOutput("msgfmt -o /dev/null -c -", po_data, ignoredOutput, err))
+        return false;
+
+    ReportMsgfmtErrors(*this, res, err);
+    return true;
+}
+
 
 bool POCatalog::UpdateFromPOT(const wxString& pot_file, bool replace_header)
 {
@@ -1728,6 +4154,9 @@ bool POCatalog::UpdateFromPOT(const wxString& pot_file, bool replace_header)
 
 bool POCatalog::UpdateFromPOT(POCatalogPtr pot, bool replace_header)
 {
+    perf::ScopedTimer timer("POCatalog::UpdateFromPOT");
+    timer.SetItemsCount(pot->GetCount());
+
     switch (m_fileType)
     {
         case Type::PO:
@@ -1739,6 +4168,7 @@ bool POCatalog::UpdateFromPOT(POCatalogPtr pot, bool replace_header)
         case Type::POT:
         {
             m_items = pot->m_items;
+            InvalidateItemsIndex();
             m_sourceLanguage = pot->m_sourceLanguage;
             m_sourceIsSymbolicID = pot->m_sourceIsSymbolicID;
             m_hasPluralItems = pot->m_hasPluralItems;
@@ -1765,54 +4195,467 @@ POCatalogPtr POCatalog::CreateFromPOT(POCatalogPtr pot)
         return nullptr;
 }
 
-bool POCatalog::Merge(const POCatalogPtr& refcat)
+namespace
 {
-    wxString oldname = m_fileName;
 
-    TempDirectory tmpdir;
-    if ( !tmpdir.IsOk() )
-        return false;
+// Appends items of @a add not yet present in @a to
+void MergeArrays(wxArrayString& to, const wxArrayString& add)
+{
+    for (auto& a: add)
+    {
+        if (to.Index(a) == wxNOT_FOUND)
+            to.Add(a);
+    }
+}
+
+// Merges flags strings in the ", c-format, no-wrap" format
+wxString MergeFlags(const wxString& to, const wxString& add)
+{
+    wxString out(to);
+    wxStringTokenizer tkn(add, ", ", wxTOKEN_STRTOK);
+    while (tkn.HasMoreTokens())
+    {
+        const wxString flag = ", " + tkn.GetNextToken();
+        if ((out + ",").find(flag + ",") == wxString::npos)
+            out += flag;
+    }
+    return out;
+}
+
+} // anonymous namespace
+
+POCatalogPtr POCatalog::CreateByConcatenating(const std::vector<wxString>& files)
+{
+    if (files.empty())
+        return nullptr;
+
+    std::vector<dispatch::future<POCatalogPtr>> loading;
+    loading.reserve(files.size());
+    for (auto& f: files)
+        loading.push_back(dispatch::async([f]{ return POCatalog::Create(f, CreationFlag_IgnoreHeader); }));
+
+    std::vector<POCatalogPtr> parts;
+    parts.reserve(files.size());
+    std::exception_ptr error;
+    for (auto& l: loading)
+    {
+        // wait for all of them even on errors, so that none outlives the call
+        try
+        {
+            parts.push_back(l.get());
+        }
+        catch (...)
+        {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+
+    auto out = parts.front();
+    if (parts.size() == 1)
+        return out;
+
+    auto key = [](const CatalogItem& item)
+    {
+        std::wstring k;
+        if (item.HasContext())
+            k = item.GetContext().ToStdWstring() + L'\x04';
+        k += item.GetRawString().ToStdWstring();
+        return k;
+    };
+
+    std::unordered_map<std::wstring, POCatalogItemPtr> index;
+    for (auto& i: out->m_items)
+    {
+        auto item = std::static_pointer_cast<POCatalogItem>(i);
+        index.emplace(key(*item), item);
+    }
+
+    for (size_t p = 1; p < parts.size(); p++)
+    {
+        auto& part = parts[p];
+        out->m_hasPluralItems |= part->m_hasPluralItems;
 
-    wxString tmp1 = tmpdir.CreateFileName("ref.pot");
-    wxString tmp2 = tmpdir.CreateFileName("input.po");
-    wxString tmp3 = tmpdir.CreateFileName("output.po");
+        for (auto& i: part->m_items)
+        {
+            auto item = std::static_pointer_cast<POCatalogItem>(i);
+            auto existing = index.emplace(key(*item), item);
+            if (existing.second)
+            {
+                out->m_items.push_back(item);
+                continue;
+            }
+
+            auto& into = *existing.first->second;
+            MergeArrays(into.m_references, item->m_references);
+            if (item->HasExtractedComments())
+            {
+                auto comments = into.GetExtractedComments();
+                MergeArrays(comments, item->GetExtractedComments());
+                into.SetExtractedComments(comments);
+            }
+            if (item->GetFlags() != into.GetFlags())
+                into.SetFlags(MergeFlags(into.GetFlags(), item->GetFlags()));
+            if (item->HasPlural() && !into.HasPlural())
+                into.SetPluralString(item->GetRawPluralString());
+        }
+    }
+
+    int id = 1;
+    for (auto& i: out->m_items)
+        i->SetId(id++);
+    out->InvalidateItemsIndex();
+
+    return out;
+}
+
+
+namespace
+{
+
+// Minimal similarity of fuzzy matches, same as msgmerge's
+const double FUZZY_THRESHOLD = 0.6;
+
+// Similarly to msgmerge, translations with different context are slightly
+// less likely to be appropriate:
+const double FUZZY_OTHER_CONTEXT_PENALTY = 0.99;
+
+/**
+    Returns similarity of two strings in the 0..1 range, computed like gettext's
+    fstrcmp() from the length of their longest common subsequence.
+
+    Returns 0 if the similarity is certainly below @a lowerBound.
+ */
+double StringSimilarity(const std::wstring& a, const std::wstring& b, double lowerBound)
+{
+    const size_t total = a.size() + b.size();
+    if (total == 0)
+        return 1.0;
+
+    const std::wstring& shorter = a.size() <= b.size() ? a : b;
+    const std::wstring& longer = a.size() <= b.size() ? b : a;
+    if (2.0 * shorter.size() / total < lowerBound)
+        return 0.0;
+
+    std::vector<uint32_t> row(shorter.size() + 1, 0);
+    for (auto c: longer)
+    {
+        uint32_t diag = 0;
+        for (size_t j = 0; j < shorter.size(); j++)
+        {
+            const uint32_t up = row[j + 1];
+            row[j + 1] = (c == shorter[j]) ? diag + 1 : std::max(up, row[j]);
+            diag = up;
+        }
+    }
+    return 2.0 * row[shorter.size()] / total;
+}
+
+/**
+    Index of translated entries used to find fuzzy matches for new strings.
+
+    Like msgmerge, candidates are found by counting character trigrams they
+    share with the searched string and only the most promising ones are then
+    compared with StringSimilarity(). Searching is thread-safe.
+ */
+class FuzzyMergeIndex
+{
+public:
+    FuzzyMergeIndex(const CatalogItemArray& items)
+    {
+        for (size_t idx = 0; idx < items.size(); idx++)
+        {
+            auto& item = *items[idx];
+            if (item.GetTranslation(0).empty())
+                continue;
+
+            Entry e;
+            e.index = idx;
+            e.text = item.GetRawString().ToStdWstring();
+            e.context = item.HasContext() ? item.GetLookupKey() : std::wstring();
+            auto grams = Trigrams(e.text);
+            e.gramsCount = grams.size();
+            for (auto g: grams)
+                m_postings[g].push_back(uint32_t(m_entries.size()));
+            m_entries.push_back(std::move(e));
+        }
+    }
+
+    size_t size() const { return m_entries.size(); }
+
+    /**
+        Returns index (into the items array passed to ctor) of the best fuzzy
+        match for @a item or -1 if there's none.
+
+        @a counts is a scratch buffer reused between calls from the same thread.
+     */
+    int FindBestMatch(const CatalogItem& item, std::vector<uint32_t>& counts) const
+    {
+        const auto text = item.GetRawString().ToStdWstring();
+        const auto context = item.HasContext() ? item.GetLookupKey() : std::wstring();
+        const auto grams = Trigrams(text);
+
+        std::vector<const std::vector<uint32_t>*> lists;
+        for (auto g: grams)
+        {
+            auto i = m_postings.find(g);
+            if (i != m_postings.end())
+                lists.push_back(&i->second);
+        }
+
+        // Very common trigrams don't help much with finding candidates, but take
+        // a lot of time to process, so ignore them unless there's nothing else:
+        const size_t commonLimit = std::max<size_t>(1000, m_entries.size() / 20);
+        const auto rare = std::count_if(lists.begin(), lists.end(),
+                                        [=](auto l){ return l->size() <= commonLimit; });
+
+        counts.resize(m_entries.size(), 0);
+        std::vector<uint32_t> touched;
+        for (auto l: lists)
+        {
+            if (rare >= 3 && l->size() > commonLimit)
+                continue;
+            for (auto idx: *l)
+            {
+                if (counts[idx]++ == 0)
+                    touched.push_back(idx);
+            }
+        }
+
+        std::vector<std::pair<double, uint32_t>> candidates;
+        candidates.reserve(touched.size());
+        for (auto idx: touched)
+        {
+            const double dice = 2.0 * counts[idx] / (grams.size() + m_entries[idx].gramsCount);
+            candidates.emplace_back(dice, idx);
+            counts[idx] = 0;
+        }
+        const size_t top = std::min(candidates.size(), MAX_CANDIDATES);
+        std::partial_sort(candidates.begin(), candidates.begin() + top, candidates.end(),
+                          [](const auto& a, const auto& b){ return a.first > b.first; });
+
+        int best = -1;
+        double bestScore = FUZZY_THRESHOLD;
+        for (size_t c = 0; c < top; c++)
+        {
+            auto& e = m_entries[candidates[c].second];
+            double score = StringSimilarity(text, e.text, bestScore);
+            if (e.context != context)
+                score *= FUZZY_OTHER_CONTEXT_PENALTY;
+            if (score > bestScore || (best == -1 && score == bestScore))
+            {
+                best = int(e.index);
+                bestScore = score;
+            }
+        }
+        return best;
+    }
+
+private:
+    static constexpr size_t MAX_CANDIDATES = 16;
+
+    // Returns set of (packed) trigrams of the string. The string is padded
+    // with a boundary marker, so that even short strings have some.
+    static std::vector<uint64_t> Trigrams(const std::wstring& text)
+    {
+        auto pack = [](wchar_t a, wchar_t b, wchar_t c)
+        {
+            return (uint64_t(a & 0x1FFFFF) << 42) | (uint64_t(b & 0x1FFFFF) << 21) | uint64_t(c & 0x1FFFFF);
+        };
+
+        const std::wstring s = L'\x01' + text + L'\x01';
+        std::vector<uint64_t> grams;
+        grams.reserve(s.size());
+        if (s.size() < 3)
+            grams.push_back(pack(s[0], s[1], 0));
+        for (size_t i = 0; i + 2 < s.size(); i++)
+            grams.push_back(pack(s[i], s[i+1], s[i+2]));
+        std::sort(grams.begin(), grams.end());
+        grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+        return grams;
+    }
+
+    struct Entry
+    {
+        size_t index;
+        std::wstring text;
+        std::wstring context;
+        size_t gramsCount;
+    };
+
+    std::vector<Entry> m_entries;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> m_postings;
+};
+
+// Adds PO file lines for given keyword and string (e.g. msgid "foo") to @a lines
+void AddPOLines(wxArrayString& lines, const wxString& prefix, const wxString& keyword, const wxString& text)
+{
+    const wxString formatted = keyword + wxS(" \"") + FormatStringForFile(text) + wxS("\"");
+    for (auto& ln: wxSplit(formatted, '\n', '\0'))
+        lines.push_back(prefix + ln);
+}
+
+} // anonymous namespace
+
+
+bool POCatalog::Merge(const POCatalogPtr& refcat)
+{
+    // This does the same as msgmerge --previous would, but in-process and
+    // (for large catalogs) with fuzzy matching done in parallel.
+
+    const bool fuzzyMatching = Config::MergeBehavior() != Merge_None;
+    const unsigned pluralsCount = GetPluralFormsCount();
+    const auto& refItems = refcat->m_items;
 
-    refcat->DoSaveOnly(tmp1, wxTextFileType_Unix);
-    DoSaveOnly(tmp2, wxTextFileType_Unix);
+    std::vector<int> matches(refItems.size(), -1);
+    std::vector<char> isExact(refItems.size(), false);
+    std::vector<size_t> unmatched;
+    for (size_t i = 0; i < refItems.size(); i++)
+    {
+        auto& ref = *refItems[i];
+        const int exact = FindItemIndexByString(ref.GetRawString(), ref.HasContext(), ref.GetContext());
+        if (exact != -1)
+        {
+            matches[i] = exact;
+            isExact[i] = true;
+        }
+        else
+        {
+            unmatched.push_back(i);
+        }
+    }
 
-    wxString flags("-q --force-po --previous");
-    if (Config::MergeBehavior() == Merge_None)
+    if (fuzzyMatching && !unmatched.empty())
     {
-        flags += " --no-fuzzy-matching";
+        FuzzyMergeIndex index(m_items);
+        if (index.size())
+        {
+            auto findMatches = [&](size_t begin, size_t end)
+            {
+                std::vector<uint32_t> counts;
+                for (size_t u = begin; u < end; u++)
+                    matches[unmatched[u]] = index.FindBestMatch(*refItems[unmatched[u]], counts);
+            };
+
+            dispatch::parallel_for(unmatched.size(), /*grain=*/50, findMatches);
+        }
     }
 
-    bool succ = ExecuteGettext
-                (
-                    wxString::Format
-                    (
-                        "msgmerge %s -o %s %s %s",
-                        flags,
-                        QuoteCmdlineArg(tmp3),
-                        QuoteCmdlineArg(tmp2),
-                        QuoteCmdlineArg(tmp1)
-                    )
-                );
+    CatalogItemArray merged;
+    merged.reserve(refItems.size());
+    std::vector<char> used(m_items.size(), false);
+    bool hasPluralItems = false;
+
+    for (size_t i = 0; i < refItems.size(); i++)
+    {
+        auto& ref = static_cast<POCatalogItem&>(*refItems[i]);
+
+        // Source strings and everything that comes with them (extracted
+        // comments, references, format flags) come from the reference:
+        auto item = std::make_shared<POCatalogItem>();
+        item->SetId(int(merged.size() + 1));
+        item->SetFlags(ref.m_moreFlags);
+        item->SetString(ref.GetRawString());
+        if (ref.HasPlural())
+        {
+            item->SetPluralString(ref.GetRawPluralString());
+            hasPluralItems = true;
+        }
+        if (ref.HasContext())
+            item->SetContext(ref.GetContext());
+        item->SetRawReferences(ref.GetRawReferences());
+        item->SetExtractedComments(ref.GetExtractedComments());
+
+        if (matches[i] == -1)
+        {
+            wxArrayString empty;
+            empty.Add(wxEmptyString, ref.HasPlural() ? pluralsCount : 1);
+            item->SetTranslations(empty);
+            merged.push_back(item);
+            continue;
+        }
+
+        // ...while translations and translator's comments are kept:
+        auto& def = static_cast<POCatalogItem&>(*m_items[matches[i]]);
+        used[matches[i]] = true;
+
+        item->SetComment(def.GetComment());
+
+        wxArrayString translations = def.GetTranslations();
+        bool fuzzy = def.IsFuzzy() || !isExact[i];
+        if (ref.HasPlural() != def.HasPlural())
+        {
+            const wxString singular = def.GetTranslation(0);
+            translations.clear();
+            translations.Add(singular, ref.HasPlural() ? pluralsCount : 1);
+            fuzzy = true;
+        }
+        else if (ref.HasPlural() && ref.GetRawPluralString() != def.GetRawPluralString())
+        {
+            fuzzy = true;
+        }
+        item->SetTranslations(translations);
+
+        if (fuzzy)
+        {
+            item->SetFuzzy(true);
+            if (isExact[i] && def.IsFuzzy())
+            {
+                item->SetOldMsgid(def.GetOldMsgidRaw());
+            }
+            else
+            {
+                wxArrayString old;
+                AddPOLines(old, wxString(), wxS("msgid"), def.GetRawString());
+                if (def.HasPlural())
+                    AddPOLines(old, wxString(), wxS("msgid_plural"), def.GetRawPluralString());
+                item->SetOldMsgid(old);
+            }
+        }
+
+        merged.push_back(item);
+    }
 
-    if (succ)
+    // Translations that are no longer used are kept as obsolete entries:
+    for (size_t i = 0; i < m_items.size(); i++)
     {
-        const wxString charset = m_header.Charset;
+        auto& def = static_cast<POCatalogItem&>(*m_items[i]);
+        if (used[i] || def.GetTranslation(0).empty())
+            continue;
 
-        Load(tmp3);
-        m_fileName = oldname;
-        PostCreation();
+        static const wxString prefix(wxS("#~ "));
+        wxArrayString lines;
+        if (def.HasContext())
+            AddPOLines(lines, prefix, wxS("msgctxt"), def.GetContext());
+        AddPOLines(lines, prefix, wxS("msgid"), def.GetRawString());
+        if (def.HasPlural())
+        {
+            AddPOLines(lines, prefix, wxS("msgid_plural"), def.GetRawPluralString());
+            for (unsigned n = 0; n < def.GetNumberOfTranslations(); n++)
+                AddPOLines(lines, prefix, wxString::Format(wxS("msgstr[%u]"), n), def.GetTranslation(n));
+        }
+        else
+        {
+            AddPOLines(lines, prefix, wxS("msgstr"), def.GetTranslation(0));
+        }
 
-        // msgmerge doesn't always preserve the charset, it tends to pick
-        // the most generic one of the charsets used, so if we are merging with
-        // UTF-8 catalog, it will become UTF-8. Some people hate this.
-        m_header.Charset = charset;
+        POCatalogDeletedData deleted(lines);
+        deleted.SetComment(def.GetComment());
+        deleted.SetFlags(def.GetFlags());
+        m_deletedItems.push_back(deleted);
     }
 
-    m_fileName = oldname;
+    m_items = std::move(merged);
+    m_hasPluralItems = hasPluralItems;
+    m_fileLayout.reset();
+    InvalidateItemsIndex();
 
-    return succ;
+    if (!refcat->Header().CreationDate.empty())
+        m_header.CreationDate = refcat->Header().CreationDate;
+
+    PostCreation();
+
+    return true;
 }
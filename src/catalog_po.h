@@ -28,8 +28,12 @@
 
 #include "catalog.h"
 
+#include <chrono>
+
 class POCatalogItem;
 class POCatalog;
+class POOutput;
+class POFileData;
 typedef std::shared_ptr<POCatalogItem> POCatalogItemPtr;
 typedef std::shared_ptr<POCatalog> POCatalogPtr;
 
@@ -42,12 +46,17 @@ public:
 
     wxArrayString GetReferences() const override;
 
+    void AddMemoryUsage(CatalogMemoryUsage& usage) const override;
+
 protected:
     const wxArrayString& GetRawReferences() const { return m_references; }
     void SetRawReferences(const wxArrayString& ref) { m_references = ref; }
 
     void UpdateInternalRepresentation() override {}
 
+    /// Creates a copy of the item for POCatalog::CreateSnapshot().
+    POCatalogItemPtr Clone() const;
+
     friend class POLoadParser;
     friend class POCatalog;
 
@@ -60,6 +69,11 @@ protected:
     This includes deleted lines, references, translation's status
     (fuzzy, non translated, translated) and optional comment(s).
 
+    Entries loaded from files are only kept as the raw text of their lines,
+    which is written back as it is, and are parsed into individual parts only
+    when one of them is accessed. Files often contain many more obsolete
+    entries than anybody ever looks at.
+
     This class is mostly internal, used by Catalog to store data.
  */
 class POCatalogDeletedData
@@ -67,37 +81,47 @@ class POCatalogDeletedData
 public:
     /// Ctor.
     POCatalogDeletedData()
-            : m_lineNum(0) {}
+            : m_parsed(true), m_lineNum(0) {}
     POCatalogDeletedData(const wxArrayString& deletedLines)
             : m_deletedLines(deletedLines),
-              m_lineNum(0) {}
+              m_parsed(true), m_lineNum(0) {}
+
+    /// Creates the entry from its raw lines, as in the file, separated by '\n'.
+    static POCatalogDeletedData FromRawText(const wxString& raw)
+    {
+        POCatalogDeletedData d;
+        d.m_raw = raw;
+        d.m_parsed = false;
+        return d;
+    }
+
+    POCatalogDeletedData(const POCatalogDeletedData& dt) = default;
+    POCatalogDeletedData& operator=(const POCatalogDeletedData& dt) = default;
 
-    POCatalogDeletedData(const POCatalogDeletedData& dt)
-            : m_deletedLines(dt.m_deletedLines),
-              m_references(dt.m_references),
-              m_extractedComments(dt.m_extractedComments),
-              m_flags(dt.m_flags),
-              m_comment(dt.m_comment),
-              m_lineNum(dt.m_lineNum) {}
+    /** Returns all lines of the entry (comments, flags and deleted lines)
+        as they are written to the file, separated by '\n'.
+     */
+    wxString GetRawText() const;
 
     /// Returns the deleted lines.
-    const wxArrayString& GetDeletedLines() const { return m_deletedLines; }
+    const wxArrayString& GetDeletedLines() const { EnsureParsed(); return m_deletedLines; }
 
     /// Returns references (#:) lines for the entry
-    const wxArrayString& GetRawReferences() const { return m_references; }
+    const wxArrayString& GetRawReferences() const { EnsureParsed(); return m_references; }
 
     /// Returns comment added by the translator to this entry
-    const wxString& GetComment() const { return m_comment; }
+    const wxString& GetComment() const { EnsureParsed(); return m_comment; }
 
     /// Returns array of all auto comments.
-    const wxArrayString& GetExtractedComments() const { return m_extractedComments; }
+    const wxArrayString& GetExtractedComments() const { EnsureParsed(); return m_extractedComments; }
 
     /// Convenience function: does this entry has a comment?
-    bool HasComment() const { return !m_comment.empty(); }
+    bool HasComment() const { return !GetComment().empty(); }
 
     /// Adds new reference to the entry (used by SourceDigger).
     void AddReference(const wxString& ref)
     {
+        PrepareForChange();
         if (m_references.Index(ref) == wxNOT_FOUND)
             m_references.Add(ref);
     }
@@ -105,12 +129,14 @@ public:
     /// Sets the string.
     void SetDeletedLines(const wxArrayString& a)
     {
+        PrepareForChange();
         m_deletedLines = a;
     }
 
     /// Sets the comment.
     void SetComment(const wxString& c)
     {
+        PrepareForChange();
         m_comment = c;
     }
 
@@ -118,10 +144,10 @@ public:
         either empty string or "#, fuzzy", "#, c-format",
         "#, fuzzy, c-format" or others (not understood by Poedit).
      */
-    void SetFlags(const wxString& flags) {m_flags = flags;};
+    void SetFlags(const wxString& flags) { PrepareForChange(); m_flags = flags; }
 
     /// Gets gettext flags. \see SetFlags
-    wxString GetFlags() const {return m_flags;};
+    wxString GetFlags() const { EnsureParsed(); return m_flags; }
 
     /// Sets the number of the line this entry occurs on.
     void SetLineNumber(int line) { m_lineNum = line; }
@@ -131,15 +157,38 @@ public:
     /// Adds new extracted comments (#. )
     void AddExtractedComments(const wxString& com)
     {
+        PrepareForChange();
         m_extractedComments.Add(com);
     }
 
+    /// Adds memory used by the entry's data to @a usage
+    void AddMemoryUsage(CatalogMemoryUsage& usage) const;
+
 private:
-    wxArrayString m_deletedLines;
+    void EnsureParsed() const
+    {
+        if (!m_parsed)
+            Parse();
+    }
+    void Parse() const;
+
+    // the raw text is no longer valid after modifications:
+    void PrepareForChange()
+    {
+        EnsureParsed();
+        m_raw.clear();
+    }
+
+    // raw text of the entry, if it was loaded and not modified since
+    wxString m_raw;
+
+    // individual parts, only valid if m_parsed:
+    mutable wxArrayString m_deletedLines;
+    mutable wxArrayString m_references, m_extractedComments;
+    mutable wxString m_flags;
+    mutable wxString m_comment;
+    mutable bool m_parsed;
 
-    wxArrayString m_references, m_extractedComments;
-    wxString m_flags;
-    wxString m_comment;
     int m_lineNum;
 };
 
@@ -180,6 +229,65 @@ public:
     static bool CanLoadFile(const wxString& extension);
     wxString GetPreferredExtension() const override;
 
+    /**
+        Returns true if @a filename is a gzip-compressed PO or POT file
+        (.po.gz, .pot.gz). Such files are decompressed in memory when loaded
+        and compressed again when saved.
+     */
+    static bool IsCompressedFileName(const wxString& filename);
+
+    /**
+        Enables caching of parsed large files in @a dir, so that reopening
+        them is faster. Caching is disabled if @a dir is empty (the default).
+     */
+    static void SetCacheDir(const wxString& dir);
+
+    /// Basic statistics of a PO file, see ScanStatistics()
+    struct FileStatistics
+    {
+        int all = 0;
+        int fuzzy = 0;
+        int untranslated = 0;
+        wxString revisionDate;
+    };
+
+    /**
+        Quickly computes statistics of @a po_file without loading it.
+
+        The file is only scanned for entries and their flags, no catalog
+        items are created, so this is much faster than loading the catalog
+        and calling GetStatistics(). Unlike it, validation errors are not
+        detected.
+
+        @return false if the file couldn't be scanned; the caller should
+                load the catalog normally to find out why.
+     */
+    static bool ScanStatistics(const wxString& po_file, FileStatistics& stats);
+
+    /// Result of CreatePreview()
+    struct Preview
+    {
+        POCatalogPtr catalog;
+        /// The catalog doesn't contain all of the file's entries
+        bool truncated = false;
+        /// Statistics of the whole file, valid only if hasStatistics is set
+        FileStatistics stats;
+        bool hasStatistics = false;
+    };
+
+    /**
+        Loads only the header and the first @a maxItems entries of @a po_file,
+        for quick previews of files of any size.
+
+        Statistics of the whole file are computed by ScanStatistics() if that
+        can be done within @a timeBudget, which is worthwhile because parsing
+        the entries is much slower than scanning them.
+
+        Throws on error.
+     */
+    static Preview CreatePreview(const wxString& po_file, size_t maxItems,
+                                 std::chrono::milliseconds timeBudget);
+
     unsigned GetPluralFormsCount() const override;
     void SetLanguage(Language lang) override;
 
@@ -189,6 +297,14 @@ public:
 
     std::string SaveToBuffer() override;
 
+    CatalogPtr CreateSnapshot() const override;
+
+    /// Adopts header dates, line numbers, layout of the saved file and
+    /// validation results of items that weren't modified in the meantime.
+    void AdoptSavedSnapshot(const Catalog& snapshot) override;
+
+    CatalogMemoryUsage GetMemoryUsage() const override;
+
     ValidationResults Validate(const wxString& fileWithSameContent) override;
 
     /// Compiles the catalog into binary MO file.
@@ -220,6 +336,19 @@ public:
     bool UpdateFromPOT(POCatalogPtr pot, bool replace_header = false);
     static POCatalogPtr CreateFromPOT(POCatalogPtr pot);
 
+    /**
+        Creates catalog by concatenating POT @a files produced by extraction,
+        in-process equivalent of msgcat.
+
+        The files are parsed in parallel (their headers are ignored). Entries
+        with the same context and msgid are merged into one, with the union of
+        their references, extracted comments and flags, in order of first
+        occurrence.
+
+        Throws on error.
+     */
+    static POCatalogPtr CreateByConcatenating(const std::vector<wxString>& files);
+
 protected:
     /** Loads catalog from .po file.
         If file named po_file ".poedit" (e.g. "cs.po.poedit") exists,
@@ -232,12 +361,16 @@ protected:
      */
     void Load(const wxString& po_file, int flags = 0);
 
+    /// Parses already read file content, returns false if some of it
+    /// couldn't be decoded. Throws on error.
+    bool ParseFileData(const POFileData& data, int flags);
+
     void Clear();
 
     /// Adds entry to the catalog (the catalog will take ownership of
     /// the object).
     void AddItem(const POCatalogItemPtr& data)
-        { m_items.push_back(data); }
+        { m_items.push_back(data); InvalidateItemsIndex(); }
 
     /// Adds entry to the catalog (the catalog will take ownership of
     /// the object).
@@ -248,9 +381,54 @@ protected:
     /// Fix commonly encountered fixable problems with loaded files
     void FixupCommonIssues();
 
+    /// Returns true if ValidateNatively() can check everything msgfmt would.
+    bool CanValidateNatively() const;
+    /// Performs msgfmt's checks (for supported format flags) in-process.
+    void ValidateNatively(ValidationResults& res);
     void ValidateWithMsgfmt(ValidationResults& res, const wxString& po_file);
+    /// Like ValidateWithMsgfmt(), but passes the data to msgfmt through a pipe.
+    bool ValidateWithMsgfmtPipe(ValidationResults& res, const std::string& po_data);
     bool DoSaveOnly(const wxString& po_file, wxTextFileType crlf);
-    bool DoSaveOnly(wxTextBuffer& f, wxTextFileType crlf);
+    bool DoSaveOnly(POOutput& f);
+    void SaveHeader(POOutput& f);
+    void SaveItem(POOutput& f, POCatalogItem& item, unsigned pluralsCount);
+
+    /// Returns msgcat's command line flag for the desired line wrapping.
+    wxString GetMsgcatWrappingFlag() const;
+    /// Reformats @a po_file with msgcat, writing into @a output_file.
+    bool FormatWithMsgcat(const wxString& po_file, const wxString& output_file) const;
+    /// Reformats PO data in memory, passing it through msgcat with pipes.
+    bool FormatWithMsgcat(const std::string& po_data, std::string& output) const;
+
+    /// Location and content of entries in the file as last loaded or saved.
+    struct FileLayout;
+
+    /** Remembers where entries are in (just loaded or saved) @a po_file
+        with @a crlf line endings.
+
+        If @a updateLineNumbers is false, items' line numbers must correspond
+        to the file, otherwise they are updated from it.
+     */
+    void UpdateFileLayout(const wxString& po_file, const POFileData& data,
+                          wxTextFileType crlf, bool updateLineNumbers);
+
+    /// Returns hash of all item's data that is written into the file.
+    static size_t GetItemFingerprint(const POCatalogItem& item);
+
+    /** Saves into @a output_file by only replacing entries that changed
+        since @a po_file was loaded or saved and keeping the rest as it is.
+
+        \return false if the file couldn't be saved this way, e.g. because
+                entries were added or removed or the file was modified externally.
+     */
+    bool SaveIncrementally(const wxString& po_file, const wxString& output_file, wxTextFileType crlf);
+
+    /// Returns name of the cache file for @a po_file or empty string if disabled.
+    static wxString GetCacheFileName(const wxString& po_file);
+    /// Loads the catalog from cache, if it has valid data for this version of the file.
+    bool LoadFromCache(const wxString& po_file, size_t fileSize, wxInt64 mtime);
+    /// Writes the just loaded catalog into the cache (in the background).
+    void WriteCache(const wxString& po_file, size_t fileSize, wxInt64 mtime);
 
     /** Merges the catalog with reference catalog
         (in the sense of msgmerge -- this catalog is old one with
@@ -268,6 +446,7 @@ protected:
     wxTextFileType m_fileCRLF;
     int m_fileWrappingWidth;
     bool m_hasPluralItems = false;
+    std::shared_ptr<FileLayout> m_fileLayout;
 
     friend class POLoadParser;
     friend class Catalog;
@@ -278,7 +457,7 @@ protected:
 class POCatalogParser
 {
 public:
-    POCatalogParser(wxTextFile *f)
+    POCatalogParser(wxTextBuffer *f)
         : m_textFile(f),
           m_detectedLineWidth(0),
           m_detectedWrappedLines(false),
@@ -348,7 +527,7 @@ protected:
     virtual void OnIgnoredEntry() {}
 
     /// Textfile being parsed.
-    wxTextFile *m_textFile;
+    wxTextBuffer *m_textFile;
     int m_detectedLineWidth;
     bool m_detectedWrappedLines;
     bool m_lastLineHardWrapped, m_previousLineHardWrapped;
@@ -26,17 +26,22 @@
 #include "catalog_xliff.h"
 
 #include "configuration.h"
+#include "perf_trace.h"
 #include "str_helpers.h"
 #include "utility.h"
 
+#include <wx/file.h>
 #include <wx/intl.h>
 #include <wx/log.h>
 
 #include <boost/algorithm/string.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
 #include <set>
 #include <sstream>
+#include <unordered_map>
 
 using namespace pugi;
 
@@ -50,6 +55,12 @@ namespace
 //        manually both ways when extracting _and_ editing text.
 constexpr auto PUGI_PARSE_FLAGS = parse_full | parse_ws_pcdata | parse_fragment;
 
+// Files at least this large are loaded in streaming mode (see XLIFFCatalog::IsStreamed())
+const wxFileOffset STREAMING_MIN_FILE_SIZE = 8 * 1024 * 1024;
+
+// Name of the processing instruction that marks streamed units' places in the skeleton
+#define STREAMED_UNIT_PI "poedit-streamed-unit"
+
 // Skip over a tag, starting at its '<' with forward iterator or '>' with reverse;
 // return iterator right after the tag or end if malformed
 template<typename Iter>
@@ -177,6 +188,12 @@ inline std::string get_node_text_with_metadata(xml_node node, const XLIFFStringM
     return s;
 }
 
+inline void revert_placeholders(std::string& s, const XLIFFStringMetadata& metadata)
+{
+    for (auto& ph: metadata.substitutions)
+        boost::replace_all(s, ph.placeholder, ph.markup);
+}
+
 bool set_node_text_with_metadata(xml_node node, std::string&& text, const XLIFFStringMetadata& metadata)
 {
     if (metadata.isPlainText)
@@ -187,8 +204,7 @@ bool set_node_text_with_metadata(xml_node node, std::string&& text, const XLIFFS
     else
     {
         std::string s(std::move(text));
-        for (auto& ph: metadata.substitutions)
-            boost::replace_all(s, ph.placeholder, ph.markup);
+        revert_placeholders(s, metadata);
 
         remove_all_children(node);
         auto result = node.append_buffer(s.c_str(), s.size(), PUGI_PARSE_FLAGS, encoding_utf8);
@@ -205,6 +221,20 @@ bool set_node_text_with_metadata(xml_node node, std::string&& text, const XLIFFS
     }
 }
 
+// Checks, without touching any document, if set_node_text_with_metadata() would succeed
+bool is_valid_text_with_metadata(std::string&& text, const XLIFFStringMetadata& metadata)
+{
+    if (metadata.isPlainText)
+        return true;
+
+    std::string s(std::move(text));
+    revert_placeholders(s, metadata);
+
+    xml_document doc;
+    auto result = doc.load_buffer(s.c_str(), s.size(), PUGI_PARSE_FLAGS, encoding_utf8);
+    return result.status == status_ok || result.status == status_no_document_element;
+}
+
 /// Check if a string contains only digit (e.g. "42")
 inline bool is_numeric_only(const std::string& s)
 {
@@ -212,6 +242,204 @@ inline bool is_numeric_only(const std::string& s)
 }
 
 
+// Reads the file's content if it is large enough to be streamed
+bool read_streamable_file(const wxString& filename, std::string& data)
+{
+    wxFile f(filename);
+    if (!f.IsOpened())
+        return false;
+    auto len = f.Length();
+    if (len < STREAMING_MIN_FILE_SIZE)
+        return false;
+
+    data.resize(len);
+    return f.Read(&data[0], len) == len;
+}
+
+// Checks that the XML data are in UTF-8, which streamed units are parsed as
+bool is_utf8_xml(const std::string& data)
+{
+    // UTF-16 or UTF-32, with or without BOM:
+    if (data.size() < 4 || data[0] == '\0' || data[1] == '\0' || (unsigned char)data[0] >= 0xFE)
+        return false;
+
+    if (data.compare(0, 5, "<?xml") != 0)
+        return true;
+    auto declEnd = data.find("?>");
+    if (declEnd == std::string::npos)
+        return false;
+    auto decl = data.substr(0, declEnd);
+    auto enc = decl.find("encoding");
+    if (enc == std::string::npos)
+        return true;
+    auto quote = decl.find_first_of("'\"", enc);
+    if (quote == std::string::npos)
+        return false;
+    auto value = decl.substr(quote + 1, decl.find(decl[quote], quote + 1) - quote - 1);
+    return boost::iequals(value, "utf-8") || boost::iequals(value, "utf8");
+}
+
+// Returns name of translation unit elements for the version of XLIFF
+// declared in the root tag, or NULL if not known
+const char *get_unit_element_name(const std::string& data)
+{
+    // find the root element's start tag, skipping over the prolog:
+    size_t pos = 0;
+    while ((pos = data.find('<', pos)) != std::string::npos)
+    {
+        if (data.compare(pos, 4, "<!--") == 0)
+            pos = data.find("-->", pos);
+        else if (data.compare(pos, 2, "<?") == 0)
+            pos = data.find("?>", pos);
+        else if (data.compare(pos, 2, "<!") == 0)
+            return nullptr;  // DOCTYPE, possibly with entity declarations
+        else
+            break;
+        if (pos == std::string::npos)
+            return nullptr;
+        pos += 2;
+    }
+    if (pos == std::string::npos)
+        return nullptr;
+
+    auto end = skip_over_tag(data.begin() + pos, data.end());
+    if (end == data.begin() + pos || *(end - 1) != '>')
+        return nullptr;
+
+    // parse it as an empty element to get at the attributes:
+    std::string tag(data.begin() + pos, end - 1);
+    if (tag.back() != '/')
+        tag += '/';
+    tag += '>';
+
+    xml_document doc;
+    if (!doc.load_buffer(tag.data(), tag.size(), parse_minimal, encoding_utf8))
+        return nullptr;
+    auto root = doc.child("xliff");
+    std::string version = root.attribute("version").value();
+    if (version == "1.0" || version == "1.1" || version == "1.2")
+        return "trans-unit";
+    else if (version == "2.0" || version == "2.1")
+        return "unit";
+    else
+        return nullptr;
+}
+
+// Finds byte ranges of all elements called @a name in XML data, which must not
+// be nested in each other. Returns false if the layout isn't understood.
+bool find_element_ranges(const std::string& data, const char *name, std::vector<std::pair<size_t, size_t>>& ranges)
+{
+    const size_t nameLen = strlen(name);
+    size_t openBegin = std::string::npos;
+
+    size_t pos = 0;
+    while ((pos = data.find('<', pos)) != std::string::npos)
+    {
+        const char *skipTo = nullptr;
+        if (data.compare(pos, 4, "<!--") == 0)
+            skipTo = "-->";
+        else if (data.compare(pos, 9, "<![CDATA[") == 0)
+            skipTo = "]]>";
+        else if (data.compare(pos, 2, "<?") == 0)
+            skipTo = "?>";
+        else if (data.compare(pos, 2, "<!") == 0)
+            return false;
+        if (skipTo)
+        {
+            pos = data.find(skipTo, pos + 2);
+            if (pos == std::string::npos)
+                return false;
+            pos += strlen(skipTo);
+            continue;
+        }
+
+        auto tagEnd = size_t(skip_over_tag(data.begin() + pos, data.end()) - data.begin());
+        if (data[tagEnd - 1] != '>')
+            return false;
+
+        const bool closing = data.compare(pos, 2, "</") == 0;
+        const size_t nameStart = pos + (closing ? 2 : 1);
+        if (data.compare(nameStart, nameLen, name) == 0 && nameStart + nameLen < data.size() &&
+            strchr(" \t\r\n/>", data[nameStart + nameLen]))
+        {
+            if (closing)
+            {
+                if (openBegin == std::string::npos)
+                    return false;
+                ranges.emplace_back(openBegin, tagEnd);
+                openBegin = std::string::npos;
+            }
+            else
+            {
+                if (openBegin != std::string::npos)
+                    return false;
+                if (data[tagEnd - 2] == '/')
+                    ranges.emplace_back(pos, tagEnd);
+                else
+                    openBegin = pos;
+            }
+        }
+
+        pos = tagEnd;
+    }
+
+    return openBegin == std::string::npos;
+}
+
+// Prepares streamed loading: finds translation units in @a data and loads
+// the rest of the document into @a skeleton, with markers in place of units
+bool load_streamed_skeleton(const std::string& data, xml_document& skeleton, std::vector<std::pair<size_t, size_t>>& ranges)
+{
+    if (!is_utf8_xml(data))
+        return false;
+    auto unitName = get_unit_element_name(data);
+    if (!unitName)
+        return false;
+    if (!find_element_ranges(data, unitName, ranges) || ranges.empty())
+        return false;
+
+    std::string markup;
+    markup.reserve(ranges.front().first + (data.size() - ranges.back().second) + 32 * ranges.size());
+    size_t last = 0;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        markup.append(data, last, ranges[i].first - last);
+        markup.append("<?" STREAMED_UNIT_PI " ").append(std::to_string(i)).append("?>");
+        last = ranges[i].second;
+    }
+    markup.append(data, last, std::string::npos);
+
+    return skeleton.load_buffer(markup.data(), markup.size(), PUGI_PARSE_FLAGS);
+}
+
+void find_streamed_unit_markers(xml_node parent, std::vector<int>& indexes)
+{
+    for (auto child: parent.children())
+    {
+        if (child.type() == node_pi && strcmp(child.name(), STREAMED_UNIT_PI) == 0)
+            indexes.push_back(atoi(child.value()));
+        else if (child.type() == node_element)
+            find_streamed_unit_markers(child, indexes);
+    }
+}
+
+// Appends text, converting line endings to Unix ones like parse_eol does
+void append_with_unix_eol(std::string& out, const char *begin, const char *end)
+{
+    while (begin != end)
+    {
+        auto cr = std::find(begin, end, '\r');
+        out.append(begin, cr);
+        if (cr == end)
+            break;
+        out += '\n';
+        begin = cr + 1;
+        if (begin != end && *begin == '\n')
+            ++begin;
+    }
+}
+
+
 
 class MetadataExtractor : public pugi::xml_tree_walker
 {
@@ -450,8 +678,55 @@ XLIFFReadException::XLIFFReadException(const wxString& what)
 
 
 XLIFFCatalogItem::document_lock::document_lock(XLIFFCatalogItem *parent)
-    : std::lock_guard<std::mutex>(parent->m_owner.m_documentMutex)
+    : std::lock_guard<perf::InstrumentedMutex>(parent->m_owner.m_documentMutex)
+{
+}
+
+
+void XLIFFCatalogItem::SetStreamedUnit(int unitIndex, int segmentIndex)
+{
+    m_streamedUnit = unitIndex;
+    m_streamedSegment = segmentIndex;
+    m_node = xml_node();
+}
+
+
+void XLIFFCatalogItem::UpdateInternalRepresentation()
+{
+    wxASSERT( m_translations.size() == 1 ); // no plurals
+
+    // Modifying the pugixml tree requires locking the entire document, which
+    // would serialize bulk edits done in parallel. So only check the markup
+    // here and write the changes to the tree later, in FlushPendingChanges().
+    auto trans = GetTranslation();
+    if (!trans.empty() && !is_valid_text_with_metadata(str::to_utf8(trans), m_metadata))
+    {
+        // TRANSLATORS: Shown as error if a translation of XLIFF markup is not valid XML
+        SetIssue(Issue::Error, _("Broken markup in translation string."));
+    }
+
+    m_hasPendingChanges = true;
+}
+
+
+void XLIFFCatalogItem::FlushPendingChanges()
 {
+    if (m_hasPendingChanges.exchange(false))
+        WriteToDocument();
+}
+
+
+xml_node XLIFFCatalogItem::GetNode() const
+{
+    if (m_streamedUnit == -1)
+        return m_node;
+
+    auto unit = m_owner.GetStreamedUnit(m_streamedUnit);
+    if (m_streamedSegment == -1)
+        return unit;
+
+    auto segments = unit.select_nodes(".//segment");
+    return (size_t)m_streamedSegment < segments.size() ? segments[m_streamedSegment].node() : xml_node();
 }
 
 
@@ -480,10 +755,31 @@ bool XLIFFCatalog::CanLoadFile(const wxString& extension)
 
 std::shared_ptr<XLIFFCatalog> XLIFFCatalog::Open(const wxString& filename)
 {
+    perf::ScopedTimer timer("XLIFFCatalog::Open");
+
     xml_document doc;
-    auto result = doc.load_file(filename.fn_str(), PUGI_PARSE_FLAGS);
-    if (!result)
-        throw XLIFFReadException(result.description());
+    std::string fileData;
+    std::vector<std::pair<size_t, size_t>> unitRanges;
+
+    if (read_streamable_file(filename, fileData))
+    {
+        if (!load_streamed_skeleton(fileData, doc, unitRanges))
+        {
+            wxLogTrace("poedit", "XLIFF file %s can't be streamed, loading fully", filename);
+            unitRanges.clear();
+            auto result = doc.load_buffer(fileData.data(), fileData.size(), PUGI_PARSE_FLAGS);
+            if (!result)
+                throw XLIFFReadException(result.description());
+            fileData.clear();
+            fileData.shrink_to_fit();
+        }
+    }
+    else
+    {
+        auto result = doc.load_file(filename.fn_str(), PUGI_PARSE_FLAGS);
+        if (!result)
+            throw XLIFFReadException(result.description());
+    }
 
     std::shared_ptr<XLIFFCatalog> cat;
 
@@ -500,8 +796,17 @@ std::shared_ptr<XLIFFCatalog> XLIFFCatalog::Open(const wxString& filename)
     else
         throw XLIFFReadException(wxString::Format(_("unsupported version (%s)"), xliff_version));
 
+    if (!unitRanges.empty())
+    {
+        cat->m_fileData = std::move(fileData);
+        cat->m_units.reserve(unitRanges.size());
+        for (auto& r: unitRanges)
+            cat->m_units.push_back({r.first, r.second, nullptr});
+    }
+
     cat->Parse(xliff_root);
 
+    timer.SetItemsCount(cat->GetCount());
     return cat;
 }
 
@@ -510,6 +815,9 @@ bool XLIFFCatalog::Save(const wxString& filename, bool /*save_mo*/,
                         ValidationResults& validation_results,
                         CompilationStatus& /*mo_compilation_status*/)
 {
+    perf::ScopedTimer timer("XLIFFCatalog::Save");
+    timer.SetItemsCount(m_items.size());
+
     if ( wxFileExists(filename) && !wxFile::Access(filename, wxFile::write) )
     {
         wxLogError(_(L"File “%s” is read-only and cannot be saved.\nPlease save it under different name."),
@@ -517,9 +825,24 @@ bool XLIFFCatalog::Save(const wxString& filename, bool /*save_mo*/,
         return false;
     }
 
+    FlushPendingChanges();
+
     TempOutputFileFor tempfile(filename);
 
-    m_doc.save_file(tempfile.FileName().fn_str(), "\t", format_raw);
+    if (IsStreamed())
+    {
+        auto data = SaveToBuffer();
+        wxFile f(tempfile.FileName(), wxFile::write);
+        if (!f.IsOpened() || f.Write(data.data(), data.size()) != data.size())
+        {
+            wxLogError(_(L"Couldn’t save file %s."), filename.c_str());
+            return false;
+        }
+    }
+    else
+    {
+        m_doc.save_file(tempfile.FileName().fn_str(), "\t", format_raw);
+    }
 
     if ( !tempfile.Commit() )
     {
@@ -536,22 +859,163 @@ bool XLIFFCatalog::Save(const wxString& filename, bool /*save_mo*/,
 
 std::string XLIFFCatalog::SaveToBuffer()
 {
+    perf::ScopedTimer timer("XLIFFCatalog::SaveToBuffer");
+    timer.SetItemsCount(m_items.size());
+
+    FlushPendingChanges();
+
     std::ostringstream s;
     m_doc.save(s, "\t", format_raw);
+    if (IsStreamed())
+        return SpliceStreamedUnits(s.str());
     return s.str();
 }
 
 
+CatalogMemoryUsage XLIFFCatalog::GetMemoryUsage() const
+{
+    auto usage = Catalog::GetMemoryUsage();
+    // pugixml doesn't report memory used by parsed documents, so only the
+    // raw content of streamed files is accounted for:
+    usage.fileData += m_fileData.capacity() + m_units.capacity() * sizeof(StreamedUnit);
+    return usage;
+}
+
+
+void XLIFFCatalog::FlushPendingChanges()
+{
+    for (auto& i: m_items)
+        static_cast<XLIFFCatalogItem&>(*i).FlushPendingChanges();
+    InvalidateXPathCache();
+}
+
+
+void XLIFFCatalog::ForEachUnit(xml_node parent, const char *name,
+                               const std::function<void(xml_node, int)>& func)
+{
+    if (!IsStreamed())
+    {
+        for (auto unit: parent.select_nodes((std::string(".//") + name).c_str()))
+            func(unit.node(), -1);
+        return;
+    }
+
+    std::vector<int> indexes;
+    find_streamed_unit_markers(parent, indexes);
+
+    // parse units into a temporary document only, to keep memory use down:
+    for (auto index: indexes)
+    {
+        if (index < 0 || index >= (int)m_units.size())
+            continue;
+        auto& u = m_units[index];
+        xml_document doc;
+        auto result = doc.load_buffer(m_fileData.data() + u.begin, u.end - u.begin, PUGI_PARSE_FLAGS, encoding_utf8);
+        if (!result)
+            throw XLIFFReadException(result.description());
+        func(doc.child(name), index);
+    }
+}
+
+
+xml_node XLIFFCatalog::GetStreamedUnit(int index)
+{
+    std::lock_guard<std::mutex> lock(m_unitsMutex);
+
+    auto& u = m_units[index];
+    if (!u.doc)
+    {
+        u.doc.reset(new xml_document);
+        u.doc->load_buffer(m_fileData.data() + u.begin, u.end - u.begin, PUGI_PARSE_FLAGS, encoding_utf8);
+    }
+    return u.doc->document_element();
+}
+
+
+std::string XLIFFCatalog::SpliceStreamedUnits(const std::string& skeleton)
+{
+    static const std::string marker("<?" STREAMED_UNIT_PI " ");
+
+    std::string out;
+    out.reserve(m_fileData.size() + skeleton.size());
+
+    std::lock_guard<std::mutex> lock(m_unitsMutex);
+
+    size_t last = 0, pos;
+    while ((pos = skeleton.find(marker, last)) != std::string::npos)
+    {
+        auto end = skeleton.find("?>", pos);
+        if (end == std::string::npos)
+            break;
+        out.append(skeleton, last, pos - last);
+        last = end + 2;
+
+        auto index = atoi(skeleton.c_str() + pos + marker.size());
+        if (index < 0 || index >= (int)m_units.size())
+            continue;
+        auto& u = m_units[index];
+        if (u.doc)
+        {
+            // parsed units may have been modified, so write them out:
+            std::ostringstream s;
+            u.doc->save(s, "\t", format_raw | format_no_declaration);
+            out.append(s.str());
+        }
+        else
+        {
+            append_with_unix_eol(out, m_fileData.data() + u.begin, m_fileData.data() + u.end);
+        }
+    }
+    out.append(skeleton, last, std::string::npos);
+
+    return out;
+}
+
+
+namespace
+{
+
+// Compiled XPath queries are shared by all catalogs, because the same few
+// queries for metadata are used over and over.
+const pugi::xpath_query& compiled_xpath_query(const char *xpath)
+{
+    static std::mutex s_mutex;
+    static std::unordered_map<std::string, std::unique_ptr<pugi::xpath_query>> s_queries;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto& q = s_queries[xpath];
+    if (!q)
+        q.reset(new pugi::xpath_query(xpath));
+    return *q;
+}
+
+} // anonymous namespace
+
+
 std::string XLIFFCatalog::GetXPathValue(const char* xpath) const
 {
-    auto x = m_doc.child("xliff").select_node(xpath);
+    std::lock_guard<std::mutex> lock(m_xpathCacheMutex);
+    auto cached = m_xpathCache.find(xpath);
+    if (cached != m_xpathCache.end())
+        return cached->second;
+
+    std::string value;
+    auto x = m_doc.child("xliff").select_node(compiled_xpath_query(xpath));
     auto v = x.attribute().value();
-    if (v)
-        return v;
-     v = x.node().value();
-     if (v)
-         return v;
-     return "";
+    if (v && *v)
+        value = v;
+    else if ((v = x.node().value()) != nullptr)
+        value = v;
+
+    m_xpathCache.emplace(xpath, value);
+    return value;
+}
+
+
+void XLIFFCatalog::InvalidateXPathCache()
+{
+    std::lock_guard<std::mutex> lock(m_xpathCacheMutex);
+    m_xpathCache.clear();
 }
 
 
@@ -606,22 +1070,21 @@ public:
         }
     }
 
-    void UpdateInternalRepresentation() override
+    void WriteToDocument() override
     {
-        wxASSERT( m_translations.size() == 1 ); // no plurals
-
         // modifications in the pugixml tree can affect other nodes, we must lock the entire document
         document_lock lock(this);
 
-        auto target = m_node.child("target");
+        auto node = GetNode();
+        auto target = node.child("target");
         if (!target)
         {
-            auto ws_after = m_node.first_child();
-            auto source = m_node.child("source");
-            target = m_node.insert_child_after("target", source);
+            auto ws_after = node.first_child();
+            auto source = node.child("source");
+            target = node.insert_child_after("target", source);
             // indent the <target> tag in the same way <source> is indented under its parent:
             if (ws_after.type() == node_pcdata)
-                m_node.insert_child_after(node_pcdata, source).text() = ws_after.text().get();
+                node.insert_child_after(node_pcdata, source).text() = ws_after.text().get();
         }
 
         auto trans = GetTranslation();
@@ -655,7 +1118,7 @@ public:
     wxArrayString GetReferences() const override
     {
         wxArrayString refs;
-        for (auto loc: m_node.select_nodes(".//context-group[@purpose='location']"))
+        for (auto loc: GetNode().select_nodes(".//context-group[@purpose='location']"))
         {
             wxString file, line;
             for (auto ctxt: loc.node().children("context"))
@@ -706,17 +1169,20 @@ void XLIFF1Catalog::Parse(pugi::xml_node root)
             extractedLanguage = true;
         }
 
-        for (auto unit: file.select_nodes(".//trans-unit"))
+        ForEachUnit(file, "trans-unit", [this,&id](xml_node node, int streamedIndex)
         {
-            auto node = unit.node();
             if (strcmp(node.attribute("translate").value(), "no") == 0)
-                continue;
+                return;
 
+            std::shared_ptr<XLIFF12CatalogItem> item;
             if (m_subversion == 0)
-                m_items.push_back(std::make_shared<XLIFF10CatalogItem>(*this, ++id, node));
+                item = std::make_shared<XLIFF10CatalogItem>(*this, ++id, node);
             else
-                m_items.push_back(std::make_shared<XLIFF12CatalogItem>(*this, ++id, node));
-        }
+                item = std::make_shared<XLIFF12CatalogItem>(*this, ++id, node);
+            if (streamedIndex != -1)
+                item->SetStreamedUnit(streamedIndex);
+            m_items.push_back(item);
+        });
     }
 }
 
@@ -729,6 +1195,8 @@ void XLIFF1Catalog::SetLanguage(Language lang)
     {
         attribute(file, "target-language") = lang.LanguageTag().c_str();
     }
+
+    InvalidateXPathCache();
 }
 
 
@@ -781,32 +1249,31 @@ public:
         }
     }
 
-    void UpdateInternalRepresentation() override
+    void WriteToDocument() override
     {
-        wxASSERT( m_translations.size() == 1 ); // no plurals
-
         // modifications in the pugixml tree can affect other nodes, we must lock the entire document
         document_lock lock(this);
 
-        auto target = m_node.child("target");
+        auto node = GetNode();
+        auto target = node.child("target");
         if (!target)
         {
-            auto ws_after = m_node.first_child();
-            auto source = m_node.child("source");
-            target = m_node.insert_child_after("target", source);
+            auto ws_after = node.first_child();
+            auto source = node.child("source");
+            target = node.insert_child_after("target", source);
             // indent the <target> tag in the same way <source> is indented under its parent:
             if (ws_after.type() == node_pcdata)
-                m_node.insert_child_after(node_pcdata, source).text() = ws_after.text().get();
+                node.insert_child_after(node_pcdata, source).text() = ws_after.text().get();
         }
 
         auto trans = GetTranslation();
         if (!trans.empty())
         {
-            attribute(m_node, "state") = "translated";
+            attribute(node, "state") = "translated";
             if (m_isFuzzy)
-                attribute(m_node, "subState") = "poedit:fuzzy";
+                attribute(node, "subState") = "poedit:fuzzy";
             else
-                m_node.remove_attribute("subState");
+                node.remove_attribute("subState");
 
             if (!set_node_text_with_metadata(target, str::to_utf8(trans), m_metadata))
             {
@@ -816,8 +1283,8 @@ public:
         }
         else // no translation
         {
-            m_node.remove_attribute("state");
-            m_node.remove_attribute("subState");
+            node.remove_attribute("state");
+            node.remove_attribute("subState");
             remove_all_children(target);
         }
     }
@@ -834,7 +1301,7 @@ public:
 
 
 protected:
-    xml_node unit() const { return m_node.parent(); }
+    xml_node unit() const { return GetNode().parent(); }
 };
 
 
@@ -844,14 +1311,21 @@ void XLIFF2Catalog::Parse(pugi::xml_node root)
     m_language = Language::FromLanguageTag(root.attribute("trgLang").value());
 
     int id = 0;
-    for (auto segment: root.select_nodes(".//segment"))
+    ForEachUnit(root, "unit", [this,&id](xml_node unit, int streamedIndex)
     {
-        auto node = segment.node();
-        if (strcmp(node.parent().attribute("translate").value(), "no") == 0)
-            continue;
+        if (strcmp(unit.attribute("translate").value(), "no") == 0)
+            return;
 
-        m_items.push_back(std::make_shared<XLIFF2CatalogItem>(*this, ++id, node));
-    }
+        int segmentIndex = 0;
+        for (auto segment: unit.select_nodes(".//segment"))
+        {
+            auto item = std::make_shared<XLIFF2CatalogItem>(*this, ++id, segment.node());
+            if (streamedIndex != -1)
+                item->SetStreamedUnit(streamedIndex, segmentIndex);
+            segmentIndex++;
+            m_items.push_back(item);
+        }
+    });
 }
 
 
@@ -859,4 +1333,5 @@ void XLIFF2Catalog::SetLanguage(Language lang)
 {
     XLIFFCatalog::SetLanguage(lang);
     attribute(GetXMLRoot(), "trgLang") = lang.LanguageTag().c_str();
+    InvalidateXPathCache();
 }
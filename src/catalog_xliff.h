@@ -28,10 +28,16 @@
 
 #include "catalog.h"
 #include "errors.h"
+#include "perf_trace.h"
 
 #include "pugixml.h"
 
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 
@@ -80,8 +86,24 @@ public:
 
     wxString GetRawSymbolicId() const override { return m_symbolicId; }
 
+    /// Makes the item refer to its streamed unit (and segment within it, for
+    /// XLIFF 2) instead of keeping the node; see XLIFFCatalog::IsStreamed().
+    void SetStreamedUnit(int unitIndex, int segmentIndex = -1);
+
+    /// Writes changes made since the last call into the XML document.
+    void FlushPendingChanges();
+
 protected:
-    struct document_lock : public std::lock_guard<std::mutex>
+    /// Only records that the item changed, see FlushPendingChanges().
+    void UpdateInternalRepresentation() override;
+
+    /// Writes the item's current state into the XML document.
+    virtual void WriteToDocument() = 0;
+
+    /// Returns item's XML node, parsing it first if the catalog is streamed.
+    pugi::xml_node GetNode() const;
+
+    struct document_lock : public std::lock_guard<perf::InstrumentedMutex>
     {
         document_lock(XLIFFCatalogItem *parent);
     };
@@ -89,6 +111,8 @@ protected:
 protected:
     XLIFFCatalog& m_owner;
     pugi::xml_node m_node;
+    int m_streamedUnit = -1, m_streamedSegment = -1;
+    std::atomic<bool> m_hasPendingChanges {false};
     XLIFFStringMetadata m_metadata;
     wxString m_symbolicId;
 };
@@ -112,6 +136,8 @@ public:
 
     std::string SaveToBuffer() override;
 
+    CatalogMemoryUsage GetMemoryUsage() const override;
+
     Language GetLanguage() const override { return m_language; }
     void SetLanguage(Language lang) override { m_language = lang; }
 
@@ -120,19 +146,67 @@ public:
     void RemoveDeletedItems() override {}
 
     pugi::xml_node GetXMLRoot() const { return m_doc.child("xliff"); }
+
+    /**
+        Returns value of the attribute or node selected by @a xpath (relative
+        to the root element), or empty string if there's no such node.
+
+        Values are cached until the document is modified, so repeated lookups
+        of the same metadata are cheap.
+     */
     std::string GetXPathValue(const char* xpath) const;
 
+    /**
+        Is the file loaded in streaming mode?
+
+        This is used for very large files: only the document's skeleton is
+        kept in m_doc, with translation units replaced by markers, and the
+        units are parsed from the original file content only when needed.
+        Unmodified units are saved as they were in the file.
+     */
+    bool IsStreamed() const { return !m_units.empty(); }
+
 protected:
     XLIFFCatalog(pugi::xml_document&& doc)
         : Catalog(Type::XLIFF), m_doc(std::move(doc)) {}
 
     virtual void Parse(pugi::xml_node root) = 0;
 
+    /// Calls @a func for every translation unit element named @a name under
+    /// @a parent, with its streamed unit index (or -1 if not streamed).
+    void ForEachUnit(pugi::xml_node parent, const char *name,
+                     const std::function<void(pugi::xml_node, int)>& func);
+
+    /// Returns the root node of a streamed unit, parsing it if needed.
+    pugi::xml_node GetStreamedUnit(int index);
+
+    /// Writes items' changes into the document before saving it.
+    void FlushPendingChanges();
+
+    /// Discards values cached by GetXPathValue(); call after modifying the document.
+    void InvalidateXPathCache();
+
+    /// Replaces unit markers in serialized skeleton with units' content.
+    std::string SpliceStreamedUnits(const std::string& skeleton);
+
 protected:
-    std::mutex m_documentMutex;
+    perf::InstrumentedMutex m_documentMutex {"XLIFF document"};
     pugi::xml_document m_doc;
     Language m_language;
 
+    mutable std::mutex m_xpathCacheMutex;
+    mutable std::unordered_map<std::string, std::string> m_xpathCache;
+
+    // streaming mode data:
+    struct StreamedUnit
+    {
+        size_t begin, end;  // range in m_fileData
+        std::unique_ptr<pugi::xml_document> doc;  // if parsed
+    };
+    std::string m_fileData;
+    std::vector<StreamedUnit> m_units;
+    std::mutex m_unitsMutex;
+
     friend class XLIFFCatalogItem;
 };
 
@@ -27,8 +27,21 @@
 
 #ifdef HAVE_HTTP_CLIENT
 
+#include "catalog.h"
 #include "crowdin_client.h"
+#include "edapp.h"
+#include "errors.h"
 #include "localazy_client.h"
+#include "str_helpers.h"
+#include "utility.h"
+
+#include <wx/file.h>
+#include <wx/filename.h>
+#include <wx/log.h>
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
 
 
 CloudAccountClient& CloudAccountClient::Get(const std::string& service_name)
@@ -49,6 +62,68 @@ void CloudAccountClient::CleanUp()
 }
 
 
+dispatch::future<void> CloudAccountClient::WhenAllCredentialsLoaded()
+{
+    auto localazy = std::make_shared<dispatch::future<void>>(LocalazyClient::Get().WhenCredentialsLoaded());
+    return CrowdinClient::Get().WhenCredentialsLoaded().then([localazy]
+    {
+        return std::move(*localazy);
+    });
+}
+
+
+dispatch::future<void> CloudAccountClient::WhenCredentialsLoaded()
+{
+    std::lock_guard<std::mutex> lock(m_credentialsMutex);
+    if (m_credentialsLoaded)
+        return dispatch::make_ready_future();
+
+    auto waiter = std::make_shared<dispatch::promise<void>>();
+    m_credentialsWaiters.push_back(waiter);
+    return waiter->get_future();
+}
+
+
+void CloudAccountClient::LoadCredentialsInBackground(std::function<void()> loader)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_credentialsMutex);
+        m_credentialsLoaded = false;
+    }
+
+    dispatch::async([this, loader]
+    {
+        try
+        {
+            loader();
+        }
+        catch (...)
+        {
+            wxLogTrace("poedit", "failed to load %s credentials: %s", GetServiceName(), DescribeCurrentException());
+        }
+
+        std::vector<std::shared_ptr<dispatch::promise<void>>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(m_credentialsMutex);
+            m_credentialsLoaded = true;
+            waiters.swap(m_credentialsWaiters);
+            // notify while locked, the object may be destroyed as soon as it's unlocked:
+            m_credentialsLoadedCond.notify_all();
+        }
+
+        for (auto& w: waiters)
+            w->set_value();
+    });
+}
+
+
+void CloudAccountClient::WaitForCredentials() const
+{
+    std::unique_lock<std::mutex> lock(m_credentialsMutex);
+    m_credentialsLoadedCond.wait(lock, [this]{ return m_credentialsLoaded; });
+}
+
+
 std::shared_ptr<CloudAccountClient::FileSyncMetadata> CloudAccountClient::ExtractSyncMetadataIfAny(Catalog& catalog)
 {
     std::shared_ptr<CloudAccountClient::FileSyncMetadata> meta;
@@ -62,4 +137,466 @@ std::shared_ptr<CloudAccountClient::FileSyncMetadata> CloudAccountClient::Extrac
 }
 
 
+namespace
+{
+
+struct BatchDownloadState
+{
+    CloudAccountClient *client;
+    CloudAccountClient::ProjectInfo project;
+    CloudAccountClient::ProjectFile file;
+    std::vector<std::pair<Language, std::wstring>> outputs;
+
+    std::mutex mutex;
+    size_t next = 0;
+    size_t pending = 0;
+    dispatch::exception_ptr error;
+    dispatch::promise<void> promise;
+};
+
+// Downloads the next file in the batch and continues with the rest once done,
+// so that there are at most as many downloads in progress as there are callers
+void DownloadNextInBatch(std::shared_ptr<BatchDownloadState> st)
+{
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(st->mutex);
+        if (st->next == st->outputs.size())
+            return;
+        index = st->next++;
+    }
+
+    auto finished = [st](dispatch::exception_ptr e)
+    {
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(st->mutex);
+            if (e && !st->error)
+                st->error = e;
+            last = --st->pending == 0;
+        }
+        if (last)
+        {
+            if (st->error)
+                st->promise.set_exception(st->error);
+            else
+                st->promise.set_value();
+        }
+        else
+        {
+            DownloadNextInBatch(st);
+        }
+    };
+
+    auto& out = st->outputs[index];
+    st->client->DownloadFile(out.second, st->project, st->file, out.first)
+        .then([finished]{ finished(dispatch::exception_ptr()); })
+        .catch_all([finished](dispatch::exception_ptr e){ finished(e); });
+}
+
+} // anonymous namespace
+
+
+dispatch::future<void> CloudAccountClient::DownloadFiles(const ProjectInfo& project, const ProjectFile& file,
+                                                         const std::vector<std::pair<Language, std::wstring>>& outputs)
+{
+    if (outputs.empty())
+        return dispatch::make_ready_future();
+
+    auto st = std::make_shared<BatchDownloadState>();
+    st->client = this;
+    st->project = project;
+    st->file = file;
+    st->outputs = outputs;
+    st->pending = outputs.size();
+    auto future = st->promise.get_future();
+
+    for (size_t i = 0; i < std::min(GetMaxParallelDownloads(), outputs.size()); i++)
+        DownloadNextInBatch(st);
+
+    return dispatch::future<void>(std::move(future));
+}
+
+
+dispatch::future<void> CloudAccountClient::UploadFile(std::shared_ptr<Catalog> catalog, std::shared_ptr<FileSyncMetadata> meta)
+{
+    // serialize in the background if the catalog can be snapshotted, because it takes a while with large files:
+    if (auto snapshot = catalog->CreateSnapshot())
+    {
+        return dispatch::async([snapshot]{ return snapshot->SaveToBuffer(); })
+               .then([this, meta](std::string file_buffer){ return UploadFile(file_buffer, meta); });
+    }
+
+    return UploadFile(catalog->SaveToBuffer(), meta);
+}
+
+
+namespace
+{
+
+std::mutex gs_downloadCacheMutex;
+
+// Files of the cache entry for given key: content and metadata
+void GetDownloadCacheFiles(const std::string& key, wxString& dataFile, wxString& metaFile)
+{
+    const auto base = wxString::Format("%s%cDownloads%c%016llx",
+                                       PoeditApp::GetCacheDir("Cloud"), wxFILE_SEP_PATH, wxFILE_SEP_PATH,
+                                       (unsigned long long)std::hash<std::string>()(key));
+    dataFile = base + ".data";
+    metaFile = base + ".meta";
+}
+
+bool ReadFileContent(const wxString& filename, std::string& content)
+{
+    wxLogNull null;
+    wxFile f;
+    if (!wxFileName::FileExists(filename) || !f.Open(filename))
+        return false;
+    const auto len = f.Length();
+    if (len < 0)
+        return false;
+    content.resize((size_t)len);
+    return len == 0 || f.Read(&content[0], (size_t)len) == (ssize_t)len;
+}
+
+std::string HashContent(const std::string& content)
+{
+    return wxString::Format("%016llx", (unsigned long long)std::hash<std::string>()(content)).ToStdString();
+}
+
+// Returns ETag of a valid entry, i.e. one whose content matches stored hash
+std::string ReadDownloadCacheEntry(const std::string& key, std::string *content)
+{
+    wxString dataFile, metaFile;
+    GetDownloadCacheFiles(key, dataFile, metaFile);
+
+    // metadata are stored in the format of key, ETag and content hash on separate lines:
+    std::string meta, data;
+    if (!ReadFileContent(metaFile, meta) || !ReadFileContent(dataFile, data))
+        return std::string();
+
+    const auto eol1 = meta.find('\n');
+    const auto eol2 = meta.find('\n', eol1 + 1);
+    if (eol1 == std::string::npos || eol2 == std::string::npos)
+        return std::string();
+    if (meta.substr(0, eol1) != key)
+        return std::string();  // hash collision
+    const auto etag = meta.substr(eol1 + 1, eol2 - eol1 - 1);
+    const auto hash = meta.substr(eol2 + 1, meta.find('\n', eol2 + 1) - eol2 - 1);
+    if (hash != HashContent(data))
+        return std::string();
+
+    if (content)
+        content->swap(data);
+    return etag;
+}
+
+} // anonymous namespace
+
+
+std::string CloudAccountClient::DownloadCache::GetETag(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(gs_downloadCacheMutex);
+    return ReadDownloadCacheEntry(key, nullptr);
+}
+
+
+bool CloudAccountClient::DownloadCache::Retrieve(const std::string& key, const std::wstring& output_file)
+{
+    std::string content;
+    {
+        std::lock_guard<std::mutex> lock(gs_downloadCacheMutex);
+        if (ReadDownloadCacheEntry(key, &content).empty())
+            return false;
+    }
+
+    wxLogNull null;
+    wxFile out;
+    if (!out.Create(output_file, /*overwrite=*/true))
+        return false;
+    return out.Write(content.data(), content.size()) == content.size() && out.Close();
+}
+
+
+void CloudAccountClient::DownloadCache::Store(const std::string& key, const std::string& etag, const std::wstring& file)
+{
+    if (etag.empty() || key.find('\n') != std::string::npos || etag.find('\n') != std::string::npos)
+        return;
+
+    std::string content;
+    if (!ReadFileContent(file, content))
+        return;
+
+    std::lock_guard<std::mutex> lock(gs_downloadCacheMutex);
+
+    wxString dataFile, metaFile;
+    GetDownloadCacheFiles(key, dataFile, metaFile);
+
+    wxLogNull null;
+    wxFileName::Mkdir(wxFileName(dataFile).GetPath(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+
+    // write content first, so that the metadata never describe different data:
+    wxRemoveFile(metaFile);
+    wxFile data;
+    if (!data.Create(dataFile, /*overwrite=*/true) || data.Write(content.data(), content.size()) != content.size() || !data.Close())
+        return;
+
+    const std::string meta = key + '\n' + etag + '\n' + HashContent(content) + '\n';
+    wxFile metaOut;
+    if (metaOut.Create(metaFile, /*overwrite=*/true))
+        metaOut.Write(meta.data(), meta.size());
+}
+
+
+namespace
+{
+
+std::mutex gs_metadataCacheMutex;
+
+wxString GetMetadataCacheFile(const std::string& service)
+{
+    return wxString::Format("%s%cMetadata-%s.json", PoeditApp::GetCacheDir("Cloud"), wxFILE_SEP_PATH, service);
+}
+
+// Reads the entire cache of @a service, returns empty object if missing or damaged
+json ReadMetadataCache(const std::string& service)
+{
+    std::string content;
+    if (ReadFileContent(GetMetadataCacheFile(service), content))
+    {
+        try
+        {
+            auto data = json::parse(content);
+            if (data.is_object())
+                return data;
+        }
+        catch (...) {}
+    }
+    return json::object();
+}
+
+json ReadMetadataCacheValue(const std::string& service, const json::json_pointer& path)
+{
+    std::lock_guard<std::mutex> lock(gs_metadataCacheMutex);
+    auto data = ReadMetadataCache(service);
+    return data.contains(path) ? data[path] : json();
+}
+
+void WriteMetadataCacheValue(const std::string& service, const json::json_pointer& path, const json& value)
+{
+    std::lock_guard<std::mutex> lock(gs_metadataCacheMutex);
+    auto data = ReadMetadataCache(service);
+    data[path] = value;
+
+    wxLogNull null;
+    const auto filename = GetMetadataCacheFile(service);
+    wxFileName::Mkdir(wxFileName(filename).GetPath(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+    TempOutputFileFor tempfile(filename);
+    {
+        const auto content = data.dump();
+        wxFile f;
+        if (!f.Create(tempfile.FileName(), /*overwrite=*/true) || f.Write(content.data(), content.size()) != content.size() || !f.Close())
+            return;
+    }
+    tempfile.Commit();
+}
+
+json::json_pointer ProjectDetailsPath(const CloudAccountClient::ProjectInfo& project)
+{
+    const std::string id = std::holds_alternative<int>(project.internalID)
+                           ? std::to_string(std::get<int>(project.internalID))
+                           : std::get<std::string>(project.internalID);
+    return json::json_pointer("/details") / id;
+}
+
+json UserInfoToJson(const CloudAccountClient::UserInfo& u)
+{
+    return {
+        { "name", str::to_utf8(u.name) },
+        { "login", u.login },
+        { "avatarUrl", u.avatarUrl }
+    };
+}
+
+CloudAccountClient::UserInfo UserInfoFromJson(const std::string& service, const json& j)
+{
+    CloudAccountClient::UserInfo u;
+    u.service = service;
+    u.name = str::to_wstring(j.at("name").get<std::string>());
+    u.login = j.at("login").get<std::string>();
+    u.avatarUrl = j.at("avatarUrl").get<std::string>();
+    return u;
+}
+
+json ProjectInfoToJson(const CloudAccountClient::ProjectInfo& p)
+{
+    json id;
+    if (std::holds_alternative<int>(p.internalID))
+        id = std::get<int>(p.internalID);
+    else
+        id = std::get<std::string>(p.internalID);
+
+    return {
+        { "id", id },
+        { "name", str::to_utf8(p.name) },
+        { "slug", p.slug },
+        { "avatarUrl", p.avatarUrl }
+    };
+}
+
+CloudAccountClient::ProjectInfo ProjectInfoFromJson(const std::string& service, const json& j)
+{
+    CloudAccountClient::ProjectInfo p;
+    p.service = service;
+    auto& id = j.at("id");
+    if (id.is_number_integer())
+        p.internalID = id.get<int>();
+    else
+        p.internalID = id.get<std::string>();
+    p.name = str::to_wstring(j.at("name").get<std::string>());
+    p.slug = j.at("slug").get<std::string>();
+    p.avatarUrl = j.at("avatarUrl").get<std::string>();
+    return p;
+}
+
+} // anonymous namespace
+
+
+void CloudAccountClient::ClearMetadataCache()
+{
+    std::lock_guard<std::mutex> lock(gs_metadataCacheMutex);
+    wxLogNull null;
+    wxRemoveFile(GetMetadataCacheFile(GetServiceName()));
+}
+
+
+bool CloudAccountClient::GetCachedUserInfo(UserInfo& out)
+{
+    try
+    {
+        auto j = ReadMetadataCacheValue(GetServiceName(), json::json_pointer("/user"));
+        if (j.is_null())
+            return false;
+        out = UserInfoFromJson(GetServiceName(), j);
+        return true;
+    }
+    catch (...)
+    {
+        return false;  // damaged or outdated cache
+    }
+}
+
+
+dispatch::future<CloudAccountClient::UserInfo> CloudAccountClient::RefreshUserInfo()
+{
+    const std::string service = GetServiceName();
+    return GetUserInfo().then([service](UserInfo u)
+    {
+        WriteMetadataCacheValue(service, json::json_pointer("/user"), UserInfoToJson(u));
+        return u;
+    });
+}
+
+
+bool CloudAccountClient::GetCachedUserProjects(std::vector<ProjectInfo>& out)
+{
+    try
+    {
+        auto j = ReadMetadataCacheValue(GetServiceName(), json::json_pointer("/projects"));
+        if (!j.is_array())
+            return false;
+        out.clear();
+        for (auto& p: j)
+            out.push_back(ProjectInfoFromJson(GetServiceName(), p));
+        return true;
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+
+dispatch::future<std::vector<CloudAccountClient::ProjectInfo>> CloudAccountClient::RefreshUserProjects()
+{
+    const std::string service = GetServiceName();
+    return GetUserProjects().then([service](std::vector<ProjectInfo> projects)
+    {
+        json j = json::array();
+        for (auto& p: projects)
+            j.push_back(ProjectInfoToJson(p));
+        WriteMetadataCacheValue(service, json::json_pointer("/projects"), j);
+        return projects;
+    });
+}
+
+
+bool CloudAccountClient::GetCachedProjectDetails(const ProjectInfo& project, ProjectDetails& out)
+{
+    try
+    {
+        auto j = ReadMetadataCacheValue(GetServiceName(), ProjectDetailsPath(project));
+        if (j.is_null())
+            return false;
+
+        ProjectDetails details;
+        for (auto& lang: j.at("languages"))
+            details.languages.push_back(Language::FromLanguageTag(lang.get<std::string>()));
+        for (auto& f: j.at("files"))
+        {
+            ProjectFile file;
+            file.title = str::to_wstring(f.at("title").get<std::string>());
+            file.description = str::to_wstring(f.at("description").get<std::string>());
+            if (f.contains("internal"))
+            {
+                file.internal = DeserializeFileInternal(f["internal"]);
+                if (!file.internal)
+                    return false;
+            }
+            details.files.push_back(file);
+        }
+
+        out = details;
+        return true;
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+
+dispatch::future<CloudAccountClient::ProjectDetails> CloudAccountClient::RefreshProjectDetails(const ProjectInfo& project)
+{
+    const std::string service = GetServiceName();
+    const auto path = ProjectDetailsPath(project);
+    return GetProjectDetails(project).then([=](ProjectDetails details)
+    {
+        json langs = json::array();
+        for (auto& lang: details.languages)
+            langs.push_back(lang.LanguageTag());
+
+        json files = json::array();
+        for (auto& f: details.files)
+        {
+            json jf = {
+                { "title", str::to_utf8(f.title) },
+                { "description", str::to_utf8(f.description) }
+            };
+            if (f.internal)
+            {
+                auto internal = SerializeFileInternal(f);
+                if (internal.is_null())
+                    return details;  // service doesn't support caching of its files
+                jf["internal"] = internal;
+            }
+            files.push_back(jf);
+        }
+
+        WriteMetadataCacheValue(service, path, { { "languages", langs }, { "files", files } });
+        return details;
+    });
+}
+
+
 #endif // #ifdef HAVE_HTTP_CLIENT
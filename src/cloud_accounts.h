@@ -29,11 +29,16 @@
 #ifdef HAVE_HTTP_CLIENT
 
 #include "concurrency.h"
+#include "json.h"
 #include "language.h"
 
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <variant>
+#include <vector>
 
 class Catalog;
 
@@ -54,6 +59,9 @@ public:
     /// Destroys all singletons, must be called (only) on app shutdown.
     static void CleanUp();
 
+    /// Returns future fulfilled when credentials of all clients are loaded, see WhenCredentialsLoaded().
+    static dispatch::future<void> WhenAllCredentialsLoaded();
+
     virtual ~CloudAccountClient() {}
 
     /// Returns identifier of the account's service
@@ -61,6 +69,18 @@ public:
     // Informal protocol: should be present in every derived class
     // static constexpr const char* SERVICE_NAME = "Something";
 
+    /**
+        Returns future fulfilled when stored credentials are loaded.
+
+        Credentials are read from the system keychain in the background
+        when the client is created, because that may take a long time (e.g.
+        when the secret service must be started first), and kept in memory
+        for the rest of the session. UI code should wait for this before
+        calling IsSignedIn() and other methods that need credentials, which
+        block until they are loaded.
+     */
+    dispatch::future<void> WhenCredentialsLoaded();
+
     /// Is the user logged into this account?
     virtual bool IsSignedIn() const = 0;
 
@@ -128,6 +148,22 @@ public:
     /// Retrieve details about given project
     virtual dispatch::future<ProjectDetails> GetProjectDetails(const ProjectInfo& project) = 0;
 
+    /**
+        Persistent cache of the account's metadata (user info, projects and
+        their details) for "stale-while-revalidate" use: the UI can show the
+        cached data immediately while fresh data are fetched from the server.
+
+        GetCached*() return false if there are no cached data. Refresh*() fetch
+        fresh data like the corresponding Get*() method and update the cache
+        with them. The cache is cleared when the user signs out.
+     */
+    bool GetCachedUserInfo(UserInfo& out);
+    dispatch::future<UserInfo> RefreshUserInfo();
+    bool GetCachedUserProjects(std::vector<ProjectInfo>& out);
+    dispatch::future<std::vector<ProjectInfo>> RefreshUserProjects();
+    bool GetCachedProjectDetails(const ProjectInfo& project, ProjectDetails& out);
+    dispatch::future<ProjectDetails> RefreshProjectDetails(const ProjectInfo& project);
+
     /// Metadata needed for uploading/downloading files
     struct FileSyncMetadata
     {
@@ -156,6 +192,17 @@ public:
     /// Asynchronously download specific file into @a output_file, using data from ExtractSyncMetadata().
     virtual dispatch::future<void> DownloadFile(const std::wstring& output_file, std::shared_ptr<FileSyncMetadata> meta) = 0;
 
+    /**
+        Asynchronously download specific file in several languages at once.
+
+        @a outputs lists the languages to download, together with local
+        filenames to store them in. Several files are requested and downloaded
+        in parallel. If some downloads fail, the others are still completed
+        and the returned future then fails with the first error.
+     */
+    dispatch::future<void> DownloadFiles(const ProjectInfo& project, const ProjectFile& file,
+                                         const std::vector<std::pair<Language, std::wstring>>& outputs);
+
     /**
         Asynchronously upload a file.
 
@@ -163,8 +210,67 @@ public:
      */
     virtual dispatch::future<void> UploadFile(const std::string& file_buffer, std::shared_ptr<FileSyncMetadata> meta) = 0;
 
+    /**
+        Asynchronously upload translations from @a catalog.
+
+        The default implementation uploads the entire file as serialized by
+        Catalog::SaveToBuffer(), done in the background on a snapshot of the
+        catalog if possible; clients may send only the changes instead.
+     */
+    virtual dispatch::future<void> UploadFile(std::shared_ptr<Catalog> catalog, std::shared_ptr<FileSyncMetadata> meta);
+
 protected:
     CloudAccountClient() {}
+
+    /// Forgets all cached metadata; to be called when signing out
+    void ClearMetadataCache();
+
+    /**
+        Runs @a loader, which reads credentials from the keychain, in the
+        background. To be called from derived class' constructor; its
+        destructor must call WaitForCredentials().
+     */
+    void LoadCredentialsInBackground(std::function<void()> loader);
+
+    /// Blocks until credentials are loaded; must be called before using them.
+    void WaitForCredentials() const;
+
+    /// How many files may DownloadFiles() download in parallel.
+    virtual size_t GetMaxParallelDownloads() const { return 4; }
+
+    /**
+        Serialize service-specific ProjectFile::internal data for the metadata
+        cache. Must be implemented by services that use ProjectFile::internal.
+     */
+    virtual json SerializeFileInternal(const ProjectFile& /*file*/) const { return json(); }
+    virtual std::shared_ptr<ProjectFile::Internal> DeserializeFileInternal(const json& /*data*/) const { return nullptr; }
+
+    /**
+        Local cache of downloaded files, so that unchanged files don't have
+        to be downloaded (or built on the server) again.
+
+        Entries are identified by a @a key unique to the remote file and its
+        language. They keep a copy of the file together with the ETag the
+        server sent for it and a hash of the content, to detect damaged
+        entries. All methods are thread-safe.
+     */
+    struct DownloadCache
+    {
+        /// Returns ETag of the cached file or empty string if there's no valid entry
+        static std::string GetETag(const std::string& key);
+
+        /// Copies cached file to @a output_file, returns false if it's not cached
+        static bool Retrieve(const std::string& key, const std::wstring& output_file);
+
+        /// Stores @a file downloaded with given @a etag in the cache
+        static void Store(const std::string& key, const std::string& etag, const std::wstring& file);
+    };
+
+private:
+    mutable std::mutex m_credentialsMutex;
+    mutable std::condition_variable m_credentialsLoadedCond;
+    bool m_credentialsLoaded = true;
+    std::vector<std::shared_ptr<dispatch::promise<void>>> m_credentialsWaiters;
 };
 
 #endif // !HAVE_HTTP_CLIENT
@@ -48,6 +48,8 @@
 #include <wx/sizer.h>
 #include <wx/statline.h>
 
+#include <map>
+
 #ifdef __WXMSW__
     #include <wx/generic/private/markuptext.h>
 #endif
@@ -180,6 +182,13 @@ AccountsPanel::AccountsPanel(wxWindow *parent, int flags) : wxPanel(parent, wxID
 
 
 void AccountsPanel::InitializeAfterShown()
+{
+    // credentials are loaded asynchronously, don't block the UI waiting for them:
+    CloudAccountClient::WhenAllCredentialsLoaded().then_on_window(this, &AccountsPanel::DoInitializeAfterShown);
+}
+
+
+void AccountsPanel::DoInitializeAfterShown()
 {
     if (IsSignedIn())
     {
@@ -298,6 +307,12 @@ inline wxString GetCacheDir()
 }
 
 
+inline bool IsSameProject(const CloudAccountClient::ProjectInfo& a, const CloudAccountClient::ProjectInfo& b)
+{
+    return a.service == b.service && a.slug == b.slug;
+}
+
+
 class CloudFileList : public wxDataViewListCtrl
 {
 public:
@@ -496,7 +511,7 @@ public:
         });
     }
 
-    wxString OutLocalFilename;
+    wxArrayString OutLocalFilenames;
 
 private:
     void FetchLoginInfo(CloudAccountClient *account)
@@ -505,36 +520,53 @@ private:
             return;
         m_loginAccountShown = account;
 
-        account->GetUserInfo()
+        // show cached information immediately and update it when fresh data arrive:
+        CloudAccountClient::UserInfo cached;
+        const bool haveCached = account->GetCachedUserInfo(cached);
+        if (haveCached)
+            ShowLoginInfo(account, cached);
+
+        account->RefreshUserInfo()
         .then_on_window(this, [=](CloudAccountClient::UserInfo u)
         {
             if (account != m_loginAccountShown)
                 return;  // user changed selection since invocation, there's another pending async call
+            if (haveCached && u.name == cached.name && u.avatarUrl == cached.avatarUrl)
+                return;  // nothing changed
 
-            wxString text = u.name;
-            if (m_accounts.size() > 1)
-                text += wxString::Format(" (%s)", account->GetServiceName());
-            text += L"  •  ";
+            ShowLoginInfo(account, u);
+        })
+        .catch_all([=](dispatch::exception_ptr e)
+        {
+            if (!haveCached)
+                m_activity->HandleError(e);
+        });
+    }
 
-            m_loginText->SetLabel(text);
-            m_loginImage->SetUserName(u.name);
-            if (u.avatarUrl.empty())
+    void ShowLoginInfo(CloudAccountClient *account, const CloudAccountClient::UserInfo& u)
+    {
+        wxString text = u.name;
+        if (m_accounts.size() > 1)
+            text += wxString::Format(" (%s)", account->GetServiceName());
+        text += L"  •  ";
+
+        m_loginText->SetLabel(text);
+        m_loginImage->SetUserName(u.name);
+        if (u.avatarUrl.empty())
+        {
+            m_loginImage->Show();
+        }
+        else
+        {
+            http_client::download_from_anywhere(u.avatarUrl)
+            .then_on_window(this, [=](downloaded_file f)
             {
+                m_loginImage->LoadIcon(f.filename());
                 m_loginImage->Show();
-            }
-            else
-            {
-                http_client::download_from_anywhere(u.avatarUrl)
-                .then_on_window(this, [=](downloaded_file f)
-                {
-                    m_loginImage->LoadIcon(f.filename());
-                    m_loginImage->Show();
-                });
-            }
-            Layout();
-            m_loginText->Show();
-        })
-        .catch_all(m_activity->HandleError);
+            });
+        }
+        Layout();
+        m_loginText->Show();
     }
 
     void EnableAllChoices(bool enable = true)
@@ -546,24 +578,51 @@ private:
 
     void FetchProjects()
     {
-        m_activity->Start();
-
-        m_projects.clear();
+        m_projectsByAccount.clear();
         m_projectsPendingLoad = m_accounts.size();
+
+        // if all accounts have cached listings, show them without waiting for
+        // the network and only update the UI when fresh data arrive:
+        bool allCached = !m_accounts.empty();
+        for (auto acc : m_accounts)
+        {
+            std::vector<CloudAccountClient::ProjectInfo> cached;
+            if (acc->GetCachedUserProjects(cached))
+                m_projectsByAccount[acc] = cached;
+            else
+                allCached = false;
+        }
+        m_showingCachedProjects = allCached;
+
+        if (m_showingCachedProjects)
+            OnFetchedAllProjects();
+        else
+            m_activity->Start();
+
         for (auto acc : m_accounts)
         {
-            acc->GetUserProjects()
-                .then_on_window(this, &CloudOpenDialog::OnFetchedProjects)
-                .catch_all(m_activity->HandleError);
+            acc->RefreshUserProjects()
+                .then_on_window(this, [=](std::vector<CloudAccountClient::ProjectInfo> prjs)
+                {
+                    m_projectsByAccount[acc] = prjs;
+                    if (--m_projectsPendingLoad > 0)
+                        return; // wait for other loads to finish
+                    OnFetchedAllProjects();
+                })
+                .catch_all([=](dispatch::exception_ptr e)
+                {
+                    // keep showing cached data if refreshing failed, e.g. when offline
+                    if (!m_showingCachedProjects)
+                        m_activity->HandleError(e);
+                });
         }
     }
 
-    void OnFetchedProjects(std::vector<CloudAccountClient::ProjectInfo> prjs)
+    void OnFetchedAllProjects()
     {
-        m_projects.insert(m_projects.end(), prjs.begin(), prjs.end());
-
-        if (--m_projectsPendingLoad > 0)
-            return; // wait for other loads to finish
+        m_projects.clear();
+        for (auto& i: m_projectsByAccount)
+            m_projects.insert(m_projects.end(), i.second.begin(), i.second.end());
 
         InitializeProjects();
     }
@@ -583,11 +642,28 @@ private:
             m_activity->StopWithError(_("No translation projects listed in your account."));
             return;
         }
-        else
+        else if (!m_showingCachedProjects)
         {
             m_activity->Stop();
         }
 
+        // when refreshing, keep current selection if the project still exists:
+        if (!m_currentProject.slug.empty())
+        {
+            auto current = std::find_if(m_projects.begin(), m_projects.end(), [=](const auto& p){ return IsSameProject(p, m_currentProject); });
+            if (current != m_projects.end())
+            {
+                m_project->SetSelection(1 + int(current - m_projects.begin()));
+                return;
+            }
+
+            m_currentProject = CloudAccountClient::ProjectInfo();
+            m_files->ClearFiles();
+            m_language->Clear();
+            EnableAllChoices(false);
+            m_project->Enable();
+        }
+
         if (m_projects.size() == 1)
         {
             m_project->SetSelection(1);
@@ -614,14 +690,30 @@ private:
             auto account = AccountFor(m_currentProject);
 
             Config::CloudLastProject(m_currentProject.slug);
-            m_activity->Start();
-            EnableAllChoices(false);
-            m_files->ClearFiles();
-            account->GetProjectDetails(m_currentProject)
+
+            const auto project = m_currentProject;
+            CloudAccountClient::ProjectDetails cached;
+            const bool haveCached = account->GetCachedProjectDetails(project, cached);
+            if (haveCached)
+            {
+                OnFetchedProjectInfo(cached);
+            }
+            else
+            {
+                m_activity->Start();
+                EnableAllChoices(false);
+                m_files->ClearFiles();
+            }
+
+            account->RefreshProjectDetails(project)
                 .then_on_window(this, [=](CloudAccountClient::ProjectDetails prj){
+                    if (!IsSameProject(project, m_currentProject))
+                        return;  // user changed selection since invocation
                     this->OnFetchedProjectInfo(prj);
                 })
                 .catch_all([=](dispatch::exception_ptr e){
+                    if (haveCached || !IsSameProject(project, m_currentProject))
+                        return;
                     m_activity->HandleError(e);
                     EnableAllChoices(true);
                 });
@@ -632,6 +724,10 @@ private:
     void OnFetchedProjectInfo(CloudAccountClient::ProjectDetails prj)
     {
         auto previouslySelectedLanguage = m_language->GetStringSelection(); // may be empty
+        auto previouslySelectedFile = m_files->GetSelectedRow();
+        CloudAccountClient::ProjectFile previousFile;
+        if (previouslySelectedFile != wxNOT_FOUND)
+            previousFile = m_info.files[previouslySelectedFile];
 
         m_info = prj;
         SortAlphabetically(m_info.languages, [](const auto& l){ return l.DisplayName(); });
@@ -640,6 +736,8 @@ private:
         m_language->Append("");
         for (auto& i: m_info.languages)
             m_language->Append(i.DisplayName());
+        if (m_info.languages.size() > 1)
+            m_language->Append(_("All languages"));
 
         m_files->SetFiles(m_info.files);
 
@@ -670,7 +768,15 @@ private:
         }
 
         if (m_info.files.size() == 1)
+        {
             m_files->SelectRow(0);
+        }
+        else if (previouslySelectedFile != wxNOT_FOUND)
+        {
+            auto f = std::find_if(m_info.files.begin(), m_info.files.end(), [&](const auto& i){ return i.title == previousFile.title && i.description == previousFile.description; });
+            if (f != m_info.files.end())
+                m_files->SelectRow(int(f - m_info.files.begin()));
+        }
 
     }
 
@@ -685,16 +791,36 @@ private:
     void OnOK(wxCommandEvent&)
     {
         auto cloudFile = m_info.files[m_files->GetSelectedRow()];
-        auto cloudLang = m_info.languages[m_language->GetSelection() - 1];
-        LanguageDialog::SetLastChosen(cloudLang);
-        OutLocalFilename = CreateLocalFilename(m_currentProject, cloudFile, cloudLang);
+        const size_t langIndex = m_language->GetSelection() - 1;
+
+        std::vector<Language> langs;
+        if (langIndex < m_info.languages.size())
+        {
+            langs.push_back(m_info.languages[langIndex]);
+            LanguageDialog::SetLastChosen(langs.front());
+        }
+        else
+        {
+            langs = m_info.languages;  // "All languages"
+        }
 
         m_activity->Start(_(L"Downloading latest translations…"));
 
-        auto outfile = std::make_shared<TempOutputFileFor>(OutLocalFilename);
-        AccountFor(m_currentProject)->DownloadFile(str::to_wstring(outfile->FileName()), m_currentProject, cloudFile, cloudLang)
+        OutLocalFilenames.clear();
+        std::vector<std::shared_ptr<TempOutputFileFor>> outfiles;
+        std::vector<std::pair<Language, std::wstring>> outputs;
+        for (auto& lang: langs)
+        {
+            auto filename = CreateLocalFilename(m_currentProject, cloudFile, lang);
+            OutLocalFilenames.push_back(filename);
+            outfiles.push_back(std::make_shared<TempOutputFileFor>(filename));
+            outputs.emplace_back(lang, str::to_wstring(outfiles.back()->FileName()));
+        }
+
+        AccountFor(m_currentProject)->DownloadFiles(m_currentProject, cloudFile, outputs)
             .then_on_window(this, [=]{
-                outfile->Commit();
+                for (auto& f: outfiles)
+                    f->Commit();
                 AcceptAndClose();
             })
             .catch_all(m_activity->HandleError);
@@ -745,7 +871,9 @@ private:
 
     std::vector<CloudAccountClient*> m_accounts;
     std::vector<CloudAccountClient::ProjectInfo> m_projects;
+    std::map<CloudAccountClient*, std::vector<CloudAccountClient::ProjectInfo>> m_projectsByAccount;
     size_t m_projectsPendingLoad = 0;
+    bool m_showingCachedProjects = false;
     CloudAccountClient::ProjectDetails m_info;
     CloudAccountClient::ProjectInfo m_currentProject;
 };
@@ -763,7 +891,7 @@ public:
 
     dispatch::future<void> Upload(CatalogPtr file) override
     {
-        return m_account.UploadFile(file->SaveToBuffer(), m_meta);
+        return m_account.UploadFile(file, m_meta);
     }
 
 protected:
@@ -795,17 +923,18 @@ public:
 
 void CloudOpenFile(wxWindow *parent,
                    std::shared_ptr<CloudAccountClient::ProjectInfo> project,
-                   std::function<void(int, wxString)> onDone)
+                   std::function<void(int, wxArrayString)> onDone)
 {
     wxWindowPtr<CloudOpenDialog> dlg(new CloudOpenDialog(parent));
 
-    if (GetSignedInAccounts().empty())
+    // Wait for credentials to be loaded before checking for signed-in accounts.
+    // This also delays the code until after the ShowModal() call below is
+    // executed, which is needed for showing window-modal login:
+    CloudAccountClient::WhenAllCredentialsLoaded().then_on_window(dlg.get(), [=]
     {
-        // FIXME: use some kind of wizard UI with going to next page instead?
-        // We need to show this window-modal after the ShowModal() call below is
-        // executed. Use CallAfter() to delay:
-        dlg->CallAfter([=]
+        if (GetSignedInAccounts().empty())
         {
+            // FIXME: use some kind of wizard UI with going to next page instead?
             dlg->ManageAccounts<CloudLoginDialog<AccountsPanel>>([dlg,project](bool ok)
             {
                 if (ok)
@@ -813,15 +942,15 @@ void CloudOpenFile(wxWindow *parent,
                 else
                     dlg->EndModal(wxID_CANCEL);
             });
-        });
-    }
-    else
-    {
-        dlg->LoadFromCloud(project);
-    }
+        }
+        else
+        {
+            dlg->LoadFromCloud(project);
+        }
+    });
 
     auto retval = dlg->ShowModal(); // FIXME: Use global modal-less dialog
-    onDone(retval, dlg->OutLocalFilename);
+    onDone(retval, dlg->OutLocalFilenames);
 }
 
 
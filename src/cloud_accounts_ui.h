@@ -138,6 +138,8 @@ protected:
     void SelectAccount(unsigned index);
 
 private:
+    void DoInitializeAfterShown();
+
     IconAndSubtitleListCtrl *m_list;
     wxSimplebook *m_panelsBook;
     ServiceSelectionPanel *m_introPanel;
@@ -203,9 +205,10 @@ public:
 
     @param parent    PoeditFrame the UI should be shown under.
     @param project   Optional project to preselect, otherwise nullptr
-    @param onDone    Called with the dialog return value (wxID_OK/CANCEL) and name of loaded PO file.
+    @param onDone    Called with the dialog return value (wxID_OK/CANCEL) and names of loaded files
+                     (more than one if the user chose to download all languages).
  */
-void CloudOpenFile(wxWindow *parent, std::shared_ptr<CloudAccountClient::ProjectInfo> project, std::function<void(int, wxString)> onDone);
+void CloudOpenFile(wxWindow *parent, std::shared_ptr<CloudAccountClient::ProjectInfo> project, std::function<void(int, wxArrayString)> onDone);
 
 /// Was the file opened directly from a cloud account and should be synced when the user saves it?
 bool ShouldSyncToCloudAutomatically(CatalogPtr catalog);
@@ -0,0 +1,243 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2017-2023 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "cloud_sync.h"
+
+#include "perf_trace.h"
+
+#ifdef HAVE_HTTP_CLIENT
+    #include "http_client.h"
+#endif
+
+#include <wx/log.h>
+#include <wx/timer.h>
+#include <wx/utils.h>
+
+#include <boost/chrono.hpp>
+
+
+namespace
+{
+
+// First retry of a failed upload is done after this delay, it doubles with every further attempt
+const int RETRY_INITIAL_DELAY = 5000;  // ms
+const int MAX_RETRIES = 5;
+
+// How long to wait for uploads in progress when shutting down
+const int SHUTDOWN_WAIT = 30;  // seconds
+
+} // anonymous namespace
+
+
+struct CloudSyncQueue::Entry
+{
+    std::shared_ptr<CloudSyncDestination> dest;
+    CatalogPtr file;
+    State state = State::Idle;
+    bool uploadAgain = false;
+    int attempt = 0;
+    wxTimer retryTimer;
+};
+
+
+CloudSyncQueue *CloudSyncQueue::ms_instance = nullptr;
+
+CloudSyncQueue& CloudSyncQueue::Get()
+{
+    if (!ms_instance)
+        ms_instance = new CloudSyncQueue();
+    return *ms_instance;
+}
+
+
+void CloudSyncQueue::CleanUp()
+{
+    if (!ms_instance)
+        return;
+
+    // don't lose changes just saved by the user, let running uploads finish:
+    for (auto& e: ms_instance->m_entries)
+        e.second->retryTimer.Stop();
+    auto start = boost::chrono::steady_clock::now();
+    while (ms_instance->IsBusy() && boost::chrono::steady_clock::now() - start < boost::chrono::seconds(SHUTDOWN_WAIT))
+    {
+        wxYield();
+        wxMilliSleep(10);
+    }
+
+    delete ms_instance;
+    ms_instance = nullptr;
+}
+
+
+CloudSyncQueue::~CloudSyncQueue()
+{
+}
+
+
+bool CloudSyncQueue::IsBusy() const
+{
+    for (auto& e: m_entries)
+    {
+        if (e.second->state == State::Uploading)
+            return true;
+    }
+    return false;
+}
+
+
+void CloudSyncQueue::Upload(std::shared_ptr<CloudSyncDestination> dest, CatalogPtr file)
+{
+    auto key = file.get();
+    auto& e = m_entries[key];
+    if (!e)
+    {
+        e.reset(new Entry);
+        e->file = file;
+        e->retryTimer.Bind(wxEVT_TIMER, [=](wxTimerEvent&){ Start(key); });
+    }
+    e->dest = dest;
+    e->attempt = 0;
+
+    if (e->state == State::Uploading)
+    {
+        // coalesce with any other pending uploads into one of the latest version:
+        e->uploadAgain = true;
+        return;
+    }
+
+    e->retryTimer.Stop();
+    Start(key);
+}
+
+
+CloudSyncQueue::State CloudSyncQueue::GetState(CatalogPtr file) const
+{
+    auto i = m_entries.find(file.get());
+    return i != m_entries.end() ? i->second->state : State::Idle;
+}
+
+
+int CloudSyncQueue::AddObserver(Observer func)
+{
+    m_observers[++m_lastObserverId] = func;
+    return m_lastObserverId;
+}
+
+
+void CloudSyncQueue::RemoveObserver(int id)
+{
+    m_observers.erase(id);
+}
+
+
+void CloudSyncQueue::Start(Catalog *key)
+{
+    auto& e = *m_entries.at(key);
+    e.uploadAgain = false;
+    Notify(e, State::Uploading);
+
+    wxLogTrace("poedit.cloud", "uploading %s to %s (attempt %d)", e.file->GetFileName(), e.dest->GetName(), e.attempt + 1);
+
+    const auto start = perf::Clock::now();
+    dispatch::future<void> upload;
+    try
+    {
+        // Note that the content of the file is serialized, or snapshotted, right away on the main thread
+        upload = e.dest->Upload(e.file);
+    }
+    catch (...)
+    {
+        OnFinished(key, dispatch::current_exception());
+        return;
+    }
+
+    upload
+        .then_on_main([key,start]
+        {
+            perf::RecordEvent("cloud upload", start);
+            if (ms_instance)
+                ms_instance->OnFinished(key, dispatch::exception_ptr());
+        })
+        .catch_all([key,start](dispatch::exception_ptr error)
+        {
+            perf::RecordEvent("cloud upload", start);
+            if (ms_instance)
+                ms_instance->OnFinished(key, error);
+        });
+}
+
+
+void CloudSyncQueue::OnFinished(Catalog *key, dispatch::exception_ptr error)
+{
+    auto i = m_entries.find(key);
+    if (i == m_entries.end())
+        return;
+    auto& e = *i->second;
+
+    if (e.uploadAgain)
+    {
+        // newer version was saved in the meantime, it supersedes this one and its error
+        e.attempt = 0;
+        Start(key);
+        return;
+    }
+
+    if (!error)
+    {
+        Notify(e, State::Idle);
+        m_entries.erase(i);
+        return;
+    }
+
+#ifdef HAVE_HTTP_CLIENT
+    const bool transient = http_client::is_transient_error(error);
+#else
+    const bool transient = false;
+#endif
+    if (transient && e.attempt < MAX_RETRIES)
+    {
+        auto delay = RETRY_INITIAL_DELAY << e.attempt;
+        e.attempt++;
+        wxLogTrace("poedit.cloud", "upload of %s failed, retrying in %d ms", e.file->GetFileName(), delay);
+        Notify(e, State::Retrying);
+        e.retryTimer.StartOnce(delay);
+        return;
+    }
+
+    Notify(e, State::Failed, DescribeException(error));
+    m_entries.erase(i);
+}
+
+
+void CloudSyncQueue::Notify(Entry& e, State state, const wxString& error)
+{
+    e.state = state;
+
+    // copy, observers may unregister themselves when called:
+    auto observers = m_observers;
+    for (auto& o: observers)
+        o.second(e.file, state, error);
+}
@@ -43,6 +43,8 @@
     #include <wx/windowptr.h>
 #endif
 
+#include <functional>
+#include <map>
 #include <memory>
 
 
@@ -124,54 +126,71 @@ public:
     }
 
     ActivityIndicator *Activity;
+};
+
+
+/**
+    Queue of uploads of files to their cloud sync destinations.
+
+    Uploads run in the background. Uploads of the same file never overlap:
+    if the file is saved again while it is being uploaded, its latest version
+    is uploaded once the current upload finishes, and intermediate versions
+    are skipped. Uploads that fail with a transient (network or server) error
+    are retried with exponential backoff.
 
-    /// Show the window while performing background sync action. Show error if 
-    static void RunSync(wxWindow *parent, std::shared_ptr<CloudSyncDestination> dest, CatalogPtr file)
+    All methods must be called on the main thread.
+ */
+class CloudSyncQueue
+{
+public:
+    /// State of a file's sync, as reported to observers
+    enum class State
     {
-        if (!dest->AuthIfNeeded(parent))
-        {
-            return;
-        }
-
-        wxWindowPtr<CloudSyncProgressWindow> progress(new CloudSyncProgressWindow(parent, dest));
-#ifdef __WXOSX__
-        progress->ShowWindowModal();
-#else
-        progress->Show();
-#endif
+        Idle,       ///< nothing to do
+        Uploading,  ///< upload in progress
+        Retrying,   ///< upload failed, will be retried soon
+        Failed      ///< upload failed permanently; the error is reported too
+    };
 
-        auto future = dispatch::async([=]{ return dest->Upload(file); });
-        for (;;)
-        {
-            if (future.wait_for(boost::chrono::milliseconds(10)) == dispatch::future_status::ready)
-                break; // all is done
-            wxYield();
-        }
-
-#ifdef __WXOSX__
-        progress->EndModal(wxID_OK);
-#else
-        progress->Hide();
-#endif
+    /// Returns the singleton instance.
+    static CloudSyncQueue& Get();
 
-        try
-        {
-            future.get();
-        }
-        catch (...)
-        {
-            wxWindowPtr<wxMessageDialog> err(new wxMessageDialog
-            (
-                    parent,
-                    // TRANSLATORS: %s is a cloud destination, e.g. "Crowdin" or ftp.wordpress.com etc.
-                    wxString::Format(_("Uploading translations to %s failed."), dest->GetName()),
-                    _("Syncing error"),
-                    wxOK | wxICON_ERROR
-                ));
-            err->SetExtendedMessage(DescribeCurrentException());
-            err->ShowWindowModalThenDo([err](int){});
-        }
-    }
+    /**
+        Destroys the singleton, must be called on app shutdown.
+
+        Waits (for a limited time) for uploads in progress to finish;
+        scheduled retries are abandoned.
+     */
+    static void CleanUp();
+
+    /// Schedules upload of the current content of @a file to @a dest.
+    void Upload(std::shared_ptr<CloudSyncDestination> dest, CatalogPtr file);
+
+    /// Returns current state of @a file's sync.
+    State GetState(CatalogPtr file) const;
+
+    /// Function notified about changes of a file's sync state; @a error is set for State::Failed.
+    typedef std::function<void(CatalogPtr file, State state, const wxString& error)> Observer;
+
+    /// Registers observer of state changes; returns ID for RemoveObserver().
+    int AddObserver(Observer func);
+    void RemoveObserver(int id);
+
+private:
+    CloudSyncQueue() {}
+    ~CloudSyncQueue();
+
+    struct Entry;
+    void Start(Catalog *key);
+    void OnFinished(Catalog *key, dispatch::exception_ptr error);
+    void Notify(Entry& e, State state, const wxString& error = wxString());
+    bool IsBusy() const;
+
+    std::map<Catalog*, std::unique_ptr<Entry>> m_entries;
+    std::map<int, Observer> m_observers;
+    int m_lastObserverId = 0;
+
+    static CloudSyncQueue *ms_instance;
 };
 
 #endif // wxUSE_GUI
@@ -26,8 +26,11 @@
 #include "concurrency.h"
 
 #include "errors.h"
+#include "perf_trace.h"
 #include <wx/log.h>
 
+#include <chrono>
+
 // All this is for rethrow_for_boost:
 #if defined(HAVE_HTTP_CLIENT) && !defined(__WXOSX__)
 #include <cpprest/http_msg.h>
@@ -92,12 +95,19 @@ void detail::dispatch_async_cxx(boost::executors::work&& f, detail::queue q)
         case detail::queue::main:
             dq = dispatch_get_main_queue();
             break;
+        case detail::queue::priority_interactive:
+            dq = dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
+            break;
         case detail::queue::priority_default:
-            dq = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+            dq = dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0);
+            break;
+        case detail::queue::priority_bulk:
+            dq = dispatch_get_global_queue(QOS_CLASS_UTILITY, 0);
             break;
     }
 
     dispatch_async(dq, [f{std::move(f)}]() mutable {
+        perf::ScopedTask task;
         try
         {
             f();
@@ -114,22 +124,427 @@ void detail::dispatch_async_cxx(boost::executors::work&& f, detail::queue q)
 #endif // HAVE_DISPATCH
 
 
+#if defined(USE_PPL_DISPATCH)
+
+#include <wx/msw/wrapwin.h>
+
 namespace
 {
 
-std::unique_ptr<dispatch::detail::background_queue_executor> gs_background_executor;
+void CALLBACK run_threadpool_work(PTP_CALLBACK_INSTANCE, void *context)
+{
+    std::unique_ptr<boost::executors::work> f(static_cast<boost::executors::work*>(context));
+    perf::ScopedTask task;
+    try
+    {
+        (*f)();
+    }
+    catch (...)
+    {
+        // consistent with dispatch_async_cxx()
+        wxLogDebug("uncaught exception: %s", DescribeCurrentException());
+    }
+}
+
+} // anonymous namespace
+
+void detail::threadpool_submit(boost::executors::work&& f, priority p)
+{
+    TP_CALLBACK_ENVIRON env;
+    InitializeThreadpoolEnvironment(&env);
+    switch (p)
+    {
+        case priority::interactive:
+            SetThreadpoolCallbackPriority(&env, TP_CALLBACK_PRIORITY_HIGH);
+            break;
+        case priority::normal:
+            SetThreadpoolCallbackPriority(&env, TP_CALLBACK_PRIORITY_NORMAL);
+            break;
+        case priority::bulk:
+            SetThreadpoolCallbackPriority(&env, TP_CALLBACK_PRIORITY_LOW);
+            break;
+    }
+
+    auto context = new boost::executors::work(std::move(f));
+    if (!TrySubmitThreadpoolCallback(run_threadpool_work, context, &env))
+    {
+        // unlikely, but don't lose the work if it happens
+        pplx::create_task([context]() mutable { run_threadpool_work(nullptr, context); });
+    }
+
+    DestroyThreadpoolEnvironment(&env);
+}
+
+#endif // USE_PPL_DISPATCH
+
+
+#if !defined(HAVE_DISPATCH) && !defined(USE_PPL_DISPATCH)
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+
+class dispatch::detail::background_queue_executor::impl
+{
+public:
+    impl()
+    {
+        const unsigned count = std::max(2u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < count; i++)
+            m_queues.emplace_back(new worker_queue);
+        for (unsigned i = 0; i < count; i++)
+            m_threads.emplace_back([=]{ worker_main(i); });
+    }
+
+    ~impl()
+    {
+        close();
+    }
+
+    void submit(work&& closure, priority p)
+    {
+        // tasks spawned by a worker stay local to it, others are distributed evenly:
+        size_t index = (ms_workerOwner == this) ? ms_workerIndex : (m_nextQueue++ % m_queues.size());
+        m_pending++;
+        {
+            auto& q = *m_queues[index];
+            std::lock_guard<perf::InstrumentedMutex> lock(q.mutex);
+            q.tasks[int(p)].push_back(std::move(closure));
+        }
+
+        {
+            // lock to not miss a worker that is about to go to sleep
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+        }
+        m_wakeup.notify_one();
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            if (m_closed)
+                return;
+            m_closed = true;
+        }
+        m_wakeup.notify_all();
+
+        for (auto& t: m_threads)
+        {
+            if (t.get_id() == std::this_thread::get_id())
+                t.detach();  // closing from a background task
+            else
+                t.join();
+        }
+    }
+
+private:
+    static const int PRIORITIES_COUNT = int(priority::bulk) + 1;
+
+    // tasks of each priority, highest priority first
+    struct worker_queue
+    {
+        perf::InstrumentedMutex mutex {"dispatch queue"};
+        std::deque<work> tasks[PRIORITIES_COUNT];
+    };
+
+    void worker_main(size_t index)
+    {
+        ms_workerOwner = this;
+        ms_workerIndex = index;
+
+        for (;;)
+        {
+            work task;
+            if (take_task(index, task))
+            {
+                perf::ScopedTask scope;
+                try
+                {
+                    task();
+                }
+                catch (...)
+                {
+                    // consistent with dispatch_async_cxx()
+                    wxLogDebug("uncaught exception: %s", DescribeCurrentException());
+                }
+                continue;
+            }
+
+            // no work anywhere, sleep until more is submitted; pending tasks
+            // are still processed after closing
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_wakeup.wait(lock, [=]{ return m_pending > 0 || m_closed; });
+            if (m_pending == 0 && m_closed)
+                return;
+        }
+    }
+
+    bool take_task(size_t index, work& task)
+    {
+        for (int p = 0; p < PRIORITIES_COUNT; p++)
+        {
+            if (take_task(index, p, task))
+                return true;
+        }
+
+        // some queues may have been skipped because they were locked, check
+        // if there's work left before giving up:
+        if (m_pending == 0)
+            return false;
+        std::this_thread::yield();
+        return take_task_blocking(index, task);
+    }
+
+    bool take_task(size_t index, int prio, work& task)
+    {
+        // own tasks first, newest first for cache locality:
+        {
+            auto& q = *m_queues[index];
+            std::lock_guard<perf::InstrumentedMutex> lock(q.mutex);
+            auto& tasks = q.tasks[prio];
+            if (!tasks.empty())
+            {
+                task = std::move(tasks.back());
+                tasks.pop_back();
+                m_pending--;
+                return true;
+            }
+        }
+
+        // steal the oldest task from someone else:
+        const size_t count = m_queues.size();
+        for (size_t i = 1; i < count; i++)
+        {
+            auto& q = *m_queues[(index + i) % count];
+            std::unique_lock<perf::InstrumentedMutex> lock(q.mutex, std::try_to_lock);
+            auto& tasks = q.tasks[prio];
+            if (lock.owns_lock() && !tasks.empty())
+            {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                m_pending--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool take_task_blocking(size_t index, work& task)
+    {
+        const size_t count = m_queues.size();
+        for (int p = 0; p < PRIORITIES_COUNT; p++)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                auto& q = *m_queues[(index + i) % count];
+                std::lock_guard<perf::InstrumentedMutex> lock(q.mutex);
+                auto& tasks = q.tasks[p];
+                if (!tasks.empty())
+                {
+                    task = std::move(tasks.front());
+                    tasks.pop_front();
+                    m_pending--;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<worker_queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_nextQueue {0};
+    std::atomic<size_t> m_pending {0};
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeup;
+    bool m_closed = false;
+
+    static thread_local impl *ms_workerOwner;
+    static thread_local size_t ms_workerIndex;
+};
+
+thread_local dispatch::detail::background_queue_executor::impl *dispatch::detail::background_queue_executor::impl::ms_workerOwner = nullptr;
+thread_local size_t dispatch::detail::background_queue_executor::impl::ms_workerIndex = 0;
+
+
+dispatch::detail::background_queue_executor::background_queue_executor(priority p)
+    : m_priority(p)
+{
+    // executors for all priorities share a single pool:
+    static std::weak_ptr<impl> s_pool;
+    static std::mutex s_poolMutex;
+    std::lock_guard<std::mutex> lock(s_poolMutex);
+    m_impl = s_pool.lock();
+    if (!m_impl)
+    {
+        m_impl = std::make_shared<impl>();
+        s_pool = m_impl;
+    }
+}
+
+dispatch::detail::background_queue_executor::~background_queue_executor()
+{
+}
+
+void dispatch::detail::background_queue_executor::submit(work&& closure)
+{
+    m_impl->submit(std::move(closure), m_priority);
+}
+
+void dispatch::detail::background_queue_executor::close()
+{
+    custom_executor::close();
+    m_impl->close();
+}
+
+#endif // !HAVE_DISPATCH && !USE_PPL_DISPATCH
+
+
+class dispatch::detail::main_thread_executor::impl : public std::enable_shared_from_this<impl>
+{
+public:
+    ~impl()
+    {
+        // closures that didn't run before shutdown are discarded:
+        DeleteList(m_head.exchange(nullptr));
+        DeleteList(m_pendingHead);
+    }
+
+    void submit(work&& closure)
+    {
+        auto n = new node{std::move(closure), m_head.load()};
+        while (!m_head.compare_exchange_weak(n->next, n)) {}
+        schedule();
+    }
+
+private:
+    struct node
+    {
+        work closure;
+        node *next;
+    };
+
+    // Time budget of running a single batch, about half of a 60 Hz frame:
+    static constexpr auto BATCH_TIME_BUDGET = std::chrono::milliseconds(8);
+
+    static void DeleteList(node *n)
+    {
+        while (n)
+        {
+            auto next = n->next;
+            delete n;
+            n = next;
+        }
+    }
+
+    // Posts draining event to the main thread, unless one is posted already
+    void schedule()
+    {
+        if (m_scheduled.exchange(true))
+            return;
+
+        auto self = shared_from_this();
+#ifdef HAVE_DISPATCH
+        dispatch_async_cxx([self]{ self->drain(); }, queue::main);
+#else
+        wxTheApp->CallAfter([self]{ self->drain(); });
+#endif
+    }
+
+    void drain()
+    {
+        // must be reset before taking the list, so that closures submitted
+        // after that post another event:
+        m_scheduled = false;
+
+        // the list is in LIFO order, append it reversed after what remained
+        // from the previous batch:
+        node *taken = m_head.exchange(nullptr);
+        node *head = nullptr, *tail = taken;
+        while (taken)
+        {
+            auto next = taken->next;
+            taken->next = head;
+            head = taken;
+            taken = next;
+        }
+        if (head)
+        {
+            if (m_pendingTail)
+                m_pendingTail->next = head;
+            else
+                m_pendingHead = head;
+            m_pendingTail = tail;
+        }
+
+        const auto deadline = std::chrono::steady_clock::now() + BATCH_TIME_BUDGET;
+        while (m_pendingHead)
+        {
+            std::unique_ptr<node> n(m_pendingHead);
+            m_pendingHead = n->next;
+            if (!m_pendingHead)
+                m_pendingTail = nullptr;
+
+            // the rest must be processed by another event, both when the time
+            // budget is used up and when the closure runs a nested event loop
+            // (e.g. shows a modal dialog):
+            if (m_pendingHead)
+                schedule();
+
+            n->closure();
+
+            if (std::chrono::steady_clock::now() >= deadline)
+                break;
+        }
+    }
+
+    std::atomic<node*> m_head {nullptr};
+    std::atomic<bool> m_scheduled {false};
+
+    // closures taken from m_head but not executed yet, only used on the main thread:
+    node *m_pendingHead = nullptr;
+    node *m_pendingTail = nullptr;
+};
+
+dispatch::detail::main_thread_executor::main_thread_executor()
+    : m_impl(std::make_shared<impl>())
+{
+}
+
+dispatch::detail::main_thread_executor::~main_thread_executor()
+{
+}
+
+void dispatch::detail::main_thread_executor::submit(work&& closure)
+{
+    m_impl->submit(std::move(closure));
+}
+
+
+namespace
+{
+
+const int PRIORITIES_COUNT = int(dispatch::priority::bulk) + 1;
+
+std::unique_ptr<dispatch::detail::background_queue_executor> gs_background_executors[PRIORITIES_COUNT];
 std::unique_ptr<dispatch::detail::main_thread_executor> gs_main_thread_executor;
 static std::once_flag gs_background_executor_flag, gs_main_thread_executor_flag;
 
 }
 
 dispatch::detail::background_queue_executor&
-dispatch::detail::background_queue_executor::get()
+dispatch::detail::background_queue_executor::get(priority p)
 {
     std::call_once(gs_background_executor_flag, []{
-        gs_background_executor.reset(new background_queue_executor);
+        for (int i = 0; i < PRIORITIES_COUNT; i++)
+            gs_background_executors[i].reset(new background_queue_executor(priority(i)));
     });
-    return *gs_background_executor;
+    return *gs_background_executors[int(p)];
 }
 
 dispatch::detail::main_thread_executor&
@@ -143,11 +558,15 @@ dispatch::detail::main_thread_executor::get()
 
 void dispatch::cleanup()
 {
-    if (gs_background_executor)
-        gs_background_executor->close();
+    for (auto& e: gs_background_executors)
+    {
+        if (e)
+            e->close();
+    }
     if (gs_main_thread_executor)
         gs_main_thread_executor->close();
 
-    gs_background_executor.reset();
+    for (auto& e: gs_background_executors)
+        e.reset();
     gs_main_thread_executor.reset();
 }
@@ -57,10 +57,6 @@
 #include <boost/chrono/duration.hpp>
 #include <boost/throw_exception.hpp>
 
-#if !defined(HAVE_DISPATCH) && !defined(USE_PPL_DISPATCH)
-    #include <boost/thread/executors/basic_thread_pool.hpp>
-#endif
-
 #if defined(HAVE_PPL)
     #if defined(_MSC_VER)
         #include <concrt.h>
@@ -71,12 +67,24 @@
     #endif
 #endif
 
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <type_traits>
 
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+    #include <coroutine>
+#endif
+#include <utility>
+#include <vector>
+
 #include <wx/app.h>
+#include <wx/thread.h>
 #include <wx/weakref.h>
 
 
@@ -89,6 +97,18 @@ template<typename T>
 class future;
 
 
+/// Priority of operations performed in the background
+enum class priority
+{
+    /// The user is waiting for the result, e.g. suggestions for the current item
+    interactive,
+    /// Default priority
+    normal,
+    /// Long running batch jobs such as pre-translation, imports or extraction
+    bulk
+};
+
+
 // implementation details
 
 namespace detail
@@ -124,7 +144,9 @@ private:
 enum class queue
 {
     main,
-    priority_default
+    priority_interactive,
+    priority_default,
+    priority_bulk
 };
 
 extern void dispatch_async_cxx(boost::executors::work&& f, queue q = queue::priority_default);
@@ -132,51 +154,99 @@ extern void dispatch_async_cxx(boost::executors::work&& f, queue q = queue::prio
 class background_queue_executor : public custom_executor
 {
 public:
-    static background_queue_executor& get();
+    static background_queue_executor& get(priority p = priority::normal);
+
+    background_queue_executor(priority p)
+        : m_queue(p == priority::interactive ? queue::priority_interactive :
+                  p == priority::bulk        ? queue::priority_bulk :
+                                               queue::priority_default)
+    {}
 
     void submit(work&& closure) override
     {
-        dispatch_async_cxx(std::forward<work>(closure));
+        dispatch_async_cxx(std::forward<work>(closure), m_queue);
     }
+
+private:
+    queue m_queue;
 };
 
 #elif defined(USE_PPL_DISPATCH)
 
+// Submits work to the system thread pool (used by PPL as well) with given priority
+extern void threadpool_submit(boost::executors::work&& f, priority p);
+
 class background_queue_executor : public custom_executor
 {
 public:
-    static background_queue_executor& get();
+    static background_queue_executor& get(priority p = priority::normal);
+
+    background_queue_executor(priority p) : m_priority(p) {}
 
     void submit(work&& closure)
     {
-        pplx::create_task([f{std::move(closure)}]() mutable { f(); });
+        threadpool_submit(std::move(closure), m_priority);
     }
+
+private:
+    priority m_priority;
 };
 
 #else // !HAVE_DISPATCH && !USE_PPL_DISPATCH
 
-class background_queue_executor : public boost::basic_thread_pool
+/**
+    Work-stealing thread pool with one worker per hardware thread.
+
+    Each worker has its own queue of tasks, so that workers don't contend on
+    a single lock. Tasks submitted from a worker go to its own queue and are
+    processed most-recent-first; idle workers steal the oldest tasks from
+    other workers' queues.
+
+    Higher priority tasks are always taken before lower priority ones. All
+    priorities share the same pool of workers.
+ */
+class background_queue_executor : public custom_executor
 {
 public:
-    static background_queue_executor& get();
+    static background_queue_executor& get(priority p = priority::normal);
+
+    background_queue_executor(priority p);
+    ~background_queue_executor();
+
+    void submit(work&& closure) override;
+    void close() override;
+
+private:
+    class impl;
+    std::shared_ptr<impl> m_impl;
+    priority m_priority;
 };
 
 #endif // HAVE_DISPATCH etc.
 
 
+/**
+    Executes closures on the main thread.
+
+    Submitted closures are collected in a lock-free list and executed, in the
+    order they were submitted, in batches from a single event posted to the
+    main thread. A batch ends when its time budget is used up and continues
+    in the next event, so that bursts of completions from background jobs
+    don't flood the event queue and delay input handling and painting.
+ */
 class main_thread_executor : public custom_executor
 {
 public:
     static main_thread_executor& get();
 
-    void submit(work&& closure)
-    {
-#ifdef HAVE_DISPATCH
-        dispatch_async_cxx(std::forward<work>(closure), queue::main);
-#else
-        wxTheApp->CallAfter(std::forward<work>(closure));
-#endif
-    }
+    main_thread_executor();
+    ~main_thread_executor();
+
+    void submit(work&& closure) override;
+
+private:
+    class impl;
+    std::shared_ptr<impl> m_impl;
 };
 
 
@@ -276,6 +346,22 @@ inline auto call_and_unwrap_if_future(F&& f, Args&&... args) -> typename future_
     return future_unwrapper<typename std::invoke_result<F, Args...>::type>::call_and_unwrap(std::forward<F>(f), std::forward<Args>(args)...);
 }
 
+
+// Runs continuation of an already fulfilled future immediately and wraps its
+// result (of type Ret, as returned by call_and_unwrap_if_future) in a future.
+// Defined after dispatch::future.
+template<typename Ret>
+struct ready_continuation;
+
+// Can then() run the continuation immediately? It can if the value is already
+// available and the caller is a background thread, because then it would be
+// just scheduled to run on another background thread.
+template<typename T>
+inline bool can_continue_immediately(const boost::future<T>& f)
+{
+    return f.is_ready() && !wxThread::IsMain();
+}
+
 } // namespace detail
 
 
@@ -369,6 +455,15 @@ public:
     auto then(F&& continuation) -> future<typename detail::future_unwrapper<typename std::invoke_result<F, typename detail::argument_type<F>::arg0_type>::type>::type>
     {
         typedef detail::continuation_calling_helper<typename detail::argument_type<typename std::decay<F>::type>::arg0_type> cch;
+        if (detail::can_continue_immediately(this->f_))
+        {
+            typedef typename detail::future_unwrapper<typename std::invoke_result<F, typename detail::argument_type<F>::arg0_type>::type>::return_type ret_type;
+            boost::future<T> x(std::move(this->f_));
+            return detail::ready_continuation<ret_type>::run([&]{
+                return detail::call_and_unwrap_if_future(continuation, cch::unpack_arg(std::move(x)));
+            });
+        }
+
         return this->f_.then(detail::background_queue_executor::get(),
                              [f{std::move(continuation)}](boost::future<T> x){
                                  try
@@ -454,6 +549,16 @@ public:
     auto then(F&& continuation) -> future<typename detail::future_unwrapper<typename std::invoke_result<F>::type>::type>
     {
         typedef detail::continuation_calling_helper<typename detail::argument_type<typename std::decay<F>::type>::arg0_type> cch;
+        if (detail::can_continue_immediately(this->f_))
+        {
+            typedef typename detail::future_unwrapper<typename std::invoke_result<F>::type>::return_type ret_type;
+            boost::future<void> x(std::move(this->f_));
+            return detail::ready_continuation<ret_type>::run([&]{
+                cch::touch_arg(x);
+                return detail::call_and_unwrap_if_future(continuation);
+            });
+        }
+
         return this->f_.then(detail::background_queue_executor::get(),
                              [f{std::move(continuation)}](boost::future<void> x){
                                  try
@@ -590,6 +695,64 @@ auto make_exceptional_future(exception_ptr ex) -> future<T>
 }
 
 
+namespace detail
+{
+
+template<typename Ret>
+struct ready_continuation
+{
+    template<typename F>
+    static future<Ret> run(F&& f)
+    {
+        try
+        {
+            return make_ready_future(f());
+        }
+        catch (...)
+        {
+            return make_exceptional_future_from_current<Ret>();
+        }
+    }
+};
+
+template<>
+struct ready_continuation<void>
+{
+    template<typename F>
+    static future<void> run(F&& f)
+    {
+        try
+        {
+            f();
+            return make_ready_future();
+        }
+        catch (...)
+        {
+            return make_exceptional_future_from_current<void>();
+        }
+    }
+};
+
+template<typename T>
+struct ready_continuation<boost::future<T>>
+{
+    template<typename F>
+    static future<T> run(F&& f)
+    {
+        try
+        {
+            return f();
+        }
+        catch (...)
+        {
+            return make_exceptional_future_from_current<T>();
+        }
+    }
+};
+
+} // namespace detail
+
+
 /// Chaining of promises
 template<typename T>
 void fulfill_promise_from_future(std::shared_ptr<promise<T>> p, future<T>&& f)
@@ -608,11 +771,138 @@ void fulfill_promise_from_future(std::shared_ptr<promise<T>> p, future<T>&& f)
 }
 
 
-/// Enqueue an operation for background processing.
+namespace detail
+{
+
+// Shared state of when_all() calls
+template<typename T>
+struct when_all_state
+{
+    std::mutex mutex;
+    size_t pending;
+    exception_ptr error;
+
+    // Records result of one of the futures; returns true for the last one
+    bool finished(exception_ptr e)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (e && !error)
+            error = e;
+        return --pending == 0;
+    }
+};
+
+} // namespace detail
+
+
+/**
+    Returns future fulfilled with results of all @a futures, in the same
+    order, once all of them finish. If any of them fails, the returned future
+    fails with the first error encountered (after all of them finish).
+
+    The results are gathered on background threads, so it is safe to wait
+    for the returned future on any thread, including the main one.
+ */
+template<typename T>
+future<std::vector<T>> when_all(std::vector<future<T>>&& futures)
+{
+    if (futures.empty())
+        return make_ready_future(std::vector<T>());
+
+    struct state : public detail::when_all_state<T>
+    {
+        std::vector<T> results;
+        promise<std::vector<T>> pr;
+    };
+
+    auto st = std::make_shared<state>();
+    st->results.resize(futures.size());
+    st->pending = futures.size();
+    auto result = st->pr.get_future();
+
+    for (size_t i = 0; i < futures.size(); i++)
+    {
+        futures[i].then([st, i](future<T> f)
+        {
+            exception_ptr error;
+            try
+            {
+                auto r = f.get();
+                std::lock_guard<std::mutex> lock(st->mutex);
+                st->results[i] = std::move(r);
+            }
+            catch (...)
+            {
+                error = current_exception();
+            }
+
+            if (st->finished(error))
+            {
+                if (st->error)
+                    st->pr.set_exception(st->error);
+                else
+                    st->pr.set_value(std::move(st->results));
+            }
+        });
+    }
+
+    return future<std::vector<T>>(std::move(result));
+}
+
+/// when_all() variant for futures without a value.
+inline future<void> when_all(std::vector<future<void>>&& futures)
+{
+    if (futures.empty())
+        return make_ready_future();
+
+    struct state : public detail::when_all_state<void>
+    {
+        promise<void> pr;
+    };
+
+    auto st = std::make_shared<state>();
+    st->pending = futures.size();
+    auto result = st->pr.get_future();
+
+    for (auto& fut: futures)
+    {
+        // future<void>::then() doesn't pass the future to the continuation, use boost's directly:
+        fut.move_to_boost().then(detail::background_queue_executor::get(), [st](boost::future<void> f)
+        {
+            exception_ptr error;
+            try
+            {
+                f.get();
+            }
+            catch (...)
+            {
+                error = current_exception();
+            }
+
+            if (st->finished(error))
+            {
+                if (st->error)
+                    st->pr.set_exception(st->error);
+                else
+                    st->pr.set_value();
+            }
+        });
+    }
+
+    return future<void>(std::move(result));
+}
+
+
+/**
+    Enqueue an operation for background processing with given priority.
+
+    Higher priority operations are started before lower priority ones
+    waiting in the queue, but don't preempt already running operations.
+ */
 template<class F>
-inline auto async(F&& f) -> future<typename detail::future_unwrapper<typename std::invoke_result<F>::type>::type>
+inline auto async(priority p, F&& f) -> future<typename detail::future_unwrapper<typename std::invoke_result<F>::type>::type>
 {
-    return {boost::async(detail::background_queue_executor::get(), [f{std::forward<F>(f)}]() {
+    return {boost::async(detail::background_queue_executor::get(p), [f{std::forward<F>(f)}]() {
         try
         {
             return detail::call_and_unwrap_if_future(f);
@@ -621,6 +911,13 @@ inline auto async(F&& f) -> future<typename detail::future_unwrapper<typename st
     })};
 }
 
+/// Enqueue an operation for background processing.
+template<class F>
+inline auto async(F&& f) -> future<typename detail::future_unwrapper<typename std::invoke_result<F>::type>::type>
+{
+    return async(priority::normal, std::forward<F>(f));
+}
+
 
 /// Run an operation on the main thread.
 template<class F>
@@ -657,7 +954,247 @@ private:
 typedef std::shared_ptr<cancellation_token> cancellation_token_ptr;
 
 
+namespace detail
+{
+
+// Shared state of parallel_for(), kept alive by helpers that may start
+// running only after the loop already finished.
+struct parallel_loop_state
+{
+    parallel_loop_state(size_t count_, size_t grain_, size_t workers_)
+        : count(count_), grain(grain_), workers(workers_) {}
+
+    const size_t count, grain, workers;
+    std::atomic<size_t> next {0};
+
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t active = 0;
+    std::exception_ptr error;
+
+    // Processes chunks until there are none left; @a f is only called while
+    // holding an "active" reference, so that the caller can wait for it
+    template<typename F>
+    void run(const F& f, const cancellation_token_ptr& token)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            active++;
+        }
+
+        try
+        {
+            for (;;)
+            {
+                if (token && token->is_cancelled())
+                    break;
+
+                // guided scheduling: big chunks first, smaller towards the end to balance the load
+                const size_t current = next.load();
+                if (current >= count)
+                    break;
+                const size_t size = std::max(grain, (count - current) / (2 * workers));
+                const size_t begin = next.fetch_add(size);
+                if (begin >= count)
+                    break;
+
+                f(begin, std::min(begin + size, count));
+            }
+        }
+        catch (...)
+        {
+            next = count;  // stop the others
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            active--;
+        }
+        done.notify_all();
+    }
+};
+
+} // namespace detail
+
+
+/**
+    Calls @a f(begin, end) for consecutive chunks of the range [0, @a count)
+    in parallel and waits for all of them to finish.
+
+    Chunks have at least @a grain items and are bigger at the beginning, so
+    that per-chunk overhead is low while the load stays balanced. Small ranges
+    are processed directly on the calling thread.
+
+    The calling thread processes chunks too and never waits for helpers that
+    didn't start yet, so it is safe to call this from background tasks as well.
+
+    If @a token is cancelled, no further chunks are started. The first
+    exception thrown by @a f is rethrown after the running chunks finish.
+ */
+template<typename F>
+void parallel_for(size_t count, size_t grain, F&& f, cancellation_token_ptr token = cancellation_token_ptr(),
+                  priority prio = priority::normal)
+{
+    grain = std::max<size_t>(1, grain);
+    const size_t workers = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), (count + grain - 1) / grain);
+    if (workers <= 1)
+    {
+        if (count && !(token && token->is_cancelled()))
+            f(size_t(0), count);
+        return;
+    }
+
+    auto state = std::make_shared<detail::parallel_loop_state>(count, grain, workers);
+    auto fn = std::make_shared<std::function<void(size_t, size_t)>>(std::forward<F>(f));
+
+    auto& executor = detail::background_queue_executor::get(prio);
+    for (size_t i = 1; i < workers; i++)
+    {
+        executor.submit([state, fn, token]
+        {
+            // the function may be gone already if the loop is finished, but
+            // then there's nothing to call it for:
+            if (state->next >= state->count)
+                return;
+            state->run(*fn, token);
+        });
+    }
+
+    state->run(*fn, token);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&]{ return state->active == 0; });
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
+
+
+/**
+    Computes @a transform(begin, end) for chunks of the range [0, @a count)
+    in parallel, as parallel_for() does, and combines the results with
+    @a reduce(accumulated, chunk_result), starting with @a init.
+
+    The results are combined in the order of the range, so @a reduce doesn't
+    need to be commutative.
+ */
+template<typename T, typename Transform, typename Reduce>
+T parallel_transform_reduce(size_t count, size_t grain, T init, Transform&& transform, Reduce&& reduce,
+                            cancellation_token_ptr token = cancellation_token_ptr(),
+                            priority prio = priority::normal)
+{
+    std::mutex mutex;
+    std::vector<std::pair<size_t, T>> parts;
+
+    parallel_for(count, grain, [&](size_t begin, size_t end)
+    {
+        T part = transform(begin, end);
+        std::lock_guard<std::mutex> lock(mutex);
+        parts.emplace_back(begin, std::move(part));
+    },
+    token, prio);
+
+    std::sort(parts.begin(), parts.end(), [](const auto& a, const auto& b){ return a.first < b.first; });
+    for (auto& p: parts)
+        init = reduce(std::move(init), std::move(p.second));
+    return init;
+}
+
+
+
+
+
+// ----------------------------------------------------------------------
+// Coroutines support
+// ----------------------------------------------------------------------
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+    #define HAVE_DISPATCH_COROUTINES
+
+/*
+    When compiled as C++20, dispatch::future can be used with coroutines:
+    functions returning dispatch::future<T> may be written as coroutines
+    and can co_await other futures:
+
+        dispatch::future<int> count_all()
+        {
+            auto counts = co_await dispatch::when_all(fetch_counts());
+            co_return std::accumulate(counts.begin(), counts.end(), 0);
+        }
+
+    The coroutine is resumed on a background thread after the awaited future
+    finishes, as with then().
+ */
+
+namespace detail
+{
+
+template<typename T>
+struct future_awaiter
+{
+    boost::future<T> f;
+    boost::future<T> result;
+
+    bool await_ready()
+    {
+        if (!f.is_ready())
+            return false;
+        result = std::move(f);
+        return true;
+    }
+
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        f.then(background_queue_executor::get(), [this, h](boost::future<T> x)
+        {
+            result = std::move(x);
+            h.resume();
+        });
+    }
+
+    T await_resume() { return result.get(); }
+};
+
+template<typename T>
+struct coroutine_promise_base
+{
+    promise<T> pr;
+
+    future<T> get_return_object() { return future<T>(pr.get_future()); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void unhandled_exception() { set_current_exception(pr); }
+};
+
+template<typename T>
+struct coroutine_promise : public coroutine_promise_base<T>
+{
+    void return_value(T value) { this->pr.set_value(std::move(value)); }
+};
+
+template<>
+struct coroutine_promise<void> : public coroutine_promise_base<void>
+{
+    void return_void() { this->pr.set_value(); }
+};
 
+} // namespace detail
+
+template<typename T>
+detail::future_awaiter<T> operator co_await(future<T>&& f)
+{
+    return detail::future_awaiter<T>{f.move_to_boost(), {}};
+}
+
+template<typename T>
+detail::future_awaiter<T> operator co_await(future<T>& f)
+{
+    return detail::future_awaiter<T>{f.move_to_boost(), {}};
+}
+
+#endif // __cpp_impl_coroutine
 
 
 /// @internal Call on shutdown to terminate queues and close executors
@@ -666,4 +1203,13 @@ extern void cleanup();
 } // namespace dispatch
 
 
+#ifdef HAVE_DISPATCH_COROUTINES
+template<typename T, typename... Args>
+struct std::coroutine_traits<dispatch::future<T>, Args...>
+{
+    using promise_type = dispatch::detail::coroutine_promise<T>;
+};
+#endif
+
+
 #endif // Poedit_concurrency_h
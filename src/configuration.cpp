@@ -30,10 +30,29 @@
 #include <wx/config.h>
 #include <wx/thread.h>
 
+#include <algorithm>
+#include <functional>
+#include <map>
 #include <mutex>
+#include <vector>
 
 
-// This class ensures that wxConfig is only accessed MT-safely
+namespace
+{
+
+void NotifyConfigObservers(const wxString& key);
+
+} // anonymous namespace
+
+
+/**
+    This class ensures that wxConfig is only accessed MT-safely.
+
+    It also caches all values (and their absence) read from the underlying
+    storage in memory, because reading from it can be rather expensive (e.g.
+    the registry on Windows) and some settings are read very often. Writes
+    go through to the storage immediately and notify Config's observers.
+ */
 class MTSafeConfig : public wxConfig
 {
 public:
@@ -115,43 +134,64 @@ public:
     bool RenameEntry(const wxString& oldName, const wxString& newName) override
     {
         Lock l(this);
+        InvalidateAll();
         return Base::RenameEntry(oldName, newName);
     }
 
     bool RenameGroup(const wxString& oldName, const wxString& newName) override
     {
         Lock l(this);
+        InvalidateAll();
         return Base::RenameGroup(oldName, newName);
     }
 
     bool DeleteEntry(const wxString& key, bool bDeleteGroupIfEmpty = true) override
     {
         Lock l(this);
+        InvalidateAll();
         return Base::DeleteEntry(key, bDeleteGroupIfEmpty);
     }
 
     bool DeleteGroup(const wxString& key) override
     {
         Lock l(this);
+        InvalidateAll();
         return Base::DeleteGroup(key);
     }
 
     bool DeleteAll() override
     {
         Lock l(this);
+        InvalidateAll();
         return Base::DeleteAll();
     }
 
     bool DoReadString(const wxString& key, wxString *pStr) const override
     {
         Lock l(this);
-        return Base::DoReadString(key, pStr);
+        auto& cached = m_strings[FullKey(key)];
+        if (!cached.known)
+        {
+            cached.exists = Base::DoReadString(key, &cached.value);
+            cached.known = true;
+        }
+        if (cached.exists)
+            *pStr = cached.value;
+        return cached.exists;
     }
 
     bool DoReadLong(const wxString& key, long *pl) const override
     {
         Lock l(this);
-        return Base::DoReadLong(key, pl);
+        auto& cached = m_longs[FullKey(key)];
+        if (!cached.known)
+        {
+            cached.exists = Base::DoReadLong(key, &cached.value);
+            cached.known = true;
+        }
+        if (cached.exists)
+            *pl = cached.value;
+        return cached.exists;
     }
 
 #if wxUSE_BASE64
@@ -164,26 +204,81 @@ public:
 
     bool DoWriteString(const wxString& key, const wxString& value) override
     {
-        Lock l(this);
-        return Base::DoWriteString(key, value);
+        wxString fullKey;
+        bool ok;
+        {
+            Lock l(this);
+            fullKey = FullKey(key);
+            Invalidate(fullKey);
+            ok = Base::DoWriteString(key, value);
+        }
+        NotifyConfigObservers(fullKey);
+        return ok;
     }
 
     bool DoWriteLong(const wxString& key, long value) override
     {
-        Lock l(this);
-        return Base::DoWriteLong(key, value);
+        wxString fullKey;
+        bool ok;
+        {
+            Lock l(this);
+            fullKey = FullKey(key);
+            Invalidate(fullKey);
+            ok = Base::DoWriteLong(key, value);
+        }
+        NotifyConfigObservers(fullKey);
+        return ok;
     }
 
 #if wxUSE_BASE64
     bool DoWriteBinary(const wxString& key, const wxMemoryBuffer& buf) override
     {
-        Lock l(this);
-        return Base::DoWriteBinary(key, buf);
+        wxString fullKey;
+        bool ok;
+        {
+            Lock l(this);
+            fullKey = FullKey(key);
+            Invalidate(fullKey);
+            ok = Base::DoWriteBinary(key, buf);
+        }
+        NotifyConfigObservers(fullKey);
+        return ok;
     }
 #endif // wxUSE_BASE64
 
 private:
-    wxConfigBase *m_real;
+    template<typename T>
+    struct CachedValue
+    {
+        bool known = false;
+        bool exists = false;
+        T value = T();
+    };
+
+    // Keys passed to DoXXX() methods are relative to the current path
+    wxString FullKey(const wxString& key) const
+    {
+        const wxString& path = Base::GetPath();
+        return path.EndsWith("/") ? path + key : path + "/" + key;
+    }
+
+    // Written values are read back from the storage (once), because it may
+    // store them in a different form (e.g. bool as long) or fail to write.
+    void Invalidate(const wxString& fullKey)
+    {
+        m_strings.erase(fullKey);
+        m_longs.erase(fullKey);
+    }
+
+    void InvalidateAll()
+    {
+        m_strings.clear();
+        m_longs.clear();
+    }
+
+    mutable std::map<wxString, CachedValue<wxString>> m_strings;
+    mutable std::map<wxString, CachedValue<long>> m_longs;
+
     mutable wxCriticalSection m_cs;
 };
 
@@ -203,6 +298,34 @@ struct CfgLock
     MTSafeConfig::Lock m_wxLock;
 };
 
+
+struct ConfigObserver
+{
+    Config::ObserverId id;
+    wxString key;
+    std::function<void()> callback;
+};
+
+std::mutex g_observersLock;
+std::vector<ConfigObserver> g_observers;
+Config::ObserverId g_lastObserverId = 0;
+
+void NotifyConfigObservers(const wxString& key)
+{
+    std::vector<std::function<void()>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(g_observersLock);
+        for (auto& o: g_observers)
+        {
+            if (o.key == key)
+                callbacks.push_back(o.callback);
+        }
+    }
+    // called without holding any locks, so that they can access the config:
+    for (auto& c: callbacks)
+        c();
+}
+
 } // anonymous namespace
 
 
@@ -215,6 +338,22 @@ void Config::Initialize(const std::wstring& configFile)
 }
 
 
+Config::ObserverId Config::AddObserver(const std::string& key, std::function<void()> callback)
+{
+    std::lock_guard<std::mutex> lock(g_observersLock);
+    g_observers.push_back({++g_lastObserverId, str::to_wx(key), callback});
+    return g_lastObserverId;
+}
+
+void Config::RemoveObserver(ObserverId id)
+{
+    std::lock_guard<std::mutex> lock(g_observersLock);
+    g_observers.erase(std::remove_if(g_observers.begin(), g_observers.end(),
+                                     [=](const ConfigObserver& o){ return o.id == id; }),
+                      g_observers.end());
+}
+
+
 bool Config::Read(const std::string& key, std::string *out)
 {
     CfgLock lock;
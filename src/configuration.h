@@ -26,6 +26,7 @@
 #ifndef Poedit_configuration_h
 #define Poedit_configuration_h
 
+#include <functional>
 #include <string>
 
 // What to do during msgmerge
@@ -47,13 +48,27 @@ struct PretranslateSettings
 /**
     High-level interface to configuration storage.
 
-    Unlike wxConfig, this is thread-safe.
+    Unlike wxConfig, this is thread-safe. Values are cached in memory after
+    they are first read, so reading them is cheap, even in tight loops; this
+    applies to direct use of wxConfig too.
  */
 class Config
 {
 public:
     static void Initialize(const std::wstring& configFile);
 
+    typedef int ObserverId;
+
+    /**
+        Registers @a callback to be called whenever the value stored under
+        @a key (full path such as "/use_tm") is written, either through
+        Config or with wxConfig directly.
+
+        The callback is called on the thread that made the change.
+     */
+    static ObserverId AddObserver(const std::string& key, std::function<void()> callback);
+    static void RemoveObserver(ObserverId id);
+
     static bool UseTM() { return Read("/use_tm", true); }
     static void UseTM(bool use) { Write("/use_tm", use); }
 
@@ -70,6 +85,9 @@ public:
     static bool ShowWarnings() { return Read("/show_warnings", true); }
     static void ShowWarnings(bool show) { Write("/show_warnings", show); }
 
+    static bool WatchSources() { return Read("/watch_sources", false); }
+    static void WatchSources(bool watch) { Write("/watch_sources", watch); }
+
     static std::string CloudLastProject() { return Read("/cloud_last_project", std::string()); }
     static void CloudLastProject(const std::string& prj) { return Write("/cloud_last_project", prj); }
 
@@ -79,6 +97,13 @@ public:
     static time_t OTATranslationLastCheck() { return Read("/ota/last_check", (long)0); }
     static void OTATranslationLastCheck(time_t when) { Write("/ota/last_check", (long)when); }
 
+    /// URL of the shared team TM server (see TeamTranslationMemory), empty if not used
+    static std::string TeamTMServer() { return Read("/tm/team_server", std::string()); }
+    static void TeamTMServer(const std::string& url) { Write("/tm/team_server", url); }
+
+    static time_t TMLastMaintenance() { return Read("/tm/last_maintenance", (long)0); }
+    static void TMLastMaintenance(time_t when) { Write("/tm/last_maintenance", (long)when); }
+
     static std::string OTATranslationEtag() { return Read("/ota/etag", std::string()); }
     static void OTATranslationEtag(const std::string& etag) { Write("/ota/etag", etag); }
 
@@ -32,9 +32,11 @@
 #include "http_client.h"
 #include "keychain/keytar.h"
 #include "str_helpers.h"
+#include "utility.h"
 
+#include <algorithm>
 #include <functional>
-#include <mutex>
+#include <map>
 #include <stack>
 #include <iostream>
 #include <ctime>
@@ -45,6 +47,8 @@
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
 
+#include <wx/file.h>
+#include <wx/log.h>
 #include <wx/translation.h>
 #include <wx/utils.h>
 
@@ -93,6 +97,70 @@ std::string base64_decode_json_part(const std::string &in)
     return out;
 }
 
+
+// Crowdin allows at most 20 simultaneous API requests per account, stay well below:
+const int MAX_CONCURRENT_REQUESTS = 8;
+
+// Uploading more changed strings than this is done by uploading the whole file:
+const size_t MAX_DELTA_UPLOAD_STRINGS = 50;
+
+// Translation edited since the last sync
+struct TranslationChange
+{
+    std::wstring source;
+    std::wstring context;
+    std::wstring translation;
+};
+
+// Identification of an item in the file: context and source text
+typedef std::pair<wxString, wxString> ItemKey;
+
+ItemKey GetItemKey(const CatalogItem& item)
+{
+    return { item.HasContext() ? item.GetContext() : wxString(), item.GetString() };
+}
+
+// Finds translations changed in @a current since @a previous version of the
+// file. Returns false if the files differ in other ways too (source strings,
+// plurals, removed translations...), which only a full upload can express.
+bool FindChangedTranslations(const Catalog& previous, const Catalog& current, std::vector<TranslationChange>& changes)
+{
+    if (previous.items().size() != current.items().size())
+        return false;
+
+    std::map<ItemKey, CatalogItemPtr> previousItems;
+    for (auto& i: previous.items())
+        previousItems.emplace(GetItemKey(*i), i);
+    if (previousItems.size() != previous.items().size())
+        return false;  // ambiguous keys, items can't be matched
+
+    for (auto& i: current.items())
+    {
+        auto p = previousItems.find(GetItemKey(*i));
+        if (p == previousItems.end())
+            return false;
+        auto& prev = p->second;
+
+        if (i->GetTranslations() == prev->GetTranslations() && i->IsFuzzy() == prev->IsFuzzy())
+            continue;
+        // Only adding translations of singular strings is possible:
+        if (i->HasPlural() || prev->HasPlural() || i->IsFuzzy() || !i->IsTranslated())
+            return false;
+
+        changes.push_back({ i->GetString().ToStdWstring(),
+                            GetItemKey(*i).first.ToStdWstring(),
+                            i->GetTranslation().ToStdWstring() });
+    }
+
+    return true;
+}
+
+// Key of the cached copy of the file as it was after the last sync
+std::string GetSyncSnapshotKey(int projectId, int fileId, const Language& lang)
+{
+    return std::string(CrowdinClient::SERVICE_NAME) + ":synced:" + std::to_string(projectId) + ':' + std::to_string(fileId) + ':' + lang.LanguageTag();
+}
+
 } // anonymous namespace
 
 
@@ -155,6 +223,62 @@ protected:
         wxLogTrace("poedit.crowdin", "JSON error: %s", message.c_str());
     }
 
+public:
+    /**
+        Fetches all items of a paginated list at @a url (e.g. project files).
+
+        The API returns at most PAGE_LIMIT items per request and doesn't say
+        how many there are in total. So the first page is fetched alone (most
+        lists fit into it) and if it's full, the following pages are fetched
+        PARALLEL_PAGES at a time until a page that isn't full is found.
+
+        Returns array of the items, i.e. concatenated "data" of the pages.
+     */
+    dispatch::future<json> get_all(const std::string& url)
+    {
+        return get_pages(url, std::make_shared<json>(json::array()), 0, 1);
+    }
+
+private:
+    static const int PAGE_LIMIT = 500;     // maximum allowed by the API
+    static const int PARALLEL_PAGES = 4;
+    static const int MAX_PAGES = 1000;     // safety net against misbehaving server
+
+    dispatch::future<json> get_pages(const std::string& url, std::shared_ptr<json> items, int offset, int count)
+    {
+        const char sep = url.find('?') == std::string::npos ? '?' : '&';
+        std::vector<dispatch::future<json>> pages;
+        for (int i = 0; i < count; i++)
+        {
+            pages.push_back(get(url + sep + "limit=" + std::to_string(PAGE_LIMIT) +
+                                "&offset=" + std::to_string(offset + i * PAGE_LIMIT)));
+        }
+
+        return dispatch::when_all(std::move(pages))
+        .then([this, url, items, offset, count](std::vector<json> pages)
+        {
+            bool complete = false;
+            for (auto& p: pages)
+            {
+                const json& data = p["data"];
+                if (!complete)
+                {
+                    for (auto& i: data)
+                        items->push_back(i);
+                }
+                if ((int)data.size() < PAGE_LIMIT)
+                    complete = true;
+            }
+
+            const int next = offset + count * PAGE_LIMIT;
+            if (complete || next >= MAX_PAGES * PAGE_LIMIT)
+                return dispatch::make_ready_future(std::move(*items));
+
+            wxLogTrace("poedit.crowdin", "Fetching %s from offset %d", url.c_str(), next);
+            return get_pages(url, items, next, PARALLEL_PAGES);
+        });
+    }
+
     CrowdinClient& m_owner;
 };
 
@@ -197,10 +321,13 @@ private:
 
 CrowdinClient::CrowdinClient()
 {
-    SignInIfAuthorized();
+    LoadCredentialsInBackground([this]{ SignInIfAuthorized(); });
 }
 
-CrowdinClient::~CrowdinClient() {}
+CrowdinClient::~CrowdinClient()
+{
+    WaitForCredentials();
+}
 
 
 dispatch::future<void> CrowdinClient::Authenticate()
@@ -298,14 +425,12 @@ dispatch::future<CloudAccountClient::UserInfo> CrowdinClient::GetUserInfo()
 
 dispatch::future<std::vector<CloudAccountClient::ProjectInfo>> CrowdinClient::GetUserProjects()
 {
-    // TODO: handle pagination if projects more than 500
-    //       (what is quite rare case I guess)
-    return m_api->get("projects?limit=500")
+    return m_api->get_all("projects")
         .then([](json r)
         {
             wxLogTrace("poedit.crowdin", "Got projects: %s", r.dump().c_str());
             std::vector<ProjectInfo> all;
-            for (const auto& d : r["data"])
+            for (const auto& d : r)
             {
                 const json& i = d["data"];
                 all.push_back(
@@ -322,33 +447,63 @@ dispatch::future<std::vector<CloudAccountClient::ProjectInfo>> CrowdinClient::Ge
 }
 
 
+json CrowdinClient::SerializeFileInternal(const ProjectFile& file) const
+{
+    auto internal = std::static_pointer_cast<FileInternal>(file.internal);
+    return {
+        { "fileName", internal->fileName },
+        { "dirName", internal->dirName },
+        { "fullPath", internal->fullPath },
+        { "id", internal->id },
+        { "dirId", internal->dirId },
+        { "branchId", internal->branchId }
+    };
+}
+
+
+std::shared_ptr<CloudAccountClient::ProjectFile::Internal> CrowdinClient::DeserializeFileInternal(const json& j) const
+{
+    auto internal = std::make_shared<FileInternal>();
+    j.at("fileName").get_to(internal->fileName);
+    j.at("dirName").get_to(internal->dirName);
+    j.at("fullPath").get_to(internal->fullPath);
+    j.at("id").get_to(internal->id);
+    j.at("dirId").get_to(internal->dirId);
+    j.at("branchId").get_to(internal->branchId);
+    return internal;
+}
+
+
 dispatch::future<CrowdinClient::ProjectDetails> CrowdinClient::GetProjectDetails(const CrowdinClient::ProjectInfo& project)
 {
     auto project_id = std::get<int>(project.internalID);
 
     auto url = "projects/" + std::to_string(project_id);
-    auto prj = std::make_shared<ProjectDetails>();
     static const int NO_ID = -1;
 
-    return m_api->get(url)
-    .then([this, url, prj](json r)
+    // all the listings are independent, so fetch them at the same time:
+    std::vector<dispatch::future<json>> requests;
+    requests.push_back(m_api->get(url));
+    requests.push_back(m_api->get_all(url + "/files"));
+    requests.push_back(m_api->get_all(url + "/directories"));
+    requests.push_back(m_api->get_all(url + "/branches"));
+
+    return dispatch::when_all(std::move(requests))
+    .then([](std::vector<json> r)
     {
+        ProjectDetails prj;
+
         // Handle project info
-        const json& d = r["data"];
+        const json& d = r[0]["data"];
 
         if (get_value(d, "publicDownloads", false) == false)
             throw Exception(_("Downloading translations is disabled in this project."));
 
         for (const auto& langCode: d.at("targetLanguageIds"))
-            prj->languages.push_back(Language::FromLanguageTag(std::string(langCode)));
+            prj.languages.push_back(Language::FromLanguageTag(std::string(langCode)));
 
-        //TODO: get more until all files gotten (if more than 500)
-        return m_api->get(url + "/files?limit=500");
-    })
-    .then([this, url, prj](json r)
-    {
         // Handle project files
-        for (auto& i : r["data"])
+        for (auto& i : r[1])
         {
             const json& d = i["data"];
             if (d["type"] != "assets")
@@ -363,14 +518,10 @@ dispatch::future<CrowdinClient::ProjectDetails> CrowdinClient::GetProjectDetails
                 internal->branchId = get_value(d, "branchId", NO_ID);
                 d.at("name").get_to(internal->fileName);
                 f.title = str::to_wstring(get_value(d, "title", internal->fileName));
-                prj->files.push_back(std::move(f));
+                prj.files.push_back(std::move(f));
             }
         }
-        //TODO: get more until all dirs gotten (if more than 500)
-        return m_api->get(url + "/directories?limit=500");
-    })
-    .then([this, url, prj](json r)
-    {
+
         // Handle directories
         struct dir_info
         {
@@ -379,7 +530,7 @@ dispatch::future<CrowdinClient::ProjectDetails> CrowdinClient::GetProjectDetails
         };
         std::map<int, dir_info> dirs;
 
-        for (const auto& i : r["data"])
+        for (const auto& i : r[2])
         {
             const json& d = i["data"];
             const json& parent = d["directoryId"];
@@ -396,7 +547,7 @@ dispatch::future<CrowdinClient::ProjectDetails> CrowdinClient::GetProjectDetails
             });
         }
 
-        for (auto& i : prj->files)
+        for (auto& i : prj.files)
         {
             auto internal = std::static_pointer_cast<FileInternal>(i.internal);
             std::list<std::string> path;
@@ -410,14 +561,7 @@ dispatch::future<CrowdinClient::ProjectDetails> CrowdinClient::GetProjectDetails
             }
             internal->dirName = boost::join(path, "/");
         }
-    })
-    .then([this, url]()
-    {
-        //TODO: get more until all branches gotten (if more than 500)
-        return m_api->get(url + "/branches?limit=500");
-    })
-    .then([this, url, prj](json r)
-    {
+
         // Handle branches
         struct branch_info
         {
@@ -425,7 +569,7 @@ dispatch::future<CrowdinClient::ProjectDetails> CrowdinClient::GetProjectDetails
         };
         std::map<int, branch_info> branches;
 
-        for (const auto& i : r.at("data"))
+        for (const auto& i : r[3])
         {
             const json& d = i.at("data");
             const auto name = d.at("name").get<std::string>();
@@ -433,7 +577,7 @@ dispatch::future<CrowdinClient::ProjectDetails> CrowdinClient::GetProjectDetails
             branches.insert({d.at("id").get<int>(), {name, title}});
         }
 
-        for (auto& i : prj->files)
+        for (auto& i : prj.files)
         {
             auto internal = std::static_pointer_cast<FileInternal>(i.internal);
             std::wstring branchName;
@@ -449,7 +593,7 @@ dispatch::future<CrowdinClient::ProjectDetails> CrowdinClient::GetProjectDetails
             i.description += str::to_wstring(internal->fullPath);
         }
 
-        return std::move(*prj);
+        return prj;
     });
 }
 
@@ -498,6 +642,7 @@ static void PostprocessDownloadedXLIFF(const wxString& filename)
 {
     // Crowdin XLIFF files have translations pre-filled with the source text if
     // not yet translated. Undo this as it is undesirable to translators.
+    std::string data;
     try
     {
         auto cat = Catalog::Create(filename);
@@ -512,17 +657,21 @@ static void PostprocessDownloadedXLIFF(const wxString& filename)
             }
         }
 
-        if (modified)
-        {
-            Catalog::ValidationResults dummy1;
-            Catalog::CompilationStatus dummy2;
-            cat->Save(filename, false, dummy1, dummy2);
-        }
+        if (!modified)
+            return;
+        data = cat->SaveToBuffer();
     }
     catch (...)
     {
         return;
     }
+
+    // The file is a freshly downloaded one that isn't used by anything yet, so
+    // it can be overwritten in place. Unlike Save(), this doesn't validate the
+    // file or go through yet another temporary file.
+    wxFile f(filename, wxFile::write);
+    if (!f.IsOpened() || f.Write(data.data(), data.size()) != data.size())
+        BOOST_THROW_EXCEPTION(Exception(_(L"Couldn’t save file.")));
 }
 
 
@@ -611,24 +760,45 @@ dispatch::future<void> CrowdinClient::DownloadFile(const std::wstring& output_fi
         { "skipUntranslatedStrings", false }
     });
 
-    return m_api->post(
-        "projects/" + std::to_string(meta->projectId) + "/translations/builds/files/" + std::to_string(meta->fileId),
-        json_data(options)
-        )
-        .then([](json r)
-        {
-            wxLogTrace("poedit.crowdin", "Got file URL: %s", r.dump().c_str());
-            auto url = r.at("data").at("url").get<std::string>();
-            return http_client::download_from_anywhere(url);
-        })
-        .then([=](downloaded_file file)
+    const std::string buildUrl = "projects/" + std::to_string(meta->projectId) + "/translations/builds/files/" + std::to_string(meta->fileId);
+    const std::string cacheKey = std::string(SERVICE_NAME) + ':' + buildUrl + ':' + meta->lang.LanguageTag() + (isXLIFFConverted ? ":xliff" : "");
+
+    return dispatch::async([=]
+    {
+        wxString outfile(output_file);
+
+        // Crowdin doesn't rebuild the file if passed ETag of the last build and
+        // nothing changed since, so the cached copy can be used:
+        auto fetch = [&](const std::string& etag)
         {
-            wxString outfile(output_file);
-            file.move_to(outfile);
+            http_client::headers hdrs;
+            if (!etag.empty())
+                hdrs.emplace_back("If-None-Match", etag);
+            try
+            {
+                json r = m_api->post(buildUrl, json_data(options), hdrs).get();
+                wxLogTrace("poedit.crowdin", "Got file URL: %s", r.dump().c_str());
+                const json& d = r.at("data");
+                http_client::download_from_anywhere(d.at("url").get<std::string>(), outfile).get();
+                DownloadCache::Store(cacheKey, get_value(d, "etag", std::string()), output_file);
+                return true;
+            }
+            catch (http_not_modified&)
+            {
+                wxLogTrace("poedit.crowdin", "File not modified, using cached copy");
+                return DownloadCache::Retrieve(cacheKey, output_file);
+            }
+        };
 
-            if (isXLIFFNative || isXLIFFConverted)
-                PostprocessDownloadedXLIFF(outfile);
-        });
+        if (!fetch(DownloadCache::GetETag(cacheKey)))
+            fetch(std::string());  // cached copy went missing in the meantime
+
+        if (isXLIFFNative || isXLIFFConverted)
+            PostprocessDownloadedXLIFF(outfile);
+
+        // remember what the synced file looks like, for UploadFile():
+        DownloadCache::Store(GetSyncSnapshotKey(meta->projectId, meta->fileId, meta->lang), "synced", output_file);
+    });
 }
 
 
@@ -653,9 +823,15 @@ dispatch::future<void> CrowdinClient::UploadFile(const std::string& file_buffer,
 
     wxLogTrace("poedit.crowdin", "UploadFile(project_id=%d, lang=%s, file_id=%d, file_extension=%s)", meta->projectId, meta->lang.LanguageTag().c_str(), meta->fileId, meta->extension.c_str());
 
+    return UploadFileData(octet_stream_data(file_buffer), meta);
+}
+
+
+dispatch::future<void> CrowdinClient::UploadFileData(const http_body_data& data, std::shared_ptr<CrowdinSyncMetadata> meta)
+{
     return m_api->post(
             "storages",
-            octet_stream_data(file_buffer),
+            data,
             { { "Crowdin-API-FileName", "crowdin." + meta->extension } }
         )
         .then([this, meta] (json r) {
@@ -674,6 +850,113 @@ dispatch::future<void> CrowdinClient::UploadFile(const std::string& file_buffer,
 }
 
 
+dispatch::future<void> CrowdinClient::UploadFile(std::shared_ptr<Catalog> catalog, std::shared_ptr<CrowdinClient::FileSyncMetadata> meta_)
+{
+    auto meta = std::dynamic_pointer_cast<CrowdinSyncMetadata>(meta_);
+    auto tmpdir = std::make_shared<TempDirectory>();
+    const wxString ext = wxFileName(catalog->GetFileName()).GetExt();
+    // serialize in the background if the catalog can be snapshotted, because it takes a while with large files:
+    auto snapshot = catalog->CreateSnapshot();
+    auto file_buffer = std::make_shared<std::string>(snapshot ? std::string() : catalog->SaveToBuffer());
+    const std::string snapshotKey = GetSyncSnapshotKey(meta->projectId, meta->fileId, meta->lang);
+
+    return dispatch::async([=]
+    {
+        if (snapshot)
+            *file_buffer = snapshot->SaveToBuffer();
+
+        // the file is uploaded from disk, don't keep possibly large buffer in memory:
+        auto currentFile = tmpdir->CreateFileName("current." + ext);
+        {
+            wxFile f;
+            if (!f.Create(currentFile, true) || !f.Write(file_buffer->data(), file_buffer->size()))
+                BOOST_THROW_EXCEPTION(Exception(_(L"Couldn’t save file.")));
+            file_buffer->clear();
+            file_buffer->shrink_to_fit();
+        }
+
+        // Compare the file with its version from the last sync to find what to send:
+        std::vector<TranslationChange> changes;
+        bool sendChanges = false;
+        auto syncedFile = tmpdir->CreateFileName("synced." + ext);
+        if (DownloadCache::Retrieve(snapshotKey, syncedFile.ToStdWstring()))
+        {
+            try
+            {
+                wxLogNull null;
+                auto synced = Catalog::Create(syncedFile);
+                auto current = Catalog::Create(currentFile);
+                sendChanges = synced && current &&
+                              FindChangedTranslations(*synced, *current, changes) &&
+                              changes.size() <= MAX_DELTA_UPLOAD_STRINGS;
+            }
+            catch (...)
+            {
+                sendChanges = false;
+            }
+        }
+
+        if (sendChanges && !changes.empty())
+        {
+            wxLogTrace("poedit.crowdin", "Uploading %d changed translations", (int)changes.size());
+            const std::string project = "projects/" + std::to_string(meta->projectId);
+            try
+            {
+                std::vector<dispatch::future<int>> lookups;
+                for (auto& c: changes)
+                {
+                    auto url = project + "/strings?fileId=" + std::to_string(meta->fileId) +
+                               "&scope=text&filter=" + http_client::url_encode(c.source);
+                    lookups.push_back(m_api->get(url).then([c](json r)
+                    {
+                        // the filter matches substrings, find the exact text, using context to disambiguate:
+                        std::vector<std::pair<int, std::wstring>> found;
+                        for (auto& s: r.at("data"))
+                        {
+                            const json& d = s.at("data");
+                            const json& text = d.at("text");
+                            if (text.is_string() && str::to_wstring(text.get<std::string>()) == c.source)
+                                found.emplace_back(d.at("id").get<int>(), str::to_wstring(get_value(d, "context", std::string())));
+                        }
+                        if (found.size() > 1 && !c.context.empty())
+                        {
+                            found.erase(std::remove_if(found.begin(), found.end(),
+                                                       [&c](const auto& f){ return f.second.find(c.context) == std::wstring::npos; }),
+                                        found.end());
+                        }
+                        if (found.size() != 1)
+                            BOOST_THROW_EXCEPTION(std::runtime_error("string not found"));
+                        return found.front().first;
+                    }));
+                }
+                auto ids = dispatch::when_all(std::move(lookups)).get();
+
+                std::vector<dispatch::future<json>> uploads;
+                for (size_t i = 0; i < changes.size(); i++)
+                {
+                    uploads.push_back(m_api->post(project + "/translations", json_data({
+                        { "stringId", ids[i] },
+                        { "languageId", meta->lang.LanguageTag() },
+                        { "text", str::to_utf8(changes[i].translation) }
+                    })));
+                }
+                dispatch::when_all(std::move(uploads)).get();
+            }
+            catch (...)
+            {
+                wxLogTrace("poedit.crowdin", "Uploading changed translations failed, uploading whole file");
+                sendChanges = false;
+            }
+        }
+
+        if (!sendChanges)
+            UploadFileData(file_data(currentFile), meta).get();
+
+        DownloadCache::Store(snapshotKey, "synced", currentFile.ToStdWstring());
+    });
+}
+
+
 bool CrowdinClient::InitWithAuthToken(const crowdin_token& token)
 {
     wxLogTrace("poedit.crowdin", "Authorization: %s", token.encoded.c_str());
@@ -683,19 +966,22 @@ bool CrowdinClient::InitWithAuthToken(const crowdin_token& token)
 
     m_api = std::make_unique<crowdin_http_client>(*this, "https://" + token.domain + "crowdin.com/api/v2/");
     m_api->set_authorization("Bearer " + token.encoded);
+    m_api->set_max_concurrent_requests(MAX_CONCURRENT_REQUESTS);
     return true;
 }
 
 
 bool CrowdinClient::IsSignedIn() const
 {
+    WaitForCredentials();
     return m_api || GetValidToken().is_valid();
 }
 
 
 void CrowdinClient::SignInIfAuthorized()
 {
-    auto token = GetValidToken();
+    auto token = ReadStoredToken();
+    m_cachedAuthToken = std::make_unique<crowdin_token>(token);
     if (!token.is_valid())
         return;
 
@@ -712,9 +998,17 @@ void CrowdinClient::SignInIfAuthorized()
 
 CrowdinClient::crowdin_token CrowdinClient::GetValidToken() const
 {
+    WaitForCredentials();
+
     if (m_cachedAuthToken)
         return *m_cachedAuthToken;
 
+    return crowdin_token("");
+}
+
+
+CrowdinClient::crowdin_token CrowdinClient::ReadStoredToken()
+{
     // Our tokens stored in keychain have the form of <version>:<token>, so not
     // only do we have to check for token's existence but also that its version
     // is current:
@@ -729,14 +1023,14 @@ CrowdinClient::crowdin_token CrowdinClient::GetValidToken() const
         token.clear();
     }
 
-    crowdin_token ct(token);
-    m_cachedAuthToken = std::make_unique<crowdin_token>(ct);
-    return ct;
+    return crowdin_token(token);
 }
 
 
 void CrowdinClient::SaveAndSetToken(const std::string& token)
 {
+    WaitForCredentials();
+
     crowdin_token ct(token);
     if (!ct.is_valid())
         return;
@@ -749,6 +1043,9 @@ void CrowdinClient::SaveAndSetToken(const std::string& token)
 
 void CrowdinClient::SignOut()
 {
+    WaitForCredentials();
+
+    ClearMetadataCache();
     m_api.reset();
     m_cachedAuthToken.reset();
     keytar::DeletePassword("Crowdin", "");
@@ -33,6 +33,8 @@
 #include "cloud_accounts.h"
 #include "language.h"
 
+class http_body_data;
+
 
 /**
     Client to the Crowdin platform.
@@ -95,6 +97,19 @@ public:
     /// Asynchronously upload specific Crowdin file data.
     dispatch::future<void> UploadFile(const std::string& file_buffer, std::shared_ptr<FileSyncMetadata> meta) override;
 
+    /**
+        Asynchronously upload translations from @a catalog.
+
+        If possible, only translations changed since the last sync are sent
+        to Crowdin, one string at a time. Structural changes, or too many
+        changes, are uploaded as a whole file.
+     */
+    dispatch::future<void> UploadFile(std::shared_ptr<Catalog> catalog, std::shared_ptr<FileSyncMetadata> meta) override;
+
+protected:
+    json SerializeFileInternal(const ProjectFile& file) const override;
+    std::shared_ptr<ProjectFile::Internal> DeserializeFileInternal(const json& j) const override;
+
 private:
     class crowdin_http_client;
     class crowdin_token;
@@ -117,12 +132,17 @@ private:
     CrowdinClient();
     ~CrowdinClient();
 
+    // Upload file's content to storage and import it as translations of the file
+    dispatch::future<void> UploadFileData(const http_body_data& data, std::shared_ptr<CrowdinSyncMetadata> meta);
+
     // Initialize m_api for use with given authorization; must be called before use
     bool InitWithAuthToken(const crowdin_token& token);
 
+    // Reads token from the keychain and signs in with it; runs in the background
     void SignInIfAuthorized();
     void SaveAndSetToken(const std::string& token);
     crowdin_token GetValidToken() const;
+    static crowdin_token ReadStoredToken();
 
     mutable std::unique_ptr<crowdin_token> m_cachedAuthToken;
     std::unique_ptr<crowdin_http_client> m_api;
@@ -329,7 +329,7 @@ void CrowdinSyncFile(wxWindow *parent, std::shared_ptr<Catalog> catalog,
     // TODO: nicer API for this.
     // This must be done right after entering the modal loop (on non-OSX)
     dlg->CallAfter([=]{
-        CrowdinClient::Get().UploadFile(catalog->SaveToBuffer(), meta)
+        CrowdinClient::Get().UploadFile(catalog, meta)
         .then([=]
         {
             auto tmpdir = std::make_shared<TempDirectory>();
@@ -206,15 +206,21 @@ void AutoWrappingText::SetAlignment(TextDirection dir)
     SetWindowStyleFlag(wxST_NO_AUTORESIZE | align);
 }
 
-void AutoWrappingText::SetAndWrapLabel(const wxString& label)
+bool AutoWrappingText::SetAndWrapLabel(const wxString& label)
 {
-    m_text = bidi::platform_mark_direction(label);
+    auto text = bidi::platform_mark_direction(label);
+    // nothing to do if the same text was already wrapped for the current width:
+    if (text == m_text && m_wrapWidth != -1)
+        return false;
+
+    m_text = text;
     if (!m_language.IsValid())
         SetAlignment(bidi::get_base_direction(m_text));
 
     m_wrapWidth = -1; // force rewrap
 
     RewrapForWidth(GetSize().x);
+    return true;
 }
 
 bool AutoWrappingText::InformFirstDirection(int direction, int size, int /*availableOtherDir*/)
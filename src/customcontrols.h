@@ -60,7 +60,8 @@ public:
     void SetLanguage(Language lang);
     void SetAlignment(TextDirection dir);
 
-    void SetAndWrapLabel(const wxString& label);
+    /// Sets the label and wraps it; returns false if it was already set to @a label.
+    bool SetAndWrapLabel(const wxString& label);
 
     bool InformFirstDirection(int direction, int size, int availableOtherDir) override;
 
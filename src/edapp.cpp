@@ -32,6 +32,7 @@
 #include <wx/image.h>
 #include <wx/cmdline.h>
 #include <wx/log.h>
+#include <wx/msgout.h>
 #include <wx/xrc/xmlres.h>
 #include <wx/xrc/xh_all.h>
 #include <wx/stdpaths.h>
@@ -48,7 +49,10 @@
 #include <wx/translation.h>
 
 #include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <map>
+#include <vector>
 #include <fstream>
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
@@ -76,18 +80,27 @@
 #endif
 
 #include "app_updates.h"
+#include "cache_registry.h"
+#include "cat_update.h"
+#include "catalog_po.h"
 #include "colorscheme.h"
 #include "concurrency.h"
 #include "configuration.h"
 #include "cloud_accounts_ui.h"
+#include "cloud_sync.h"
 #include "crowdin_client.h"
 #include "localazy_client.h"
 #include "edapp.h"
 #include "edframe.h"
+#include "edit_journal.h"
+#include "extractors/extractor.h"
 #include "extractors/extractor_legacy.h"
 #include "filemonitor.h"
 #include "manager.h"
 #include "prefsdlg.h"
+#include "perf_trace.h"
+#include "pretranslate.h"
+#include "project_search.h"
 #include "chooselang.h"
 #include "customcontrols.h"
 #include "gexecute.h"
@@ -97,6 +110,7 @@
 #include "version.h"
 #include "recent_files.h"
 #include "str_helpers.h"
+#include "tm/team_tm.h"
 #include "tm/transmem.h"
 #include "utility.h"
 #include "prefsdlg.h"
@@ -320,11 +334,336 @@ static wxArrayString gs_filesToOpen;
 #endif
 static int gs_lineToOpen = 0;
 static wxString gs_uriToHandle;
+static std::vector<wxString> gs_pathsToImportIntoTM;
+static std::vector<wxString> gs_filesToProcessInBatch;
+static int gs_batchOperations = 0;
+static int gs_headlessExitCode = -1;
+
+namespace
+{
+
+/// Logs durations of startup phases, see wxLogTrace("poedit.startup")
+class StartupTimer
+{
+public:
+    void Phase(const char *name)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        wxLogTrace("poedit.startup", "%s: %d ms (%d ms since start)", name, ToMs(now - m_last), ToMs(now - m_start));
+        perf::RecordEvent(name, m_last);
+        m_last = now;
+    }
+
+private:
+    static int ToMs(std::chrono::steady_clock::duration d)
+    {
+        return (int)std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    }
+
+    // static initialization happens right when the process starts:
+    std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point m_last = m_start;
+};
+
+StartupTimer gs_startupTimer;
+
+/// Imports given files and directories into the TM without showing any UI.
+/// Returns process exit code.
+int ImportIntoTMHeadless(const std::vector<wxString>& paths)
+{
+    wxMessageOutputStderr out;
+    int failed = 0;
+    try
+    {
+        auto imported = TranslationMemory::Get().ImportFiles(paths,
+            [&out,&failed](const wxString& filename, const wxString& error)
+            {
+                out.Printf("%s: %s\n", filename, error);
+                failed++;
+            });
+        out.Printf("%s\n", wxString::Format(wxPLURAL("Imported %d file into translation memory.",
+                                                     "Imported %d files into translation memory.",
+                                                     imported), imported));
+    }
+    catch (...)
+    {
+        out.Printf("%s\n", DescribeCurrentException());
+        return 1;
+    }
+    return failed ? 1 : 0;
+}
+
+
+/// Operations done by RunBatchHeadless(), in this order
+enum BatchOperation
+{
+    Batch_Update       = 0x01,
+    Batch_PreTranslate = 0x02,
+    Batch_Validate     = 0x04,
+    Batch_Compile      = 0x08
+};
+
+// Key identifying source code configuration, so that strings are only
+// extracted once for catalogs that share it (e.g. all languages of a project)
+wxString GetSourceCodeSpecKey(const SourceCodeSpec& spec)
+{
+    wxString key = spec.BasePath;
+    for (auto& arr: {spec.SearchPaths, spec.ExcludedPaths, spec.Keywords})
+    {
+        key << '\n';
+        for (auto& s: arr)
+            key << s << '\t';
+    }
+    key << '\n' << spec.Charset << '\n';
+    for (auto& m: spec.TypeMapping)
+        key << m.first << '=' << m.second << '\t';
+    key << '\n';
+    for (auto& h: spec.XHeaders)
+        key << h.first << '=' << h.second << '\t';
+    return key;
+}
+
+/// Runs given operations (BatchOperation flags) on catalog files without
+/// showing any UI, processing the files in parallel. Returns process exit code.
+int RunBatchHeadless(const std::vector<wxString>& filenames, int operations)
+{
+    wxMessageOutputStderr out;
+
+    // catch errors that would otherwise be shown in message boxes:
+    wxLogChain logChain(new wxLogStderr);
+    logChain.PassMessages(false);
+
+    struct File
+    {
+        wxString filename;
+        CatalogPtr catalog;
+        bool modified = false;
+        Catalog::ValidationResults validation;
+        bool validated = false;
+        std::vector<wxString> messages;
+        bool failed = false;
+
+        void Error(const wxString& msg) { messages.push_back(msg); failed = true; }
+    };
+    std::vector<File> files(filenames.size());
+    for (size_t i = 0; i < files.size(); i++)
+        files[i].filename = filenames[i];
+
+    std::vector<std::pair<wxString, double>> timings;
+
+    // Runs @a func for all files that didn't fail yet, measuring the stage's duration:
+    auto run_stage = [&](const wxString& name, bool parallel, std::function<void(File&)> func)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        auto run = [&func](File& f)
+        {
+            try
+            {
+                func(f);
+            }
+            catch (...)
+            {
+                f.Error(DescribeCurrentException());
+            }
+        };
+
+        std::vector<dispatch::future<void>> ops;
+        for (auto& f: files)
+        {
+            if (f.failed)
+                continue;
+            if (parallel)
+                ops.push_back(dispatch::async([&run,&f]{ run(f); }));
+            else
+                run(f);
+        }
+        for (auto& op: ops)
+            op.get();
+
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        timings.emplace_back(name, duration.count());
+    };
+
+    run_stage("load", true, [](File& f)
+    {
+        f.catalog = Catalog::Create(f.filename);
+    });
+
+    if (operations & Batch_Update)
+    {
+        // Extracting strings is by far the most expensive part, so it's done
+        // only once for every source tree, then merged into catalogs in parallel:
+        std::map<wxString, POCatalogPtr> extracted;
+        run_stage("extract", false, [&extracted](File& f)
+        {
+            auto po = std::dynamic_pointer_cast<POCatalog>(f.catalog);
+            auto spec = po ? po->GetSourceCodeSpec() : nullptr;
+            if (!spec)
+                return;
+            // POT files take over the extracted items, so they can't share them:
+            const auto key = po->GetFileType() == Catalog::Type::PO ? GetSourceCodeSpecKey(*spec) : f.filename;
+            if (extracted.find(key) != extracted.end())
+                return;
+
+            UpdateResultReason reason;
+            extracted[key] = ExtractPOTFromSources(po, reason);
+            if (!extracted[key])
+            {
+                switch (reason.code)
+                {
+                    case UpdateResultReason::NoSourcesFound:
+                        f.Error(_("No source files found."));
+                        break;
+                    case UpdateResultReason::PermissionDenied:
+                        f.Error(wxString::Format(_(L"Permission denied: %s"), reason.file));
+                        break;
+                    default:
+                        f.Error(_("Updating from sources failed."));
+                        break;
+                }
+            }
+        });
+
+        run_stage("update", true, [&extracted](File& f)
+        {
+            auto po = std::dynamic_pointer_cast<POCatalog>(f.catalog);
+            auto spec = po ? po->GetSourceCodeSpec() : nullptr;
+            if (!spec)
+            {
+                f.messages.push_back(_("Not updated, source code extraction is not configured."));
+                return;
+            }
+            const auto key = po->GetFileType() == Catalog::Type::PO ? GetSourceCodeSpecKey(*spec) : f.filename;
+            auto pot = extracted.find(key);
+            if (pot == extracted.end() || !pot->second)
+            {
+                f.Error(_("Updating from sources failed."));
+                return;
+            }
+            if (po->UpdateFromPOT(pot->second))
+                f.modified = true;
+            else
+                f.Error(_("Updating from sources failed."));
+        });
+    }
+
+    if (operations & Batch_PreTranslate)
+    {
+        // All files are pre-translated at once, so that strings shared by
+        // several of them (e.g. all languages of a project) are only looked
+        // up in the TM once; this parallelizes internally.
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<File*> todo;
+        std::vector<CatalogPtr> catalogs;
+        for (auto& f: files)
+        {
+            if (f.failed || !f.catalog->HasCapability(Catalog::Cap::Translations))
+                continue;
+            if (!CanPreTranslateCatalog(f.catalog))
+            {
+                f.messages.push_back(_("Cannot pre-translate without source text."));
+                continue;
+            }
+            todo.push_back(&f);
+            catalogs.push_back(f.catalog);
+        }
+
+        auto settings = Config::PretranslateSettings();
+        PreTranslateOptions options;
+        if (settings.onlyExact)
+            options.flags |= PreTranslate_OnlyExact;
+        if (settings.exactNotFuzzy)
+            options.flags |= PreTranslate_ExactNotFuzzy;
+
+        try
+        {
+            auto matches = PreTranslateCatalogsHeadless(catalogs, options);
+            for (size_t i = 0; i < todo.size(); i++)
+            {
+                if (!matches[i])
+                    continue;
+                todo[i]->modified = true;
+                todo[i]->messages.push_back(wxString::Format(wxPLURAL("%d entry was pre-translated.", "%d entries were pre-translated.", matches[i]), matches[i]));
+            }
+        }
+        catch (...)
+        {
+            const auto error = DescribeCurrentException();
+            for (auto f: todo)
+                f->Error(error);
+        }
+
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        timings.emplace_back("pre-translate", duration.count());
+    }
+
+    run_stage("save", true, [](File& f)
+    {
+        if (!f.modified)
+            return;
+        Catalog::CompilationStatus mo_status;
+        if (f.catalog->Save(f.filename, false, f.validation, mo_status))
+            f.validated = true;
+        else
+            f.Error(_(L"Couldn’t save file."));
+    });
+
+    if (operations & Batch_Validate)
+    {
+        run_stage("validate", true, [](File& f)
+        {
+            if (!f.validated)
+            {
+                f.validation = f.catalog->Validate();
+                f.validated = true;
+            }
+            if (f.validation.errors)
+                f.Error(wxString::Format(wxPLURAL("%d issue with the translation found.", "%d issues with the translation found.", f.validation.errors), f.validation.errors));
+        });
+    }
+
+    if (operations & Batch_Compile)
+    {
+        run_stage("compile", true, [](File& f)
+        {
+            auto po = std::dynamic_pointer_cast<POCatalog>(f.catalog);
+            if (!po || po->GetFileType() != Catalog::Type::PO)
+                return;
+            Catalog::ValidationResults validation;
+            Catalog::CompilationStatus mo_status;
+            const wxString mo_file = wxFileName::StripExtension(f.filename) + ".mo";
+            if (!po->CompileToMO(mo_file, validation, mo_status) || mo_status == Catalog::CompilationStatus::Error)
+                f.Error(_(L"Couldn’t compile MO file."));
+        });
+    }
+
+    wxLog::FlushActive();
+
+    int failed = 0;
+    for (auto& f: files)
+    {
+        for (auto& msg: f.messages)
+            out.Printf("%s: %s\n", f.filename, msg);
+        if (f.failed)
+            failed++;
+    }
+
+    for (auto& t: timings)
+        out.Printf("%-14s %8.3f s\n", t.first + ":", t.second);
+    out.Printf("%s\n", wxString::Format(wxPLURAL("Processed %d file, %d failed.", "Processed %d files, %d failed.", (int)files.size()), (int)files.size(), failed));
+
+    return failed ? 1 : 0;
+}
+
+} // anonymous namespace
 
 extern void InitXmlResource();
 
 bool PoeditApp::OnInit()
 {
+    perf::ScopedTimer timer("PoeditApp::OnInit");
+
 #ifdef __WXMSW__
     // remove the current directory from the default DLL search order
     SetDllDirectory(L"");
@@ -353,6 +692,8 @@ bool PoeditApp::OnInit()
     if (!wxApp::OnInit())
         return false;
 
+    gs_startupTimer.Phase("command line");
+
 #ifdef __WXOSX__
     // macOS 10.15 Vista throws a fit and bombards the user with scary UAC prompt
     // if a subprocess, shell or gettext, is launched with CWD within a "protected"
@@ -415,6 +756,7 @@ bool PoeditApp::OnInit()
 #endif
 
     Config::Initialize(CFG_FILE.ToStdWstring());
+    gs_startupTimer.Phase("configuration");
 
 #ifndef __WXOSX__
     wxImage::AddHandler(new wxPNGHandler);
@@ -441,7 +783,41 @@ bool PoeditApp::OnInit()
     wxArtProvider::Push(new PoeditArtProvider);
 #endif
 
+    gs_startupTimer.Phase("resources");
+
     SetupLanguage();
+    gs_startupTimer.Phase("UI language");
+
+    if (!gs_pathsToImportIntoTM.empty())
+    {
+        // headless mode, OnRun() returns right away without entering the event loop
+        gs_headlessExitCode = ImportIntoTMHeadless(gs_pathsToImportIntoTM);
+        gs_pathsToImportIntoTM.clear();
+        return true;
+    }
+
+    if (gs_batchOperations)
+    {
+        // headless mode too
+        gs_headlessExitCode = RunBatchHeadless(gs_filesToProcessInBatch, gs_batchOperations);
+        gs_filesToProcessInBatch.clear();
+        return true;
+    }
+
+    POCatalog::SetCacheDir(GetCacheDir("Catalogs"));
+    Extractor::SetCacheDir(GetCacheDir("Extraction"));
+    Language::SetDisplayNamesCacheDir(GetCacheDir("Languages"));
+    EditJournal::SetJournalDir(GetCacheDir("Journal"));
+    ProjectSearchIndex::SetCacheDir(GetCacheDir("ProjectSearch"));
+
+    // long sessions with large files accumulate a lot of cached data, which
+    // is trimmed when the system gets low on memory:
+    CacheRegistry::StartMonitoring();
+
+#ifndef __WXOSX__
+    // decode icons in the background while the rest of the UI is being created:
+    PoeditArtProvider::PreloadIcons();
+#endif
 
 #ifdef __WXOSX__
     CreateMenu(Menu::Global);
@@ -450,9 +826,21 @@ bool PoeditApp::OnInit()
     s_macHelpMenuTitleName = _("&Help");
 #endif
 
+    // None of the following is needed to show the first window:
 #ifdef HAS_UPDATES_CHECK
-    AppUpdates::Get().InitAndStart();
+    RunAfterStartup([]{ AppUpdates::Get().InitAndStart(); });
 #endif
+    RunAfterStartup([=]
+    {
+        // opening the TM takes a while, so have it ready by the time it's needed:
+        if (Config::UseTM())
+            m_tmPreloading = dispatch::async([]{ TranslationMemory::Get(); });
+#ifdef HAVE_HTTP_CLIENT
+        TeamTranslationMemory::Init();
+#endif
+        // so that language pickers don't have to wait for it when first shown:
+        dispatch::async([]{ Language::PreloadDisplayNames(); });
+    });
 
 #ifndef __WXOSX__
     // NB: opening files or creating empty window is handled differently on
@@ -487,6 +875,7 @@ bool PoeditApp::OnInit()
         return false;
 #endif
 
+    gs_startupTimer.Phase("initialization");
     return true;
 }
 
@@ -494,6 +883,50 @@ void PoeditApp::OnEventLoopEnter(wxEventLoopBase *loop)
 {
     wxApp::OnEventLoopEnter(loop);
     FileMonitor::EventLoopStarted();
+
+    if (!m_startupFinished && loop->IsMain())
+        Bind(wxEVT_IDLE, &PoeditApp::OnStartupIdle, this);
+}
+
+void PoeditApp::OnStartupIdle(wxIdleEvent& event)
+{
+    event.Skip();
+    Unbind(wxEVT_IDLE, &PoeditApp::OnStartupIdle, this);
+
+    // All pending events, including painting of windows shown so far, were
+    // processed when the app becomes idle:
+    gs_startupTimer.Phase("first window shown");
+    FinishStartup();
+}
+
+void PoeditApp::RunAfterStartup(std::function<void()> task)
+{
+    if (m_startupFinished)
+        CallAfter(task);
+    else
+        m_afterStartupTasks.push_back(std::move(task));
+}
+
+void PoeditApp::FinishStartup()
+{
+    if (m_startupFinished)
+        return;
+    m_startupFinished = true;
+
+    auto tasks = std::move(m_afterStartupTasks);
+    m_afterStartupTasks.clear();
+    for (auto& t: tasks)
+        t();
+
+    gs_startupTimer.Phase("deferred initialization");
+}
+
+int PoeditApp::OnRun()
+{
+    if (gs_headlessExitCode != -1)
+        return gs_headlessExitCode;
+
+    return wxApp::OnRun();
 }
 
 int PoeditApp::OnExit()
@@ -512,23 +945,32 @@ int PoeditApp::OnExit()
     // early -- e.g. before wxConfig is destroyed, so they can save changes
     DeletePendingObjects();
 
+    CacheRegistry::StopMonitoring();
     FileMonitor::CleanUp();
     ColorScheme::CleanUp();
     RecentFiles::CleanUp();
+    if (m_tmPreloading.valid())
+        m_tmPreloading.wait();
     TranslationMemory::CleanUp();
 
 #ifdef HAS_UPDATES_CHECK
     AppUpdates::CleanUp();
 #endif
 
+    CloudSyncQueue::CleanUp();
+
 #ifdef HAVE_HTTP_CLIENT
+    TeamTranslationMemory::CleanUp();
     CloudAccountClient::CleanUp();
+    http_client::cleanup();
 #endif
 
     dispatch::cleanup();
 
     u_cleanup();
 
+    perf::StopRecording();
+
     return wxApp::OnExit();
 }
 
@@ -789,6 +1231,12 @@ namespace
 const char *CL_KEEP_TEMP_FILES = "keep-temp-files";
 const char *CL_HANDLE_POEDIT_URI = "handle-poedit-uri";
 const char *CL_LINE = "line";
+const char *CL_IMPORT_INTO_TM = "import-into-tm";
+const char *CL_BATCH_UPDATE = "update";
+const char *CL_BATCH_PRETRANSLATE = "pretranslate";
+const char *CL_BATCH_VALIDATE = "validate";
+const char *CL_BATCH_COMPILE = "compile";
+const char *CL_TRACE = "trace";
 }
 
 void PoeditApp::OnInitCmdLine(wxCmdLineParser& parser)
@@ -801,6 +1249,18 @@ void PoeditApp::OnInitCmdLine(wxCmdLineParser& parser)
                      _("handle a poedit:// URI"), wxCMD_LINE_VAL_STRING);
     parser.AddLongOption(CL_LINE,
                      _("go to item at given line number"), wxCMD_LINE_VAL_NUMBER);
+    parser.AddSwitch("", CL_IMPORT_INTO_TM,
+                     _("import given files or directories into translation memory and exit"));
+    parser.AddSwitch("", CL_BATCH_UPDATE,
+                     _("update given files from source code, save them and exit"));
+    parser.AddSwitch("", CL_BATCH_PRETRANSLATE,
+                     _("pre-translate given files from translation memory, save them and exit"));
+    parser.AddSwitch("", CL_BATCH_VALIDATE,
+                     _("check given files for errors and exit"));
+    parser.AddSwitch("", CL_BATCH_COMPILE,
+                     _("compile given files into MO files and exit"));
+    parser.AddLongOption(CL_TRACE,
+                     _("record timings of operations into given file (in Chrome trace format)"), wxCMD_LINE_VAL_STRING);
     parser.AddParam("translation.po", wxCMD_LINE_VAL_STRING,
                     wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_PARAM_MULTIPLE);
 }
@@ -817,6 +1277,59 @@ bool PoeditApp::OnCmdLineParsed(wxCmdLineParser& parser)
     if ( parser.Found(CL_KEEP_TEMP_FILES) )
         TempDirectory::KeepFiles();
 
+    wxString traceFile;
+    if (parser.Found(CL_TRACE, &traceFile))
+    {
+        wxFileName fn(traceFile);
+        fn.MakeAbsolute();
+        perf::StartRecording(fn.GetFullPath());
+    }
+
+    if (parser.Found(CL_IMPORT_INTO_TM))
+    {
+        if (parser.GetParamCount() == 0)
+        {
+            parser.Usage();
+            return false;
+        }
+        for (size_t i = 0; i < parser.GetParamCount(); i++)
+        {
+            wxFileName fnFull(parser.GetParam(i));
+            fnFull.MakeAbsolute();
+            gs_pathsToImportIntoTM.push_back(fnFull.GetFullPath());
+        }
+        // don't forward to already running instance, nor open any files
+        return true;
+    }
+
+    const std::pair<const char*, int> batchSwitches[] = {
+        { CL_BATCH_UPDATE, Batch_Update },
+        { CL_BATCH_PRETRANSLATE, Batch_PreTranslate },
+        { CL_BATCH_VALIDATE, Batch_Validate },
+        { CL_BATCH_COMPILE, Batch_Compile }
+    };
+    for (auto& sw: batchSwitches)
+    {
+        if (parser.Found(sw.first))
+            gs_batchOperations |= sw.second;
+    }
+    if (gs_batchOperations)
+    {
+        if (parser.GetParamCount() == 0)
+        {
+            parser.Usage();
+            return false;
+        }
+        for (size_t i = 0; i < parser.GetParamCount(); i++)
+        {
+            wxFileName fnFull(parser.GetParam(i));
+            fnFull.MakeAbsolute();
+            gs_filesToProcessInBatch.push_back(fnFull.GetFullPath());
+        }
+        // headless as well, see above
+        return true;
+    }
+
 #ifndef __WXOSX__
     RemoteClient client(m_instanceChecker.get());
     switch (client.ConnectIfNeeded())
@@ -1179,17 +1692,12 @@ void PoeditApp::OnOpen(wxCommandEvent& event)
 template<typename T>
 void PoeditApp::OpenCloudTranslation(T preopen)
 {
-    CloudOpenFile(nullptr, preopen, [=](int retval, wxString filename)
+    CloudOpenFile(nullptr, preopen, [=](int retval, wxArrayString filenames)
     {
         if (retval != wxID_OK)
             return;
 
-        auto cat = PoeditFrame::PreOpenFileWithErrorsUI(filename, nullptr);
-        if (!cat)
-            return;
-
-        auto frame = PoeditFrame::CreateEmpty();
-        frame->DoOpenFile(cat);
+        OpenFiles(filenames);
     });
 }
 
@@ -1201,7 +1709,7 @@ void PoeditApp::OnOpenCloudTranslation(wxCommandEvent& event)
         return;
 
     win.NotifyIsStarting();
-    CloudOpenFile(win.GetParentWindowIfAny(), nullptr, [=](int retval, wxString filename)
+    CloudOpenFile(win.GetParentWindowIfAny(), nullptr, [=](int retval, wxArrayString filenames)
     {
         if (retval != wxID_OK)
         {
@@ -1209,11 +1717,15 @@ void PoeditApp::OnOpenCloudTranslation(wxCommandEvent& event)
             return;
         }
 
-        auto cat = PoeditFrame::PreOpenFileWithErrorsUI(filename, win.GetParentWindowIfAny());
+        auto cat = PoeditFrame::PreOpenFileWithErrorsUI(filenames.front(), win.GetParentWindowIfAny());
         if (cat)
             win.GetActionTarget()->DoOpenFile(cat);
-        else
+        else if (filenames.size() == 1)
             win.NotifyWasAborted();
+
+        filenames.erase(filenames.begin());
+        if (!filenames.empty())
+            OpenFiles(filenames);
     });
 }
 #endif
@@ -1386,6 +1898,7 @@ void PoeditApp::OnCloseWindowCommand(wxCommandEvent&)
 #ifdef HAS_UPDATES_CHECK
 void PoeditApp::OnCheckForUpdates(wxCommandEvent&)
 {
+    FinishStartup(); // initializes AppUpdates
     AppUpdates::Get().CheckForUpdatesWithUI();
 }
 
@@ -35,6 +35,10 @@
 #include <wx/docview.h>
 
 #include "prefsdlg.h"
+#include "concurrency.h"
+
+#include <functional>
+#include <vector>
 
 class WXDLLIMPEXP_FWD_BASE wxConfigBase;
 class WXDLLIMPEXP_FWD_BASE wxSingleInstanceChecker;
@@ -55,6 +59,7 @@ class PoeditApp : public wxApp, public MenusManager
          */
         bool OnInit() override;
         void OnEventLoopEnter(wxEventLoopBase *loop) override;
+        int OnRun() override;
         int OnExit() override;
 
         wxLayoutDirection GetLayoutDirection() const override;
@@ -82,6 +87,20 @@ class PoeditApp : public wxApp, public MenusManager
 
         void EditPreferences();
 
+        /**
+            Runs @a task on the main thread once startup is finished, i.e. when
+            the app becomes idle for the first time after showing its window,
+            or soon if that already happened.
+
+            Use for initialization that isn't needed to show the UI, so that
+            it doesn't delay it.
+         */
+        void RunAfterStartup(std::function<void()> task);
+
+        /// Runs RunAfterStartup() tasks right away if they didn't run yet,
+        /// for when a feature that depends on them is used before that.
+        void FinishStartup();
+
         bool OnExceptionInMainLoop() override;
 
         // Open page on poedit.net in the browser
@@ -107,6 +126,7 @@ class PoeditApp : public wxApp, public MenusManager
         void HandleCustomURI(const wxString& uri);
 
         void SetupLanguage();
+        void OnStartupIdle(wxIdleEvent& event);
 #ifdef SUPPORTS_OTA_UPDATES
         void SetupOTALanguageUpdate(wxTranslations *trans, const wxString& lang);
 #endif
@@ -135,6 +155,10 @@ class PoeditApp : public wxApp, public MenusManager
         std::unique_ptr<PoeditPreferencesEditor> m_preferences;
         std::unique_ptr<wxLocale> m_locale;
 
+        bool m_startupFinished = false;
+        std::vector<std::function<void()>> m_afterStartupTasks;
+        dispatch::future<void> m_tmPreloading;
+
 #ifndef __WXOSX__
         class RemoteServer;
         class RemoteClient;
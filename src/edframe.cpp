@@ -40,6 +40,7 @@
 #include <wx/statusbr.h>
 #include <wx/stdpaths.h>
 #include <wx/splitter.h>
+#include <wx/srchctrl.h>
 #include <wx/fontutil.h>
 #include <wx/textfile.h>
 #include <wx/wupdlock.h>
@@ -67,18 +68,22 @@
 #include "crowdin_gui.h"
 #include "customcontrols.h"
 #include "edapp.h"
+#include "edit_journal.h"
 #include "editing_area.h"
 #include "hidpi.h"
 #include "propertiesdlg.h"
 #include "prefsdlg.h"
 #include "fileviewer.h"
 #include "findframe.h"
+#include "tm/team_tm.h"
 #include "tm/transmem.h"
 #include "language.h"
 #include "progressinfo.h"
+#include "qa_checks.h"
 #include "commentdlg.h"
 #include "main_toolbar.h"
 #include "manager.h"
+#include "perf_trace.h"
 #include "pretranslate.h"
 #include "attentionbar.h"
 #include "utility.h"
@@ -89,11 +94,21 @@
 #include "sidebar.h"
 #include "spellchecking.h"
 #include "str_helpers.h"
+#include "syntaxhighlighter.h"
 
 
 namespace
 {
 
+// Number of items following the selected one for which suggestions are prefetched
+const int SIDEBAR_PREFETCH_ITEMS = 5;
+
+// Number of untranslated items for which suggestions are prefetched after opening a file
+const int WARMUP_PREFETCH_ITEMS = 5;
+
+// Number of items spellchecked as one chunk of a parallel CheckSpelling()
+const size_t SPELLCHECK_GRAIN = 500;
+
 /// Splitters with customized appearance to blend with EditingArea:
 class ThinSplitter : public wxSplitterWindow
 {
@@ -254,10 +269,23 @@ bool g_focusToText = false;
     {
         if (wxFileName(n->GetFileName()) == fn)
             return n;
+        if (!n->m_loadingFileName.empty() && wxFileName(n->m_loadingFileName) == fn)
+            return n;
     }
     return NULL;
 }
 
+/*static*/ std::vector<CatalogPtr> PoeditFrame::GetOpenCatalogs()
+{
+    std::vector<CatalogPtr> catalogs;
+    for (auto n: ms_instances)
+    {
+        if (n->m_catalog)
+            catalogs.push_back(n->m_catalog);
+    }
+    return catalogs;
+}
+
 /*static*/ bool PoeditFrame::AnyWindowIsModified()
 {
     for (PoeditFramesList::const_iterator n = ms_instances.begin();
@@ -275,24 +303,19 @@ bool g_focusToText = false;
     if (f)
     {
         f->Raise();
+        f->Show(true);
+
+        // HACK: make sure this is called *after* the delayed call in PoeditListCtrl::CatalogChanged
+        if (f->m_list)
+            f->m_list->CallAfter([=]{ f->PlaceInitialFocus(lineno); });
     }
     else
     {
-        auto cat = PreOpenFileWithErrorsUI(filename, nullptr);
-        if (!cat)
-            return nullptr;
-
         f = new PoeditFrame();
         f->Show(true);
-        f->ReadCatalog(cat);
+        f->LoadFileInBackground(filename, lineno);
     }
 
-    f->Show(true);
-
-    // HACK: make sure this is called *after* the delayed call in PoeditListCtrl::CatalogChanged
-    if (f->m_list)
-        f->m_list->CallAfter([=]{ f->PlaceInitialFocus(lineno); });
-
     return f;
 }
 
@@ -322,6 +345,7 @@ BEGIN_EVENT_TABLE(PoeditFrame, wxFrame)
   #endif
    EVT_MENU           (XRCID("toolbar_update"),PoeditFrame::OnUpdateSmart)
    EVT_MENU           (XRCID("menu_validate"),    PoeditFrame::OnValidate)
+   EVT_MENU           (XRCID("menu_check_spelling"), PoeditFrame::OnCheckSpelling)
    EVT_MENU           (XRCID("menu_purge_deleted"), PoeditFrame::OnPurgeDeleted)
    EVT_MENU           (XRCID("menu_fuzzy"),       PoeditFrame::OnFuzzyFlag)
    EVT_MENU           (XRCID("menu_ids"),         PoeditFrame::OnIDsFlag)
@@ -388,6 +412,7 @@ BEGIN_EVENT_TABLE(PoeditFrame, wxFrame)
    EVT_UPDATE_UI(XRCID("menu_statistics"),    PoeditFrame::OnHasCatalogUpdate)
    EVT_UPDATE_UI(XRCID("menu_pretranslate"),  PoeditFrame::OnIsEditableUpdate)
    EVT_UPDATE_UI(XRCID("menu_validate"),      PoeditFrame::OnIsEditableUpdate)
+   EVT_UPDATE_UI(XRCID("menu_check_spelling"), PoeditFrame::OnIsEditableUpdate)
    EVT_UPDATE_UI(XRCID("menu_update_from_src"), PoeditFrame::OnUpdateFromSourcesUpdate)
  #ifdef HAVE_HTTP_CLIENT
    EVT_UPDATE_UI(XRCID("menu_update_from_crowdin"), PoeditFrame::OnUpdateFromCrowdinUpdate)
@@ -435,7 +460,7 @@ public:
         }
 
         wxFileName f(files[0]);
-        if (!Catalog::CanLoadFile(f.GetExt()))
+        if (!Catalog::CanLoadFile(f.GetExt()) && !POCatalog::IsCompressedFileName(f.GetFullPath()))
         {
             wxLogError(_(L"File “%s” is not a translation file."),
                        f.GetFullPath().c_str());
@@ -468,14 +493,43 @@ PoeditFrame::PoeditFrame() :
     m_contentType(Content::Invalid),
     m_contentView(nullptr),
     m_catalog(nullptr),
-    m_fileMonitor(new FileMonitor),
+    m_fileMonitor(new FileMonitor([this]{ ReloadFileIfChanged(); })),
     m_fileExistsOnDisk(false),
     m_list(nullptr),
+    m_spellingChecked(false),
     m_modified(false),
     m_hasObsoleteItems(false),
-    m_setSashPositionsWhenMaximized(false)
+    m_setSashPositionsWhenMaximized(false),
+    m_spellcheckerInitPending(false),
+    m_cacheRegistration("search index",
+                        [this]{ return m_searchIndex ? m_searchIndex->GetMemoryUsage() : 0; },
+                        [this](CacheRegistry::Pressure pressure)
+                        {
+                            // GetSearchIndex() recreates it when needed again
+                            if (pressure == CacheRegistry::Pressure::Critical)
+                                m_searchIndex.reset();
+                        })
 {
+    m_cloudSyncObserver = CloudSyncQueue::Get().AddObserver([=](CatalogPtr file, CloudSyncQueue::State state, const wxString& error)
+    {
+        auto dest = file->GetCloudSync();
+        if (file != m_catalog || state != CloudSyncQueue::State::Failed || !dest)
+            return;
+
+        AttentionMessage msg
+            (
+                "cloud-sync-failed",
+                AttentionMessage::Error,
+                // TRANSLATORS: %s is a cloud destination, e.g. "Crowdin" or ftp.wordpress.com etc.
+                wxString::Format(_("Uploading translations to %s failed."), dest->GetName())
+            );
+        msg.SetExplanation(error);
+        msg.AddAction(_("Retry"), [=]{ CloudSyncQueue::Get().Upload(dest, file); });
+        m_attentionBar->ShowMessage(msg);
+    });
+
     m_list = nullptr;
+    m_filterField = nullptr;
     m_editingArea = nullptr;
     m_splitter = nullptr;
     m_sidebarSplitter = nullptr;
@@ -514,6 +568,20 @@ PoeditFrame::PoeditFrame() :
     GetMenuBar()->Check(XRCID("menu_ids"), m_displayIDs);
     GetMenuBar()->Check(XRCID("menu_warnings"), Config::ShowWarnings());
 
+    // Performance diagnostics are only of interest to developers, so show
+    // them only when perf tracing is enabled (WXTRACE=poedit.perf):
+    if (wxLog::IsAllowedTraceMask("poedit.perf"))
+    {
+        const int viewMenuPos = GetMenuBar()->FindMenu(_("&View"));
+        if (viewMenuPos != wxNOT_FOUND)
+        {
+            auto view = GetMenuBar()->GetMenu(viewMenuPos);
+            view->AppendSeparator();
+            auto item = view->Append(wxID_ANY, L"Diagnostics…");
+            Bind(wxEVT_MENU, &PoeditFrame::OnDiagnostics, this, item->GetId());
+        }
+    }
+
     if (wxConfigBase::Get()->ReadBool("/statusbar_shown", true))
         CreateStatusBar(1, wxST_SIZEGRIP);
 
@@ -579,6 +647,10 @@ void PoeditFrame::EnsureContentView(Content type)
         case Content::POT:
             m_contentView = CreateContentViewPO(type);
             break;
+
+        case Content::Loading:
+            m_contentView = CreateContentViewLoading();
+            break;
     }
 
     m_contentType = type;
@@ -632,7 +704,19 @@ wxWindow* PoeditFrame::CreateContentViewPO(Content type)
     // make only the upper part grow when resizing
     m_splitter->SetSashGravity(1.0);
 
-    m_list = new PoeditListCtrl(m_splitter, wxID_ANY, m_displayIDs);
+    auto listPanel = new wxPanel(m_splitter, wxID_ANY);
+    auto listSizer = new wxBoxSizer(wxVERTICAL);
+    listPanel->SetSizer(listSizer);
+
+    m_filterField = new wxSearchCtrl(listPanel, wxID_ANY);
+    m_filterField->SetDescriptiveText(_("Filter"));
+    m_filterField->ShowCancelButton(true);
+    m_filterField->Bind(wxEVT_TEXT, [=](wxCommandEvent&){ OnFilterTextChanged(); });
+    m_filterField->Bind(wxEVT_SEARCHCTRL_CANCEL_BTN, [=](wxCommandEvent&){ m_filterField->Clear(); });
+    listSizer->Add(m_filterField, wxSizerFlags().Expand().Border(wxALL, PX(4)));
+
+    m_list = new PoeditListCtrl(listPanel, wxID_ANY, m_displayIDs);
+    listSizer->Add(m_list, wxSizerFlags(1).Expand());
 
     m_editingArea = new EditingArea
                         (
@@ -702,7 +786,7 @@ wxWindow* PoeditFrame::CreateContentViewPO(Content type)
             Layout();
         }
 
-        m_splitter->SplitHorizontally(m_list, m_editingArea, (int)wxConfigBase::Get()->ReadLong("/splitter", -PX(320)));
+        m_splitter->SplitHorizontally(listPanel, m_editingArea, (int)wxConfigBase::Get()->ReadLong("/splitter", -PX(320)));
 
         if (m_sidebar)
             m_sidebar->SetUpperHeight(m_splitter->GetSashPosition());
@@ -725,6 +809,23 @@ wxWindow* PoeditFrame::CreateContentViewEmptyPO()
 }
 
 
+wxWindow* PoeditFrame::CreateContentViewLoading()
+{
+    auto panel = new wxPanel(this, wxID_ANY);
+    auto sizer = new wxBoxSizer(wxVERTICAL);
+    panel->SetSizer(sizer);
+
+    auto activity = new ActivityIndicator(panel, ActivityIndicator::Centered);
+    sizer->AddStretchSpacer();
+    sizer->Add(activity, wxSizerFlags().Expand().Border(wxALL, PX(20)));
+    sizer->AddStretchSpacer();
+
+    activity->Start(wxString::Format(_(L"Loading “%s”…"), wxFileName(m_loadingFileName).GetFullName()));
+
+    return panel;
+}
+
+
 void PoeditFrame::DestroyContentView()
 {
     if (!m_contentView)
@@ -740,6 +841,7 @@ void PoeditFrame::DestroyContentView()
     m_contentView = nullptr;
 
     m_list = nullptr;
+    m_filterField = nullptr;
     m_splitter = nullptr;
     m_sidebarSplitter = nullptr;
     m_sidebar = nullptr;
@@ -757,6 +859,8 @@ PoeditFrame::~PoeditFrame()
 {
     ms_instances.erase(this);
 
+    CloudSyncQueue::Get().RemoveObserver(m_cloudSyncObserver);
+
     // don't leave file references window as the only one open:
     if (ms_instances.empty() && FileViewer::GetIfExists())
         FileViewer::GetIfExists()->Close();
@@ -774,6 +878,8 @@ PoeditFrame::~PoeditFrame()
     cfg->Flush();
 
     m_catalog.reset();
+    m_journal.reset();
+    m_sourcesWatcher.reset();
     m_pendingHumanEditedItem.reset();
     m_navigationHistory.clear();
 
@@ -896,6 +1002,54 @@ void PoeditFrame::InitSpellchecker()
 }
 
 
+void PoeditFrame::ScheduleInitSpellchecker()
+{
+    // Opening or updating a file changes the language several times in
+    // a row; (re)loading dictionaries is expensive, so do it only once. If the
+    // window is being opened at startup, don't delay showing it either:
+    if (m_spellcheckerInitPending)
+        return;
+    m_spellcheckerInitPending = true;
+    wxWeakRef<PoeditFrame> self(this);
+    wxGetApp().RunAfterStartup([self]{
+        if (!self)
+            return;
+        self->m_spellcheckerInitPending = false;
+        self->InitSpellchecker();
+    });
+}
+
+
+void PoeditFrame::UpdateSourcesWatcher()
+{
+    auto cat = std::dynamic_pointer_cast<POCatalog>(m_catalog);
+    if (!cat || !Config::WatchSources() || !cat->HasSourcesConfigured())
+    {
+        m_sourcesWatcher.reset();
+        return;
+    }
+
+    // checking for the sources can be slow on network drives, so don't block on it;
+    // the continuation also conveniently runs when the event loop, which the watcher
+    // needs, is already running, which isn't the case yet when opening files at startup:
+    cat->HasSourcesAvailableAsync().then_on_window(this, [=](bool available)
+    {
+        if (m_catalog != cat)
+            return;
+
+        auto spec = available ? cat->GetSourceCodeSpec() : nullptr;
+        if (!spec)
+        {
+            m_sourcesWatcher.reset();
+            return;
+        }
+
+        if (!m_sourcesWatcher || !m_sourcesWatcher->Matches(*spec))
+            m_sourcesWatcher = std::make_unique<SourcesWatcher>(*spec);
+    });
+}
+
+
 void PoeditFrame::UpdateTextLanguage()
 {
     if (!m_catalog)
@@ -903,7 +1057,7 @@ void PoeditFrame::UpdateTextLanguage()
 
     if (m_editingArea)
     {
-        InitSpellchecker();
+        ScheduleInitSpellchecker();
         m_editingArea->SetLanguage(m_catalog->GetLanguage());
     }
 
@@ -923,9 +1077,81 @@ void PoeditFrame::OnCloseCmd(wxCommandEvent&)
 void PoeditFrame::OpenFile(const wxString& filename, int lineno)
 {
     DoIfCanDiscardCurrentDoc([=]{
-        auto cat = PreOpenFileWithErrorsUI(filename, this);
-        if (cat)
-            DoOpenFile(cat, lineno);
+        LoadFileInBackground(filename, lineno);
+    });
+}
+
+
+void PoeditFrame::LoadFileInBackground(const wxString& filename, int lineno)
+{
+    if (m_loadingCancellation)
+        m_loadingCancellation->cancel();
+    auto token = std::make_shared<dispatch::cancellation_token>();
+    m_loadingCancellation = token;
+    m_loadingFileName = filename;
+
+    // Show the placeholder until loading is done. The current catalog, if
+    // any, is kept until the new one replaces it, so that it can be shown
+    // again if loading fails.
+    EnsureContentView(Content::Loading);
+    if (!m_catalog)
+        SetTitle(wxFileName(filename).GetFullName());
+
+    // Parsing, post-processing and validation (including QA checks) are all
+    // expensive for large files, so do it all on a background thread and only
+    // update the UI with the fully prepared catalog:
+    wxWeakRef<PoeditFrame> self(this);
+    dispatch::async([=]
+    {
+        auto cat = Catalog::Create(filename);
+        if (!token->is_cancelled())
+        {
+            wxLogNull null;  // don't report non-item warnings
+            // the file was just loaded, it is identical to in-memory content and we can pass `fileWithSameContent`
+            cat->Validate(/*fileWithSameContent=*/restoredEdits ? wxString() : cat->GetFileName());
+        }
+        return cat;
+    })
+    .then_on_window(this, [=](CatalogPtr cat)
+    {
+        if (token->is_cancelled())
+            return;
+        ReadCatalog(cat, ReadCatalog_AlreadyValidated);
+
+        // HACK: make sure this is called *after* the delayed call in PoeditListCtrl::CatalogChanged
+        if (m_list)
+            m_list->CallAfter([=]{ PlaceInitialFocus(lineno); });
+    })
+    .catch_all([=](dispatch::exception_ptr e)
+    {
+        if (!self || token->is_cancelled())
+            return;
+
+        self->m_loadingCancellation.reset();
+        self->m_loadingFileName.clear();
+        if (self->m_catalog)
+            self->EnsureAppropriateContentView();
+        else
+            self->EnsureContentView(Content::Invalid);
+        self->UpdateTitle();
+
+        wxMessageDialog dlg
+        (
+            self,
+            wxString::Format(_(L"The file “%s” couldn’t be opened."), wxFileName(filename).GetFullName()),
+            _("Invalid file"),
+            wxOK | wxICON_ERROR
+        );
+        dlg.SetExtendedMessage(DescribeException(e));
+        dlg.ShowModal();
+
+        // don't leave empty window behind if it was created just for this file:
+        if (!self->m_catalog)
+        {
+            if (ms_instances.size() == 1)
+                WelcomeWindow::GetAndActivate();
+            self->Destroy();
+        }
     });
 }
 
@@ -971,6 +1197,9 @@ void PoeditFrame::ReloadFileIfChanged()
     if (!m_fileExistsOnDisk || !m_fileMonitor || !m_catalog)
         return;
 
+    // changes on disk (e.g. VCS checkouts) may have affected the sources too:
+    m_catalog->InvalidateSourcesAvailability();
+
     if (m_fileMonitor->ShouldRespondToFileChange())
     {
         if (NeedsToAskIfCanDiscardCurrentDoc())
@@ -1057,6 +1286,8 @@ void PoeditFrame::DoIfCanDiscardCurrentDoc(const TFunctor1& completionHandler, c
         else if (retval == wxID_NO)
         {
             // call completion without saving the document
+            if (m_journal)
+                m_journal->DiscardAll();
             completionHandler();
         }
         else if (retval == wxID_CANCEL)
@@ -1109,6 +1340,14 @@ wxWindowPtr<wxMessageDialog> PoeditFrame::CreateAskAboutSavingDialog()
 
 void PoeditFrame::OnCloseWindow(wxCloseEvent& event)
 {
+    if (event.CanVeto() && m_backgroundSaveGuard)
+    {
+        // don't interrupt saving, close the window when it finishes instead
+        event.Veto();
+        m_closeAfterBackgroundSave = true;
+        return;
+    }
+
     if (event.CanVeto() && NeedsToAskIfCanDiscardCurrentDoc())
     {
 #ifdef __WXOSX__
@@ -1163,12 +1402,12 @@ void PoeditFrame::OnSave(wxCommandEvent& event)
                 dlg->ShowWindowModalThenDo([this,dlg](int retval)
                 {
                     if (retval == wxID_YES)
-                        WriteCatalog(GetFileName());
+                        WriteCatalogInBackground(GetFileName());
                 });
             }
             else
             {
-                WriteCatalog(GetFileName());
+                WriteCatalogInBackground(GetFileName());
             }
         }
     }
@@ -1362,6 +1601,7 @@ void PoeditFrame::NewFromPOT(POCatalogPtr pot, Language language)
         return;
 
     m_catalog = catalog;
+    m_journal.reset();
     m_pendingHumanEditedItem.reset();
     m_navigationHistory.clear();
 
@@ -1432,6 +1672,7 @@ void PoeditFrame::NewFromScratch()
     catalog->CreateNewHeader();
 
     m_catalog = catalog;
+    m_journal.reset();
     m_pendingHumanEditedItem.reset();
     m_navigationHistory.clear();
 
@@ -1538,6 +1779,9 @@ void PoeditFrame::EditCatalogProperties()
 
             break;
         }
+
+        case Catalog::Type::MO:
+            break; // read-only, nothing to edit
     }
 }
 
@@ -1586,6 +1830,8 @@ void PoeditFrame::UpdateAfterPreferencesChange()
         m_list->Refresh(); // if font changed
         UpdateTextLanguage();
     }
+
+    UpdateSourcesWatcher();
 }
 
 /*static*/ void PoeditFrame::UpdateAllAfterPreferencesChange()
@@ -1619,7 +1865,15 @@ bool PoeditFrame::UpdateCatalog(const wxString& pot_file)
     {
         if (cat->HasSourcesAvailable())
         {
-            succ = PerformUpdateFromSourcesWithUI(this, cat, reason);
+            // use strings extracted in the background if they're up to date:
+            POCatalogPtr extracted;
+            if (m_sourcesWatcher)
+            {
+                if (auto spec = cat->GetSourceCodeSpec())
+                    extracted = m_sourcesWatcher->TakeExtractedPOT(*spec);
+            }
+
+            succ = PerformUpdateFromSourcesWithUI(this, cat, reason, 0, extracted);
 
             locker.reset();
             EnsureAppropriateContentView();
@@ -1642,6 +1896,7 @@ bool PoeditFrame::UpdateCatalog(const wxString& pot_file)
 
     m_modified = succ || m_modified;
     UpdateStatusBar();
+    UpdateSourcesWatcher();
 
     if (!succ)
     {
@@ -1739,6 +1994,24 @@ void PoeditFrame::OnUpdateFromSources(wxCommandEvent&)
     });
 }
 
+void PoeditFrame::OnDiagnostics(wxCommandEvent&)
+{
+    std::string report;
+    if (m_catalog)
+        report += "memory used by the file (estimate):\n" + m_catalog->GetMemoryUsage().Report() + "\n";
+    report += str::to_utf8(wxString::Format("peak memory usage: %.1f MB\n\n", perf::GetPeakMemoryUsage() / (1024.0 * 1024.0)));
+    report += "QA checks:\n" + QAChecker::GetDiagnosticsReport() + "\n";
+    report += "syntax highlighting:\n" + SyntaxHighlighter::GetDiagnosticsReport();
+    auto locks = perf::GetLockContentionReport();
+    if (!locks.empty())
+        report += "\nlocks:\n" + locks;
+    wxLogTrace("poedit.perf", "%s", report);
+
+    wxWindowPtr<wxMessageDialog> dlg(new wxMessageDialog(this, "Performance diagnostics", GetTitle(), wxOK | wxICON_INFORMATION));
+    dlg->SetExtendedMessage(wxString::FromUTF8(report));
+    dlg->ShowWindowModalThenDo([dlg](int){});
+}
+
 void PoeditFrame::OnUpdateFromSourcesUpdate(wxUpdateUIEvent& event)
 {
     event.Enable(m_catalog &&
@@ -1887,6 +2160,7 @@ void PoeditFrame::OnValidate(wxCommandEvent&)
     {
         wxBusyCursor bcur;
         auto results = m_catalog->Validate();
+        ApplySpellingIssues();
         if (m_list && m_list->sortOrder().errorsFirst)
             m_list->Sort();
         ReportValidationErrors(results,
@@ -2006,8 +2280,13 @@ void PoeditFrame::OnListSel(wxDataViewEvent& event)
 
     if (m_pendingHumanEditedItem)
     {
-        OnNewTranslationEntered(m_pendingHumanEditedItem);
+        auto edited = m_pendingHumanEditedItem;
         m_pendingHumanEditedItem.reset();
+        OnNewTranslationEntered(edited);
+        // the item's new state may put it elsewhere in the list; this doesn't
+        // resort the whole list and is cheap even for huge files:
+        if (m_list)
+            m_list->SortItem(edited);
     }
 
     if (multipleSel)
@@ -2025,7 +2304,19 @@ void PoeditFrame::OnListSel(wxDataViewEvent& event)
         if (multipleSel)
             m_sidebar->SetMultipleSelection();
         else
-            m_sidebar->SetSelectedItem(m_catalog, GetCurrentItem()); // may be nullptr
+        {
+            // Translators almost always proceed down the list, so let the sidebar
+            // know what's coming next:
+            std::vector<CatalogItemPtr> upcoming;
+            if (m_list)
+            {
+                const int row = m_list->GetCurrentItemListIndex();
+                const int count = m_list->GetItemCount();
+                for (int i = row + 1; row != -1 && i < count && i <= row + SIDEBAR_PREFETCH_ITEMS; i++)
+                    upcoming.push_back(m_list->ListIndexToCatalogItem(i));
+            }
+            m_sidebar->SetSelectedItem(m_catalog, GetCurrentItem(), upcoming); // may be nullptr
+        }
     }
 
     if (hasTextFocus)
@@ -2073,29 +2364,50 @@ void PoeditFrame::ShowReference(int num)
 
 
 
-void PoeditFrame::OnFuzzyFlag(wxCommandEvent&)
+template<typename F>
+void PoeditFrame::EditSelectedItems(F&& func, int textCtrlFlags)
 {
-    bool setFuzzy = GetMenuBar()->IsChecked(XRCID("menu_fuzzy"));
-
-    bool modified = false;
-
-    m_list->ForSelectedCatalogItemsDo([=,&modified](CatalogItem& item){
-        if (item.IsFuzzy() != setFuzzy)
+    std::vector<int> changed;
+    std::vector<CatalogItemPtr> changedItems;
+    for (auto index: m_list->GetSelectedCatalogItemIndexes())
+    {
+        auto item = (*m_catalog)[index];
+        if (func(*item))
         {
-            item.SetFuzzy(setFuzzy);
-            item.SetModified(true);
-            modified = true;
+            changed.push_back(index);
+            changedItems.push_back(item);
         }
-    });
+    }
 
-    if (modified && !IsModified())
+    if (!changed.empty())
     {
-        m_modified = true;
-        UpdateTitle();
+        m_list->RefreshItems(changed);
+        RecordEditsToJournal(changedItems);
+
+        if (!IsModified())
+        {
+            m_modified = true;
+            UpdateTitle();
+        }
+        UpdateStatusBar();
     }
-    UpdateStatusBar();
 
-    UpdateToTextCtrl(EditingArea::UndoableEdit | EditingArea::DontTouchText);
+    UpdateToTextCtrl(textCtrlFlags);
+}
+
+
+void PoeditFrame::OnFuzzyFlag(wxCommandEvent&)
+{
+    bool setFuzzy = GetMenuBar()->IsChecked(XRCID("menu_fuzzy"));
+
+    EditSelectedItems([=](CatalogItem& item){
+        if (item.IsFuzzy() == setFuzzy)
+            return false;
+        item.SetFuzzy(setFuzzy);
+        item.SetModified(true);
+        return true;
+    },
+    EditingArea::UndoableEdit | EditingArea::DontTouchText);
 
     if (m_list->HasSingleSelection())
     {
@@ -2125,6 +2437,7 @@ void PoeditFrame::OnToggleWarnings(wxCommandEvent& e)
     if (m_catalog)
     {
         m_catalog->Validate();
+        ApplySpellingIssues();
         if (m_list && m_list->sortOrder().errorsFirst)
             m_list->Sort();
         else
@@ -2139,42 +2452,20 @@ void PoeditFrame::OnCopyFromSingular(wxCommandEvent&)
 
 void PoeditFrame::OnCopyFromSource(wxCommandEvent&)
 {
-    bool modified = false;
-
-    m_list->ForSelectedCatalogItemsDo([&modified](CatalogItem& item){
+    EditSelectedItems([](CatalogItem& item){
         item.SetTranslationFromSource();
-        if (item.IsModified())
-            modified = true;
-    });
-
-    if (modified && !IsModified())
-    {
-        m_modified = true;
-        UpdateTitle();
-    }
-    UpdateStatusBar();
-
-    UpdateToTextCtrl(EditingArea::UndoableEdit);
+        return item.IsModified();
+    },
+    EditingArea::UndoableEdit);
 }
 
 void PoeditFrame::OnClearTranslation(wxCommandEvent&)
 {
-    bool modified = false;
-
-    m_list->ForSelectedCatalogItemsDo([&modified](CatalogItem& item){
+    EditSelectedItems([](CatalogItem& item){
         item.ClearTranslation();
-        if (item.IsModified())
-            modified = true;
-    });
-
-    if (modified && !IsModified())
-    {
-        m_modified = true;
-        UpdateTitle();
-    }
-    UpdateStatusBar();
-
-    UpdateToTextCtrl(EditingArea::UndoableEdit);
+        return item.IsModified();
+    },
+    EditingArea::UndoableEdit);
 }
 
 
@@ -2226,6 +2517,7 @@ void PoeditFrame::OnUpdatedFromTextCtrl(CatalogItemPtr item, bool statsChanged)
 
     m_pendingHumanEditedItem = item;
     RecordItemToNavigationHistory(item);
+    RecordEditsToJournal({item});
 
     if (statsChanged)
     {
@@ -2241,6 +2533,33 @@ void PoeditFrame::OnUpdatedFromTextCtrl(CatalogItemPtr item, bool statsChanged)
 }
 
 
+void PoeditFrame::RecordEditsToJournal(const std::vector<CatalogItemPtr>& items)
+{
+    if (!m_journal)
+        return;
+    for (auto& item: items)
+        m_journal->RecordEdit(*item);
+}
+
+
+void PoeditFrame::UpdateJournalAfterSaving(const wxString& catalog, uint64_t journalPosition)
+{
+    if (m_journal && m_journal->IsFor(catalog))
+    {
+        m_journal->DiscardUpTo(journalPosition);
+        return;
+    }
+
+    // saved under a different name, all edits are in the new file:
+    if (m_journal)
+        m_journal->DiscardAll();
+    if (m_catalog->HasCapability(Catalog::Cap::Translations))
+        m_journal = std::make_unique<EditJournal>(catalog);
+    else
+        m_journal.reset();
+}
+
+
 void PoeditFrame::RecordItemToNavigationHistory(const CatalogItemPtr& item)
 {
     if (m_navigationHistory.empty() || m_navigationHistory.back() != item)
@@ -2250,6 +2569,10 @@ void PoeditFrame::RecordItemToNavigationHistory(const CatalogItemPtr& item)
 
 void PoeditFrame::OnNewTranslationEntered(const CatalogItemPtr& item)
 {
+    // editing cleared the item's issue, including any misspelling, so check again
+    if (m_spellingChecked)
+        CheckSpelling({item}, /*reportResults=*/false);
+
     if (item->IsFuzzy() || !item->IsTranslated())
         return;
 
@@ -2260,6 +2583,7 @@ void PoeditFrame::OnNewTranslationEntered(const CatalogItemPtr& item)
         dispatch::async([=](){
             try
             {
+                perf::ScopedTimer timer("TM insert");
                 auto tm = TranslationMemory::Get().GetWriter();
                 tm->Insert(srclang, lang, item);
                 // Note: do *not* call tm->Commit() here, because Lucene commit is
@@ -2273,6 +2597,11 @@ void PoeditFrame::OnNewTranslationEntered(const CatalogItemPtr& item)
                 // ignore failures here, they'll become apparent when saving the file
             }
         });
+
+#ifdef HAVE_HTTP_CLIENT
+        if (auto team = TeamTranslationMemory::Get())
+            team->Insert(srclang, lang, item);
+#endif
     }
 }
 
@@ -2291,24 +2620,53 @@ void PoeditFrame::UpdateToTextCtrl(int flags)
 }
 
 
-void PoeditFrame::ReadCatalog(const CatalogPtr& cat)
+void PoeditFrame::ReadCatalog(const CatalogPtr& cat, int flags)
 {
     wxASSERT( cat );
+    perf::ScopedTimer timer("PoeditFrame::ReadCatalog");
+
+    // this supersedes any file being loaded in the background:
+    if (m_loadingCancellation)
+    {
+        m_loadingCancellation->cancel();
+        m_loadingCancellation.reset();
+    }
+    m_loadingFileName.clear();
 
     {
 #ifdef __WXMSW__
         wxWindowUpdateLocker no_updates(this);
 #endif
+        // This supersedes unsaved edits of the previous document, including
+        // those of the same file if it is being reloaded:
+        if (m_journal)
         {
+            m_journal->DiscardAll();
+            m_journal.reset();
+        }
+
+        // restore unsaved edits if Poedit crashed the last time:
+        const int restoredEdits = cat->HasCapability(Catalog::Cap::Translations)
+                                  ? EditJournal::Replay(cat->GetFileName(), *cat)
+                                  : 0;
+
+        if (!(flags & ReadCatalog_AlreadyValidated) || restoredEdits)
+        {
+            perf::ScopedTimer validationTimer("validation");
             wxLogNull null;  // don't report non-item warnings
             // the file was just loaded, it is identical to in-memory content and we can pass `fileWithSameContent`
             cat->Validate(/*fileWithSameContent=*/cat->GetFileName());
         }
 
         m_catalog = cat;
+        if (cat->HasCapability(Catalog::Cap::Translations))
+            m_journal = std::make_unique<EditJournal>(cat->GetFileName());
         m_fileMonitor->SetFile(m_catalog->GetFileName());
+        UpdateSourcesWatcher();
         m_pendingHumanEditedItem.reset();
         m_navigationHistory.clear();
+        m_spellingChecked = false;
+        m_misspellings.clear();
 
         if (m_catalog->empty())
         {
@@ -2316,6 +2674,7 @@ void PoeditFrame::ReadCatalog(const CatalogPtr& cat)
         }
         else
         {
+            perf::ScopedTimer listTimer("list population");
             EnsureAppropriateContentView();
             // This must be done as soon as possible, otherwise the list would be
             // confused. GetCurrentItem() could return nullptr or something invalid,
@@ -2325,7 +2684,7 @@ void PoeditFrame::ReadCatalog(const CatalogPtr& cat)
         }
 
         m_fileExistsOnDisk = true;
-        m_modified = false;
+        m_modified = restoredEdits > 0;
 
         UpdateEditingUIAfterChange();
         RefreshControls(Refresh_NoCatalogChanged /*done right above*/);
@@ -2339,6 +2698,25 @@ void PoeditFrame::ReadCatalog(const CatalogPtr& cat)
 
         if (cat->UsesSymbolicIDsForSource())
             OfferSideloadingSourceText();
+
+        if (restoredEdits)
+        {
+            AttentionMessage msg
+                (
+                    "restored-edits",
+                    AttentionMessage::Warning,
+                    wxString::Format(wxPLURAL("%d unsaved change was restored.", "%d unsaved changes were restored.", restoredEdits), restoredEdits)
+                );
+            msg.SetExplanation(_(L"Poedit didn’t quit properly when this file was last edited. Changes that weren’t saved were restored, save the file to keep them."));
+            msg.AddAction(MSW_OR_OTHER(_("Discard changes"), _("Discard Changes")), [=]{
+                if (m_journal)
+                    m_journal->DiscardAll();
+                auto original = PreOpenFileWithErrorsUI(GetFileName(), this);
+                if (original)
+                    ReadCatalog(original);
+            });
+            m_attentionBar->ShowMessage(msg);
+        }
     }
 
     // Can't do this with the window being frozen, because positioning the toolbar
@@ -2353,6 +2731,194 @@ void PoeditFrame::ReadCatalog(const CatalogPtr& cat)
 #endif
 
     FixDuplicatesIfPresent();
+    WarmupSuggestions();
+}
+
+void PoeditFrame::WarmupSuggestions()
+{
+    if (!Config::UseTM() || !m_catalog->HasCapability(Catalog::Cap::Translations))
+        return;
+
+    auto srclang = m_catalog->GetSourceLanguage();
+    auto lang = m_catalog->GetLanguage();
+    if (!srclang.IsValid() || !lang.IsValid())
+        return;
+
+    // The user will most likely start with the first untranslated items, so
+    // have their suggestions ready in SuggestionsProvider's cache:
+    std::vector<std::wstring> sources;
+    for (auto& item: m_catalog->items())
+    {
+        if (item->IsTranslated())
+            continue;
+        sources.push_back(str::to_wstring(item->GetString()));
+        if ((int)sources.size() == WARMUP_PREFETCH_ITEMS)
+            break;
+    }
+
+    TranslationMemory::Get().Warmup(srclang, lang)
+    .then([=]
+    {
+        SuggestionsProvider provider;
+        for (auto& s: sources)
+        {
+            // results are discarded, they end up in the cache:
+            provider.SuggestTranslation(TranslationMemory::Get(), SuggestionQuery{srclang, lang, s})
+                    .catch_all([](dispatch::exception_ptr){});
+        }
+    })
+    .catch_all([](dispatch::exception_ptr){});
+}
+
+void PoeditFrame::OnCheckSpelling(wxCommandEvent&)
+{
+    m_spellingChecked = true;
+    m_misspellings.clear();
+    CheckSpelling(m_catalog->items(), /*reportResults=*/true);
+}
+
+void PoeditFrame::CheckSpelling(const CatalogItemArray& items, bool reportResults)
+{
+    if (!m_catalog || !m_catalog->HasCapability(Catalog::Cap::Translations))
+        return;
+
+    struct Entry
+    {
+        CatalogItemPtr item;
+        unsigned revision;
+        wxString source;
+        wxArrayString translations;
+        SyntaxHighlighterPtr highlighter;
+    };
+
+    // Copy the texts, because the items may be edited while checking runs;
+    // results for items changed in the meantime are discarded.
+    auto entries = std::make_shared<std::vector<Entry>>();
+    entries->reserve(items.size());
+    for (auto& item: items)
+    {
+        auto source = item->GetString();
+        if (item->HasPlural())
+            source += "\n" + item->GetPluralString();
+        entries->push_back({item, item->GetRevision(), source, item->GetTranslations(),
+                            SyntaxHighlighter::ForItem(*item, SyntaxHighlighter::Markup | SyntaxHighlighter::Placeholder | SyntaxHighlighter::Escape)});
+    }
+
+    auto cat = m_catalog;
+    auto lang = cat->GetLanguage();
+
+    dispatch::async(dispatch::priority::bulk, [=]
+    {
+        std::shared_ptr<std::vector<wxString>> misspelled;
+        auto checker = SpellChecker::GetFor(lang);
+        if (!checker)
+            return misspelled;
+
+        misspelled = std::make_shared<std::vector<wxString>>(entries->size());
+        dispatch::parallel_for(entries->size(), SPELLCHECK_GRAIN, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                auto& e = (*entries)[i];
+                for (auto& t: e.translations)
+                {
+                    if (checker->FindMisspelledWord(t, e.source, e.highlighter, (*misspelled)[i]))
+                        break;
+                }
+            }
+        }, dispatch::cancellation_token_ptr(), dispatch::priority::bulk);
+
+        return misspelled;
+    })
+    .then_on_window(this, [=](std::shared_ptr<std::vector<wxString>> misspelled)
+    {
+        if (m_catalog != cat)
+            return;
+
+        if (!misspelled)
+        {
+            if (reportResults)
+            {
+                wxWindowPtr<wxMessageDialog> dlg(new wxMessageDialog
+                (
+                    this,
+                    _("Spellchecking is not available for this language."),
+                    _("Spellchecking results"),
+                    wxOK | wxICON_INFORMATION
+                ));
+                dlg->SetExtendedMessage(wxString::Format(_("Make sure a spellchecker dictionary for %s is installed."), lang.DisplayName()));
+                dlg->ShowWindowModalThenDo([dlg](int){});
+            }
+            return;
+        }
+
+        int found = 0;
+        for (size_t i = 0; i < entries->size(); ++i)
+        {
+            auto& e = (*entries)[i];
+            // edited in the meantime and rechecked by OnNewTranslationEntered()
+            if (e.item->GetRevision() != e.revision)
+                continue;
+
+            auto& word = (*misspelled)[i];
+            if (word.empty())
+            {
+                m_misspellings.erase(e.item->GetId());
+            }
+            else
+            {
+                m_misspellings[e.item->GetId()] = word;
+                found++;
+            }
+        }
+
+        ApplySpellingIssues();
+
+        if (m_list)
+        {
+            if (entries->size() > 1)
+                m_list->RefreshAllItems();
+            else if (!entries->empty())
+                m_list->RefreshItem(m_list->CatalogItemToListItem(entries->front().item));
+        }
+
+        if (reportResults)
+        {
+            if (m_list && m_list->sortOrder().errorsFirst)
+                m_list->Sort();
+
+            wxWindowPtr<wxMessageDialog> dlg(new wxMessageDialog
+            (
+                this,
+                found
+                    ? wxString::Format(wxPLURAL("%d translation with a possible misspelling found.",
+                                                "%d translations with possible misspellings found.",
+                                                found), found)
+                    : _("No misspellings found."),
+                _("Spellchecking results"),
+                wxOK | (found ? wxICON_WARNING : wxICON_INFORMATION)
+            ));
+            if (found)
+                dlg->SetExtendedMessage(_("Entries with possible misspellings were marked with a warning in the list. The misspelled word will be shown when you select such an entry."));
+            dlg->ShowWindowModalThenDo([dlg](int){});
+        }
+    })
+    .catch_all([](dispatch::exception_ptr){});
+}
+
+void PoeditFrame::ApplySpellingIssues()
+{
+    if (m_misspellings.empty() || !m_catalog || !Config::ShowWarnings())
+        return;
+
+    for (auto& item: m_catalog->items())
+    {
+        if (item->HasIssue())
+            continue;
+        auto found = m_misspellings.find(item->GetId());
+        if (found != m_misspellings.end())
+            item->SetIssue(CatalogItem::Issue::Warning, wxString::Format(_(L"Possible misspelling: “%s”."), found->second));
+    }
 }
 
 void PoeditFrame::FixDuplicatesIfPresent()
@@ -2540,7 +3106,7 @@ void PoeditFrame::SideloadSourceTextFromFile(const wxFileName& fn)
 {
     try
     {
-        auto refcat = Catalog::Create(fn.GetFullPath());
+        auto refcat = Catalog::CreateSharedReferenceFile(fn.GetFullPath());
         m_catalog->SideloadSourceDataFromReferenceFile(refcat);
         UpdateEditingUIAfterChange();
         NotifyCatalogChanged(m_catalog);
@@ -2605,6 +3171,12 @@ void PoeditFrame::RefreshControls(int flags)
 
 void PoeditFrame::NotifyCatalogChanged(const CatalogPtr& cat)
 {
+    // the filter and search index are for the previous content:
+    CancelListFilter();
+    m_searchIndex.reset();
+    if (m_filterField)
+        m_filterField->ChangeValue(wxString());
+
     if (m_sidebar)
         m_sidebar->ResetCatalog();
     if (m_list)
@@ -2612,6 +3184,98 @@ void PoeditFrame::NotifyCatalogChanged(const CatalogPtr& cat)
 }
 
 
+std::shared_ptr<CatalogSearchIndex> PoeditFrame::GetSearchIndex()
+{
+    if (!m_searchIndex && m_catalog)
+        m_searchIndex = CatalogSearchIndex::Create(m_catalog);
+    return m_searchIndex;
+}
+
+
+void PoeditFrame::OnFilterTextChanged()
+{
+    ApplyListFilter(m_filterField->GetValue());
+}
+
+
+void PoeditFrame::CancelListFilter()
+{
+    if (m_filterCancellation)
+    {
+        m_filterCancellation->cancel();
+        m_filterCancellation.reset();
+    }
+}
+
+
+void PoeditFrame::ApplyListFilter(const wxString& text)
+{
+    // results of the previous, now stale, query are never applied:
+    CancelListFilter();
+
+    if (!m_list || !m_catalog)
+        return;
+
+    if (text.empty())
+    {
+        if (m_list->IsFiltered())
+            m_list->SetFilter(nullptr);
+        return;
+    }
+
+    // Matching runs in the background over the index, so that typing never
+    // blocks the UI. Only items changed since the index was built need to
+    // be checked here, when applying the results.
+    auto token = std::make_shared<dispatch::cancellation_token>();
+    m_filterCancellation = token;
+
+    auto index = GetSearchIndex();
+    auto catalog = m_catalog;
+    auto revisions = CatalogSearchIndex::GetRevisions(*catalog);
+
+    dispatch::async([=]
+    {
+        index->EnsureBuilt();
+        if (token->is_cancelled())
+            return std::vector<CatalogSearchIndex::MatchResult>();
+        return index->Match(text, revisions, token);
+    })
+    .then_on_window(this, [=](std::vector<CatalogSearchIndex::MatchResult> results)
+    {
+        if (token->is_cancelled() || catalog != m_catalog || !m_list)
+            return;
+        m_filterCancellation.reset();
+
+        auto& items = catalog->items();
+        if (results.size() != items.size())
+        {
+            // catalog changed too much since indexing
+            m_searchIndex.reset();
+            ApplyListFilter(text);
+            return;
+        }
+
+        auto filter = std::make_shared<std::vector<bool>>(items.size());
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            switch (results[i])
+            {
+                case CatalogSearchIndex::Match_Yes:
+                    (*filter)[i] = true;
+                    break;
+                case CatalogSearchIndex::Match_Changed:
+                    (*filter)[i] = CatalogSearchIndex::ItemMatches(*items[i], text);
+                    break;
+                case CatalogSearchIndex::Match_No:
+                    break;
+            }
+        }
+
+        m_list->SetFilter(filter);
+    });
+}
+
+
 void PoeditFrame::UpdateStatusBar()
 {
     auto bar = GetStatusBar();
@@ -2735,6 +3399,7 @@ void PoeditFrame::UpdateMenu()
 
     menubar->Enable(XRCID("menu_purge_deleted"), editable);
     menubar->Enable(XRCID("menu_validate"), editable);
+    menubar->Enable(XRCID("menu_check_spelling"), editable);
     menubar->Enable(XRCID("menu_catproperties"), hasCatalog);
 
     menubar->Enable(XRCID("menu_ids"), nonEmpty);
@@ -2759,20 +3424,17 @@ void PoeditFrame::WriteCatalog(const wxString& catalog)
     WriteCatalog(catalog, [](bool){});
 }
 
-template<typename TFunctor>
-void PoeditFrame::WriteCatalog(const wxString& catalog, TFunctor completionHandler)
+void PoeditFrame::PrepareForWritingCatalog()
 {
-    wxBusyCursor bcur;
-
-    dispatch::future<void> tmUpdateThread;
     if (Config::UseTM() && m_catalog->HasCapability(Catalog::Cap::Translations))
     {
-        tmUpdateThread = dispatch::async([=]{
+        dispatch::async([=]{
             try
             {
-                // Commit pending writes made in OnNewTranslationEntered():
+                // Commit pending writes made in OnNewTranslationEntered(). This
+                // is done in the background and doesn't need to be waited for.
                 auto tm = TranslationMemory::Get().GetWriter();
-                tm->Commit();
+                tm->ScheduleCommit();
             }
             catch ( const Exception& e )
             {
@@ -2791,23 +3453,154 @@ void PoeditFrame::WriteCatalog(const wxString& catalog, TFunctor completionHandl
         dt.Translator = wxConfig::Get()->Read("translator_name", dt.Translator);
         dt.TranslatorEmail = wxConfig::Get()->Read("translator_email", dt.TranslatorEmail);
     }
+}
+
+template<typename TFunctor>
+void PoeditFrame::WriteCatalog(const wxString& catalog, TFunctor completionHandler)
+{
+    wxBusyCursor bcur;
+    perf::ScopedTimer timer("PoeditFrame::WriteCatalog");
+
+    PrepareForWritingCatalog();
 
-    FileMonitor::WritingGuard guard(*m_fileMonitor);
+    // the monitor is already guarded if a background save is running:
+    std::unique_ptr<FileMonitor::WritingGuard> guard;
+    if (!m_backgroundSaveGuard)
+        guard.reset(new FileMonitor::WritingGuard(*m_fileMonitor));
+
+    const uint64_t journalPosition = m_journal ? m_journal->GetPosition() : 0;
 
     Catalog::ValidationResults validation_results;
     Catalog::CompilationStatus mo_compilation_status = Catalog::CompilationStatus::NotDone;
     if ( !m_catalog->Save(catalog, true, validation_results, mo_compilation_status) )
     {
-        if (tmUpdateThread.valid())
-            tmUpdateThread.wait();
         completionHandler(false);
         return;
     }
 
-    m_catalog->SetFileName(catalog);
+    UpdateJournalAfterSaving(catalog, journalPosition);
+
+    // A background save that is still running would overwrite the file with
+    // older content when it finishes, so save it again after it:
+    if (m_backgroundSaveGuard)
+        m_pendingBackgroundSave = catalog;
+
     m_modified = false;
+    FinishWritingCatalog(catalog, m_catalog->GetCloudSync(), validation_results, mo_compilation_status, completionHandler);
+}
+
+
+void PoeditFrame::WriteCatalogInBackground(const wxString& catalog)
+{
+    if (m_backgroundSaveGuard)
+    {
+        // saves of the same file must not run concurrently, do it afterwards:
+        m_pendingBackgroundSave = catalog;
+        return;
+    }
+
+    perf::ScopedTimer timer("PoeditFrame::WriteCatalogInBackground");
+
+    PrepareForWritingCatalog();
+
+    // Saving works with a copy of the catalog, so that it can be edited in
+    // the meantime. Any changes made while saving mark the document as
+    // modified again; if saving fails, it is marked as such right away.
+    auto snapshot = m_catalog->CreateSnapshot();
+    if (!snapshot)
+    {
+        WriteCatalog(catalog);
+        return;
+    }
+    // edits made from now on aren't in the snapshot and must stay in the journal:
+    const uint64_t journalPosition = m_journal ? m_journal->GetPosition() : 0;
+    auto cat = m_catalog;
+    auto cloudsync = m_catalog->GetCloudSync();
+    m_backgroundSaveGuard.reset(new FileMonitor::WritingGuard(*m_fileMonitor));
+    m_modified = false;
+    UpdateTitle();
+
+    struct Result
+    {
+        bool saved = false;
+        Catalog::ValidationResults validation;
+        Catalog::CompilationStatus mo_compilation_status = Catalog::CompilationStatus::NotDone;
+    };
+
+    dispatch::async([=]
+    {
+        Result r;
+        try
+        {
+            r.saved = snapshot->Save(catalog, true, r.validation, r.mo_compilation_status);
+        }
+        catch (...)
+        {
+            wxLogError(_(L"Couldn’t save file %s."), catalog);
+            wxLogError("%s", DescribeCurrentException());
+        }
+        return r;
+    })
+    .then_on_window(this, [=](Result r)
+    {
+        m_backgroundSaveGuard.reset();
+
+        if (m_catalog != cat)
+        {
+            // the document was replaced with another one in the meantime
+            OnBackgroundSaveFinished();
+            return;
+        }
+
+        if (!r.saved)
+        {
+            m_modified = true;
+            UpdateTitle();
+            OnBackgroundSaveFinished();
+            return;
+        }
+
+        cat->AdoptSavedSnapshot(*snapshot);
+        UpdateJournalAfterSaving(catalog, journalPosition);
+        FinishWritingCatalog(catalog, cloudsync, r.validation, r.mo_compilation_status, [=](bool){
+            OnBackgroundSaveFinished();
+        });
+    });
+}
+
+
+void PoeditFrame::OnBackgroundSaveFinished()
+{
+    if (!m_pendingBackgroundSave.empty())
+    {
+        auto fn = m_pendingBackgroundSave;
+        m_pendingBackgroundSave.clear();
+        if (m_catalog)
+        {
+            WriteCatalogInBackground(fn);
+            return;
+        }
+    }
+
+    if (m_closeAfterBackgroundSave)
+    {
+        m_closeAfterBackgroundSave = false;
+        Close();
+    }
+}
+
+
+template<typename TFunctor>
+void PoeditFrame::FinishWritingCatalog(const wxString& catalog,
+                                       std::shared_ptr<CloudSyncDestination> cloudsync,
+                                       const Catalog::ValidationResults& validation_results,
+                                       Catalog::CompilationStatus mo_compilation_status,
+                                       TFunctor completionHandler)
+{
+    m_catalog->SetFileName(catalog);
     m_fileExistsOnDisk = true;
     m_fileMonitor->SetFile(m_catalog->GetFileName());
+    UpdateSourcesWatcher();
 
     UpdateTitle();
 
@@ -2818,14 +3611,15 @@ void PoeditFrame::WriteCatalog(const wxString& catalog, TFunctor completionHandl
     if (ManagerFrame::Get())
         ManagerFrame::Get()->NotifyFileChanged(GetFileName());
 
-    if (m_catalog->GetCloudSync())
+    if (cloudsync)
     {
-        CloudSyncProgressWindow::RunSync(this, m_catalog->GetCloudSync(), m_catalog);
+        // uploaded in the background, any errors are reported in the attention bar
+        if (cloudsync->AuthIfNeeded(this))
+            CloudSyncQueue::Get().Upload(cloudsync, m_catalog);
     }
 
-    if (tmUpdateThread.valid())
-        tmUpdateThread.wait();
-
+    // saving validated the catalog again
+    ApplySpellingIssues();
     if (m_list && m_list->sortOrder().errorsFirst)
         m_list->Sort();
 
@@ -2872,20 +3666,14 @@ void PoeditFrame::OnEditComment(wxCommandEvent& event)
             UpdateTitle();
             wxString comment = dlg->GetComment();
 
-            bool modified = false;
-            m_list->ForSelectedCatalogItemsDo([&modified,comment](CatalogItem& item){
-                if (item.GetComment() != comment)
-                {
-                    item.SetComment(comment);
-                    item.SetModified(true);
-                    modified = true;
-                }
-            });
-            if (modified && !IsModified())
-            {
-                m_modified = true;
-                UpdateTitle();
-            }
+            EditSelectedItems([comment](CatalogItem& item){
+                if (item.GetComment() == comment)
+                    return false;
+                item.SetComment(comment);
+                item.SetModified(true);
+                return true;
+            },
+            EditingArea::DontTouchText);
 
             // update comment window
             if (m_sidebar)
@@ -2934,6 +3722,7 @@ void PoeditFrame::OnSuggestion(wxCommandEvent& event)
     UpdateStatusBar();
 
     RecordItemToNavigationHistory(entry);
+    RecordEditsToJournal({entry});
     UpdateToTextCtrl(EditingArea::UndoableEdit);
     m_list->RefreshItem(m_list->GetCurrentItem());
 }
@@ -3449,6 +4238,7 @@ void PoeditFrame::OnDoneAndNext(wxCommandEvent&)
         // do additional processing of finished translations, such as adding it to the TM:
         m_pendingHumanEditedItem = item;
         RecordItemToNavigationHistory(item);
+        RecordEditsToJournal({item});
     }
 
     // like "next unfinished", but wraps
@@ -3464,7 +4254,9 @@ void PoeditFrame::OnDoneAndNext(wxCommandEvent&)
 void PoeditFrame::OnGoPreviouslyEdited(wxCommandEvent&)
 {
     auto previous = m_navigationHistory.back();
-    m_list->SelectAndFocus(m_list->CatalogItemToListItem(previous));
+    auto listItem = m_list->CatalogItemToListItem(previous);
+    if (listItem.IsOk()) // not if hidden by the filter
+        m_list->SelectAndFocus(listItem);
     m_navigationHistory.pop_back();
 }
 
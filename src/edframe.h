@@ -28,15 +28,19 @@
 
 #include <memory>
 #include <set>
+#include <unordered_map>
+#include <vector>
 
 #include <wx/frame.h>
 #include <wx/process.h>
 #include <wx/msgdlg.h>
 #include <wx/windowptr.h>
 
+class WXDLLIMPEXP_FWD_CORE wxSearchCtrl;
 class WXDLLIMPEXP_FWD_CORE wxSplitterWindow;
 class WXDLLIMPEXP_FWD_CORE wxSplitterEvent;
 
+#include "cache_registry.h"
 #include "catalog.h"
 #include "catalog_po.h"
 #include "gexecute.h"
@@ -54,10 +58,13 @@ class WXDLLIMPEXP_FWD_CORE wxSplitterEvent;
 
 class PoeditFrame;
 class AttentionBar;
+class CatalogSearchIndex;
 class FindFrame;
 class MainToolbar;
 class Sidebar;
 class EditingArea;
+class SourcesWatcher;
+class EditJournal;
 
 /** This class provides main editing frame. It handles user's input
     and provides frontend to catalog editing engine. Nothing fancy.
@@ -80,7 +87,7 @@ class PoeditFrame : public PoeditFrameBase
         static PoeditFrame *CreateEmpty();
 
         /// Opens given file in this frame. Asks user for permission first
-        /// if there's unsaved document.
+        /// if there's unsaved document. The file is loaded in the background.
         void OpenFile(const wxString& filename, int lineno = 0);
 
         static CatalogPtr PreOpenFileWithErrorsUI(const wxString& filename, wxWindow *parent);
@@ -104,17 +111,42 @@ class PoeditFrame : public PoeditFrameBase
 
         static int GetOpenWindowsCount() { return (int)ms_instances.size(); }
 
+        /// Returns catalogs currently open in all windows
+        static std::vector<CatalogPtr> GetOpenCatalogs();
+
         ~PoeditFrame();
 
         /// Reads catalog, refreshes controls, takes ownership of catalog.
-        void ReadCatalog(const CatalogPtr& cat);
+        enum { ReadCatalog_AlreadyValidated = 1 };
+        void ReadCatalog(const CatalogPtr& cat, int flags = 0);
         /// Writes catalog.
         void WriteCatalog(const wxString& catalog);
 
         template<typename TFunctor>
         void WriteCatalog(const wxString& catalog, TFunctor completionHandler);
 
+        /**
+            Writes catalog on a background thread, from its snapshot, so that
+            editing can continue while it is being saved. Errors are reported
+            when saving finishes.
+
+            Falls back to WriteCatalog() for formats that don't support
+            Catalog::CreateSnapshot().
+         */
+        void WriteCatalogInBackground(const wxString& catalog);
+
         void FixDuplicatesIfPresent();
+        /// Prepares TM for the catalog's languages and prefetches first suggestions
+        void WarmupSuggestions();
+
+        /**
+            Spellchecks translations of @a items in the background and marks
+            those with misspelled words with a warning. If @a reportResults
+            is true, the user is told about the results when done.
+         */
+        void CheckSpelling(const CatalogItemArray& items, bool reportResults);
+        /// Marks items with misspellings found by CheckSpelling(), which Validate() clears
+        void ApplySpellingIssues();
         void WarnAboutLanguageIssues();
         void SideloadSourceTextFromFile(const wxFileName& fn);
         void OfferSideloadingSourceText();
@@ -141,9 +173,23 @@ class PoeditFrame : public PoeditFrameBase
         /// Puts text from catalog & listctrl to textctrls.
         void UpdateToTextCtrl(int flags);
 
+        /**
+            Edits all selected items as a single operation.
+
+            @a func is called for every selected item and returns true if it
+            modified it. The document's state, statistics, modified rows of
+            the list and (with @a textCtrlFlags) the editing area are updated
+            only once afterwards, however many items were edited.
+         */
+        template<typename F>
+        void EditSelectedItems(F&& func, int textCtrlFlags);
+
         /// Puts text from textctrls to catalog & listctrl.
         void OnUpdatedFromTextCtrl(CatalogItemPtr item, bool statsChanged);
 
+        /// Returns search index for the current catalog, created on first use.
+        std::shared_ptr<CatalogSearchIndex> GetSearchIndex();
+
         wxString GetFileName() const
             { return m_catalog ? m_catalog->GetFileName() : wxString(); }
         wxString GetFileNamePartOfTitle() const
@@ -174,7 +220,8 @@ class PoeditFrame : public PoeditFrameBase
             Invalid, // no content whatsoever
             Translation,
             POT,
-            Empty_PO
+            Empty_PO,
+            Loading // placeholder shown while the file is loaded
         };
         Content m_contentType;
         /// parent of all content controls etc.
@@ -187,8 +234,13 @@ class PoeditFrame : public PoeditFrameBase
         void EnsureAppropriateContentView();
         wxWindow* CreateContentViewPO(Content type);
         wxWindow* CreateContentViewEmptyPO();
+        wxWindow* CreateContentViewLoading();
         void DestroyContentView();
 
+        /// Loads the file on a background thread and shows it when done,
+        /// showing a progress placeholder in the meantime
+        void LoadFileInBackground(const wxString& filename, int lineno);
+
         void PlaceInitialFocus(int lineno = 0);
 
         typedef std::set<PoeditFrame*> PoeditFramesList;
@@ -229,6 +281,16 @@ class PoeditFrame : public PoeditFrameBase
 
         // (Re)initializes spellchecker, if needed
         void InitSpellchecker();
+        // Calls InitSpellchecker() soon, coalescing repeated requests
+        void ScheduleInitSpellchecker();
+
+        // Starts or stops watching the catalog's sources, as configured
+        void UpdateSourcesWatcher();
+
+        // Records edited items to the crash recovery journal
+        void RecordEditsToJournal(const std::vector<CatalogItemPtr>& items);
+        // Updates the journal after the catalog was saved as @a catalog
+        void UpdateJournalAfterSaving(const wxString& catalog, uint64_t journalPosition);
 
         void RecordItemToNavigationHistory(const CatalogItemPtr& item);
 
@@ -260,6 +322,7 @@ private:
         void DoSaveAs(const wxString& filename);
         void OnEditProperties(wxCommandEvent& event);
         void OnUpdateEditProperties(wxUpdateUIEvent& event);
+        void OnDiagnostics(wxCommandEvent& event);
 
         void OnUpdateFromSources(wxCommandEvent& event);
         void OnUpdateFromSourcesUpdate(wxUpdateUIEvent& event);
@@ -271,6 +334,7 @@ private:
         void OnUpdateSmartUpdate(wxUpdateUIEvent& event);
 
         void OnValidate(wxCommandEvent& event);
+        void OnCheckSpelling(wxCommandEvent& event);
         void OnListSel(wxDataViewEvent& event);
         void OnListRightClick(wxDataViewEvent& event);
         void OnListFocus(wxFocusEvent& event);
@@ -347,8 +411,27 @@ private:
         DECLARE_EVENT_TABLE()
 
     private:
+        // Parts of WriteCatalog() shared by WriteCatalogInBackground():
+        void PrepareForWritingCatalog();
+        template<typename TFunctor>
+        void FinishWritingCatalog(const wxString& catalog,
+                                  std::shared_ptr<CloudSyncDestination> cloudsync,
+                                  const Catalog::ValidationResults& validation_results,
+                                  Catalog::CompilationStatus mo_compilation_status,
+                                  TFunctor completionHandler);
+        void OnBackgroundSaveFinished();
+
         CatalogPtr m_catalog;
         std::unique_ptr<FileMonitor> m_fileMonitor;
+        // Set while WriteCatalogInBackground() runs, must be destroyed before m_fileMonitor:
+        std::unique_ptr<FileMonitor::WritingGuard> m_backgroundSaveGuard;
+        // File to save again once the running background save finishes, if any:
+        wxString m_pendingBackgroundSave;
+        bool m_closeAfterBackgroundSave = false;
+        std::unique_ptr<SourcesWatcher> m_sourcesWatcher;
+        // Unsaved edits for crash recovery, if the file exists on disk:
+        std::unique_ptr<EditJournal> m_journal;
+        int m_cloudSyncObserver;
         bool m_fileExistsOnDisk;
 
         wxString m_fileNamePartOfTitle;
@@ -367,10 +450,31 @@ private:
         Sidebar *m_sidebar;
         wxWeakRef<FindFrame> m_findWindow;
 
+        // Filter-as-you-type field above the list and the running filter query:
+        wxSearchCtrl *m_filterField;
+        dispatch::cancellation_token_ptr m_filterCancellation;
+
+        // file being loaded by LoadFileInBackground(), if any
+        wxString m_loadingFileName;
+        dispatch::cancellation_token_ptr m_loadingCancellation;
+        void OnFilterTextChanged();
+        void ApplyListFilter(const wxString& text);
+        void CancelListFilter();
+
+        std::shared_ptr<CatalogSearchIndex> m_searchIndex;
+
+        // misspelled words found by CheckSpelling(), keyed by item ID; once
+        // the user spellchecked the file, edited items are rechecked
+        bool m_spellingChecked;
+        std::unordered_map<int, wxString> m_misspellings;
+
         bool m_modified;
         bool m_hasObsoleteItems;
         bool m_displayIDs;
         bool m_setSashPositionsWhenMaximized;
+        bool m_spellcheckerInitPending;
+
+        CacheRegistry::Registration m_cacheRegistration;
 };
 
 
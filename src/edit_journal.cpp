@@ -0,0 +1,357 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2023 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "edit_journal.h"
+
+#include "concurrency.h"
+#include "json.h"
+#include "str_helpers.h"
+
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <wx/log.h>
+
+#include <algorithm>
+#include <mutex>
+#include <set>
+#include <vector>
+
+
+namespace
+{
+
+wxString gs_journalDir;
+
+wxString NormalizedPath(const wxString& filename)
+{
+    wxFileName fn(filename);
+    fn.Normalize(wxPATH_NORM_DOTS | wxPATH_NORM_ABSOLUTE);
+    return fn.GetFullPath();
+}
+
+wxString GetJournalFileName(const wxString& normalizedCatalogFile)
+{
+    if (gs_journalDir.empty() || normalizedCatalogFile.empty())
+        return wxString();
+
+    const auto hash = std::hash<std::wstring>()(normalizedCatalogFile.ToStdWstring());
+    return wxString::Format("%s%c%016llx.journal", gs_journalDir, wxFILE_SEP_PATH, (unsigned long long)hash);
+}
+
+// The first line of the journal identifies the catalog, to guard against hash collisions:
+std::string MakeJournalHeader(const wxString& normalizedCatalogFile)
+{
+    json j;
+    j["file"] = str::to_utf8(normalizedCatalogFile);
+    return j.dump() + '\n';
+}
+
+} // anonymous namespace
+
+
+class EditJournal::Impl : public std::enable_shared_from_this<EditJournal::Impl>
+{
+public:
+    explicit Impl(const wxString& catalogFile)
+        : m_catalogFile(NormalizedPath(catalogFile)),
+          m_filename(GetJournalFileName(m_catalogFile))
+    {}
+
+    const wxString& GetCatalogFile() const { return m_catalogFile; }
+    bool IsEnabled() const { return !m_filename.empty(); }
+
+    void Record(int itemId, std::string&& line)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // coalesce repeated edits of the same item that weren't written yet:
+        for (size_t i = m_written; i < m_records.size(); i++)
+        {
+            if (m_records[i].itemId == itemId)
+            {
+                m_records.erase(m_records.begin() + i);
+                break;
+            }
+        }
+
+        m_records.push_back({++m_lastPosition, itemId, std::move(line)});
+        ScheduleFlush();
+    }
+
+    Position GetPosition() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_lastPosition;
+    }
+
+    void DiscardUpTo(Position pos)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_records.erase(std::remove_if(m_records.begin(), m_records.end(),
+                                       [=](const Record& r){ return r.position <= pos; }),
+                        m_records.end());
+        // the file is small and rewritten rarely (on save), so just rewrite it:
+        m_written = 0;
+        m_rewrite = true;
+        ScheduleFlush();
+    }
+
+    void DiscardAll()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_records.clear();
+            m_written = 0;
+            m_rewrite = true;
+        }
+        Flush();
+    }
+
+    /// Writes pending changes to the file; may be called from any thread.
+    void Flush()
+    {
+        // flushes must be serialized, but without blocking recording of new edits:
+        std::lock_guard<std::mutex> fileLock(m_fileMutex);
+
+        std::string data;
+        bool rewrite;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_flushScheduled = false;
+            rewrite = m_rewrite;
+            m_rewrite = false;
+            for (size_t i = m_written; i < m_records.size(); i++)
+            {
+                data += m_records[i].line;
+                data += '\n';
+            }
+            m_written = m_records.size();
+        }
+
+        if (data.empty())
+        {
+            if (rewrite && wxFileExists(m_filename))
+                wxRemoveFile(m_filename);
+            return;
+        }
+
+        const bool isNew = rewrite || !wxFileExists(m_filename);
+        wxFFile f(m_filename, isNew ? "wb" : "ab");
+        if (!f.IsOpened())
+            return;
+        if (isNew)
+            data.insert(0, MakeJournalHeader(m_catalogFile));
+        if (!f.Write(data.data(), data.size()) || !f.Flush())
+            wxLogTrace("poedit", "failed to write edits journal %s", m_filename);
+    }
+
+private:
+    void ScheduleFlush()
+    {
+        // called with m_mutex locked
+        if (m_flushScheduled || !IsEnabled())
+            return;
+        m_flushScheduled = true;
+        auto self = shared_from_this();
+        dispatch::async([self]{ self->Flush(); });
+    }
+
+    struct Record
+    {
+        Position position;
+        int itemId;
+        std::string line;
+    };
+
+    const wxString m_catalogFile;
+    const wxString m_filename;
+
+    mutable std::mutex m_mutex;
+    std::vector<Record> m_records;  // all edits not discarded yet
+    size_t m_written = 0;           // how many of m_records are in the file
+    bool m_rewrite = false;         // must the file be written from scratch?
+    bool m_flushScheduled = false;
+    Position m_lastPosition = 0;
+
+    std::mutex m_fileMutex;
+};
+
+
+void EditJournal::SetJournalDir(const wxString& dir)
+{
+    gs_journalDir = dir;
+}
+
+
+EditJournal::EditJournal(const wxString& catalogFile)
+    : m_impl(std::make_shared<Impl>(catalogFile))
+{
+}
+
+
+EditJournal::~EditJournal()
+{
+    // pending writes are finished in the background, m_impl is kept alive by them
+}
+
+
+bool EditJournal::IsFor(const wxString& catalogFile) const
+{
+    return m_impl->GetCatalogFile() == NormalizedPath(catalogFile);
+}
+
+
+void EditJournal::RecordEdit(const CatalogItem& item)
+{
+    if (!m_impl->IsEnabled())
+        return;
+
+    json j;
+    j["id"] = item.GetId();
+    j["msgid"] = str::to_utf8(item.GetRawString());
+    if (item.HasContext())
+        j["msgctxt"] = str::to_utf8(item.GetContext());
+    auto& translations = j["translations"] = json::array();
+    for (auto& t: item.GetTranslations())
+        translations.push_back(str::to_utf8(t));
+    j["fuzzy"] = item.IsFuzzy();
+    j["pretranslated"] = item.IsPreTranslated();
+
+    m_impl->Record(item.GetId(), j.dump());
+}
+
+
+EditJournal::Position EditJournal::GetPosition() const
+{
+    return m_impl->GetPosition();
+}
+
+
+void EditJournal::DiscardUpTo(Position pos)
+{
+    m_impl->DiscardUpTo(pos);
+}
+
+
+void EditJournal::DiscardAll()
+{
+    m_impl->DiscardAll();
+}
+
+
+int EditJournal::Replay(const wxString& catalogFile, Catalog& catalog)
+{
+    const wxString catalogPath = NormalizedPath(catalogFile);
+    const wxString filename = GetJournalFileName(catalogPath);
+    if (filename.empty() || !wxFileExists(filename))
+        return 0;
+
+    std::string data;
+    {
+        wxLogNull null;
+        wxFFile f(filename, "rb");
+        if (!f.IsOpened())
+            return 0;
+        data.resize((size_t)f.Length());
+        if (f.Read(&data[0], data.size()) != data.size())
+            return 0;
+    }
+
+    std::set<int> restored;
+    size_t pos = 0;
+    bool header = true;
+    while (pos < data.size())
+    {
+        size_t end = data.find('\n', pos);
+        if (end == std::string::npos)
+            end = data.size();
+        const auto lineBegin = data.begin() + pos;
+        const auto lineEnd = data.begin() + end;
+        pos = end + 1;
+
+        json j;
+        try
+        {
+            j = json::parse(lineBegin, lineEnd);
+        }
+        catch (...)
+        {
+            if (header)
+                return 0;
+            // the last line may be incomplete if the app crashed while writing it
+            continue;
+        }
+
+        try
+        {
+            if (header)
+            {
+                if (str::to_wx(j.at("file").get<std::string>()) != catalogPath)
+                    return 0;
+                header = false;
+                continue;
+            }
+
+            const int id = j.at("id").get<int>();
+            const wxString msgid = str::to_wx(j.at("msgid").get<std::string>());
+            const bool hasContext = j.contains("msgctxt");
+            const wxString context = hasContext ? str::to_wx(j["msgctxt"].get<std::string>()) : wxString();
+
+            // IDs are only stable if the file didn't change in the meantime:
+            int index = id - 1;
+            if (index < 0 || index >= (int)catalog.GetCount() ||
+                catalog[index]->GetRawString() != msgid ||
+                catalog[index]->HasContext() != hasContext ||
+                (hasContext && catalog[index]->GetContext() != context))
+            {
+                index = catalog.FindItemIndexByString(msgid, hasContext, context);
+                if (index == -1)
+                    continue;
+            }
+
+            wxArrayString translations;
+            for (auto& t: j.at("translations"))
+                translations.push_back(str::to_wx(t.get<std::string>()));
+
+            auto item = catalog[index];
+            item->SetTranslations(translations);
+            item->SetFuzzy(j.value("fuzzy", false));
+            item->SetPreTranslated(j.value("pretranslated", false));
+            item->SetModified(true);
+            restored.insert(index);
+        }
+        catch (...)
+        {
+            if (header)
+                return 0;
+            continue;  // malformed record
+        }
+    }
+
+    if (!restored.empty())
+        wxLogTrace("poedit", "restored %d unsaved edits of %s", (int)restored.size(), catalogPath);
+
+    return (int)restored.size();
+}
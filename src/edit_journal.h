@@ -0,0 +1,89 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2023 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_edit_journal_h
+#define Poedit_edit_journal_h
+
+#include "catalog.h"
+
+#include <cstdint>
+#include <memory>
+
+
+/**
+    Append-only journal of edits made to a catalog since it was last saved,
+    for recovering unsaved work after a crash.
+
+    Every edit appends the new state of the item (its translations and flags)
+    to a journal file kept in the cache directory. Writes are done on a
+    background thread and their cost only depends on the size of the edit,
+    not the size of the catalog. When the catalog is saved, the journal is
+    emptied; if it wasn't, the edits are replayed when the file is opened
+    again.
+ */
+class EditJournal
+{
+public:
+    /// Set directory to keep journals in; journaling is disabled if not set.
+    static void SetJournalDir(const wxString& dir);
+
+    /// Creates (empty) journal for given catalog file.
+    explicit EditJournal(const wxString& catalogFile);
+    ~EditJournal();
+
+    /// Is this the journal of @a catalogFile?
+    bool IsFor(const wxString& catalogFile) const;
+
+    /// Records current state of an edited item. Cheap, writing happens in the background.
+    void RecordEdit(const CatalogItem& item);
+
+    /// Identifies all edits recorded up to some point, see DiscardUpTo().
+    typedef uint64_t Position;
+    Position GetPosition() const;
+
+    /// Removes edits recorded up to @a pos, e.g. because they were saved.
+    void DiscardUpTo(Position pos);
+
+    /// Removes all edits, e.g. when the user discarded them. Done synchronously.
+    void DiscardAll();
+
+    /**
+        Applies edits from a journal left by a previous session to @a catalog,
+        which must be freshly loaded from @a catalogFile.
+
+        Items are matched by their source text, so edits of items that are no
+        longer in the file are skipped. The journal is kept until the catalog
+        is saved (see DiscardUpTo()) or the edits are discarded.
+
+        @return Number of restored items, 0 if there was no journal.
+     */
+    static int Replay(const wxString& catalogFile, Catalog& catalog);
+
+private:
+    class Impl;
+    std::shared_ptr<Impl> m_impl;
+};
+
+#endif // Poedit_edit_journal_h
@@ -733,22 +733,19 @@ void EditingArea::RecreatePluralTextCtrls(CatalogPtr catalog)
 
         if (plurals && formsCount > 1)
         {
-            for (int example = 0; example < PluralFormsExpr::MAX_EXAMPLES_COUNT; example++)
+            for (int example: plurals.examples_for_form(form))
             {
-                if (plurals.evaluate_for_n(example) == form)
+                if (++examplesCnt == 1)
+                    firstExample = example;
+                if (examplesCnt == maxExamplesCnt)
                 {
-                    if (++examplesCnt == 1)
-                        firstExample = example;
-                    if (examplesCnt == maxExamplesCnt)
-                    {
-                        examples += L'…';
-                        break;
-                    }
-                    else if (examplesCnt == 1)
-                        examples += wxString::Format("%d", example);
-                    else
-                        examples += wxString::Format(", %d", example);
+                    examples += L'…';
+                    break;
                 }
+                else if (examplesCnt == 1)
+                    examples += wxString::Format("%d", example);
+                else
+                    examples += wxString::Format(", %d", example);
             }
         }
 
@@ -932,7 +929,7 @@ void EditingArea::UpdateToTextCtrl(CatalogItemPtr item, int flags)
 {
     if (!(flags & DontTouchText))
     {
-        auto syntax = SyntaxHighlighter::ForItem(*item);
+        auto syntax = SyntaxHighlighter::ForItem(*item, 0xffff, SyntaxHighlighter::Memoize);
         m_textOrig->SetSyntaxHighlighter(syntax);
         if (m_textTrans)
             m_textTrans->SetSyntaxHighlighter(syntax);
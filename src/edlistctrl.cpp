@@ -30,6 +30,8 @@
 #include "language.h"
 #include "cat_sorting.h"
 #include "colorscheme.h"
+#include "concurrency.h"
+#include "perf_trace.h"
 #include "unicode_helpers.h"
 #include "utility.h"
 
@@ -38,6 +40,7 @@
 #include <wx/artprov.h>
 #include <wx/dcmemory.h>
 #include <wx/image.h>
+#include <wx/thread.h>
 #include <wx/wupdlock.h>
 
 #ifdef __WXMSW__
@@ -52,6 +55,9 @@
 #endif
 
 #include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
 
 
 namespace
@@ -76,9 +82,13 @@ public:
             list->SetSelectedCatalogItemIndexes(selection);
         if (focus != -1)
         {
+            // the item may be filtered out now:
             auto item = list->CatalogIndexToListItem(focus);
-            list->EnsureVisible(item);
-            list->SetCurrentItem(item);
+            if (item.IsOk())
+            {
+                list->EnsureVisible(item);
+                list->SetCurrentItem(item);
+            }
         }
     }
 
@@ -251,7 +261,15 @@ PoeditListCtrl::Model::Model(TextDirection appTextDir)
       m_maxVisibleWidth(0),
       m_sourceTextDir(TextDirection::LTR),
       m_transTextDir(TextDirection::LTR),
-      m_appTextDir(appTextDir)
+      m_appTextDir(appTextDir),
+      m_cacheRegistration("list rows",
+                          [this]{ return GetCacheMemoryUsage(); },
+                          [this](CacheRegistry::Pressure)
+                          {
+                              // rows are formatted again as they are shown:
+                              InvalidateCache();
+                              m_cache.shrink_to_fit();
+                          })
 {
     sortOrder = SortOrder::Default();
 }
@@ -268,6 +286,8 @@ void PoeditListCtrl::Model::SetVisualMode(ColorScheme::Mode visualMode)
     m_iconComment = wxArtProvider::GetIcon("ItemCommentTemplate");
     m_iconError = wxArtProvider::GetIcon("StatusError");
     m_iconWarning = wxArtProvider::GetIcon("StatusWarning");
+
+    InvalidateCache();
 }
 
 
@@ -275,8 +295,12 @@ void PoeditListCtrl::Model::SetCatalog(CatalogPtr catalog)
 {
     m_catalog = catalog;
 
+    m_filter.reset();
+    InvalidateCache();
+
     if (!catalog)
     {
+        m_comparator.reset();
         Reset(0);
         return;
     }
@@ -289,7 +313,7 @@ void PoeditListCtrl::Model::SetCatalog(CatalogPtr catalog)
     // sort catalog items, create indexes mapping
     CreateSortMap();
 
-    Reset(catalog->GetCount());
+    Reset((unsigned)m_mapListToCatalog.size());
 }
 
 
@@ -298,7 +322,58 @@ void PoeditListCtrl::Model::UpdateSort()
     if (!m_catalog)
         return;
     CreateSortMap();
-    Reset(m_catalog->GetCount());
+    Reset((unsigned)m_mapListToCatalog.size());
+}
+
+
+void PoeditListCtrl::Model::SetFilter(std::shared_ptr<const std::vector<bool>> filter)
+{
+    m_filter = filter;
+    UpdateSort();
+}
+
+
+void PoeditListCtrl::Model::UpdateSortForItem(int index)
+{
+    if (!m_catalog)
+        return;
+
+    if (!m_comparator || m_mapCatalogToList.size() != m_catalog->GetCount() ||
+        index < 0 || index >= (int)m_mapCatalogToList.size())
+    {
+        UpdateSort();
+        return;
+    }
+
+    // filtered out items stay hidden:
+    if (m_mapCatalogToList[index] == -1)
+        return;
+
+    InvalidateCache(index);
+
+    // Only this item's position may change and the rest of the list remains
+    // sorted, so it can be moved to the right place found by binary search:
+    m_comparator->Update(index);
+
+    auto& order = m_mapListToCatalog;
+    const int oldRow = m_mapCatalogToList[index];
+    order.erase(order.begin() + oldRow);
+    auto pos = std::lower_bound(order.begin(), order.end(), index, std::cref(*m_comparator));
+    const int newRow = int(pos - order.begin());
+    order.insert(pos, index);
+
+    if (newRow == oldRow)
+    {
+        RowChanged(oldRow);
+        return;
+    }
+
+    // only rows between the old and new position were shifted:
+    for (int row = std::min(oldRow, newRow); row <= std::max(oldRow, newRow); row++)
+        m_mapCatalogToList[order[row]] = row;
+
+    RowDeleted(oldRow);
+    RowInserted(newRow);
 }
 
 
@@ -350,100 +425,156 @@ void PoeditListCtrl::Model::GetValueByRow(wxVariant& variant, unsigned row, unsi
         return;
     }
 
-    auto d = Item(row);
-    wxCHECK_RET(d, "invalid row");
+    const int index = CatalogIndex(row);
+    wxCHECK_RET(index != -1, "invalid row");
+    auto& cached = GetCachedRow(index);
 
     switch (col)
     {
         case Col_ID:
-        {
-            variant = wxString::Format("%d", d->GetId());
+            variant = cached.id;
             break;
-        }
 
         case Col_Icon:
         {
-            if (d->HasIssue())
+            switch (cached.icon)
             {
-                switch (d->GetIssue()->severity)
-                {
-                    case CatalogItem::Issue::Error:
-                        variant << m_iconError;
-                        break;
-                    case CatalogItem::Issue::Warning:
-                        variant << m_iconWarning;
-                        break;
-                }
-                break;
+                case CachedRow::Icon_Error:
+                    variant << m_iconError;
+                    break;
+                case CachedRow::Icon_Warning:
+                    variant << m_iconWarning;
+                    break;
+                case CachedRow::Icon_Comment:
+                    variant << m_iconComment;
+                    break;
+                case CachedRow::Icon_None:
+                    NULL_ICON(variant);
+                    break;
             }
-            else if (d->HasComment())
-                variant << m_iconComment;
-            else
-                NULL_ICON(variant);
             break;
         }
 
         case Col_Source:
-        {
-            wxString orig;
-            const auto orig_str = TrimTextValue(d->GetString(), m_maxVisibleWidth);
+            variant = cached.source;
+            break;
+
+        case Col_Translation:
+            variant = cached.translation;
+            break;
+
+        default:
+            variant.Clear();
+            break;
+    };
+}
+
+
+const PoeditListCtrl::Model::CachedRow& PoeditListCtrl::Model::GetCachedRow(int index) const
+{
+    // Formatting is relatively expensive and happens on every repaint of
+    // every visible row, so it is only done once per item until it changes:
+    if (m_cache.size() != m_catalog->GetCount())
+        m_cache.assign(m_catalog->GetCount(), CachedRow());
+
+    auto& cached = m_cache[index];
+    if (!cached.valid)
+    {
+        FormatRow((*m_catalog)[index], cached);
+        cached.valid = true;
+    }
+    return cached;
+}
+
 
-        #ifdef __WXMSW__
-            // Temporary workaround for https://github.com/vslavik/poedit/issues/343 and
-            // https://github.com/vslavik/poedit/issues/481 -- fall back to old style rendering:
-            if (m_appTextDir == TextDirection::RTL && m_sourceTextDir == TextDirection::LTR)
+size_t PoeditListCtrl::Model::GetCacheMemoryUsage() const
+{
+    size_t size = m_cache.capacity() * sizeof(CachedRow);
+    for (auto& row: m_cache)
+    {
+        if (row.valid)
+            size += (row.id.length() + row.source.length() + row.translation.length()) * sizeof(wxChar);
+    }
+    return size;
+}
+
+
+void PoeditListCtrl::Model::FormatRow(const CatalogItemPtr& d, CachedRow& out) const
+{
+    out.id = wxString::Format("%d", d->GetId());
+
+    if (d->HasIssue())
+    {
+        out.icon = d->GetIssue()->severity == CatalogItem::Issue::Error
+                   ? CachedRow::Icon_Error
+                   : CachedRow::Icon_Warning;
+    }
+    else if (d->HasComment())
+        out.icon = CachedRow::Icon_Comment;
+    else
+        out.icon = CachedRow::Icon_None;
+
+    if (d->HasError())
+        out.attr = CachedRow::Attr_Invalid;
+    else if (d->IsFuzzy())
+        out.attr = CachedRow::Attr_Fuzzy;
+    else
+        out.attr = CachedRow::Attr_None;
+
+    // source column:
+    {
+        wxString orig;
+        const auto orig_str = TrimTextValue(d->GetString(), m_maxVisibleWidth);
+
+    #ifdef __WXMSW__
+        // Temporary workaround for https://github.com/vslavik/poedit/issues/343 and
+        // https://github.com/vslavik/poedit/issues/481 -- fall back to old style rendering:
+        if (m_appTextDir == TextDirection::RTL && m_sourceTextDir == TextDirection::LTR)
+        {
+            // non-markup rendering of source column:
+            if (d->HasContext())
+                orig.Printf("[%s] %s", d->GetContext(), orig_str);
+            else
+                orig = orig_str;
+        }
+        else
+    #endif
+        {
+            if (d->HasContext())
             {
-                // non-markup rendering of source column:
-                if (d->HasContext())
-                    orig.Printf("[%s] %s", d->GetContext(), orig_str);
-                else
-                    orig = orig_str;
+                // Work around a problem with GTK+'s coloring of markup that begins with colorizing <span>:
+            #ifdef __WXGTK__
+                #define MARKUP(x) L"\u200B" L##x
+            #else
+                #define MARKUP(x) x
+            #endif
+                orig.Printf(MARKUP("<span bgcolor=\"%s\" color=\"%s\"> %s </span> %s"),
+                    m_clrContextBg, m_clrContextFg,
+                    EscapeMarkup(d->GetContext()), EscapeMarkup(orig_str));
             }
             else
-        #endif
             {
-                if (d->HasContext())
-                {
-                    // Work around a problem with GTK+'s coloring of markup that begins with colorizing <span>:
-                #ifdef __WXGTK__
-                    #define MARKUP(x) L"\u200B" L##x
-                #else
-                    #define MARKUP(x) x
-                #endif
-                    orig.Printf(MARKUP("<span bgcolor=\"%s\" color=\"%s\"> %s </span> %s"),
-                        m_clrContextBg, m_clrContextFg,
-                        EscapeMarkup(d->GetContext()), EscapeMarkup(orig_str));
-                }
-                else
-                {
-                    orig = EscapeMarkup(orig_str);
-                }
+                orig = EscapeMarkup(orig_str);
             }
-
-            // Add RTL Unicode mark to render bidi texts correctly
-            if (m_appTextDir != m_sourceTextDir)
-                variant = bidi::mark_direction(orig, m_sourceTextDir);
-            else
-                variant = orig;
-            break;
         }
 
-        case Col_Translation:
-        {
-            const auto trans = TrimTextValue(d->GetTranslation(), m_maxVisibleWidth);
+        // Add RTL Unicode mark to render bidi texts correctly
+        if (m_appTextDir != m_sourceTextDir)
+            out.source = bidi::mark_direction(orig, m_sourceTextDir);
+        else
+            out.source = orig;
+    }
 
-            // Add RTL Unicode mark to render bidi texts correctly
-            if (m_appTextDir != m_transTextDir)
-                variant = bidi::mark_direction(trans, m_transTextDir);
-            else
-                variant = trans;
-            break;
-        }
+    // translation column:
+    {
+        const auto trans = TrimTextValue(d->GetTranslation(), m_maxVisibleWidth);
 
-        default:
-            variant.Clear();
-            break;
-    };
+        // Add RTL Unicode mark to render bidi texts correctly
+        if (m_appTextDir != m_transTextDir)
+            out.translation = bidi::mark_direction(trans, m_transTextDir);
+        else
+            out.translation = trans;
+    }
 }
 
 bool PoeditListCtrl::Model::SetValueByRow(const wxVariant&, unsigned, unsigned)
@@ -468,21 +599,21 @@ bool PoeditListCtrl::Model::GetAttrByRow(unsigned row, unsigned col, wxDataViewI
         case Col_Source:
         case Col_Translation:
         {
-            auto d = Item(row);
-            if (d->HasError())
-            {
-                attr.SetColour(m_clrInvalid);
-                return true;
-            }
-            else if (d->IsFuzzy())
-            {
-                attr.SetColour(m_clrFuzzy);
-                return true;
-            }
-            else
-            {
+            const int index = CatalogIndex(row);
+            if (index == -1)
                 return false;
+            switch (GetCachedRow(index).attr)
+            {
+                case CachedRow::Attr_Invalid:
+                    attr.SetColour(m_clrInvalid);
+                    return true;
+                case CachedRow::Attr_Fuzzy:
+                    attr.SetColour(m_clrFuzzy);
+                    return true;
+                case CachedRow::Attr_None:
+                    return false;
             }
+            return false;
         }
 
         default:
@@ -491,32 +622,112 @@ bool PoeditListCtrl::Model::GetAttrByRow(unsigned row, unsigned col, wxDataViewI
 }
 
 
+namespace
+{
+
+// Minimum number of items for which sorting is worth splitting between threads
+const size_t PARALLEL_SORT_MIN_ITEMS = 10000;
+
+// Changed rows are repainted at most this often (ms), i.e. once per frame
+const int REFRESH_INTERVAL = 16;
+
+/**
+    Merge sort of @a data using all available cores for large inputs.
+
+    Chunks are sorted in parallel first and then merged pairwise, with the
+    merges of each round also running in parallel. @a comp must be safe to
+    call from multiple threads.
+ */
+template<typename T, typename Compare>
+void ParallelSort(std::vector<T>& data, const Compare& comp)
+{
+    const size_t count = data.size();
+    const size_t jobsCount = (count >= PARALLEL_SORT_MIN_ITEMS && wxThread::IsMain())
+                             ? std::max<size_t>(1, std::thread::hardware_concurrency())
+                             : 1;
+    if (jobsCount == 1)
+    {
+        std::sort(data.begin(), data.end(), std::cref(comp));
+        return;
+    }
+
+    // boundaries of sorted runs:
+    std::vector<size_t> runs;
+    const size_t chunk = (count + jobsCount - 1) / jobsCount;
+    for (size_t start = 0; start < count; start += chunk)
+        runs.push_back(start);
+    runs.push_back(count);
+
+    std::vector<dispatch::future<void>> jobs;
+    for (size_t r = 0; r + 1 < runs.size(); r++)
+    {
+        auto begin = data.begin() + runs[r];
+        auto end = data.begin() + runs[r + 1];
+        jobs.push_back(dispatch::async([begin, end, &comp]{ std::sort(begin, end, std::cref(comp)); }));
+    }
+    for (auto& j: jobs)
+        j.get();
+
+    while (runs.size() > 2)
+    {
+        jobs.clear();
+        std::vector<size_t> merged;
+        size_t r = 0;
+        for (; r + 2 < runs.size(); r += 2)
+        {
+            auto begin = data.begin() + runs[r];
+            auto middle = data.begin() + runs[r + 1];
+            auto end = data.begin() + runs[r + 2];
+            jobs.push_back(dispatch::async([begin, middle, end, &comp]{ std::inplace_merge(begin, middle, end, std::cref(comp)); }));
+            merged.push_back(runs[r]);
+        }
+        // odd run out is carried over to the next round as-is:
+        if (r + 1 < runs.size())
+            merged.push_back(runs[r]);
+        merged.push_back(count);
+
+        for (auto& j: jobs)
+            j.get();
+        runs.swap(merged);
+    }
+}
+
+} // anonymous namespace
+
+
 void PoeditListCtrl::Model::CreateSortMap()
 {
     // FIXME: Use native wxDataViewCtrl sorting instead
 
+    perf::ScopedTimer timer("list sorting");
+
     int count = (int)m_catalog->GetCount();
+    timer.SetItemsCount(count);
 
-    m_mapListToCatalog.resize(count);
-    m_mapCatalogToList.resize(count);
+    // filter that doesn't match the catalog (anymore) is ignored:
+    if (m_filter && m_filter->size() != (size_t)count)
+        m_filter.reset();
 
-    // First create identity mapping for the sort order.
+    m_mapListToCatalog.clear();
+    m_mapListToCatalog.reserve(count);
+    m_mapCatalogToList.assign(count, -1);
+
+    // First create identity mapping for the sort order, containing only
+    // items that pass the filter.
     for ( int i = 0; i < count; i++ )
-        m_mapListToCatalog[i] = i;
+    {
+        if ( !m_filter || (*m_filter)[i] )
+            m_mapListToCatalog.push_back(i);
+    }
 
     // m_mapListToCatalog will hold our desired sort order. Sort it in place
     // now, using the desired sort criteria.
-    CatalogItemsComparator comparator(*m_catalog, sortOrder);
-    std::sort
-    (
-        m_mapListToCatalog.begin(),
-        m_mapListToCatalog.end(),
-        std::ref(comparator)
-    );
+    m_comparator.reset(new CatalogItemsComparator(*m_catalog, sortOrder));
+    ParallelSort(m_mapListToCatalog, *m_comparator);
 
     // Finally, construct m_mapCatalogToList to be the inverse mapping to
-    // m_mapListToCatalog.
-    for ( int i = 0; i < count; i++ )
+    // m_mapListToCatalog, with -1 for filtered out items.
+    for ( int i = 0; i < (int)m_mapListToCatalog.size(); i++ )
         m_mapCatalogToList[m_mapListToCatalog[i]] = i;
 }
 
@@ -524,7 +735,8 @@ void PoeditListCtrl::Model::CreateSortMap()
 
 
 PoeditListCtrl::PoeditListCtrl(wxWindow *parent, wxWindowID id, bool dispIDs)
-     : wxDataViewCtrl(parent, id, wxDefaultPosition, wxDefaultSize, wxDV_MULTIPLE | wxDV_ROW_LINES | wxNO_BORDER, wxDefaultValidator, "translations list")
+     : wxDataViewCtrl(parent, id, wxDefaultPosition, wxDefaultSize, wxDV_MULTIPLE | wxDV_ROW_LINES | wxNO_BORDER, wxDefaultValidator, "translations list"),
+       m_allItemsDirty(false)
 {
     m_displayIDs = dispIDs;
     m_appTextDir = (wxTheApp->GetLayoutDirection() == wxLayout_RightToLeft) ? TextDirection::RTL : TextDirection::LTR;
@@ -562,6 +774,7 @@ PoeditListCtrl::PoeditListCtrl(wxWindow *parent, wxWindowID id, bool dispIDs)
 #endif
 
     Bind(wxEVT_SIZE, &PoeditListCtrl::OnSize, this);
+    m_refreshTimer.Bind(wxEVT_TIMER, [=](wxTimerEvent&){ FlushPendingRefresh(); });
 }
 
 PoeditListCtrl::~PoeditListCtrl()
@@ -667,7 +880,13 @@ void PoeditListCtrl::CreateColumns()
     AppendColumn(m_colTrans);
 
     auto idRenderer = new wxDataViewTextRenderer();
-    m_colID = new DataViewFixedColumn(_("ID"), idRenderer, Model::Col_ID, wxCOL_WIDTH_AUTOSIZE, wxALIGN_RIGHT);
+#ifdef __WXGTK__
+    // fixed height mode (see below) requires all columns to have fixed width
+    const int idWidth = wxDVC_DEFAULT_WIDTH;
+#else
+    const int idWidth = wxCOL_WIDTH_AUTOSIZE;
+#endif
+    m_colID = new DataViewFixedColumn(_("ID"), idRenderer, Model::Col_ID, idWidth, wxALIGN_RIGHT);
     AppendColumn(m_colID);
 
     // wxDVC insists on having an expander column, but we really don't want one:
@@ -680,6 +899,14 @@ void PoeditListCtrl::CreateColumns()
         m_colSource->SetAlignment(wxALIGN_RIGHT);
 #endif
 
+#ifdef __WXGTK__
+    // Otherwise GtkTreeView measures every row whenever the model is reset,
+    // e.g. when sorting or filtering, and when scrolling to a row, which is
+    // very slow with 100k+ items. With all rows of the same height, only
+    // the visible ones are ever measured and rendered.
+    gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(GtkGetTreeView()), TRUE);
+#endif
+
     ColorScheme::SetupWindowColors(this, [=]
     {
     #if !defined(__WXMSW__) && !defined(__WXOSX__)
@@ -755,8 +982,12 @@ void PoeditListCtrl::UpdateColumns()
     m_colID->SetHidden(!m_displayIDs);
 
     // determine best fitting width only once, then set it as fixed, because IDs are immutable
+#ifdef __WXGTK__
+    m_colID->SetWidth(ComputeIdColumnWidth());
+#else
     m_colID->SetWidth(wxCOL_WIDTH_AUTOSIZE);
     FixIdColumnSize();
+#endif
 
     SizeColumns();
 
@@ -777,6 +1008,20 @@ void PoeditListCtrl::FixIdColumnSize()
         m_colID->SetWidth(computed_colID_width);
 }
 
+#ifdef __WXGTK__
+int PoeditListCtrl::ComputeIdColumnWidth() const
+{
+    // autosizing would measure all rows and isn't possible in fixed height mode
+    int maxId = 0;
+    for (auto& item: m_catalog->items())
+        maxId = std::max(maxId, item->GetId());
+
+    const int textWidth = std::max(GetTextExtent(wxString::Format("%d", maxId)).x,
+                                   GetTextExtent(m_colID->GetTitle()).x);
+    return textWidth + PX(16) /* cell and header padding */;
+}
+#endif
+
 void PoeditListCtrl::SizeColumns()
 {
     int w = GetClientSize().x;
@@ -851,13 +1096,84 @@ void PoeditListCtrl::CatalogChanged(const CatalogPtr& catalog)
 
 void PoeditListCtrl::RefreshAllItems()
 {
-    // Can't use Cleared() here because it messes up selection and scroll position
+    m_model->InvalidateCache();
+    m_allItemsDirty = true;
+    ScheduleRefresh();
+}
+
+
+void PoeditListCtrl::RefreshItem(const wxDataViewItem& item)
+{
+    const int index = ListItemToCatalogIndex(item);
+    if (index == -1)
+        return;
+    RefreshItems({index});
+}
+
+
+void PoeditListCtrl::RefreshItems(const std::vector<int>& catalogIndexes)
+{
+    // cached values are discarded immediately, so that any repaint happening
+    // before the scheduled refresh already shows current data:
+    for (auto index: catalogIndexes)
+        m_model->InvalidateCache(index);
+
+    if (!m_allItemsDirty)
+        m_dirtyItems.insert(m_dirtyItems.end(), catalogIndexes.begin(), catalogIndexes.end());
+    ScheduleRefresh();
+}
+
+
+void PoeditListCtrl::ScheduleRefresh()
+{
+    if (!m_refreshTimer.IsRunning())
+        m_refreshTimer.StartOnce(REFRESH_INTERVAL);
+}
+
+
+void PoeditListCtrl::FlushPendingRefresh()
+{
+    const bool all = m_allItemsDirty;
+    std::vector<int> dirty;
+    dirty.swap(m_dirtyItems);
+    m_allItemsDirty = false;
+
     const int count = m_model->GetCount();
+    if (!m_catalog || count == 0)
+        return;
+
+    // Rows outside of the visible range don't need to be notified: the
+    // control asks the model for their values when they are scrolled into
+    // view and the model's cache was already invalidated for them.
+    int first = GetTopItem().IsOk() ? (int)m_model->GetRow(GetTopItem()) : 0;
+    if (first < 0 || first >= count)
+        first = 0;
+    const int last = std::min(count, first + GetCountPerPage() + 1);
+
+    // Can't use Cleared() here because it messes up selection and scroll position
     wxDataViewItemArray items;
-    items.reserve(count);
-    for (int i = 0; i < count; i++)
-        items.push_back(m_model->GetItem(i));
-    m_model->ItemsChanged(items);
+    if (all)
+    {
+        items.reserve(last - first);
+        for (int row = first; row < last; row++)
+            items.push_back(m_model->GetItem(row));
+    }
+    else
+    {
+        std::sort(dirty.begin(), dirty.end());
+        dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+        for (auto index: dirty)
+        {
+            const int row = m_model->RowFromCatalogIndex(index);
+            if (row >= first && row < last)
+                items.push_back(m_model->GetItem(row));
+        }
+    }
+
+    if (items.size() == 1)
+        m_model->ItemChanged(items.front());
+    else if (!items.empty())
+        m_model->ItemsChanged(items);
 }
 
 
@@ -871,6 +1187,43 @@ void PoeditListCtrl::Sort()
 }
 
 
+void PoeditListCtrl::SetFilter(std::shared_ptr<const std::vector<bool>> filter)
+{
+    if (!m_catalog)
+        return;
+
+    wxWindowUpdateLocker lock(this);
+    SelectionPreserver preserve(this);
+    m_model->SetFilter(filter);
+}
+
+
+void PoeditListCtrl::SortItem(const CatalogItemPtr& item)
+{
+    if (!m_catalog || !item)
+        return;
+
+    auto listItem = CatalogItemToListItem(item);
+    if (!listItem.IsOk())
+        return;
+
+    // nothing can move when sorted purely by file order:
+    auto& order = sortOrder();
+    if (order.by == SortOrder::By_FileOrder && !order.errorsFirst && !order.untransFirst)
+    {
+        RefreshItem(listItem);
+        return;
+    }
+
+    const int index = ListItemToCatalogIndex(listItem);
+    if (index == -1)
+        return;
+
+    SelectionPreserver preserve(this);
+    m_model->UpdateSortForItem(index);
+}
+
+
 void PoeditListCtrl::OnSize(wxSizeEvent& event)
 {
     wxWindowUpdateLocker lock(this);
@@ -29,12 +29,14 @@
 
 #include <wx/dataview.h>
 #include <wx/frame.h>
+#include <wx/timer.h>
 
 #include <vector>
 
 class WXDLLIMPEXP_FWD_CORE wxListCtrl;
 class WXDLLIMPEXP_FWD_CORE wxListEvent;
 
+#include "cache_registry.h"
 #include "catalog.h"
 #include "cat_sorting.h"
 #include "colorscheme.h"
@@ -51,6 +53,22 @@ class PoeditListCtrl : public wxDataViewCtrl
         /// Re-sort the control according to user-specified criteria.
         void Sort();
 
+        /**
+            Moves @a item to its correct position after its state changed
+            (e.g. it was translated or QA issues changed), without resorting
+            the whole list.
+         */
+        void SortItem(const CatalogItemPtr& item);
+
+        /**
+            Only shows items for which @a filter, indexed by position in the
+            catalog, is true. Pass nullptr to show all items again.
+         */
+        void SetFilter(std::shared_ptr<const std::vector<bool>> filter);
+
+        /// Returns true if some items are hidden by SetFilter()
+        bool IsFiltered() const { return m_model->IsFiltered(); }
+
         void SizeColumns();
 
         void SetDisplayLines(bool dl);
@@ -73,14 +91,15 @@ class PoeditListCtrl : public wxDataViewCtrl
             return m_model->RowFromCatalogIndex(index);
         }
 
+        /// Returns invalid item if the item isn't shown in the list (see SetFilter())
         wxDataViewItem CatalogIndexToListItem(int index) const
         {
-            return m_model->GetItem(m_model->RowFromCatalogIndex(index));
+            return ListIndexToListItem(m_model->RowFromCatalogIndex(index));
         }
 
         wxDataViewItem CatalogItemToListItem(const CatalogItemPtr& item) const
         {
-            return m_model->GetItem(m_model->RowFromCatalogItem(item));
+            return ListIndexToListItem(m_model->RowFromCatalogItem(item));
         }
 
         /// Returns item's index in the catalog
@@ -136,23 +155,14 @@ class PoeditListCtrl : public wxDataViewCtrl
         {
             wxDataViewItemArray sel;
             for (auto i: selection)
-                sel.push_back(CatalogIndexToListItem(i));
+            {
+                auto item = CatalogIndexToListItem(i);
+                if (item.IsOk()) // may be filtered out
+                    sel.push_back(item);
+            }
             SetSelections(sel);
         }
 
-        // Perform given function for all selected items. The function takes
-        // reference to the item as its argument. Also refresh the items touched,
-        // on the assumption that the operation modifies them.
-        template<typename T>
-        void ForSelectedCatalogItemsDo(T func)
-        {
-            wxDataViewItemArray sel;
-            GetSelections(sel);
-            for (auto item: sel)
-                func(*ListItemToCatalogItem(item));
-            m_model->ItemsChanged(sel);
-        }
-
         void SelectOnly(const wxDataViewItem& item)
         {
             wxDataViewItemArray sel;
@@ -197,12 +207,17 @@ class PoeditListCtrl : public wxDataViewCtrl
         /// Returns true if more than one item are selected.
         bool HasMultipleSelection() const { return GetSelectedItemsCount() > 1; }
 
-        void RefreshAllItems();
+        /**
+            Refreshes display of changed items.
 
-        void RefreshItem(const wxDataViewItem& item)
-        {
-            m_model->ItemChanged(item);
-        }
+            Refreshes are coalesced and happen at most once per frame; only
+            the rows currently visible are repainted, the others are updated
+            when they are scrolled into view.
+         */
+        void RefreshAllItems();
+        void RefreshItem(const wxDataViewItem& item);
+        /// Refreshes items at given positions in the catalog.
+        void RefreshItems(const std::vector<int>& catalogIndexes);
 
         int GetCurrentItemListIndex()
         {
@@ -245,6 +260,9 @@ class PoeditListCtrl : public wxDataViewCtrl
 
             void SetCatalog(CatalogPtr catalog);
             void UpdateSort();
+            void UpdateSortForItem(int index);
+            void SetFilter(std::shared_ptr<const std::vector<bool>> filter);
+            bool IsFiltered() const { return m_filter != nullptr; }
 
             unsigned int GetColumnCount() const override { return Col_Max; }
             wxString GetColumnType( unsigned int col ) const override;
@@ -296,23 +314,63 @@ class PoeditListCtrl : public wxDataViewCtrl
             void Freeze() { m_frozen = true; }
             void Thaw() { m_frozen = false; }
 
-            void SetMaxVisibleWidth(int chars) { m_maxVisibleWidth = chars; }
+            void SetMaxVisibleWidth(int chars)
+            {
+                if (chars != m_maxVisibleWidth)
+                    InvalidateCache();
+                m_maxVisibleWidth = chars;
+            }
+
+            /// Discards cached display values of the item at catalog @a index.
+            void InvalidateCache(int index)
+            {
+                if (index >= 0 && index < (int)m_cache.size())
+                    m_cache[index].valid = false;
+            }
+
+            /// Discards all cached display values.
+            void InvalidateCache() { m_cache.clear(); }
 
         public:
             CatalogPtr m_catalog;
             SortOrder sortOrder;
 
         private:
+            /// Formatted values of a row, as shown in the list
+            struct CachedRow
+            {
+                enum Icon : uint8_t { Icon_None, Icon_Comment, Icon_Warning, Icon_Error };
+                enum Attr : uint8_t { Attr_None, Attr_Fuzzy, Attr_Invalid };
+
+                bool valid = false;
+                Icon icon = Icon_None;
+                Attr attr = Attr_None;
+                wxString id, source, translation;
+            };
+
+            /// Returns display values of item at catalog @a index, formatting them if needed.
+            const CachedRow& GetCachedRow(int index) const;
+            void FormatRow(const CatalogItemPtr& d, CachedRow& out) const;
+            size_t GetCacheMemoryUsage() const;
+
             bool m_frozen;
             int m_maxVisibleWidth;
+            // formatted rows, indexed by position in catalog:
+            mutable std::vector<CachedRow> m_cache;
             std::vector<int> m_mapListToCatalog;
             std::vector<int> m_mapCatalogToList;
+            // comparator used for the current sort map, kept for incremental updates:
+            std::unique_ptr<CatalogItemsComparator> m_comparator;
+            // items to show, indexed by position in catalog (all if nullptr):
+            std::shared_ptr<const std::vector<bool>> m_filter;
 
             TextDirection m_sourceTextDir, m_transTextDir, m_appTextDir;
 
             wxColour m_clrID, m_clrInvalid, m_clrFuzzy;
             wxString m_clrContextFg, m_clrContextBg;
             wxIcon m_iconComment, m_iconError, m_iconWarning;
+
+            CacheRegistry::Registration m_cacheRegistration;
         };
 
 
@@ -320,7 +378,12 @@ class PoeditListCtrl : public wxDataViewCtrl
         void CreateColumns();
         void UpdateColumns();
         void FixIdColumnSize();
+#ifdef __WXGTK__
+        int ComputeIdColumnWidth() const;
+#endif
         void OnSize(wxSizeEvent& event);
+        void ScheduleRefresh();
+        void FlushPendingRefresh();
 
         bool m_displayIDs;
         TextDirection m_appTextDir;
@@ -329,6 +392,11 @@ class PoeditListCtrl : public wxDataViewCtrl
 
         CatalogPtr m_catalog;
         wxObjectDataPtr<Model> m_model;
+
+        // catalog indexes of items changed since the last refresh:
+        std::vector<int> m_dirtyItems;
+        bool m_allItemsDirty;
+        wxTimer m_refreshTimer;
 };
 
 #endif // Poedit_edlistctrl_h
@@ -30,15 +30,90 @@
 
 #include <wx/intl.h>
 
+#include <string>
+
 namespace
 {
 
-inline std::string fmt_trans(const wxString& s)
+/**
+    Writes HTML output through a large memory buffer.
+
+    Text is converted to UTF-8 and escaped in a single pass directly into the
+    buffer, which is written to the underlying stream in big blocks, so that
+    memory use stays bounded even for huge catalogs.
+ */
+class HTMLWriter
 {
-    wxString out = EscapeMarkup(s);
-    out.Replace("\n", "\n<br>");
-    return str::to_utf8(out);
-}
+public:
+    explicit HTMLWriter(std::ostream& f) : m_out(f)
+    {
+        m_buffer.reserve(BUFFER_SIZE + BUFFER_SIZE / 4);
+    }
+
+    ~HTMLWriter() { flush(); }
+
+    HTMLWriter& operator<<(const char *s)
+    {
+        m_buffer.append(s);
+        return *this;
+    }
+
+    HTMLWriter& operator<<(const std::string& s)
+    {
+        m_buffer.append(s);
+        return *this;
+    }
+
+    HTMLWriter& operator<<(int i)
+    {
+        m_buffer.append(std::to_string(i));
+        return *this;
+    }
+
+    /// Appends escaped version of translatable text, with line breaks preserved
+    void text(const wxString& s)
+    {
+        str::to_utf8(s, m_utf8);
+        const char *run = m_utf8.data();
+        const char *end = run + m_utf8.size();
+        for (const char *p = run; p != end; ++p)
+        {
+            const char *replacement;
+            switch (*p)
+            {
+                case '&':  replacement = "&amp;";    break;
+                case '<':  replacement = "&lt;";     break;
+                case '>':  replacement = "&gt;";     break;
+                case '\n': replacement = "\n<br>";  break;
+                default:   continue;
+            }
+            m_buffer.append(run, p);
+            m_buffer.append(replacement);
+            run = p + 1;
+        }
+        m_buffer.append(run, end);
+    }
+
+    /// Writes buffer content to the stream if it grew large enough
+    void maybe_flush()
+    {
+        if (m_buffer.size() >= BUFFER_SIZE)
+            flush();
+    }
+
+    void flush()
+    {
+        m_out.write(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+    }
+
+private:
+    static const size_t BUFFER_SIZE = 256 * 1024;
+
+    std::ostream& m_out;
+    std::string m_buffer;
+    std::string m_utf8; // reused by text() for conversions
+};
 
 template<typename T1, typename T2>
 inline void TableRow(std::ostream& f, const T1& col1, const T2& col2)
@@ -53,7 +128,7 @@ extern const char *CSS_STYLE;
 
 } // anonymous namespace
 
-void Catalog::ExportToHTML(std::ostream& f)
+void Catalog::ExportToHTML(std::ostream& f, const HTMLExportOptions& options)
 {
     const bool translated = HasCapability(Catalog::Cap::Translations);
     const auto lang = translated ? GetLanguage() : Language();
@@ -87,7 +162,17 @@ void Catalog::ExportToHTML(std::ostream& f)
         int fuzzy = 0;
         int untranslated = 0;
         int unfinished = 0;
-        GetStatistics(&all, &fuzzy, nullptr, &untranslated, &unfinished);
+        if (options.all >= 0)
+        {
+            all = options.all;
+            fuzzy = options.fuzzy;
+            untranslated = options.untranslated;
+            unfinished = fuzzy + untranslated;
+        }
+        else
+        {
+            GetStatistics(&all, &fuzzy, nullptr, &untranslated, &unfinished);
+        }
         int percent = (all == 0 ) ? 0 : (100 * (all - unfinished) / all);
 
         f << "<div class='stats'>\n"
@@ -108,7 +193,7 @@ void Catalog::ExportToHTML(std::ostream& f)
     }
     else
     {
-        int all = (int)items().size();
+        int all = options.all >= 0 ? options.all : (int)items().size();
         f << "<div class='stats'>\n"
           << "  <div class='graph'>\n"
           << "    <div class='percent-untrans' style='width: 100%'>&nbsp;</div>\n"
@@ -157,89 +242,125 @@ void Catalog::ExportToHTML(std::ostream& f)
          "  </thead>\n"
          "  <tbody>\n";
 
+    HTMLWriter out(f);
+
     for (auto& item: items())
     {
         bool hasComments = item->HasComment() || item->HasExtractedComments();
 
-        std::string klass("i");
+        out << "<tr class='i";
         if (!item->IsTranslated())
-            klass += " untrans";
+            out << " untrans";
         if (item->IsFuzzy())
-            klass += " fuzzy";
+            out << " fuzzy";
         if (hasComments)
-            klass += " with-comments";
-        f << "<tr class='" << klass << "'>\n";
+            out << " with-comments";
+        out << "'>\n";
 
         // Source string:
-        f << "<td class='src' " << lang_src << ">\n";
+        out << "<td class='src' " << lang_src << ">\n";
         if (item->HasSymbolicId())
-            f << " <div class='id'>" << fmt_trans(item->GetSymbolicId()) << "</div>";
+        {
+            out << " <div class='id'>";
+            out.text(item->GetSymbolicId());
+            out << "</div>";
+        }
         if (item->HasContext())
-            f << " <span class='msgctxt'>" << fmt_trans(item->GetContext()) << "</span>";
+        {
+            out << " <span class='msgctxt'>";
+            out.text(item->GetContext());
+            out << "</span>";
+        }
         if (item->HasPlural())
         {
-            f << "<ol class='plurals'>\n"
-              << "  <li>" << fmt_trans(item->GetString()) << "</li>\n"
-              << "  <li>" << fmt_trans(item->GetPluralString()) << "</li>\n"
-              << "</ol>\n";
+            out << "<ol class='plurals'>\n"
+                << "  <li>";
+            out.text(item->GetString());
+            out << "</li>\n"
+                << "  <li>";
+            out.text(item->GetPluralString());
+            out << "</li>\n"
+                << "</ol>\n";
         }
         else
         {
-            f << fmt_trans(item->GetString());
+            out.text(item->GetString());
         }
-        f << "</td>\n";
+        out << "</td>\n";
 
         // Translation:
         if (translated)
         {
-            f << "<td class='tra' " << lang_tra << ">\n";
+            out << "<td class='tra' " << lang_tra << ">\n";
             if (item->HasPlural())
             {
                 if (item->IsTranslated())
                 {
-                    f << "<ol class='plurals'>\n";
-                    for (auto t: item->GetTranslations())
-                        f << "  <li>" << fmt_trans(t) << "</li>\n";
-                    f << "</ol>\n";
+                    out << "<ol class='plurals'>\n";
+                    for (auto& t: item->GetTranslations())
+                    {
+                        out << "  <li>";
+                        out.text(t);
+                        out << "</li>\n";
+                    }
+                    out << "</ol>\n";
                 }
             }
             else
             {
-                f << fmt_trans(item->GetTranslation());
+                out.text(item->GetTranslation());
             }
-            f << "</td>\n";
+            out << "</td>\n";
         }
 
         // Notes, if present:
         if (hasComments)
         {
-            f << "</tr>\n"
-              << "<tr class='comments'>\n"
-              << "  <td colspan='" << (translated ? 2 : 1) << "'><div>";
+            out << "</tr>\n"
+                << "<tr class='comments'>\n"
+                << "  <td colspan='" << (translated ? 2 : 1) << "'><div>";
             if (item->HasExtractedComments())
             {
-                f << "<p>\n";
+                out << "<p>\n";
                 for (auto& n: item->GetExtractedComments())
-                    f << fmt_trans(n) << "<br>\n";
-                f << "</p>\n";
+                {
+                    out.text(n);
+                    out << "<br>\n";
+                }
+                out << "</p>\n";
             }
             if (item->HasComment())
             {
-                f << "<p>\n"
-                  << fmt_trans(item->GetComment())
-                  << "</p>\n";
+                out << "<p>\n";
+                out.text(item->GetComment());
+                out << "</p>\n";
             }
-            f << "</div></td>\n";
+            out << "</div></td>\n";
         }
 
-        f << "</tr>\n";
+        out << "</tr>\n";
+        out.maybe_flush();
     }
 
-    f << "</tbody>\n"
-         "</table>\n"
-         "</div>\n"
-         "</body>\n"
-         "</html>\n";
+    out << "</tbody>\n"
+           "</table>\n";
+
+    if (options.truncated)
+    {
+        const int shown = (int)items().size();
+        wxString note;
+        if (options.all > shown)
+            note = wxString::Format(_("Only the first %d of %d entries are shown."), shown, options.all);
+        else
+            note = wxString::Format(wxPLURAL("Only the first %d entry is shown.", "Only the first %d entries are shown.", shown), shown);
+        out << "<div class='truncated'>";
+        out.text(note);
+        out << "</div>\n";
+    }
+
+    out << "</div>\n"
+           "</body>\n"
+           "</html>\n";
 }
 
 
@@ -362,6 +483,12 @@ tr.comments td { padding-top: 0; }
   margin-right: 4px;
 }
 
+.truncated {
+  font-size: smaller;
+  padding: 12px 0;
+  text-align: center;
+}
+
 
 /* Colors */
 
@@ -371,6 +498,7 @@ body { background-color: #fff; color: #333; }
 .percent-fuzzy   { background-color: rgb(255, 149, 0); height: 10px; }
 .percent-untrans { background-color: #F1F1F1; height: 10px; }
 .legend          { color: #aaa; }
+.truncated       { color: #aaa; }
 .id              { color: #aaa; }
 tr.comments div  { color: #aaa; }
 .fuzzy .tra      { color: rgb(230, 134, 0); }
@@ -382,6 +510,7 @@ tr.comments div  { color: #aaa; }
     body             { background-color: rgb(45, 42, 41); color: #eee; }
     .percent-untrans { background-color: rgba(255, 255, 255, 0.3); }
     .legend          { color: rgba(255, 255, 255, 0.6); }
+    .truncated       { color: rgba(255, 255, 255, 0.6); }
     .id              { color: rgba(255, 255, 255, 0.6); }
     tr.comments div  { color: rgba(255, 255, 255, 0.6); }
     .fuzzy .tra      { color: rgb(253, 178, 72); }
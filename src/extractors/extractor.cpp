@@ -27,13 +27,34 @@
 
 #include "extractor_legacy.h"
 
+#include "concurrency.h"
 #include "gexecute.h"
+#include "perf_trace.h"
+#include "progressinfo.h"
+#include "version.h"
 
 #include <wx/dir.h>
+#include <wx/file.h>
 #include <wx/filename.h>
+#include <wx/log.h>
 #include <wx/textfile.h>
+#include <wx/thread.h>
+
+#ifdef __UNIX__
+    #include <dirent.h>
+    #include <errno.h>
+    #include <sys/stat.h>
+#endif
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <string_view>
+#include <thread>
 
 namespace
 {
@@ -44,13 +65,24 @@ struct PathToMatch
 {
     wxString path;
     bool isWildcard;
+    // for wildcards, the literal part before the first wildcard character;
+    // for plain paths, the prefix files in the directory start with:
+    wxString prefix;
+
+    PathToMatch(const wxString& p) : path(p), isWildcard(wxIsWild(p))
+    {
+        if (isWildcard)
+            prefix = path.substr(0, path.find_first_of("*?["));
+        else
+            prefix = path + "/";
+    }
 
     bool MatchesFile(const wxString& fn) const
     {
         if (isWildcard)
-            return wxMatchWild(path, fn);
+            return fn.starts_with(prefix) && wxMatchWild(path, fn);
         else
-            return fn == path || fn.starts_with(path + "/");
+            return fn == path || fn.starts_with(prefix);
     }
 };
 
@@ -62,7 +94,7 @@ public:
     {
         paths.reserve(a.size());
         for (auto& p: a)
-            paths.push_back({p, wxIsWild(p)});
+            paths.emplace_back(p);
     }
 
     bool MatchesFile(const wxString& fn) const
@@ -87,81 +119,353 @@ inline void CheckReadPermissions(const wxString& basepath, const wxString& path)
     }
 }
 
+// Minimum number of files worth running a separate extraction process for
+const size_t MIN_FILES_PER_SHARD = 100;
+
 inline bool IsVCSDir(const wxString& d)
 {
     return d == ".git" || d == ".svn" || d == ".hg" || d == ".bzr" || d == "CVS";
 }
 
 
-int FindInDir(const wxString& basepath, const wxString& dirname, const PathsToMatch& excludedPaths,
-              Extractor::FilesList& output)
+/**
+    Finds files in a directory tree, walking subdirectories in parallel.
+
+    Subdirectories found are put into a shared queue that all workers take
+    work from, so that unbalanced trees are still processed efficiently.
+ */
+class SourceTreeWalker
 {
-    if (dirname.empty())
-        return 0;
+public:
+    SourceTreeWalker(const wxString& basepath, const PathsToMatch& excludedPaths,
+                     const Extractor::FileFilter& filter,
+                     dispatch::cancellation_token_ptr cancellationToken)
+        : m_basepath(basepath), m_excludedPaths(excludedPaths), m_filter(filter),
+          m_cancellationToken(cancellationToken)
+    {}
+
+    /// Adds files found in @a dirname to @a output, returns their count
+    int Walk(const wxString& dirname, Extractor::FilesList& output)
+    {
+        if (dirname.empty())
+            return 0;
 
-    wxDir dir(basepath + dirname);
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<wxString> pending{dirname};
+        int busy = 0;
+        std::exception_ptr error;
 
-    CheckReadPermissions(basepath, dirname);
+        auto worker = [&]() -> Extractor::FilesList
+        {
+            Extractor::FilesList found;
+            std::vector<wxString> subdirs;
+            for (;;)
+            {
+                wxString dir;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cond.wait(lock, [&]{ return error || !pending.empty() || busy == 0; });
+                    if (error || pending.empty())
+                        break;
+                    dir = std::move(pending.front());
+                    pending.pop_front();
+                    busy++;
+                }
+
+                subdirs.clear();
+                try
+                {
+                    if (m_cancellationToken && m_cancellationToken->is_cancelled())
+                        throw ExtractionException(ExtractionError::Cancelled);
+                    ProcessDir(dir, found, subdirs);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error)
+                        error = std::current_exception();
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    busy--;
+                    for (auto& d: subdirs)
+                        pending.push_back(std::move(d));
+                }
+                cond.notify_all();
+            }
+            return found;
+        };
+
+        const size_t jobsCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+        std::vector<dispatch::future<Extractor::FilesList>> jobs;
+        for (size_t i = 1; i < jobsCount; i++)
+            jobs.push_back(dispatch::async(worker));
+
+        std::vector<Extractor::FilesList> results;
+        results.push_back(worker());
+        for (auto& j: jobs)
+            results.push_back(j.get());
+
+        if (error)
+            std::rethrow_exception(error);
 
-    if (!dir.IsOpened())
-        return 0;
+        int count = 0;
+        for (auto& r: results)
+        {
+            count += (int)r.size();
+            std::move(r.begin(), r.end(), std::back_inserter(output));
+        }
+        return count;
+    }
 
-    bool cont;
-    wxString iter;
-    int found = 0;
-    
-    cont = dir.GetFirst(&iter, wxEmptyString, wxDIR_FILES);
-    while (cont)
+private:
+    wxString MakeFullPath(const wxString& dirname, const wxString& filename) const
     {
-        const wxString filename = iter;
-        const wxString fullpath = (dirname == ".") ? filename : dirname + "/" + filename;
-        cont = dir.GetNext(&iter);
+        return (dirname == ".") ? filename : dirname + "/" + filename;
+    }
 
-        if (excludedPaths.MatchesFile(fullpath))
-            continue;
+    // Checks the (cheap) filter; done first to avoid unnecessary syscalls
+    bool IsWanted(const wxString& fullpath) const
+    {
+        return !m_filter || m_filter(fullpath);
+    }
 
-        // Normally, a file enumerated by wxDir exists, but in one special case, it may
-        // not: if it is a broken symlink. FileExists() follows the symlink to check.
-        if (!wxFileName::FileExists(basepath + fullpath))
-            continue;
-        
-        CheckReadPermissions(basepath, fullpath);
+    // Handles a file found in the tree that passed IsWanted()
+    void AddFile(const wxString& fullpath, Extractor::FilesList& output) const
+    {
+        if (m_excludedPaths.MatchesFile(fullpath))
+            return;
+
+        CheckReadPermissions(m_basepath, fullpath);
         wxLogTrace("poedit.extractor", "  - %s", fullpath);
         output.push_back(fullpath);
-        found++;
     }
 
-    cont = dir.GetFirst(&iter, wxEmptyString, wxDIR_DIRS);
-    while (cont)
+    // Handles a subdirectory found in the tree
+    void AddDir(const wxString& filename, const wxString& fullpath, std::vector<wxString>& subdirs) const
     {
-        const wxString filename = iter;
-        const wxString fullpath = (dirname == ".") ? filename : dirname + "/" + filename;
-        cont = dir.GetNext(&iter);
-
         if (IsVCSDir(filename))
-            continue;
+            return;
+        if (m_excludedPaths.MatchesFile(fullpath))
+            return;
+        subdirs.push_back(fullpath);
+    }
 
-        if (excludedPaths.MatchesFile(fullpath))
-            continue;
+#ifdef __UNIX__
+    void ProcessDir(const wxString& dirname, Extractor::FilesList& files, std::vector<wxString>& subdirs) const
+    {
+        const wxString dirpath = m_basepath + dirname;
+        std::unique_ptr<DIR, int(*)(DIR*)> dir(opendir(dirpath.fn_str()), &closedir);
+        if (!dir)
+        {
+            if (errno == EACCES)
+                throw ExtractionException(ExtractionError::PermissionDenied);
+            return;
+        }
 
-        CheckReadPermissions(basepath, fullpath);
-        found += FindInDir(basepath, fullpath, excludedPaths, output);
+        while (struct dirent *entry = readdir(dir.get()))
+        {
+            // skip ".", ".." and hidden files, like wxDir does
+            if (entry->d_name[0] == '.')
+                continue;
+
+            const wxString filename(entry->d_name, *wxConvFileName);
+            const wxString fullpath = MakeFullPath(dirname, filename);
+
+            bool isDir = entry->d_type == DT_DIR;
+            bool isFile = entry->d_type == DT_REG;
+            if (isFile && !IsWanted(fullpath))
+                continue;
+            if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN)
+            {
+                // the type is only known after following the symlink (which may
+                // be broken) or isn't reported by the filesystem at all:
+                struct stat st;
+                if (stat((m_basepath + fullpath).fn_str(), &st) != 0)
+                    continue;
+                isDir = S_ISDIR(st.st_mode);
+                isFile = S_ISREG(st.st_mode) && IsWanted(fullpath);
+            }
+
+            if (isFile)
+                AddFile(fullpath, files);
+            else if (isDir)
+                AddDir(filename, fullpath, subdirs);
+        }
     }
+#else // !__UNIX__
+    void ProcessDir(const wxString& dirname, Extractor::FilesList& files, std::vector<wxString>& subdirs) const
+    {
+        wxDir dir(m_basepath + dirname);
 
-    return found;
-}
+        CheckReadPermissions(m_basepath, dirname);
 
-} // anonymous namespace
+        if (!dir.IsOpened())
+            return;
+
+        bool cont;
+        wxString iter;
+
+        cont = dir.GetFirst(&iter, wxEmptyString, wxDIR_FILES);
+        while (cont)
+        {
+            const wxString fullpath = MakeFullPath(dirname, iter);
+            cont = dir.GetNext(&iter);
+
+            if (!IsWanted(fullpath))
+                continue;
+
+            // Normally, a file enumerated by wxDir exists, but in one special case, it may
+            // not: if it is a broken symlink. FileExists() follows the symlink to check.
+            if (!wxFileName::FileExists(m_basepath + fullpath))
+                continue;
+
+            AddFile(fullpath, files);
+        }
+
+        cont = dir.GetFirst(&iter, wxEmptyString, wxDIR_DIRS);
+        while (cont)
+        {
+            const wxString filename = iter;
+            cont = dir.GetNext(&iter);
+            AddDir(filename, MakeFullPath(dirname, filename), subdirs);
+        }
+    }
+#endif // __UNIX__/!__UNIX__
+
+    const wxString m_basepath;
+    const PathsToMatch& m_excludedPaths;
+    const Extractor::FileFilter& m_filter;
+    dispatch::cancellation_token_ptr m_cancellationToken;
+};
+
+
+/// Enables or disables logging on the current thread for the scope's lifetime
+class LoggingScope
+{
+public:
+    explicit LoggingScope(bool enable) : m_previous(wxLog::EnableLogging(enable)) {}
+    ~LoggingScope() { wxLog::EnableLogging(m_previous); }
+
+private:
+    bool m_previous;
+};
 
 
-Extractor::FilesList Extractor::CollectAllFiles(const SourceCodeSpec& sources)
+wxString gs_extractionCacheDir;
+
+/**
+    Persistent per-project cache of files' extraction results.
+
+    Each source file's sub-POT is stored under a name derived from the
+    extractor's signature, the file's path and its content, so that a
+    fragment found in the cache is always valid for the file as it is now.
+
+    Methods may be called from multiple threads.
+ */
+class ExtractionCache
 {
-    // TODO: Only collect files with recognized extensions
+public:
+    explicit ExtractionCache(const SourceCodeSpec& sources)
+    {
+        if (gs_extractionCacheDir.empty())
+            return;
+
+        wxFileName base = wxFileName::DirName(sources.BasePath);
+        base.Normalize(wxPATH_NORM_DOTS | wxPATH_NORM_ABSOLUTE);
+        const auto hash = std::hash<std::wstring>()(base.GetFullPath().ToStdWstring());
+        auto dir = wxString::Format("%s%c%016llx", gs_extractionCacheDir, wxFILE_SEP_PATH, (unsigned long long)hash);
+
+        if (!wxFileName::DirExists(dir) && !wxFileName::Mkdir(dir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL))
+            return;
+        m_dir = dir;
+        m_basePath = sources.BasePath;
+    }
+
+    bool IsOk() const { return !m_dir.empty(); }
+
+    /**
+        Returns filename of the cached fragment for @a file, which may not
+        exist yet, or empty string if the file can't be read.
+     */
+    wxString GetFragmentFileName(const wxString& signature, const wxString& file) const
+    {
+        std::string content;
+        {
+            wxLogNull null;
+            wxFile f;
+            if (!f.Open(m_basePath + file))
+                return wxString();
+            const auto len = f.Length();
+            if (len < 0)
+                return wxString();
+            content.resize((size_t)len);
+            if (len > 0 && f.Read(&content[0], (size_t)len) != (ssize_t)len)
+                return wxString();
+        }
 
+        const auto keyHash = std::hash<std::wstring>()((POEDIT_VERSION "\n" + signature + "\n" + file).ToStdWstring());
+        const auto contentHash = std::hash<std::string_view>()(std::string_view(content));
+        return wxString::Format("%s%c%016llx-%016llx.pot",
+                                m_dir, wxFILE_SEP_PATH,
+                                (unsigned long long)keyHash, (unsigned long long)contentHash);
+    }
+
+    /// Moves freshly extracted @a pot into the cache as @a fragment, returns file to use.
+    wxString Store(const wxString& pot, const wxString& fragment)
+    {
+        wxLogNull null;
+        return wxRenameFile(pot, fragment, /*overwrite=*/true) ? fragment : pot;
+    }
+
+    /// Records that @a fragment is still in use, see RemoveUnused().
+    void MarkUsed(const wxString& fragment)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_used.insert(fragment);
+    }
+
+    /// Removes fragments not used in this extraction (i.e. of changed or deleted files)
+    void RemoveUnused()
+    {
+        wxLogNull null;
+        wxDir dir(m_dir);
+        if (!dir.IsOpened())
+            return;
+
+        std::vector<wxString> unused;
+        wxString name;
+        for (bool cont = dir.GetFirst(&name, "*.pot", wxDIR_FILES); cont; cont = dir.GetNext(&name))
+        {
+            auto path = m_dir + wxFILE_SEP_PATH + name;
+            if (m_used.find(path) == m_used.end())
+                unused.push_back(path);
+        }
+
+        wxLogTrace("poedit.extractor", "removing %d stale cached fragments", (int)unused.size());
+        for (auto& path: unused)
+            wxRemoveFile(path);
+    }
+
+private:
+    wxString m_dir, m_basePath;
+    std::mutex m_mutex;
+    std::set<wxString> m_used;
+};
+
+} // anonymous namespace
+
+
+Extractor::FilesList Extractor::CollectAllFiles(const SourceCodeSpec& sources, const FileFilter& filter,
+                                                dispatch::cancellation_token_ptr cancellationToken)
+{
     wxLogTrace("poedit.extractor", "collecting files:");
 
     const auto basepath = sources.BasePath;
     const auto excludedPaths = PathsToMatch(sources.ExcludedPaths);
+    SourceTreeWalker walker(basepath, excludedPaths, filter, cancellationToken);
 
     FilesList output;
 
@@ -180,7 +484,7 @@ Extractor::FilesList Extractor::CollectAllFiles(const SourceCodeSpec& sources)
         }
         else if (wxFileName::DirExists(basepath + path))
         {
-            if (!FindInDir(basepath, path, excludedPaths, output))
+            if (!walker.Walk(path, output))
             {
                 wxLogTrace("poedit.extractor", "no files found in '%s'", path);
             }
@@ -205,23 +509,45 @@ Extractor::FilesList Extractor::CollectAllFiles(const SourceCodeSpec& sources)
 
 wxString Extractor::ExtractWithAll(TempDirectory& tmpdir,
                                    const SourceCodeSpec& sourceSpec,
-                                   const std::vector<wxString>& files_)
+                                   const std::vector<wxString>& files)
+{
+    auto subPots = ExtractSubPOTs(tmpdir, sourceSpec, files);
+    if (subPots.size() == 1)
+    {
+        return subPots.front();
+    }
+    else
+    {
+        wxLogTrace("poedit.extractor", "merging %d subPOTs", (int)subPots.size());
+        return ConcatCatalogs(tmpdir, subPots);
+    }
+}
+
+
+std::vector<wxString> Extractor::ExtractSubPOTs(TempDirectory& tmpdir,
+                                                const SourceCodeSpec& sourceSpec,
+                                                const std::vector<wxString>& files_,
+                                                dispatch::cancellation_token_ptr cancellationToken)
 {
     auto files = files_;
     wxLogTrace("poedit.extractor", "extracting from %d files", (int)files.size());
 
-    std::vector<wxString> subPots;
+    // Incremented from the shard jobs too, which is safe:
+    Progress progress((int)files.size());
+
+    // Shard jobs log (or not, if the caller suppressed it) like this thread does:
+    const bool logging = wxLog::IsEnabled();
+
+    // Assign files to extractors first, in their priority order:
+    std::vector<std::pair<std::shared_ptr<Extractor>, FilesList>> assigned;
 
     for (auto ex: CreateAllExtractors(sourceSpec))
     {
-        const auto ex_files = ex->FilterFiles(files);
+        auto ex_files = ex->FilterFiles(files);
         if (ex_files.empty())
             continue;
 
         wxLogTrace("poedit.extractor", " .. using extractor '%s' for %d files", ex->GetId(), (int)ex_files.size());
-        auto subPot = ex->Extract(tmpdir, sourceSpec, ex_files);
-        if (!subPot.empty())
-            subPots.push_back(subPot);
 
         if (files.size() > ex_files.size())
         {
@@ -232,29 +558,182 @@ wxString Extractor::ExtractWithAll(TempDirectory& tmpdir,
                                 ex_files.begin(), ex_files.end(),
                                 std::inserter(remaining, remaining.begin()));
             std::swap(files, remaining);
+            assigned.emplace_back(ex, std::move(ex_files));
         }
         else
         {
             files.clear();
+            assigned.emplace_back(ex, std::move(ex_files));
             break; // no more work to do
         }
     }
 
-    wxLogTrace("poedit.extractor", "extraction finished with %d unrecognized files and %d sub-POTs", (int)files.size(), (int)subPots.size());
+    // files that no extractor handles are done already:
+    if (!files.empty())
+        progress.increment((int)files.size());
 
-    if (subPots.empty())
+    // Then run the extractors. Gettext tools can only run concurrently when
+    // we're not on the main thread (see ExecuteGettext()), so large file lists
+    // are split into shards extracted in parallel only in that case:
+    const bool canParallelize = !wxThread::IsMain();
+    const size_t maxShards = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    // Files are extracted one by one when caching, which is only efficient
+    // if done in parallel:
+    std::shared_ptr<ExtractionCache> cache;
+    if (canParallelize)
     {
-        throw ExtractionException(ExtractionError::NoSourcesFound);
+        cache = std::make_shared<ExtractionCache>(sourceSpec);
+        if (!cache->IsOk())
+            cache.reset();
     }
-    else if (subPots.size() == 1)
+
+    std::vector<std::vector<dispatch::future<std::vector<wxString>>>> shardJobs(assigned.size());
+    std::vector<wxString> serialPots(assigned.size());
+
+    for (size_t i = 0; i < assigned.size(); i++)
     {
-        return subPots.front();
+        auto& ex = assigned[i].first;
+        auto& ex_files = assigned[i].second;
+
+        if (!canParallelize || !ex->CanExtractInParallel())
+            continue;
+
+        const auto signature = cache ? ex->GetCacheSignature(sourceSpec) : wxString();
+        const bool useCache = !signature.empty();
+
+        const size_t shards = std::max<size_t>(1, std::min(maxShards, ex_files.size() / MIN_FILES_PER_SHARD));
+        if (shards == 1 && !useCache)
+            continue;
+
+        wxLogTrace("poedit.extractor", " .. extracting with '%s' in %d shards%s", ex->GetId(), (int)shards, useCache ? " using cache" : "");
+        const size_t chunk = (ex_files.size() + shards - 1) / shards;
+        for (size_t start = 0; start < ex_files.size(); start += chunk)
+        {
+            const size_t end = std::min(start + chunk, ex_files.size());
+            FilesList shard(ex_files.begin() + start, ex_files.begin() + end);
+
+            if (!useCache)
+            {
+                shardJobs[i].push_back(dispatch::async([ex, shard{std::move(shard)}, cancellationToken, logging, &progress, &tmpdir, &sourceSpec]
+                {
+                    LoggingScope loggingScope(logging);
+                    CheckIfCancelled(cancellationToken);
+                    auto pot = ex->Extract(tmpdir, sourceSpec, shard, cancellationToken);
+                    progress.increment((int)shard.size());
+                    return std::vector<wxString>{pot};
+                }));
+                continue;
+            }
+
+            shardJobs[i].push_back(dispatch::async([ex, shard{std::move(shard)}, cache, signature, cancellationToken, logging, &progress, &tmpdir, &sourceSpec]
+            {
+                LoggingScope loggingScope(logging);
+                std::vector<wxString> fragments;
+                fragments.reserve(shard.size());
+                for (auto& file: shard)
+                {
+                    CheckIfCancelled(cancellationToken);
+                    auto fragment = cache->GetFragmentFileName(signature, file);
+                    if (fragment.empty())
+                    {
+                        fragments.push_back(ex->Extract(tmpdir, sourceSpec, {file}, cancellationToken));
+                    }
+                    else
+                    {
+                        if (!wxFileName::FileExists(fragment))
+                            fragment = cache->Store(ex->Extract(tmpdir, sourceSpec, {file}, cancellationToken), fragment);
+                        else
+                            wxLogTrace("poedit.extractor", "  - %s (cached)", file);
+                        cache->MarkUsed(fragment);
+                        fragments.push_back(fragment);
+                    }
+                    progress.increment();
+                }
+                return fragments;
+            }));
+        }
     }
-    else
+
+    std::vector<wxString> subPots;
+
+    try
     {
-        wxLogTrace("poedit.extractor", "merging %d subPOTs", (int)subPots.size());
-        return ConcatCatalogs(tmpdir, subPots);
+        // remaining extractors run on this thread while the shards are processed:
+        for (size_t i = 0; i < assigned.size(); i++)
+        {
+            if (shardJobs[i].empty())
+            {
+                CheckIfCancelled(cancellationToken);
+                serialPots[i] = assigned[i].first->Extract(tmpdir, sourceSpec, assigned[i].second, cancellationToken);
+                progress.increment((int)assigned[i].second.size());
+            }
+        }
+
+        // Collect sub-POTs in the extractors' order, so that the output is the same
+        // regardless of how the work was split:
+        for (size_t i = 0; i < assigned.size(); i++)
+        {
+            if (shardJobs[i].empty())
+            {
+                if (!serialPots[i].empty())
+                    subPots.push_back(serialPots[i]);
+                continue;
+            }
+
+            for (auto& job: shardJobs[i])
+            {
+                for (auto& subPot: job.get())
+                {
+                    if (!subPot.empty())
+                        subPots.push_back(subPot);
+                }
+            }
+        }
+    }
+    catch (...)
+    {
+        // the jobs use tmpdir, they must not outlive this function:
+        for (auto& jobs: shardJobs)
+        {
+            for (auto& job: jobs)
+            {
+                if (job.valid())
+                    job.wait();
+            }
+        }
+        throw;
     }
+
+    if (cache)
+        cache->RemoveUnused();
+
+    wxLogTrace("poedit.extractor", "extraction finished with %d unrecognized files and %d sub-POTs", (int)files.size(), (int)subPots.size());
+
+    if (subPots.empty())
+        throw ExtractionException(ExtractionError::NoSourcesFound);
+
+    return subPots;
+}
+
+
+Extractor::FileFilter Extractor::SupportedFilesFilter(const ExtractorsList& extractors)
+{
+    return [extractors](const wxString& file)
+    {
+        for (auto& ex: extractors)
+        {
+            if (ex->IsFileSupported(file))
+                return true;
+        }
+        return false;
+    };
+}
+
+
+void Extractor::SetCacheDir(const wxString& dir)
+{
+    gs_extractionCacheDir = dir;
 }
 
 
@@ -321,6 +800,9 @@ void Extractor::RegisterWildcard(const wxString& wildcard)
 
 wxString Extractor::ConcatCatalogs(TempDirectory& tmpdir, const std::vector<wxString>& files)
 {
+    perf::ScopedTimer timer("Extractor::ConcatCatalogs");
+    timer.SetItemsCount(files.size());
+
     if (files.empty())
     {
         return "";
@@ -375,7 +857,9 @@ Extractor::ExtractorsList Extractor::CreateAllExtractors(const SourceCodeSpec& s
     // User-defined "legacy" extractors customizing the behavior:
     CreateAllLegacyExtractors(all, sources);
 
-    // Standard builtin extractors follow
+    // Standard builtin extractors follow, with native ones preferred over
+    // xgettext for the languages they support:
+    CreateNativeExtractors(all, sources);
     CreateGettextExtractors(all, sources);
 
     std::stable_sort(all.begin(), all.end(), [](const auto& a, const auto& b)
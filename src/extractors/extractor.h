@@ -26,6 +26,7 @@
 #ifndef Poedit_extractor_h
 #define Poedit_extractor_h
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <stdexcept>
@@ -34,6 +35,7 @@
 
 #include <wx/string.h>
 
+#include "concurrency.h"
 #include "utility.h"
 
 
@@ -51,13 +53,26 @@ struct SourceCodeSpec
 
     // additional keys from the headers
     std::map<wxString, wxString> XHeaders;
+
+    bool operator==(const SourceCodeSpec& other) const
+    {
+        return BasePath == other.BasePath &&
+               SearchPaths == other.SearchPaths &&
+               ExcludedPaths == other.ExcludedPaths &&
+               Keywords == other.Keywords &&
+               Charset == other.Charset &&
+               TypeMapping == other.TypeMapping &&
+               XHeaders == other.XHeaders;
+    }
+    bool operator!=(const SourceCodeSpec& other) const { return !(*this == other); }
 };
 
 enum class ExtractionError
 {
     Unspecified,
     NoSourcesFound,
-    PermissionDenied
+    PermissionDenied,
+    Cancelled
 };
 
 class ExtractionException : public std::runtime_error
@@ -80,6 +95,7 @@ class Extractor
 public:
     typedef std::vector<std::shared_ptr<Extractor>> ExtractorsList;
     typedef std::vector<wxString> FilesList;
+    typedef std::function<bool(const wxString& file)> FileFilter;
 
     // Static helper methods:
 
@@ -96,11 +112,20 @@ public:
         Collects all files from source code, possibly including files that
         don't contain translations.
 
+        If @a filter is provided, only files for which it returns true are
+        collected from directories (explicitly listed files are always
+        included). The filter is called from multiple threads.
+
         The returned list is guaranteed to be sorted by operator<
 
-        May throw ExtractionException.
+        May throw ExtractionException, including ExtractionError::Cancelled
+        if @a cancellationToken is cancelled.
      */
-    static FilesList CollectAllFiles(const SourceCodeSpec& sources);
+    static FilesList CollectAllFiles(const SourceCodeSpec& sources, const FileFilter& filter = FileFilter(),
+                                     dispatch::cancellation_token_ptr cancellationToken = dispatch::cancellation_token_ptr());
+
+    /// Returns filter for CollectAllFiles() accepting only files supported by some of @a extractors.
+    static FileFilter SupportedFilesFilter(const ExtractorsList& extractors);
 
 
     /**
@@ -114,6 +139,22 @@ public:
                                    const SourceCodeSpec& sourceSpec,
                                    const std::vector<wxString>& files);
 
+    /**
+        Like ExtractWithAll(), but doesn't concatenate the results: returns
+        (non-empty) list of POT files in @a tmpdir that together contain
+        all extracted translations, in the order they should be merged in.
+
+        Progress is reported per processed file through the current Progress.
+        If @a cancellationToken is cancelled, running tools are killed and
+        ExtractionError::Cancelled is thrown.
+
+        May throw ExtractionException.
+     */
+    static std::vector<wxString> ExtractSubPOTs(TempDirectory& tmpdir,
+                                                const SourceCodeSpec& sourceSpec,
+                                                const std::vector<wxString>& files,
+                                                dispatch::cancellation_token_ptr cancellationToken = dispatch::cancellation_token_ptr());
+
     // Extractor helpers:
 
     /// Returns only those files from @a files that are supported by this extractor.
@@ -157,10 +198,36 @@ public:
 
         Returns filename of the created POT file, which is stored in @a tmpdir
         or empty string on failure.
+
+        Implementations should stop as soon as possible when @a cancellationToken
+        (which may be null) is cancelled, see CheckIfCancelled().
      */
     virtual wxString Extract(TempDirectory& tmpdir,
                              const SourceCodeSpec& sourceSpec,
-                             const std::vector<wxString>& files) const = 0;
+                             const std::vector<wxString>& files,
+                             dispatch::cancellation_token_ptr cancellationToken) const = 0;
+
+    /**
+        Returns whether Extract() may be called concurrently from several
+        threads, each with a different subset of the files.
+
+        If true, ExtractWithAll() splits large file lists into shards that
+        are extracted in parallel and merged afterwards.
+     */
+    virtual bool CanExtractInParallel() const { return false; }
+
+    /**
+        Returns string identifying everything except for the input file that
+        affects Extract() output (e.g. options passed to the tool).
+
+        If nonempty, results of extracting individual files are cached and
+        only files that changed since are extracted again. Only used for
+        extractors that CanExtractInParallel().
+     */
+    virtual wxString GetCacheSignature(const SourceCodeSpec& /*sourceSpec*/) const { return wxString(); }
+
+    /// Sets directory to store cached extraction results in; caching is disabled if not set.
+    static void SetCacheDir(const wxString& dir);
 
 protected:
     Extractor() : m_priority(Priority::Default) {}
@@ -172,6 +239,13 @@ protected:
     /// Concatenates catalogs using msgcat
     static wxString ConcatCatalogs(TempDirectory& tmpdir, const std::vector<wxString>& files);
 
+    /// Throws ExtractionError::Cancelled if @a cancellationToken is cancelled
+    static void CheckIfCancelled(const dispatch::cancellation_token_ptr& cancellationToken)
+    {
+        if (cancellationToken && cancellationToken->is_cancelled())
+            throw ExtractionException(ExtractionError::Cancelled);
+    }
+
 private:
     Priority m_priority;
     std::set<wxString> m_extensions;
@@ -180,6 +254,7 @@ private:
 protected:
     // private factories:
     static void CreateAllLegacyExtractors(ExtractorsList& into, const SourceCodeSpec& sources);
+    static void CreateNativeExtractors(ExtractorsList& into, const SourceCodeSpec& sources);
     static void CreateGettextExtractors(ExtractorsList& into, const SourceCodeSpec& sources);
 };
 
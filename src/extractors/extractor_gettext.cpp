@@ -26,8 +26,19 @@
 #include "extractor.h"
 
 #include "gexecute.h"
+#include "pugixml.h"
 
+#include <wx/dir.h>
+#include <wx/file.h>
+#include <wx/filename.h>
+#include <wx/log.h>
 #include <wx/textfile.h>
+#include <wx/tokenzr.h>
+#include <wx/utils.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
 
 namespace
 {
@@ -90,6 +101,265 @@ const char * const GETTEXT_EXTENSIONS[] = {
 };
 
 
+
+
+/**
+    Locating rules of ITS-based XML formats (GSettings schemas, Glade files,
+    AppData etc.), as read by xgettext from the *.loc files in its data
+    directories, and the ITS rules files they point to.
+
+    Loaded once and shared; thread-safe.
+ */
+class ITSLocatingRules
+{
+public:
+    static const ITSLocatingRules& Get()
+    {
+        static ITSLocatingRules s_instance;
+        return s_instance;
+    }
+
+    /// Returns true if @a file's name matches any of the rules
+    bool MayMatch(const wxString& file) const
+    {
+        auto name = wxFileName(file).GetFullName();
+        for (auto& r: m_rules)
+        {
+            if (wxMatchWild(r.pattern, name))
+                return true;
+        }
+        return false;
+    }
+
+    /**
+        Returns full path to ITS rules file for @a fullpath or empty string
+        if there's none or it is ambiguous.
+
+        Like xgettext, uses the first rule matching the filename and, for
+        rules that depend on it, the document's root element.
+     */
+    wxString FindRulesFile(const wxString& fullpath) const
+    {
+        auto name = wxFileName(fullpath).GetFullName();
+        for (auto& r: m_rules)
+        {
+            if (!wxMatchWild(r.pattern, name))
+                continue;
+
+            if (r.documentRules.empty())
+                return r.target;
+
+            wxString ns, localName;
+            if (!ReadRootElement(fullpath, ns, localName))
+                return wxString();
+            for (auto& d: r.documentRules)
+            {
+                if ((d.ns.empty() || d.ns == ns) && (d.localName.empty() || d.localName == localName))
+                    return d.target;
+            }
+        }
+        return wxString();
+    }
+
+private:
+    struct DocumentRule
+    {
+        wxString ns, localName, target;
+    };
+
+    struct LocatingRule
+    {
+        wxString pattern, target;
+        std::vector<DocumentRule> documentRules;
+    };
+
+    ITSLocatingRules()
+    {
+        auto dirs = GetDataDirs();
+
+        // ITS files with the same name in several directories are all applied
+        // by xgettext, which can't be replicated with a single --its option:
+        std::map<wxString, wxString> itsFiles;
+        for (auto& dir: dirs)
+        {
+            wxDir d(dir);
+            if (!d.IsOpened())
+                continue;
+            wxString f;
+            for (bool cont = d.GetFirst(&f, "*.its", wxDIR_FILES); cont; cont = d.GetNext(&f))
+            {
+                auto& path = itsFiles[f];
+                path = path.empty() ? dir + wxFILE_SEP_PATH + f : wxString("-");
+            }
+        }
+
+        for (auto& dir: dirs)
+        {
+            wxDir d(dir);
+            if (!d.IsOpened())
+                continue;
+            wxString f;
+            for (bool cont = d.GetFirst(&f, "*.loc", wxDIR_FILES); cont; cont = d.GetNext(&f))
+                LoadLocatingRules(dir + wxFILE_SEP_PATH + f, itsFiles);
+        }
+
+        wxLogTrace("poedit.extractor", "loaded %d ITS locating rules", (int)m_rules.size());
+    }
+
+    static std::vector<wxString> GetDataDirs()
+    {
+        std::vector<wxString> dirs;
+        auto addDataDir = [&dirs](const wxString& datadir)
+        {
+            auto add = [&dirs](const wxString& dir)
+            {
+                if (std::find(dirs.begin(), dirs.end(), dir) == dirs.end())
+                    dirs.push_back(dir);
+            };
+
+            if (datadir.empty())
+                return;
+            add(datadir + "/gettext/its");
+            // gettext's own rules are in versioned directory on some systems:
+            wxDir d(datadir);
+            wxString sub;
+            if (d.IsOpened())
+            {
+                for (bool cont = d.GetFirst(&sub, "gettext-*", wxDIR_DIRS); cont; cont = d.GetNext(&sub))
+                    add(datadir + "/" + sub + "/its");
+            }
+        };
+
+#if defined(__WXOSX__) || defined(__WXMSW__)
+        addDataDir(GetGettextPackagePath() + "/share");
+#endif
+#ifdef __UNIX__
+        const char *defaultXDGDataDirs = "/usr/local/share:/usr/share";
+#else
+        const char *defaultXDGDataDirs = "";
+#endif
+        for (auto& var: {std::make_pair("GETTEXTDATADIRS", ""), std::make_pair("XDG_DATA_DIRS", defaultXDGDataDirs)})
+        {
+            wxString value;
+            if (!wxGetEnv(var.first, &value))
+                value = var.second;
+            for (auto& d: wxStringTokenize(value, wxPATH_SEP))
+                addDataDir(d);
+        }
+
+        return dirs;
+    }
+
+    void LoadLocatingRules(const wxString& filename, const std::map<wxString, wxString>& itsFiles)
+    {
+        pugi::xml_document doc;
+        if (!doc.load_file(filename.fn_str()))
+            return;
+
+        auto resolve = [&itsFiles](const char *target) -> wxString
+        {
+            auto i = itsFiles.find(wxString::FromUTF8(target));
+            return (i == itsFiles.end() || i->second == "-") ? wxString() : i->second;
+        };
+
+        for (auto node: doc.child("locatingRules").children("locatingRule"))
+        {
+            LocatingRule rule;
+            rule.pattern = wxString::FromUTF8(node.attribute("pattern").value());
+            if (rule.pattern.empty())
+                continue;
+
+            bool ok = true;
+            if (auto target = node.attribute("target"))
+            {
+                rule.target = resolve(target.value());
+                ok = !rule.target.empty();
+            }
+            for (auto d: node.children("documentRule"))
+            {
+                DocumentRule dr;
+                dr.ns = wxString::FromUTF8(d.attribute("ns").value());
+                dr.localName = wxString::FromUTF8(d.attribute("localName").value());
+                dr.target = resolve(d.attribute("target").value());
+                ok = ok && !dr.target.empty();
+                rule.documentRules.push_back(dr);
+            }
+
+            // Rules that can't be resolved are kept as unmatchable, because
+            // they still take precedence over rules that follow:
+            if (!ok)
+            {
+                rule.target.clear();
+                rule.documentRules.clear();
+            }
+            m_rules.push_back(rule);
+        }
+    }
+
+    /// Finds the root element without parsing the whole document
+    static bool ReadRootElement(const wxString& fullpath, wxString& ns, wxString& localName)
+    {
+        wxLogNull null;
+        wxFile f;
+        if (!f.Open(fullpath))
+            return false;
+
+        char buf[16384];
+        auto len = f.Read(buf, sizeof(buf));
+        if (len == wxInvalidOffset || len <= 0)
+            return false;
+        std::string head(buf, len);
+
+        // skip XML declaration, processing instructions, comments and DOCTYPE:
+        size_t pos = 0;
+        for (;;)
+        {
+            pos = head.find('<', pos);
+            if (pos == std::string::npos || pos + 1 >= head.size())
+                return false;
+            if (head[pos + 1] != '?' && head[pos + 1] != '!')
+                break;
+            auto end = head.compare(pos, 4, "<!--") == 0 ? head.find("-->", pos) : head.find('>', pos);
+            if (end == std::string::npos)
+                return false;
+            pos = end;
+        }
+
+        auto tagEnd = head.find('>', pos);
+        if (tagEnd == std::string::npos)
+            return false;
+        auto tag = head.substr(pos + 1, tagEnd - pos - 1);
+
+        auto nameEnd = tag.find_first_of(" \t\r\n/");
+        auto qname = tag.substr(0, nameEnd);
+        std::string prefix;
+        auto colon = qname.find(':');
+        if (colon != std::string::npos)
+        {
+            prefix = qname.substr(0, colon);
+            qname = qname.substr(colon + 1);
+        }
+        localName = wxString::FromUTF8(qname);
+
+        ns.clear();
+        const std::string xmlns = prefix.empty() ? "xmlns=" : "xmlns:" + prefix + "=";
+        auto nsPos = tag.find(xmlns);
+        if (nsPos != std::string::npos && nsPos + xmlns.length() < tag.length())
+        {
+            auto quote = tag[nsPos + xmlns.length()];
+            auto valueStart = nsPos + xmlns.length() + 1;
+            auto valueEnd = tag.find(quote, valueStart);
+            if (valueEnd != std::string::npos)
+                ns = wxString::FromUTF8(tag.substr(valueStart, valueEnd - valueStart));
+        }
+
+        return !localName.empty();
+    }
+
+    std::vector<LocatingRule> m_rules;
+};
+
+
 } // anonymous namespace
 
 
@@ -99,7 +369,28 @@ class GettextExtractorBase : public Extractor
 public:
     wxString Extract(TempDirectory& tmpdir,
                      const SourceCodeSpec& sourceSpec,
-                     const std::vector<wxString>& files) const override
+                     const std::vector<wxString>& files,
+                     dispatch::cancellation_token_ptr cancellationToken) const override
+    {
+        return RunXgettext(tmpdir, sourceSpec, files, wxString(), cancellationToken);
+    }
+    
+    bool CanExtractInParallel() const override { return true; }
+
+    wxString GetCacheSignature(const SourceCodeSpec& sourceSpec) const override
+    {
+        return GetId() + "\n" + GetOptions(sourceSpec);
+    }
+
+protected:
+    virtual wxString GetAdditionalFlags() const = 0;
+
+    /// Runs xgettext on @a files, with @a extraArgs in addition to the usual options
+    wxString RunXgettext(TempDirectory& tmpdir,
+                         const SourceCodeSpec& sourceSpec,
+                         const std::vector<wxString>& files,
+                         const wxString& extraArgs,
+                         dispatch::cancellation_token_ptr cancellationToken) const
     {
         auto basepath = sourceSpec.BasePath;
 #ifdef __WXMSW__
@@ -129,20 +420,42 @@ public:
         wxString cmdline;
         cmdline.Printf
         (
-            "xgettext --force-po -o %s --directory=%s --files-from=%s --from-code=%s",
+            "xgettext --force-po -o %s --directory=%s --files-from=%s",
             QuoteCmdlineArg(outfile),
             QuoteCmdlineArg(basepath),
-            QuoteCmdlineArg(filelist.GetName()),
+            QuoteCmdlineArg(filelist.GetName())
+        );
+        cmdline += " " + GetOptions(sourceSpec);
+        if (!extraArgs.empty())
+            cmdline += " " + extraArgs;
+
+        if (!ExecuteGettext(cmdline, cancellationToken))
+        {
+            CheckIfCancelled(cancellationToken);
+            throw ExtractionException(ExtractionError::Unspecified);
+        }
+
+        return outfile;
+    }
+
+private:
+    /// Returns xgettext options that don't depend on files being processed
+    wxString GetOptions(const SourceCodeSpec& sourceSpec) const
+    {
+        wxString options;
+        options.Printf
+        (
+            "--from-code=%s",
             QuoteCmdlineArg(!sourceSpec.Charset.empty() ? sourceSpec.Charset : "UTF-8")
         );
 
         auto additional = GetAdditionalFlags();
         if (!additional.empty())
-            cmdline += " " + additional;
+            options += " " + additional;
 
         for (auto& kw: sourceSpec.Keywords)
         {
-            cmdline += wxString::Format(" -k%s", QuoteCmdlineArg(kw));
+            options += wxString::Format(" -k%s", QuoteCmdlineArg(kw));
         }
 
         wxString extraFlags;
@@ -153,19 +466,13 @@ public:
         catch (std::out_of_range&) {}
 
         if (!extraFlags.Contains("--add-comments"))
-            cmdline += " --add-comments=TRANSLATORS:";
+            options += " --add-comments=TRANSLATORS:";
 
         if (!extraFlags.empty())
-            cmdline += " " + extraFlags;
+            options += " " + extraFlags;
 
-        if (!ExecuteGettext(cmdline))
-            throw ExtractionException(ExtractionError::Unspecified);
-
-        return outfile;
+        return options;
     }
-    
-protected:
-    virtual wxString GetAdditionalFlags() const = 0;
 };
 
 
@@ -186,6 +493,97 @@ protected:
 };
 
 
+/**
+    Extractor for ITS-based XML formats (GSettings schemas, Glade files etc.)
+
+    xgettext would locate and compile the ITS rules again for every file
+    it processes. Instead, the rules are located once for all of them (see
+    ITSLocatingRules) and files are extracted in groups using the same rules,
+    passed explicitly with --its, so that xgettext compiles them only once
+    per group.
+
+    Files that the rules can't be reliably located for are left to the
+    generic GettextExtractor.
+ */
+class ITSGettextExtractor : public GettextExtractorBase
+{
+public:
+    ITSGettextExtractor(const wxString& basePath) : m_basePath(basePath) {}
+
+    wxString GetId() const override { return "gettext-its"; }
+
+    bool IsFileSupported(const wxString& file) const override
+    {
+        return !GetRulesFile(file).empty();
+    }
+
+    wxString Extract(TempDirectory& tmpdir,
+                     const SourceCodeSpec& sourceSpec,
+                     const std::vector<wxString>& files,
+                     dispatch::cancellation_token_ptr cancellationToken) const override
+    {
+        std::map<wxString, FilesList> groups;
+        for (auto& f: files)
+            groups[GetRulesFile(f)].push_back(f);
+
+        std::vector<wxString> pots;
+        for (auto& g: groups)
+        {
+            CheckIfCancelled(cancellationToken);
+            if (g.first.empty())
+                continue;  // shouldn't happen, FilterFiles() was used
+            wxLogTrace("poedit.extractor", " .. using ITS rules %s for %d files", g.first, (int)g.second.size());
+            pots.push_back(RunXgettext(tmpdir, sourceSpec, g.second, "--its=" + QuoteCmdlineArg(CliSafeITSPath(g.first)), cancellationToken));
+        }
+
+        if (pots.size() == 1)
+            return pots.front();
+        return ConcatCatalogs(tmpdir, pots);
+    }
+
+protected:
+    wxString GetAdditionalFlags() const override { return ""; }
+
+private:
+    wxString GetRulesFile(const wxString& file) const
+    {
+        auto& rules = ITSLocatingRules::Get();
+        if (!rules.MayMatch(file))
+            return wxString();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto i = m_rulesFiles.find(file);
+            if (i != m_rulesFiles.end())
+                return i->second;
+        }
+
+        auto rulesFile = rules.FindRulesFile(m_basePath + file);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_rulesFiles[file] = rulesFile;
+        return rulesFile;
+    }
+
+    static wxString CliSafeITSPath(const wxString& path)
+    {
+#ifdef __WXMSW__
+        auto p = CliSafeFileName(path);
+        p.Replace("\\", "/");
+        return p;
+#else
+        return path;
+#endif
+    }
+
+    wxString m_basePath;
+
+    // located rules for files, computed on first use:
+    mutable std::mutex m_mutex;
+    mutable std::map<wxString, wxString> m_rulesFiles;
+};
+
+
 /// Dedicated extractor for non-standard PHP extensions (*.phtml etc.)
 class CustomGettextExtractor : public GettextExtractorBase
 {
@@ -215,6 +613,8 @@ public:
 
 void Extractor::CreateGettextExtractors(Extractor::ExtractorsList& into, const SourceCodeSpec& sources)
 {
+    // must precede GettextExtractor, which handles the files it doesn't:
+    into.push_back(std::make_shared<ITSGettextExtractor>(sources.BasePath));
     into.push_back(std::make_shared<GettextExtractor>());
     into.push_back(std::make_shared<NonstandardPHPGettextExtractor>());
 
@@ -25,16 +25,34 @@
 
 #include "extractor_legacy.h"
 
+#include "catalog_po.h"
 #include "gexecute.h"
 
+#include <wx/file.h>
 #include <wx/filename.h>
 #include <wx/wfstream.h>
 #include <wx/config.h>
+#include <wx/log.h>
+#include <wx/thread.h>
 #include <wx/tokenzr.h>
 
+#include <algorithm>
+#include <thread>
+
 namespace
 {
 
+// Maximum length of files list passed to the extractor in one command line,
+// with some room left for the rest of the command:
+#ifdef __WXMSW__
+const size_t MAX_FILES_CMDLINE_LENGTH = 24 * 1024;
+#else
+const size_t MAX_FILES_CMDLINE_LENGTH = 96 * 1024;
+#endif
+
+// Chunks run in parallel shouldn't be too small, to not start too many processes:
+const size_t MIN_FILES_PER_CHUNK = 16;
+
 inline LegacyExtractorSpec LoadExtractorSpec(const wxString& name, wxConfigBase *cfg)
 {
     LegacyExtractorSpec info;
@@ -309,34 +327,115 @@ LegacyExtractor::LegacyExtractor(const LegacyExtractorSpec& spec)
 
 wxString LegacyExtractor::Extract(TempDirectory& tmpdir,
                                   const SourceCodeSpec& sourceSpec,
-                                  const std::vector<wxString>& files) const
+                                  const std::vector<wxString>& files,
+                                  dispatch::cancellation_token_ptr cancellationToken) const
 {
-    // cmdline's length is limited by OS/shell, this is maximal number
-    // of files we'll pass to the parser at one run:
-    const int BATCH_SIZE = 16;
-
-    std::vector<wxString> batchfiles, tempfiles;
-    size_t i, last = 0;
+    // Gettext tools can only run concurrently when we're not on the main
+    // thread (see ExecuteGettext()):
+    const bool parallel = !wxThread::IsMain();
+
+    // cmdline's length is limited by OS, so files are passed to the parser
+    // in chunks of limited length; when running in parallel, large lists are
+    // split further so that all CPU cores are used:
+    size_t maxChunkFiles = files.size();
+    if (parallel)
+    {
+        const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+        maxChunkFiles = std::max(MIN_FILES_PER_CHUNK, (files.size() + cores - 1) / cores);
+    }
 
-    while (last < files.size())
+    std::vector<std::vector<wxString>> chunks;
+    size_t chunkLength = 0;
+    for (auto& fn: files)
     {
-        batchfiles.clear();
-        for (i = last; i < last + BATCH_SIZE && i < files.size(); i++)
-            batchfiles.push_back(files[i]);
-        last = i;
+        // quotes and separating space included:
+        const size_t length = m_spec.FileItem.length() + fn.length() + 3;
+        if (chunks.empty() || chunks.back().size() >= maxChunkFiles || chunkLength + length > MAX_FILES_CMDLINE_LENGTH)
+        {
+            chunks.emplace_back();
+            chunkLength = 0;
+        }
+        chunks.back().push_back(fn);
+        chunkLength += length;
+    }
 
+    std::vector<wxString> commands, tempfiles;
+    for (auto& chunk: chunks)
+    {
         wxString tempfile = tmpdir.CreateFileName(GetId() + "_extracted.pot");
+        commands.push_back(m_spec.BuildCommand(chunk, sourceSpec.Keywords, tempfile, sourceSpec.Charset));
+        tempfiles.push_back(tempfile);
+    }
 
+    {
         CurrentWorkingDirectoryChanger cwd(sourceSpec.BasePath);
-        if (!ExecuteGettext(m_spec.BuildCommand(batchfiles, sourceSpec.Keywords, tempfile, sourceSpec.Charset)))
+
+        bool ok = true;
+        if (parallel && commands.size() > 1)
         {
+            std::vector<dispatch::future<bool>> jobs;
+            for (auto& cmd: commands)
+                jobs.push_back(ExecuteGettextAsync(cmd, {}, cancellationToken));
+
+            // wait for all of them even on errors, they run in our working directory:
+            for (auto& job: jobs)
+            {
+                try
+                {
+                    if (!job.get())
+                        ok = false;
+                }
+                catch (...)
+                {
+                    ok = false;
+                }
+            }
+        }
+        else
+        {
+            for (auto& cmd: commands)
+            {
+                if (!ExecuteGettext(cmd, cancellationToken))
+                {
+                    ok = false;
+                    break;
+                }
+            }
+        }
+
+        if (!ok)
+        {
+            CheckIfCancelled(cancellationToken);
             throw ExtractionException(ExtractionError::Unspecified);
         }
+    }
 
-        tempfiles.push_back(tempfile);
+    if (tempfiles.size() == 1)
+        return tempfiles.front();
+
+    // merge the chunks in-process, without running msgcat:
+    tempfiles.erase(std::remove_if(tempfiles.begin(), tempfiles.end(),
+                                   [](const wxString& f){ return !wxFileName::FileExists(f); }),
+                    tempfiles.end());
+    if (tempfiles.empty())
+        return wxString();
+
+    auto outfile = tmpdir.CreateFileName(GetId() + "_merged.pot");
+    try
+    {
+        auto merged = POCatalog::CreateByConcatenating(tempfiles);
+        const auto data = merged->SaveToBuffer();
+        wxFile f;
+        if (data.empty() || !f.Create(outfile, true) || !f.Write(data.data(), data.size()))
+            throw ExtractionException(ExtractionError::Unspecified);
+    }
+    catch (...)
+    {
+        wxLogError(_("Failed to merge gettext catalogs."));
+        throw ExtractionException(ExtractionError::Unspecified);
     }
 
-    return ConcatCatalogs(tmpdir, tempfiles);
+    return outfile;
 }
 
 
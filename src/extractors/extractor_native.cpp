@@ -0,0 +1,1575 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2023 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "extractor.h"
+
+#include "utility.h"
+
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <wx/intl.h>
+#include <wx/log.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+    Native extractors handle the most common languages directly, without
+    running xgettext for them. They only understand the subset of xgettext's
+    functionality that Poedit uses by default (keywords and TRANSLATORS:
+    comments) and so aren't used if the project customizes xgettext flags or
+    uses a source encoding other than UTF-8; the xgettext-based extractors
+    handle such files instead.
+
+    Their output is meant to be identical to what xgettext would produce,
+    including the heuristic marking of format strings.
+ */
+
+namespace
+{
+
+enum class Language
+{
+    C,
+    ObjC,
+    Python,
+    JavaScript,
+    PHP
+};
+
+// Tag of comments to extract, same as used with xgettext by default:
+const char TRANSLATORS_TAG[] = "TRANSLATORS:";
+
+// Default keywords, synced with init_keywords() in deps/gettext/gettext-tools/src/x-*.c files:
+const char * const KEYWORDS_C[] = {
+    "gettext", "dgettext:2", "dcgettext:2", "ngettext:1,2", "dngettext:2,3", "dcngettext:2,3",
+    "gettext_noop", "pgettext:1c,2", "dpgettext:2c,3", "dcpgettext:2c,3",
+    "npgettext:1c,2,3", "dnpgettext:2c,3,4", "dcnpgettext:2c,3,4",
+    nullptr
+};
+
+const char * const KEYWORDS_OBJC[] = {
+    "NSLocalizedString", "_", "NSLocalizedStaticString", "__",
+    nullptr
+};
+
+const char * const KEYWORDS_PYTHON[] = {
+    "gettext", "ugettext", "dgettext:2", "ngettext:1,2", "ungettext:1,2", "dngettext:2,3", "_",
+    "pgettext:1c,2", "npgettext:1c,2,3", "dpgettext:2c,3", "dnpgettext:2c,3,4",
+    nullptr
+};
+
+const char * const KEYWORDS_JAVASCRIPT[] = {
+    "_", "gettext", "dgettext:2", "dcgettext:2", "ngettext:1,2", "dngettext:2,3",
+    "pgettext:1c,2", "dpgettext:2c,3",
+    nullptr
+};
+
+const char * const KEYWORDS_PHP[] = {
+    "_", "gettext", "dgettext:2", "dcgettext:2", "ngettext:1,2", "dngettext:2,3", "dcngettext:2,3",
+    nullptr
+};
+
+
+/// Positions (1-based) of keyword function's arguments
+struct KeywordArgs
+{
+    int singular = 0;
+    int plural = 0;
+    int context = 0;
+    int total = 0;
+};
+
+typedef std::unordered_map<std::string, KeywordArgs> KeywordsMap;
+
+inline bool IsIdentStart(int c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$' || c >= 0x80;
+}
+
+inline bool IsIdentChar(int c)
+{
+    return IsIdentStart(c) || (c >= '0' && c <= '9');
+}
+
+/**
+    Parses xgettext's keyword specification ("name", "name:1,2", "name:1c,2",
+    "name:1,2t" etc.). Returns false if the syntax isn't supported.
+ */
+bool ParseKeywordSpec(const std::string& spec, std::string& name, KeywordArgs& args)
+{
+    args = KeywordArgs();
+    auto colon = spec.find(':');
+    // "::" is part of qualified C++ name, not a separator:
+    while (colon != std::string::npos && colon + 1 < spec.size() && spec[colon + 1] == ':')
+        colon = spec.find(':', colon + 2);
+
+    name = spec.substr(0, colon);
+    if (name.empty())
+        return false;
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        if (!IsIdentChar((unsigned char)name[i]) && !(name[i] == ':' && i + 1 < name.size() && name[++i] == ':'))
+            return false;
+    }
+
+    if (colon == std::string::npos)
+    {
+        args.singular = 1;
+        return true;
+    }
+
+    const std::string argspec = spec.substr(colon + 1);
+    size_t pos = 0;
+    while (pos < argspec.size())
+    {
+        size_t endpos = argspec.find(',', pos);
+        if (endpos == std::string::npos)
+            endpos = argspec.size();
+        const std::string part = argspec.substr(pos, endpos - pos);
+        pos = endpos + 1;
+
+        size_t digits = 0;
+        while (digits < part.size() && isdigit((unsigned char)part[digits]))
+            digits++;
+        if (digits == 0)
+            return false;
+        const int num = std::stoi(part.substr(0, digits));
+        const std::string suffix = part.substr(digits);
+        if (num <= 0)
+            return false;
+
+        if (suffix.empty())
+        {
+            if (!args.singular)
+                args.singular = num;
+            else if (!args.plural)
+                args.plural = num;
+            else
+                return false;
+        }
+        else if (suffix == "c" && !args.context)
+        {
+            args.context = num;
+        }
+        else if (suffix == "t" && !args.total)
+        {
+            args.total = num;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return args.singular != 0;
+}
+
+void AppendUTF8(std::string& out, unsigned long c)
+{
+    if (c < 0x80)
+    {
+        out += (char)c;
+    }
+    else if (c < 0x800)
+    {
+        out += (char)(0xC0 | (c >> 6));
+        out += (char)(0x80 | (c & 0x3F));
+    }
+    else if (c < 0x10000)
+    {
+        out += (char)(0xE0 | (c >> 12));
+        out += (char)(0x80 | ((c >> 6) & 0x3F));
+        out += (char)(0x80 | (c & 0x3F));
+    }
+    else if (c < 0x110000)
+    {
+        out += (char)(0xF0 | (c >> 18));
+        out += (char)(0x80 | ((c >> 12) & 0x3F));
+        out += (char)(0x80 | ((c >> 6) & 0x3F));
+        out += (char)(0x80 | (c & 0x3F));
+    }
+}
+
+inline bool IsASCII(const std::string& s)
+{
+    for (auto c: s)
+    {
+        if ((unsigned char)c >= 0x80)
+            return false;
+    }
+    return true;
+}
+
+inline bool IsValidUTF8(const std::string& s)
+{
+    return IsASCII(s) || !wxString::FromUTF8(s.data(), s.size()).empty();
+}
+
+
+// Heuristic detection of format strings, mimicking deps/gettext/gettext-tools/src/format-*.c.
+// Like xgettext, strings are considered format strings if they parse as such
+// and contain at least one directive.
+
+bool IsCFormatString(const std::string& s, bool objc = false)
+{
+    bool found = false;
+    const size_t len = s.size();
+    for (size_t i = 0; i < len; i++)
+    {
+        if (s[i] != '%')
+            continue;
+        if (++i == len)
+            return false;
+        found = true;
+        if (s[i] == '%')
+            continue;
+
+        // argument number:
+        size_t j = i;
+        while (j < len && isdigit((unsigned char)s[j]))
+            j++;
+        if (j < len && j > i && s[j] == '$')
+            i = j + 1;
+        // flags:
+        while (i < len && strchr("-+ #0'I", s[i]))
+            i++;
+        // width:
+        if (i < len && s[i] == '*')
+        {
+            i++;
+            j = i;
+            while (j < len && isdigit((unsigned char)s[j]))
+                j++;
+            if (j < len && j > i && s[j] == '$')
+                i = j + 1;
+        }
+        else
+        {
+            while (i < len && isdigit((unsigned char)s[i]))
+                i++;
+        }
+        // precision:
+        if (i < len && s[i] == '.')
+        {
+            i++;
+            if (i < len && s[i] == '*')
+                i++;
+            while (i < len && isdigit((unsigned char)s[i]))
+                i++;
+        }
+        // size:
+        if (i < len && strchr("hlLqjzZt", s[i]))
+        {
+            if (i + 1 < len && (s[i] == 'h' || s[i] == 'l') && s[i + 1] == s[i])
+                i++;
+            i++;
+        }
+        if (i == len || !(strchr("diouxXeEfFgGaAcCsSpnm", s[i]) || (objc && s[i] == '@')))
+            return false;
+    }
+    return found;
+}
+
+bool IsPythonFormatString(const std::string& s)
+{
+    bool found = false, named = false, unnamed = false;
+    const size_t len = s.size();
+    for (size_t i = 0; i < len; i++)
+    {
+        if (s[i] != '%')
+            continue;
+        if (++i == len)
+            return false;
+        found = true;
+        if (s[i] == '%')
+            continue;
+
+        if (s[i] == '(')
+        {
+            auto close = s.find(')', i);
+            if (close == std::string::npos)
+                return false;
+            i = close + 1;
+            named = true;
+        }
+        else
+        {
+            unnamed = true;
+        }
+        while (i < len && strchr("-+ #0", s[i]))
+            i++;
+        if (i < len && s[i] == '*')
+            i++;
+        else while (i < len && isdigit((unsigned char)s[i]))
+            i++;
+        if (i < len && s[i] == '.')
+        {
+            i++;
+            if (i < len && s[i] == '*')
+                i++;
+            else while (i < len && isdigit((unsigned char)s[i]))
+                i++;
+        }
+        if (i < len && strchr("hlL", s[i]))
+            i++;
+        if (i == len || !strchr("diouxXeEfFgGcrsa", s[i]))
+            return false;
+    }
+    return found && !(named && unnamed);
+}
+
+bool IsPHPOrJSFormatString(const std::string& s, const char *conversions)
+{
+    bool found = false;
+    const size_t len = s.size();
+    for (size_t i = 0; i < len; i++)
+    {
+        if (s[i] != '%')
+            continue;
+        if (++i == len)
+            return false;
+        found = true;
+        if (s[i] == '%')
+            continue;
+
+        size_t j = i;
+        while (j < len && isdigit((unsigned char)s[j]))
+            j++;
+        if (j < len && j > i && s[j] == '$')
+            i = j + 1;
+        for (;;)
+        {
+            if (i < len && strchr("-+ 0", s[i]))
+                i++;
+            else if (i + 1 < len && s[i] == '\'')
+                i += 2;  // custom padding character
+            else
+                break;
+        }
+        while (i < len && isdigit((unsigned char)s[i]))
+            i++;
+        if (i < len && s[i] == '.')
+        {
+            i++;
+            while (i < len && isdigit((unsigned char)s[i]))
+                i++;
+        }
+        if (i == len || !strchr(conversions, s[i]))
+            return false;
+    }
+    return found;
+}
+
+
+struct Token
+{
+    enum Type
+    {
+        Name,               // identifier
+        Symbol,             // punctuation, in text
+        String,             // literal string, decoded value in text
+        NonLiteralString,   // string with interpolation or unsupported escapes
+        Comment,            // one line of a comment, in text
+        Other,              // numbers, character literals etc.
+        End
+    };
+
+    Type type;
+    std::string text;
+    int line;
+};
+
+
+/// Tokenizer for C-like languages
+class Lexer
+{
+public:
+    Lexer(Language lang, const char *begin, const char *end)
+        : m_lang(lang), m_p(begin), m_end(end), m_line(1),
+          m_inCode(lang != Language::PHP)
+    {}
+
+    std::vector<Token> Tokenize()
+    {
+        std::vector<Token> tokens;
+        tokens.reserve((m_end - m_p) / 8);
+
+        while (m_p < m_end)
+        {
+            if (!m_inCode)
+            {
+                SkipToPHPCode();
+                continue;
+            }
+
+            const int c = Peek();
+            if (c == '\n')
+            {
+                m_line++;
+                m_p++;
+                continue;
+            }
+            if (isspace(c))
+            {
+                m_p++;
+                continue;
+            }
+
+            if (c == '/' && Peek(1) == '/')
+            {
+                m_p += 2;
+                LineComment(tokens);
+                continue;
+            }
+            if (c == '/' && Peek(1) == '*')
+            {
+                m_p += 2;
+                BlockComment(tokens);
+                continue;
+            }
+            if (c == '#' && (m_lang == Language::Python || m_lang == Language::PHP))
+            {
+                m_p++;
+                LineComment(tokens);
+                continue;
+            }
+            if (c == '?' && Peek(1) == '>' && m_lang == Language::PHP)
+            {
+                m_p += 2;
+                m_inCode = false;
+                Add(tokens, Token::Symbol, ";");
+                continue;
+            }
+
+            if (c == '"' || c == '\'' || (c == '`' && m_lang == Language::JavaScript))
+            {
+                StringLiteral(tokens, std::string());
+                continue;
+            }
+            if (c == '@' && Peek(1) == '"' && (m_lang == Language::C || m_lang == Language::ObjC))
+            {
+                m_p++;
+                StringLiteral(tokens, std::string());
+                continue;
+            }
+            if (c == '<' && Peek(1) == '<' && Peek(2) == '<' && m_lang == Language::PHP)
+            {
+                HereDoc(tokens);
+                continue;
+            }
+
+            if (c == '$' && m_lang == Language::PHP)
+            {
+                // variables are never keywords
+                const char *start = m_p++;
+                while (m_p < m_end && IsIdentChar((unsigned char)*m_p))
+                    m_p++;
+                Add(tokens, Token::Other, std::string(start, m_p));
+                continue;
+            }
+
+            if (IsIdentStart(c))
+            {
+                const char *start = m_p;
+                while (m_p < m_end && IsIdentChar((unsigned char)*m_p))
+                    m_p++;
+                std::string name(start, m_p);
+                const int next = Peek();
+                if ((next == '"' || next == '\'') && IsStringPrefix(name))
+                {
+                    StringLiteral(tokens, name);
+                    continue;
+                }
+                Add(tokens, Token::Name, std::move(name));
+                continue;
+            }
+
+            if (isdigit(c) || (c == '.' && isdigit(Peek(1))))
+            {
+                const char *start = m_p;
+                while (m_p < m_end && (isalnum((unsigned char)*m_p) || *m_p == '.' || *m_p == '_' ||
+                                       // C++14 digit separators:
+                                       (*m_p == '\'' && m_lang != Language::Python && m_p + 1 < m_end && isalnum((unsigned char)m_p[1]))))
+                {
+                    m_p++;
+                }
+                Add(tokens, Token::Other, std::string(start, m_p));
+                continue;
+            }
+
+            if (c == '/' && m_lang == Language::JavaScript && IsRegexAllowed(tokens))
+            {
+                RegexLiteral(tokens);
+                continue;
+            }
+
+            if (c == ':' && Peek(1) == ':')
+            {
+                m_p += 2;
+                Add(tokens, Token::Symbol, "::");
+                continue;
+            }
+
+            m_p++;
+            Add(tokens, Token::Symbol, std::string(1, (char)c));
+        }
+
+        Add(tokens, Token::End, std::string());
+        return tokens;
+    }
+
+private:
+    int Peek(size_t offset = 0) const
+    {
+        return m_p + offset < m_end ? (unsigned char)m_p[offset] : -1;
+    }
+
+    void Add(std::vector<Token>& tokens, Token::Type type, std::string&& text)
+    {
+        tokens.push_back({type, std::move(text), m_line});
+    }
+
+    void Add(std::vector<Token>& tokens, Token::Type type, const char *text)
+    {
+        tokens.push_back({type, text, m_line});
+    }
+
+    void AddCommentLine(std::vector<Token>& tokens, const char *begin, const char *end)
+    {
+        while (begin < end && isspace((unsigned char)*begin))
+            begin++;
+        while (end > begin && isspace((unsigned char)end[-1]))
+            end--;
+        Add(tokens, Token::Comment, std::string(begin, end));
+    }
+
+    void LineComment(std::vector<Token>& tokens)
+    {
+        const char *start = m_p;
+        while (m_p < m_end && *m_p != '\n')
+        {
+            // PHP's one-line comments end at "?>" too:
+            if (m_lang == Language::PHP && *m_p == '?' && Peek(1) == '>')
+                break;
+            m_p++;
+        }
+        AddCommentLine(tokens, start, m_p);
+    }
+
+    void BlockComment(std::vector<Token>& tokens)
+    {
+        const char *start = m_p;
+        while (m_p < m_end)
+        {
+            if (*m_p == '*' && Peek(1) == '/')
+            {
+                AddCommentLine(tokens, start, m_p);
+                m_p += 2;
+                return;
+            }
+            if (*m_p == '\n')
+            {
+                AddCommentLine(tokens, start, m_p);
+                m_line++;
+                start = m_p + 1;
+            }
+            m_p++;
+        }
+        AddCommentLine(tokens, start, m_p);
+    }
+
+    void SkipToPHPCode()
+    {
+        while (m_p < m_end)
+        {
+            if (*m_p == '<' && Peek(1) == '?')
+            {
+                m_p += 2;
+                if (Peek() == '=')
+                    m_p++;
+                else if (m_end - m_p >= 3 && tolower(m_p[0]) == 'p' && tolower(m_p[1]) == 'h' && tolower(m_p[2]) == 'p')
+                    m_p += 3;
+                m_inCode = true;
+                return;
+            }
+            if (*m_p == '\n')
+                m_line++;
+            m_p++;
+        }
+    }
+
+    bool IsStringPrefix(const std::string& name) const
+    {
+        switch (m_lang)
+        {
+            case Language::C:
+            case Language::ObjC:
+                return name == "L" || name == "u" || name == "U" || name == "u8" ||
+                       name == "R" || name == "LR" || name == "uR" || name == "UR" || name == "u8R";
+            case Language::Python:
+            {
+                if (name.size() > 2)
+                    return false;
+                for (auto c: name)
+                {
+                    if (!strchr("rRuUbBfF", c))
+                        return false;
+                }
+                return true;
+            }
+            case Language::JavaScript:
+            case Language::PHP:
+                return false;
+        }
+        return false;
+    }
+
+    bool IsRegexAllowed(const std::vector<Token>& tokens) const
+    {
+        // A slash starts a regex literal unless it follows something that
+        // can end an expression:
+        for (auto i = tokens.rbegin(); i != tokens.rend(); ++i)
+        {
+            switch (i->type)
+            {
+                case Token::Comment:
+                    continue;
+                case Token::Name:
+                {
+                    static const std::set<std::string> operators = {
+                        "return", "typeof", "case", "do", "else", "in", "of", "new", "delete",
+                        "void", "throw", "instanceof", "yield", "await"
+                    };
+                    return operators.find(i->text) != operators.end();
+                }
+                case Token::Symbol:
+                    return i->text != ")" && i->text != "]" && i->text != "}";
+                default:
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    void RegexLiteral(std::vector<Token>& tokens)
+    {
+        m_p++;
+        bool inClass = false;
+        while (m_p < m_end && *m_p != '\n')
+        {
+            const char c = *m_p++;
+            if (c == '\\' && m_p < m_end && *m_p != '\n')
+                m_p++;
+            else if (c == '[')
+                inClass = true;
+            else if (c == ']')
+                inClass = false;
+            else if (c == '/' && !inClass)
+                break;
+        }
+        while (m_p < m_end && IsIdentChar((unsigned char)*m_p))
+            m_p++;
+        Add(tokens, Token::Other, "/regex/");
+    }
+
+    void HereDoc(std::vector<Token>& tokens)
+    {
+        const int line = m_line;
+        m_p += 3;
+        while (m_p < m_end && (*m_p == ' ' || *m_p == '\t'))
+            m_p++;
+        if (m_p < m_end && (*m_p == '"' || *m_p == '\''))
+            m_p++;
+        const char *start = m_p;
+        while (m_p < m_end && IsIdentChar((unsigned char)*m_p))
+            m_p++;
+        const std::string id(start, m_p);
+        if (id.empty())
+        {
+            Add(tokens, Token::Symbol, "<");
+            return;
+        }
+
+        // skip to the line containing only the closing identifier (possibly indented):
+        bool atLineStart = false;
+        while (m_p < m_end)
+        {
+            if (*m_p == '\n')
+            {
+                m_line++;
+                m_p++;
+                atLineStart = true;
+                continue;
+            }
+            if (atLineStart)
+            {
+                while (m_p < m_end && (*m_p == ' ' || *m_p == '\t'))
+                    m_p++;
+                if ((size_t)(m_end - m_p) >= id.size() && std::equal(id.begin(), id.end(), m_p) &&
+                    (m_p + id.size() == m_end || !IsIdentChar((unsigned char)m_p[id.size()])))
+                {
+                    m_p += id.size();
+                    break;
+                }
+                atLineStart = false;
+                continue;
+            }
+            m_p++;
+        }
+
+        tokens.push_back({Token::NonLiteralString, std::string(), line});
+    }
+
+    /// Reads escape sequence after backslash and appends it to @a out; returns false if not supported
+    bool Escape(std::string& out)
+    {
+        const char c = *m_p++;
+        switch (c)
+        {
+            case 'n': out += '\n'; return true;
+            case 't': out += '\t'; return true;
+            case 'r': out += '\r'; return true;
+            case 'f': out += '\f'; return true;
+            case 'v': out += '\v'; return true;
+            case 'a': out += '\a'; return true;
+            case 'b': out += '\b'; return true;
+            case 'e':
+                if (m_lang != Language::PHP)
+                    break;
+                out += '\x1b';
+                return true;
+            case '\\': case '\'': case '"': case '?': case '`': case '$':
+                out += c;
+                return true;
+            case '\r':
+                if (Peek() != '\n')
+                    break;
+                m_p++;
+                // fall through
+            case '\n':
+                m_line++;
+                return true;  // line continuation
+            case 'x':
+            {
+                unsigned long value = 0;
+                int digits = 0;
+                while (m_p < m_end && isxdigit((unsigned char)*m_p) && (m_lang == Language::C || m_lang == Language::ObjC || digits < 2))
+                {
+                    value = value * 16 + (isdigit((unsigned char)*m_p) ? *m_p - '0' : (tolower(*m_p) - 'a' + 10));
+                    m_p++;
+                    digits++;
+                }
+                if (!digits)
+                    return false;
+                if (m_lang == Language::C || m_lang == Language::ObjC || m_lang == Language::PHP)
+                    out += (char)value;  // raw byte
+                else
+                    AppendUTF8(out, value);
+                return true;
+            }
+            case 'u':
+            case 'U':
+            {
+                if (m_lang == Language::PHP && c == 'u' && Peek() != '{')
+                    break;
+                const bool braced = (Peek() == '{' && (m_lang == Language::JavaScript || m_lang == Language::PHP));
+                if (braced)
+                    m_p++;
+                const int maxDigits = braced ? 6 : (c == 'u' ? 4 : 8);
+                unsigned long value = 0;
+                int digits = 0;
+                while (m_p < m_end && isxdigit((unsigned char)*m_p) && digits < maxDigits)
+                {
+                    value = value * 16 + (isdigit((unsigned char)*m_p) ? *m_p - '0' : (tolower(*m_p) - 'a' + 10));
+                    m_p++;
+                    digits++;
+                }
+                if (braced && Peek() == '}')
+                    m_p++;
+                else if (braced || digits != maxDigits)
+                    return false;
+                // combine UTF-16 surrogate pairs in JS/Python:
+                if (value >= 0xD800 && value <= 0xDBFF && c == 'u' && !braced &&
+                    m_end - m_p >= 6 && m_p[0] == '\\' && m_p[1] == 'u')
+                {
+                    const unsigned long low = strtoul(std::string(m_p + 2, m_p + 6).c_str(), nullptr, 16);
+                    if (low >= 0xDC00 && low <= 0xDFFF)
+                    {
+                        value = 0x10000 + ((value - 0xD800) << 10) + (low - 0xDC00);
+                        m_p += 6;
+                    }
+                }
+                AppendUTF8(out, value);
+                return true;
+            }
+            default:
+                if (c >= '0' && c <= '7')
+                {
+                    unsigned long value = c - '0';
+                    for (int digits = 1; digits < 3 && m_p < m_end && *m_p >= '0' && *m_p <= '7'; digits++)
+                        value = value * 8 + (*m_p++ - '0');
+                    if (m_lang == Language::Python || m_lang == Language::JavaScript)
+                        AppendUTF8(out, value);
+                    else
+                        out += (char)value;
+                    return true;
+                }
+                break;
+        }
+
+        if (m_lang == Language::Python || m_lang == Language::PHP)
+        {
+            // unknown escapes are kept verbatim in these languages
+            out += '\\';
+            out += c;
+            return true;
+        }
+        return false;
+    }
+
+    void StringLiteral(std::vector<Token>& tokens, const std::string& prefix)
+    {
+        const int line = m_line;
+        const char quote = *m_p;
+        bool raw = false, literal = true;
+
+        switch (m_lang)
+        {
+            case Language::C:
+            case Language::ObjC:
+                if (!prefix.empty() && prefix.back() == 'R')
+                {
+                    RawCString(tokens, line);
+                    return;
+                }
+                break;
+            case Language::Python:
+                for (auto c: prefix)
+                {
+                    if (c == 'r' || c == 'R')
+                        raw = true;
+                    else if (c == 'f' || c == 'F' || c == 'b' || c == 'B')
+                        literal = false;
+                }
+                break;
+            case Language::JavaScript:
+            case Language::PHP:
+                break;
+        }
+
+        bool triple = false;
+        if (m_lang == Language::Python && Peek(1) == quote && Peek(2) == quote)
+        {
+            triple = true;
+            m_p += 2;
+        }
+        m_p++;
+
+        // PHP's single-quoted strings only know \\ and \' escapes:
+        const bool simple = (m_lang == Language::PHP && quote == '\'');
+        // only triple-quoted Python strings, PHP and JS template strings may span lines:
+        const bool multiline = triple || m_lang == Language::PHP || quote == '`';
+
+        std::string value;
+        bool terminated = false;
+        while (m_p < m_end)
+        {
+            const char c = *m_p;
+            if (c == quote && (!triple || (Peek(1) == quote && Peek(2) == quote)))
+            {
+                m_p += triple ? 3 : 1;
+                terminated = true;
+                break;
+            }
+            if (c == '\n')
+            {
+                if (!multiline)
+                    break;
+                m_line++;
+            }
+            if (c == '\\' && m_p + 1 < m_end)
+            {
+                if (raw || simple)
+                {
+                    const char next = m_p[1];
+                    if (!raw && next != '\\' && next != '\'')
+                    {
+                        value += c;
+                        m_p++;
+                        continue;
+                    }
+                    if (raw)
+                        value += c;
+                    if (next == '\n')
+                        m_line++;
+                    value += next;
+                    m_p += 2;
+                    continue;
+                }
+                m_p++;
+                if (!Escape(value))
+                    literal = false;
+                continue;
+            }
+            if (quote == '`' && c == '$' && Peek(1) == '{')
+            {
+                literal = false;
+                SkipTemplateSubstitution();
+                continue;
+            }
+            if (m_lang == Language::PHP && quote == '"' && c == '$' && (IsIdentStart(Peek(1)) || Peek(1) == '{'))
+                literal = false;  // variable interpolation
+            value += c;
+            m_p++;
+        }
+
+        if ((m_lang == Language::C || m_lang == Language::ObjC) && quote == '\'')
+            tokens.push_back({Token::Other, std::string(), line});  // character literal
+        else
+            tokens.push_back({terminated && literal ? Token::String : Token::NonLiteralString, std::move(value), line});
+    }
+
+    void RawCString(std::vector<Token>& tokens, int line)
+    {
+        // R"delim( ... )delim"
+        m_p++;
+        const char *delimStart = m_p;
+        while (m_p < m_end && *m_p != '(' && *m_p != '\n')
+            m_p++;
+        if (m_p == m_end || *m_p != '(')
+        {
+            tokens.push_back({Token::NonLiteralString, std::string(), line});
+            return;
+        }
+        const std::string terminator = ")" + std::string(delimStart, m_p) + "\"";
+        m_p++;
+        const char *start = m_p;
+        while (m_p < m_end)
+        {
+            if ((size_t)(m_end - m_p) >= terminator.size() && std::equal(terminator.begin(), terminator.end(), m_p))
+            {
+                std::string value(start, m_p);
+                m_p += terminator.size();
+                tokens.push_back({Token::String, std::move(value), line});
+                return;
+            }
+            if (*m_p == '\n')
+                m_line++;
+            m_p++;
+        }
+        tokens.push_back({Token::NonLiteralString, std::string(), line});
+    }
+
+    void SkipTemplateSubstitution()
+    {
+        // skip "${ ... }", including nested braces and strings
+        m_p += 2;
+        int depth = 1;
+        while (m_p < m_end && depth > 0)
+        {
+            const char c = *m_p++;
+            if (c == '{')
+                depth++;
+            else if (c == '}')
+                depth--;
+            else if (c == '\n')
+                m_line++;
+            else if (c == '"' || c == '\'' || c == '`')
+            {
+                while (m_p < m_end && *m_p != c)
+                {
+                    if (*m_p == '\\' && m_p + 1 < m_end)
+                        m_p++;
+                    if (*m_p == '\n')
+                        m_line++;
+                    m_p++;
+                }
+                if (m_p < m_end)
+                    m_p++;
+            }
+        }
+    }
+
+    Language m_lang;
+    const char *m_p, *m_end;
+    int m_line;
+    bool m_inCode;
+};
+
+
+/// Extracted message
+struct Message
+{
+    bool hasContext = false;
+    std::string context, msgid, plural;
+    std::vector<std::string> comments;
+    std::vector<std::string> references;
+    std::set<std::string> flags;
+};
+
+
+/// Collection of extracted messages, in order of their first occurrence
+class MessagesList
+{
+public:
+    void Add(Message&& msg)
+    {
+        auto key = msg.hasContext ? msg.context + '\x04' + msg.msgid : msg.msgid;
+        auto existing = m_index.find(key);
+        if (existing == m_index.end())
+        {
+            m_index.emplace(std::move(key), m_messages.size());
+            m_messages.push_back(std::move(msg));
+            return;
+        }
+
+        auto& m = m_messages[existing->second];
+        if (m.plural.empty())
+            m.plural = msg.plural;
+        for (auto& c: msg.comments)
+        {
+            if (std::find(m.comments.begin(), m.comments.end(), c) == m.comments.end())
+                m.comments.push_back(c);
+        }
+        for (auto& r: msg.references)
+        {
+            if (std::find(m.references.begin(), m.references.end(), r) == m.references.end())
+                m.references.push_back(r);
+        }
+        m.flags.insert(msg.flags.begin(), msg.flags.end());
+    }
+
+    bool empty() const { return m_messages.empty(); }
+
+    /// Writes the messages as POT file; returns false on I/O error
+    bool Write(const wxString& filename) const
+    {
+        std::string out;
+        out += "msgid \"\"\n"
+               "msgstr \"\"\n"
+               "\"Content-Type: text/plain; charset=UTF-8\\n\"\n"
+               "\"Content-Transfer-Encoding: 8bit\\n\"\n";
+
+        for (auto& m: m_messages)
+        {
+            out += '\n';
+            for (auto& c: m.comments)
+                out += "#. " + c + '\n';
+            if (!m.references.empty())
+            {
+                out += "#:";
+                for (auto& r: m.references)
+                    out += ' ' + r;
+                out += '\n';
+            }
+            if (!m.flags.empty())
+            {
+                out += "#";
+                for (auto& f: m.flags)
+                    out += ", " + f;
+                out += '\n';
+            }
+            if (m.hasContext)
+                out += "msgctxt \"" + EscapeCString(m.context) + "\"\n";
+            out += "msgid \"" + EscapeCString(m.msgid) + "\"\n";
+            if (!m.plural.empty())
+            {
+                out += "msgid_plural \"" + EscapeCString(m.plural) + "\"\n";
+                out += "msgstr[0] \"\"\n"
+                       "msgstr[1] \"\"\n";
+            }
+            else
+            {
+                out += "msgstr \"\"\n";
+            }
+        }
+
+        wxFFile f(filename, "wb");
+        return f.IsOpened() && f.Write(out.data(), out.size()) == out.size() && f.Close();
+    }
+
+private:
+    std::vector<Message> m_messages;
+    std::unordered_map<std::string, size_t> m_index;
+};
+
+
+/// Finds keyword calls in tokenized file and extracts messages from them
+class Parser
+{
+public:
+    Parser(Language lang, const KeywordsMap& keywords, const std::vector<Token>& tokens,
+           const std::string& reference, MessagesList& messages)
+        : m_lang(lang), m_keywords(keywords), m_tokens(tokens), m_reference(reference), m_messages(messages),
+          m_pos(0), m_lastCommentLine(-1), m_lastCodeLine(-1)
+    {}
+
+    void Run()
+    {
+        for (;;)
+        {
+            auto& t = Next();
+            if (t.type == Token::End)
+                break;
+            if (t.type == Token::Name)
+                MaybeKeywordCall(t);
+        }
+    }
+
+private:
+    /// Returns next non-comment token, collecting comments before it
+    const Token& Next()
+    {
+        while (m_tokens[m_pos].type == Token::Comment)
+        {
+            auto& c = m_tokens[m_pos++];
+            if (m_lastCodeLine > m_lastCommentLine && m_lastCodeLine < c.line)
+                m_comments.clear();
+            m_comments.push_back(c.text);
+            m_lastCommentLine = c.line;
+        }
+
+        auto& t = m_tokens[m_pos];
+        if (t.type != Token::End)
+            m_pos++;
+        // comments only apply to the line of code immediately following them:
+        if (m_lastCodeLine > m_lastCommentLine && t.line > m_lastCodeLine)
+            m_comments.clear();
+        m_lastCodeLine = t.line;
+        return t;
+    }
+
+    const Token& PeekNext(size_t offset = 0) const
+    {
+        size_t pos = m_pos;
+        for (;;)
+        {
+            while (m_tokens[pos].type == Token::Comment)
+                pos++;
+            if (offset == 0 || m_tokens[pos].type == Token::End)
+                return m_tokens[pos];
+            offset--;
+            pos++;
+        }
+    }
+
+    static bool IsSymbol(const Token& t, const char *s)
+    {
+        return t.type == Token::Symbol && t.text == s;
+    }
+
+    /// Checks if @a name is a keyword followed by its arguments and processes it; returns true if it was
+    bool MaybeKeywordCall(const Token& name)
+    {
+        std::string qualified = name.text;
+        if (m_lang == Language::C || m_lang == Language::ObjC)
+        {
+            while (IsSymbol(PeekNext(), "::") && PeekNext(1).type == Token::Name)
+            {
+                Next();
+                qualified += "::" + Next().text;
+            }
+        }
+
+        auto kw = m_keywords.find(qualified);
+        if (kw == m_keywords.end() && qualified != name.text)
+            kw = m_keywords.find(qualified.substr(qualified.rfind(':') + 1));
+        if (kw == m_keywords.end() || !IsSymbol(PeekNext(), "("))
+            return false;
+
+        // take comments preceding the keyword:
+        std::vector<std::string> comments;
+        for (size_t i = 0; i < m_comments.size(); i++)
+        {
+            if (m_comments[i].compare(0, sizeof(TRANSLATORS_TAG) - 1, TRANSLATORS_TAG) == 0)
+            {
+                comments.assign(m_comments.begin() + i, m_comments.end());
+                break;
+            }
+        }
+
+        Next();  // "("
+        ParseArguments(kw->second, comments);
+        return true;
+    }
+
+    struct Argument
+    {
+        bool literal = true;
+        bool hasString = false;
+        bool pendingConcat = false;
+        bool lastWasString = false;
+        std::string value;
+        int line = 0;
+    };
+
+    void ParseArguments(const KeywordArgs& kw, std::vector<std::string>& comments)
+    {
+        std::vector<Argument> args;
+        Argument arg;
+        bool empty = true;
+        int depth = 1;
+
+        for (;;)
+        {
+            auto& t = Next();
+            if (t.type == Token::End)
+                return;
+
+            if (t.type == Token::Name)
+            {
+                empty = false;
+                if (MaybeKeywordCall(t))
+                {
+                    arg.literal = false;
+                    continue;
+                }
+            }
+
+            if (t.type == Token::Symbol && t.text.size() == 1)
+            {
+                const char c = t.text[0];
+                if (c == '(' || c == '[' || c == '{')
+                {
+                    depth++;
+                    arg.literal = false;
+                    empty = false;
+                    continue;
+                }
+                if (c == ')' || c == ']' || c == '}')
+                {
+                    if (--depth == 0)
+                        break;
+                    continue;
+                }
+                if (c == ',' && depth == 1)
+                {
+                    args.push_back(std::move(arg));
+                    arg = Argument();
+                    continue;
+                }
+                if (c == '+' && depth == 1 && m_lang == Language::JavaScript && arg.lastWasString)
+                {
+                    arg.lastWasString = false;
+                    arg.pendingConcat = true;
+                    continue;
+                }
+            }
+
+            empty = false;
+            if (depth > 1)
+                continue;
+
+            if (t.type == Token::String)
+            {
+                if (!arg.hasString)
+                {
+                    if (arg.pendingConcat)
+                        arg.literal = false;
+                    arg.hasString = true;
+                    arg.value = t.text;
+                    arg.line = t.line;
+                }
+                else if (arg.pendingConcat || (arg.lastWasString && m_lang != Language::JavaScript && m_lang != Language::PHP))
+                {
+                    arg.value += t.text;
+                }
+                else
+                {
+                    arg.literal = false;
+                }
+                arg.lastWasString = true;
+                arg.pendingConcat = false;
+                continue;
+            }
+
+            arg.literal = false;
+            arg.lastWasString = false;
+        }
+
+        if (!empty || !args.empty())
+            args.push_back(std::move(arg));
+
+        if (kw.total && (int)args.size() != kw.total)
+            return;
+
+        auto get = [&args](int pos) -> const Argument*
+        {
+            if (pos <= 0 || pos > (int)args.size())
+                return nullptr;
+            auto& a = args[pos - 1];
+            return (a.literal && a.hasString && !a.pendingConcat) ? &a : nullptr;
+        };
+
+        auto singular = get(kw.singular);
+        if (!singular || (kw.plural && !get(kw.plural)) || (kw.context && !get(kw.context)))
+            return;
+        if (singular->value.empty())
+            return;  // reserved for the header, xgettext ignores it too
+
+        Message msg;
+        msg.msgid = singular->value;
+        if (kw.plural)
+            msg.plural = get(kw.plural)->value;
+        if (kw.context)
+        {
+            msg.hasContext = true;
+            msg.context = get(kw.context)->value;
+        }
+
+        if (!IsValidUTF8(msg.msgid) || !IsValidUTF8(msg.plural) || !IsValidUTF8(msg.context))
+        {
+            wxLogWarning(_("%s:%d: String is not valid UTF-8 and was skipped."),
+                         wxString::FromUTF8(m_reference), singular->line);
+            return;
+        }
+
+        msg.references.push_back(m_reference + ':' + std::to_string(singular->line));
+        msg.comments = std::move(comments);
+        comments.clear();
+
+        const char *format = GetFormatFlag(msg.msgid) ? GetFormatFlag(msg.msgid) : GetFormatFlag(msg.plural);
+        if (format)
+            msg.flags.insert(format);
+
+        m_messages.Add(std::move(msg));
+    }
+
+    const char *GetFormatFlag(const std::string& s) const
+    {
+        if (s.find('%') == std::string::npos)
+            return nullptr;
+        switch (m_lang)
+        {
+            case Language::C:
+                return IsCFormatString(s) ? "c-format" : nullptr;
+            case Language::ObjC:
+                return IsCFormatString(s, /*objc=*/true) ? "objc-format" : nullptr;
+            case Language::Python:
+                return IsPythonFormatString(s) ? "python-format" : nullptr;
+            case Language::JavaScript:
+                return IsPHPOrJSFormatString(s, "bcdeEfFgGijosxX") ? "javascript-format" : nullptr;
+            case Language::PHP:
+                return IsPHPOrJSFormatString(s, "bcdeEfFgGosuxX") ? "php-format" : nullptr;
+        }
+        return nullptr;
+    }
+
+    Language m_lang;
+    const KeywordsMap& m_keywords;
+    const std::vector<Token>& m_tokens;
+    const std::string& m_reference;
+    MessagesList& m_messages;
+
+    size_t m_pos;
+    std::vector<std::string> m_comments;
+    int m_lastCommentLine, m_lastCodeLine;
+};
+
+} // anonymous namespace
+
+
+/// Extractor implemented natively, without using external tools
+class NativeExtractor : public Extractor
+{
+public:
+    NativeExtractor(Language lang, const KeywordsMap& keywords)
+        : m_lang(lang), m_keywords(keywords)
+    {
+        switch (lang)
+        {
+            case Language::C:
+                for (auto ext: {"c", "h", "C", "c++", "cc", "cxx", "cpp", "hh", "hxx", "hpp"})
+                    RegisterExtension(ext);
+                break;
+            case Language::ObjC:
+                RegisterExtension("m");
+                break;
+            case Language::Python:
+                RegisterExtension("py");
+                break;
+            case Language::JavaScript:
+                for (auto ext: {"js", "mjs", "cjs", "ts"})
+                    RegisterExtension(ext);
+                break;
+            case Language::PHP:
+                for (auto ext: {"php", "php3", "php4", "phtml", "ctp"})
+                    RegisterExtension(ext);
+                break;
+        }
+    }
+
+    wxString GetId() const override
+    {
+        switch (m_lang)
+        {
+            case Language::C:           return "native-c";
+            case Language::ObjC:        return "native-objc";
+            case Language::Python:      return "native-python";
+            case Language::JavaScript:  return "native-javascript";
+            case Language::PHP:         return "native-php";
+        }
+        return "native";
+    }
+
+    wxString Extract(TempDirectory& tmpdir,
+                     const SourceCodeSpec& sourceSpec,
+                     const std::vector<wxString>& files,
+                     dispatch::cancellation_token_ptr cancellationToken) const override
+    {
+        MessagesList messages;
+
+        for (auto& file: files)
+        {
+            CheckIfCancelled(cancellationToken);
+
+            wxFileName fn(file);
+            if (fn.IsRelative())
+                fn.MakeAbsolute(sourceSpec.BasePath);
+
+            std::string content;
+            wxFFile f(fn.GetFullPath(), "rb");
+            if (!f.IsOpened())
+                throw ExtractionException(ExtractionError::Unspecified, file);
+            const wxFileOffset length = f.Length();
+            if (length > 0)
+            {
+                content.resize((size_t)length);
+                if (f.Read(&content[0], content.size()) != content.size())
+                    throw ExtractionException(ExtractionError::Unspecified, file);
+            }
+            f.Close();
+
+            auto reference = file.utf8_string();
+#ifdef __WXMSW__
+            std::replace(reference.begin(), reference.end(), '\\', '/');
+#endif
+
+            const char *begin = content.data();
+            // skip UTF-8 BOM:
+            if (content.size() >= 3 && memcmp(begin, "\xEF\xBB\xBF", 3) == 0)
+                begin += 3;
+
+            auto tokens = Lexer(m_lang, begin, content.data() + content.size()).Tokenize();
+            Parser(m_lang, m_keywords, tokens, reference, messages).Run();
+        }
+
+        if (messages.empty())
+            return wxString();
+
+        auto outfile = tmpdir.CreateFileName("native.pot");
+        if (!messages.Write(outfile))
+            throw ExtractionException(ExtractionError::Unspecified);
+        return outfile;
+    }
+
+    bool CanExtractInParallel() const override { return true; }
+
+    wxString GetCacheSignature(const SourceCodeSpec& /*sourceSpec*/) const override
+    {
+        // keywords are all that affects the output:
+        std::set<std::string> keywords;
+        for (auto& kw: m_keywords)
+        {
+            keywords.insert(kw.first + ':' + std::to_string(kw.second.singular) + ',' + std::to_string(kw.second.plural) +
+                            ',' + std::to_string(kw.second.context) + ',' + std::to_string(kw.second.total));
+        }
+        wxString sig = GetId();
+        for (auto& kw: keywords)
+            sig += "\n" + wxString::FromUTF8(kw);
+        return sig;
+    }
+
+private:
+    Language m_lang;
+    KeywordsMap m_keywords;
+};
+
+
+void Extractor::CreateNativeExtractors(Extractor::ExtractorsList& into, const SourceCodeSpec& sources)
+{
+    // Customized xgettext invocations or non-UTF-8 sources are left to xgettext:
+    if (sources.XHeaders.find("X-Poedit-Flags-xgettext") != sources.XHeaders.end())
+        return;
+    if (!sources.Charset.empty())
+    {
+        const auto charset = sources.Charset.Upper();
+        if (charset != "UTF-8" && charset != "UTF8" && charset != "ASCII" && charset != "US-ASCII")
+            return;
+    }
+
+    bool useDefaults = true;
+    KeywordsMap custom;
+    for (auto& spec: sources.Keywords)
+    {
+        if (spec.empty())
+        {
+            useDefaults = false;  // same as xgettext's -k
+            continue;
+        }
+        std::string name;
+        KeywordArgs args;
+        if (!ParseKeywordSpec(spec.utf8_string(), name, args))
+        {
+            wxLogTrace("poedit.extractor", "keyword '%s' not supported natively, using xgettext", spec);
+            return;
+        }
+        custom[name] = args;
+    }
+
+    auto create = [&](Language lang, std::initializer_list<const char * const *> defaults)
+    {
+        KeywordsMap keywords;
+        if (useDefaults)
+        {
+            for (auto list: defaults)
+            {
+                for (auto k = list; *k; k++)
+                {
+                    std::string name;
+                    KeywordArgs args;
+                    if (ParseKeywordSpec(*k, name, args))
+                        keywords[name] = args;
+                }
+            }
+        }
+        for (auto& kw: custom)
+            keywords[kw.first] = kw.second;
+
+        into.push_back(std::make_shared<NativeExtractor>(lang, keywords));
+    };
+
+    create(Language::C, {KEYWORDS_C});
+    create(Language::ObjC, {KEYWORDS_C, KEYWORDS_OBJC});
+    create(Language::Python, {KEYWORDS_PYTHON});
+    create(Language::JavaScript, {KEYWORDS_JAVASCRIPT});
+    create(Language::PHP, {KEYWORDS_PHP});
+}
@@ -29,9 +29,13 @@
 #include "str_helpers.h"
 
 #include <wx/fswatcher.h>
+#include <wx/timer.h>
 
 #include <algorithm>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 
@@ -106,6 +110,8 @@ namespace
 
 const int MONITORING_FLASG = wxFSW_EVENT_CREATE | wxFSW_EVENT_RENAME | wxFSW_EVENT_MODIFY;
 
+// Single watcher shared by all monitored files; directories are reference
+// counted, because several open files may live in the same directory.
 class FSWatcher
 {
 public:
@@ -118,26 +124,20 @@ public:
 
     void Add(const wxFileName& dir)
     {
-        if (m_watcher)
-        {
+        if (m_dirs[dir.GetFullPath().ToStdWstring()]++ == 0 && m_watcher)
             m_watcher->Add(dir, MONITORING_FLASG);
-        }
-        else
-        {
-            m_pending.push_back(dir);
-            return;
-        }
     }
 
     void Remove(const wxFileName& dir)
     {
-        if (m_watcher)
-        {
-            m_watcher->Remove(dir);
-        }
-        else
+        auto i = m_dirs.find(dir.GetFullPath().ToStdWstring());
+        if (i == m_dirs.end())
+            return;
+        if (--i->second == 0)
         {
-            m_pending.erase(std::remove(m_pending.begin(), m_pending.end(), dir), m_pending.end());
+            m_dirs.erase(i);
+            if (m_watcher)
+                m_watcher->Remove(dir);
         }
     }
 
@@ -156,9 +156,8 @@ public:
             FileMonitor::NotifyFileChanged(fn.GetFullPath());
         });
 
-        for (auto& dir : m_pending)
-            Add(dir);
-        m_pending.clear();
+        for (auto& dir : m_dirs)
+            m_watcher->Add(wxFileName::DirName(dir.first), MONITORING_FLASG);
     }
 
     static void CleanUp() { ms_instance.reset(); }
@@ -166,7 +165,7 @@ public:
 private:
     FSWatcher() {}
 
-    std::vector<wxFileName> m_pending;
+    std::unordered_map<std::wstring, int> m_dirs;
     std::unique_ptr<wxFileSystemWatcher> m_watcher;
 
     static std::unique_ptr<FSWatcher> ms_instance;
@@ -197,6 +196,118 @@ private:
 #endif // !__WXOSX__
 
 
+namespace
+{
+
+// Keeps track of all FileMonitor instances, indexed by the monitored path,
+// and dispatches (debounced) change notifications to them.
+class MonitorsRegistry
+{
+public:
+    static MonitorsRegistry& Get()
+    {
+        if (!ms_instance)
+            ms_instance.reset(new MonitorsRegistry);
+        return *ms_instance;
+    }
+
+    static void CleanUp() { ms_instance.reset(); }
+
+    static std::wstring Key(const wxFileName& fn)
+    {
+        wxString key = fn.GetFullPath();
+#ifdef __WXMSW__
+        key.MakeLower();
+#endif
+        return key.ToStdWstring();
+    }
+
+    void Subscribe(const std::wstring& key, const wxFileName& fn, FileMonitor *monitor)
+    {
+        auto& entry = m_entries[key];
+        if (!entry.impl)
+            entry.impl = std::make_unique<FileMonitor::Impl>(fn);
+        entry.monitors.push_back(monitor);
+    }
+
+    void Unsubscribe(const std::wstring& key, FileMonitor *monitor)
+    {
+        auto i = m_entries.find(key);
+        if (i == m_entries.end())
+            return;
+        auto& monitors = i->second.monitors;
+        monitors.erase(std::remove(monitors.begin(), monitors.end(), monitor), monitors.end());
+        if (monitors.empty())
+            m_entries.erase(i);
+    }
+
+    void Notify(const wxString& path)
+    {
+        auto key = Key(wxFileName(path));
+        if (m_entries.find(key) == m_entries.end())
+            return;  // not one of ours, e.g. another file in the same directory
+
+        m_pending.insert(key);
+        // wait for the burst of events (e.g. editor writing a temp file and
+        // renaming it) to settle down before doing anything:
+        m_timer.StartOnce(DEBOUNCE_DELAY);
+    }
+
+private:
+    static const int DEBOUNCE_DELAY = 300; // ms
+
+    MonitorsRegistry()
+    {
+        m_timer.Bind(wxEVT_TIMER, [=](wxTimerEvent&){ Flush(); });
+    }
+
+    void Flush()
+    {
+        std::unordered_set<std::wstring> pending;
+        pending.swap(m_pending);
+
+        for (auto& key: pending)
+        {
+            auto i = m_entries.find(key);
+            if (i == m_entries.end())
+                continue;
+            // handlers may (un)subscribe monitors, so work on a copy:
+            auto monitors = i->second.monitors;
+            for (auto m: monitors)
+            {
+                if (IsSubscribed(key, m))
+                    m->OnFileChanged();
+            }
+        }
+    }
+
+    bool IsSubscribed(const std::wstring& key, FileMonitor *monitor) const
+    {
+        auto i = m_entries.find(key);
+        if (i == m_entries.end())
+            return false;
+        auto& monitors = i->second.monitors;
+        return std::find(monitors.begin(), monitors.end(), monitor) != monitors.end();
+    }
+
+    struct Entry
+    {
+        std::unique_ptr<FileMonitor::Impl> impl;
+        std::vector<FileMonitor*> monitors;
+    };
+
+    std::unordered_map<std::wstring, Entry> m_entries;
+    std::unordered_set<std::wstring> m_pending;
+    wxTimer m_timer;
+
+    static std::unique_ptr<MonitorsRegistry> ms_instance;
+};
+
+std::unique_ptr<MonitorsRegistry> MonitorsRegistry::ms_instance;
+
+} // anonymous namespace
+
+
 void FileMonitor::EventLoopStarted()
 {
 #ifndef __WXOSX__
@@ -206,13 +317,15 @@ void FileMonitor::EventLoopStarted()
 
 void FileMonitor::CleanUp()
 {
+    MonitorsRegistry::CleanUp();
 #ifndef __WXOSX__
     FSWatcher::CleanUp();
 #endif
 }
 
 
-FileMonitor::FileMonitor() : m_isRespondingGuard(false)
+FileMonitor::FileMonitor(std::function<void()> onChanged)
+    : m_onChanged(onChanged), m_isRespondingGuard(false)
 {
 }
 
@@ -226,7 +339,7 @@ void FileMonitor::SetFile(wxFileName file)
     // unmonitor first (needed even if the filename didn't change)
     if (file == m_file)
     {
-        m_loadTime = m_file.GetModificationTime();
+        UpdateLoadedState();
         return;
     }
 
@@ -236,20 +349,45 @@ void FileMonitor::SetFile(wxFileName file)
     if (!m_file.IsOk())
         return;
 
-    m_impl = std::make_unique<Impl>(m_file);
-    m_loadTime = m_file.GetModificationTime();
+    m_file.MakeAbsolute();
+    MonitorsRegistry::Get().Subscribe(MonitorsRegistry::Key(m_file), m_file, this);
+    UpdateLoadedState();
 }
 
 void FileMonitor::Reset()
 {
-    m_impl.reset();
+    if (m_file.IsOk())
+        MonitorsRegistry::Get().Unsubscribe(MonitorsRegistry::Key(m_file), this);
     m_file.Clear();
 }
 
-void FileMonitor::NotifyFileChanged(const wxString& path)
+void FileMonitor::UpdateLoadedState()
+{
+    m_loadTime = m_file.GetModificationTime();
+    m_loadSize = m_file.GetSize();
+}
+
+bool FileMonitor::WasModifiedOnDisk() const
 {
-    auto window = PoeditFrame::Find(path);
-    if (window)
-        window->ReloadFileIfChanged();
+    if (!m_file.IsOk())
+        return false;
+    if (!m_file.FileExists())
+        return false;
+    return m_loadTime != m_file.GetModificationTime() || m_loadSize != m_file.GetSize();
 }
 
+void FileMonitor::OnFileChanged()
+{
+    // spurious notifications are common (e.g. metadata changes, network
+    // drives), so only bother the owner if the content possibly changed:
+    if (m_isRespondingGuard || !WasModifiedOnDisk())
+        return;
+
+    if (m_onChanged)
+        m_onChanged();
+}
+
+void FileMonitor::NotifyFileChanged(const wxString& path)
+{
+    MonitorsRegistry::Get().Notify(path);
+}
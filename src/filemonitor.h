@@ -31,25 +31,28 @@
 
 #include <wx/filename.h>
 
+#include <functional>
 #include <memory>
 
 
+/**
+    Monitors a file for changes done by other applications.
+
+    All monitors share a single OS-level watch per file and change
+    notifications are coalesced, so that e.g. an editor saving the file in
+    several steps results in a single notification. The handler is only
+    called if the file's modification time or size actually changed.
+ */
 class FileMonitor
 {
 public:
-    FileMonitor();
+    /// @a onChanged is called on the main thread when the file changes
+    explicit FileMonitor(std::function<void()> onChanged);
     ~FileMonitor();
 
     void SetFile(wxFileName file);
 
-    bool WasModifiedOnDisk() const
-    {
-        if (!m_file.IsOk())
-            return false;
-        if (!m_file.FileExists())
-            return false;
-        return m_loadTime != m_file.GetModificationTime();
-    }
+    bool WasModifiedOnDisk() const;
 
     // if true is returned, _must_ call StopRespondingToEvent() afterwards
     bool ShouldRespondToFileChange()
@@ -92,17 +95,18 @@ public:
     // the following is public only for the needs of filemonitor.cpp implementations:
     class Impl;
     static void NotifyFileChanged(const wxString& path);
+    void OnFileChanged();
 
 private:
     void Reset();
+    void UpdateLoadedState();
 
 private:
+    std::function<void()> m_onChanged;
     bool m_isRespondingGuard;
-    wxString m_monitoredPath;
-    wxFileName m_file, m_dir;
+    wxFileName m_file;
     wxDateTime m_loadTime;
-
-    std::unique_ptr<Impl> m_impl;
+    wxULongLong m_loadSize;
 };
 
 
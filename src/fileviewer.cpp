@@ -48,6 +48,8 @@
 #include <wx/msw/webview_ie.h>
 #endif
 
+#include <algorithm>
+#include <cstring>
 #include <unordered_map>
 
 #include "customcontrols.h"
@@ -64,7 +66,20 @@ const int FRAME_STYLE = wxDEFAULT_FRAME_STYLE | wxFRAME_TOOL_WINDOW;
 const int FRAME_STYLE = wxDEFAULT_FRAME_STYLE;
 #endif
 
-wxString FileToHTMLMarkup(const wxTextFile& file, const wxString& ext, size_t lineno);
+// How many lines around the referenced line to render initially:
+const size_t CONTEXT_LINES = 500;
+// How many lines to add when scrolled to the beginning or end of rendered window:
+const size_t MORE_LINES = 1000;
+// How many rendered references to keep:
+const size_t MAX_CACHED_REFERENCES = 8;
+
+// Prefix of pseudo-URLs used by the page to ask for more lines:
+const char *LOAD_MORE_URL = "poedit-more:";
+
+std::string FilenameToLanguage(const std::string& ext);
+wxString FileToHTMLMarkup(const SourceFileContent& file, const wxString& language, size_t lineno, size_t from, size_t to);
+wxString LinesToHTML(const SourceFileContent& file, size_t from, size_t to);
+wxString ToJSStringLiteral(const wxString& s);
 
 extern const char *HTML_POEDIT_CSS;
 extern const char *SVG_ICON;
@@ -72,6 +87,90 @@ extern const char *SVG_ICON;
 } // anonymous namespace
 
 
+/**
+    Lines of a source file.
+
+    The file is memory-mapped and lines are decoded only when needed, so that
+    opening huge files is cheap. Files in encodings that can't be processed
+    this way (UTF-16) are read with wxTextFile instead.
+ */
+class SourceFileContent
+{
+public:
+    /// Returns nullptr if the file cannot be read.
+    static std::shared_ptr<SourceFileContent> Open(const wxString& filename)
+    {
+        auto file = std::make_shared<SourceFileContent>();
+
+        auto map = std::make_unique<MappedFile>(filename);
+        if (map->IsOk() && !HasUTF16BOM(map->data(), map->size()))
+        {
+            const char *data = map->data();
+            const size_t size = map->size();
+
+            size_t pos = 0;
+            if (size >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0)
+                pos = 3;
+            file->m_lineStarts.push_back(pos);
+            while (auto nl = (const char*)memchr(data + pos, '\n', size - pos))
+            {
+                pos = nl - data + 1;
+                file->m_lineStarts.push_back(pos);
+            }
+            // trailing newline doesn't start another line:
+            if (file->m_lineStarts.size() > 1 && file->m_lineStarts.back() == size)
+                file->m_lineStarts.pop_back();
+
+            file->m_map = std::move(map);
+        }
+        else
+        {
+            wxTextFile text;
+            if (!text.Open(filename))
+                return nullptr;
+            for (size_t i = 0; i < text.GetLineCount(); i++)
+                file->m_lines.push_back(text[i]);
+        }
+
+        return file;
+    }
+
+    size_t GetLineCount() const
+    {
+        return m_map ? m_lineStarts.size() : m_lines.size();
+    }
+
+    wxString GetLine(size_t i) const
+    {
+        if (!m_map)
+            return m_lines[i];
+
+        const char *start = m_map->data() + m_lineStarts[i];
+        const char *end = m_map->data() + (i + 1 < m_lineStarts.size() ? m_lineStarts[i + 1] : m_map->size());
+        while (end > start && (end[-1] == '\n' || end[-1] == '\r'))
+            end--;
+        if (start == end)
+            return wxString();
+
+        // fall back to Latin-1 for legacy 8-bit files, like wxTextFile does:
+        auto line = wxString::FromUTF8(start, end - start);
+        if (line.empty())
+            line = wxString(start, wxConvISO8859_1, end - start);
+        return line;
+    }
+
+private:
+    static bool HasUTF16BOM(const char *data, size_t size)
+    {
+        return size >= 2 && ((data[0] == '\xFF' && data[1] == '\xFE') || (data[0] == '\xFE' && data[1] == '\xFF'));
+    }
+
+    std::unique_ptr<MappedFile> m_map;
+    std::vector<size_t> m_lineStarts;
+    std::vector<wxString> m_lines;
+};
+
+
 #ifdef __WXMSW__
 struct FileViewer::TempFile
 {
@@ -167,6 +266,15 @@ FileViewer::FileViewer(wxWindow*)
     m_file->Bind(wxEVT_CHOICE, &FileViewer::OnChoice, this);
     m_openInEditor->Bind(wxEVT_BUTTON, &FileViewer::OnEditFile, this);
 
+    m_content->Bind(wxEVT_WEBVIEW_NAVIGATING, [=](wxWebViewEvent& e)
+    {
+        const wxString url = e.GetURL();
+        if (!url.starts_with(LOAD_MORE_URL))
+            return;
+        e.Veto();
+        LoadMoreLines(url.substr(strlen(LOAD_MORE_URL)) == "before");
+    });
+
 #ifdef __WXOSX__
     wxAcceleratorEntry entries[] = {
         { wxACCEL_CMD, 'W', wxID_CLOSE }
@@ -284,10 +392,18 @@ void FileViewer::SelectReference(const wxString& ref)
 
     const wxString fullpath = filename.GetFullPath();
 
-    wxTextFile file;
-    wxString data;
+    m_source.reset();
 
-    if ( !filename.IsFileReadable() || !file.Open(fullpath) )
+    // support GNOME's xml2po's extension to references in the form of
+    // filename:line(xml_node):
+    wxString linenumStr = ref.AfterLast(_T(':')).BeforeFirst(_T('('));
+
+    long linenum;
+    if (!linenumStr.ToLong(&linenum) || linenum < 0)
+        linenum = 0;
+
+    auto rendered = filename.IsFileReadable() ? RenderReference(filename, (size_t)linenum) : nullptr;
+    if (!rendered)
     {
         ShowError(SVG_ICON, _("File cannot be opened"),
                   wxString::Format(_(L"Poedit was unable to open the “%s” file."), fullpath));
@@ -297,16 +413,102 @@ void FileViewer::SelectReference(const wxString& ref)
 
     m_openInEditor->Enable();
 
-    // support GNOME's xml2po's extension to references in the form of
-    // filename:line(xml_node):
-    wxString linenumStr = ref.AfterLast(_T(':')).BeforeFirst(_T('('));
+    m_source = rendered->file;
+    m_sourceLanguage = rendered->language;
+    m_firstLine = rendered->firstLine;
+    m_lastLine = rendered->lastLine;
+    ShowHTMLContent(rendered->markup);
+}
 
-    long linenum;
-    if (!linenumStr.ToLong(&linenum))
-        linenum = 0;
 
-    auto markup = FileToHTMLMarkup(file, filename.GetExt(), (size_t)linenum);
-    ShowHTMLContent(markup);
+const FileViewer::RenderedReference *FileViewer::RenderReference(const wxFileName& filename, size_t lineno)
+{
+    const wxString fullpath = filename.GetFullPath();
+    const time_t modTime = wxFileModificationTime(fullpath);
+
+    std::shared_ptr<SourceFileContent> file;
+    for (auto i = m_cache.begin(); i != m_cache.end(); )
+    {
+        if (i->path != fullpath)
+        {
+            ++i;
+        }
+        else if (i->modTime != modTime)
+        {
+            // the file was modified since it was rendered
+            i = m_cache.erase(i);
+        }
+        else if (i->lineno == lineno)
+        {
+            m_cache.splice(m_cache.begin(), m_cache, i);
+            return &m_cache.front();
+        }
+        else
+        {
+            // reuse the loaded file for another reference into it:
+            file = i->file;
+            ++i;
+        }
+    }
+
+    if (!file)
+    {
+        file = SourceFileContent::Open(fullpath);
+        if (!file)
+            return nullptr;
+    }
+
+    const size_t count = file->GetLineCount();
+    if (lineno > count)
+        lineno = 0;
+
+    RenderedReference r;
+    r.path = fullpath;
+    r.modTime = modTime;
+    r.lineno = lineno;
+    r.file = file;
+    r.language = FilenameToLanguage(filename.GetExt().Lower().utf8_string());
+    r.firstLine = lineno > CONTEXT_LINES ? lineno - CONTEXT_LINES : 0;
+    r.lastLine = std::min(count, std::max(lineno, (size_t)1) + CONTEXT_LINES);
+    if (r.firstLine == 0)
+        r.lastLine = std::min(count, std::max(r.lastLine, 2 * CONTEXT_LINES));
+    r.markup = FileToHTMLMarkup(*file, r.language, lineno, r.firstLine, r.lastLine);
+
+    m_cache.push_front(std::move(r));
+    if (m_cache.size() > MAX_CACHED_REFERENCES)
+        m_cache.pop_back();
+    return &m_cache.front();
+}
+
+
+void FileViewer::LoadMoreLines(bool before)
+{
+    if (!m_source)
+        return;
+
+    size_t from, to;
+    bool hasMore;
+    if (before)
+    {
+        to = m_firstLine;
+        from = to > MORE_LINES ? to - MORE_LINES : 0;
+        m_firstLine = from;
+        hasMore = from > 0;
+    }
+    else
+    {
+        from = m_lastLine;
+        to = std::min(m_source->GetLineCount(), from + MORE_LINES);
+        m_lastLine = to;
+        hasMore = to < m_source->GetLineCount();
+    }
+
+    m_content->RunScript(wxString::Format("poedit.insert(%s, %s, %d, %d, %s);",
+                                          before ? "true" : "false",
+                                          ToJSStringLiteral(LinesToHTML(*m_source, from, to)),
+                                          (int)(to - from),
+                                          (int)from,
+                                          hasMore ? "true" : "false"));
 }
 
 
@@ -401,7 +603,7 @@ void FileViewer::OnEditFile(wxCommandEvent&)
 namespace
 {
 
-inline std::string FilenameToLanguage(const std::string& ext)
+std::string FilenameToLanguage(const std::string& ext)
 {
     static const std::unordered_map<std::string, std::string> mapping = {
         #include "fileviewer.extensions.h"
@@ -414,16 +616,96 @@ inline std::string FilenameToLanguage(const std::string& ext)
     return ext;
 }
 
-inline void OutputBlock(wxString& html, const wxTextFile& file, size_t lfrom, size_t lto)
+wxString LinesToHTML(const SourceFileContent& file, size_t from, size_t to)
 {
-    for (size_t i = lfrom; i < lto; i++)
+    wxString html;
+    for (size_t i = from; i < to; i++)
     {
-        html += EscapeMarkup(file[i]);
+        html += EscapeMarkup(file.GetLine(i));
         html += '\n';
     }
+    return html;
 }
 
-wxString FileToHTMLMarkup(const wxTextFile& file, const wxString& ext, size_t lineno)
+wxString ToJSStringLiteral(const wxString& s)
+{
+    wxString out;
+    out.reserve(s.length() + 2);
+    out += '"';
+    for (auto c: s)
+    {
+        switch (c.GetValue())
+        {
+            case '\\':   out += "\\\\";     break;
+            case '"':    out += "\\\"";     break;
+            case '\n':   out += "\\n";      break;
+            case '\r':   out += "\\r";      break;
+            case '<':    out += "\\u003c";  break;
+            case 0x2028: out += "\\u2028";  break;
+            case 0x2029: out += "\\u2029";  break;
+            default:     out += c;          break;
+        }
+    }
+    out += '"';
+    return out;
+}
+
+// Loads more lines when scrolled close to the edge of rendered lines. The page
+// asks for them by navigating to LOAD_MORE_URL and FileViewer::LoadMoreLines()
+// responds by calling poedit.insert(). Because highlighting depends on context,
+// the whole code block is highlighted again with the new lines.
+const char *LOAD_MORE_SCRIPT = R"(
+<script>
+var poedit = {
+    source: document.getElementById('src').innerHTML,
+    hasBefore: %s,
+    hasAfter: %s,
+    pending: false,
+
+    request: function(where) {
+        if (poedit.pending)
+            return;
+        poedit.pending = true;
+        window.location.href = '%s' + where;
+    },
+
+    insert: function(before, html, count, from, hasMore) {
+        var src = document.getElementById('src');
+        var rows = document.getElementById('rows');
+        var root = document.documentElement;
+        var oldHeight = root.scrollHeight;
+        var spans = new Array(count + 1).join('<span></span>');
+        if (before) {
+            poedit.source = html + poedit.source;
+            rows.insertAdjacentHTML('afterbegin', spans);
+            document.getElementById('pre').style.counterReset = 'linenumber ' + from;
+            poedit.hasBefore = hasMore;
+        } else {
+            poedit.source += html;
+            rows.insertAdjacentHTML('beforeend', spans);
+            poedit.hasAfter = hasMore;
+        }
+        src.innerHTML = poedit.source;
+        if (window.Prism)
+            Prism.highlightElement(src);
+        if (before)
+            window.scrollBy(0, root.scrollHeight - oldHeight);
+        poedit.pending = false;
+    }
+};
+
+window.onscroll = function() {
+    var y = window.pageYOffset;
+    var margin = window.innerHeight;
+    if (poedit.hasBefore && y < margin)
+        poedit.request('before');
+    else if (poedit.hasAfter && y + window.innerHeight > document.documentElement.scrollHeight - margin)
+        poedit.request('after');
+};
+</script>
+)";
+
+wxString FileToHTMLMarkup(const SourceFileContent& file, const wxString& language, size_t lineno, size_t from, size_t to)
 {
     wxString html = wxString::Format(
         R"(<!DOCTYPE html>
@@ -437,29 +719,28 @@ wxString FileToHTMLMarkup(const wxTextFile& file, const wxString& ext, size_t li
         )",
         HTML_POEDIT_CSS);
 
-    html += wxString::Format("<pre class=\"line-numbers\">"
+    html += wxString::Format("<pre id=\"pre\" class=\"line-numbers\" style=\"counter-reset: linenumber %d\">"
                                  "<code>"
-                                     "<code class=\"language-%s\">",
-                             FilenameToLanguage(ext.Lower().utf8_string()));
+                                     "<code id=\"src\" class=\"language-%s\">",
+                             (int)from, language);
 
-    const size_t count = file.GetLineCount();
-    if (lineno && lineno <= count)
+    if (lineno > from && lineno <= to)
     {
-        OutputBlock(html, file, 0, lineno-1);
+        html += LinesToHTML(file, from, lineno-1);
         html += "<mark>";
-        OutputBlock(html, file, lineno-1, lineno);
+        html += LinesToHTML(file, lineno-1, lineno);
         html += "</mark>";
-        OutputBlock(html, file, lineno, count);
+        html += LinesToHTML(file, lineno, to);
     }
     else
     {
-        OutputBlock(html, file, 0, count);
+        html += LinesToHTML(file, from, to);
     }
 
     // add line numbers:
     html += "</code>"
-            "<span aria-hidden=\"true\" class=\"line-numbers-rows\">";
-    for (size_t i = 0; i < count; i++)
+            "<span id=\"rows\" aria-hidden=\"true\" class=\"line-numbers-rows\">";
+    for (size_t i = from; i < to; i++)
     {
         if (i == lineno-1)
             html += "<span id=\"mark\"><span id=\"msie_anchor\"></span></span>";
@@ -469,6 +750,11 @@ wxString FileToHTMLMarkup(const wxTextFile& file, const wxString& ext, size_t li
 
     html += "</span></code></pre>";
 
+    html += wxString::Format(LOAD_MORE_SCRIPT,
+                             from > 0 ? "true" : "false",
+                             to < file.GetLineCount() ? "true" : "false",
+                             LOAD_MORE_URL);
+
     if (lineno)
     {
         // Alternative implementation that doesn't need msie_anchor, but doesn't work on MSIE, is to do:
@@ -30,6 +30,7 @@
 
 #include <wx/frame.h>
 
+#include <list>
 #include <memory>
 
 class WXDLLIMPEXP_FWD_CORE wxButton;
@@ -39,9 +40,15 @@ class WXDLLIMPEXP_FWD_CORE wxFileName;
 class WXDLLIMPEXP_FWD_CORE wxWebView;
 class WXDLLIMPEXP_FWD_CORE wxSizer;
 
+class SourceFileContent;
+
 
 /** This class implements frame that shows part of file
-    surrounding specified line (40 lines in both directions).
+    surrounding specified line.
+
+    Only a window of lines around the referenced line is rendered at first
+    and more lines are loaded as the user scrolls, so that even huge
+    (typically generated) source files are shown instantly.
  */
 class FileViewer : public wxFrame
 {
@@ -61,12 +68,34 @@ private:
 
     void SelectReference(const wxString& ref);
     void ShowHTMLContent(const wxString& markup);
+    /// Extends rendered window of lines of the current file upwards or downwards
+    void LoadMoreLines(bool before);
     void ShowError(const char *icon, const wxString& msg, const wxString& description = "", const wxString& references = "");
 
 private:
     wxString m_basePath;
     wxArrayString m_references;
 
+    // Recently rendered references, most recent first, so that switching
+    // between them doesn't need to load and render the file again:
+    struct RenderedReference
+    {
+        wxString path;
+        time_t modTime;
+        size_t lineno;
+        std::shared_ptr<SourceFileContent> file;
+        wxString language;
+        wxString markup;
+        size_t firstLine, lastLine;
+    };
+    std::list<RenderedReference> m_cache;
+    const RenderedReference *RenderReference(const wxFileName& filename, size_t lineno);
+
+    // Currently shown file and the rendered range of its lines [first,last):
+    std::shared_ptr<SourceFileContent> m_source;
+    wxString m_sourceLanguage;
+    size_t m_firstLine = 0, m_lastLine = 0;
+
     wxChoice *m_file;
     wxStaticText *m_description;
     wxButton *m_openInEditor;
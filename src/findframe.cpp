@@ -33,6 +33,9 @@
 #include <wx/stattext.h>
 #include <wx/textctrl.h>
 #include <wx/checkbox.h>
+#include <wx/log.h>
+#include <wx/thread.h>
+#include <wx/utils.h>
 
 #ifdef __WXOSX__
 #include <AppKit/AppKit.h>
@@ -44,14 +47,27 @@
 #endif
 
 #include "catalog.h"
+#include "concurrency.h"
+#include "errors.h"
+#include "str_helpers.h"
 #include "text_control.h"
 #include "edframe.h"
 #include "editing_area.h"
 #include "edlistctrl.h"
 #include "findframe.h"
 #include "hidpi.h"
+#include "perf_trace.h"
 #include "utility.h"
 
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include <unicode/uregex.h>
+#include <unicode/ustring.h>
+
 namespace
 {
 
@@ -68,9 +84,268 @@ enum
 const int FRAME_STYLE = (wxDEFAULT_FRAME_STYLE | wxFRAME_TOOL_WINDOW | wxTAB_TRAVERSAL | wxFRAME_FLOAT_ON_PARENT)
                         & ~(wxRESIZE_BORDER | wxMAXIMIZE_BOX);
 
+// Smaller catalogs are searched quickly enough without an index
+const size_t SEARCH_INDEX_MIN_ITEMS = 5000;
+
 } // anonymous namespace
 
 
+std::shared_ptr<CatalogSearchIndex> CatalogSearchIndex::Create(const CatalogPtr& catalog)
+{
+    std::shared_ptr<CatalogSearchIndex> index(new CatalogSearchIndex(catalog));
+    dispatch::async([index]{ index->EnsureBuilt(); });
+    return index;
+}
+
+
+CatalogSearchIndex::CatalogSearchIndex(const CatalogPtr& catalog)
+{
+    auto& items = catalog->items();
+    m_revisions = GetRevisions(*catalog);
+    m_snapshot.reserve(items.size());
+    for (auto& i: items)
+    {
+        Snapshot snap;
+        snap.text.push_back(i->GetString());
+        if (i->HasPlural())
+            snap.text.push_back(i->GetPluralString());
+        for (auto& t: i->GetTranslations())
+            snap.text.push_back(t);
+        if (i->HasComment())
+            snap.comments.push_back(i->GetComment());
+        for (auto& c: i->GetExtractedComments())
+            snap.comments.push_back(c);
+        m_snapshot.push_back(std::move(snap));
+    }
+}
+
+
+void CatalogSearchIndex::EnsureBuilt()
+{
+    std::call_once(m_buildOnce, [this]
+    {
+        perf::ScopedTimer timer("search index build");
+        timer.SetItemsCount(m_snapshot.size());
+
+        // folding is the expensive part and is independent for each item, so
+        // do it in parallel; postings lists are then built in items order
+        const size_t count = m_snapshot.size();
+        m_folded.resize(count);
+        std::vector<std::vector<Trigram>> itemTrigrams(count);
+
+        dispatch::parallel_for(count, /*grain=*/500, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                auto& trigrams = itemTrigrams[i];
+                std::wstring folded;
+                for (auto& t: m_snapshot[i].text)
+                {
+                    auto f = Fold(t);
+                    AddTrigrams(f, trigrams);
+                    folded += f;
+                    folded += FIELDS_SEPARATOR;
+                }
+                for (auto& c: m_snapshot[i].comments)
+                    AddTrigrams(Fold(c), trigrams);
+
+                m_folded[i] = std::move(folded);
+
+                std::sort(trigrams.begin(), trigrams.end());
+                trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+            }
+        });
+
+        for (size_t i = 0; i < count; i++)
+        {
+            for (auto t: itemTrigrams[i])
+                m_postings[t].push_back((int)i);
+        }
+
+        m_snapshot.clear();
+        m_snapshot.shrink_to_fit();
+        m_ready = true;
+    });
+}
+
+
+size_t CatalogSearchIndex::GetMemoryUsage() const
+{
+    // the data can't be accessed while EnsureBuilt() is modifying them
+    if (!m_ready)
+        return 0;
+
+    size_t size = m_folded.capacity() * sizeof(std::wstring);
+    for (auto& f: m_folded)
+        size += f.capacity() * sizeof(wchar_t);
+    size += m_postings.bucket_count() * sizeof(void*);
+    for (auto& p: m_postings)
+        size += sizeof(p) + 2 * sizeof(void*) + p.second.capacity() * sizeof(int);
+    return size;
+}
+
+
+/*static*/ std::vector<unsigned> CatalogSearchIndex::GetRevisions(const Catalog& catalog)
+{
+    std::vector<unsigned> revisions;
+    revisions.reserve(catalog.GetCount());
+    for (auto& i: catalog.items())
+        revisions.push_back(i->GetRevision());
+    return revisions;
+}
+
+
+bool CatalogSearchIndex::FindIndexed(const std::wstring& folded, std::vector<int>& found) const
+{
+    std::vector<Trigram> trigrams;
+    AddTrigrams(folded, trigrams);
+    if (trigrams.empty())
+        return false;
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    found.clear();
+
+    // intersect postings of all trigrams, starting with the shortest ones:
+    std::vector<const std::vector<int>*> postings;
+    for (auto t: trigrams)
+    {
+        auto p = m_postings.find(t);
+        if (p == m_postings.end())
+            return true; // no item has this trigram
+        postings.push_back(&p->second);
+    }
+
+    std::sort(postings.begin(), postings.end(),
+              [](const std::vector<int> *a, const std::vector<int> *b){ return a->size() < b->size(); });
+
+    found = *postings.front();
+    std::vector<int> tmp;
+    for (size_t i = 1; i < postings.size() && !found.empty(); i++)
+    {
+        tmp.clear();
+        std::set_intersection(found.begin(), found.end(),
+                              postings[i]->begin(), postings[i]->end(),
+                              std::back_inserter(tmp));
+        found.swap(tmp);
+    }
+
+    return true;
+}
+
+
+bool CatalogSearchIndex::FindCandidates(const Catalog& catalog, const wxString& text, std::vector<bool>& candidates) const
+{
+    if (!m_ready)
+        return false;
+
+    auto& items = catalog.items();
+    if (items.size() != m_revisions.size())
+        return false;
+
+    std::vector<int> found;
+    if (!FindIndexed(Fold(text), found))
+        return false;
+
+    candidates.assign(items.size(), false);
+    for (auto i: found)
+        candidates[i] = true;
+
+    // items modified after the index was built must be searched too:
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        if (items[i]->GetRevision() != m_revisions[i])
+            candidates[i] = true;
+    }
+
+    return true;
+}
+
+
+std::vector<CatalogSearchIndex::MatchResult>
+CatalogSearchIndex::Match(const wxString& text, const std::vector<unsigned>& revisions,
+                          dispatch::cancellation_token_ptr cancellationToken) const
+{
+    if (revisions.size() != m_revisions.size())
+        return {};
+
+    const auto folded = Fold(text);
+    const size_t count = m_folded.size();
+
+    std::vector<MatchResult> results(count, Match_No);
+
+    auto check = [&](size_t i)
+    {
+        if (m_folded[i].find(folded) != std::wstring::npos)
+            results[i] = Match_Yes;
+    };
+
+    std::vector<int> found;
+    if (FindIndexed(folded, found))
+    {
+        for (auto i: found)
+            check(i);
+    }
+    else
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if ((i % 1024) == 0 && cancellationToken->is_cancelled())
+                return {};
+            check(i);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (revisions[i] != m_revisions[i])
+            results[i] = Match_Changed;
+    }
+
+    if (cancellationToken->is_cancelled())
+        return {};
+    return results;
+}
+
+
+/*static*/ bool CatalogSearchIndex::ItemMatches(const CatalogItem& item, const wxString& text)
+{
+    const auto folded = Fold(text);
+    auto contains = [&folded](const wxString& s){ return Fold(s).find(folded) != std::wstring::npos; };
+
+    if (contains(item.GetString()))
+        return true;
+    if (item.HasPlural() && contains(item.GetPluralString()))
+        return true;
+    for (auto& t: item.GetTranslations())
+    {
+        if (contains(t))
+            return true;
+    }
+    return false;
+}
+
+
+/*static*/ std::wstring CatalogSearchIndex::Fold(wxString s)
+{
+    s.MakeLower();
+    s.Replace("&", "");
+    s.Replace("_", "");
+    return str::to_wstring(s);
+}
+
+
+/*static*/ void CatalogSearchIndex::AddTrigrams(const std::wstring& s, std::vector<Trigram>& out)
+{
+    for (size_t i = 0; i + 2 < s.length(); i++)
+    {
+        out.push_back(((Trigram(s[i]) & 0x1FFFFF) << 42) |
+                      ((Trigram(s[i+1]) & 0x1FFFFF) << 21) |
+                      (Trigram(s[i+2]) & 0x1FFFFF));
+    }
+}
+
+
 wxString FindFrame::ms_text;
 
 FindFrame::FindFrame(PoeditFrame *owner,
@@ -119,6 +394,7 @@ FindFrame::FindFrame(PoeditFrame *owner,
     m_ignoreCase = new wxCheckBox(collPane, wxID_ANY, _("Ignore case"));
     m_wrapAround = new wxCheckBox(collPane, wxID_ANY, _("Wrap around"));
     m_wholeWords = new wxCheckBox(collPane, wxID_ANY, _("Whole words only"));
+    m_useRegex = new wxCheckBox(collPane, wxID_ANY, _("Regular expression"));
     m_findInOrig = new wxCheckBox(collPane, wxID_ANY, _("Find in source texts"));
     m_findInTrans = new wxCheckBox(collPane, wxID_ANY, _("Find in translations"));
     m_findInComments = new wxCheckBox(collPane, wxID_ANY, _("Find in comments"));
@@ -131,6 +407,7 @@ FindFrame::FindFrame(PoeditFrame *owner,
     optionsL->Add(m_ignoreCase, wxSizerFlags().Expand());
     optionsL->Add(m_wrapAround, wxSizerFlags().Expand().Border(wxTOP, PX(2)));
     optionsL->Add(m_wholeWords, wxSizerFlags().Expand().Border(wxTOP, PX(2)));
+    optionsL->Add(m_useRegex, wxSizerFlags().Expand().Border(wxTOP, PX(2)));
     optionsR->Add(m_findInOrig, wxSizerFlags().Expand().Border(wxTOP, PX(2)));
     optionsR->Add(m_findInTrans, wxSizerFlags().Expand().Border(wxTOP, PX(2)));
     optionsR->Add(m_findInComments, wxSizerFlags().Expand().Border(wxTOP, PX(2)));
@@ -179,6 +456,7 @@ FindFrame::FindFrame(PoeditFrame *owner,
     m_ignoreCase->SetValue(!wxConfig::Get()->ReadBool("find_case_sensitive", false));
     m_wrapAround->SetValue(wxConfig::Get()->ReadBool("find_wrap_around", true));
     m_wholeWords->SetValue(wxConfig::Get()->ReadBool("whole_words", false));
+    m_useRegex->SetValue(wxConfig::Get()->ReadBool("find_regex", false));
 
     wxAcceleratorEntry entries[] = {
 #ifndef __WXGTK__
@@ -252,6 +530,14 @@ void FindFrame::Reset(const CatalogPtr& c)
     UpdateButtons();
 }
 
+std::shared_ptr<CatalogSearchIndex> FindFrame::GetSearchIndex()
+{
+    // until the index is built in the background, searching works without it
+    if (!m_catalog || m_catalog->GetCount() < SEARCH_INDEX_MIN_ITEMS)
+        return nullptr;
+    return m_owner->GetSearchIndex();
+}
+
 void FindFrame::UpdateButtons()
 {
     m_btnPrev->Enable(!ms_text.empty());
@@ -334,6 +620,7 @@ void FindFrame::OnCheckbox(wxCommandEvent&)
     wxConfig::Get()->Write("find_case_sensitive", !m_ignoreCase->GetValue());
     wxConfig::Get()->Write("find_wrap_around", m_wrapAround->GetValue());
     wxConfig::Get()->Write("whole_words", m_wholeWords->GetValue());
+    wxConfig::Get()->Write("find_regex", m_useRegex->GetValue());
 }
 
 
@@ -368,6 +655,150 @@ void FindFrame::FindNext()
 namespace
 {
 
+/**
+    Regular expression for the regex search mode, compiled once per query.
+
+    ICU's engine is used, because Poedit uses ICU anyway and its syntax is the
+    usual Perl-like one. It is a backtracking engine, though, so the time spent
+    matching a single text is limited to protect against pathological patterns.
+
+    The compiled expression can't be used by several threads at once, but
+    copying it is cheap, because the pattern isn't compiled again.
+ */
+class SearchRegex
+{
+public:
+    /// Compiles @a pattern; throws Exception if it is invalid.
+    SearchRegex(const wxString& pattern, bool ignoreCase, bool wholeWords)
+    {
+        auto full = wholeWords ? "\\b(?:" + pattern + ")\\b" : pattern;
+        auto fullBuf = str::to_icu(full);
+
+        UParseError parseError;
+        UErrorCode err = U_ZERO_ERROR;
+        m_re = uregex_open(fullBuf, -1, ignoreCase ? UREGEX_CASE_INSENSITIVE : 0, &parseError, &err);
+        if (U_FAILURE(err))
+        {
+            if (m_re)
+                uregex_close(m_re);
+            throw Exception(wxString::Format(_("Invalid regular expression: %s"), wxString(u_errorName(err))));
+        }
+        SetTimeLimit();
+    }
+
+    SearchRegex(const SearchRegex& other)
+    {
+        UErrorCode err = U_ZERO_ERROR;
+        m_re = uregex_clone(other.m_re, &err);
+        if (U_FAILURE(err))
+            throw Exception(wxString(u_errorName(err)));
+        SetTimeLimit();
+    }
+
+    SearchRegex& operator=(const SearchRegex&) = delete;
+
+    ~SearchRegex()
+    {
+        uregex_close(m_re);
+    }
+
+    /// Finds the first match in @a str, sets its position (in wxString characters).
+    bool Find(const wxString& str, size_t& pos, size_t& len)
+    {
+        auto buf = str::to_icu(str);
+        UErrorCode err = U_ZERO_ERROR;
+        uregex_setText(m_re, buf, -1, &err);
+        if (!uregex_find(m_re, 0, &err) || U_FAILURE(err))
+            return false;
+
+        const int32_t start = uregex_start(m_re, 0, &err);
+        const int32_t end = uregex_end(m_re, 0, &err);
+        if (U_FAILURE(err))
+            return false;
+
+        pos = FromUTF16Index(buf, start);
+        len = FromUTF16Index(buf, end) - pos;
+        return true;
+    }
+
+    bool Matches(const wxString& str)
+    {
+        size_t pos, len;
+        return Find(str, pos, len);
+    }
+
+    size_t MatchesAny(const wxArrayString& strs)
+    {
+        for (size_t i = 0; i < strs.GetCount(); i++)
+        {
+            if (Matches(strs[i]))
+                return i;
+        }
+        return (size_t)-1;
+    }
+
+    /// Replaces all matches in @a str, @a replacement may refer to groups as $1 etc.
+    bool ReplaceAll(wxString& str, const wxString& replacement)
+    {
+        auto buf = str::to_icu(str);
+        auto replacementBuf = str::to_icu(replacement);
+
+        UErrorCode err = U_ZERO_ERROR;
+        uregex_setText(m_re, buf, -1, &err);
+        if (!uregex_find(m_re, 0, &err) || U_FAILURE(err))
+            return false;
+
+        // preflight to find out the length of output:
+        int32_t len = uregex_replaceAll(m_re, replacementBuf, -1, nullptr, 0, &err);
+        if (err != U_BUFFER_OVERFLOW_ERROR && U_FAILURE(err))
+            return false;
+
+        std::vector<UChar> out(len + 1);
+        err = U_ZERO_ERROR;
+        uregex_replaceAll(m_re, replacementBuf, -1, out.data(), len + 1, &err);
+        if (U_FAILURE(err))
+            return false;
+
+        str = str::to_wx(out.data(), len);
+        return true;
+    }
+
+private:
+    void SetTimeLimit()
+    {
+        // in ICU's match engine "steps", which are roughly milliseconds:
+        UErrorCode err = U_ZERO_ERROR;
+        uregex_setTimeLimit(m_re, 200, &err);
+    }
+
+    static size_t FromUTF16Index(const UChar *str, int32_t index)
+    {
+#if SIZEOF_WCHAR_T == 2
+        (void)str;
+        return (size_t)index;
+#else
+        return (size_t)u_countChar32(str, index);
+#endif
+    }
+
+    URegularExpression *m_re;
+};
+
+// Regex searches are done in parallel in chunks of at least this many items:
+const size_t PARALLEL_REGEX_SEARCH_GRAIN = 1000;
+
+// Checks if any of the item's fields searched in matches @a regex
+bool ItemMatchesRegex(const CatalogItem& item, SearchRegex& regex, bool inTrans, bool inSource, bool inComments)
+{
+    if (inTrans && regex.MatchesAny(item.GetTranslations()) != (size_t)-1)
+        return true;
+    if (inSource && (regex.Matches(item.GetString()) || (item.HasPlural() && regex.Matches(item.GetPluralString()))))
+        return true;
+    if (inComments && (regex.Matches(item.GetComment()) || regex.MatchesAny(item.GetExtractedComments()) != (size_t)-1))
+        return true;
+    return false;
+}
+
 template<typename S, typename F>
 bool FindTextInStringAndDo(S& str, const wxString& text, bool wholeWords, F&& handler)
 {
@@ -439,6 +870,93 @@ bool ReplaceTextInString(wxString& str, const wxString& text, bool wholeWords, c
                                  });
 }
 
+// Replace All is computed in parallel in chunks of at least this many items:
+const size_t PARALLEL_REPLACE_GRAIN = 1000;
+
+struct Replacement
+{
+    size_t index;
+    wxArrayString translations;
+};
+
+/// Replaces searched text in the string passed to it, returns true if it did
+typedef std::function<bool(wxString&)> Replacer;
+
+/**
+    Computes new translations for items at @a indexes, without modifying them.
+
+    @a makeReplacer is called once for every chunk of items processed in
+    parallel, to create replacer for use by that chunk's thread.
+
+    Only items where something was replaced are included in the result, in
+    the order of @a indexes.
+ */
+std::vector<Replacement> ComputeReplacements(const CatalogItemArray& items,
+                                             const std::vector<size_t>& indexes,
+                                             const std::function<Replacer()>& makeReplacer)
+{
+    auto compute = [&items, &indexes, &makeReplacer](size_t begin, size_t end)
+    {
+        auto replacer = makeReplacer();
+        std::vector<Replacement> out;
+        for (size_t i = begin; i < end; i++)
+        {
+            auto& item = items[indexes[i]];
+            bool replaced = false;
+            auto translations = item->GetTranslations();
+            for (auto& t: translations)
+            {
+                if (replacer(t))
+                    replaced = true;
+            }
+            if (replaced)
+                out.push_back({indexes[i], std::move(translations)});
+        }
+        return out;
+    };
+
+    const size_t count = indexes.size();
+    if (!wxThread::IsMain())
+        return compute(0, count);
+
+    // The UI is blocked while waiting for the jobs, so the items can't change
+    // under them and it's safe to read them from worker threads.
+    return dispatch::parallel_transform_reduce
+    (
+        count, PARALLEL_REPLACE_GRAIN, std::vector<Replacement>(),
+        compute,
+        [](std::vector<Replacement> all, std::vector<Replacement> part)
+        {
+            std::move(part.begin(), part.end(), std::back_inserter(all));
+            return all;
+        }
+    );
+}
+
+/**
+    Creates factory of replacers for given search options, for use with
+    ComputeReplacements().
+
+    Throws Exception if @a search is an invalid regular expression.
+ */
+std::function<Replacer()> MakeReplacerFactory(const wxString& search, bool useRegex, bool wholeWords, const wxString& replace)
+{
+    if (useRegex)
+    {
+        auto regex = std::make_shared<SearchRegex>(search, /*ignoreCase=*/false, wholeWords);
+        return [regex, replace]() -> Replacer
+        {
+            auto copy = std::make_shared<SearchRegex>(*regex);
+            return [copy, replace](wxString& s){ return copy->ReplaceAll(s, replace); };
+        };
+    }
+
+    return [search, wholeWords, replace]() -> Replacer
+    {
+        return [search, wholeWords, replace](wxString& s){ return ReplaceTextInString(s, search, wholeWords, replace); };
+    };
+}
+
 enum FoundState
 {
     Found_Not = 0,
@@ -458,6 +976,8 @@ bool FindFrame::DoFind(int dir)
     if (!m_listCtrl)
         return false;
 
+    perf::ScopedTimer timer("find");
+
     int mode = m_mode->GetSelection();
     int cnt = m_listCtrl->GetItemCount();
     bool inTrans = m_findInTrans->GetValue() && (m_catalog->HasCapability(Catalog::Cap::Translations));
@@ -466,6 +986,7 @@ bool FindFrame::DoFind(int dir)
     bool ignoreCase = (mode == Mode_Find) && m_ignoreCase->GetValue();
     bool wholeWords = m_wholeWords->GetValue();
     bool wrapAround = m_wrapAround->GetValue();
+    bool useRegex = m_useRegex->GetValue();
     size_t trans;
 
     FoundState found = Found_Not;
@@ -484,6 +1005,57 @@ bool FindFrame::DoFind(int dir)
     const bool ignoreAmp = (mode == Mode_Find) && (text.Find(_T('&')) == wxNOT_FOUND);
     const bool ignoreUnderscore = (mode == Mode_Find) && (text.Find(_T('_')) == wxNOT_FOUND);
 
+    std::unique_ptr<SearchRegex> regex;
+    if (useRegex)
+    {
+        try
+        {
+            regex.reset(new SearchRegex(ms_text, ignoreCase, wholeWords));
+        }
+        catch (...)
+        {
+            wxLogError("%s", DescribeCurrentException());
+            return false;
+        }
+    }
+
+    auto matchesString = [&](const wxString& s, bool ignoreMnemonics)
+    {
+        if (regex)
+            return regex->Matches(s);
+        return IsTextInString(s, text, ignoreCase, wholeWords, ignoreMnemonics && ignoreAmp, ignoreMnemonics && ignoreUnderscore);
+    };
+    auto matchesStrings = [&](const wxArrayString& strs, bool ignoreMnemonics)
+    {
+        if (regex)
+            return regex->MatchesAny(strs);
+        return IsTextInStrings(strs, text, ignoreCase, wholeWords, ignoreMnemonics && ignoreAmp, ignoreMnemonics && ignoreUnderscore);
+    };
+
+    std::vector<bool> candidates;
+    bool useIndex = false;
+    if (regex)
+    {
+        // Regexes can't use the search index, but matching all items at once
+        // in parallel is much faster than testing them one by one. The UI is
+        // blocked while waiting, so it's safe to read the items from workers.
+        auto& items = m_catalog->items();
+        std::vector<char> matched(items.size(), 0);
+        dispatch::parallel_for(items.size(), PARALLEL_REGEX_SEARCH_GRAIN, [&](size_t begin, size_t end)
+        {
+            SearchRegex chunkRegex(*regex);
+            for (size_t i = begin; i < end; i++)
+                matched[i] = ItemMatchesRegex(*items[i], chunkRegex, inTrans, inSource, inComments);
+        });
+        candidates.assign(matched.begin(), matched.end());
+        useIndex = true;
+    }
+    else
+    {
+        auto searchIndex = GetSearchIndex();
+        useIndex = searchIndex && searchIndex->FindCandidates(*m_catalog, ms_text, candidates);
+    }
+
     const int posOrig = std::max(0, std::min(m_position, cnt-1));
     m_position = posOrig + dir;
 
@@ -504,11 +1076,15 @@ bool FindFrame::DoFind(int dir)
                 break;
         }
 
-        auto dt = lastItem = (*m_catalog)[m_listCtrl->ListIndexToCatalog(m_position)];
+        const int index = m_listCtrl->ListIndexToCatalog(m_position);
+        if (useIndex && !candidates[index])
+            continue;
+
+        auto dt = lastItem = (*m_catalog)[index];
 
         if (inTrans)
         {
-            trans = IsTextInStrings(dt->GetTranslations(), text, ignoreCase, wholeWords, ignoreAmp, ignoreUnderscore);
+            trans = matchesStrings(dt->GetTranslations(), true);
             if (trans != (size_t)-1)
             {
                 found = Found_InTrans;
@@ -517,12 +1093,12 @@ bool FindFrame::DoFind(int dir)
         }
         if (inSource)
         {
-            if (IsTextInString(dt->GetString(), text, ignoreCase, wholeWords, ignoreAmp, ignoreUnderscore))
+            if (matchesString(dt->GetString(), true))
             {
                 found = Found_InOrig;
                 break;
             }
-            if (dt->HasPlural() && IsTextInString(dt->GetPluralString(), text, ignoreCase, wholeWords, ignoreAmp, ignoreUnderscore))
+            if (dt->HasPlural() && matchesString(dt->GetPluralString(), true))
             {
                 found = Found_InOrigPlural;
                 break;
@@ -530,12 +1106,12 @@ bool FindFrame::DoFind(int dir)
         }
         if (inComments)
         {
-            if (IsTextInString(dt->GetComment(), text, ignoreCase, wholeWords, false, false))
+            if (matchesString(dt->GetComment(), false))
             {
                 found = Found_InComments;
                 break;
             }
-            if (IsTextInStrings(dt->GetExtractedComments(), text, ignoreCase, wholeWords, false, false) != (size_t)-1)
+            if (matchesStrings(dt->GetExtractedComments(), false) != (size_t)-1)
             {
                 found = Found_InExtractedComments;
                 break;
@@ -578,7 +1154,13 @@ bool FindFrame::DoFind(int dir)
               break;
         }
 
-        if (txt)
+        if (txt && regex)
+        {
+            size_t pos, len;
+            if (regex->Find(txt->GetValue(), pos, len))
+                txt->ShowFindIndicator((int)pos, (int)len);
+        }
+        else if (txt)
         {
             textc = txt->GetValue();
             if (ignoreCase)
@@ -603,15 +1185,22 @@ bool FindFrame::DoFind(int dir)
 
 bool FindFrame::DoReplaceInItem(CatalogItemPtr item)
 {
-    bool wholeWords = m_wholeWords->GetValue();
-    auto search = m_searchField->GetValue();
-    auto replace = m_replaceField->GetValue();
+    Replacer replacer;
+    try
+    {
+        replacer = MakeReplacerFactory(m_searchField->GetValue(), m_useRegex->GetValue(), m_wholeWords->GetValue(), m_replaceField->GetValue())();
+    }
+    catch (...)
+    {
+        wxLogError("%s", DescribeCurrentException());
+        return false;
+    }
 
     bool replaced = false;
     auto translations = item->GetTranslations();
     for (auto& t: translations)
     {
-        if (ReplaceTextInString(t, search, wholeWords, replace))
+        if (replacer(t))
             replaced = true;
     }
 
@@ -632,24 +1221,66 @@ void FindFrame::OnReplace(wxCommandEvent&)
     if (!m_lastItem)
         return;
     if (DoReplaceInItem(m_lastItem))
-    {
-        // FIXME: Only refresh affected items
-        m_listCtrl->RefreshAllItems();
-    }
+        m_listCtrl->RefreshItem(m_listCtrl->CatalogItemToListItem(m_lastItem));
 }
 
 void FindFrame::OnReplaceAll(wxCommandEvent&)
 {
-    bool replaced = false;
-    for (auto& item: m_catalog->items())
+    perf::ScopedTimer timer("replace all");
+    timer.SetItemsCount(m_catalog->GetCount());
+
+    const auto search = m_searchField->GetValue();
+    const bool useRegex = m_useRegex->GetValue();
+
+    std::function<Replacer()> makeReplacer;
+    try
     {
-        if (DoReplaceInItem(item))
-            replaced = true;
+        makeReplacer = MakeReplacerFactory(search, useRegex, m_wholeWords->GetValue(), m_replaceField->GetValue());
+    }
+    catch (...)
+    {
+        wxLogError("%s", DescribeCurrentException());
+        return;
     }
 
-    if (replaced)
+    // the index only applies to literal text, regexes are checked on all items:
+    std::vector<bool> candidates;
+    auto searchIndex = useRegex ? nullptr : GetSearchIndex();
+    const bool useIndex = searchIndex && searchIndex->FindCandidates(*m_catalog, search, candidates);
+
+    auto& items = m_catalog->items();
+    std::vector<size_t> indexes;
+    indexes.reserve(useIndex ? 0 : items.size());
+    for (size_t i = 0; i < items.size(); i++)
     {
-        // FIXME: Only refresh affected items
-        m_listCtrl->RefreshAllItems();
+        if (!useIndex || candidates[i])
+            indexes.push_back(i);
     }
+
+    wxBusyCursor bcur;
+    auto replacements = ComputeReplacements(items, indexes, makeReplacer);
+    if (replacements.empty())
+        return;
+
+    // Apply all changes in a single pass and update the UI only once for
+    // the whole batch, not after every modified item:
+    auto current = m_owner->GetCurrentItem();
+    bool currentChanged = false;
+    std::vector<int> changed;
+    changed.reserve(replacements.size());
+    for (auto& r: replacements)
+    {
+        auto& item = items[r.index];
+        item->SetTranslations(r.translations);
+        item->SetModified(true);
+        if (item == current)
+            currentChanged = true;
+        changed.push_back((int)r.index);
+    }
+
+    m_owner->MarkAsModified();
+    if (currentChanged)
+        m_owner->UpdateToTextCtrl(EditingArea::UndoableEdit);
+
+    m_listCtrl->RefreshItems(changed);
 }
@@ -26,11 +26,19 @@
 #ifndef _FINDFRAME_H_
 #define _FINDFRAME_H_
 
+#include "concurrency.h"
 #include "edlistctrl.h"
 
 #include <wx/frame.h>
 #include <wx/weakref.h>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 class WXDLLIMPEXP_FWD_CORE wxButton;
 class WXDLLIMPEXP_FWD_CORE wxCheckBox;
 class WXDLLIMPEXP_FWD_CORE wxChoice;
@@ -40,6 +48,104 @@ class Catalog;
 class EditingArea;
 class PoeditFrame;
 
+/**
+    Index of catalog's searchable text (source, translations and comments),
+    used by find and list filtering to quickly find matching items.
+
+    All text is folded in the same way, lowercased and with accelerator
+    characters removed. The trigram index of folded text is then a valid filter
+    for any search options: if a field contains the text with whatever options,
+    its folded version contains the folded text too.
+
+    The index is built in the background from a snapshot of the text taken
+    on the main thread. Items changed since then are recognized by their
+    revision numbers and must be checked by the caller.
+ */
+class CatalogSearchIndex
+{
+public:
+    /**
+        Creates index for @a catalog and starts building it in the background.
+        Must be called on the main thread.
+     */
+    static std::shared_ptr<CatalogSearchIndex> Create(const CatalogPtr& catalog);
+
+    /// Builds the index unless it's already built; can be called on any thread.
+    void EnsureBuilt();
+
+    /// Returns revisions of @a catalog items, for use with Match(). Main thread only.
+    static std::vector<unsigned> GetRevisions(const Catalog& catalog);
+
+    /**
+        Marks items of @a catalog that may contain @a text in @a candidates,
+        with any search options.
+
+        Returns false if the index can't narrow the search down (e.g. because
+        it isn't built yet or the text is too short), in which case all items
+        must be searched.
+
+        Must be called on the main thread.
+     */
+    bool FindCandidates(const Catalog& catalog, const wxString& text, std::vector<bool>& candidates) const;
+
+    enum MatchResult : uint8_t
+    {
+        Match_No,
+        Match_Yes,
+        Match_Changed  ///< item changed since indexing, caller must check it
+    };
+
+    /**
+        Finds items whose source text or translation contains @a text, ignoring
+        case and accelerators.
+
+        Only indexed data are used, so this can be called on any thread after
+        EnsureBuilt(). @a revisions are items' current revisions, as returned by
+        GetRevisions().
+
+        Returns result for each item, or empty vector if cancelled or if the
+        catalog doesn't match the index anymore.
+     */
+    std::vector<MatchResult> Match(const wxString& text, const std::vector<unsigned>& revisions,
+                                   dispatch::cancellation_token_ptr cancellationToken) const;
+
+    /// Returns approximate memory used by the index; 0 until it is built.
+    size_t GetMemoryUsage() const;
+
+    /// Checks current text of @a item the same way as Match() does.
+    static bool ItemMatches(const CatalogItem& item, const wxString& text);
+
+    // Building blocks of the index, shared with ProjectSearchIndex:
+    typedef uint64_t Trigram;
+    static const wchar_t FIELDS_SEPARATOR = L'\x1f';
+
+    /// Folds @a s for searching, see the class description.
+    static std::wstring Fold(wxString s);
+    /// Appends all trigrams of @a s to @a out, unsorted and with duplicates.
+    static void AddTrigrams(const std::wstring& s, std::vector<Trigram>& out);
+
+private:
+    explicit CatalogSearchIndex(const CatalogPtr& catalog);
+
+    // Finds items containing all trigrams of @a folded; returns false if
+    // the index can't be used for it
+    bool FindIndexed(const std::wstring& folded, std::vector<int>& found) const;
+
+    struct Snapshot
+    {
+        std::vector<wxString> text, comments;
+    };
+    std::vector<Snapshot> m_snapshot;
+    std::vector<unsigned> m_revisions;
+
+    std::once_flag m_buildOnce;
+    std::atomic<bool> m_ready {false};
+    // folded source and translations of each item, separated by FIELDS_SEPARATOR:
+    std::vector<std::wstring> m_folded;
+    std::unordered_map<Trigram, std::vector<int>> m_postings;
+};
+
+
 /** FindFrame is small dialog frame that contains controls for searching
     in content of EditorFrame's wxListCtrl object and associated Catalog
     instance.
@@ -87,11 +193,12 @@ class FindFrame : public wxFrame
         void OnReplaceAll(wxCommandEvent &event);
         bool DoFind(int dir);
         bool DoReplaceInItem(CatalogItemPtr item);
+        std::shared_ptr<CatalogSearchIndex> GetSearchIndex();
 
         PoeditFrame *m_owner;
         wxChoice *m_mode;
         wxTextCtrl *m_searchField, *m_replaceField;
-        wxCheckBox *m_ignoreCase, *m_wrapAround, *m_wholeWords,
+        wxCheckBox *m_ignoreCase, *m_wrapAround, *m_wholeWords, *m_useRegex,
                    *m_findInOrig, *m_findInTrans, *m_findInComments;
 
         wxWeakRef<PoeditListCtrl> m_listCtrl;
@@ -33,11 +33,24 @@
 #include <wx/intl.h>
 #include <wx/stdpaths.h>
 #include <wx/translation.h>
+#include <wx/timer.h>
+#include <wx/tokenzr.h>
 #include <wx/filename.h>
 
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <regex>
+#include <string>
+#include <thread>
 #include <boost/throw_exception.hpp>
 
+#ifdef __UNIX__
+    #include <signal.h>
+#endif
+
 #include "concurrency.h"
 #include "gexecute.h"
 #include "errors.h"
@@ -115,10 +128,9 @@ bool ReadOutput(wxInputStream& s, wxArrayString& out)
     return true;
 }
 
-std::pair<long, wxArrayString> DoExecuteGettextImpl(const wxString& cmdline_)
+// Returns full command line to run and sets up environment for it
+wxString PrepareGettextCommand(const wxString& cmdline_, wxExecuteEnv& env)
 {
-    wxArrayString gstderr;
-    wxExecuteEnv env;
     wxString cmdline(cmdline_);
 
 #if defined(__WXOSX__) || defined(__WXMSW__)
@@ -132,8 +144,19 @@ std::pair<long, wxArrayString> DoExecuteGettextImpl(const wxString& cmdline_)
         lang = "en"; // don't want things like en@blockquot
 	if ( !lang.empty() )
         env.env["LANG"] = lang;
+#else
+    (void)env;
 #endif // __WXOSX__ || __WXMSW__
 
+    return cmdline;
+}
+
+std::pair<long, wxArrayString> DoExecuteGettextImpl(const wxString& cmdline_)
+{
+    wxArrayString gstderr;
+    wxExecuteEnv env;
+    const wxString cmdline = PrepareGettextCommand(cmdline_, env);
+
     wxLogTrace("poedit.execute", "executing: %s", cmdline.c_str());
 
     wxScopedPtr<wxProcess> process(new wxProcess);
@@ -157,7 +180,341 @@ std::pair<long, wxArrayString> DoExecuteGettextImpl(const wxString& cmdline_)
     return std::make_pair(retcode, gstderr);
 }
 
-std::pair<long, wxArrayString> DoExecuteGettext(const wxString& cmdline)
+// Decodes a line of gettext tools' output, see ReadOutput() for explanation
+inline wxString DecodeOutputLine(const char *data, size_t len)
+{
+    const wxString line(data, wxConvISO8859_1, len);
+    wxString line2(line.mb_str(wxConvISO8859_1), wxConvUTF8);
+    return line2.empty() ? line : line2;
+}
+
+#if wxUSE_GUI
+
+/**
+    Gettext process started asynchronously from the main thread.
+
+    This is used when gettext tools are run from background threads or with
+    ExecuteGettextAsync(): wxExecute() can only be called on the main thread,
+    but running the process asynchronously there, instead of blocking the main
+    thread until it finishes, lets several tools run at the same time.
+
+    At most MAX_RUNNING processes run at once, others wait in a queue. All
+    bookkeeping is done on the main thread, so it needs no locking.
+ */
+class AsyncGettextProcess : public wxProcess
+{
+public:
+    typedef std::pair<long, wxArrayString> Result;
+    typedef std::function<void(const wxString&)> LineCallback;
+
+    struct Request
+    {
+        wxString cmdline;
+        std::shared_ptr<dispatch::promise<Result>> promise;
+        dispatch::cancellation_token_ptr cancellationToken;
+        std::chrono::milliseconds timeout {0};
+        LineCallback onStderrLine;
+    };
+
+    /**
+        Starts the process (or queues it if too many already run); must be
+        called on the main thread. Result is reported to the request's promise.
+
+        The process is killed if the request's cancellation token is cancelled
+        or its timeout expires while it runs; in the latter case, the promise
+        fails with Exception.
+     */
+    static void Start(Request&& req)
+    {
+        if (ms_running >= MaxRunning())
+        {
+            wxLogTrace("poedit.execute", "queueing: %s", req.cmdline.c_str());
+            ms_queue.push_back(std::move(req));
+            return;
+        }
+
+        if (req.cancellationToken && req.cancellationToken->is_cancelled())
+        {
+            req.promise->set_value(std::make_pair(-1L, wxArrayString()));
+            return;
+        }
+
+        wxExecuteEnv env;
+        const wxString cmdline = PrepareGettextCommand(req.cmdline, env);
+
+        wxLogTrace("poedit.execute", "executing asynchronously: %s", cmdline.c_str());
+
+        auto process = new AsyncGettextProcess(std::move(req));
+        long pid = wxExecute(cmdline, wxEXEC_ASYNC | wxEXEC_NODISABLE, process, &env);
+        if (pid == 0)
+        {
+            auto promise = process->m_req.promise;
+            delete process;
+            try
+            {
+                BOOST_THROW_EXCEPTION(Exception(wxString::Format(_("Cannot execute program: %s"), cmdline.c_str())));
+            }
+            catch (...)
+            {
+                dispatch::set_current_exception(promise);
+            }
+            return;
+        }
+
+        ms_running++;
+        // stderr must be read continuously, otherwise the process could block
+        // on writing into a full pipe:
+        process->m_timer.Start(POLL_INTERVAL);
+    }
+
+    void OnTerminate(int /*pid*/, int status) override
+    {
+        m_timer.Stop();
+        ReadAvailableErrors();
+        if (!m_partialLine.empty())
+            AddLine(m_partialLine.data(), m_partialLine.size());
+
+        if (status != 0)
+        {
+            wxLogTrace("poedit.execute", "  execution of command failed with exit code %d", status);
+        }
+
+        if (m_timedOut)
+        {
+            try
+            {
+                BOOST_THROW_EXCEPTION(Exception(wxString::Format(_(L"Program didn’t finish in time: %s"), m_req.cmdline.c_str())));
+            }
+            catch (...)
+            {
+                dispatch::set_current_exception(m_req.promise);
+            }
+        }
+        else
+        {
+            m_req.promise->set_value(std::make_pair((long)status, m_lines));
+        }
+
+        ms_running--;
+        delete this;
+
+        if (!ms_queue.empty())
+        {
+            Request next = std::move(ms_queue.front());
+            ms_queue.pop_front();
+            Start(std::move(next));
+        }
+    }
+
+private:
+    static const int POLL_INTERVAL = 50; // ms
+
+    static int MaxRunning()
+    {
+        return std::max(2, (int)std::thread::hardware_concurrency());
+    }
+
+    AsyncGettextProcess(Request&& req)
+        : m_req(std::move(req)), m_killed(false), m_timedOut(false), m_timer(this),
+          m_started(std::chrono::steady_clock::now())
+    {
+        Redirect();
+        Bind(wxEVT_TIMER, [=](wxTimerEvent&)
+        {
+            ReadAvailableErrors();
+            if (m_killed)
+                return;
+            if (m_req.cancellationToken && m_req.cancellationToken->is_cancelled())
+            {
+                // OnTerminate() is still called when the process exits
+                wxLogTrace("poedit.execute", "  killing cancelled process %d", (int)GetPid());
+                m_killed = true;
+                wxProcess::Kill(GetPid(), wxSIGKILL, wxKILL_CHILDREN);
+            }
+            else if (m_req.timeout.count() > 0 && std::chrono::steady_clock::now() - m_started > m_req.timeout)
+            {
+                wxLogTrace("poedit.execute", "  killing process %d after timeout", (int)GetPid());
+                m_killed = m_timedOut = true;
+                wxProcess::Kill(GetPid(), wxSIGKILL, wxKILL_CHILDREN);
+            }
+        });
+    }
+
+    void ReadAvailableErrors()
+    {
+        wxInputStream *std_err = GetErrorStream();
+        if (!std_err)
+            return;
+
+        char buffer[4096];
+        while (IsErrorAvailable())
+        {
+            std_err->Read(buffer, sizeof(buffer));
+            const size_t read = std_err->LastRead();
+            if (!read)
+                break;
+            m_partialLine.append(buffer, read);
+        }
+
+        // pass on complete lines as soon as they are available:
+        size_t pos = 0;
+        for (;;)
+        {
+            const size_t eol = m_partialLine.find_first_of("\r\n", pos);
+            if (eol == std::string::npos)
+                break;
+            if (eol > pos)
+                AddLine(m_partialLine.data() + pos, eol - pos);
+            pos = eol + 1;
+        }
+        m_partialLine.erase(0, pos);
+    }
+
+    void AddLine(const char *data, size_t len)
+    {
+        const wxString line = DecodeOutputLine(data, len);
+        m_lines.push_back(line);
+        if (m_req.onStderrLine)
+            m_req.onStderrLine(line);
+    }
+
+    Request m_req;
+    bool m_killed, m_timedOut;
+    std::string m_partialLine;
+    wxArrayString m_lines;
+    wxTimer m_timer;
+    std::chrono::steady_clock::time_point m_started;
+
+    static int ms_running;
+    static std::deque<Request> ms_queue;
+};
+
+int AsyncGettextProcess::ms_running = 0;
+std::deque<AsyncGettextProcess::Request> AsyncGettextProcess::ms_queue;
+
+#endif // wxUSE_GUI
+
+/**
+    Gettext process whose stdin and stdout are connected to in-memory buffers.
+
+    The pipes are serviced by helper threads, so that the process can't block
+    on a full pipe while Poedit waits for it to read another one. The calling
+    (main) thread doesn't process any events while waiting, just like
+    DoExecuteGettextImpl() doesn't.
+ */
+class PipedGettextProcess : public wxProcess
+{
+public:
+    /// Runs the process; must be called on the main thread. Returns false if it couldn't run.
+    static bool Run(const wxString& cmdline_, const std::string& input, std::string& output, wxArrayString& gstderr)
+    {
+        wxExecuteEnv env;
+        const wxString cmdline = PrepareGettextCommand(cmdline_, env);
+
+        wxLogTrace("poedit.execute", "executing with pipes: %s", cmdline.c_str());
+
+#ifdef __UNIX__
+        // writing into the pipe of a process that exited early must fail
+        // with EPIPE instead of killing Poedit:
+        static bool s_sigpipeIgnored = false;
+        if (!s_sigpipeIgnored)
+        {
+            signal(SIGPIPE, SIG_IGN);
+            s_sigpipeIgnored = true;
+        }
+#endif
+
+        // the process must outlive this function, because wxWidgets only
+        // notifies it about termination later; it deletes itself then
+        auto process = new PipedGettextProcess;
+        if (wxExecute(cmdline, wxEXEC_ASYNC | wxEXEC_NODISABLE, process, &env) == 0)
+        {
+            delete process;
+            return false;
+        }
+
+        wxInputStream *std_out = process->GetInputStream();
+        wxInputStream *std_err = process->GetErrorStream();
+        wxOutputStream *std_in = process->GetOutputStream();
+        if (!std_out || !std_err || !std_in)
+            return false;
+
+        std::string errData;
+        bool writeOk = true;
+        std::thread writer([&]
+        {
+            const char *pos = input.data();
+            const char *end = pos + input.size();
+            while (pos < end && writeOk)
+            {
+                std_in->Write(pos, std::min<size_t>(end - pos, 64 * 1024));
+                if (std_in->LastWrite() == 0)
+                    writeOk = false;
+                pos += std_in->LastWrite();
+            }
+            process->CloseOutput(); // signal EOF to the process
+        });
+        std::thread errReader([&]{ ReadAll(*std_err, errData); });
+        const bool readOk = ReadAll(*std_out, output);
+        errReader.join();
+        writer.join();
+
+        size_t pos = 0;
+        for (;;)
+        {
+            const size_t eol = errData.find_first_of("\r\n", pos);
+            const size_t end = (eol == std::string::npos) ? errData.size() : eol;
+            if (end > pos)
+                gstderr.push_back(DecodeOutputLine(errData.data() + pos, end - pos));
+            if (eol == std::string::npos)
+                break;
+            pos = eol + 1;
+        }
+
+        return readOk && writeOk;
+    }
+
+    void OnTerminate(int /*pid*/, int status) override
+    {
+        if (status != 0)
+        {
+            wxLogTrace("poedit.execute", "  execution of piped command failed with exit code %d", status);
+        }
+        delete this;
+    }
+
+private:
+    PipedGettextProcess()
+    {
+        Redirect();
+    }
+
+    // reads until EOF, i.e. until the process exits or closes the pipe
+    static bool ReadAll(wxInputStream& s, std::string& out)
+    {
+        char buffer[64 * 1024];
+        for (;;)
+        {
+            s.Read(buffer, sizeof(buffer));
+            const size_t read = s.LastRead();
+            out.append(buffer, read);
+            switch (s.GetLastError())
+            {
+                case wxSTREAM_NO_ERROR:
+                    if (read == 0)
+                        return true;
+                    break;
+                case wxSTREAM_EOF:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+    }
+};
+
+std::pair<long, wxArrayString> DoExecuteGettext(const wxString& cmdline,
+                                                 dispatch::cancellation_token_ptr cancellationToken = dispatch::cancellation_token_ptr())
 {
 #if wxUSE_GUI
     if (wxThread::IsMain())
@@ -166,9 +523,16 @@ std::pair<long, wxArrayString> DoExecuteGettext(const wxString& cmdline)
     }
     else
     {
-        return dispatch::on_main([=]{ return DoExecuteGettextImpl(cmdline); }).get();
+        AsyncGettextProcess::Request req;
+        req.cmdline = cmdline;
+        req.promise = std::make_shared<dispatch::promise<AsyncGettextProcess::Result>>();
+        req.cancellationToken = cancellationToken;
+        auto result = req.promise->get_future();
+        dispatch::on_main([req]() mutable { AsyncGettextProcess::Start(std::move(req)); });
+        return result.get();
     }
 #else
+    (void)cancellationToken;
     return DoExecuteGettextImpl(cmdline);
 #endif
 }
@@ -189,15 +553,8 @@ void LogUnrecognizedError(const wxString& err)
     wxLogError("%s", err);
 }
 
-} // anonymous namespace
-
-
-bool ExecuteGettext(const wxString& cmdline)
+void LogGettextErrors(const wxArrayString& gstderr)
 {
-    wxArrayString gstderr;
-    long retcode;
-    std::tie(retcode, gstderr) = DoExecuteGettext(cmdline);
-
     wxString pending;
     for (auto& ln: gstderr)
     {
@@ -220,18 +577,102 @@ bool ExecuteGettext(const wxString& cmdline)
 
     if (!pending.empty())
         LogUnrecognizedError(pending);
+}
+
+} // anonymous namespace
+
+
+bool ExecuteGettext(const wxString& cmdline, dispatch::cancellation_token_ptr cancellationToken)
+{
+    wxArrayString gstderr;
+    long retcode;
+    std::tie(retcode, gstderr) = DoExecuteGettext(cmdline, cancellationToken);
 
+    // errors of a killed process are of no interest:
+    if (cancellationToken && cancellationToken->is_cancelled())
+        return false;
+
+    LogGettextErrors(gstderr);
     return retcode == 0;
 }
 
 
-bool ExecuteGettextAndParseOutput(const wxString& cmdline, GettextErrors& errors)
+dispatch::future<bool> ExecuteGettextAsync(const wxString& cmdline,
+                                           std::function<void(const wxString& line)> onStderrLine,
+                                           dispatch::cancellation_token_ptr cancellationToken,
+                                           std::chrono::milliseconds timeout)
 {
+    typedef std::pair<long, wxArrayString> Result;
+    dispatch::future<Result> result;
+
+#if wxUSE_GUI
+    AsyncGettextProcess::Request req;
+    req.cmdline = cmdline;
+    req.promise = std::make_shared<dispatch::promise<Result>>();
+    req.cancellationToken = cancellationToken;
+    req.timeout = timeout;
+    req.onStderrLine = onStderrLine;
+    result = req.promise->get_future();
+    dispatch::on_main([req]() mutable { AsyncGettextProcess::Start(std::move(req)); });
+#else
+    // without an event loop, the best that can be done is running it in the background:
+    (void)timeout;
+    result = dispatch::async([=]
+    {
+        auto r = DoExecuteGettextImpl(cmdline);
+        if (onStderrLine)
+        {
+            for (auto& ln: r.second)
+                onStderrLine(ln);
+        }
+        return r;
+    });
+#endif
+
+    return result.then([=](Result r)
+    {
+        // errors of a killed process are of no interest:
+        if (cancellationToken && cancellationToken->is_cancelled())
+            return false;
+        if (!onStderrLine)
+            LogGettextErrors(r.second);
+        return r.first == 0;
+    });
+}
+
+
+bool ExecuteGettextWithPipes(const wxString& cmdline, const std::string& input, std::string& output,
+                             wxArrayString *stderrOutput)
+{
+#if wxUSE_GUI
+    if (!wxThread::IsMain())
+    {
+        return dispatch::on_main([&]{ return ExecuteGettextWithPipes(cmdline, input, output, stderrOutput); }).get();
+    }
+#endif
+
     wxArrayString gstderr;
-    long retcode;
-    std::tie(retcode, gstderr) = DoExecuteGettext(cmdline);
+    if (!PipedGettextProcess::Run(cmdline, input, output, gstderr))
+    {
+        wxLogTrace("poedit.execute", "  piping data through command failed: %s", cmdline.c_str());
+        return false;
+    }
+
+    if (stderrOutput)
+        *stderrOutput = gstderr;
+    else
+        LogGettextErrors(gstderr);
+    return true;
+}
+
 
-    static const std::wregex RE_ERROR(L".*\\.po:([0-9]+)(:[0-9]+)?: (.*)");
+namespace
+{
+
+void ParseGettextErrors(const wxArrayString& gstderr, GettextErrors& errors)
+{
+    // errors in files read from stdin are reported as "<stdin>:LINE: ..."
+    static const std::wregex RE_ERROR(L".*(\\.po|<stdin>):([0-9]+)(:[0-9]+)?: (.*)");
 
     for (const auto& ewx: gstderr)
     {
@@ -245,8 +686,8 @@ bool ExecuteGettextAndParseOutput(const wxString& cmdline, GettextErrors& errors
         std::wsmatch match;
         if (std::regex_match(e, match, RE_ERROR))
         {
-            rec.line = std::stoi(match.str(1));
-            rec.text = match.str(3);
+            rec.line = std::stoi(match.str(2));
+            rec.text = match.str(4);
             errors.push_back(rec);
             wxLogTrace("poedit.execute",
                        _T("        => parsed error = \"%s\" at %d"),
@@ -258,11 +699,32 @@ bool ExecuteGettextAndParseOutput(const wxString& cmdline, GettextErrors& errors
             // FIXME: handle the rest of output gracefully too
         }
     }
+}
+
+} // anonymous namespace
+
 
+bool ExecuteGettextAndParseOutput(const wxString& cmdline, GettextErrors& errors)
+{
+    wxArrayString gstderr;
+    long retcode;
+    std::tie(retcode, gstderr) = DoExecuteGettext(cmdline);
+    ParseGettextErrors(gstderr, errors);
     return retcode == 0;
 }
 
 
+bool ExecuteGettextWithPipesAndParseOutput(const wxString& cmdline, const std::string& input, std::string& output,
+                                           GettextErrors& errors)
+{
+    wxArrayString gstderr;
+    if (!ExecuteGettextWithPipes(cmdline, input, output, &gstderr))
+        return false;
+    ParseGettextErrors(gstderr, errors);
+    return true;
+}
+
+
 wxString QuoteCmdlineArg(const wxString& s)
 {
     wxString s2(s);
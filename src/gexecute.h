@@ -26,7 +26,13 @@
 #ifndef _GEXECUTE_H_
 #define _GEXECUTE_H_
 
+#include "concurrency.h"
+
 #include <wx/string.h>
+#include <wx/arrstr.h>
+#include <chrono>
+#include <functional>
+#include <string>
 #include <vector>
 
 
@@ -41,14 +47,61 @@ typedef std::vector<GettextError> GettextErrors;
 
 /** Executes command. Writes stderr output to \a stderrOutput if not NULL,
     and logs it with wxLogError otherwise.
+
+    If \a cancellationToken is cancelled while the program runs on a background
+    thread, the program is killed and false is returned without logging errors.
+
     \return true if program exited with exit code 0, false otherwise.
  */
-extern bool ExecuteGettext(const wxString& cmdline);
+extern bool ExecuteGettext(const wxString& cmdline,
+                           dispatch::cancellation_token_ptr cancellationToken = dispatch::cancellation_token_ptr());
+
+/**
+    Executes command asynchronously, without blocking the calling thread.
+
+    Lines of stderr output are passed to \a onStderrLine on the main thread
+    as soon as they are written; if no callback is provided, the output is
+    logged with wxLogError when the program finishes.
+
+    Only a limited number of programs runs at the same time (this includes
+    programs run with ExecuteGettext() from background threads), others wait
+    until some of them finish.
+
+    If \a cancellationToken is cancelled, the program is killed and the
+    future resolves to false. If it doesn't finish within \a timeout (if
+    nonzero), it is killed and the future fails with Exception.
+
+    \return Future resolving to true if program exited with exit code 0,
+            false otherwise.
+ */
+extern dispatch::future<bool> ExecuteGettextAsync(const wxString& cmdline,
+                                                  std::function<void(const wxString& line)> onStderrLine = {},
+                                                  dispatch::cancellation_token_ptr cancellationToken = dispatch::cancellation_token_ptr(),
+                                                  std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
 
 /// Like ExecuteGettext(), but stores error output parsed into per-item entries.
 extern bool ExecuteGettextAndParseOutput(const wxString& cmdline,
                                          GettextErrors& errors);
 
+/**
+    Executes command that reads its input from stdin and writes its result
+    to stdout (e.g. "msgcat -o - -"), feeding it \a input and collecting
+    its standard output in \a output, without any temporary files.
+
+    stderr output is stored into \a stderrOutput if not NULL and logged
+    with wxLogError otherwise.
+
+    \return true if the program ran and all data were passed through, false
+            otherwise. Its exit code is not available, the caller must check
+            the output instead.
+ */
+extern bool ExecuteGettextWithPipes(const wxString& cmdline, const std::string& input, std::string& output,
+                                    wxArrayString *stderrOutput = nullptr);
+
+/// Like ExecuteGettextWithPipes(), but stores error output parsed into per-item entries.
+extern bool ExecuteGettextWithPipesAndParseOutput(const wxString& cmdline, const std::string& input, std::string& output,
+                                                  GettextErrors& errors);
+
 extern wxString QuoteCmdlineArg(const wxString& s);
 
 extern wxString GetGettextPackagePath();
@@ -28,15 +28,23 @@
 #include "utility.h"
 #include "str_helpers.h"
 
+#include <algorithm>
+#include <fstream>
 #include <iomanip>
+#include <map>
+#include <mutex>
 #include <sstream>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 
 #include <wx/filename.h>
+#include <wx/log.h>
 #include <wx/uri.h>
 
 
@@ -73,6 +81,46 @@ void downloaded_file::move_to(const wxFileName& target) { return m_impl->move_to
 downloaded_file::~downloaded_file() {}
 
 
+void http_body_data::write_gzip_compressed(const wxString& output_file) const
+{
+    namespace io = boost::iostreams;
+
+    std::ofstream output(output_file.fn_str(), std::ios::binary);
+    io::filtering_ostream out;
+    out.push(io::gzip_compressor());
+    out.push(output);
+
+    auto file = body_file();
+    if (!file.empty())
+    {
+        std::ifstream input(file.fn_str(), std::ios::binary);
+        if (!input)
+            BOOST_THROW_EXCEPTION(std::runtime_error("failed to read " + file.utf8_string()));
+        io::copy(input, out);
+    }
+    else
+    {
+        auto data = body();
+        out.write(data.data(), data.size());
+        out.reset();  // flushes the compressor
+    }
+
+    output.close();
+    if (!output)
+        BOOST_THROW_EXCEPTION(std::runtime_error("failed to write " + output_file.utf8_string()));
+}
+
+
+std::string file_data::body() const
+{
+    std::ifstream f(m_filename.fn_str(), std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    if (f.bad())
+        BOOST_THROW_EXCEPTION(std::runtime_error("failed to read " + m_filename.utf8_string()));
+    return data;
+}
+
+
 multipart_form_data::multipart_form_data()
 {
     boost::uuids::random_generator gen;
@@ -125,23 +173,58 @@ json_data::json_data(const json& data)
 }
 
 
+namespace
+{
+
+// Maximum number of hosts to keep shared clients for in download_from_anywhere()
+const size_t MAX_SHARED_CLIENTS = 8;
+
+std::mutex gs_sharedClientsMutex;
+std::map<std::string, std::shared_ptr<http_client>> gs_sharedClients;
+
+std::shared_ptr<http_client> get_shared_client(const std::string& prefix)
+{
+    std::lock_guard<std::mutex> lock(gs_sharedClientsMutex);
+
+    auto i = gs_sharedClients.find(prefix);
+    if (i != gs_sharedClients.end())
+        return i->second;
+
+    if (gs_sharedClients.size() >= MAX_SHARED_CLIENTS)
+        gs_sharedClients.clear();  // clients in use are kept alive by their requests
+
+    auto client = std::make_shared<http_client>(prefix);
+    gs_sharedClients[prefix] = client;
+    return client;
+}
+
+} // anonymous namespace
+
+
+void http_client::cleanup()
+{
+    std::lock_guard<std::mutex> lock(gs_sharedClientsMutex);
+    gs_sharedClients.clear();
+}
+
+
 dispatch::future<downloaded_file> http_client::download_from_anywhere(const std::string& url, const headers& hdrs)
 {
     // http_client requires that all requests are relative to the provided prefix
     // (this is a C++REST SDK limitation enforced on some platforms), so we need
-    // to determine the URL's prefix, create a transient http_client for it and
-    // use it to perform the request.
+    // to determine the URL's prefix and use a http_client for it to perform the
+    // request. Clients are shared per host to reuse connections and TLS sessions.
 
     wxURI uri(url);
     const std::string prefix = str::to_utf8(uri.GetScheme() + "://" + uri.GetServer());
 
-    auto transient = std::make_shared<http_client>(prefix);
-    return transient->download(url, hdrs)
-           .then([transient](downloaded_file file)
+    auto client = get_shared_client(prefix);
+    return client->download(url, hdrs)
+           .then([client](downloaded_file file)
            {
                // The entire purpose of this otherwise-useless closure is to
-               // capture the `transient` http_client instance and ensure it won't
-               // be destroyed too early.
+               // capture the `client` http_client instance and ensure it won't
+               // be destroyed too early if it's no longer shared.
                //
                // It will only be released at this point.
                return file;
@@ -149,6 +232,149 @@ dispatch::future<downloaded_file> http_client::download_from_anywhere(const std:
 }
 
 
+dispatch::future<std::string> http_client::download_from_anywhere(const std::string& url, const wxString& output_file, const headers& hdrs)
+{
+    wxURI uri(url);
+    const std::string prefix = str::to_utf8(uri.GetScheme() + "://" + uri.GetServer());
+
+    auto client = get_shared_client(prefix);
+    return client->download(url, output_file, hdrs)
+           .then([client](std::string etag)
+           {
+               return etag;  // see above
+           });
+}
+
+
+namespace
+{
+
+// Aggregated statistics of requests to one host, reported by
+// http_client::get_diagnostics_report().
+struct host_stats
+{
+    // accumulated duration of a phase, only over requests where it was measured:
+    struct phase
+    {
+        uint64_t count = 0;
+        double total_ms = 0;
+
+        void add(double ms)
+        {
+            if (ms < 0)
+                return;
+            count++;
+            total_ms += ms;
+        }
+
+        double avg() const { return count ? total_ms / count : 0.0; }
+    };
+
+    uint64_t requests = 0, failed = 0;
+    phase total, dns, connect, tls, ttfb, transfer;
+    double max_ms = 0;
+    uint64_t bytes_sent = 0, bytes_received = 0;
+};
+
+std::mutex gs_statsMutex;
+std::map<std::string, host_stats> gs_stats;
+uint64_t gs_statsRequests = 0;
+
+// how often to dump aggregated statistics into the trace log
+const uint64_t STATS_TRACE_DUMP_INTERVAL = 50;
+
+// Formats phase duration for tracing, "-" if not measured
+std::string format_phase(double ms)
+{
+    if (ms < 0)
+        return "-";
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(1) << ms;
+    return ss.str();
+}
+
+} // anonymous namespace
+
+
+void http_client::record_metrics(const request_metrics& m)
+{
+    const bool failed = m.status_code == 0 || m.status_code >= 400;
+    bool dumpReport = false;
+    {
+        std::lock_guard<std::mutex> lock(gs_statsMutex);
+        auto& s = gs_stats[m.host];
+        s.requests++;
+        if (failed)
+            s.failed++;
+        s.total.add(m.total_ms);
+        s.dns.add(m.dns_ms);
+        s.connect.add(m.connect_ms);
+        s.tls.add(m.tls_ms);
+        s.ttfb.add(m.ttfb_ms);
+        s.transfer.add(m.transfer_ms);
+        s.max_ms = std::max(s.max_ms, m.total_ms);
+        s.bytes_sent += m.bytes_sent;
+        s.bytes_received += m.bytes_received;
+        dumpReport = (++gs_statsRequests % STATS_TRACE_DUMP_INTERVAL) == 0;
+    }
+
+    if (!wxLog::IsAllowedTraceMask("poedit.http"))
+        return;
+
+    wxLogTrace("poedit.http", "%s %s: %d in %.1f ms (dns %s, connect %s, tls %s, ttfb %s, transfer %s), sent %llu B, received %llu B",
+               m.method, m.url, m.status_code, m.total_ms,
+               format_phase(m.dns_ms), format_phase(m.connect_ms), format_phase(m.tls_ms),
+               format_phase(m.ttfb_ms), format_phase(m.transfer_ms),
+               (unsigned long long)m.bytes_sent, (unsigned long long)m.bytes_received);
+
+    if (dumpReport)
+    {
+        std::istringstream ss(get_diagnostics_report());
+        std::string line;
+        while (std::getline(ss, line))
+            wxLogTrace("poedit.http", "%s", line);
+    }
+}
+
+
+std::string http_client::get_diagnostics_report()
+{
+    std::lock_guard<std::mutex> lock(gs_statsMutex);
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(1);
+
+    if (gs_stats.empty())
+        ss << "no requests\n";
+
+    for (auto& i: gs_stats)
+    {
+        auto& s = i.second;
+        ss << i.first << ": requests " << s.requests
+           << ", failed " << s.failed
+           << ", avg " << s.total.avg() << " ms"
+           << ", max " << s.max_ms << " ms"
+           << ", sent " << s.bytes_sent / 1024 << " KiB"
+           << ", received " << s.bytes_received / 1024 << " KiB\n";
+        ss << "    avg phases (ms):";
+        const std::pair<const char*, const host_stats::phase*> phases[] = {
+            {"dns", &s.dns}, {"connect", &s.connect}, {"tls", &s.tls}, {"ttfb", &s.ttfb}, {"transfer", &s.transfer}
+        };
+        for (auto& p: phases)
+        {
+            ss << " " << p.first << " ";
+            if (p.second->count)
+                ss << p.second->avg() << " (" << p.second->count << "x)";
+            else
+                ss << "n/a";
+        }
+        ss << "\n";
+    }
+
+    return ss.str();
+}
+
+
 std::string http_client::url_encode(const std::string& s, int flags)
 {
     std::ostringstream escaped;
@@ -34,6 +34,7 @@
 #include <wx/filename.h>
 
 #include <exception>
+#include <stdexcept>
 #include <map>
 #include <memory>
 #include <string>
@@ -41,6 +42,17 @@
 class http_client;
 
 
+/**
+    Thrown by http_client's methods if the server responded with
+    304 Not Modified to a conditional (If-None-Match) request.
+ */
+class http_not_modified : public std::runtime_error
+{
+public:
+    http_not_modified() : std::runtime_error("not modified") {}
+};
+
+
 /**
     File downloaded using http_client::download().
 
@@ -87,6 +99,17 @@ public:
 
     /// Returns generated body of the request.
     virtual std::string body() const = 0;
+
+    /**
+        Returns file with the body of the request if the data are stored on
+        disk, empty string otherwise.
+
+        File data are streamed to the server and body() isn't used for them.
+     */
+    virtual wxString body_file() const { return wxString(); }
+
+    /// Writes gzip-compressed body of the request into @a output_file.
+    void write_gzip_compressed(const wxString& output_file) const;
 };
 
 /// Stores unspecified binary data
@@ -104,6 +127,22 @@ private:
     std::string m_body;
 };
 
+/// Binary data stored in a file on disk, sent without loading into memory
+class file_data : public http_body_data
+{
+public:
+    file_data(const wxString& filename, const std::string& content_type = "application/octet-stream")
+        : m_filename(filename), m_content_type(content_type) {}
+
+    std::string content_type() const override { return m_content_type; }
+    std::string body() const override;
+    wxString body_file() const override { return m_filename; }
+
+private:
+    wxString m_filename;
+    std::string m_content_type;
+};
+
 /// Stores POSTed data (RFC 1867)
 class multipart_form_data : public http_body_data
 {
@@ -161,8 +200,9 @@ public:
     /// Connection flags for the client.
     enum flags
     {
-        // currently no flags are used
-        default_flags = 0
+        default_flags = 0,
+        /// Send gzip-compressed request bodies; only for servers that accept Content-Encoding: gzip
+        compress_requests = 1
     };
 
     using headers = std::vector<std::pair<std::string, std::string>>;
@@ -186,6 +226,18 @@ public:
     /// Sets Authorization header to be used in all requests
     void set_authorization(const std::string& auth);
 
+    /**
+        Limits the number of requests performed at the same time.
+
+        Further requests are queued until one of the running requests finishes.
+        Connections to the server are kept alive and reused by all requests
+        made with the same client. Unlimited (0) by default.
+     */
+    void set_max_concurrent_requests(int max);
+
+    /// Releases clients shared by download_from_anywhere(); must be called on app shutdown.
+    static void cleanup();
+
     /// Perform a GET request at the given URL
     dispatch::future<json> get(const std::string& url, const headers& hdrs = headers());
 
@@ -194,17 +246,31 @@ public:
 
         This method supports ETag handling. If the headers include If-None-Match value
         and the server returns 304 Not Modified, downloaded_file is not returned and
-        an exception is thrown instead.
+        http_not_modified exception is thrown instead.
      */
     dispatch::future<downloaded_file> download(const std::string& url, const headers& hdrs = headers());
 
+    /**
+        Perform a GET request and write the body directly into @a output_file.
+
+        Unlike download(), the body is streamed straight to its destination,
+        without an intermediate temporary file. Returns the ETag of the
+        response (or empty string). Throws http_not_modified like download().
+     */
+    dispatch::future<std::string> download(const std::string& url, const wxString& output_file, const headers& hdrs = headers());
+
     /**
         Convenience variant of download() for downloading without having full http_client.
 
         This is useful e.g. when downloading from unknown host. @a url is absolute URL.
+        Clients for recently used hosts are shared, so that their connections
+        are reused by subsequent downloads.
      */
     static dispatch::future<downloaded_file> download_from_anywhere(const std::string& url, const headers& hdrs = headers());
 
+    /// Convenience variant of download() into @a output_file for downloading without having full http_client.
+    static dispatch::future<std::string> download_from_anywhere(const std::string& url, const wxString& output_file, const headers& hdrs = headers());
+
     /**
         Perform a POST request with multipart/form-data formatted @a params.
      */
@@ -222,6 +288,22 @@ public:
     static std::string url_encode(const std::string& s, int flags = 0);
     static std::string url_encode(const std::wstring& s, int flags = 0);
 
+    /**
+        Returns true if @a e is an error that may go away if the request is
+        retried later: network failure, server error or rate limiting.
+     */
+    static bool is_transient_error(dispatch::exception_ptr e);
+
+    /**
+        Returns human-readable report of HTTP requests statistics (per-phase
+        latencies, transferred bytes, errors) aggregated per host since the
+        application started.
+
+        Individual requests, as well as the report periodically, are logged
+        with wxLogTrace("poedit.http").
+     */
+    static std::string get_diagnostics_report();
+
 protected:
     /**
         Extract more detailed, client specific error response from the
@@ -241,6 +323,22 @@ protected:
     virtual void on_error_response(int& /*statusCode*/, std::string& /*message*/) {};
 
 private:
+    /// Measurements of a single finished request. Phases that the backend
+    /// can't measure are negative.
+    struct request_metrics
+    {
+        std::string method;
+        std::string url;
+        std::string host;
+        int status_code = 0;  // 0 if there was no response
+        double dns_ms = -1, connect_ms = -1, tls_ms = -1, ttfb_ms = -1, transfer_ms = -1;
+        double total_ms = 0;
+        uint64_t bytes_sent = 0, bytes_received = 0;
+    };
+
+    /// Records finished request into diagnostic statistics; thread-safe.
+    static void record_metrics(const request_metrics& m);
+
     class impl;
     std::unique_ptr<impl> m_impl;
 };
@@ -27,8 +27,11 @@
 
 #include "version.h"
 #include "str_helpers.h"
+#include "utility.h"
 
+#include <chrono>
 #include <cstdlib>
+#include <functional>
 
 #include <boost/algorithm/string/predicate.hpp>
 
@@ -45,6 +48,8 @@
 #include <cpprest/http_msg.h>
 #include <cpprest/filestream.h>
 
+#include <deque>
+#include <mutex>
 #include <regex>
 
 
@@ -120,6 +125,68 @@ public:
     }
 };
 
+// Limits the number of requests running concurrently, queuing the rest
+class request_limiter : public http::http_pipeline_stage
+{
+public:
+    void set_max(int max)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_max = max;
+    }
+
+    pplx::task<http::http_response> propagate(http::http_request request) override
+    {
+        pplx::task_completion_event<void> slot;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_max <= 0 || m_running < m_max)
+            {
+                m_running++;
+                slot.set();
+            }
+            else
+            {
+                m_waiting.push_back(slot);
+            }
+        }
+
+        auto self = std::static_pointer_cast<request_limiter>(shared_from_this());
+        return pplx::create_task(slot)
+        .then([self, request]
+        {
+            return self->next_stage()->propagate(request);
+        })
+        .then([self](pplx::task<http::http_response> t)
+        {
+            self->release();
+            return t;
+        });
+    }
+
+private:
+    void release()
+    {
+        pplx::task_completion_event<void> next;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_waiting.empty())
+            {
+                m_running--;
+                return;
+            }
+            next = m_waiting.front();  // the slot is passed on to it
+            m_waiting.pop_front();
+        }
+        next.set();
+    }
+
+    std::mutex m_mutex;
+    int m_max = 0;
+    int m_running = 0;
+    std::deque<pplx::task_completion_event<void>> m_waiting;
+};
+
 } // anonymous namespace
 
 
@@ -141,9 +208,13 @@ public:
             #define USER_AGENT_PLATFORM
         #endif
         m_userAgent = L"Poedit/" make_wide_str(POEDIT_VERSION) USER_AGENT_PLATFORM;
+        m_compress = (flags & http_client::compress_requests) != 0;
 
         std::shared_ptr<http::http_pipeline_stage> gzip_stage = std::make_shared<gzip_compression_support>();
         m_native.add_handler(gzip_stage);
+
+        m_limiter = std::make_shared<request_limiter>();
+        m_native.add_handler(m_limiter);
     }
 
     static string_t ui_language;
@@ -153,17 +224,27 @@ public:
         m_auth = std::wstring(auth.begin(), auth.end());
     }
 
+    void set_max_concurrent_requests(int max)
+    {
+        m_limiter->set_max(max);
+    }
+
     dispatch::future<::json> get(const std::string& url, const headers& hdrs)
     {
         auto req = build_request(http::methods::GET, url, hdrs);
+        auto timing = start_timing(req);
 
         return
         m_native.request(req)
         .then([=](http::http_response response)
         {
+            timing->response_received(response);
             handle_error(response);
-            return ::json::parse(response.extract_utf8string().get());
-        });
+            auto body = response.extract_utf8string().get();
+            timing->metrics.bytes_received = body.size();
+            return ::json::parse(body);
+        })
+        .then(timing->finish<::json>());
     }
 
     dispatch::future<downloaded_file> download(const std::string& url, const headers& hdrs)
@@ -171,11 +252,13 @@ public:
         using namespace concurrency::streams;
 
         auto req = build_request(http::methods::GET, url, hdrs);
+        auto timing = start_timing(req);
 
         return
         m_native.request(req)
         .then([=](http::http_response response)
         {
+            timing->response_received(response);
             handle_error(response);
 
             std::string etag;
@@ -191,8 +274,9 @@ public:
             {
                 return
                 response.body().read_to_end(outFile.streambuf())
-                .then([=](size_t)
+                .then([=](size_t size)
                 {
+                    timing->metrics.bytes_received = size;
                     return outFile.close();
                 });
             })
@@ -200,27 +284,150 @@ public:
             {
                 return file;
             });
-        });
+        })
+        .then(timing->finish<downloaded_file>());
+    }
+
+    dispatch::future<std::string> download(const std::string& url, const wxString& output_file, const headers& hdrs)
+    {
+        using namespace concurrency::streams;
+
+        auto req = build_request(http::methods::GET, url, hdrs);
+        auto timing = start_timing(req);
+
+        return
+        m_native.request(req)
+        .then([=](http::http_response response)
+        {
+            timing->response_received(response);
+            handle_error(response);
+
+            std::string etag;
+            auto i_etag = response.headers().find(http::header_names::etag);
+            if (i_etag != response.headers().end())
+                etag = str::to_utf8(i_etag->second);
+
+            return
+            fstream::open_ostream(to_string_t(output_file), std::ios::out | std::ios::trunc | std::ios::binary)
+            .then([=](ostream outFile)
+            {
+                return
+                response.body().read_to_end(outFile.streambuf())
+                .then([=](size_t size)
+                {
+                    timing->metrics.bytes_received = size;
+                    return outFile.close();
+                });
+            })
+            .then([etag]()
+            {
+                return etag;
+            });
+        })
+        .then(timing->finish<std::string>());
     }
 
     dispatch::future<::json> post(const std::string& url, const http_body_data& data, const headers& hdrs)
     {
+        using namespace concurrency::streams;
+
         auto req = build_request(http::methods::POST, url, hdrs);
 
-        auto body = data.body();
-        req.set_body(body, data.content_type());
-        req.headers().set_content_length(body.size());
+        // compressed data are written into a temporary file and streamed from there:
+        std::shared_ptr<TempDirectory> tmpdir;
+        wxString body_file = data.body_file();
+        if (m_compress)
+        {
+            tmpdir = std::make_shared<TempDirectory>();
+            auto compressed = tmpdir->CreateFileName("body.gz");
+            data.write_gzip_compressed(compressed);
+            body_file = compressed;
+            req.headers().add(http::header_names::content_encoding, _XPLATSTR("gzip"));
+        }
+
+        auto timing = start_timing(req);
+
+        istream body_stream;
+        if (!body_file.empty())
+        {
+            auto size = (size_t)wxFileName::GetSize(body_file).GetValue();
+            body_stream = file_stream<uint8_t>::open_istream(to_string_t(body_file)).get();
+            req.set_body(body_stream, size, to_string_t(data.content_type()));
+            timing->metrics.bytes_sent = size;
+        }
+        else
+        {
+            auto body = data.body();
+            req.set_body(body, data.content_type());
+            req.headers().set_content_length(body.size());
+            timing->metrics.bytes_sent = body.size();
+        }
 
         return
         m_native.request(req)
-        .then([=](http::http_response response)
+        .then([=, keep_alive = tmpdir](http::http_response response)
         {
+            timing->response_received(response);
+            if (body_stream.is_valid())
+                body_stream.close().wait();
+
             handle_error(response);
-            return ::json::parse(response.extract_utf8string().get());
-        });
+            auto body = response.extract_utf8string().get();
+            timing->metrics.bytes_received = body.size();
+            return ::json::parse(body);
+        })
+        .then(timing->finish<::json>());
     }
 
 private:
+    // Measures request for diagnostic statistics. Connection-level phases
+    // (DNS, connect, TLS) aren't exposed by cpprestsdk, so they are included
+    // in TTFB, which also includes waiting in the request_limiter queue.
+    struct request_timing : public std::enable_shared_from_this<request_timing>
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        request_metrics metrics;
+        Clock::time_point start = Clock::now(), headers_received;
+
+        void response_received(const http::http_response& response)
+        {
+            headers_received = Clock::now();
+            metrics.ttfb_ms = to_ms(headers_received - start);
+            metrics.status_code = response.status_code();
+        }
+
+        // Returns continuation that records the request when it finishes, successfully or not
+        template<typename T>
+        std::function<T(pplx::task<T>)> finish()
+        {
+            auto self = shared_from_this();
+            return [self](pplx::task<T> task)
+            {
+                auto end = Clock::now();
+                if (self->metrics.ttfb_ms >= 0)
+                    self->metrics.transfer_ms = to_ms(end - self->headers_received);
+                self->metrics.total_ms = to_ms(end - self->start);
+                http_client::record_metrics(self->metrics);
+                return task.get();
+            };
+        }
+
+        static double to_ms(Clock::duration d)
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0;
+        }
+    };
+
+    std::shared_ptr<request_timing> start_timing(const http::http_request& req)
+    {
+        auto t = std::make_shared<request_timing>();
+        t->metrics.method = str::to_utf8(req.method());
+        t->metrics.url = str::to_utf8(req.request_uri().to_string());
+        t->metrics.host = str::to_utf8(m_native.base_uri().host());
+        return t;
+    }
+
     http::http_request build_request(http::method method, const std::string& relative_url, const headers& hdrs)
     {
         http::http_request req(method);
@@ -245,6 +452,9 @@ private:
         if (r.status_code() >= 200 && r.status_code() < 300)
             return; // not an error
 
+        if (r.status_code() == http::status_codes::NotModified)
+            BOOST_THROW_EXCEPTION(http_not_modified());
+
         int status_code = r.status_code();
         std::string msg;
         if (r.headers().content_type() == _XPLATSTR("application/json"))
@@ -330,6 +540,8 @@ private:
     http::client::http_client m_native;
     std::wstring m_userAgent;
     std::wstring m_auth;
+    bool m_compress;
+    std::shared_ptr<request_limiter> m_limiter;
 };
 
 
@@ -355,6 +567,11 @@ void http_client::set_authorization(const std::string& auth)
     m_impl->set_authorization(auth);
 }
 
+void http_client::set_max_concurrent_requests(int max)
+{
+    m_impl->set_max_concurrent_requests(max);
+}
+
 dispatch::future<::json> http_client::get(const std::string& url, const headers& hdrs)
 {
     return m_impl->get(url, hdrs);
@@ -365,6 +582,32 @@ dispatch::future<downloaded_file> http_client::download(const std::string& url,
     return m_impl->download(url, hdrs);
 }
 
+bool http_client::is_transient_error(dispatch::exception_ptr e)
+{
+    try
+    {
+        boost::rethrow_exception(e);
+    }
+    catch (http::http_exception& ex)
+    {
+        // errors reported by the server use HTTP status codes, anything else
+        // is a failure to communicate with it:
+        const int code = ex.error_code().value();
+        if (code >= 400 && code < 600)
+            return code == 429 /* Too Many Requests */ || code >= 500;
+        return true;
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+dispatch::future<std::string> http_client::download(const std::string& url, const wxString& output_file, const headers& hdrs)
+{
+    return m_impl->download(url, output_file, hdrs);
+}
+
 dispatch::future<::json> http_client::post(const std::string& url, const http_body_data& data, const headers& hdrs)
 {
     return m_impl->post(url, data, hdrs);
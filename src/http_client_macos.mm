@@ -26,22 +26,33 @@
 #include "http_client.h"
 
 #include "str_helpers.h"
+#include "utility.h"
 #include "version.h"
 
 
 class http_exception : public std::runtime_error
 {
 public:
-    http_exception(const std::string& what) : std::runtime_error(what) {}
+    http_exception(int code, const std::string& what) : std::runtime_error(what), status_code(code) {}
+
+    /// HTTP status of the response or 0 if there was no response
+    int status_code;
 };
 
 
+// Collects timing of finished tasks for http_client's diagnostic statistics
+@interface PoeditHTTPMetricsCollector : NSObject <NSURLSessionTaskDelegate>
+@end
+
+
 class http_client::impl
 {
 public:
-    impl(http_client& owner, const std::string& url_prefix, int /*flags*/)
+    impl(http_client& owner, const std::string& url_prefix, int flags)
         : m_owner(owner), m_authHeader(nil)
     {
+        m_compress = (flags & http_client::compress_requests) != 0;
+
         int majorVersion, minorVersion, patchVersion;
         NSOperatingSystemVersion macos = [[NSProcessInfo processInfo] operatingSystemVersion];
         majorVersion = (int)macos.majorVersion;
@@ -61,7 +72,8 @@ public:
         NSString *str = str::to_NS(url_prefix);
 
         m_baseURL = [NSURL URLWithString:str];
-        m_session = [NSURLSession sessionWithConfiguration:config];
+        m_config = config;
+        m_session = create_session();
     }
 
     ~impl()
@@ -74,6 +86,16 @@ public:
         m_authHeader = auth.empty() ? nil : str::to_NS(auth);
     }
 
+    void set_max_concurrent_requests(int max)
+    {
+        // NSURLSession queues requests over the limit by itself (and multiplexes
+        // them over a single connection with HTTP/2), but the limit can only be
+        // set when creating the session:
+        m_config.HTTPMaximumConnectionsPerHost = max > 0 ? max : 6 /* system default */;
+        [m_session finishTasksAndInvalidate];
+        m_session = create_session();
+    }
+
     dispatch::future<json> get(const std::string& url, const headers& hdrs)
     {
         auto promise = std::make_shared<dispatch::promise<json>>();
@@ -130,17 +152,62 @@ public:
         return promise->get_future();
     }
 
+    dispatch::future<std::string> download(const std::string& url, const wxString& output_file, const headers& hdrs)
+    {
+        auto promise = std::make_shared<dispatch::promise<std::string>>();
+
+        auto request = build_request(@"GET", url, hdrs);
+        auto task = [m_session downloadTaskWithRequest:request completionHandler:^(NSURL *location, NSURLResponse *response_, NSError *error) {
+            try
+            {
+                NSHTTPURLResponse *response = (NSHTTPURLResponse*)response_;
+
+                if (handle_error(nil, response, error, *promise))
+                    return;
+
+                NSString *etag = response.allHeaderFields[@"ETag"];
+                NSString *outputPath = str::to_NS(output_file);
+
+                // the system stores the body in its own temporary location, which is on
+                // the same volume as Poedit's files in practice; so just move it over:
+                NSError *err = nil;
+                NSFileManager *fm = [NSFileManager defaultManager];
+                [fm removeItemAtPath:outputPath error:nil];
+                if (![fm moveItemAtPath:[location path] toPath:outputPath error:&err])
+                    throw std::runtime_error(str::to_utf8([err localizedDescription]));
+
+                promise->set_value(etag ? str::to_utf8(etag) : std::string());
+            }
+            catch (...)
+            {
+                dispatch::set_current_exception(promise);
+            }
+        }];
+        [task resume];
+
+        return promise->get_future();
+    }
+
     dispatch::future<json> post(const std::string& url, const http_body_data& body_data, const headers& hdrs)
     {
         auto promise = std::make_shared<dispatch::promise<json>>();
 
         auto request = build_request(@"POST", url, hdrs);
-        auto body = body_data.body();
         [request setValue:str::to_NS(body_data.content_type()) forHTTPHeaderField:@"Content-Type"];
-        [request setValue:[NSString stringWithFormat:@"%lu", body.size()] forHTTPHeaderField:@"Content-Length"];
-        [request setHTTPBody:[NSData dataWithBytes:body.data() length:body.size()]];
 
-        auto task = [m_session dataTaskWithRequest:request completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+        // compressed data are written into a temporary file and streamed from there:
+        std::shared_ptr<TempDirectory> tmpdir;
+        wxString body_file = body_data.body_file();
+        if (m_compress)
+        {
+            tmpdir = std::make_shared<TempDirectory>();
+            auto compressed = tmpdir->CreateFileName("body.gz");
+            body_data.write_gzip_compressed(compressed);
+            body_file = compressed;
+            [request setValue:@"gzip" forHTTPHeaderField:@"Content-Encoding"];
+        }
+
+        auto handler = ^(NSData *data, NSURLResponse *response, NSError *error) {
             try
             {
                 if (handle_error(data, response, error, *promise))
@@ -151,13 +218,71 @@ public:
             {
                 dispatch::set_current_exception(promise);
             }
-        }];
+        };
+
+        NSURLSessionTask *task;
+        if (!body_file.empty())
+        {
+            auto fileURL = [NSURL fileURLWithPath:str::to_NS(body_file)];
+            task = [m_session uploadTaskWithRequest:request fromFile:fileURL completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+                handler(data, response, error);
+                (void)tmpdir; // keep the temporary file alive until sent
+            }];
+        }
+        else
+        {
+            auto body = body_data.body();
+            [request setValue:[NSString stringWithFormat:@"%lu", body.size()] forHTTPHeaderField:@"Content-Length"];
+            [request setHTTPBody:[NSData dataWithBytes:body.data() length:body.size()]];
+            task = [m_session dataTaskWithRequest:request completionHandler:handler];
+        }
         [task resume];
 
         return promise->get_future();
     }
 
+    static void record_task_metrics(NSURLSessionTask *task, NSURLSessionTaskMetrics *metrics)
+    {
+        auto interval = [](NSDate *from, NSDate *to) -> double
+        {
+            if (!from || !to)
+                return -1;  // not measured, e.g. reused connection
+            return [to timeIntervalSinceDate:from] * 1000.0;
+        };
+
+        request_metrics m;
+        NSURLRequest *request = task.originalRequest;
+        m.method = str::to_utf8(request.HTTPMethod);
+        m.url = str::to_utf8(request.URL.path);
+        m.host = str::to_utf8(request.URL.host);
+        if (!task.error)
+            m.status_code = (int)((NSHTTPURLResponse*)task.response).statusCode;
+        m.total_ms = metrics.taskInterval.duration * 1000.0;
+        m.bytes_sent = (uint64_t)task.countOfBytesSent;
+        m.bytes_received = (uint64_t)task.countOfBytesReceived;
+
+        // redirects produce multiple transactions, the last one is the interesting one:
+        NSURLSessionTaskTransactionMetrics *t = metrics.transactionMetrics.lastObject;
+        if (t)
+        {
+            m.dns_ms = interval(t.domainLookupStartDate, t.domainLookupEndDate);
+            m.connect_ms = interval(t.connectStartDate, t.connectEndDate);
+            m.tls_ms = interval(t.secureConnectionStartDate, t.secureConnectionEndDate);
+            m.ttfb_ms = interval(t.requestStartDate, t.responseStartDate);
+            m.transfer_ms = interval(t.responseStartDate, t.responseEndDate);
+        }
+
+        http_client::record_metrics(m);
+    }
+
 private:
+    NSURLSession *create_session()
+    {
+        return [NSURLSession sessionWithConfiguration:m_config
+                                             delegate:[PoeditHTTPMetricsCollector new]
+                                        delegateQueue:nil];
+    }
+
     NSMutableURLRequest *build_request(NSString *method, const std::string& relative_url, const headers& hdrs)
     {
         auto url = [NSURL URLWithString:str::to_NS(relative_url) relativeToURL:m_baseURL];
@@ -181,6 +306,19 @@ private:
         if (error == nil && status_code >= 200 && status_code < 300)
             return false;  // no error
 
+        if (error == nil && status_code == 304)
+        {
+            try
+            {
+                BOOST_THROW_EXCEPTION(http_not_modified());
+            }
+            catch (...)
+            {
+                dispatch::set_current_exception(promise);
+            }
+            return true;
+        }
+
         std::string desc;
 
         // try to parse error description if present:
@@ -208,7 +346,7 @@ private:
         try
         {
             m_owner.on_error_response(status_code, desc);
-            BOOST_THROW_EXCEPTION(http_exception(desc));
+            BOOST_THROW_EXCEPTION(http_exception(error ? 0 : status_code, desc));
         }
         catch (...)
         {
@@ -226,12 +364,24 @@ private:
 private:
     http_client& m_owner;
 
+    NSURLSessionConfiguration *m_config;
     NSURLSession *m_session;
     NSURL *m_baseURL;
     NSString *m_authHeader;
+    bool m_compress;
 };
 
 
+@implementation PoeditHTTPMetricsCollector
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didFinishCollectingMetrics:(NSURLSessionTaskMetrics *)metrics
+{
+    http_client::impl::record_task_metrics(task, metrics);
+}
+
+@end
+
+
 http_client::http_client(const std::string& url_prefix, int flags)
     : m_impl(new impl(*this, url_prefix, flags))
 {
@@ -246,6 +396,11 @@ void http_client::set_authorization(const std::string& auth)
     m_impl->set_authorization(auth);
 }
 
+void http_client::set_max_concurrent_requests(int max)
+{
+    m_impl->set_max_concurrent_requests(max);
+}
+
 dispatch::future<json> http_client::get(const std::string& url, const headers& hdrs)
 {
     return m_impl->get(url, hdrs);
@@ -256,6 +411,27 @@ dispatch::future<downloaded_file> http_client::download(const std::string& url,
     return m_impl->download(url, hdrs);
 }
 
+bool http_client::is_transient_error(dispatch::exception_ptr e)
+{
+    try
+    {
+        boost::rethrow_exception(e);
+    }
+    catch (http_exception& ex)
+    {
+        return ex.status_code == 0 || ex.status_code == 429 || ex.status_code >= 500;
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+dispatch::future<std::string> http_client::download(const std::string& url, const wxString& output_file, const headers& hdrs)
+{
+    return m_impl->download(url, output_file, hdrs);
+}
+
 dispatch::future<json> http_client::post(const std::string& url, const http_body_data& data, const headers& hdrs)
 {
     return m_impl->post(url, data, hdrs);
@@ -28,6 +28,8 @@
 #include <wx/image.h>
 #include <wx/rawbmp.h>
 
+#include <map>
+#include <mutex>
 #include <set>
 
 #ifdef __WXGTK__
@@ -37,6 +39,7 @@
 #include "icons.h"
 
 #include "colorscheme.h"
+#include "concurrency.h"
 #include "edapp.h"
 #include "hidpi.h"
 #include "utility.h"
@@ -93,12 +96,12 @@ bool ShouldBeMirorredInRTL(const wxArtID& id, const wxArtClient& client)
     return mirror;
 }
 
-void ProcessTemplateImage(wxImage& img, bool keepOpaque, bool inverted)
+void ProcessTemplateImage(wxImage& img, ColorScheme::Mode mode, bool keepOpaque, bool inverted)
 {
     int size = img.GetWidth() * img.GetHeight();
 
     ColorScheme::Mode inverseMode = inverted ? ColorScheme::Light : ColorScheme::Dark;
-    if (ColorScheme::GetAppMode() == inverseMode)
+    if (mode == inverseMode)
     {
         auto rgb = img.GetData();
         for (int i = 0; i < 3*size; ++i, ++rgb)
@@ -114,6 +117,77 @@ void ProcessTemplateImage(wxImage& img, bool keepOpaque, bool inverted)
     }
 }
 
+// Decoded (and possibly rescaled) images shared by all icon variants, which
+// is where most of the time is spent. May be used from any thread.
+class DecodedImagesCache
+{
+public:
+    static DecodedImagesCache& Get()
+    {
+        static DecodedImagesCache s_instance;
+        return s_instance;
+    }
+
+    /// Loads image for icon @a iconfile (full path without extension) in @a mode.
+    ScaledImage Load(const wxString& iconfile, ColorScheme::Mode mode)
+    {
+        const wxString key = MakeKey(iconfile, mode);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto i = m_images.find(key);
+            if (i != m_images.end())
+                return i->second;
+        }
+
+        // failures are cached too, there's no point in checking again
+        auto icon = DoLoad(iconfile, mode);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_images.emplace(key, icon);
+        return icon;
+    }
+
+    /// Like Load(), but only fills the cache; to be used from worker threads.
+    void Preload(const wxString& iconfile, ColorScheme::Mode mode)
+    {
+        const wxString key = MakeKey(iconfile, mode);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_images.find(key) != m_images.end())
+                return;
+        }
+
+        auto icon = DoLoad(iconfile, mode);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_images.emplace(key, icon);
+        // wxImage's reference counting isn't thread-safe, so don't keep any
+        // reference to the shared data outside of the lock:
+        icon = ScaledImage();
+    }
+
+private:
+    static wxString MakeKey(const wxString& iconfile, ColorScheme::Mode mode)
+    {
+        return wxString::Format("%s|%d|%f", iconfile, (int)mode, HiDPIScalingFactor());
+    }
+
+    static ScaledImage DoLoad(const wxString& iconfile, ColorScheme::Mode mode)
+    {
+        ScaledImage icon;
+        if (mode == ColorScheme::Dark)
+            icon = LoadScaledBitmap(iconfile + "Dark");
+        if (!icon.IsOk())
+            icon = LoadScaledBitmap(iconfile);
+        return icon;
+    }
+
+    std::mutex m_mutex;
+    std::map<wxString, ScaledImage> m_images;
+};
+
+// Final bitmaps, with all the variants' processing applied, keyed by
+// everything that affects them. Only used from the main thread.
+std::map<wxString, wxBitmap> gs_bitmapsCache;
+
 #ifdef __WXGTK3__
 // FIXME: This is not correct, should use dedicated loading API instead
 void ProcessSymbolicImage(wxBitmap& bmp)
@@ -151,6 +225,32 @@ PoeditArtProvider::PoeditArtProvider()
 }
 
 
+void PoeditArtProvider::PreloadIcons()
+{
+    static const char *ids[] =
+    {
+        "document-open",
+        "document-save",
+        "poedit-update",
+        "poedit-validate",
+        "poedit-sync",
+        "sidebar",
+        "follow-link",
+        "StatusError",
+        "StatusWarning",
+        "ItemCommentTemplate",
+    };
+
+    auto iconsdir = GetIconsDir();
+    auto mode = ColorScheme::GetAppMode();
+    dispatch::async([iconsdir, mode]
+    {
+        for (auto id: ids)
+            DecodedImagesCache::Get().Preload(iconsdir + "/" + id, mode);
+    });
+}
+
+
 wxString PoeditArtProvider::GetIconsDir()
 {
 #if defined(__WXMSW__)
@@ -167,6 +267,29 @@ wxBitmap PoeditArtProvider::CreateBitmap(const wxArtID& id_,
 {
     wxLogTrace("poedit.icons", "getting icon '%s'", id_.c_str());
 
+    // wxArtProvider's own cache is purged when the color scheme changes, so
+    // keep our own that doesn't need to be:
+    const auto mode = ColorScheme::GetAppMode();
+    const bool rtl = wxTheApp->GetLayoutDirection() == wxLayout_RightToLeft;
+    const wxString cacheKey = wxString::Format("%s|%s|%dx%d|%f|%d|%d",
+                                               id_, client, size.x, size.y,
+                                               HiDPIScalingFactor(), (int)mode, (int)rtl);
+    auto cached = gs_bitmapsCache.find(cacheKey);
+    if (cached != gs_bitmapsCache.end())
+        return cached->second;
+
+    auto bitmap = DoCreateBitmap(id_, client, size, mode, rtl);
+    gs_bitmapsCache.emplace(cacheKey, bitmap);
+    return bitmap;
+}
+
+
+wxBitmap PoeditArtProvider::DoCreateBitmap(const wxArtID& id_,
+                                           const wxArtClient& client,
+                                           const wxSize& size,
+                                           ColorScheme::Mode mode,
+                                           bool rtl)
+{
     wxArtID id(id_);
     #define CHECK_FOR_VARIANT(name)                         \
         const bool name##Variant = id.Contains("@" #name);  \
@@ -220,12 +343,7 @@ wxBitmap PoeditArtProvider::CreateBitmap(const wxArtID& id_,
     wxString iconfile;
     iconfile.Printf("%s/%s", iconsdir, id);
     wxLogTrace("poedit.icons", "loading from %s", iconfile);
-    ScaledImage icon;
-
-    if (ColorScheme::GetAppMode() == ColorScheme::Dark)
-        icon = LoadScaledBitmap(iconfile + "Dark");
-    if (!icon.IsOk())
-        icon = LoadScaledBitmap(iconfile);
+    ScaledImage icon = DecodedImagesCache::Get().Load(iconfile, mode);
 
     if (!icon.IsOk())
     {
@@ -234,12 +352,16 @@ wxBitmap PoeditArtProvider::CreateBitmap(const wxArtID& id_,
     }
 
     if (id.ends_with("Template"))
-        ProcessTemplateImage(icon.image, opaqueVariant, invertedVariant);
+    {
+        // modified in place, don't change the cached copy:
+        icon.image = icon.image.Copy();
+        ProcessTemplateImage(icon.image, mode, opaqueVariant, invertedVariant);
+    }
 
     if (disabledVariant)
         icon.image = icon.image.ConvertToDisabled();
 
-    if (wxTheApp->GetLayoutDirection() == wxLayout_RightToLeft && ShouldBeMirorredInRTL(id, client))
+    if (rtl && ShouldBeMirorredInRTL(id, client))
     {
         icon.image = icon.image.Mirror();
     }
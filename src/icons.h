@@ -28,6 +28,8 @@
 
 #include <wx/artprov.h>
 
+#include "colorscheme.h"
+
 #if defined(__WXGTK20__)
     #define HAS_THEMES_SUPPORT
 #endif
@@ -38,12 +40,30 @@ class PoeditArtProvider : public wxArtProvider
 public:
     PoeditArtProvider();
 
+    /**
+        Loads and decodes artwork that is needed by every editor window
+        (toolbar, list status icons) in the background, so that opening
+        windows doesn't have to wait for it.
+
+        Decoded images are cached for the lifetime of the process, per
+        scale factor and color scheme, so switching between color schemes
+        is cheap too.
+     */
+    static void PreloadIcons();
+
 protected:
     static wxString GetIconsDir();
 
     virtual wxBitmap CreateBitmap(const wxArtID& id,
                                   const wxArtClient& client,
                                   const wxSize& size);
+
+private:
+    wxBitmap DoCreateBitmap(const wxArtID& id,
+                            const wxArtClient& client,
+                            const wxSize& size,
+                            ColorScheme::Mode mode,
+                            bool rtl);
 };
 #endif
 
@@ -30,15 +30,18 @@
 
 #include <cctype>
 #include <algorithm>
+#include <fstream>
 #include <unordered_map>
 #include <mutex>
 #include <memory>
+#include <numeric>
 #include <regex>
 #include <set>
 
 #include <boost/algorithm/string.hpp>
 
 #include <unicode/utypes.h>
+#include <unicode/uversion.h>
 
 #include <wx/filename.h>
 
@@ -57,12 +60,55 @@
 namespace
 {
 
-// see http://www.gnu.org/software/gettext/manual/html_node/Header-Entry.html
-// for description of permitted formats
-const std::wregex RE_LANG_CODE(L"([a-z]){2,3}(_([A-Z]{2}|[0-9]{3}))?(@[a-z]+)?");
+// Checks if the string is a language code, i.e. matches
+//
+//   ([a-z]){2,3}(_([A-Z]{2}|[0-9]{3}))?(@[a-z]+)?
+//
+// (see http://www.gnu.org/software/gettext/manual/html_node/Header-Entry.html
+// for description of permitted formats), or, if @a permissive is set, a more
+// permissive variant of the same that TryNormalize() would fix:
+//
+//   ([a-zA-Z]){2,3}([_-]([a-zA-Z]{2}|[0-9]{3}))?(@[a-zA-Z]+)?
+//
+// This is called for every Language created from a string, so it is
+// hand-written instead of using std::regex.
+template<typename T>
+bool MatchLangCode(const T& s, bool permissive)
+{
+    auto lower = [=](auto c){ return (c >= 'a' && c <= 'z') || (permissive && c >= 'A' && c <= 'Z'); };
+    auto upper = [=](auto c){ return (c >= 'A' && c <= 'Z') || (permissive && c >= 'a' && c <= 'z'); };
+    auto digit = [](auto c){ return c >= '0' && c <= '9'; };
+
+    const size_t len = s.length();
+    size_t i = 0;
 
-// a more permissive variant of the same that TryNormalize() would fix
-const std::wregex RE_LANG_CODE_PERMISSIVE(L"([a-zA-Z]){2,3}([_-]([a-zA-Z]{2}|[0-9]{3}))?(@[a-zA-Z]+)?");
+    while (i < len && lower(s[i]))
+        i++;
+    if (i < 2 || i > 3)
+        return false;
+
+    if (i < len && (s[i] == '_' || (permissive && s[i] == '-')))
+    {
+        i++;
+        if (i + 2 <= len && upper(s[i]) && upper(s[i+1]))
+            i += 2;
+        else if (i + 3 <= len && digit(s[i]) && digit(s[i+1]) && digit(s[i+2]))
+            i += 3;
+        else
+            return false;
+    }
+
+    if (i < len && s[i] == '@')
+    {
+        const size_t start = ++i;
+        while (i < len && lower(s[i]))
+            i++;
+        if (i == start)
+            return false;
+    }
+
+    return i == len;
+}
 
 // try some normalizations: s/-/_/, case adjustments
 void TryNormalize(std::wstring& s)
@@ -137,112 +183,214 @@ struct DisplayNamesData
     typedef std::unordered_map<std::u16string, std::string> Map;
     Map names, namesEng;
     std::vector<std::wstring> sortedNames;
+
+    // Language names in the order they were added, for the on-disk cache
+    struct Entry
+    {
+        std::string code;
+        std::wstring name, engName;
+    };
+    std::vector<Entry> entries;
+
+    void Add(const std::string& code, const std::wstring& name, const std::wstring& engName)
+    {
+        sortedNames.push_back(name);
+        names[unicode::fold_case_to_type<std::u16string>(name)] = code;
+        if (!engName.empty())
+            namesEng[unicode::fold_case_to_type<std::u16string>(engName)] = code;
+        entries.push_back({code, name, engName});
+    }
 };
 
 std::once_flag of_namesList;
 
-const DisplayNamesData& GetDisplayNamesData()
+wxString gs_displayNamesCacheDir;
+
+// Increment when changing the format of the cache file:
+const char DISPLAY_NAMES_CACHE_MAGIC[] = "PoeditLanguageNames 1";
+
+// The names depend on ICU's data and the UI language:
+std::string GetDisplayNamesCacheKey()
 {
-    static DisplayNamesData data;
+    char icuVerStr[U_MAX_VERSION_STRING_LENGTH] = {0};
+    UVersionInfo icuVer;
+    u_getVersion(icuVer);
+    u_versionToString(icuVer, icuVerStr);
+    return std::string(DISPLAY_NAMES_CACHE_MAGIC) + " " + icuVerStr + " " + uloc_getDefault();
+}
 
-    std::call_once(of_namesList, [=]{
-        std::set<std::string> foundCodes;
+wxString GetDisplayNamesCacheFile()
+{
+    if (gs_displayNamesCacheDir.empty())
+        return wxString();
+    return gs_displayNamesCacheDir + wxFILE_SEP_PATH + "LanguageNames.cache";
+}
 
-        int32_t count = uloc_countAvailable();
-        data.sortedNames.reserve(count);
+// The cache is a text file with the cache key on the first line, followed
+// by "code\tname\tEnglish name" lines in the order the names were added,
+// an empty line and the names in sorted order, one per line.
+bool LoadDisplayNamesCache(DisplayNamesData& data)
+{
+    const wxString filename = GetDisplayNamesCacheFile();
+    if (filename.empty() || !wxFileName::FileExists(filename))
+        return false;
 
-        char language[128] = {0};
-        char script[128] = {0};
-        char country[128] = {0};
-        char variant[128] = {0};
+    std::ifstream f(filename.fn_str(), std::ios::binary);
+    std::string line;
+    if (!std::getline(f, line) || line != GetDisplayNamesCacheKey())
+        return false;
 
-        for (int i = 0; i < count; i++)
-        {
-            const char *locale = uloc_getAvailable(i);
+    DisplayNamesData loaded;
+    while (std::getline(f, line) && !line.empty())
+    {
+        auto tab1 = line.find('\t');
+        auto tab2 = tab1 == std::string::npos ? tab1 : line.find('\t', tab1 + 1);
+        if (tab2 == std::string::npos)
+            return false;
+        loaded.Add(line.substr(0, tab1),
+                   str::to_wstring(line.substr(tab1 + 1, tab2 - tab1 - 1)),
+                   str::to_wstring(line.substr(tab2 + 1)));
+    }
 
-            UErrorCode err = U_ZERO_ERROR;
-            uloc_getLanguage(locale, language, std::size(language), &err);
-            uloc_getScript(locale, script, std::size(script), &err);
-            uloc_getCountry(locale, country, std::size(country), &err);
-            uloc_getVariant(locale, variant, std::size(variant), &err);
+    // Add() put names in the order of adding, replace them with sorted ones:
+    const size_t count = loaded.sortedNames.size();
+    loaded.sortedNames.clear();
+    while (std::getline(f, line))
+        loaded.sortedNames.push_back(str::to_wstring(line));
+    if (loaded.sortedNames.size() != count || count == 0)
+        return false;
 
-            // TODO: for now, ignore variants here and in FormatForRoundtrip(),
-            //       because translating them between gettext and ICU is nontrivial
-            if (!str::empty(variant))
-                continue;
+    data = std::move(loaded);
+    return true;
+}
 
-            UChar buf[512] = {0};
-            err = U_ZERO_ERROR;
-            uloc_getDisplayName(locale, nullptr, buf, std::size(buf), &err);
+void SaveDisplayNamesCache(const DisplayNamesData& data)
+{
+    const wxString filename = GetDisplayNamesCacheFile();
+    if (filename.empty())
+        return;
 
-            data.sortedNames.emplace_back(str::to_wstring(buf));
-            auto foldedName = unicode::fold_case_to_type<std::u16string>(buf);
+    if (!wxFileName::DirExists(gs_displayNamesCacheDir))
+        wxFileName::Mkdir(gs_displayNamesCacheDir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
 
-            if (strcmp(language, "zh") == 0 && *country == '\0')
-            {
-                if (strcmp(script, "Hans") == 0)
-                    strncpy(country, "CN", std::size(country));
-                else if (strcmp(script, "Hant") == 0)
-                    strncpy(country, "TW", std::size(country));
-            }
+    const wxString tempname = filename + ".tmp";
+    {
+        std::ofstream f(tempname.fn_str(), std::ios::binary);
+        f << GetDisplayNamesCacheKey() << '\n';
+        for (auto& e: data.entries)
+            f << e.code << '\t' << str::to_utf8(e.name) << '\t' << str::to_utf8(e.engName) << '\n';
+        f << '\n';
+        for (auto& n: data.sortedNames)
+            f << str::to_utf8(n) << '\n';
+        if (!f)
+            return;
+    }
+    wxRenameFile(tempname, filename, /*overwrite=*/true);
+}
 
-            std::string code(language);
-            if (*country != '\0')
+void BuildDisplayNamesData(DisplayNamesData& data)
+{
+    std::set<std::string> foundCodes;
+
+    int32_t count = uloc_countAvailable();
+    data.sortedNames.reserve(count);
+
+    char language[128] = {0};
+    char script[128] = {0};
+    char country[128] = {0};
+    char variant[128] = {0};
+
+    for (int i = 0; i < count; i++)
+    {
+        const char *locale = uloc_getAvailable(i);
+
+        UErrorCode err = U_ZERO_ERROR;
+        uloc_getLanguage(locale, language, std::size(language), &err);
+        uloc_getScript(locale, script, std::size(script), &err);
+        uloc_getCountry(locale, country, std::size(country), &err);
+        uloc_getVariant(locale, variant, std::size(variant), &err);
+
+        // TODO: for now, ignore variants here and in FormatForRoundtrip(),
+        //       because translating them between gettext and ICU is nontrivial
+        if (!str::empty(variant))
+            continue;
+
+        UChar buf[512] = {0};
+        err = U_ZERO_ERROR;
+        uloc_getDisplayName(locale, nullptr, buf, std::size(buf), &err);
+        const auto name = str::to_wstring(buf);
+
+        if (strcmp(language, "zh") == 0 && *country == '\0')
+        {
+            if (strcmp(script, "Hans") == 0)
+                strncpy(country, "CN", std::size(country));
+            else if (strcmp(script, "Hant") == 0)
+                strncpy(country, "TW", std::size(country));
+        }
+
+        std::string code(language);
+        if (*country != '\0')
+        {
+            code += '_';
+            code += country;
+        }
+        if (*script != '\0')
+        {
+            if (strcmp(script, "Latn") == 0)
             {
-                code += '_';
-                code += country;
+                code += "@latin";
             }
-            if (*script != '\0')
+            else if (strcmp(script, "Cyrl") == 0)
             {
-                if (strcmp(script, "Latn") == 0)
-                {
-                    code += "@latin";
-                }
-                else if (strcmp(script, "Cyrl") == 0)
-                {
-                    // add @cyrillic only if it's not the default already
-                    if (strcmp(language, "sr") != 0)
-                        code += "@cyrillic";
-                }
+                // add @cyrillic only if it's not the default already
+                if (strcmp(language, "sr") != 0)
+                    code += "@cyrillic";
             }
+        }
 
-            foundCodes.insert(code);
-            data.names[foldedName] = code;
- 
-            err = U_ZERO_ERROR;
-            uloc_getDisplayName(locale, ULOC_ENGLISH, buf, std::size(buf), &err);
-            auto foldedEngName = unicode::fold_case_to_type<std::u16string>(buf);
+        foundCodes.insert(code);
 
-            data.namesEng[foldedEngName] = code;
-        }
+        err = U_ZERO_ERROR;
+        uloc_getDisplayName(locale, ULOC_ENGLISH, buf, std::size(buf), &err);
 
-        // add languages that are not listed as locales in ICU:
-        for (const char * const* i = uloc_getISOLanguages(); *i != nullptr; ++i)
-        {
-            const char *code = *i;
-            if (foundCodes.find(code) != foundCodes.end())
-                continue;
+        data.Add(code, name, str::to_wstring(buf));
+    }
+
+    // add languages that are not listed as locales in ICU:
+    for (const char * const* i = uloc_getISOLanguages(); *i != nullptr; ++i)
+    {
+        const char *code = *i;
+        if (foundCodes.find(code) != foundCodes.end())
+            continue;
+
+        UErrorCode err = U_ZERO_ERROR;
+        uloc_getLanguage(code, language, std::size(language), &err);
+        if (U_FAILURE(err) || strcmp(code, language) != 0)
+            continue; // e.g. 'und' for undetermined language
 
-            UErrorCode err = U_ZERO_ERROR;
-            uloc_getLanguage(code, language, std::size(language), &err);
-            if (U_FAILURE(err) || strcmp(code, language) != 0)
-                continue; // e.g. 'und' for undetermined language
+        auto isoName = GetDisplayNameOrLanguage<std::wstring>(code, nullptr);
+        if (isoName.empty())
+            continue;
 
-            auto isoName = GetDisplayNameOrLanguage<std::wstring>(code, nullptr);
-            if (isoName.empty())
-                continue;
+        data.Add(code, isoName, GetDisplayNameOrLanguage<std::wstring>(code, ULOC_ENGLISH));
+    }
 
-            data.sortedNames.push_back(isoName);
-            data.names[unicode::fold_case_to_type<std::u16string>(isoName)] = code;
+    // sort the names alphabetically for data.sortedNames:
+    unicode::Collator coll(unicode::Collator::case_insensitive);
+    std::sort(data.sortedNames.begin(), data.sortedNames.end(), std::ref(coll));
+}
 
-            auto isoEngName = GetDisplayNameOrLanguage<std::wstring>(code, ULOC_ENGLISH);
-            if (!isoEngName.empty())
-                data.namesEng[unicode::fold_case_to_type<std::u16string>(isoEngName)] = code;
-        }
+const DisplayNamesData& GetDisplayNamesData()
+{
+    static DisplayNamesData data;
+
+    std::call_once(of_namesList, [=]{
+        // Building the list takes a while, so it is cached on disk:
+        if (LoadDisplayNamesCache(data))
+            return;
 
-        // sort the names alphabetically for data.sortedNames:
-        unicode::Collator coll(unicode::Collator::case_insensitive);
-        std::sort(data.sortedNames.begin(), data.sortedNames.end(), std::ref(coll));
+        BuildDisplayNamesData(data);
+        SaveDisplayNamesCache(data);
     });
 
     return data;
@@ -285,85 +433,119 @@ std::string DoGetLanguageTag(const Language& lang)
     return tag;
 }
 
-inline bool DoIsRTL(const Language& lang)
+inline TextDirection DoGetDirection(const std::string& icuLocale)
 {
-    auto locale = lang.IcuLocaleName();
-    return uloc_isRightToLeft(locale.c_str());
+    return uloc_isRightToLeft(icuLocale.c_str()) ? TextDirection::RTL : TextDirection::LTR;
 }
 
 } // anonymous namespace
 
 
-void Language::Init(const std::string& code)
+const Language::Data& Language::InvalidData()
 {
-    m_code = code;
+    static const Data s_invalid;
+    return s_invalid;
+}
 
-    if (IsValid())
+void Language::Init(const std::string& code)
+{
+    if (code.empty())
     {
-        m_tag = DoGetLanguageTag(*this);
-        m_icuLocale = m_tag;
+        m_data.reset();
+        return;
+    }
 
-        char locale[512];
-        UErrorCode status = U_ZERO_ERROR;
-        uloc_forLanguageTag(m_tag.c_str(), locale, 512, NULL, &status);
-        if (U_SUCCESS(status))
-            m_icuLocale = locale;
+    // Languages are created from codes all the time (e.g. for every TM
+    // insertion or query) and computing the tag or ICU locale is expensive,
+    // so the records are interned and created only once for every code:
+    static std::mutex s_mutex;
+    static std::unordered_map<std::string, std::shared_ptr<const Data>> s_interned;
 
-        m_direction = DoIsRTL(*this) ? TextDirection::RTL : TextDirection::LTR;
-    }
-    else
     {
-        m_tag.clear();
-        m_icuLocale.clear();
-        m_direction = TextDirection::LTR;
+        std::lock_guard<std::mutex> lock(s_mutex);
+        auto i = s_interned.find(code);
+        if (i != s_interned.end())
+        {
+            m_data = i->second;
+            return;
+        }
     }
+
+    auto d = std::make_shared<Data>();
+    d->code = code;
+    d->wcode.assign(code.begin(), code.end());
+    m_data = d;
+
+    d->tag = DoGetLanguageTag(*this);
+    d->icuLocale = d->tag;
+
+    char locale[512];
+    UErrorCode status = U_ZERO_ERROR;
+    uloc_forLanguageTag(d->tag.c_str(), locale, 512, NULL, &status);
+    if (U_SUCCESS(status))
+        d->icuLocale = locale;
+
+    d->direction = DoGetDirection(d->icuLocale);
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    m_data = s_interned.emplace(code, d).first->second;
 }
 
 bool Language::IsValidCode(const std::wstring& s)
 {
-    return std::regex_match(s, RE_LANG_CODE);
+    return MatchLangCode(s, /*permissive=*/false);
+}
+
+bool Language::IsValidCode(const std::string& s)
+{
+    return MatchLangCode(s, /*permissive=*/false);
 }
 
 std::string Language::Lang() const
 {
-    return m_code.substr(0, m_code.find_first_of("_@"));
+    auto& code = Code();
+    return code.substr(0, code.find_first_of("_@"));
 }
 
 std::string Language::Country() const
 {
-    const size_t pos = m_code.find('_');
+    auto& code = Code();
+    const size_t pos = code.find('_');
     if (pos == std::string::npos)
         return std::string();
 
-    const size_t endpos = m_code.rfind('@');
+    const size_t endpos = code.rfind('@');
     if (endpos == std::string::npos)
-        return m_code.substr(pos+1);
+        return code.substr(pos+1);
     else
-        return m_code.substr(pos+1, endpos - (pos+1));
+        return code.substr(pos+1, endpos - (pos+1));
 }
 
 std::string Language::LangAndCountry() const
 {
-    return m_code.substr(0, m_code.rfind('@'));
+    auto& code = Code();
+    return code.substr(0, code.rfind('@'));
 }
 
 std::string Language::Variant() const
 {
-    const size_t pos = m_code.rfind('@');
+    auto& code = Code();
+    const size_t pos = code.rfind('@');
     if (pos == std::string::npos)
         return std::string();
     else
-        return m_code.substr(pos + 1);
+        return code.substr(pos + 1);
 }
 
 Language Language::MinimizeSubtags() const
 {
-    if (m_icuLocale.empty())
+    auto& locale = IcuLocaleName();
+    if (locale.empty())
         return *this;
 
     char minimized[512];
     UErrorCode status = U_ZERO_ERROR;
-    uloc_minimizeSubtags(m_icuLocale.c_str(), minimized, 512, &status);
+    uloc_minimizeSubtags(locale.c_str(), minimized, 512, &status);
     if (U_FAILURE(status))
         return *this;
 
@@ -392,7 +574,7 @@ Language Language::TryParse(const std::wstring& s)
         return Language("zh_TW");
 
     // Is it a standard language code?
-    if (std::regex_match(s, RE_LANG_CODE_PERMISSIVE))
+    if (MatchLangCode(s, /*permissive=*/true))
     {
         std::wstring s2(s);
         TryNormalize(s2);
@@ -401,7 +583,7 @@ Language Language::TryParse(const std::wstring& s)
     }
 
     // If not, perhaps it's a human-readable name (perhaps coming from the language control)?
-    auto names = GetDisplayNamesData();
+    auto& names = GetDisplayNamesData();
     auto folded = unicode::fold_case_to_type<std::u16string>(s);
     auto i = names.names.find(folded);
     if (i != names.names.end())
@@ -420,6 +602,15 @@ Language Language::TryParse(const std::wstring& s)
     return Language(); // invalid
 }
 
+Language Language::TryParse(const std::string& s)
+{
+    // avoid conversion of the common case of well-formed code:
+    if (IsValidCode(s))
+        return Language(s);
+
+    return TryParse(std::wstring(s.begin(), s.end()));
+}
+
 
 Language Language::TryParseWithValidation(const std::wstring& s)
 {
@@ -449,24 +640,30 @@ Language Language::FromLanguageTag(const std::string& tag)
     if (U_FAILURE(status) || !len)
         return Language();
 
-    Language lang;
-    lang.m_tag = tag;
-    lang.m_icuLocale = locale;
+    auto d = std::make_shared<Data>();
+    d->tag = tag;
+    d->icuLocale = locale;
 
     char buf[512];
     if (uloc_getLanguage(locale, buf, 512, &status))
-        lang.m_code = buf;
+        d->code = buf;
     if (uloc_getCountry(locale, buf, 512, &status))
-        lang.m_code += "_" + std::string(buf);
+        d->code += "_" + std::string(buf);
 
     // ICU converts private use subtag into 'x' keyword, e.g. de-DE-x-formal => de_DE@x=formal
     static const std::regex re_private_subtag("@x=([^@]+)$");
     std::cmatch m;
     if (std::regex_search(locale, m, re_private_subtag))
-        lang.m_code += "@" + m.str(1);
+        d->code += "@" + m.str(1);
 
-    lang.m_direction = DoIsRTL(lang) ? TextDirection::RTL : TextDirection::LTR;
+    if (d->code.empty())
+        return Language(); // invalid
+
+    d->wcode.assign(d->code.begin(), d->code.end());
+    d->direction = DoGetDirection(d->icuLocale);
 
+    Language lang;
+    lang.m_data = d;
     return lang;
 }
 
@@ -505,7 +702,7 @@ PluralFormsExpr Language::DefaultPluralFormsExpr() const
         #include "language_impl_plurals.h"
     };
 
-    auto i = forms.find(m_code);
+    auto i = forms.find(Code());
     if ( i != forms.end() )
         return i->second;
 
@@ -530,20 +727,20 @@ int Language::nplurals() const
 
 wxString Language::DisplayName() const
 {
-    return GetDisplayNameOrLanguage<wxString>(m_icuLocale.c_str(), nullptr);
+    return GetDisplayNameOrLanguage<wxString>(IcuLocaleName().c_str(), nullptr);
 }
 
 wxString Language::LanguageDisplayName() const
 {
     UErrorCode err = U_ZERO_ERROR;
     UChar buf[512] = {0};
-    uloc_getDisplayLanguage(m_icuLocale.c_str(), nullptr, buf, std::size(buf), &err);
+    uloc_getDisplayLanguage(IcuLocaleName().c_str(), nullptr, buf, std::size(buf), &err);
     return str::to_wx(buf);
 }
 
 wxString Language::DisplayNameInItself() const
 {
-    auto name = GetDisplayNameOrLanguage<wxString>(m_icuLocale.c_str(), m_icuLocale.c_str());
+    auto name = GetDisplayNameOrLanguage<wxString>(IcuLocaleName().c_str(), IcuLocaleName().c_str());
     if (!name.empty())
         return name;
 
@@ -556,7 +753,7 @@ wxString Language::FormatForRoundtrip() const
     // Can't show all variants nicely, but some common one can be
     auto v = Variant();
     if (!v.empty() && v != "latin" && v != "cyrillic")
-        return m_code;
+        return Code();
 
     wxString disp = DisplayName();
     // ICU isn't 100% reliable, some of the display names it produces
@@ -566,7 +763,7 @@ wxString Language::FormatForRoundtrip() const
     if (TryParse(disp.ToStdWstring()).IsValid())
         return disp;
     else
-        return m_code;
+        return Code();
 }
 
 
@@ -576,6 +773,18 @@ const std::vector<std::wstring>& Language::AllFormattedNames()
 }
 
 
+void Language::SetDisplayNamesCacheDir(const wxString& dir)
+{
+    gs_displayNamesCacheDir = dir;
+}
+
+
+void Language::PreloadDisplayNames()
+{
+    GetDisplayNamesData();
+}
+
+
 Language Language::TryGuessFromFilename(const wxString& filename, wxString *wildcard)
 {
     if (wildcard)
@@ -655,11 +864,19 @@ Language Language::TryGuessFromFilename(const wxString& filename, wxString *wild
 }
 
 
-Language Language::TryDetectFromText(const char *buffer, size_t len, Language probableLanguage)
+namespace
+{
+
+// Detects language of the text. Returns invalid language if it couldn't be
+// detected at all, otherwise sets @a reliable to indicate whether the result
+// can be relied upon.
+Language DoDetectFromText(const char *buffer, size_t len, const Language& probableLanguage, bool& reliable)
 {
 #ifdef HAVE_CLD2
     using namespace CLD2;
 
+    reliable = false;
+
     CLDHints hints = {NULL, NULL, UNKNOWN_ENCODING, UNKNOWN_LANGUAGE};
     if (probableLanguage.IsValid())
     {
@@ -696,8 +913,10 @@ Language Language::TryDetectFromText(const char *buffer, size_t len, Language pr
         is_reliable = true;
     }
 
-    if (lang == UNKNOWN_LANGUAGE || !is_reliable)
-        return Language();
+    if (lang == UNKNOWN_LANGUAGE)
+        return ::Language();
+
+    reliable = is_reliable;
 
     // CLD2 penalizes English in bilingual content in some cases as "boilerplate"
     // because it is tailored for the web. So e.g. 66% English, 33% Italian is
@@ -708,21 +927,125 @@ Language Language::TryDetectFromText(const char *buffer, size_t len, Language pr
     if (lang != language3[0] && language3[0] == CLD2::ENGLISH && language3[1] == lang)
         lang = language3[0];
 
-    return Language::TryParse(LanguageCode(lang));
+    return ::Language::TryParse(LanguageCode(lang));
 #else
     (void)buffer;
     (void)len;
+    reliable = true;
     return probableLanguage;
 #endif
 }
 
+// Sizes of samples analyzed by TryDetectFromSample(): starts with the initial
+// size and grows 4x with every round until the max size is reached
+const size_t DETECTION_SAMPLE_INITIAL_SIZE = 4 * 1024;
+const size_t DETECTION_SAMPLE_MAX_SIZE = 256 * 1024;
+
+} // anonymous namespace
+
 
-PluralFormsExpr::PluralFormsExpr() : m_calcCreated(true)
+Language Language::TryDetectFromText(const char *buffer, size_t len, Language probableLanguage)
+{
+    bool reliable;
+    auto lang = DoDetectFromText(buffer, len, probableLanguage, reliable);
+    return reliable ? lang : Language();
+}
+
+
+Language Language::TryDetectFromSample(size_t count,
+                                       const std::function<std::string(size_t)>& getText,
+                                       Language probableLanguage)
+{
+    if (!count)
+        return Language();
+
+    // Texts are visited in order that spreads them evenly over the whole
+    // range, so that even a small sample covers all parts of the input: by
+    // stepping with a stride that is coprime with count (so that all texts are
+    // eventually visited) and close to count/golden ratio.
+    size_t stride = 1;
+    if (count > 2)
+    {
+        stride = std::max<size_t>(1, size_t(count * 0.6180339887));
+        while (std::gcd(stride, count) != 1)
+            stride++;
+    }
+
+    std::string sample;
+    size_t sampleSize = DETECTION_SAMPLE_INITIAL_SIZE;
+    size_t visited = 0;
+    size_t pos = 0;
+    for (;;)
+    {
+        while (visited < count && sample.size() < sampleSize)
+        {
+            auto text = getText(pos);
+            if (!text.empty())
+            {
+                sample += text;
+                sample += '\n';
+            }
+            pos = (pos + stride) % count;
+            visited++;
+        }
+
+        if (sample.empty())
+            return Language();
+
+        bool reliable;
+        auto lang = DoDetectFromText(sample.data(), sample.size(), probableLanguage, reliable);
+        if (reliable)
+            return lang;
+
+        if (visited == count || sampleSize >= DETECTION_SAMPLE_MAX_SIZE)
+            return Language();
+        sampleSize *= 4;
+    }
+}
+
+
+namespace
+{
+
+// How many examples to remember for each plural form
+const size_t MAX_STORED_EXAMPLES = 10;
+
+} // anonymous namespace
+
+struct PluralFormsExpr::Data
+{
+    explicit Data(const std::string& expr)
+    {
+        if (!expr.empty())
+            calc = PluralFormsCalculator::make(expr.c_str());
+        if (!calc)
+            return;
+
+        forms.resize(MAX_EXAMPLES_COUNT);
+        examples.resize(std::max(calc->nplurals(), 1));
+        for (int n = 0; n < MAX_EXAMPLES_COUNT; n++)
+        {
+            const int form = calc->evaluate(n);
+            forms[n] = form;
+            if (form < (int)examples.size() && examples[form].size() < MAX_STORED_EXAMPLES)
+                examples[form].push_back(n);
+        }
+    }
+
+    std::shared_ptr<PluralFormsCalculator> calc;
+    // forms of numbers 0..MAX_EXAMPLES_COUNT-1:
+    std::vector<int> forms;
+    // examples for each form:
+    std::vector<std::vector<int>> examples;
+};
+
+
+PluralFormsExpr::PluralFormsExpr() : m_nplurals(-1)
 {
 }
 
 PluralFormsExpr::PluralFormsExpr(const std::string& expr, int nplurals)
-    : m_expr(expr), m_nplurals(nplurals), m_calcCreated(false)
+    : m_expr(expr), m_nplurals(nplurals)
 {
 }
 
@@ -734,8 +1057,8 @@ int PluralFormsExpr::nplurals() const
 {
     if (m_nplurals != -1)
         return m_nplurals;
-    if (m_calc)
-        return m_calc->nplurals();
+    if (m_data && m_data->calc)
+        return m_data->calc->nplurals();
 
     const std::regex re("^nplurals=([0-9]+)");
     std::smatch m;
@@ -745,15 +1068,32 @@ int PluralFormsExpr::nplurals() const
         return -1;
 }
 
+const PluralFormsExpr::Data& PluralFormsExpr::data() const
+{
+    if (!m_data)
+    {
+        // Tables are shared by all instances with the same expression, because
+        // PluralFormsExpr objects are typically short-lived:
+        static std::mutex s_mutex;
+        static std::unordered_map<std::string, std::shared_ptr<const Data>> s_cache;
+
+        std::lock_guard<std::mutex> lock(s_mutex);
+        auto i = s_cache.find(m_expr);
+        if (i == s_cache.end())
+        {
+            // there's only a handful of expressions in practice, but don't grow unbounded:
+            if (s_cache.size() >= 256)
+                s_cache.clear();
+            i = s_cache.emplace(m_expr, std::make_shared<Data>(m_expr)).first;
+        }
+        m_data = i->second;
+    }
+    return *m_data;
+}
+
 std::shared_ptr<PluralFormsCalculator> PluralFormsExpr::calc() const
 {
-    auto self = const_cast<PluralFormsExpr*>(this);
-    if (m_calcCreated)
-        return m_calc;
-    if (!m_expr.empty())
-        self->m_calc = PluralFormsCalculator::make(m_expr.c_str());
-    self->m_calcCreated = true;
-    return m_calc;
+    return data().calc;
 }
 
 bool PluralFormsExpr::operator==(const PluralFormsExpr& other) const
@@ -769,28 +1109,34 @@ bool PluralFormsExpr::operator==(const PluralFormsExpr& other) const
         return true;
 
     // failing that, compare the expressions semantically:
-    auto calc1 = calc();
-    auto calc2 = other.calc();
+    auto& data1 = data();
+    auto& data2 = other.data();
 
-    if (!calc1 || !calc2)
+    if (!data1.calc || !data2.calc)
         return false; // at least one is invalid _and_ the strings are different due to code above
 
-    if (calc1->nplurals() != calc2->nplurals())
+    if (data1.calc->nplurals() != data2.calc->nplurals())
         return false;
 
-    for (int i = 0; i < MAX_EXAMPLES_COUNT; i++)
-    {
-        if (calc1->evaluate(i) != calc2->evaluate(i))
-            return false;
-    }
-    // both expressions are identical on all tested integers
-    return true;
+    // both expressions are identical if they are so on all tested integers
+    return data1.forms == data2.forms;
 }
 
 int PluralFormsExpr::evaluate_for_n(int n) const
 {
-    auto c = calc();
-    return c ? c->evaluate(n) : 0;
+    auto& d = data();
+    if (n >= 0 && n < (int)d.forms.size())
+        return d.forms[n];
+    return d.calc ? d.calc->evaluate(n) : 0;
+}
+
+const std::vector<int>& PluralFormsExpr::examples_for_form(int form) const
+{
+    static const std::vector<int> s_none;
+    auto& d = data();
+    if (form < 0 || form >= (int)d.examples.size())
+        return s_none;
+    return d.examples[form];
 }
 
 PluralFormsExpr PluralFormsExpr::English()
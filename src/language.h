@@ -27,6 +27,7 @@
 #define Poedit_language_h
 
 #include <wx/string.h>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -47,11 +48,11 @@ enum class TextDirection
 class Language
 {
 public:
-    Language() : m_direction(TextDirection::LTR) {}
+    Language() {}
 
-    bool IsValid() const { return !m_code.empty(); }
-    const std::string& Code() const { return m_code; }
-    std::wstring WCode() const { return std::wstring(m_code.begin(), m_code.end()); }
+    bool IsValid() const { return m_data != nullptr; }
+    const std::string& Code() const { return data().code; }
+    const std::wstring& WCode() const { return data().wcode; }
 
     /// Returns language part (cs)
     std::string Lang() const;
@@ -63,13 +64,13 @@ public:
     std::string Variant() const;
 
     /// Return language tag for the language, per BCP 47, e.g. en-US or sr-Latn
-    std::string LanguageTag() const { return m_tag; }
+    const std::string& LanguageTag() const { return data().tag; }
 
     /// Minimizes the subtags, e.g. returns cs for cs-CZ, but en-GB for en-GB
     Language MinimizeSubtags() const;
 
     /// Returns name of the locale suitable for ICU
-    std::string IcuLocaleName() const { return m_icuLocale; }
+    const std::string& IcuLocaleName() const { return data().icuLocale; }
 
     /// Returns name of this language suitable for display to the user in current UI language
     wxString DisplayName() const;
@@ -95,6 +96,16 @@ public:
      */
     static const std::vector<std::wstring>& AllFormattedNames();
 
+    /**
+        Sets directory to cache the list of language names in, so that it
+        doesn't have to be built from ICU data (slowly) every time.
+        Caching is disabled if not set.
+     */
+    static void SetDisplayNamesCacheDir(const wxString& dir);
+
+    /// Builds (or loads) the list of language names used by AllFormattedNames() and TryParse().
+    static void PreloadDisplayNames();
+
     /**
         Return appropriate plural form for this language.
 
@@ -107,10 +118,10 @@ public:
     int nplurals() const;
 
     /// Returns language's text writing direction
-    TextDirection Direction() const { return m_direction; }
+    TextDirection Direction() const { return data().direction; }
 
     /// Returns true if the language is written right-to-left.
-    bool IsRTL() const { return m_direction == TextDirection::RTL; }
+    bool IsRTL() const { return data().direction == TextDirection::RTL; }
 
     /**
         Tries to parse the string as language identification.
@@ -130,8 +141,7 @@ public:
         if you are not sure.
      */
     static Language TryParse(const std::wstring& s);
-    static Language TryParse(const std::string& s)
-        { return TryParse(std::wstring(s.begin(), s.end())); }
+    static Language TryParse(const std::string& s);
 
     /**
         Like TryParse(), but only accepts language codes if they are known
@@ -175,6 +185,22 @@ public:
         return TryDetectFromText(str.data(), str.length(), probableLanguage);
     }
 
+    /**
+        Try to detect the language from a potentially large collection of
+        texts, e.g. all strings of a catalog.
+
+        Only a sample of the texts, spread evenly over the collection, is
+        analyzed. The sample is enlarged in rounds up to a fixed size limit
+        until the detection is reliable.
+
+        @param count   Number of texts.
+        @param getText Returns i-th text (0 <= i < count) as UTF-8, or empty
+                       string if it should be skipped.
+     */
+    static Language TryDetectFromSample(size_t count,
+                                        const std::function<std::string(size_t)>& getText,
+                                        Language probableLanguage = Language());
+
     /// Returns object for English language
     static Language English() { return Language("en"); }
 
@@ -182,21 +208,33 @@ public:
         Checks if @a s has the form of language code.
      */
     static bool IsValidCode(const std::wstring& s);
+    static bool IsValidCode(const std::string& s);
 
-    bool operator==(const Language& other) const { return m_code == other.m_code; }
-    bool operator!=(const Language& other) const { return m_code != other.m_code; }
-    bool operator<(const Language& other) const { return m_code < other.m_code; }
+    bool operator==(const Language& other) const { return m_data == other.m_data || Code() == other.Code(); }
+    bool operator!=(const Language& other) const { return !(*this == other); }
+    bool operator<(const Language& other) const { return Code() < other.Code(); }
 
 private:
     Language(const std::string& code) { Init(code); }
     Language(const std::wstring& code) { Init(std::string(code.begin(), code.end())); }
     void Init(const std::string& code);
 
+    // Immutable language record; instances created from a code share
+    // a single interned record for it
+    struct Data
+    {
+        std::string code;
+        std::wstring wcode;
+        std::string tag;
+        std::string icuLocale;
+        TextDirection direction = TextDirection::LTR;
+    };
+
+    const Data& data() const { return m_data ? *m_data : InvalidData(); }
+    static const Data& InvalidData();
+
 private:
-    std::string m_code;
-    std::string m_tag;
-    std::string m_icuLocale;
-    TextDirection m_direction;
+    std::shared_ptr<const Data> m_data;
 };
 
 
@@ -220,15 +258,30 @@ public:
 
     int nplurals() const;
 
+    /**
+        Returns index of the plural form used for @a n.
+
+        Forms of numbers below MAX_EXAMPLES_COUNT are precomputed once per
+        expression and looked up in a table.
+     */
     int evaluate_for_n(int n) const;
 
+    /**
+        Returns a few smallest numbers (in increasing order) that use
+        given plural @a form, or empty list if the form isn't used by any
+        number below MAX_EXAMPLES_COUNT.
+     */
+    const std::vector<int>& examples_for_form(int form) const;
+
 private:
+    struct Data;
+
+    const Data& data() const;
     std::shared_ptr<PluralFormsCalculator> calc() const;
 
     std::string m_expr;
     int m_nplurals;
-    bool m_calcCreated;
-    std::shared_ptr<PluralFormsCalculator> m_calc;
+    mutable std::shared_ptr<const Data> m_data;
 };
 
 #endif // Poedit_language_h
@@ -27,10 +27,16 @@
 
 #include "str_helpers.h"
 #include "hidpi.h"
+#include "unicode_helpers.h"
 
 #include <wx/config.h>
 #include <wx/sizer.h>
 #include <wx/stattext.h>
+#include <wx/textcompleter.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
 
 #ifdef __WXOSX__
 
@@ -120,6 +126,109 @@ wxString LanguageCtrl::GetString(unsigned int n) const
 #endif // __WXOSX__
 
 
+#ifndef __WXOSX__
+
+namespace
+{
+
+/**
+    Index of language names for fast autocompletion.
+
+    Contains case-folded full names, each of their words and language codes,
+    sorted, so that all entries starting with typed text can be found with
+    binary search instead of comparing it with every name.
+ */
+class LanguageNamesIndex
+{
+public:
+    LanguageNamesIndex(const wxArrayString& names) : m_names(names)
+    {
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            const auto folded = unicode::fold_case_to_type<std::u16string>(names[i]);
+            // the full name and the start of every word in it, e.g. "(Brazil)":
+            for (size_t pos = 0; pos < folded.size(); pos++)
+            {
+                if (pos == 0 || IsWordStart(folded, pos))
+                    m_entries.push_back({folded.substr(pos), (unsigned)i});
+            }
+
+            auto lang = Language::TryParse(names[i].ToStdWstring());
+            if (lang.IsValid())
+                m_entries.push_back({unicode::fold_case_to_type<std::u16string>(str::to_wstring(lang.Code())), (unsigned)i});
+        }
+        std::sort(m_entries.begin(), m_entries.end());
+        m_seen.resize(names.size());
+    }
+
+    /// Returns names whose full name, some word or code starts with @a prefix, in sorted order.
+    void FindCompletions(const wxString& prefix, wxArrayString& out)
+    {
+        const auto folded = unicode::fold_case_to_type<std::u16string>(prefix);
+
+        m_found.clear();
+        auto i = std::lower_bound(m_entries.begin(), m_entries.end(), Entry{folded, 0});
+        for (; i != m_entries.end() && i->key.compare(0, folded.size(), folded) == 0; ++i)
+        {
+            if (m_seen[i->name])
+                continue;
+            m_seen[i->name] = true;
+            m_found.push_back(i->name);
+        }
+
+        // names are sorted, so sorting indexes gives them in alphabetical order:
+        std::sort(m_found.begin(), m_found.end());
+        out.reserve(m_found.size());
+        for (auto n: m_found)
+        {
+            out.push_back(m_names[n]);
+            m_seen[n] = false;
+        }
+    }
+
+private:
+    struct Entry
+    {
+        std::u16string key;
+        unsigned name;
+
+        bool operator<(const Entry& other) const { return key < other.key; }
+    };
+
+    static bool IsWordStart(const std::u16string& s, size_t pos)
+    {
+        const auto prev = s[pos - 1];
+        return (prev == ' ' || prev == '(' || prev == '-') && s[pos] != ' ' && s[pos] != '(';
+    }
+
+    const wxArrayString& m_names;
+    std::vector<Entry> m_entries;
+    // reused buffers for FindCompletions(), which is only called on the main thread:
+    std::vector<bool> m_seen;
+    std::vector<unsigned> m_found;
+};
+
+
+class LanguageCompleter : public wxTextCompleterSimple
+{
+public:
+    LanguageCompleter(LanguageNamesIndex& index) : m_index(index) {}
+
+    void GetCompletions(const wxString& prefix, wxArrayString& res) override
+    {
+        if (!prefix.empty())
+            m_index.FindCompletions(prefix, res);
+    }
+
+private:
+    LanguageNamesIndex& m_index;
+};
+
+} // anonymous namespace
+
+#endif // !__WXOSX__
+
+
 IMPLEMENT_DYNAMIC_CLASS(LanguageCtrl, wxComboBox)
 
 LanguageCtrl::LanguageCtrl() : m_inited(false)
@@ -158,8 +267,9 @@ void LanguageCtrl::Init(Language lang)
     cb.usesDataSource = YES;
     cb.dataSource = m_impl->dataSource;
 #else
+    static LanguageNamesIndex index(choices);
     Set(choices);
-    AutoComplete(choices);
+    AutoComplete(new LanguageCompleter(index));
 #endif
 
     m_inited = true;
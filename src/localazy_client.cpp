@@ -46,6 +46,14 @@
 
 using namespace std::chrono_literals;
 
+namespace
+{
+
+// Limit on simultaneous API requests, shared by all downloads and listings:
+const int MAX_CONCURRENT_REQUESTS = 8;
+
+} // anonymous namespace
+
 
 // ----------------------------------------------------------------
 // Implementation
@@ -69,7 +77,10 @@ std::string LocalazyClient::AttributeLink(std::string page)
 class LocalazyClient::localazy_http_client : public http_client
 {
 public:
-    localazy_http_client() : http_client("https://api.localazy.com") {}
+    localazy_http_client() : http_client("https://api.localazy.com")
+    {
+        set_max_concurrent_requests(MAX_CONCURRENT_REQUESTS);
+    }
 
 protected:
     std::string parse_json_error(const json& response) const override
@@ -194,7 +205,10 @@ LocalazyClient::LocalazyClient() : m_api(new localazy_http_client())
     InitMetadataAndTokens();
 }
 
-LocalazyClient::~LocalazyClient() {}
+LocalazyClient::~LocalazyClient()
+{
+    WaitForCredentials();
+}
 
 
 dispatch::future<void> LocalazyClient::Authenticate()
@@ -273,6 +287,7 @@ dispatch::future<LocalazyClient::ProjectInfo> LocalazyClient::ExchangeTemporaryT
                    project.at("image").get<std::string>()
                };
 
+               WaitForCredentials();
                std::lock_guard<std::mutex> guard(m_mutex);
                m_metadata->add(projectId, project, user);
                m_tokens->add(projectId, token);
@@ -285,10 +300,18 @@ dispatch::future<LocalazyClient::ProjectInfo> LocalazyClient::ExchangeTemporaryT
 
 void LocalazyClient::InitMetadataAndTokens()
 {
-    std::lock_guard<std::mutex> guard(m_mutex);
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_metadata.reset(new metadata(Config::LocalazyMetadata()));
+        m_tokens.reset(new project_tokens(""));
+    }
+
+    LoadCredentialsInBackground([this]{ LoadTokens(); });
+}
 
-    m_metadata.reset(new metadata(Config::LocalazyMetadata()));
 
+void LocalazyClient::LoadTokens()
+{
     // Our tokens stored in keychain have the form of <version>:<token>, so not
     // only do we have to check for token's existence but also that its version is current:
     std::string encoded_tokens;
@@ -302,6 +325,7 @@ void LocalazyClient::InitMetadataAndTokens()
         encoded_tokens.clear();
     }
 
+    std::lock_guard<std::mutex> guard(m_mutex);
     m_tokens.reset(new project_tokens(encoded_tokens));
 }
 
@@ -320,6 +344,7 @@ void LocalazyClient::SaveMetadataAndTokens(std::lock_guard<std::mutex>& /*acquir
 
 std::string LocalazyClient::GetAuthorization(const std::string& project_id) const
 {
+    WaitForCredentials();
     std::lock_guard<std::mutex> guard(m_mutex);
     return "Bearer " + m_tokens->get(project_id);
 }
@@ -364,6 +389,59 @@ dispatch::future<std::vector<CloudAccountClient::ProjectInfo>> LocalazyClient::G
 dispatch::future<CloudAccountClient::ProjectDetails> LocalazyClient::GetProjectDetails(const ProjectInfo& project)
 {
     auto project_id = std::get<std::string>(project.internalID);
+
+    // If the project's details are already being fetched, share the result
+    // instead of issuing another identical request:
+    auto waiter = std::make_shared<dispatch::promise<ProjectDetails>>();
+    dispatch::future<ProjectDetails> result(waiter->get_future());
+    {
+        std::lock_guard<std::mutex> guard(m_detailsMutex);
+        auto& waiters = m_detailsWaiters[project_id];
+        waiters.push_back(waiter);
+        if (waiters.size() > 1)
+            return result;
+    }
+
+    auto finished = [this, project_id](std::function<void(dispatch::promise<ProjectDetails>&)> fulfill)
+    {
+        std::vector<std::shared_ptr<dispatch::promise<ProjectDetails>>> waiters;
+        {
+            std::lock_guard<std::mutex> guard(m_detailsMutex);
+            waiters.swap(m_detailsWaiters[project_id]);
+            m_detailsWaiters.erase(project_id);
+        }
+        for (auto& w: waiters)
+            fulfill(*w);
+    };
+
+    auto request = [&]
+    {
+        try
+        {
+            return FetchProjectDetails(project_id);
+        }
+        catch (...)
+        {
+            return dispatch::make_exceptional_future_from_current<ProjectDetails>();
+        }
+    }();
+
+    request
+        .then([finished](ProjectDetails details)
+        {
+            finished([&](dispatch::promise<ProjectDetails>& p){ p.set_value(details); });
+        })
+        .catch_all([finished](dispatch::exception_ptr e)
+        {
+            finished([&](dispatch::promise<ProjectDetails>& p){ p.set_exception(e); });
+        });
+
+    return result;
+}
+
+
+dispatch::future<CloudAccountClient::ProjectDetails> LocalazyClient::FetchProjectDetails(const std::string& project_id)
+{
     http_client::headers headers {{"Authorization", GetAuthorization(project_id)}};
 
     return m_api->get("/projects?languages=true", headers)
@@ -399,6 +477,13 @@ dispatch::future<CloudAccountClient::ProjectDetails> LocalazyClient::GetProjectD
 }
 
 
+size_t LocalazyClient::GetMaxParallelDownloads() const
+{
+    // exports are cheap for Localazy, so download as many as the client allows:
+    return MAX_CONCURRENT_REQUESTS;
+}
+
+
 std::wstring LocalazyClient::CreateLocalFilename(const ProjectInfo& project, const ProjectFile& /*file*/, const Language& lang) const
 {
     auto project_name = project.name;
@@ -426,14 +511,33 @@ dispatch::future<void> LocalazyClient::DownloadFile(const std::wstring& output_f
 {
     auto meta = std::dynamic_pointer_cast<LocalazySyncMetadata>(meta_);
 
-    http_client::headers headers {{"Authorization", GetAuthorization(meta->projectId)}};
+    const std::string url = "/projects/" + meta->projectId + "/exchange/export/" + meta->lang;
+    const std::string cacheKey = std::string(SERVICE_NAME) + ':' + url;
+    const std::string authorization = GetAuthorization(meta->projectId);
 
-    return m_api->download("/projects/" + meta->projectId + "/exchange/export/" + meta->lang, headers)
-            .then([=](downloaded_file file)
+    return dispatch::async([=]
+    {
+        auto fetch = [&](const std::string& etag)
+        {
+            http_client::headers headers {{"Authorization", authorization}};
+            if (!etag.empty())
+                headers.emplace_back("If-None-Match", etag);
+            try
             {
-                wxString outfile(output_file);
-                file.move_to(outfile);
-            });
+                auto etag = m_api->download(url, wxString(output_file), headers).get();
+                DownloadCache::Store(cacheKey, etag, output_file);
+                return true;
+            }
+            catch (http_not_modified&)
+            {
+                wxLogTrace("poedit.localazy", "File not modified, using cached copy");
+                return DownloadCache::Retrieve(cacheKey, output_file);
+            }
+        };
+
+        if (!fetch(DownloadCache::GetETag(cacheKey)))
+            fetch(std::string());  // cached copy went missing in the meantime
+    });
 }
 
 
@@ -489,6 +593,7 @@ dispatch::future<void> LocalazyClient::UploadFile(const std::string& file_buffer
 
 bool LocalazyClient::IsSignedIn() const
 {
+    WaitForCredentials();
     std::lock_guard<std::mutex> guard(m_mutex);
     return m_tokens->is_valid() && m_metadata->is_valid();
 }
@@ -496,6 +601,9 @@ bool LocalazyClient::IsSignedIn() const
 
 void LocalazyClient::SignOut()
 {
+    WaitForCredentials();
+    ClearMetadataCache();
+
     std::lock_guard<std::mutex> guard(m_mutex);
 
     m_metadata->clear();
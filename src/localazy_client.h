@@ -31,6 +31,7 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include "cloud_accounts.h"
 
@@ -98,6 +99,7 @@ public:
     dispatch::future<void> DownloadFile(const std::wstring& output_file, std::shared_ptr<FileSyncMetadata> meta) override;
 
     dispatch::future<void> UploadFile(const std::string& file_buffer, std::shared_ptr<FileSyncMetadata> meta) override;
+    using CloudAccountClient::UploadFile;
 
 private:
     /**
@@ -110,6 +112,11 @@ private:
     /// Get authorization header for given project
     std::string GetAuthorization(const std::string& project_id) const;
 
+    /// Performs the request for GetProjectDetails()
+    dispatch::future<ProjectDetails> FetchProjectDetails(const std::string& project_id);
+
+    size_t GetMaxParallelDownloads() const override;
+
     struct LocalazySyncMetadata : public FileSyncMetadata
     {
         std::string lang;
@@ -125,6 +132,8 @@ private:
     ~LocalazyClient();
 
     void InitMetadataAndTokens();
+    // reads tokens from the keychain; runs in the background
+    void LoadTokens();
     // can only be called if m_mutex is held:
     void SaveMetadataAndTokens(std::lock_guard<std::mutex>& acquiredLock);
 
@@ -132,6 +141,10 @@ private:
     std::unique_ptr<metadata> m_metadata;
     mutable std::mutex m_mutex; // guards m_tokens and m_metadata
 
+    // callers waiting for GetProjectDetails() requests in progress, per project:
+    std::map<std::string, std::vector<std::shared_ptr<dispatch::promise<ProjectDetails>>>> m_detailsWaiters;
+    std::mutex m_detailsMutex;
+
     std::unique_ptr<localazy_http_client> m_api;
 
     std::shared_ptr<dispatch::promise<void>> m_authCallback;
@@ -48,14 +48,27 @@
 #include <wx/iconbndl.h>
 #include <wx/windowptr.h>
 #include <wx/sizer.h>
+#include <wx/srchctrl.h>
+#include <wx/ffile.h>
+#include <wx/file.h>
+#include <wx/filename.h>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "catalog.h"
+#include "catalog_po.h"
 #include "cat_update.h"
+#include "concurrency.h"
 #include "edapp.h"
 #include "edframe.h"
+#include "errors.h"
 #include "hidpi.h"
 #include "menus.h"
+#include "pretranslate.h"
 #include "progressinfo.h"
+#include "project_search.h"
 #include "utility.h"
 
 
@@ -173,9 +186,15 @@ ManagerFrame::ManagerFrame() :
     m_projectName->SetFont(m_projectName->GetFont().Larger().Bold());
     topbar->Add(m_projectName, wxSizerFlags().Center().Border(wxRIGHT, PX(10)));
     topbar->AddStretchSpacer();
+    m_searchField = new wxSearchCtrl(m_details, wxID_ANY, "", wxDefaultPosition, wxSize(PX(200), -1), wxTE_PROCESS_ENTER);
+    m_searchField->SetDescriptiveText(_("Search in all catalogs"));
+    topbar->Add(m_searchField, wxSizerFlags().Center().Border(wxLEFT, PX(5)));
     auto btn_update = new PseudoToolbarButton(m_details, "poedit-update", _("Update all"));
     btn_update->SetToolTip(_("Update all catalogs in the project"));
     topbar->Add(btn_update, wxSizerFlags().Border(wxLEFT, PX(5)));
+    auto btn_pretranslate = new wxButton(m_details, wxID_ANY, _(L"Pre-translate all…"), wxDefaultPosition, wxDefaultSize, wxBU_EXACTFIT);
+    btn_pretranslate->SetToolTip(_("Pre-translate all catalogs in the project"));
+    topbar->Add(btn_pretranslate, wxSizerFlags().Center().Border(wxLEFT, PX(5)));
 
     m_listCat = new wxListCtrl(m_details, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxBORDER_NONE | wxLC_REPORT | wxLC_SINGLE_SEL);
 #ifdef __WXOSX__
@@ -201,11 +220,13 @@ ManagerFrame::ManagerFrame() :
 #ifdef __WXMSW__
         SetBackgroundColour(col);
         btn_update->SetBackgroundColour(col);
+        btn_pretranslate->SetBackgroundColour(col);
 #endif
     });
 
     m_details->Hide();
     m_curPrj = -1;
+    m_statsGeneration = 0;
 
     int last = (int)wxConfig::Get()->Read("manager_last_selected", (long)0);
 
@@ -223,6 +244,9 @@ ManagerFrame::ManagerFrame() :
     btn_delete->Bind(wxEVT_UPDATE_UI, [=](wxUpdateUIEvent& e) { e.Enable(m_listPrj->GetSelection() != wxNOT_FOUND); });
     btn_edit->Bind(wxEVT_BUTTON, &ManagerFrame::OnEditProject, this);
     btn_update->Bind(wxEVT_BUTTON, &ManagerFrame::OnUpdateProject, this);
+    btn_pretranslate->Bind(wxEVT_BUTTON, &ManagerFrame::OnPreTranslateProject, this);
+    m_searchField->Bind(wxEVT_TEXT_ENTER, &ManagerFrame::OnSearchProject, this);
+    m_searchField->Bind(wxEVT_SEARCHCTRL_SEARCH_BTN, &ManagerFrame::OnSearchProject, this);
 }
 
 
@@ -272,81 +296,194 @@ void ManagerFrame::UpdateListPrj(int select)
 }
 
 
-static void AddCatalogToList(wxListCtrl *list, int i, int id, const wxString& file)
+namespace
 {
-    wxConfigBase *cfg = wxConfig::Get();
-    int all = 0, fuzzy = 0, untranslated = 0, badtokens = 0;
+
+// Statistics of a single catalog file, as shown in the list
+struct CatalogFileStats
+{
+    time_t mtime = 0;
+    wxULongLong size;
+    int all = 0, fuzzy = 0, badtokens = 0, untranslated = 0;
     wxString lastmodified;
-    time_t modtime;
-    wxString key;
-    wxString file2(file);
-    file2.Replace("/", "_");
-    file2.Replace("\\", "_");
-    // FIXME: move cache to cache file and out of *config* file!
-    key.Printf("Manager/project_%i/FilesCache/%s/", id, file2.c_str());
+    bool valid = false;  // false if the file couldn't be loaded
+};
+
+/**
+    Persistent cache of catalogs' statistics, so that the list of files
+    in a project doesn't require parsing them every time. Entries are
+    keyed by path and validated against the file's modification time and
+    size. Must only be used from the main thread.
+ */
+class StatsCache
+{
+public:
+    static StatsCache& Get()
+    {
+        static StatsCache s_instance;
+        return s_instance;
+    }
+
+    bool Lookup(const wxString& file, time_t mtime, wxULongLong size, CatalogFileStats& stats) const
+    {
+        auto i = m_entries.find(file.ToStdWstring());
+        if (i == m_entries.end() || i->second.mtime != mtime || i->second.size != size)
+            return false;
+        stats = i->second;
+        return true;
+    }
+
+    void Store(const wxString& file, const CatalogFileStats& stats)
+    {
+        if (!stats.valid || file.find_first_of("\t\n") != wxString::npos)
+            return;
+        m_entries[file.ToStdWstring()] = stats;
+        m_dirty = true;
+    }
+
+    void Save()
+    {
+        if (!m_dirty)
+            return;
+
+        wxFileName::Mkdir(wxFileName(m_filename).GetPath(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+        wxLogNull null;
+        wxTempFile f(m_filename);
+        if (!f.IsOpened())
+            return;
 
-    modtime = cfg->Read(key + "timestamp", (long)0);
+        wxString out(CACHE_MAGIC);
+        out += '\n';
+        for (auto& e: m_entries)
+        {
+            auto& s = e.second;
+            out += wxString::Format("%s\t%lld\t%s\t%d\t%d\t%d\t%d\t%s\n",
+                                    wxString(e.first), (long long)s.mtime, s.size.ToString(),
+                                    s.all, s.fuzzy, s.badtokens, s.untranslated, s.lastmodified);
+        }
+        if (f.Write(out, wxConvUTF8) && f.Commit())
+            m_dirty = false;
+    }
 
-    if (modtime == wxFileModificationTime(file))
+private:
+    StatsCache() : m_dirty(false)
     {
-        all = (int)cfg->Read(key + "all", (long)0);
-        fuzzy = (int)cfg->Read(key + "fuzzy", (long)0);
-        badtokens = (int)cfg->Read(key + "badtokens", (long)0);
-        untranslated = (int)cfg->Read(key + "untranslated", (long)0);
-        lastmodified = cfg->Read(key + "lastmodified", "?");
+        m_filename = PoeditApp::GetCacheDir("Manager") + wxFILE_SEP_PATH + "stats.txt";
+        Load();
     }
-    else
+
+    void Load()
     {
-        // suppress error messages, we don't care about specifics of the error
-        // FIXME: *do* indicate error somehow
-        wxLogNull nullLog;
+        wxLogNull null;
+        wxFFile f;
+        wxString data;
+        if (!wxFileName::FileExists(m_filename) || !f.Open(m_filename) || !f.ReadAll(&data, wxConvUTF8))
+            return;
+
+        wxStringTokenizer lines(data, "\n", wxTOKEN_STRTOK);
+        if (!lines.HasMoreTokens() || lines.GetNextToken() != CACHE_MAGIC)
+            return;
 
-        // FIXME: don't re-load the catalog if it's already loaded in the
-        //        editor, reuse loaded instance
-        try
+        while (lines.HasMoreTokens())
         {
-            auto cat = Catalog::Create(file);
-            if (cat)
+            wxStringTokenizer fields(lines.GetNextToken(), "\t", wxTOKEN_RET_EMPTY_ALL);
+            wxString file = fields.GetNextToken();
+            CatalogFileStats s;
+            long long mtime;
+            wxULongLong_t size;
+            if (fields.CountTokens() != 7 ||
+                !fields.GetNextToken().ToLongLong(&mtime) ||
+                !fields.GetNextToken().ToULongLong(&size) ||
+                !ReadInt(fields, s.all) || !ReadInt(fields, s.fuzzy) ||
+                !ReadInt(fields, s.badtokens) || !ReadInt(fields, s.untranslated))
             {
-                cat->GetStatistics(&all, &fuzzy, &badtokens, &untranslated, NULL);
-                modtime = wxFileModificationTime(file);
-                lastmodified = cat->Header().RevisionDate;
-                cfg->Write(key + "timestamp", (long)modtime);
-                cfg->Write(key + "all", (long)all);
-                cfg->Write(key + "fuzzy", (long)fuzzy);
-                cfg->Write(key + "badtokens", (long)badtokens);
-                cfg->Write(key + "untranslated", (long)untranslated);
-                cfg->Write(key + "lastmodified", lastmodified);
+                continue;
             }
+            s.mtime = (time_t)mtime;
+            s.size = size;
+            s.lastmodified = fields.GetNextToken();
+            s.valid = true;
+            m_entries[file.ToStdWstring()] = s;
         }
-        catch (...)
+    }
+
+    static bool ReadInt(wxStringTokenizer& fields, int& value)
+    {
+        long v;
+        if (!fields.GetNextToken().ToLong(&v))
+            return false;
+        value = (int)v;
+        return true;
+    }
+
+    // Increment when changing the format or the meaning of the values:
+    static constexpr const char *CACHE_MAGIC = "PoeditManagerStats 1";
+
+    wxString m_filename;
+    std::unordered_map<std::wstring, CatalogFileStats> m_entries;
+    bool m_dirty;
+};
+
+// Computes statistics of the file, may be called from any thread
+CatalogFileStats ComputeCatalogStats(const wxString& file, time_t mtime, wxULongLong size)
+{
+    CatalogFileStats stats;
+    stats.mtime = mtime;
+    stats.size = size;
+
+    // fast path that doesn't create the items:
+    POCatalog::FileStatistics scanned;
+    if (POCatalog::ScanStatistics(file, scanned))
+    {
+        stats.all = scanned.all;
+        stats.fuzzy = scanned.fuzzy;
+        stats.untranslated = scanned.untranslated;
+        stats.lastmodified = scanned.revisionDate;
+        stats.valid = true;
+        return stats;
+    }
+
+    // suppress error messages, we don't care about specifics of the error
+    wxLogNull nullLog;
+    try
+    {
+        auto cat = Catalog::Create(file);
+        if (cat)
         {
-            // FIXME: Nicer way of showing errors, this is hacky
-            lastmodified = L"⚠️ " + DescribeCurrentException();
-            badtokens = 1;
+            cat->GetStatistics(&stats.all, &stats.fuzzy, &stats.badtokens, &stats.untranslated, NULL);
+            stats.lastmodified = cat->Header().RevisionDate;
+            stats.valid = true;
         }
     }
+    catch (...)
+    {
+        // FIXME: Nicer way of showing errors, this is hacky
+        stats.lastmodified = L"⚠️ " + DescribeCurrentException();
+        stats.badtokens = 1;
+    }
+    return stats;
+}
 
+void SetCatalogStats(wxListCtrl *list, int i, const CatalogFileStats& stats)
+{
+    const int unfinished = stats.fuzzy + stats.untranslated + stats.badtokens;
     int icon;
-    if (fuzzy+untranslated+badtokens == 0) icon = 2;
-    else if ((double)all / (fuzzy+untranslated+badtokens) <= 3) icon = 0;
+    if (unfinished == 0) icon = 2;
+    else if ((double)stats.all / unfinished <= 3) icon = 0;
     else icon = 1;
 
-    wxString tmp;
-    // FIXME: don't put full filename there, remove common prefix (of all
-    //        directories in project's settings)
-    list->InsertItem(i, file, icon);
-    tmp.Printf("%i", all);
-    list->SetItem(i, 1, tmp);
-    tmp.Printf("%i", untranslated);
-    list->SetItem(i, 2, tmp);
-    tmp.Printf("%i", fuzzy);
-    list->SetItem(i, 3, tmp);
-    tmp.Printf("%i", badtokens);
-    list->SetItem(i, 4, tmp);
-    list->SetItem(i, 5, lastmodified);
+    list->SetItemImage(i, icon);
+    list->SetItem(i, 1, wxString::Format("%i", stats.all));
+    list->SetItem(i, 2, wxString::Format("%i", stats.untranslated));
+    list->SetItem(i, 3, wxString::Format("%i", stats.fuzzy));
+    list->SetItem(i, 4, wxString::Format("%i", stats.badtokens));
+    list->SetItem(i, 5, stats.lastmodified);
 }
 
+int gs_statsGeneration = 0;
+
+} // anonymous namespace
+
 void ManagerFrame::UpdateListCat(int id)
 {
     wxBusyCursor bcur;
@@ -361,6 +498,10 @@ void ManagerFrame::UpdateListCat(int id)
     wxString key;
     key.Printf("Manager/project_%i/", id);
 
+    // statistics used to be cached in the config file, see StatsCache:
+    if (cfg->HasGroup(key + "FilesCache"))
+        cfg->DeleteGroup(key + "FilesCache");
+
     wxString dirs = cfg->Read(key + "Dirs", wxEmptyString);
     wxStringTokenizer tkn(dirs, wxPATH_SEP);
 
@@ -381,10 +522,60 @@ void ManagerFrame::UpdateListCat(int id)
     m_listCat->InsertColumn(4, _("Errors"));
     m_listCat->InsertColumn(5, _("Last modified"));
 
-    // FIXME: this is time-consuming, it should be done in parallel on
-    //        multi-core/SMP systems
+    // statistics of changed (or new) files are computed in the background,
+    // the list is shown immediately with what is already known:
+    auto& cache = StatsCache::Get();
+    std::vector<std::pair<int, CatalogFileStats>> pending;
     for (int i = 0; i < (int)m_catalogs.GetCount(); i++)
-        AddCatalogToList(m_listCat, i, id, m_catalogs[i]);
+    {
+        const wxString& file = m_catalogs[i];
+        // FIXME: don't put full filename there, remove common prefix (of all
+        //        directories in project's settings)
+        m_listCat->InsertItem(i, file, -1);
+
+        CatalogFileStats stats;
+        wxFileName fn(file);
+        const time_t mtime = wxFileModificationTime(file);
+        const wxULongLong size = fn.GetSize();
+        if (cache.Lookup(file, mtime, size, stats))
+        {
+            SetCatalogStats(m_listCat, i, stats);
+        }
+        else
+        {
+            for (int col = 1; col <= 5; col++)
+                m_listCat->SetItem(i, col, L"…");
+            stats.mtime = mtime;
+            stats.size = size;
+            pending.emplace_back(i, stats);
+        }
+    }
+
+    m_statsGeneration = ++gs_statsGeneration;
+    if (!pending.empty())
+    {
+        auto remaining = std::make_shared<int>((int)pending.size());
+        for (auto& p: pending)
+        {
+            const int index = p.first;
+            const int generation = m_statsGeneration;
+            const wxString file = m_catalogs[index];
+            const time_t mtime = p.second.mtime;
+            const wxULongLong size = p.second.size;
+            dispatch::async([=]{ return ComputeCatalogStats(file, mtime, size); })
+            .then_on_main([=](CatalogFileStats stats)
+            {
+                StatsCache::Get().Store(file, stats);
+                if (--*remaining == 0)
+                    StatsCache::Get().Save();
+
+                // the list may have been changed or closed in the meantime:
+                auto self = ManagerFrame::Get();
+                if (self && self->m_statsGeneration == generation)
+                    SetCatalogStats(self->m_listCat, index, stats);
+            });
+        }
+    }
 
     m_listCat->SetColumnWidth(0, wxLIST_AUTOSIZE);
     m_listCat->SetColumnWidth(1, wxLIST_AUTOSIZE_USEHEADER);
@@ -575,45 +766,78 @@ void ManagerFrame::OnUpdateProject(wxCommandEvent&)
          if (retval != wxID_YES)
             return;
 
-        ProgressWindow::RunCancellableTaskThenDo(this, ("Updating project catalogs"),
-        [=](dispatch::cancellation_token_ptr cancellationToken)
+        // files open in the editor must be updated there, to preserve unsaved edits;
+        // the rest is updated at once, sharing the extraction:
+        std::vector<PoeditFrame*> open;
+        std::vector<wxString> files;
+        for (size_t i = 0; i < m_catalogs.GetCount(); i++)
         {
-            Progress progress((int)m_catalogs.GetCount());
+            wxString f = m_catalogs[i];
+            PoeditFrame *fr = PoeditFrame::Find(f);
+            if (fr)
+                open.push_back(fr);
+            else
+                files.push_back(f);
+        }
 
-            for (size_t i = 0; i < m_catalogs.GetCount(); i++)
-            {
-                if (cancellationToken->is_cancelled())
-                    return;
+        if (PerformProjectUpdateFromSourcesWithUI(this, files))
+        {
+            for (auto fr: open)
+                fr->UpdateCatalog();
+        }
 
-                wxString f = m_catalogs[i];
-                PoeditFrame *fr = PoeditFrame::Find(f);
-                if (fr)
-                {
-                    fr->UpdateCatalog();
-                }
-                else
-                {
-                    Progress subtask(1, progress, 1);
-
-                    auto cat = POCatalog::Create(f);
-                    UpdateResultReason reason;
-                    if (PerformUpdateFromSources(cat, reason))
-                    {
-                        Catalog::ValidationResults validation_results;
-                        Catalog::CompilationStatus mo_status;
-                        cat->Save(f, false, validation_results, mo_status);
-                    }
-                }
-             }
-        },
-        [=](bool /*finished*/)
+        UpdateListCat();
+    });
+}
+
+
+void ManagerFrame::OnPreTranslateProject(wxCommandEvent&)
+{
+    int sel = m_listPrj->GetSelection();
+    if (sel == -1) return;
+
+    // files open in the editor may have unsaved edits and are pre-translated
+    // there; the rest is pre-translated at once, sharing the TM lookups:
+    std::vector<wxString> files;
+    int openCount = 0;
+    for (size_t i = 0; i < m_catalogs.GetCount(); i++)
+    {
+        if (PoeditFrame::Find(m_catalogs[i]))
+            openCount++;
+        else
+            files.push_back(m_catalogs[i]);
+    }
+
+    if (openCount)
+    {
+        wxWindowPtr<wxMessageDialog> dlg(new wxMessageDialog(this,
+                                         _("Some of the catalogs are open in the editor."),
+                                         MSW_OR_OTHER(_("Confirmation"), ""), wxOK | wxCANCEL | wxICON_QUESTION));
+        dlg->SetExtendedMessage(_(L"Catalogs that are open won’t be pre-translated, so that unsaved changes aren’t lost. Use pre-translation in their windows instead."));
+        dlg->SetOKLabel(_("Continue"));
+        dlg->ShowWindowModalThenDo([this,dlg,files](int retval)
         {
-            UpdateListCat();
+            if (retval == wxID_OK && !files.empty())
+                PreTranslateProjectWithUI(this, files, [=]{ UpdateListCat(); });
         });
-    });
+        return;
+    }
+
+    PreTranslateProjectWithUI(this, files, [=]{ UpdateListCat(); });
 }
 
 
+void ManagerFrame::OnSearchProject(wxCommandEvent&)
+{
+    wxString key;
+    key.Printf("Manager/project_%i/Dirs", m_curPrj);
+    const wxString dirs = wxConfig::Get()->Read(key, wxEmptyString);
+
+    std::vector<wxString> files(m_catalogs.begin(), m_catalogs.end());
+    ProjectSearchFrame::ShowFor(this, m_projectName->GetLabel(), dirs, files, m_searchField->GetValue());
+    m_searchField->Clear();
+}
+
 void ManagerFrame::OnOpenCatalog(wxListEvent& event)
 {
     PoeditFrame *f = PoeditFrame::Create(m_catalogs[event.GetIndex()]);
@@ -32,6 +32,7 @@
 #include <wx/string.h>
 
 class WXDLLIMPEXP_FWD_CORE wxListBox;
+class WXDLLIMPEXP_FWD_CORE wxSearchCtrl;
 
 class Catalog;
 
@@ -84,6 +85,8 @@ class ManagerFrame : public ManagerFrameBase
         void OnEditProject(wxCommandEvent& event);
         void OnDeleteProject(wxCommandEvent& event);
         void OnUpdateProject(wxCommandEvent& event);
+        void OnPreTranslateProject(wxCommandEvent& event);
+        void OnSearchProject(wxCommandEvent& event);
         void OnSelectProject(wxCommandEvent& event);
         void OnOpenCatalog(wxListEvent& event);
 
@@ -91,8 +94,10 @@ class ManagerFrame : public ManagerFrameBase
         wxListCtrl *m_listCat;
         wxListBox  *m_listPrj;
         wxStaticText *m_projectName;
+        wxSearchCtrl *m_searchField;
         wxArrayString m_catalogs;
         int m_curPrj;
+        int m_statsGeneration;
 
         static ManagerFrame *ms_instance;
 };
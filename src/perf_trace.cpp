@@ -0,0 +1,378 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2023 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "perf_trace.h"
+
+#include <wx/ffile.h>
+#include <wx/log.h>
+#include <wx/thread.h>
+
+#ifdef __WXMSW__
+    #include <windows.h>
+    #include <psapi.h>
+    #pragma comment(lib, "psapi.lib")
+#else
+    #include <sys/resource.h>
+#endif
+
+#include <atomic>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace perf
+{
+
+namespace
+{
+
+const char *TRACE_MASK = "poedit.perf";
+const char *LOCKS_TRACE_MASK = "poedit.locks";
+
+struct Event
+{
+    std::string name;
+    char phase; // 'X' for durations, 'C' for counters
+    long long start, duration; // in microseconds since gs_epoch
+    long long value; // items count for durations (or -1), value for counters
+    unsigned thread;
+};
+
+const Clock::time_point gs_epoch = Clock::now();
+
+std::atomic<bool> gs_recording(false);
+std::mutex gs_mutex;
+std::vector<Event> gs_events;
+wxString gs_filename;
+
+long long ToMicroseconds(Clock::duration d)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+// Small, stable thread identifiers are easier to read in trace viewers
+// than native IDs; the main thread is always 0.
+unsigned CurrentThreadId()
+{
+    static std::atomic<unsigned> s_lastId(0);
+    thread_local unsigned id = wxThread::IsMain() ? 0 : ++s_lastId;
+    return id;
+}
+
+void AppendJSONString(std::string& out, const std::string& s)
+{
+    out += '"';
+    for (auto c: s)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        else if ((unsigned char)c < 0x20)
+            c = ' ';
+        out += c;
+    }
+    out += '"';
+}
+
+void AddEvent(Event&& e)
+{
+    std::lock_guard<std::mutex> lock(gs_mutex);
+    if (gs_recording)
+        gs_events.push_back(std::move(e));
+}
+
+} // anonymous namespace
+
+
+void StartRecording(const wxString& filename)
+{
+    std::lock_guard<std::mutex> lock(gs_mutex);
+    gs_filename = filename;
+    gs_events.clear();
+    gs_events.reserve(1024);
+    gs_recording = true;
+}
+
+
+namespace { void TraceLockContention(); }
+
+void StopRecording()
+{
+    TraceLockContention();
+
+    std::vector<Event> events;
+    wxString filename;
+    {
+        std::lock_guard<std::mutex> lock(gs_mutex);
+        if (!gs_recording)
+            return;
+        gs_recording = false;
+        events.swap(gs_events);
+        filename = gs_filename;
+    }
+
+    std::string out("{\"traceEvents\":[\n");
+    out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"main\"}}";
+    for (auto& e: events)
+    {
+        out += ",\n{\"name\":";
+        AppendJSONString(out, e.name);
+        out += ",\"ph\":\"";
+        out += e.phase;
+        out += "\",\"pid\":1,\"tid\":" + std::to_string(e.thread) +
+               ",\"ts\":" + std::to_string(e.start);
+        if (e.phase == 'C')
+            out += ",\"args\":{\"bytes\":" + std::to_string(e.value) + "}";
+        else
+        {
+            out += ",\"dur\":" + std::to_string(e.duration);
+            if (e.value >= 0)
+                out += ",\"args\":{\"items\":" + std::to_string(e.value) + "}";
+        }
+        out += "}";
+    }
+    out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    wxFFile f(filename, "wb");
+    if (!f.IsOpened() || !f.Write(out.data(), out.size()))
+        wxLogWarning("Failed to write trace file %s.", filename);
+}
+
+
+bool IsRecording()
+{
+    return gs_recording;
+}
+
+
+bool IsEnabled()
+{
+    return gs_recording || wxLog::IsAllowedTraceMask(TRACE_MASK);
+}
+
+
+void RecordEvent(const char *name, Clock::time_point start, long long items)
+{
+    const bool recording = gs_recording;
+    if (!recording && !wxLog::IsAllowedTraceMask(TRACE_MASK))
+        return;
+
+    const auto end = Clock::now();
+    const auto duration = ToMicroseconds(end - start);
+    if (recording)
+        AddEvent({name, 'X', ToMicroseconds(start - gs_epoch), duration, items, CurrentThreadId()});
+
+    if (items >= 0 && duration > 0)
+    {
+        wxLogTrace(TRACE_MASK, "%s: %.1f ms (%lld items, %.0f items/s)",
+                   name, duration / 1000.0, items, items * 1e6 / duration);
+    }
+    else
+    {
+        wxLogTrace(TRACE_MASK, "%s: %.1f ms", name, duration / 1000.0);
+    }
+}
+
+
+void RecordEvent(const wxString& name, Clock::time_point start)
+{
+    const bool recording = gs_recording;
+    if (!recording && !wxLog::IsAllowedTraceMask(TRACE_MASK))
+        return;
+
+    const auto end = Clock::now();
+    const auto duration = ToMicroseconds(end - start);
+    if (recording)
+        AddEvent({name.utf8_string(), 'X', ToMicroseconds(start - gs_epoch), duration, -1, CurrentThreadId()});
+
+    wxLogTrace(TRACE_MASK, "%s: %.1f ms", name, duration / 1000.0);
+}
+
+
+void ScopedTask::RecordTask(Clock::time_point start)
+{
+    const auto end = Clock::now();
+    AddEvent({"task", 'X', ToMicroseconds(start - gs_epoch), ToMicroseconds(end - start), -1, CurrentThreadId()});
+}
+
+
+size_t GetPeakMemoryUsage()
+{
+#if defined(__WXMSW__)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+  #ifdef __WXOSX__
+    return (size_t)usage.ru_maxrss; // in bytes on macOS...
+  #else
+    return (size_t)usage.ru_maxrss * 1024; // ...but in kilobytes elsewhere
+  #endif
+#endif
+}
+
+
+void RecordPeakMemoryUsage()
+{
+    const bool recording = gs_recording;
+    if (!recording && !wxLog::IsAllowedTraceMask(TRACE_MASK))
+        return;
+
+    const size_t peak = GetPeakMemoryUsage();
+    if (recording)
+        AddEvent({"peak memory usage", 'C', ToMicroseconds(Clock::now() - gs_epoch), 0, (long long)peak, CurrentThreadId()});
+
+    wxLogTrace(TRACE_MASK, "peak memory usage: %.1f MB", peak / (1024.0 * 1024.0));
+}
+
+
+
+struct InstrumentedMutex::Stats
+{
+    typedef std::atomic<uint64_t> Counter;
+    Counter acquisitions {0}, contended {0}, waitUs {0}, maxWaitUs {0}, holdUs {0};
+};
+
+namespace
+{
+
+std::mutex gs_lockStatsMutex;
+std::map<std::string, std::unique_ptr<InstrumentedMutex::Stats>> gs_lockStats;
+
+bool LockStatsEnabled()
+{
+    static const bool s_traced = wxLog::IsAllowedTraceMask(LOCKS_TRACE_MASK);
+    return s_traced || gs_recording;
+}
+
+} // anonymous namespace
+
+
+InstrumentedMutex::InstrumentedMutex(const char *name)
+{
+    std::lock_guard<std::mutex> lock(gs_lockStatsMutex);
+    auto& stats = gs_lockStats[name];
+    if (!stats)
+        stats.reset(new Stats);
+    m_stats = stats.get();
+}
+
+
+void InstrumentedMutex::lock()
+{
+    if (!LockStatsEnabled())
+    {
+        m_mutex.lock();
+        m_instrumented = false;
+        return;
+    }
+
+    auto now = Clock::now();
+    if (!m_mutex.try_lock())
+    {
+        const auto waitStart = now;
+        m_mutex.lock();
+        now = Clock::now();
+        const uint64_t us = (uint64_t)ToMicroseconds(now - waitStart);
+        m_stats->contended++;
+        m_stats->waitUs += us;
+        uint64_t prevMax = m_stats->maxWaitUs;
+        while (us > prevMax && !m_stats->maxWaitUs.compare_exchange_weak(prevMax, us)) {}
+    }
+    m_stats->acquisitions++;
+    m_instrumented = true;
+    m_lockedAt = now;
+}
+
+
+bool InstrumentedMutex::try_lock()
+{
+    if (!m_mutex.try_lock())
+        return false;
+    m_instrumented = LockStatsEnabled();
+    if (m_instrumented)
+    {
+        m_stats->acquisitions++;
+        m_lockedAt = Clock::now();
+    }
+    return true;
+}
+
+
+void InstrumentedMutex::unlock()
+{
+    if (m_instrumented)
+    {
+        m_stats->holdUs += (uint64_t)ToMicroseconds(Clock::now() - m_lockedAt);
+        m_instrumented = false;
+    }
+    m_mutex.unlock();
+}
+
+
+std::string GetLockContentionReport()
+{
+    std::lock_guard<std::mutex> lock(gs_lockStatsMutex);
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    for (auto& i: gs_lockStats)
+    {
+        auto& s = *i.second;
+        const uint64_t acquisitions = s.acquisitions, contended = s.contended;
+        if (!acquisitions)
+            continue;
+        ss << i.first << ": acquired " << acquisitions
+           << ", contended " << contended << " (" << 100.0 * contended / acquisitions << "%)"
+           << ", waited " << s.waitUs / 1000.0 << " ms (max " << s.maxWaitUs / 1000.0 << " ms)"
+           << ", held " << s.holdUs / 1000.0 << " ms\n";
+    }
+    return ss.str();
+}
+
+
+namespace
+{
+
+void TraceLockContention()
+{
+    if (!wxLog::IsAllowedTraceMask(LOCKS_TRACE_MASK))
+        return;
+    std::istringstream ss(GetLockContentionReport());
+    std::string line;
+    while (std::getline(ss, line))
+        wxLogTrace(LOCKS_TRACE_MASK, "%s", line);
+}
+
+} // anonymous namespace
+
+} // namespace perf
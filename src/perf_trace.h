@@ -0,0 +1,169 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2023 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_perf_trace_h
+#define Poedit_perf_trace_h
+
+#include <wx/string.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+/**
+    Lightweight measuring of time spent in interesting operations.
+
+    Durations are logged with wxLogTrace("poedit.perf") and, if enabled with
+    StartRecording() (see the --trace command line option), recorded into
+    a file in Chrome's trace event format that can be viewed in
+    chrome://tracing or https://ui.perfetto.dev and attached to bug reports.
+
+    When neither is enabled, the overhead is just reading the clock.
+ */
+namespace perf
+{
+
+typedef std::chrono::steady_clock Clock;
+
+/// Starts recording of events, they are written to @a filename by StopRecording().
+void StartRecording(const wxString& filename);
+
+/// Writes events recorded so far, if any, and stops recording.
+void StopRecording();
+
+/// Returns true if events are being recorded into a file.
+bool IsRecording();
+
+/// Returns true if events are recorded or logged, i.e. measuring isn't wasted.
+bool IsEnabled();
+
+/**
+    Records an event that started at @a start and ends now.
+
+    May be called from any thread. @a name must be a string literal (or
+    otherwise outlive the recording). If @a items is not negative, it is
+    the number of items (e.g. catalog entries) processed and throughput
+    is logged too.
+ */
+void RecordEvent(const char *name, Clock::time_point start, long long items = -1);
+
+/// Records an event with dynamically created @a name, e.g. a progress stage.
+void RecordEvent(const wxString& name, Clock::time_point start);
+
+/// Returns peak memory usage (resident set size) of the process in bytes, or 0 if unknown.
+size_t GetPeakMemoryUsage();
+
+/// Records the current value of GetPeakMemoryUsage() as a counter.
+void RecordPeakMemoryUsage();
+
+
+/// Records time spent in a scope as an event named @a name.
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(const char *name) : m_name(name), m_start(Clock::now()) {}
+    ~ScopedTimer() { RecordEvent(m_name, m_start, m_items); }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    /// Sets number of items processed in the scope, see RecordEvent()
+    void SetItemsCount(size_t count) { m_items = (long long)count; }
+
+private:
+    const char *m_name;
+    Clock::time_point m_start;
+    long long m_items = -1;
+};
+
+
+/**
+    Records time spent running a task on a background thread (see dispatch).
+
+    Unlike other events, tasks are only recorded into the trace file, where
+    they show utilization of the threads, and not logged, because there are
+    too many of them.
+ */
+class ScopedTask
+{
+public:
+    ScopedTask() : m_recording(IsRecording()) { if (m_recording) m_start = Clock::now(); }
+    ~ScopedTask() { if (m_recording) RecordTask(m_start); }
+
+    ScopedTask(const ScopedTask&) = delete;
+    ScopedTask& operator=(const ScopedTask&) = delete;
+
+private:
+    static void RecordTask(Clock::time_point start);
+
+    bool m_recording;
+    Clock::time_point m_start;
+};
+
+
+
+/**
+    Mutex that collects contention statistics: how many times it was
+    acquired, how often and how long threads had to wait for it and how
+    long it was held. Mutexes with the same @a name share statistics.
+
+    Statistics are only collected when lock tracing is enabled (with
+    WXTRACE=poedit.locks) or a trace is being recorded; otherwise the only
+    overhead over std::mutex is checking that.
+
+    See GetLockContentionReport().
+ */
+class InstrumentedMutex
+{
+public:
+    explicit InstrumentedMutex(const char *name);
+
+    InstrumentedMutex(const InstrumentedMutex&) = delete;
+    InstrumentedMutex& operator=(const InstrumentedMutex&) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+    struct Stats;
+
+private:
+    std::mutex m_mutex;
+    Stats *m_stats;
+    // only accessed by the thread holding the lock:
+    bool m_instrumented = false;
+    Clock::time_point m_lockedAt;
+};
+
+/**
+    Returns human-readable report of statistics collected by InstrumentedMutex
+    instances. It is also logged with wxLogTrace("poedit.locks") on shutdown.
+ */
+std::string GetLockContentionReport();
+
+} // namespace perf
+
+#endif // Poedit_perf_trace_h
@@ -11,6 +11,9 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include <ctype.h>
+#include <string.h>
+
+#include <string>
 
 #include "pl_evaluate.h"
 
@@ -235,20 +238,304 @@ PluralFormsNode::evaluate(PluralFormsToken::Number n) const
 }
 
 
+// ----------------------------------------------------------------------------
+// Plural forms compiler
+// ----------------------------------------------------------------------------
+
+namespace
+{
+
+// Deeper expressions are evaluated by walking the tree; no real-world
+// expression comes even close
+const int MAX_STACK_DEPTH = 32;
+
+typedef PluralFormsInstruction Instr;
+
+bool binaryOp(PluralFormsToken::Type type, Instr::Op& op)
+{
+    switch (type)
+    {
+        case PluralFormsToken::T_EQUAL:            op = Instr::OP_EQUAL; return true;
+        case PluralFormsToken::T_NOT_EQUAL:        op = Instr::OP_NOT_EQUAL; return true;
+        case PluralFormsToken::T_GREATER:          op = Instr::OP_GREATER; return true;
+        case PluralFormsToken::T_GREATER_OR_EQUAL: op = Instr::OP_GREATER_OR_EQUAL; return true;
+        case PluralFormsToken::T_LESS:             op = Instr::OP_LESS; return true;
+        case PluralFormsToken::T_LESS_OR_EQUAL:    op = Instr::OP_LESS_OR_EQUAL; return true;
+        case PluralFormsToken::T_REMINDER:         op = Instr::OP_REMINDER; return true;
+        default:                                   return false;
+    }
+}
+
+// Emits code for the node into 'code', leaving its value on top of the stack.
+// 'depth' is the stack depth before evaluating the node.
+bool compileNode(const PluralFormsNode* node, std::vector<Instr>& code, int depth, int& maxDepth)
+{
+    if (!node)
+        return false;
+    if (depth + 1 > maxDepth)
+        maxDepth = depth + 1;
+    if (maxDepth > MAX_STACK_DEPTH)
+        return false;
+
+    const PluralFormsToken& token = node->token();
+    Instr::Op op;
+    switch (token.type())
+    {
+        case PluralFormsToken::T_NUMBER:
+            code.push_back({Instr::OP_NUMBER, token.number()});
+            return true;
+
+        case PluralFormsToken::T_N:
+            code.push_back({Instr::OP_N, 0});
+            return true;
+
+        case PluralFormsToken::T_LOGICAL_AND:
+        case PluralFormsToken::T_LOGICAL_OR:
+        {
+            if (!compileNode(node->node(0), code, depth, maxDepth))
+                return false;
+            size_t jump = code.size();
+            code.push_back({token.type() == PluralFormsToken::T_LOGICAL_AND
+                                ? Instr::OP_JUMP_IF_ZERO_ELSE_POP
+                                : Instr::OP_JUMP_IF_NONZERO_ELSE_POP,
+                            0});
+            if (!compileNode(node->node(1), code, depth, maxDepth))
+                return false;
+            code.push_back({Instr::OP_BOOL, 0});
+            code[jump].arg = (int)code.size();
+            return true;
+        }
+
+        case PluralFormsToken::T_QUESTION:
+        {
+            if (!compileNode(node->node(0), code, depth, maxDepth))
+                return false;
+            size_t jumpElse = code.size();
+            code.push_back({Instr::OP_JUMP_IF_ZERO_POP, 0});
+            if (!compileNode(node->node(1), code, depth, maxDepth))
+                return false;
+            size_t jumpEnd = code.size();
+            code.push_back({Instr::OP_JUMP, 0});
+            code[jumpElse].arg = (int)code.size();
+            if (!compileNode(node->node(2), code, depth, maxDepth))
+                return false;
+            code[jumpEnd].arg = (int)code.size();
+            return true;
+        }
+
+        default:
+        {
+            if (!binaryOp(token.type(), op))
+                return false;
+            if (!compileNode(node->node(0), code, depth, maxDepth))
+                return false;
+            // constant right operand, as in "n%10==1", is folded into the instruction:
+            const PluralFormsNode* right = node->node(1);
+            if (right && right->token().type() == PluralFormsToken::T_NUMBER)
+            {
+                code.push_back({Instr::Op(op + (Instr::OP_EQUAL_C - Instr::OP_EQUAL)), right->token().number()});
+                return true;
+            }
+            if (!compileNode(right, code, depth + 1, maxDepth))
+                return false;
+            code.push_back({op, 0});
+            return true;
+        }
+    }
+}
+
+
+// Native versions of the most common expressions from language_impl_plurals.h,
+// keyed by the expression with whitespace removed:
+
+constexpr int plural_1(int) { return 0; }
+constexpr int plural_2_not1(int n) { return n != 1; }
+constexpr int plural_2_gt1(int n) { return n > 1; }
+constexpr int plural_2_01(int n) { return n==0 || n==1; }
+constexpr int plural_3_12(int n) { return n==1 ? 0 : n==2 ? 1 : 2; }
+constexpr int plural_3_slavic(int n) { return n%10==1 && n%100!=11 ? 0 : n%10>=2 && n%10<=4 && (n%100<12 || n%100>14) ? 1 : 2; }
+constexpr int plural_3_czech(int n) { return n==1 ? 0 : n>=2 && n<=4 ? 1 : 2; }
+constexpr int plural_3_polish(int n) { return n==1 ? 0 : n%10>=2 && n%10<=4 && (n%100<12 || n%100>14) ? 1 : 2; }
+constexpr int plural_4_slovenian(int n) { return n%100==1 ? 0 : n%100==2 ? 1 : n%100>=3 && n%100<=4 ? 2 : 3; }
+constexpr int plural_6_arabic(int n) { return n==0 ? 0 : n==1 ? 1 : n==2 ? 2 : n%100>=3 && n%100<=10 ? 3 : n%100>=11 && n%100<=99 ? 4 : 5; }
+
+static_assert(plural_3_slavic(1) == 0 && plural_3_slavic(11) == 2 && plural_3_slavic(22) == 1 && plural_3_slavic(25) == 2, "broken Slavic plurals");
+static_assert(plural_3_polish(1) == 0 && plural_3_polish(21) == 2 && plural_3_polish(24) == 1, "broken Polish plurals");
+static_assert(plural_6_arabic(0) == 0 && plural_6_arabic(103) == 3 && plural_6_arabic(111) == 4 && plural_6_arabic(100) == 5, "broken Arabic plurals");
+
+struct KnownPluralForms
+{
+    const char *expr;
+    PluralFormsToken::Number (*func)(PluralFormsToken::Number);
+};
+
+const KnownPluralForms gs_knownPluralForms[] =
+{
+    { "nplurals=1;plural=0;", plural_1 },
+    { "nplurals=2;plural=(n!=1);", plural_2_not1 },
+    { "nplurals=2;plural=n!=1;", plural_2_not1 },
+    { "nplurals=2;plural=(n>1);", plural_2_gt1 },
+    { "nplurals=2;plural=n>1;", plural_2_gt1 },
+    { "nplurals=2;plural=(n==0||n==1);", plural_2_01 },
+    { "nplurals=3;plural=(n==1?0:n==2?1:2);", plural_3_12 },
+    { "nplurals=3;plural=(n%10==1&&n%100!=11?0:n%10>=2&&n%10<=4&&(n%100<12||n%100>14)?1:2);", plural_3_slavic },
+    { "nplurals=3;plural=(n==1?0:n>=2&&n<=4?1:2);", plural_3_czech },
+    { "nplurals=3;plural=(n==1?0:n%10>=2&&n%10<=4&&(n%100<12||n%100>14)?1:2);", plural_3_polish },
+    { "nplurals=4;plural=(n%100==1?0:n%100==2?1:n%100>=3&&n%100<=4?2:3);", plural_4_slovenian },
+    { "nplurals=6;plural=(n==0?0:n==1?1:n==2?2:n%100>=3&&n%100<=10?3:n%100>=11&&n%100<=99?4:5);", plural_6_arabic },
+};
+
+PluralFormsToken::Number (*findKnownPluralForms(const char *s))(PluralFormsToken::Number)
+{
+    std::string normalized;
+    for (; *s; ++s)
+    {
+        if (!isspace(*s))
+            normalized += *s;
+    }
+
+    for (auto& known: gs_knownPluralForms)
+    {
+        if (normalized == known.expr)
+            return known.func;
+    }
+    return nullptr;
+}
+
+} // anonymous namespace
+
+
 void PluralFormsCalculator::init(PluralFormsToken::Number nplurals,
                                    PluralFormsNode* plural)
 {
     m_nplurals = nplurals;
     m_plural.reset(plural);
+    m_native = nullptr;
+    if (!compile())
+        m_code.clear();
 }
 
-int PluralFormsCalculator::evaluate(int n) const
+bool PluralFormsCalculator::compile()
 {
+    m_code.clear();
+    m_stackDepth = 0;
     if (m_plural.get() == 0)
+        return false;
+    return compileNode(m_plural.get(), m_code, 0, m_stackDepth);
+}
+
+int PluralFormsCalculator::evaluate(int n) const
+{
+    PluralFormsToken::Number number;
+    if (m_native)
+    {
+        number = m_native(n);
+    }
+    else if (!m_code.empty())
+    {
+        PluralFormsToken::Number stack[MAX_STACK_DEPTH];
+        int sp = -1;
+
+        const PluralFormsInstruction *code = m_code.data();
+        const size_t size = m_code.size();
+        size_t pc = 0;
+        while (pc < size)
+        {
+            const PluralFormsInstruction& i = code[pc++];
+            switch (i.op)
+            {
+                case Instr::OP_N:
+                    stack[++sp] = n;
+                    break;
+                case Instr::OP_NUMBER:
+                    stack[++sp] = i.arg;
+                    break;
+
+                case Instr::OP_EQUAL:
+                    sp--; stack[sp] = stack[sp] == stack[sp+1];
+                    break;
+                case Instr::OP_NOT_EQUAL:
+                    sp--; stack[sp] = stack[sp] != stack[sp+1];
+                    break;
+                case Instr::OP_GREATER:
+                    sp--; stack[sp] = stack[sp] > stack[sp+1];
+                    break;
+                case Instr::OP_GREATER_OR_EQUAL:
+                    sp--; stack[sp] = stack[sp] >= stack[sp+1];
+                    break;
+                case Instr::OP_LESS:
+                    sp--; stack[sp] = stack[sp] < stack[sp+1];
+                    break;
+                case Instr::OP_LESS_OR_EQUAL:
+                    sp--; stack[sp] = stack[sp] <= stack[sp+1];
+                    break;
+                case Instr::OP_REMINDER:
+                    sp--; stack[sp] = stack[sp+1] != 0 ? stack[sp] % stack[sp+1] : 0;
+                    break;
+
+                case Instr::OP_EQUAL_C:
+                    stack[sp] = stack[sp] == i.arg;
+                    break;
+                case Instr::OP_NOT_EQUAL_C:
+                    stack[sp] = stack[sp] != i.arg;
+                    break;
+                case Instr::OP_GREATER_C:
+                    stack[sp] = stack[sp] > i.arg;
+                    break;
+                case Instr::OP_GREATER_OR_EQUAL_C:
+                    stack[sp] = stack[sp] >= i.arg;
+                    break;
+                case Instr::OP_LESS_C:
+                    stack[sp] = stack[sp] < i.arg;
+                    break;
+                case Instr::OP_LESS_OR_EQUAL_C:
+                    stack[sp] = stack[sp] <= i.arg;
+                    break;
+                case Instr::OP_REMINDER_C:
+                    stack[sp] = i.arg != 0 ? stack[sp] % i.arg : 0;
+                    break;
+
+                case Instr::OP_BOOL:
+                    stack[sp] = stack[sp] != 0;
+                    break;
+
+                case Instr::OP_JUMP:
+                    pc = i.arg;
+                    break;
+                case Instr::OP_JUMP_IF_ZERO_POP:
+                    if (stack[sp--] == 0)
+                        pc = i.arg;
+                    break;
+                case Instr::OP_JUMP_IF_ZERO_ELSE_POP:
+                    if (stack[sp] == 0)
+                        pc = i.arg;
+                    else
+                        sp--;
+                    break;
+                case Instr::OP_JUMP_IF_NONZERO_ELSE_POP:
+                    if (stack[sp] != 0)
+                    {
+                        stack[sp] = 1;
+                        pc = i.arg;
+                    }
+                    else
+                    {
+                        sp--;
+                    }
+                    break;
+            }
+        }
+        number = stack[0];
+    }
+    else if (m_plural.get() != 0)
+    {
+        number = m_plural->evaluate(n);
+    }
+    else
     {
         return 0;
     }
-    PluralFormsToken::Number number = m_plural->evaluate(n);
+
     if (number < 0 || number > m_nplurals)
     {
         return 0;
@@ -588,6 +875,7 @@ std::shared_ptr<PluralFormsCalculator> PluralFormsCalculator::make(const char* s
         {
             return NULL;
         }
+        calculator->m_native = findKnownPluralForms(s);
     }
     return calculator;
 }
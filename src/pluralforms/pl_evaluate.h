@@ -13,6 +13,7 @@
 #include <wx/string.h>
 
 #include <memory>
+#include <vector>
 
 // ----------------------------------------------------------------------------
 // Plural forms parser
@@ -125,10 +126,37 @@ private:
 };
 
 
+// Instruction of the compiled plural expression, see PluralFormsCalculator
+struct PluralFormsInstruction
+{
+    enum Op
+    {
+        // push n or the constant arg
+        OP_N, OP_NUMBER,
+        // binary operators taking both operands from the stack
+        OP_EQUAL, OP_NOT_EQUAL, OP_GREATER, OP_GREATER_OR_EQUAL,
+        OP_LESS, OP_LESS_OR_EQUAL, OP_REMINDER,
+        // the same operators with constant arg as the right operand
+        OP_EQUAL_C, OP_NOT_EQUAL_C, OP_GREATER_C, OP_GREATER_OR_EQUAL_C,
+        OP_LESS_C, OP_LESS_OR_EQUAL_C, OP_REMINDER_C,
+        // convert top of the stack to 0/1
+        OP_BOOL,
+        // jumps to instruction arg:
+        OP_JUMP,
+        OP_JUMP_IF_ZERO_POP,        // pops the value in any case
+        OP_JUMP_IF_ZERO_ELSE_POP,   // leaves 0 on the stack if jumping (&&)
+        OP_JUMP_IF_NONZERO_ELSE_POP // leaves 1 on the stack if jumping (||)
+    };
+
+    Op op;
+    int arg;
+};
+
+
 class PluralFormsCalculator
 {
 public:
-    PluralFormsCalculator() : m_nplurals(0), m_plural(0) {}
+    PluralFormsCalculator() : m_nplurals(0), m_plural(0), m_stackDepth(0), m_native(nullptr) {}
 
     // input: number, returns msgstr index
     int evaluate(int n) const;
@@ -146,6 +174,16 @@ public:
     wxString getString() const;
 
 private:
+    bool compile();
+
     PluralFormsToken::Number m_nplurals;
     PluralFormsNodePtr m_plural;
+
+    // The expression is compiled into postfix code evaluated in a tight loop
+    // instead of walking the tree; m_plural is only used if compilation fails
+    std::vector<PluralFormsInstruction> m_code;
+    int m_stackDepth;
+
+    // Native implementation used instead for well-known expressions
+    PluralFormsToken::Number (*m_native)(PluralFormsToken::Number);
 };
@@ -25,13 +25,13 @@
 
 #include "prefsdlg.h"
 
-#include <fstream>
 #include <memory>
 
 #include <wx/editlbox.h>
 #include <wx/textctrl.h>
 #include <wx/button.h>
 #include <wx/config.h>
+#include <wx/log.h>
 #include <wx/choicdlg.h>
 #include <wx/checkbox.h>
 #include <wx/choice.h>
@@ -60,6 +60,8 @@
 #include "configuration.h"
 #include "crowdin_gui.h"
 #include "hidpi.h"
+#include "http_client.h"
+#include "progressinfo.h"
 #include "tm/transmem.h"
 #include "tm/tmx_io.h"
 #include "chooselang.h"
@@ -201,6 +203,8 @@ public:
         sizer->Add(m_compileMo);
         m_showSummary = new wxCheckBox(this, wxID_ANY, _("Show summary after updating files"));
         sizer->Add(m_showSummary, wxSizerFlags().PXBorder(wxTOP));
+        m_watchSources = new wxCheckBox(this, wxID_ANY, _("Extract strings from changed source code in the background"));
+        sizer->Add(m_watchSources, wxSizerFlags().PXBorder(wxTOP));
 
         sizer->AddSpacer(PX(10));
 
@@ -262,6 +266,7 @@ public:
             m_useFontText->Bind(wxEVT_CHECKBOX, &GeneralPageWindow::TransferDataFromWindowAndUpdateUI, this);
             Bind(wxEVT_FONTPICKER_CHANGED, &GeneralPageWindow::TransferDataFromWindowAndUpdateUI, this);
             m_focusToText->Bind(wxEVT_CHECKBOX, &GeneralPageWindow::TransferDataFromWindowAndUpdateUI, this);
+            m_watchSources->Bind(wxEVT_CHECKBOX, &GeneralPageWindow::TransferDataFromWindowAndUpdateUI, this);
             m_spellchecking->Bind(wxEVT_CHECKBOX, &GeneralPageWindow::TransferDataFromWindowAndUpdateUI, this);
         }
 
@@ -280,6 +285,7 @@ public:
         m_userEmail->SetValue(cfg.Read("translator_email", wxEmptyString));
         m_compileMo->SetValue(cfg.ReadBool("compile_mo", true));
         m_showSummary->SetValue(cfg.ReadBool("show_summary", false));
+        m_watchSources->SetValue(Config::WatchSources());
         m_focusToText->SetValue(cfg.ReadBool("focus_to_text", false));
 
         if (IsSpellcheckingAvailable())
@@ -313,6 +319,7 @@ public:
         cfg.Write("translator_email", m_userEmail->GetValue());
         cfg.Write("compile_mo", m_compileMo->GetValue());
         cfg.Write("show_summary", m_showSummary->GetValue());
+        Config::WatchSources(m_watchSources->GetValue());
         cfg.Write("focus_to_text", m_focusToText->GetValue());
 
         if (IsSpellcheckingAvailable())
@@ -340,7 +347,7 @@ public:
 
 private:
     wxTextCtrl *m_userName, *m_userEmail;
-    wxCheckBox *m_compileMo, *m_showSummary, *m_focusToText, *m_spellchecking;
+    wxCheckBox *m_compileMo, *m_showSummary, *m_watchSources, *m_focusToText, *m_spellchecking;
     wxCheckBox *m_useFontList, *m_useFontText;
     wxFontPickerCtrl *m_fontList, *m_fontText;
 #if NEED_CHOOSELANG_UI
@@ -496,7 +503,9 @@ private:
         static const auto idLearn = wxNewId();
         static const auto idImportTMX = wxNewId();
         static const auto idExportTMX = wxNewId();
+        static const auto idCleanUp = wxNewId();
         static const auto idReset = wxNewId();
+        static const auto idDiagnostics = wxNewId();
 
         wxMenu menu;
 #ifdef __WXOSX__
@@ -507,12 +516,23 @@ private:
         menu.Append(idImportTMX, MSW_OR_OTHER(_(L"Import from TMX…"), _(L"Import From TMX…")));
         menu.Append(idExportTMX, MSW_OR_OTHER(_(L"Export to TMX…"), _(L"Export To TMX…")));
         menu.AppendSeparator();
+        // TRANSLATORS: This is a menu item that removes duplicates from the translation memory and compacts it
+        menu.Append(idCleanUp, MSW_OR_OTHER(_(L"Clean up…"), _(L"Clean Up…")));
         // TRANSLATORS: This is a button that deletes everything in the translation memory (i.e. clears/resets it).
         menu.Append(idReset, _("Reset"));
+        // Query performance statistics are only of interest to developers, so show
+        // them only when TM tracing is enabled (WXTRACE=poedit.tm):
+        if (wxLog::IsAllowedTraceMask("poedit.tm"))
+        {
+            menu.AppendSeparator();
+            menu.Append(idDiagnostics, L"Diagnostics…");
+            menu.Bind(wxEVT_MENU, &TMPageWindow::OnTMDiagnostics, this, idDiagnostics);
+        }
 
         menu.Bind(wxEVT_MENU, &TMPageWindow::OnImportIntoTM, this, idLearn);
         menu.Bind(wxEVT_MENU, &TMPageWindow::OnImportTMX, this, idImportTMX);
         menu.Bind(wxEVT_MENU, &TMPageWindow::OnExportTMX, this, idExportTMX);
+        menu.Bind(wxEVT_MENU, &TMPageWindow::OnCleanUpTM, this, idCleanUp);
         menu.Bind(wxEVT_MENU, &TMPageWindow::OnResetTM, this, idReset);
 
         auto win = dynamic_cast<wxButton*>(e.GetEventObject());
@@ -582,7 +602,7 @@ private:
             MACOS_OR_OTHER("", _("Select TMX files to import")),
             "",
             "",
-            MaskForType("*.tmx", _("TMX Files")),
+            MaskForType("*.tmx;*.tmx.gz", _("TMX Files")) + "|" + MaskForType("*.poedittm;*.poedittm.gz", _("Translation Memory Backups")),
             wxFD_OPEN | wxFD_FILE_MUST_EXIST | wxFD_MULTIPLE)
         );
 
@@ -595,41 +615,48 @@ private:
             wxArrayString paths;
             dlg->GetPaths(paths);
 
-            wxProgressDialog progress(_("Translation Memory"),
-                                      _(L"Importing translations…"),
-                                      (int)paths.size() + 1,
-                                      this,
-                                      wxPD_APP_MODAL|wxPD_AUTO_HIDE|wxPD_CAN_ABORT);
-            progress.Pulse();
-            for (auto p: paths)
+            // collect errors to report them after the (modal) progress window is closed:
+            std::vector<std::pair<wxString, wxString>> errors;
+
+            ProgressWindow::RunCancellableTask(this, _(L"Importing translations…"),
+            [paths,&errors](dispatch::cancellation_token_ptr cancellationToken)
             {
-                try
+                Progress progress((int)paths.size());
+                for (auto p: paths)
                 {
-                    std::ifstream f;
-                    f.open(p.fn_str());
-                    TMX::ImportFromFile(f, TranslationMemory::Get());
-                    f.close();
-
-                    if (!progress.Pulse())
+                    if (cancellationToken->is_cancelled())
                         break;
+                    try
+                    {
+                        if (TMBinary::IsBinaryFileName(p))
+                            TMBinary::ImportFromFile(p, TranslationMemory::Get());
+                        else
+                            TMX::ImportFromFile(p, TranslationMemory::Get());
+                    }
+                    catch (...)
+                    {
+                        errors.emplace_back(p, DescribeCurrentException());
+                    }
+                    progress.increment();
                 }
-                catch (...)
-                {
-                    wxWindowPtr<wxMessageDialog> err(new wxMessageDialog
-                    (
-                            this,
-                            wxString::Format(_(L"Importing translation memory from “%s” failed."), p),
-                            _("Import error"),
-                            wxOK | wxICON_ERROR
-                        ));
-                    err->SetExtendedMessage(DescribeCurrentException());
-                    // FIXME: can't use ShowWindowModalThenDo, as would be better, because multiple
-                    //        errors may occur in this loop. See https://github.com/vslavik/poedit/issues/748
-                    if (paths.size() == 1)
-                        err->ShowWindowModalThenDo([err](int){});
-                    else
-                        err->ShowModal();
-                }
+            });
+
+            for (auto& e: errors)
+            {
+                wxWindowPtr<wxMessageDialog> err(new wxMessageDialog
+                (
+                        this,
+                        wxString::Format(_(L"Importing translation memory from “%s” failed."), e.first),
+                        _("Import error"),
+                        wxOK | wxICON_ERROR
+                    ));
+                err->SetExtendedMessage(e.second);
+                // FIXME: can't use ShowWindowModalThenDo, as would be better, because multiple
+                //        errors may occur in this loop. See https://github.com/vslavik/poedit/issues/748
+                if (errors.size() == 1)
+                    err->ShowWindowModalThenDo([err](int){});
+                else
+                    err->ShowModal();
             }
             UpdateStats();
         }
@@ -643,7 +670,8 @@ private:
             MACOS_OR_OTHER("", _(L"Export as…")),
             "",
             "",
-            MaskForType("*.tmx", _("TMX Files")),
+            MaskForType("*.tmx", _("TMX Files")) + "|" + MaskForType("*.tmx.gz", _("Compressed TMX Files")) + "|" +
+                MaskForType("*.poedittm.gz", _("Translation Memory Backups")),
             wxFD_SAVE | wxFD_OVERWRITE_PROMPT)
         );
 
@@ -654,21 +682,29 @@ private:
                 return;
 
             auto p = dlg->GetPath();
-            wxProgressDialog progress(_("Translation Memory"),
-                                      _(L"Exporting translations…"),
-                                      1,
-                                      this,
-                                      wxPD_APP_MODAL|wxPD_AUTO_HIDE|wxPD_CAN_ABORT);
-            progress.Pulse();
-
-            try
+            const bool binary = dlg->GetFilterIndex() == 2;
+            if (binary && !TMBinary::IsBinaryFileName(p))
+                p += ".poedittm.gz";
+            else if (dlg->GetFilterIndex() == 1 && !TMX::IsCompressedFileName(p))
+                p += ".gz";
+
+            wxString error;
+            ProgressWindow::RunTask(this, _(L"Exporting translations…"), [p,binary,&error]
             {
-                std::ofstream f;
-                f.open(p.fn_str());
-                TMX::ExportToFile(TranslationMemory::Get(), f);
-                f.close();
-            }
-            catch (...)
+                try
+                {
+                    if (binary)
+                        TMBinary::ExportToFile(TranslationMemory::Get(), p);
+                    else
+                        TMX::ExportToFile(TranslationMemory::Get(), p);
+                }
+                catch (...)
+                {
+                    error = DescribeCurrentException();
+                }
+            });
+
+            if (!error.empty())
             {
                 wxWindowPtr<wxMessageDialog> err(new wxMessageDialog
                 (
@@ -677,12 +713,51 @@ private:
                         _("Export error"),
                         wxOK | wxICON_ERROR
                     ));
-                err->SetExtendedMessage(DescribeCurrentException());
+                err->SetExtendedMessage(error);
                 err->ShowWindowModalThenDo([err](int){});
             }
         }
     }
 
+    void OnCleanUpTM(wxCommandEvent&)
+    {
+        TranslationMemory::MaintenanceResult result;
+        wxString error;
+        ProgressWindow::RunTask(this, _(L"Cleaning up translation memory…"), [&result,&error]
+        {
+            try
+            {
+                result = TranslationMemory::Get().Maintain(TranslationMemory::MaintenanceOptions()).get();
+            }
+            catch (...)
+            {
+                error = DescribeCurrentException();
+            }
+        });
+
+        UpdateStats();
+
+        wxWindowPtr<wxMessageDialog> dlg;
+        if (error.empty())
+        {
+            dlg.reset(new wxMessageDialog(this, _("Translation memory was cleaned up."), _("Translation Memory"), wxOK | wxICON_INFORMATION));
+            dlg->SetExtendedMessage(wxString::Format
+            (
+                wxPLURAL("%ld duplicate entry was removed and %s of disk space was freed.",
+                         "%ld duplicate entries were removed and %s of disk space was freed.",
+                         result.duplicatesRemoved),
+                result.duplicatesRemoved,
+                wxFileName::GetHumanReadableSize(wxULongLong(result.bytesReclaimed), "0", 1, wxSIZE_CONV_SI)
+            ));
+        }
+        else
+        {
+            dlg.reset(new wxMessageDialog(this, _(L"Translation memory couldn’t be cleaned up."), _("Translation Memory"), wxOK | wxICON_ERROR));
+            dlg->SetExtendedMessage(error);
+        }
+        dlg->ShowWindowModalThenDo([dlg](int){});
+    }
+
     void OnResetTM(wxCommandEvent&)
     {
         auto title = _("Reset translation memory");
@@ -702,6 +777,16 @@ private:
         });
     }
 
+    void OnTMDiagnostics(wxCommandEvent&)
+    {
+        auto report = TranslationMemory::GetDiagnosticsReport();
+        wxLogTrace("poedit.tm", "%s", report);
+
+        wxWindowPtr<wxMessageDialog> dlg(new wxMessageDialog(this, "Translation memory query statistics", _("Translation Memory"), wxOK | wxICON_INFORMATION));
+        dlg->SetExtendedMessage(wxString::FromUTF8(report));
+        dlg->ShowWindowModalThenDo([dlg](int){});
+    }
+
     void OnUpdateUI(wxUpdateUIEvent& e)
     {
         e.Enable(m_useTM->GetValue());
@@ -1033,6 +1118,15 @@ public:
         m_accounts = new AccountsPanel(this);
         sizer->Add(m_accounts, wxSizerFlags(1).Expand().PXDoubleBorderAll());
 
+        // Network statistics are only of interest to developers, so show
+        // them only when HTTP tracing is enabled (WXTRACE=poedit.http):
+        if (wxLog::IsAllowedTraceMask("poedit.http"))
+        {
+            auto diagnostics = new wxButton(this, wxID_ANY, L"Diagnostics…");
+            sizer->Add(diagnostics, wxSizerFlags().Right().PXDoubleBorder(wxLEFT|wxRIGHT|wxBOTTOM));
+            diagnostics->Bind(wxEVT_BUTTON, &AccountsPageWindow::OnHTTPDiagnostics, this);
+        }
+
     #ifdef __WXOSX__
         // This window was possibly created on demand (pre-macOS 11), possibly
         // hidden. Initialize as soon as it is shown:
@@ -1066,6 +1160,16 @@ public:
     }
 
 private:
+    void OnHTTPDiagnostics(wxCommandEvent&)
+    {
+        auto report = http_client::get_diagnostics_report();
+        wxLogTrace("poedit.http", "%s", report);
+
+        wxWindowPtr<wxMessageDialog> dlg(new wxMessageDialog(this, "Network request statistics", _("Accounts"), wxOK | wxICON_INFORMATION));
+        dlg->SetExtendedMessage(wxString::FromUTF8(report));
+        dlg->ShowWindowModalThenDo([dlg](int){});
+    }
+
     AccountsPanel *m_accounts;
 };
 
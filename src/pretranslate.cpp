@@ -27,7 +27,9 @@
 
 #include "configuration.h"
 #include "customcontrols.h"
+#include "edframe.h"
 #include "hidpi.h"
+#include "perf_trace.h"
 #include "progressinfo.h"
 #include "str_helpers.h"
 #include "tm/transmem.h"
@@ -37,23 +39,210 @@
 #include <wx/checkbox.h>
 #include <wx/dialog.h>
 #include <wx/intl.h>
+#include <wx/log.h>
 #include <wx/msgdlg.h>
 #include <wx/sizer.h>
 #include <wx/windowptr.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
-template<typename T>
-int PreTranslateCatalogImpl(CatalogPtr catalog, const T& range, PreTranslateOptions options, dispatch::cancellation_token_ptr cancellation_token)
+
+namespace
 {
-    if (range.empty())
-        return 0;
 
-    if (!Config::UseTM())
-        return 0;
+// Number of source texts looked up in the TM by a single background job
+const size_t PRETRANSLATE_BATCH_SIZE = 64;
+
+/**
+    Returns, for each of the catalog's plural forms, whether it is used for
+    n=1 and should be filled from the singular's translation. The other forms
+    are filled from the plural string's translation.
+
+    Returns empty vector if the plural forms aren't known.
+ */
+PluralFormsExpr GetPluralFormsExpr(const CatalogPtr& catalog)
+{
+    PluralFormsExpr expr(catalog->Header().GetHeader("Plural-Forms").utf8_string());
+    if (!expr)
+        expr = catalog->GetLanguage().DefaultPluralFormsExpr();
+    return expr;
+}
+
+std::vector<bool> GetSingularPluralForms(const CatalogPtr& catalog)
+{
+    auto expr = GetPluralFormsExpr(catalog);
+    if (!expr || expr.nplurals() < 1)
+        return {};
+
+    std::vector<bool> forms(expr.nplurals(), false);
+    const int singular = expr.evaluate_for_n(1);
+    if (singular >= 0 && singular < (int)forms.size())
+        forms[singular] = true;
+    return forms;
+}
+
+
+/**
+    Translations of strings from catalogs that are already loaded in memory
+    (other open files, the reference file), used as exact matches before
+    the TM is consulted.
+
+    Must be built on the main thread, because the catalogs may be modified
+    by the UI. It is read-only afterwards and can be used from any thread.
+ */
+class InMemoryMatches
+{
+public:
+    /// Index translated items from @a sources that are usable for @a target.
+    InMemoryMatches(const CatalogPtr& target, const std::vector<CatalogPtr>& sources)
+        : InMemoryMatches(target->GetSourceLanguage(), target->GetLanguage(), GetPluralFormsExpr(target), sources, target)
+    {
+    }
+
+    /// Index translated items from @a sources, except @a exclude, in given language pair and plural forms.
+    InMemoryMatches(const Language& srclang_, const Language& lang_, const PluralFormsExpr& plurals,
+                    const std::vector<CatalogPtr>& sources, const CatalogPtr& exclude = nullptr)
+    {
+        const auto srclang = srclang_.Code();
+        const auto lang = lang_.Code();
+
+        for (auto& cat: sources)
+        {
+            if (!cat || cat == exclude)
+                continue;
+            if (cat->GetLanguage().Code() != lang || cat->GetSourceLanguage().Code() != srclang)
+                continue;
+            // plural translations are only reusable with the same plural forms:
+            const bool usePlurals = plurals && GetPluralFormsExpr(cat) == plurals;
+
+            for (auto& item: cat->items())
+            {
+                if (!item->IsTranslated() || item->IsFuzzy())
+                    continue;
+                if (item->HasPlural() && !usePlurals)
+                    continue;
+                Add(MakeKey(*item), item->GetTranslations());
+            }
+        }
+    }
+
+    bool empty() const { return m_entries.empty(); }
+
+    /**
+        Returns translations found for @a item as TM-like results, one list
+        per translation form, or empty vector if none were found.
+
+        Conflicting translations are reported as two exact matches, which
+        pre-translation treats as ambiguous.
+     */
+    std::vector<SuggestionsList> Lookup(const CatalogItem& item) const
+    {
+        auto i = m_entries.find(MakeKey(item));
+        if (i == m_entries.end())
+            return {};
+
+        std::vector<SuggestionsList> results;
+        for (auto& t: i->second.translations)
+        {
+            SuggestionsList r{Suggestion(str::to_wstring(t), 1.0)};
+            if (i->second.ambiguous)
+                r.push_back(r.front());
+            results.push_back(std::move(r));
+        }
+        return results;
+    }
+
+private:
+    struct Entry
+    {
+        wxArrayString translations;
+        bool ambiguous = false;
+    };
+
+    static std::wstring MakeKey(const CatalogItem& item)
+    {
+        auto key = str::to_wstring(item.GetString());
+        if (item.HasPlural())
+        {
+            key += L'\x1f';
+            key += str::to_wstring(item.GetPluralString());
+        }
+        return key;
+    }
+
+    void Add(std::wstring&& key, const wxArrayString& translations)
+    {
+        auto r = m_entries.emplace(std::move(key), Entry());
+        auto& e = r.first->second;
+        if (r.second)
+            e.translations = translations;
+        else if (e.translations != translations)
+            e.ambiguous = true;
+    }
+
+    std::unordered_map<std::wstring, Entry> m_entries;
+};
+
+// Creates InMemoryMatches for @a catalog, or nullptr if there's nothing to use.
+std::shared_ptr<const InMemoryMatches> CreateInMemoryMatches(const CatalogPtr& catalog, std::vector<CatalogPtr> sources)
+{
+    auto sideloaded = catalog->GetSideloadedSourceData();
+    if (sideloaded && sideloaded->reference_file)
+        sources.push_back(sideloaded->reference_file);
+
+    auto matches = std::make_shared<InMemoryMatches>(catalog, sources);
+    if (matches->empty())
+        return nullptr;
+    return matches;
+}
+
+
+/// Pre-translation of (some) items of a single catalog
+struct PreTranslationJob
+{
+    CatalogPtr catalog;
+    std::vector<CatalogItemPtr> items;
+    std::shared_ptr<const InMemoryMatches> inMemory;
+
+    /// Number of pre-translated items, filled in by PreTranslateJobs()
+    int matches = 0;
+};
+
+/**
+    Pre-translates items of all @a jobs, which must be in the same language
+    pair, and fills in their matches counts.
+
+    Each unique source text is only looked up in the TM once, no matter in
+    how many items or catalogs it occurs, and the results are then applied
+    to all catalogs in parallel.
+
+    Throws on TM errors.
+ */
+void PreTranslateJobs(std::vector<PreTranslationJob>& jobs, PreTranslateOptions options,
+                      dispatch::cancellation_token_ptr cancellation_token)
+{
+    if (jobs.empty() || !Config::UseTM())
+        return;
+
+    size_t itemsCount = 0;
+    for (auto& job: jobs)
+        itemsCount += job.items.size();
+    if (!itemsCount)
+        return;
+
+    perf::ScopedTimer timer("pre-translation");
+    timer.SetItemsCount(itemsCount);
 
     TranslationMemory& tm = TranslationMemory::Get();
-    auto srclang = catalog->GetSourceLanguage();
-    auto lang = catalog->GetLanguage();
+    auto srclang = jobs.front().catalog->GetSourceLanguage();
+    auto lang = jobs.front().catalog->GetLanguage();
     const auto flags = options.flags;
 
     Progress top_progress(1);
@@ -91,67 +280,270 @@ int PreTranslateCatalogImpl(CatalogPtr catalog, const T& range, PreTranslateOpti
             return true;
         };
 
-    std::vector<dispatch::future<bool>> operations;
-    for (auto dt: range)
-    {
-        if (dt->IsTranslated() && !dt->IsFuzzy())
-            continue;
-
-        operations.push_back(dispatch::async([=,&tm]{
-            if (cancellation_token->is_cancelled())
+    // Ditto for plural items, @a singularForms is from GetSingularPluralForms():
+    auto process_plural_results = [=](CatalogItemPtr dt, const std::vector<bool>& singularForms,
+                                      const SuggestionsList& singularResults, const SuggestionsList& pluralResults) -> bool
+        {
+            // as with 2 forms, only fill in the plural if the singular was found:
+            bool foundSingular = false;
+            bool isFuzzy = false;
+            for (unsigned form = 0; form < singularForms.size(); form++)
+            {
+                if (singularForms[form] && process_results(dt, form, singularResults))
+                {
+                    foundSingular = true;
+                    isFuzzy = isFuzzy || dt->IsFuzzy();
+                }
+            }
+            if (!foundSingular)
                 return false;
 
-            auto results = tm.Search(srclang, lang, str::to_wstring(dt->GetString()));
-            bool ok = process_results(dt, 0, results);
+            unsigned filledFromPlural = 0;
+            for (unsigned form = 0; form < singularForms.size(); form++)
+            {
+                if (!singularForms[form] && process_results(dt, form, pluralResults))
+                {
+                    filledFromPlural++;
+                    isFuzzy = isFuzzy || dt->IsFuzzy();
+                }
+            }
+
+            // With more than 2 forms, the TM only knows one of them and using it for all
+            // others is just a starting point, so the translation must be reviewed:
+            if (filledFromPlural > 1)
+                isFuzzy = true;
+            dt->SetFuzzy(isFuzzy);
+
+            return true;
+        };
 
-            if (ok && dt->HasPlural())
+    // Items left for the TM, with indexes of their texts in `sources`:
+    static const size_t NO_SOURCE = size_t(-1);
+    struct TodoItem
+    {
+        CatalogItemPtr item;
+        size_t singular, plural;
+    };
+    std::vector<std::vector<TodoItem>> todo(jobs.size());
+    std::vector<std::wstring> sources;
+    std::unordered_map<std::wstring, size_t> sourcesIndex;
+    auto add_source = [&](std::wstring&& text)
+    {
+        auto r = sourcesIndex.emplace(text, sources.size());
+        if (r.second)
+            sources.push_back(std::move(text));
+        return r.first->second;
+    };
+
+    // For plural items, both the singular and plural strings are looked up
+    // and mapped to the forms according to the language's plural rules. Note
+    // that PluralFormsExpr isn't thread-safe, so this is evaluated upfront.
+    std::vector<std::vector<bool>> pluralForms(jobs.size());
+
+    // Strings already translated in other files that are loaded in memory
+    // are the cheapest to pre-translate and are filled in first, the rest
+    // is left for the TM:
+    for (size_t j = 0; j < jobs.size(); j++)
+    {
+        auto& job = jobs[j];
+        pluralForms[j] = GetSingularPluralForms(job.catalog);
+        const bool searchPlurals = pluralForms[j].size() > 1;
+
+        for (auto& dt: job.items)
+        {
+            if (dt->IsTranslated() && !dt->IsFuzzy())
+                continue;
+
+            if (job.inMemory)
             {
-                switch (lang.nplurals())
+                auto results = job.inMemory->Lookup(*dt);
+                if (!results.empty())
                 {
-                    case 2:  // "simple" English-like plurals
+                    bool applied = false;
+                    bool isFuzzy = false;
+                    for (unsigned form = 0; form < results.size(); form++)
+                    {
+                        if (process_results(dt, form, results[form]))
+                        {
+                            applied = true;
+                            isFuzzy = isFuzzy || dt->IsFuzzy();
+                        }
+                    }
+                    if (applied)
                     {
-                        auto results_plural = tm.Search(srclang, lang, str::to_wstring(dt->GetPluralString()));
-                        process_results(dt, 1, results_plural);
+                        dt->SetFuzzy(isFuzzy);
+                        job.matches++;
+                        continue;
                     }
-                    case 1:  // nothing else to do
-                    default: // not supported
-                        break;
                 }
             }
 
-            return ok;
-        }));
+            TodoItem t{dt, add_source(str::to_wstring(dt->GetString())), NO_SOURCE};
+            if (searchPlurals && dt->HasPlural())
+                t.plural = add_source(str::to_wstring(dt->GetPluralString()));
+            todo[j].push_back(std::move(t));
+        }
     }
 
-    Progress progress((int)operations.size());
-    progress.message(_(L"Pre-translating from translation memory…"));
+    if (cancellation_token->is_cancelled())
+        return;
 
-    int matches = 0;
-    for (auto& op: operations)
+    // Unique texts are looked up in batches: this amortizes the cost of
+    // opening the TM index for searching, while still processing the batches
+    // in parallel. Each batch fills its own part of `results`.
+    std::vector<SuggestionsList> results(sources.size());
+    const size_t batchesCount = (sources.size() + PRETRANSLATE_BATCH_SIZE - 1) / PRETRANSLATE_BATCH_SIZE;
+
+    // Completed batches are reported back through this queue, in whatever
+    // order they finish in, so that a single slow batch doesn't hold up
+    // progress reporting or submitting of more work.
+    struct BatchResult
     {
-        if (cancellation_token->is_cancelled())
-            break;
+        size_t size = 0;
+        std::exception_ptr error;
+    };
+    struct Pipeline
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<BatchResult> done;
+    };
+    auto pipeline = std::make_shared<Pipeline>();
+
+    auto submit_batch = [&](size_t batchIndex)
+    {
+        const size_t begin = batchIndex * PRETRANSLATE_BATCH_SIZE;
+        const size_t end = std::min(begin + PRETRANSLATE_BATCH_SIZE, sources.size());
 
-        if (op.get())
+        dispatch::async(dispatch::priority::bulk, [=,&tm,&sources,&results]{
+            BatchResult r;
+            r.size = end - begin;
+            try
+            {
+                if (!cancellation_token->is_cancelled())
+                {
+                    std::vector<std::wstring> batch(sources.begin() + begin, sources.begin() + end);
+                    auto found = tm.SearchBatch(srclang, lang, batch);
+                    std::move(found.begin(), found.end(), results.begin() + begin);
+                }
+            }
+            catch (...)
+            {
+                r.error = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(pipeline->mutex);
+            pipeline->done.push_back(r);
+            pipeline->cv.notify_one();
+        });
+    };
+
+    // Only a limited number of batches is in flight at any time, so that
+    // interactive work (e.g. TM suggestions for the current item) isn't stuck
+    // in the background queue behind all of them. A new batch is submitted
+    // whenever one completes.
+    const size_t maxInFlight = std::max<size_t>(2, std::thread::hardware_concurrency());
+
+    size_t submitted = 0;
+    for (; submitted < std::min(batchesCount, maxInFlight); submitted++)
+        submit_batch(submitted);
+
+    Progress progress((int)sources.size());
+    progress.message(_(L"Pre-translating from translation memory…"));
+
+    std::exception_ptr error;
+    for (size_t completed = 0; completed < submitted; completed++)
+    {
+        BatchResult r;
         {
-            matches++;
-            progress.message(wxString::Format(wxPLURAL("Pre-translated %u string", "Pre-translated %u strings", matches), matches));
+            std::unique_lock<std::mutex> lock(pipeline->mutex);
+            pipeline->cv.wait(lock, [&pipeline]{ return !pipeline->done.empty(); });
+            r = pipeline->done.front();
+            pipeline->done.pop_front();
         }
 
-        progress.increment();
+        if (r.error && !error)
+            error = r.error;
+
+        // Stop feeding the pipeline on cancellation or error, but keep draining
+        // it, so that no job touches the results after returning:
+        if (!error && !cancellation_token->is_cancelled() && submitted < batchesCount)
+            submit_batch(submitted++);
+
+        progress.increment((int)r.size);
     }
 
-    return matches;
+    if (error)
+        std::rethrow_exception(error);
+
+    // Fan the results out to all catalogs; catalogs are independent of each
+    // other, so they can be modified in parallel:
+    std::vector<dispatch::future<int>> applying;
+    for (size_t j = 0; j < jobs.size(); j++)
+    {
+        applying.push_back(dispatch::async([&,j]
+        {
+            int matches = 0;
+            for (auto& t: todo[j])
+            {
+                // don't modify anything once cancelled:
+                if (cancellation_token->is_cancelled())
+                    break;
+                if (t.plural != NO_SOURCE)
+                {
+                    if (process_plural_results(t.item, pluralForms[j], results[t.singular], results[t.plural]))
+                        matches++;
+                }
+                else
+                {
+                    if (process_results(t.item, 0, results[t.singular]))
+                        matches++;
+                }
+            }
+            return matches;
+        }));
+    }
+
+    int matches = 0;
+    for (size_t j = 0; j < jobs.size(); j++)
+    {
+        jobs[j].matches += applying[j].get();
+        matches += jobs[j].matches;
+    }
+    progress.message(wxString::Format(wxPLURAL("Pre-translated %u string", "Pre-translated %u strings", matches), matches));
+}
+
+} // anonymous namespace
+
+
+template<typename T>
+int PreTranslateCatalogImpl(CatalogPtr catalog, const T& range, PreTranslateOptions options,
+                            std::shared_ptr<const InMemoryMatches> inMemory,
+                            dispatch::cancellation_token_ptr cancellation_token)
+{
+    if (range.empty())
+        return 0;
+
+    std::vector<PreTranslationJob> jobs(1);
+    jobs[0].catalog = catalog;
+    jobs[0].items.assign(range.begin(), range.end());
+    jobs[0].inMemory = inMemory;
+
+    PreTranslateJobs(jobs, options, cancellation_token);
+    return jobs[0].matches;
 }
 
 template<typename T>
 int PreTranslateCatalog(wxWindow *window, CatalogPtr catalog, const T& range, const PreTranslateOptions& options)
 {
+    // other open files are only safe to access here, on the main thread:
+    auto inMemory = CreateInMemoryMatches(catalog, PoeditFrame::GetOpenCatalogs());
+
     int matches = 0;
     ProgressWindow::RunCancellableTask(window, _(L"Pre-translating…"),
     [=,&matches](dispatch::cancellation_token_ptr cancellationToken)
     {
-        matches = PreTranslateCatalogImpl(catalog, range, options, cancellationToken);
+        matches = PreTranslateCatalogImpl(catalog, range, options, inMemory, cancellationToken);
     });
 
     return matches;
@@ -162,40 +554,101 @@ int PreTranslateCatalog(wxWindow *window, CatalogPtr catalog, const PreTranslate
     return PreTranslateCatalog(window, catalog, catalog->items(), options);
 }
 
+int PreTranslateCatalogHeadless(CatalogPtr catalog, const PreTranslateOptions& options)
+{
+    return PreTranslateCatalogImpl(catalog, catalog->items(), options,
+                                   CreateInMemoryMatches(catalog, {}),
+                                   std::make_shared<dispatch::cancellation_token>());
+}
 
-void PreTranslateWithUI(wxWindow *window, PoeditListCtrl *list, CatalogPtr catalog, std::function<void()> onChangesMade)
+bool CanPreTranslateCatalog(const CatalogPtr& catalog)
 {
-    if (catalog->UsesSymbolicIDsForSource())
+    return catalog->HasCapability(Catalog::Cap::Translations) &&
+           !catalog->UsesSymbolicIDsForSource() &&
+           catalog->GetSourceLanguage().IsValid();
+}
+
+std::vector<int> PreTranslateCatalogsHeadless(const std::vector<CatalogPtr>& catalogs,
+                                              const PreTranslateOptions& options,
+                                              dispatch::cancellation_token_ptr cancellationToken)
+{
+    if (!cancellationToken)
+        cancellationToken = std::make_shared<dispatch::cancellation_token>();
+
+    std::vector<int> matches(catalogs.size(), 0);
+
+    // Catalogs are grouped by language pair, because that's what TM lookups
+    // depend on, and by plural forms, so that translations of plural items
+    // can be shared within the group:
+    std::map<std::string, std::vector<size_t>> groups;
+    for (size_t i = 0; i < catalogs.size(); i++)
     {
-        wxWindowPtr<wxMessageDialog> resultsDlg(
-            new wxMessageDialog
-                (
-                    window,
-                    _("Cannot pre-translate without source text."),
-                    _("Pre-translate"),
-                    wxOK | wxICON_ERROR
-                )
-        );
-        resultsDlg->SetExtendedMessage(_(L"Pre-translation requires that source text is available. It doesn’t work if only IDs without the actual text are used."));
-        resultsDlg->ShowWindowModalThenDo([resultsDlg](int){});
-        return;
+        auto& cat = catalogs[i];
+        if (!CanPreTranslateCatalog(cat))
+            continue;
+        std::string key = cat->GetSourceLanguage().Code();
+        key += '\x1f';
+        key += cat->GetLanguage().Code();
+        key += '\x1f';
+        key += GetPluralFormsExpr(cat).str();
+        groups[key].push_back(i);
     }
-    else if (!catalog->GetSourceLanguage().IsValid())
+
+    Progress progress((int)groups.size());
+
+    for (auto& g: groups)
     {
-        wxWindowPtr<wxMessageDialog> resultsDlg(
-            new wxMessageDialog
-                (
-                    window,
-                    _("Cannot pre-translate from unknown language."),
-                    _("Pre-translate"),
-                    wxOK | wxICON_ERROR
-                )
-        );
-        resultsDlg->SetExtendedMessage(_(L"Pre-translation requires that source text’s language is known. Poedit couldn’t detect it in this file."));
-        resultsDlg->ShowWindowModalThenDo([resultsDlg](int){});
-        return;
+        if (cancellationToken->is_cancelled())
+            break;
+
+        Progress groupProgress(1, progress, 1);
+
+        auto& first = catalogs[g.second.front()];
+        std::vector<CatalogPtr> sources;
+        std::vector<PreTranslationJob> jobs;
+        for (auto i: g.second)
+        {
+            auto& cat = catalogs[i];
+            sources.push_back(cat);
+            auto sideloaded = cat->GetSideloadedSourceData();
+            if (sideloaded && sideloaded->reference_file &&
+                std::find(sources.begin(), sources.end(), sideloaded->reference_file) == sources.end())
+            {
+                sources.push_back(sideloaded->reference_file);
+            }
+
+            PreTranslationJob job;
+            job.catalog = cat;
+            job.items = cat->items();
+            jobs.push_back(std::move(job));
+        }
+
+        // Translations are shared by all of the group's files, as if they
+        // were all open in the editor. They're indexed before anything is
+        // pre-translated, so only the files' existing translations are used.
+        std::shared_ptr<const InMemoryMatches> inMemory =
+            std::make_shared<InMemoryMatches>(first->GetSourceLanguage(), first->GetLanguage(), GetPluralFormsExpr(first), sources);
+        if (inMemory->empty())
+            inMemory.reset();
+        for (auto& job: jobs)
+            job.inMemory = inMemory;
+
+        PreTranslateJobs(jobs, options, cancellationToken);
+
+        for (size_t j = 0; j < jobs.size(); j++)
+            matches[g.second[j]] = jobs[j].matches;
     }
 
+    return matches;
+}
+
+
+namespace
+{
+
+/// Shows dialog for choosing pre-translation options and calls @a onAccepted with them unless cancelled.
+void AskForPreTranslateOptions(wxWindow *window, std::function<void(const PreTranslateOptions&)> onAccepted)
+{
     wxWindowPtr<wxDialog> dlg(new wxDialog(window, wxID_ANY, _("Pre-translate"), wxDefaultPosition, wxSize(PX(440), -1)));
     auto topsizer = new wxBoxSizer(wxVERTICAL);
     auto sizer = new wxBoxSizer(wxVERTICAL);
@@ -252,7 +705,7 @@ void PreTranslateWithUI(wxWindow *window, PoeditListCtrl *list, CatalogPtr catal
         noFuzzy->SetValue(settings.exactNotFuzzy);
     }
 
-    dlg->ShowWindowModalThenDo([catalog,window,list,onlyExact,noFuzzy,onChangesMade,dlg](int retcode)
+    dlg->ShowWindowModalThenDo([onlyExact,noFuzzy,onAccepted,dlg](int retcode)
     {
         if (retcode != wxID_OK)
             return;
@@ -262,14 +715,56 @@ void PreTranslateWithUI(wxWindow *window, PoeditListCtrl *list, CatalogPtr catal
         settings.exactNotFuzzy = noFuzzy->GetValue();
         Config::PretranslateSettings(settings);
 
-        int matches = 0;
-
         PreTranslateOptions options;
         if (settings.onlyExact)
             options.flags |= PreTranslate_OnlyExact;
         if (settings.exactNotFuzzy)
             options.flags |= PreTranslate_ExactNotFuzzy;
 
+        onAccepted(options);
+    });
+}
+
+} // anonymous namespace
+
+
+void PreTranslateWithUI(wxWindow *window, PoeditListCtrl *list, CatalogPtr catalog, std::function<void()> onChangesMade)
+{
+    if (catalog->UsesSymbolicIDsForSource())
+    {
+        wxWindowPtr<wxMessageDialog> resultsDlg(
+            new wxMessageDialog
+                (
+                    window,
+                    _("Cannot pre-translate without source text."),
+                    _("Pre-translate"),
+                    wxOK | wxICON_ERROR
+                )
+        );
+        resultsDlg->SetExtendedMessage(_(L"Pre-translation requires that source text is available. It doesn’t work if only IDs without the actual text are used."));
+        resultsDlg->ShowWindowModalThenDo([resultsDlg](int){});
+        return;
+    }
+    else if (!catalog->GetSourceLanguage().IsValid())
+    {
+        wxWindowPtr<wxMessageDialog> resultsDlg(
+            new wxMessageDialog
+                (
+                    window,
+                    _("Cannot pre-translate from unknown language."),
+                    _("Pre-translate"),
+                    wxOK | wxICON_ERROR
+                )
+        );
+        resultsDlg->SetExtendedMessage(_(L"Pre-translation requires that source text’s language is known. Poedit couldn’t detect it in this file."));
+        resultsDlg->ShowWindowModalThenDo([resultsDlg](int){});
+        return;
+    }
+
+    AskForPreTranslateOptions(window, [catalog,window,list,onChangesMade](const PreTranslateOptions& options)
+    {
+        int matches = 0;
+
         if (list->HasMultipleSelection())
         {
             matches = PreTranslateCatalog(window, catalog, list->GetSelectedCatalogItems(), options);
@@ -313,3 +808,137 @@ void PreTranslateWithUI(wxWindow *window, PoeditListCtrl *list, CatalogPtr catal
         resultsDlg->ShowWindowModalThenDo([resultsDlg](int){});
     });
 }
+
+
+void PreTranslateProjectWithUI(wxWindow *window, const std::vector<wxString>& files, std::function<void()> onChangesMade)
+{
+    AskForPreTranslateOptions(window, [window,files,onChangesMade](const PreTranslateOptions& options)
+    {
+        int matches = 0;
+        int modifiedFiles = 0;
+        int failedFiles = 0;
+        bool completed = false;
+
+        ProgressWindow::RunCancellableTask(window, _(L"Pre-translating…"),
+        [&](dispatch::cancellation_token_ptr cancellationToken)
+        {
+            // rough relative durations of the stages:
+            const int LOAD_WEIGHT = 10, PRETRANSLATE_WEIGHT = 80, SAVE_WEIGHT = 10;
+            Progress progress(LOAD_WEIGHT + PRETRANSLATE_WEIGHT + SAVE_WEIGHT);
+
+            std::vector<CatalogPtr> catalogs;
+            {
+                Progress subtask((int)files.size(), progress, LOAD_WEIGHT);
+                subtask.message(_(L"Loading translation files…"));
+
+                std::vector<dispatch::future<CatalogPtr>> loading;
+                for (auto& f: files)
+                {
+                    loading.push_back(dispatch::async([f,&subtask]
+                    {
+                        // suppress error messages, files that can't be loaded are just skipped
+                        wxLogNull nullLog;
+                        CatalogPtr cat;
+                        try
+                        {
+                            cat = Catalog::Create(f);
+                        }
+                        catch (...) {}
+                        subtask.increment();
+                        return cat;
+                    }));
+                }
+                for (auto& l: loading)
+                {
+                    auto cat = l.get();
+                    if (cat)
+                        catalogs.push_back(cat);
+                    else
+                        failedFiles++;
+                }
+            }
+
+            std::vector<int> fileMatches;
+            {
+                Progress subtask(1, progress, PRETRANSLATE_WEIGHT);
+                fileMatches = PreTranslateCatalogsHeadless(catalogs, options, cancellationToken);
+            }
+            if (cancellationToken->is_cancelled())
+                return;
+
+            Progress subtask((int)catalogs.size(), progress, SAVE_WEIGHT);
+            subtask.message(_(L"Saving files…"));
+
+            // saving of individual files is independent, so do it in parallel:
+            std::vector<dispatch::future<bool>> saving;
+            for (size_t i = 0; i < catalogs.size(); i++)
+            {
+                if (!fileMatches[i])
+                {
+                    subtask.increment();
+                    continue;
+                }
+                matches += fileMatches[i];
+                modifiedFiles++;
+                saving.push_back(dispatch::async([cat=catalogs[i],&subtask]
+                {
+                    Catalog::ValidationResults validation_results;
+                    Catalog::CompilationStatus mo_status;
+                    bool ok = false;
+                    try
+                    {
+                        ok = cat->Save(cat->GetFileName(), false, validation_results, mo_status);
+                    }
+                    catch (...) {}
+                    subtask.increment();
+                    return ok;
+                }));
+            }
+            for (auto& s: saving)
+            {
+                if (!s.get())
+                    failedFiles++;
+            }
+            completed = true;
+        });
+
+        if (modifiedFiles)
+            onChangesMade();
+        // nothing to report if cancelled or failed (errors were already shown):
+        if (!completed)
+            return;
+
+        wxString msg, details;
+        if (matches)
+        {
+            msg = wxString::Format(wxPLURAL("%d entry was pre-translated.",
+                                            "%d entries were pre-translated.",
+                                            matches), matches);
+            details = wxString::Format(wxPLURAL("%d file was modified.", "%d files were modified.", modifiedFiles), modifiedFiles);
+            details += " ";
+            details += _("The translations were marked as needing work, because they may be inaccurate. You should review them for correctness.");
+        }
+        else
+        {
+            msg = _("No entries could be pre-translated.");
+            details = _(L"The TM doesn’t contain any strings similar to the content of these files. It is only effective for semi-automatic translations after Poedit learns enough from files that you translated manually.");
+        }
+        if (failedFiles)
+        {
+            details += "\n\n";
+            details += wxString::Format(wxPLURAL(L"%d file couldn’t be loaded or saved.", L"%d files couldn’t be loaded or saved.", failedFiles), failedFiles);
+        }
+
+        wxWindowPtr<wxMessageDialog> resultsDlg(
+            new wxMessageDialog
+                (
+                    window,
+                    msg,
+                    _("Pre-translate"),
+                    wxOK | (failedFiles ? wxICON_WARNING : wxICON_INFORMATION)
+                )
+        );
+        resultsDlg->SetExtendedMessage(details);
+        resultsDlg->ShowWindowModalThenDo([resultsDlg](int){});
+    });
+}
@@ -32,6 +32,7 @@
 #include <wx/window.h>
 
 #include <functional>
+#include <vector>
 
 
 /// Flags for pre-translation functions
@@ -70,6 +71,33 @@ int PreTranslateCatalog(wxWindow *window, CatalogPtr catalog, const T& range, co
  */
 int PreTranslateCatalog(wxWindow *window, CatalogPtr catalog, const PreTranslateOptions& options);
 
+/**
+    Pre-translate all items in the catalog without showing any UI.
+
+    Returns number of pre-translated (i.e. changed) items.
+ */
+int PreTranslateCatalogHeadless(CatalogPtr catalog, const PreTranslateOptions& options);
+
+/// Returns whether @a catalog can be pre-translated at all (has source text etc.).
+bool CanPreTranslateCatalog(const CatalogPtr& catalog);
+
+/**
+    Pre-translate all items in multiple catalogs at once, e.g. all files of
+    a project, without showing any UI.
+
+    Catalogs are grouped by language and every unique source string is only
+    looked up in the TM once for the whole group; the results are then
+    applied to all of the group's catalogs in parallel. Existing translations
+    in the group's catalogs are used for the others too.
+
+    Catalogs for which CanPreTranslateCatalog() is false are skipped.
+
+    Returns number of pre-translated items for each catalog. May throw.
+ */
+std::vector<int> PreTranslateCatalogsHeadless(const std::vector<CatalogPtr>& catalogs,
+                                              const PreTranslateOptions& options,
+                                              dispatch::cancellation_token_ptr cancellationToken = nullptr);
+
 /**
     Show UI for choosing pre-translation choices, then proceed with
     pre-translation unless cancelled (in which case false is returned).
@@ -84,4 +112,15 @@ void PreTranslateWithUI(wxWindow *window, PoeditListCtrl *list,
                         CatalogPtr catalog,
                         std::function<void()> onChangesMade);
 
+/**
+    Show UI for choosing pre-translation choices, then pre-translate all
+    catalog @a files together (see PreTranslateCatalogsHeadless()) and save
+    the modified ones.
+
+    The files must not be open in the editor. @a onChangesMade is called if
+    any of them were modified.
+ */
+void PreTranslateProjectWithUI(wxWindow *window, const std::vector<wxString>& files,
+                               std::function<void()> onChangesMade);
+
 #endif // Poedit_pretranslate_h
@@ -27,9 +27,11 @@
 
 #include "customcontrols.h"
 #include "hidpi.h"
+#include "perf_trace.h"
 #include "utility.h"
 
 #include <atomic>
+#include <chrono>
 #include <mutex>
 #include <set>
 
@@ -39,6 +41,7 @@
 #include <wx/log.h>
 #include <wx/gauge.h>
 #include <wx/stattext.h>
+#include <wx/timer.h>
 #include <wx/dialog.h>
 #include <wx/sizer.h>
 #include <wx/button.h>
@@ -182,6 +185,8 @@ void Progress::init(impl *implObj)
 
 Progress::~Progress()
 {
+    stage_finished();
+
     ms_threadImplicitParent = m_previousImplicitParent;
     if (auto p = m_impl->parent())
         p->remove_child(m_impl);
@@ -192,9 +197,26 @@ Progress::~Progress()
 
 void Progress::message(const wxString& text)
 {
+    // stages of long operations are recorded as seen by the user, so that
+    // profiles sent to us are easy to match with what they describe:
+    stage_finished();
+    if (perf::IsEnabled())
+    {
+        m_stage = text;
+        m_stageStart = perf::Clock::now();
+    }
+
     m_impl->message(text);
 }
 
+void Progress::stage_finished()
+{
+    if (m_stage.empty())
+        return;
+    perf::RecordEvent(m_stage, m_stageStart);
+    m_stage.clear();
+}
+
 void Progress::increment(int count)
 {
     m_impl->increment(count);
@@ -226,10 +248,130 @@ ProgressObserver::~ProgressObserver()
 }
 
 
+/**
+    Collects progress updates reported by background threads and publishes
+    them to the window on the main thread, at most once per PUBLISH_INTERVAL.
+
+    Jobs may report progress for every processed item; forwarding each of
+    them to the main thread would flood the event queue and slow the job
+    down. Instead, only the latest message and progress value are kept and
+    at most one main thread call is pending at any time. The final state is
+    always published, possibly with a delay of up to PUBLISH_INTERVAL.
+ */
+class ProgressWindow::CoalescedUpdates : public std::enable_shared_from_this<ProgressWindow::CoalescedUpdates>
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    static constexpr std::chrono::milliseconds PUBLISH_INTERVAL{33}; // ~30 updates per second
+
+    CoalescedUpdates(ProgressWindow *window) : m_window(window)
+    {
+        m_timer.Bind(wxEVT_TIMER, [=](wxTimerEvent&){ flush(); });
+    }
+
+    /// Must be called on the main thread before the window is destroyed
+    void detach()
+    {
+        m_window = nullptr;
+        m_timer.Stop();
+    }
+
+    // These may be called from any thread:
+
+    void message(const wxString& text)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_message = text;
+        m_hasMessage = true;
+        schedule();
+    }
+
+    void progress(double completedFraction)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_completedFraction = completedFraction;
+        m_hasProgress = true;
+        schedule();
+    }
+
+private:
+    // Called with m_mutex locked
+    void schedule()
+    {
+        if (m_scheduled)
+            return;
+        m_scheduled = true;
+        auto self = shared_from_this();
+        dispatch::on_main([self]{ self->flush_when_due(); });
+    }
+
+    void flush_when_due()
+    {
+        auto elapsed = Clock::now() - m_lastPublished;
+        if (elapsed < PUBLISH_INTERVAL)
+        {
+            if (m_window && !m_timer.IsRunning())
+            {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(PUBLISH_INTERVAL - elapsed);
+                m_timer.StartOnce(std::max(1, (int)remaining.count()));
+            }
+            return;
+        }
+        flush();
+    }
+
+    void flush()
+    {
+        wxString message;
+        double completedFraction;
+        bool hasMessage, hasProgress;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            message = m_message;
+            completedFraction = m_completedFraction;
+            hasMessage = m_hasMessage;
+            hasProgress = m_hasProgress;
+            m_hasMessage = m_hasProgress = false;
+            m_scheduled = false;
+        }
+        m_lastPublished = Clock::now();
+
+        if (!m_window)
+            return;
+
+        // don't overwrite "Cancelling..." with a message reported before cancellation:
+        auto& token = m_window->m_cancellationToken;
+        if (hasMessage && !(token && token->is_cancelled()))
+            m_window->m_message->SetLabel(message);
+        if (hasProgress)
+        {
+            const int range = m_window->PROGRESS_BAR_RANGE;
+            auto value = std::min((int)std::lround(completedFraction * range), range);
+            m_window->m_gauge->SetValue(value);
+        }
+    }
+
+    // accessed on the main thread only:
+    ProgressWindow *m_window;
+    wxTimer m_timer;
+    Clock::time_point m_lastPublished;
+
+    std::mutex m_mutex;
+    bool m_scheduled = false;
+    wxString m_message;
+    bool m_hasMessage = false;
+    double m_completedFraction = 0;
+    bool m_hasProgress = false;
+};
+
+constexpr std::chrono::milliseconds ProgressWindow::CoalescedUpdates::PUBLISH_INTERVAL;
+
+
 ProgressWindow::ProgressWindow(wxWindow *parent, const wxString& title, dispatch::cancellation_token_ptr cancellationToken)
     : TitlelessDialog(parent, wxID_ANY, title, wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE & ~wxCLOSE_BOX)
 {
     m_cancellationToken = cancellationToken;
+    m_updates = std::make_shared<CoalescedUpdates>(this);
 
     auto sizer = new wxBoxSizer(wxVERTICAL);
     auto topsizer = new wxBoxSizer(wxHORIZONTAL);
@@ -282,24 +424,22 @@ ProgressWindow::ProgressWindow(wxWindow *parent, const wxString& title, dispatch
         CenterOnParent();
 }
 
+ProgressWindow::~ProgressWindow()
+{
+    m_updates->detach();
+}
+
 void ProgressWindow::update_message(const wxString& text)
 {
     if (m_cancellationToken && m_cancellationToken->is_cancelled())
         return;
 
-    dispatch::on_main([=]
-    {
-        m_message->SetLabel(text);
-    });
+    m_updates->message(text);
 }
 
 void ProgressWindow::update_progress(double completedFraction)
 {
-    dispatch::on_main([=]
-    {
-        auto value = std::min((int)std::lround(completedFraction * PROGRESS_BAR_RANGE), PROGRESS_BAR_RANGE);
-        m_gauge->SetValue(value);
-    });
+    m_updates->progress(completedFraction);
 }
 
 
@@ -33,6 +33,7 @@
 #include <wx/string.h>
 #include <wx/windowptr.h>
 
+#include <chrono>
 #include <memory>
 
 class WXDLLIMPEXP_FWD_CORE wxStaticBitmap;
@@ -63,6 +64,11 @@ private:
     class impl;
     std::shared_ptr<impl> m_impl;
 
+    // the current stage described by message(), recorded for perf tracing
+    wxString m_stage;
+    std::chrono::steady_clock::time_point m_stageStart;
+    void stage_finished();
+
     static thread_local std::weak_ptr<impl> ms_threadImplicitParent;
     std::weak_ptr<impl> m_previousImplicitParent;
 
@@ -100,6 +106,8 @@ protected:
     ProgressWindow(wxWindow *parent, const wxString& title,
                    dispatch::cancellation_token_ptr cancellationToken = dispatch::cancellation_token_ptr());
 
+    ~ProgressWindow();
+
     template<typename TBackgroundJob, typename TCompletion>
     void DoRunTask(const TBackgroundJob& task, const TCompletion& completionHandler, bool forceModal = false)
     {
@@ -209,6 +217,10 @@ protected:
     void OnCancel(wxCommandEvent&);
 
 private:
+    // Coalesces updates from background threads into at most a few per second:
+    class CoalescedUpdates;
+    std::shared_ptr<CoalescedUpdates> m_updates;
+
     std::shared_ptr<Progress> m_progress;
 
     wxStaticBitmap *m_image;
@@ -0,0 +1,770 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2023 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "project_search.h"
+
+#include "catalog.h"
+#include "edframe.h"
+#include "findframe.h"
+#include "hidpi.h"
+#include "perf_trace.h"
+#include "str_helpers.h"
+#include "utility.h"
+
+#include <wx/file.h>
+#include <wx/filename.h>
+#include <wx/listctrl.h>
+#include <wx/log.h>
+#include <wx/panel.h>
+#include <wx/sizer.h>
+#include <wx/srchctrl.h>
+#include <wx/stattext.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+
+
+namespace
+{
+
+wxString gs_cacheDir;
+
+// Increment when changing the format of stored indexes:
+const uint32_t INDEX_MAGIC = 0x58495350; // "PSIX"
+const uint32_t INDEX_VERSION = 1;
+
+// Results are passed to the callback in batches of this size (or smaller,
+// if they take longer to find), so that the first ones show up immediately:
+const size_t RESULTS_BATCH_SIZE = 200;
+const auto RESULTS_BATCH_INTERVAL = std::chrono::milliseconds(50);
+
+class BinaryWriter
+{
+public:
+    void UInt32(uint32_t v) { m_data.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    void Int64(int64_t v) { m_data.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+
+    void String(const std::wstring& s)
+    {
+        m_utf8.clear();
+        str::append_utf8(m_utf8, s);
+        UInt32((uint32_t)m_utf8.size());
+        m_data += m_utf8;
+    }
+
+    const std::string& data() const { return m_data; }
+
+private:
+    std::string m_data, m_utf8;
+};
+
+class BinaryReader
+{
+public:
+    BinaryReader(const char *data, size_t size) : m_pos(data), m_end(data + size) {}
+
+    bool UInt32(uint32_t& v) { return Read(&v, sizeof(v)); }
+    bool Int64(int64_t& v) { return Read(&v, sizeof(v)); }
+
+    bool String(std::wstring& s)
+    {
+        uint32_t len;
+        if (!UInt32(len) || len > size_t(m_end - m_pos))
+            return false;
+        str::to_wstring(std::string_view(m_pos, len), s);
+        m_pos += len;
+        return true;
+    }
+
+private:
+    bool Read(void *out, size_t len)
+    {
+        if (len > size_t(m_end - m_pos))
+            return false;
+        memcpy(out, m_pos, len);
+        m_pos += len;
+        return true;
+    }
+
+    const char *m_pos, *m_end;
+};
+
+std::wstring Join(const wxArrayString& parts)
+{
+    std::wstring out;
+    for (auto& p: parts)
+    {
+        if (p.empty())
+            continue;
+        if (!out.empty())
+            out += L'\n';
+        out += str::to_wstring(p);
+    }
+    return out;
+}
+
+} // anonymous namespace
+
+
+struct ProjectSearchIndex::FileData
+{
+    struct Entry
+    {
+        int line;
+        // plural forms and multiple comments are separated with newlines:
+        std::wstring source, translation, comments;
+    };
+
+    wxString path;
+    int64_t mtime = 0;
+    int64_t size = 0;
+    std::vector<Entry> entries;
+
+    // folded fields of entries, separated by FIELDS_SEPARATOR:
+    std::vector<std::wstring> folded;
+    // sorted indexes of entries containing given trigram:
+    std::unordered_map<CatalogSearchIndex::Trigram, std::vector<uint32_t>> postings;
+
+    static std::shared_ptr<FileData> LoadCatalog(const wxString& path, int64_t mtime, int64_t size);
+    void BuildIndex();
+};
+
+
+struct ProjectSearchIndex::Data
+{
+    std::vector<std::shared_ptr<const FileData>> files;
+};
+
+
+std::shared_ptr<ProjectSearchIndex::FileData>
+ProjectSearchIndex::FileData::LoadCatalog(const wxString& path, int64_t mtime, int64_t size)
+{
+    auto fd = std::make_shared<FileData>();
+    fd->path = path;
+    fd->mtime = mtime;
+    fd->size = size;
+
+    // broken files are indexed as empty, so that they aren't loaded again
+    // until they change; errors are shown when they are opened
+    wxLogNull null;
+    try
+    {
+        auto cat = Catalog::Create(path);
+        if (cat)
+        {
+            fd->entries.reserve(cat->GetCount());
+            for (auto& item: cat->items())
+            {
+                Entry e;
+                e.line = item->GetLineNumber();
+                e.source = str::to_wstring(item->GetString());
+                if (item->HasPlural())
+                    e.source += L'\n' + str::to_wstring(item->GetPluralString());
+                e.translation = Join(item->GetTranslations());
+                e.comments = Join(item->GetExtractedComments());
+                if (item->HasComment())
+                {
+                    if (!e.comments.empty())
+                        e.comments += L'\n';
+                    e.comments += str::to_wstring(item->GetComment());
+                }
+                fd->entries.push_back(std::move(e));
+            }
+        }
+    }
+    catch (...)
+    {
+        fd->entries.clear();
+    }
+
+    fd->BuildIndex();
+    return fd;
+}
+
+
+void ProjectSearchIndex::FileData::BuildIndex()
+{
+    const auto sep = CatalogSearchIndex::FIELDS_SEPARATOR;
+
+    folded.resize(entries.size());
+    postings.clear();
+
+    std::vector<CatalogSearchIndex::Trigram> trigrams;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        auto& e = entries[i];
+        auto& f = folded[i];
+        f = CatalogSearchIndex::Fold(e.source);
+        f += sep;
+        f += CatalogSearchIndex::Fold(e.translation);
+        f += sep;
+        f += CatalogSearchIndex::Fold(e.comments);
+
+        trigrams.clear();
+        CatalogSearchIndex::AddTrigrams(f, trigrams);
+        std::sort(trigrams.begin(), trigrams.end());
+        trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+        for (auto t: trigrams)
+            postings[t].push_back((uint32_t)i);
+    }
+}
+
+
+/*static*/ void ProjectSearchIndex::SetCacheDir(const wxString& dir)
+{
+    gs_cacheDir = dir;
+}
+
+
+/*static*/ std::shared_ptr<ProjectSearchIndex> ProjectSearchIndex::Get(const wxString& projectKey)
+{
+    static std::map<wxString, std::weak_ptr<ProjectSearchIndex>> s_instances;
+
+    auto& weak = s_instances[projectKey];
+    auto index = weak.lock();
+    if (!index)
+    {
+        wxString filename;
+        if (!gs_cacheDir.empty())
+        {
+            const auto hash = std::hash<std::wstring>()(projectKey.ToStdWstring());
+            filename = wxString::Format("%s%c%016llx.index", gs_cacheDir, wxFILE_SEP_PATH, (unsigned long long)hash);
+        }
+        index.reset(new ProjectSearchIndex(filename));
+        weak = index;
+    }
+    return index;
+}
+
+
+ProjectSearchIndex::ProjectSearchIndex(const wxString& filename) : m_filename(filename)
+{
+}
+
+
+std::shared_ptr<const ProjectSearchIndex::Data> ProjectSearchIndex::GetData() const
+{
+    std::lock_guard<std::mutex> lock(m_dataMutex);
+    return m_data;
+}
+
+
+dispatch::future<void> ProjectSearchIndex::Update(const std::vector<wxString>& files)
+{
+    auto self = shared_from_this();
+    return dispatch::async([self, files]{ self->DoUpdate(files); });
+}
+
+
+void ProjectSearchIndex::DoUpdate(const std::vector<wxString>& files)
+{
+    std::lock_guard<std::mutex> lock(m_updateMutex);
+
+    perf::ScopedTimer timer("project search index update");
+
+    auto current = GetData();
+    if (!current)
+        current = Load();
+
+    std::unordered_map<std::wstring, std::shared_ptr<const FileData>> existing;
+    for (auto& f: current->files)
+        existing.emplace(f->path.ToStdWstring(), f);
+
+    auto data = std::make_shared<Data>();
+    data->files.resize(files.size());
+
+    std::vector<size_t> modified;
+    std::vector<std::pair<int64_t, int64_t>> stats(files.size());
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        wxLogNull null;
+        const int64_t mtime = (int64_t)wxFileModificationTime(files[i]);
+        const int64_t size = (int64_t)wxFileName::GetSize(files[i]).GetValue();
+        stats[i] = {mtime, size};
+
+        auto e = existing.find(files[i].ToStdWstring());
+        if (e != existing.end() && e->second->mtime == mtime && e->second->size == size)
+            data->files[i] = e->second;
+        else
+            modified.push_back(i);
+    }
+
+    timer.SetItemsCount(modified.size());
+
+    dispatch::parallel_for(modified.size(), /*grain=*/1, [&](size_t begin, size_t end)
+    {
+        for (size_t j = begin; j < end; j++)
+        {
+            const size_t i = modified[j];
+            data->files[i] = FileData::LoadCatalog(files[i], stats[i].first, stats[i].second);
+        }
+    });
+
+    const bool changed = !modified.empty() || files.size() != current->files.size();
+
+    {
+        std::lock_guard<std::mutex> dataLock(m_dataMutex);
+        m_data = data;
+    }
+
+    if (changed)
+        Save(*data);
+}
+
+
+std::shared_ptr<const ProjectSearchIndex::Data> ProjectSearchIndex::Load() const
+{
+    auto data = std::make_shared<Data>();
+    if (m_filename.empty() || !wxFileName::FileExists(m_filename))
+        return data;
+
+    MappedFile file(m_filename);
+    if (!file.IsOk())
+        return data;
+
+    BinaryReader in(file.data(), file.size());
+    uint32_t magic, version, count;
+    if (!in.UInt32(magic) || magic != INDEX_MAGIC ||
+        !in.UInt32(version) || version != INDEX_VERSION ||
+        !in.UInt32(count))
+    {
+        return data;
+    }
+
+    std::vector<std::shared_ptr<FileData>> files;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto fd = std::make_shared<FileData>();
+        std::wstring path;
+        uint32_t entriesCount;
+        if (!in.String(path) || !in.Int64(fd->mtime) || !in.Int64(fd->size) || !in.UInt32(entriesCount))
+            return data;
+        fd->path = path;
+
+        fd->entries.resize(entriesCount);
+        for (auto& e: fd->entries)
+        {
+            uint32_t line;
+            if (!in.UInt32(line) || !in.String(e.source) || !in.String(e.translation) || !in.String(e.comments))
+                return data;
+            e.line = (int)line;
+        }
+        files.push_back(fd);
+    }
+
+    // only the texts are stored, the index is rebuilt, which is fast enough
+    // when done in parallel and keeps the file small:
+    dispatch::parallel_for(files.size(), /*grain=*/1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+            files[i]->BuildIndex();
+    });
+
+    data->files.assign(files.begin(), files.end());
+    return data;
+}
+
+
+void ProjectSearchIndex::Save(const Data& data) const
+{
+    if (m_filename.empty())
+        return;
+
+    BinaryWriter out;
+    out.UInt32(INDEX_MAGIC);
+    out.UInt32(INDEX_VERSION);
+    out.UInt32((uint32_t)data.files.size());
+    for (auto& f: data.files)
+    {
+        out.String(f->path.ToStdWstring());
+        out.Int64(f->mtime);
+        out.Int64(f->size);
+        out.UInt32((uint32_t)f->entries.size());
+        for (auto& e: f->entries)
+        {
+            out.UInt32((uint32_t)e.line);
+            out.String(e.source);
+            out.String(e.translation);
+            out.String(e.comments);
+        }
+    }
+
+    wxLogNull null;
+    wxFileName::Mkdir(gs_cacheDir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+    wxTempFile f(m_filename);
+    if (f.IsOpened() && f.Write(out.data().data(), out.data().size()))
+        f.Commit();
+}
+
+
+dispatch::future<int> ProjectSearchIndex::Search(const wxString& text,
+                                                 ResultsCallback onResults,
+                                                 dispatch::cancellation_token_ptr cancellationToken)
+{
+    auto data = GetData();
+    return dispatch::async([=]
+    {
+        if (!data)
+            return 0;
+
+        const auto query = CatalogSearchIndex::Fold(text);
+        if (query.empty())
+            return 0;
+
+        std::vector<CatalogSearchIndex::Trigram> trigrams;
+        CatalogSearchIndex::AddTrigrams(query, trigrams);
+        std::sort(trigrams.begin(), trigrams.end());
+        trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+        int total = 0;
+        std::vector<Result> batch;
+        auto batchStart = std::chrono::steady_clock::now();
+
+        auto flush = [&]
+        {
+            if (batch.empty())
+                return;
+            auto results = std::make_shared<std::vector<Result>>(std::move(batch));
+            dispatch::on_main([onResults, cancellationToken, results]
+            {
+                if (!cancellationToken->is_cancelled())
+                    onResults(std::move(*results));
+            });
+            batch.clear();
+            batchStart = std::chrono::steady_clock::now();
+        };
+
+        std::vector<uint32_t> candidates, tmp;
+        for (auto& file: data->files)
+        {
+            if (cancellationToken->is_cancelled())
+                return total;
+
+            // intersect postings of all trigrams, starting with the shortest
+            // ones; short queries without trigrams must check all entries
+            candidates.clear();
+            if (trigrams.empty())
+            {
+                for (uint32_t i = 0; i < (uint32_t)file->entries.size(); i++)
+                    candidates.push_back(i);
+            }
+            else
+            {
+                std::vector<const std::vector<uint32_t>*> postings;
+                for (auto t: trigrams)
+                {
+                    auto p = file->postings.find(t);
+                    if (p == file->postings.end())
+                        break;
+                    postings.push_back(&p->second);
+                }
+                if (postings.size() != trigrams.size())
+                    continue;
+
+                std::sort(postings.begin(), postings.end(),
+                          [](const std::vector<uint32_t> *a, const std::vector<uint32_t> *b){ return a->size() < b->size(); });
+                candidates = *postings.front();
+                for (size_t i = 1; i < postings.size() && !candidates.empty(); i++)
+                {
+                    tmp.clear();
+                    std::set_intersection(candidates.begin(), candidates.end(),
+                                          postings[i]->begin(), postings[i]->end(),
+                                          std::back_inserter(tmp));
+                    candidates.swap(tmp);
+                }
+            }
+
+            for (auto i: candidates)
+            {
+                if (file->folded[i].find(query) == std::wstring::npos)
+                    continue;
+
+                auto& e = file->entries[i];
+                batch.push_back({file->path, e.line, e.source, e.translation});
+                if (++total == MAX_RESULTS)
+                {
+                    flush();
+                    return total;
+                }
+            }
+
+            if (batch.size() >= RESULTS_BATCH_SIZE || std::chrono::steady_clock::now() - batchStart > RESULTS_BATCH_INTERVAL)
+                flush();
+        }
+
+        flush();
+        return total;
+    });
+}
+
+
+
+class ProjectSearchFrame::ResultsList : public wxListCtrl
+{
+public:
+    ResultsList(wxWindow *parent)
+        : wxListCtrl(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize,
+                     wxLC_REPORT | wxLC_VIRTUAL | wxLC_SINGLE_SEL | MSW_OR_OTHER(wxBORDER_SIMPLE, wxBORDER_SUNKEN))
+    {
+        AppendColumn(_("File"), wxLIST_FORMAT_LEFT, PX(150));
+        AppendColumn(_("Source text"), wxLIST_FORMAT_LEFT, PX(300));
+        AppendColumn(_("Translation"), wxLIST_FORMAT_LEFT, PX(300));
+    }
+
+    void SetCommonPrefix(const wxString& prefix) { m_prefix = prefix; }
+
+    void Clear()
+    {
+        m_results.clear();
+        SetItemCount(0);
+    }
+
+    void Append(std::vector<ProjectSearchIndex::Result>&& results)
+    {
+        m_results.insert(m_results.end(),
+                         std::make_move_iterator(results.begin()),
+                         std::make_move_iterator(results.end()));
+        SetItemCount((long)m_results.size());
+    }
+
+    const ProjectSearchIndex::Result& GetResult(long item) const { return m_results[item]; }
+
+protected:
+    wxString OnGetItemText(long item, long column) const override
+    {
+        auto& r = m_results[item];
+        wxString text;
+        switch (column)
+        {
+            case 0:
+                text = r.file.StartsWith(m_prefix) ? r.file.substr(m_prefix.length()) : r.file;
+                break;
+            case 1:
+                text = r.source;
+                break;
+            case 2:
+                text = r.translation;
+                break;
+        }
+        // multiline texts would be hard to read in a list:
+        text.Replace("\n", L" ⏎ ");
+        return text;
+    }
+
+private:
+    wxString m_prefix;
+    std::vector<ProjectSearchIndex::Result> m_results;
+};
+
+
+ProjectSearchFrame *ProjectSearchFrame::ms_instance = nullptr;
+
+/*static*/ void ProjectSearchFrame::ShowFor(wxWindow *parent,
+                                            const wxString& projectName,
+                                            const wxString& projectKey,
+                                            const std::vector<wxString>& files,
+                                            const wxString& text)
+{
+    if (ms_instance && ms_instance->m_projectKey != projectKey)
+    {
+        ms_instance->Destroy();
+        ms_instance = nullptr;
+    }
+
+    if (!ms_instance)
+        ms_instance = new ProjectSearchFrame(parent, projectName, projectKey, files);
+    else
+        ms_instance->SetFiles(files);
+
+    ms_instance->Show();
+    ms_instance->Raise();
+
+    if (!text.empty())
+        ms_instance->m_search->ChangeValue(text);
+    ms_instance->m_search->SetFocus();
+    ms_instance->UpdateIndex();
+    ms_instance->StartSearch();
+}
+
+
+ProjectSearchFrame::ProjectSearchFrame(wxWindow *parent,
+                                       const wxString& projectName,
+                                       const wxString& projectKey,
+                                       const std::vector<wxString>& files)
+    : wxFrame(parent, wxID_ANY, wxString::Format(_("Search in %s"), projectName),
+              wxDefaultPosition, wxDefaultSize,
+              wxDEFAULT_FRAME_STYLE | wxFRAME_FLOAT_ON_PARENT, "projectsearch"),
+      m_projectKey(projectKey),
+      m_updating(false),
+      m_updatePending(false)
+{
+    m_index = ProjectSearchIndex::Get(projectKey);
+
+    auto panel = new wxPanel(this, wxID_ANY);
+    auto sizer = new wxBoxSizer(wxVERTICAL);
+
+    m_search = new wxSearchCtrl(panel, wxID_ANY);
+    m_search->SetDescriptiveText(_("Search in all catalogs"));
+    m_search->ShowCancelButton(true);
+    sizer->Add(m_search, wxSizerFlags().Expand().PXBorderAll());
+
+    m_status = new wxStaticText(panel, wxID_ANY, "");
+#ifdef __WXOSX__
+    m_status->SetWindowVariant(wxWINDOW_VARIANT_SMALL);
+#endif
+    sizer->Add(m_status, wxSizerFlags().Expand().PXBorder(wxLEFT|wxRIGHT));
+
+    m_list = new ResultsList(panel);
+    sizer->Add(m_list, wxSizerFlags(1).Expand().PXBorderAll());
+
+    panel->SetSizer(sizer);
+    auto topsizer = new wxBoxSizer(wxHORIZONTAL);
+    topsizer->Add(panel, wxSizerFlags(1).Expand());
+    SetSizer(topsizer);
+
+    RestoreWindowState(this, wxSize(PX(800), PX(500)));
+
+    SetFiles(files);
+
+    m_search->Bind(wxEVT_TEXT, [=](wxCommandEvent&){ StartSearch(); });
+    m_search->Bind(wxEVT_SEARCHCTRL_CANCEL_BTN, [=](wxCommandEvent&){ m_search->Clear(); });
+    m_list->Bind(wxEVT_LIST_ITEM_ACTIVATED, [=](wxListEvent& e)
+    {
+        auto& r = m_list->GetResult(e.GetIndex());
+        PoeditFrame *f = PoeditFrame::Create(r.file, r.line);
+        if (f)
+            f->Raise();
+    });
+    // files may have been edited while the window was in the background:
+    Bind(wxEVT_ACTIVATE, [=](wxActivateEvent& e)
+    {
+        e.Skip();
+        if (e.GetActive())
+            UpdateIndex();
+    });
+}
+
+
+ProjectSearchFrame::~ProjectSearchFrame()
+{
+    SaveWindowState(this);
+
+    if (m_cancellation)
+        m_cancellation->cancel();
+
+    if (ms_instance == this)
+        ms_instance = nullptr;
+}
+
+
+void ProjectSearchFrame::SetFiles(const std::vector<wxString>& files)
+{
+    m_files = files;
+
+    // show paths relative to the directory common to all files:
+    wxString prefix;
+    if (!files.empty())
+    {
+        prefix = wxFileName(files.front()).GetPath(wxPATH_GET_VOLUME | wxPATH_GET_SEPARATOR);
+        for (auto& f: files)
+        {
+            while (!prefix.empty() && !f.StartsWith(prefix))
+                prefix = wxFileName(prefix.substr(0, prefix.length() - 1)).GetPath(wxPATH_GET_VOLUME | wxPATH_GET_SEPARATOR);
+        }
+    }
+    m_list->SetCommonPrefix(prefix);
+}
+
+
+void ProjectSearchFrame::UpdateIndex()
+{
+    if (m_updating)
+    {
+        m_updatePending = true;
+        return;
+    }
+
+    m_updating = true;
+    m_status->SetLabel(_(L"Updating index…"));
+
+    m_index->Update(m_files).then_on_window(this, [=]
+    {
+        m_updating = false;
+        if (m_updatePending)
+        {
+            m_updatePending = false;
+            UpdateIndex();
+            return;
+        }
+        // results of the search done during the update may be outdated:
+        StartSearch();
+    });
+}
+
+
+void ProjectSearchFrame::StartSearch()
+{
+    if (m_cancellation)
+        m_cancellation->cancel();
+    m_cancellation.reset();
+
+    m_list->Clear();
+
+    const auto text = m_search->GetValue();
+    if (text.empty())
+    {
+        if (!m_updating)
+            m_status->SetLabel("");
+        return;
+    }
+
+    auto token = std::make_shared<dispatch::cancellation_token>();
+    m_cancellation = token;
+
+    m_index->Search(text, [=](std::vector<ProjectSearchIndex::Result>&& results)
+    {
+        m_list->Append(std::move(results));
+    },
+    token)
+    .then_on_window(this, [=](int count)
+    {
+        if (!token->is_cancelled() && !m_updating)
+            SetStatus(count);
+    });
+}
+
+
+void ProjectSearchFrame::SetStatus(int count)
+{
+    wxString status;
+    if (count >= ProjectSearchIndex::MAX_RESULTS)
+        status.Printf(_("Showing first %d matches"), count);
+    else
+        status.Printf(wxPLURAL("%d match", "%d matches", count), count);
+    m_status->SetLabel(status);
+}
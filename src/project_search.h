@@ -0,0 +1,166 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2023 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_project_search_h
+#define Poedit_project_search_h
+
+#include "concurrency.h"
+
+#include <wx/frame.h>
+#include <wx/string.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class WXDLLIMPEXP_FWD_CORE wxSearchCtrl;
+class WXDLLIMPEXP_FWD_CORE wxStaticText;
+
+
+/**
+    Search index of all catalogs in a project (see ManagerFrame), for finding
+    text in all of the project's languages at once.
+
+    Source texts, translations and comments are indexed, folded the same way
+    CatalogSearchIndex does it, so searches are case-insensitive and ignore
+    accelerator characters.
+
+    The index is kept on disk and updated incrementally: only files that are
+    new or were modified since the last update are loaded again.
+ */
+class ProjectSearchIndex : public std::enable_shared_from_this<ProjectSearchIndex>
+{
+public:
+    /// Sets directory where indexes are stored.
+    static void SetCacheDir(const wxString& dir);
+
+    /**
+        Returns index for the project identified by @a projectKey, which is
+        any string unique to the project (e.g. its list of directories).
+
+        There's only one instance for any project at a time. Main thread only.
+     */
+    static std::shared_ptr<ProjectSearchIndex> Get(const wxString& projectKey);
+
+    /**
+        Updates the index in the background to contain exactly @a files.
+
+        Updates are serialized and searches keep using the previous version of
+        the index until the new one is complete.
+     */
+    dispatch::future<void> Update(const std::vector<wxString>& files);
+
+    /// Item found by Search()
+    struct Result
+    {
+        wxString file;
+        int line;
+        wxString source;
+        wxString translation;
+    };
+
+    typedef std::function<void(std::vector<Result>&& results)> ResultsCallback;
+
+    /// Search() never returns more results than this.
+    static const int MAX_RESULTS = 10000;
+
+    /**
+        Searches for @a text in the background.
+
+        Results are passed to @a onResults, on the main thread, in batches as
+        they are found; the callback is not called anymore once the search is
+        cancelled. The returned future is fulfilled with the total number of
+        results after all batches were passed to @a onResults.
+     */
+    dispatch::future<int> Search(const wxString& text,
+                                 ResultsCallback onResults,
+                                 dispatch::cancellation_token_ptr cancellationToken);
+
+private:
+    struct FileData;
+    struct Data;
+
+    explicit ProjectSearchIndex(const wxString& filename);
+
+    void DoUpdate(const std::vector<wxString>& files);
+    std::shared_ptr<const Data> GetData() const;
+    std::shared_ptr<const Data> Load() const;
+    void Save(const Data& data) const;
+
+    wxString m_filename;
+    std::mutex m_updateMutex;
+    mutable std::mutex m_dataMutex;
+    std::shared_ptr<const Data> m_data;
+};
+
+
+/**
+    Window with results of searching in all catalogs of a project.
+
+    Activating a result opens the catalog in PoeditFrame at that item.
+ */
+class ProjectSearchFrame : public wxFrame
+{
+public:
+    /**
+        Shows the search window for the project, reusing the existing window
+        if it is for the same project, and searches for @a text in it.
+     */
+    static void ShowFor(wxWindow *parent,
+                        const wxString& projectName,
+                        const wxString& projectKey,
+                        const std::vector<wxString>& files,
+                        const wxString& text);
+
+    ~ProjectSearchFrame();
+
+private:
+    class ResultsList;
+
+    ProjectSearchFrame(wxWindow *parent,
+                       const wxString& projectName,
+                       const wxString& projectKey,
+                       const std::vector<wxString>& files);
+
+    void SetFiles(const std::vector<wxString>& files);
+    void UpdateIndex();
+    void StartSearch();
+    void SetStatus(int count);
+
+    wxString m_projectKey;
+    std::vector<wxString> m_files;
+    std::shared_ptr<ProjectSearchIndex> m_index;
+    bool m_updating, m_updatePending;
+    dispatch::cancellation_token_ptr m_cancellation;
+
+    wxSearchCtrl *m_search;
+    wxStaticText *m_status;
+    ResultsList *m_list;
+
+    static ProjectSearchFrame *ms_instance;
+};
+
+#endif // Poedit_project_search_h
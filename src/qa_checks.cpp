@@ -25,14 +25,115 @@
 
 #include "qa_checks.h"
 
+#include "concurrency.h"
+#include "str_helpers.h"
 #include "syntaxhighlighter.h"
 
-#include <regex>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <set>
+#include <sstream>
+#include <string_view>
+#include <vector>
 #include <unicode/uchar.h>
+#include <wx/log.h>
+#include <wx/tokenzr.h>
 #include <wx/translation.h>
 
 
+// -------------------------------------------------------------
+// Edge profiles
+// -------------------------------------------------------------
+
+/**
+    Traits of the start and end of a string, which is all that whitespace,
+    punctuation and case checks look at. Computed once per string.
+ */
+struct QAEdgeProfile
+{
+    QAEdgeProfile() {}
+    explicit QAEdgeProfile(const wxString& s);
+
+    size_t length = 0;
+    UChar32 first = 0;
+    UChar32 last = 0;
+
+    bool firstIsSpace = false;
+    bool firstIsUpper = false;
+    bool firstIsLower = false;
+    bool secondIsLower = false;
+
+    bool lastIsSpace = false;
+    bool lastIsPunctuation = false;
+    bool lastIsQuote = false;
+    bool lastIsClosingBracket = false;
+};
+
+QAEdgeProfile::QAEdgeProfile(const wxString& s) : length(s.length())
+{
+    if (s.empty())
+        return;
+
+    first = s[0];
+    last = s.Last();
+
+    firstIsSpace = u_isspace(first);
+    firstIsUpper = u_isupper(first);
+    firstIsLower = u_islower(first);
+    secondIsLower = length >= 2 && u_islower(s[1]);
+
+    lastIsSpace = u_isspace(last);
+    lastIsQuote = u_hasBinaryProperty(last, UCHAR_QUOTATION_MARK);
+    lastIsPunctuation = lastIsQuote ||
+                        u_hasBinaryProperty(last, UCHAR_TERMINAL_PUNCTUATION) ||
+                        last == L'…' ||  // somehow U+2026 ellipsis is not terminal punctuation
+                        last == L'⋯';    // ...or Chinese U+22EF
+    lastIsClosingBracket = u_getIntPropertyValue(last, UCHAR_BIDI_PAIRED_BRACKET_TYPE) == U_BPT_CLOSE;
+}
+
+
+/// Lazily computed edge profiles of all strings of an item
+class QAItemEdges
+{
+public:
+    QAItemEdges(const CatalogItem& item) : m_item(item) {}
+
+    const QAEdgeProfile& Source()
+    {
+        if (!m_source)
+            m_source.emplace(m_item.GetString());
+        return *m_source;
+    }
+
+    const QAEdgeProfile& Plural()
+    {
+        if (!m_plural)
+            m_plural.emplace(m_item.GetPluralString());
+        return *m_plural;
+    }
+
+    const QAEdgeProfile& Translation(unsigned index)
+    {
+        if (m_translations.size() <= index)
+            m_translations.resize(index + 1);
+        auto& t = m_translations[index];
+        if (!t)
+            t.emplace(m_item.GetTranslation(index));
+        return *t;
+    }
+
+private:
+    const CatalogItem& m_item;
+    std::optional<QAEdgeProfile> m_source, m_plural;
+    std::vector<std::optional<QAEdgeProfile>> m_translations;
+};
+
+
 // -------------------------------------------------------------
 // QACheck implementations
 // -------------------------------------------------------------
@@ -40,6 +141,48 @@
 namespace QA
 {
 
+/// Base class for checks that only look at the start and end of strings
+class EdgesCheck : public QACheck
+{
+public:
+    bool CheckItem(CatalogItemPtr item) override
+    {
+        QAItemEdges edges(*item);
+        return CheckItemWithEdges(item, edges);
+    }
+
+    // Compares the same pairs of strings as QACheck::CheckItem() does:
+    bool CheckItemWithEdges(CatalogItemPtr item, QAItemEdges& edges) override
+    {
+        auto& translations = item->GetTranslations();
+
+        if (!translations[0].empty() &&
+            CheckEdges(item, item->GetString(), edges.Source(), translations[0], edges.Translation(0)))
+        {
+            return true;
+        }
+
+        if (item->HasPlural())
+        {
+            for (unsigned i = 1; i < translations.size(); i++)
+            {
+                if (!translations[i].empty() &&
+                    CheckEdges(item, item->GetPluralString(), edges.Plural(), translations[i], edges.Translation(i)))
+                {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+protected:
+    virtual bool CheckEdges(CatalogItemPtr item,
+                            const wxString& source, const QAEdgeProfile& s,
+                            const wxString& translation, const QAEdgeProfile& t) = 0;
+};
+
 #define QA_ENUM_ALL_CHECKS(m)       \
     m(QA::Placeholders);            \
     m(QA::NotAllPlurals);           \
@@ -55,8 +198,6 @@ namespace QA
     const char *GetCheckId() const override { return GetId(); }
 
 
-std::wregex RE_POSITIONAL_FORMAT(LR"(^%[0-9]\$(.*))", std::regex_constants::ECMAScript | std::regex_constants::optimize);
-
 class Placeholders : public QACheck
 {
 public:
@@ -148,11 +289,8 @@ private:
 
             // filter out reordering of positional arguments by tracking them as unordered;
             // e.g. %1$s is translated into %s
-            std::wsmatch m;
-            if (std::regex_match(x, m, RE_POSITIONAL_FORMAT))
-            {
-                x = std::wstring(L"%") + std::wstring(m[1]);
-            }
+            if (x.length() >= 3 && x[0] == '%' && x[1] >= '0' && x[1] <= '9' && x[2] == '$')
+                x.erase(1, 2);
 
             ph.insert(x);
         });
@@ -193,7 +331,7 @@ public:
 };
 
 
-class CaseMismatch : public QACheck
+class CaseMismatch : public EdgesCheck
 {
 public:
     QA_METADATA("case", _("Inconsistent upper/lower case"))
@@ -203,20 +341,22 @@ public:
         m_shouldCheck = (m_lang != "zh" && m_lang != "ja");
     }
 
-    bool CheckString(CatalogItemPtr item, const wxString& source, const wxString& translation) override
+    bool CheckEdges(CatalogItemPtr item,
+                    const wxString& /*source*/, const QAEdgeProfile& s,
+                    const wxString& /*translation*/, const QAEdgeProfile& t) override
     {
-        if (!m_shouldCheck || source.length() < 2)
+        if (!m_shouldCheck || s.length < 2)
             return false;
 
         // Detect that the source string is a sentence: should have 1st letter uppercase and 2nd lowercase,
         // as checking just the 1st letter would lead to false positives (consider e.g. "MSP430 built-in"):
-        if (u_isupper(source[0]) && u_islower(source[1]) && u_islower(translation[0]))
+        if (s.firstIsUpper && s.secondIsLower && t.firstIsLower)
         {
             item->SetIssue(CatalogItem::Issue::Warning, _("The translation should start as a sentence."));
             return true;
         }
 
-        if (u_islower(source[0]) && u_isupper(translation[0]))
+        if (s.firstIsLower && t.firstIsUpper)
         {
             if (m_lang != "de")
             {
@@ -235,7 +375,7 @@ private:
 };
 
 
-class WhitespaceMismatch : public QACheck
+class WhitespaceMismatch : public EdgesCheck
 {
 public:
     QA_METADATA("whitespace", _("Inconsistent whitespace"))
@@ -248,39 +388,41 @@ public:
         m_checkSpaceInTranslation = (l != "zh" && l != "ja");
     }
 
-    bool CheckString(CatalogItemPtr item, const wxString& source, const wxString& translation) override
+    bool CheckEdges(CatalogItemPtr item,
+                    const wxString& /*source*/, const QAEdgeProfile& s,
+                    const wxString& /*translation*/, const QAEdgeProfile& t) override
     {
-        if (m_checkSpaceInTranslation && u_isspace(source[0]) && !u_isspace(translation[0]))
+        if (m_checkSpaceInTranslation && s.firstIsSpace && !t.firstIsSpace)
         {
             item->SetIssue(CatalogItem::Issue::Warning, _(L"The translation doesn’t start with a space."));
             return true;
         }
 
-        if (!u_isspace(source[0]) && u_isspace(translation[0]))
+        if (!s.firstIsSpace && t.firstIsSpace)
         {
             item->SetIssue(CatalogItem::Issue::Warning, _(L"The translation starts with a space, but the source text doesn’t."));
             return true;
         }
 
-        if (source.Last() == '\n' && translation.Last() != '\n')
+        if (s.last == '\n' && t.last != '\n')
         {
             item->SetIssue(CatalogItem::Issue::Warning, _(L"The translation is missing a newline at the end."));
             return true;
         }
 
-        if (source.Last() != '\n' && translation.Last() == '\n')
+        if (s.last != '\n' && t.last == '\n')
         {
             item->SetIssue(CatalogItem::Issue::Warning, _(L"The translation ends with a newline, but the source text doesn’t."));
             return true;
         }
 
-        if (m_checkSpaceInTranslation && u_isspace(source.Last()) && !u_isspace(translation.Last()))
+        if (m_checkSpaceInTranslation && s.lastIsSpace && !t.lastIsSpace)
         {
             item->SetIssue(CatalogItem::Issue::Warning, _(L"The translation is missing a space at the end."));
             return true;
         }
 
-        if (!u_isspace(source.Last()) && u_isspace(translation.Last()))
+        if (!s.lastIsSpace && t.lastIsSpace)
         {
             item->SetIssue(CatalogItem::Issue::Warning, _(L"The translation ends with a space, but the source text doesn’t."));
             return true;
@@ -294,7 +436,7 @@ private:
 };
 
 
-class PunctuationMismatch : public QACheck
+class PunctuationMismatch : public EdgesCheck
 {
 public:
     QA_METADATA("punctuation", _("Punctuation checks"));
@@ -303,7 +445,9 @@ public:
     {
     }
 
-    bool CheckString(CatalogItemPtr item, const wxString& source_, const wxString& translation) override
+    bool CheckEdges(CatalogItemPtr item,
+                    const wxString& source_, const QAEdgeProfile& s_,
+                    const wxString& /*translation*/, const QAEdgeProfile& t) override
     {
         if (m_lang == "th" || m_lang == "lo" || m_lang == "km" || m_lang == "my")
         {
@@ -316,22 +460,32 @@ public:
             return false;
         }
 
-        auto source(source_);
+        const wxString *sourcePtr = &source_;
+        const QAEdgeProfile *sPtr = &s_;
+        wxString trimmedSource;
+        QAEdgeProfile trimmedProfile;
         if (m_lang == "zh" || m_lang == "ja")
         {
             // Space is used sparingly in these languages andd e.g. not present after sentence-ending
             // period, so strip it from the source if present and check punctuation w/o it.
-            if (u_isspace(source.Last()) && !u_isspace(translation.Last()))
-                source.Trim(/*fromRight:*/true);
+            if (s_.lastIsSpace && !t.lastIsSpace)
+            {
+                trimmedSource = source_;
+                trimmedSource.Trim(/*fromRight:*/true);
+                trimmedProfile = QAEdgeProfile(trimmedSource);
+                sourcePtr = &trimmedSource;
+                sPtr = &trimmedProfile;
+            }
         }
+        const wxString& source = *sourcePtr;
+        const QAEdgeProfile& s = *sPtr;
 
-        const UChar32 s_last = source.Last();
-        const UChar32 t_last = translation.Last();
-        const bool s_punct = IsPunctuation(s_last);
-        const bool t_punct = IsPunctuation(t_last);
+        const UChar32 s_last = s.last;
+        const UChar32 t_last = t.last;
+        const bool s_punct = s.lastIsPunctuation;
+        const bool t_punct = t.lastIsPunctuation;
 
-        if (u_getIntPropertyValue(s_last, UCHAR_BIDI_PAIRED_BRACKET_TYPE) == U_BPT_CLOSE ||
-            u_getIntPropertyValue(t_last, UCHAR_BIDI_PAIRED_BRACKET_TYPE) == U_BPT_CLOSE)
+        if (s.lastIsClosingBracket || t.lastIsClosingBracket)
         {
             // too many reordering related false positives for brackets
             // e.g. "your {site} account" -> "váš účet na {site}"
@@ -350,7 +504,7 @@ public:
             }
         }
 
-        if (u_hasBinaryProperty(s_last, UCHAR_QUOTATION_MARK) || (!s_punct && u_hasBinaryProperty(t_last, UCHAR_QUOTATION_MARK)))
+        if (s.lastIsQuote || (!s_punct && t.lastIsQuote))
         {
             // quoted fragments can move around, e.g., so ignore quotes in reporting:
             //      >> Invalid value for ‘{fieldName}’​ field
@@ -384,7 +538,7 @@ public:
             {
                 // as a special case, allow translating ... (3 dots) as … (ellipsis)
             }
-            else if (u_hasBinaryProperty(s_last, UCHAR_QUOTATION_MARK) && u_hasBinaryProperty(t_last, UCHAR_QUOTATION_MARK))
+            else if (s.lastIsQuote && t.lastIsQuote)
             {
                 // don't check for correct quotes for now, accept any quotations marks as equal
             }
@@ -405,14 +559,6 @@ public:
     }
 
 private:
-    bool IsPunctuation(UChar32 c) const
-    {
-        return u_hasBinaryProperty(c, UCHAR_TERMINAL_PUNCTUATION) ||
-               u_hasBinaryProperty(c, UCHAR_QUOTATION_MARK) ||
-               c == L'…' ||  // somehow U+2026 ellipsis is not terminal punctuation
-               c == L'⋯';    // ...or Chinese U+22EF
-    }
-
     bool IsEquivalent(UChar32 src, UChar32 trans) const
     {
         if (src == trans)
@@ -525,6 +671,124 @@ bool QACheck::CheckString(CatalogItemPtr /*item*/, const wxString& /*source*/, c
 // QAChecker
 // -------------------------------------------------------------
 
+namespace
+{
+
+inline void hash_combine(size_t& seed, size_t value)
+{
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+inline size_t hash_string(const wxString& s)
+{
+    return std::hash<std::wstring_view>()(std::wstring_view(s.wc_str(), s.length()));
+}
+
+
+struct RegisteredCheck
+{
+    std::string id;
+    std::function<wxString()> description;
+    QAChecker::CheckFactory factory;
+};
+
+std::mutex gs_registryMutex;
+
+// must be called with gs_registryMutex locked
+std::vector<RegisteredCheck>& GetRegistry()
+{
+    static std::vector<RegisteredCheck> s_registry;
+    static bool s_initialized = false;
+    if (!s_initialized)
+    {
+        s_initialized = true;
+        #define qa_register(klass) \
+            s_registry.push_back({klass::GetId(), &klass::GetDescription, \
+                                  [](const Language& lang){ return std::make_shared<klass>(lang); }})
+        QA_ENUM_ALL_CHECKS(qa_register);
+    }
+    return s_registry;
+}
+
+
+// Cost accounting of individual checks, reported by QAChecker::GetDiagnosticsReport()
+class CheckCosts
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    typedef std::map<std::string, QAChecker::CheckCost> Entries;
+
+    static CheckCosts& Get()
+    {
+        static CheckCosts s_instance;
+        return s_instance;
+    }
+
+    void RecordRun(const Entries& run, size_t itemsCount)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_lastRun = run;
+            m_lastRunItems = itemsCount;
+            m_runs++;
+            for (auto& e: run)
+                m_total[e.first].Add(e.second);
+        }
+
+        if (wxLog::IsAllowedTraceMask("poedit.qa"))
+        {
+            std::istringstream ss(Report());
+            std::string line;
+            while (std::getline(ss, line))
+                wxLogTrace("poedit.qa", "%s", line);
+        }
+    }
+
+    std::string Report() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(2);
+
+        auto dump = [&ss](const Entries& entries)
+        {
+            for (auto& e: entries)
+            {
+                auto& c = e.second;
+                ss << "  " << e.first << ": " << c.us / 1000.0 << " ms"
+                   << ", items " << c.items
+                   << ", avg " << (c.items ? double(c.us) / c.items : 0.0) << " us/item"
+                   << ", issues " << c.issues << "\n";
+            }
+        };
+
+        ss << "last run (" << m_lastRunItems << " items):\n";
+        dump(m_lastRun);
+        ss << "all " << m_runs << " runs:\n";
+        dump(m_total);
+        return ss.str();
+    }
+
+    static uint64_t to_us(Clock::duration d)
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    }
+
+private:
+    CheckCosts() {}
+
+    mutable std::mutex m_mutex;
+    Entries m_lastRun, m_total;
+    size_t m_lastRunItems = 0;
+    uint64_t m_runs = 0;
+};
+
+const char *DISABLED_CHECKS_HEADER = "X-Poedit-DisabledChecks";
+
+} // anonymous namespace
+
 QAChecker::QAChecker()
 {
 }
@@ -534,13 +798,30 @@ QAChecker::~QAChecker()
 }
 
 
+void QAChecker::RegisterCheck(const std::string& id, std::function<wxString()> description, CheckFactory factory)
+{
+    std::lock_guard<std::mutex> lock(gs_registryMutex);
+    auto& registry = GetRegistry();
+    wxASSERT_MSG(std::none_of(registry.begin(), registry.end(), [&id](const RegisteredCheck& r){ return r.id == id; }),
+                 "QA check registered twice");
+    registry.push_back({id, description, factory});
+}
+
+
 std::shared_ptr<QAChecker> QAChecker::GetFor(Catalog& catalog)
 {
     auto lang = catalog.GetLanguage();
+    auto disabled = GetDisabledChecks(catalog);
+
     auto c = std::make_shared<QAChecker>();
+    c->m_signature = std::hash<std::string>()(lang.Code());
 
-    #define qa_instantiate(klass) c->AddCheck<klass>(lang);
-    QA_ENUM_ALL_CHECKS(qa_instantiate);
+    std::lock_guard<std::mutex> lock(gs_registryMutex);
+    for (auto& r: GetRegistry())
+    {
+        if (disabled.find(r.id) == disabled.end())
+            c->AddCheck(r.factory(lang));
+    }
 
     return c;
 }
@@ -549,41 +830,161 @@ std::vector<std::pair<std::string, wxString>> QAChecker::GetMetadata()
 {
     std::vector<std::pair<std::string, wxString>> m;
 
-    #define qa_metadata(klass) m.emplace_back(klass::GetId(), klass::GetDescription())
-    QA_ENUM_ALL_CHECKS(qa_metadata);
+    std::lock_guard<std::mutex> lock(gs_registryMutex);
+    for (auto& r: GetRegistry())
+        m.emplace_back(r.id, r.description());
 
     return m;
 }
 
 
+std::set<std::string> QAChecker::GetDisabledChecks(Catalog& catalog)
+{
+    std::set<std::string> ids;
+    wxStringTokenizer tkn(catalog.Header().GetHeader(DISABLED_CHECKS_HEADER), ",");
+    while (tkn.HasMoreTokens())
+    {
+        auto id = tkn.GetNextToken().Strip(wxString::both);
+        if (!id.empty())
+            ids.insert(str::to_utf8(id));
+    }
+    return ids;
+}
+
+void QAChecker::SetDisabledChecks(Catalog& catalog, const std::set<std::string>& ids)
+{
+    wxString value;
+    for (auto& id: ids)
+    {
+        if (!value.empty())
+            value += ", ";
+        value += wxString::FromUTF8(id);
+    }
+    catalog.Header().SetHeaderNotEmpty(DISABLED_CHECKS_HEADER, value);
+}
+
+
+std::string QAChecker::GetDiagnosticsReport()
+{
+    return CheckCosts::Get().Report();
+}
+
 
 int QAChecker::Check(Catalog& catalog)
 {
-    int issues = 0;
+    // Checks are independent for each item and only store results in the item
+    // itself, so large catalogs are split into chunks checked in parallel.
+    static const size_t PARALLEL_CHECK_GRAIN = 500;
+
+    auto& items = catalog.items();
+    const size_t count = items.size();
+
+    struct ChunkResult
+    {
+        int issues = 0;
+        Costs costs;
+    };
+
+    ChunkResult initial;
+    initial.costs.resize(m_checks.size());
+
+    auto result = dispatch::parallel_transform_reduce
+    (
+        count, PARALLEL_CHECK_GRAIN, std::move(initial),
+        [this, &items](size_t start, size_t end)
+        {
+            ChunkResult r;
+            r.costs.resize(m_checks.size());
+            for (size_t i = start; i < end; i++)
+                r.issues += DoCheck(items[i], r.costs);
+            return r;
+        },
+        [](ChunkResult total, ChunkResult r)
+        {
+            total.issues += r.issues;
+            for (size_t i = 0; i < total.costs.size(); i++)
+                total.costs[i].Add(r.costs[i]);
+            return total;
+        }
+    );
+
+    const int issues = result.issues;
+    auto& costs = result.costs;
 
-    for (auto& i: catalog.items())
-        issues += Check(i);
+    CheckCosts::Entries run;
+    for (size_t i = 0; i < m_checks.size(); i++)
+        run[m_checks[i]->GetCheckId()].Add(costs[i]);
+    CheckCosts::Get().RecordRun(run, count);
 
     return issues;
 }
 
 
+void QAChecker::AddCheck(std::shared_ptr<QACheck> c)
+{
+    m_checks.push_back(c);
+    hash_combine(m_signature, std::hash<std::string>()(c->GetCheckId()));
+}
+
+
+size_t QAChecker::GetItemFingerprint(const CatalogItem& item) const
+{
+    size_t h = m_signature;
+    hash_combine(h, hash_string(item.m_string));
+    hash_combine(h, item.m_hasPlural ? hash_string(item.m_plural) : 0);
+    for (auto& t: item.m_translations)
+        hash_combine(h, hash_string(t));
+    hash_combine(h, item.m_isFuzzy);
+    hash_combine(h, hash_string(item.m_moreFlags));
+    hash_combine(h, std::hash<std::string>()(item.GetInternalFormatFlag()));
+    return h ? h : 1;  // 0 is reserved for "not checked"
+}
+
+
 int QAChecker::Check(CatalogItemPtr item)
 {
+    Costs costs(m_checks.size());
+    return DoCheck(item, costs);
+}
+
+
+int QAChecker::DoCheck(const CatalogItemPtr& item, Costs& costs)
+{
+    // Unchanged items don't need to be checked again, only get their last result back:
+    const size_t fingerprint = GetItemFingerprint(*item);
+    if (fingerprint == item->m_qaFingerprint)
+    {
+        if (!item->m_qaIssue)
+            return 0;
+        item->SetIssue(item->m_qaIssue);
+        return 1;
+    }
+
     int issues = 0;
+    QAItemEdges edges(*item);
 
-    for (auto& c: m_checks)
+    for (size_t i = 0; i < m_checks.size(); i++)
     {
         if (item->GetString().empty() || (item->HasPlural() && item->GetPluralString().empty()))
             continue;
 
-        if (c->CheckItem(item))
+        auto& cost = costs[i];
+        auto start = CheckCosts::Clock::now();
+        const bool found = m_checks[i]->CheckItemWithEdges(item, edges);
+        cost.us += CheckCosts::to_us(CheckCosts::Clock::now() - start);
+        cost.items++;
+
+        if (found)
         {
+            cost.issues++;
             issues++;
             // we only record single issue, so there's no point in continuing with other checks:
             break;
         }
     }
 
+    item->m_qaIssue = issues ? item->GetIssue() : nullptr;
+    item->m_qaFingerprint = fingerprint;
+
     return issues;
 }
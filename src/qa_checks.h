@@ -28,10 +28,16 @@
 
 #include "catalog.h"
 
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <set>
+#include <string>
 #include <vector>
 
 
+class QAItemEdges;
+
 /// Interface for implementing quality checks
 class QACheck
 {
@@ -52,6 +58,13 @@ public:
      */
     virtual bool CheckItem(CatalogItemPtr item);
 
+    /**
+        Same as CheckItem(), but with access to precomputed traits of the
+        start and end of the item's strings, which are shared by all checks
+        run on the item. Implemented by checks that use them.
+     */
+    virtual bool CheckItemWithEdges(CatalogItemPtr item, QAItemEdges& /*edges*/) { return CheckItem(item); }
+
     /// A more convenient API, checking only strings
     virtual bool CheckString(CatalogItemPtr item, const wxString& source, const wxString& translation);
 };
@@ -67,10 +80,61 @@ public:
     /// Returns metadata for the available checkers, as (id,description) pairs
     static std::vector<std::pair<std::string, wxString>> GetMetadata();
 
+    /// Creates instance of a check for given translation language
+    typedef std::function<std::shared_ptr<QACheck>(const Language& lang)> CheckFactory;
+
+    /**
+        Adds a check to the registry of available checks used by GetFor().
+
+        Built-in checks are always registered; @a id must be unique.
+     */
+    static void RegisterCheck(const std::string& id, std::function<wxString()> description, CheckFactory factory);
+
+    template<typename TCheck>
+    static void RegisterCheck()
+    {
+        RegisterCheck(TCheck::GetId(), &TCheck::GetDescription,
+                      [](const Language& lang){ return std::make_shared<TCheck>(lang); });
+    }
+
+    /**
+        Returns IDs of checks disabled for given file.
+
+        This is a per-project setting stored in the X-Poedit-DisabledChecks
+        header, similarly to source code search paths.
+     */
+    static std::set<std::string> GetDisabledChecks(Catalog& catalog);
+    static void SetDisabledChecks(Catalog& catalog, const std::set<std::string>& ids);
+
+    /// Time spent in a single check and number of items it checked
+    struct CheckCost
+    {
+        uint64_t us = 0;
+        uint64_t items = 0;
+        uint64_t issues = 0;
+
+        void Add(const CheckCost& c) { us += c.us; items += c.items; issues += c.issues; }
+    };
+
+    /**
+        Returns human-readable report of time spent in individual checks in
+        the last whole-catalog check and in all of them since the start.
+
+        The report is also logged with wxLogTrace("poedit.qa") after every
+        whole-catalog check.
+     */
+    static std::string GetDiagnosticsReport();
+
     /// Checks all items. Returns # of issues found.
     int Check(Catalog& catalog);
 
-    /// Check a single item. Returns # of issues found.
+    /**
+        Check a single item. Returns # of issues found.
+
+        Results are remembered in the item together with a fingerprint of its
+        content (source, translations and flags) and of the checker's setup,
+        so that rechecking unchanged items is cheap.
+     */
     int Check(CatalogItemPtr item);
 
     // Low-level creation and setup:
@@ -81,18 +145,21 @@ public:
     template<typename TCheck, typename... Args>
     void AddCheck(Args&&... args)
     {
-        if (IsCheckEnabled<TCheck>())
-            AddCheck(std::make_shared<TCheck>(args...));
+        AddCheck(std::make_shared<TCheck>(args...));
     }
 
-    void AddCheck(std::shared_ptr<QACheck> c) { m_checks.push_back(c); }
+    void AddCheck(std::shared_ptr<QACheck> c);
 
 private:
-    template<typename TCheck>
-    bool IsCheckEnabled() const { return true; }
+    typedef std::vector<CheckCost> Costs; // indexed the same as m_checks
+
+    int DoCheck(const CatalogItemPtr& item, Costs& costs);
+    size_t GetItemFingerprint(const CatalogItem& item) const;
 
 protected:
     std::vector<std::shared_ptr<QACheck>> m_checks;
+    // hash of the language and enabled checks, part of items' fingerprints:
+    size_t m_signature = 0;
 };
 
 #endif // Poedit_qa_checks_h
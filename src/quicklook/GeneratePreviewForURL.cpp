@@ -31,6 +31,7 @@
 #include <sstream>
 
 #include <wx/init.h>
+#include <wx/filename.h>
 #include <wx/intl.h>
 #include <wx/string.h>
 #include <wx/osx/core/cfstring.h>
@@ -39,6 +40,7 @@
 #include <unicode/uclean.h>
 
 #include "catalog.h"
+#include "catalog_po.h"
 
 #if wxUSE_GUI
     #error "compiled with GUI features of wx - not needed"
@@ -47,6 +49,12 @@
 namespace
 {
 
+// QuickLook expects previews to be generated promptly, so only the beginning
+// of PO files is parsed; the rest is quickly scanned for statistics if
+// possible within the time budget.
+const size_t PREVIEW_MAX_ITEMS = 1000;
+const std::chrono::milliseconds PREVIEW_STATS_BUDGET(300);
+
 CFDataRef CreateHTMLDataForURL(CFURLRef url, CFStringRef contentTypeUTI)
 {
     #pragma unused(contentTypeUTI)
@@ -57,10 +65,31 @@ CFDataRef CreateHTMLDataForURL(CFURLRef url, CFStringRef contentTypeUTI)
 
     try
     {
-        auto cat = Catalog::Create(path.AsString());
+        const wxString filename = path.AsString();
+        wxString ext;
+        wxFileName::SplitPath(filename, nullptr, nullptr, nullptr, &ext);
+
+        CatalogPtr cat;
+        Catalog::HTMLExportOptions options;
+        if (POCatalog::CanLoadFile(ext.Lower()))
+        {
+            auto preview = POCatalog::CreatePreview(filename, PREVIEW_MAX_ITEMS, PREVIEW_STATS_BUDGET);
+            cat = preview.catalog;
+            options.truncated = preview.truncated;
+            if (preview.hasStatistics)
+            {
+                options.all = preview.stats.all;
+                options.fuzzy = preview.stats.fuzzy;
+                options.untranslated = preview.stats.untranslated;
+            }
+        }
+        else
+        {
+            cat = Catalog::Create(filename);
+        }
 
         std::ostringstream s;
-        cat->ExportToHTML(s);
+        cat->ExportToHTML(s, options);
         std::string data = s.str();
         return CFDataCreate(NULL, (const UInt8*)data.data(), data.length());
     }
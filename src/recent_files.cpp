@@ -26,6 +26,7 @@
 #include "recent_files.h"
 
 #include "colorscheme.h"
+#include "concurrency.h"
 #include "edapp.h"
 #include "hidpi.h"
 #include "str_helpers.h"
@@ -47,6 +48,8 @@
 #include <wx/weakref.h>
 #include <wx/xrc/xmlres.h>
 
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <map>
@@ -108,6 +111,125 @@ protected:
 };
 
 
+/**
+    Remembers which recent files exist, checked in the background.
+
+    Checking existence of files can take seconds if they are on network
+    shares or disconnected drives, so it is never done on the main thread.
+    Until a file's existence is known, it is assumed to exist.
+ */
+class existence_cache : public std::enable_shared_from_this<existence_cache>
+{
+public:
+    /// Returns false only if @a fn is known to not exist
+    bool may_exist(const wxFileName& fn) const
+    {
+        auto i = m_entries.find(fn.GetFullPath());
+        return i == m_entries.end() || i->second.exists;
+    }
+
+    /// Returns @a files without those known to not exist
+    std::vector<wxFileName> filter(const std::vector<wxFileName>& files) const
+    {
+        std::vector<wxFileName> out;
+        out.reserve(files.size());
+        for (auto& f: files)
+        {
+            if (may_exist(f))
+                out.push_back(f);
+        }
+        return out;
+    }
+
+    /**
+        Checks files that weren't checked recently in the background. If any
+        of them turns out to have changed existence, @a onChanged is called on
+        the main thread afterwards.
+     */
+    void refresh(const std::vector<wxFileName>& files, std::function<void()> onChanged)
+    {
+        const auto now = clock::now();
+        std::vector<wxString> stale;
+        for (auto& f: files)
+        {
+            auto path = f.GetFullPath();
+            auto i = m_entries.find(path);
+            if (i == m_entries.end() || now - i->second.checked > MAX_AGE)
+                stale.push_back(path);
+        }
+        if (stale.empty())
+            return;
+
+        m_pendingCallbacks.push_back(onChanged);
+
+        // Only one check runs at a time, so that checks of unresponsive
+        // files don't pile up and block all background threads:
+        if (m_checking)
+            return;
+        m_checking = true;
+
+        auto self = shared_from_this();
+        dispatch::async([stale]
+        {
+            // Don't spend more than a few seconds on it; files not checked in
+            // time keep being treated as existing and are checked next time:
+            const auto deadline = clock::now() + CHECK_TIMEOUT;
+            std::vector<std::pair<wxString, bool>> results;
+            for (auto& path: stale)
+            {
+                if (clock::now() > deadline)
+                    break;
+                results.emplace_back(path, wxFileName::FileExists(path));
+            }
+            return results;
+        })
+        .then_on_main([self](std::vector<std::pair<wxString, bool>> results)
+        {
+            self->m_checking = false;
+
+            bool changed = false;
+            const auto now = clock::now();
+            for (auto& r: results)
+            {
+                auto& e = self->m_entries[r.first];
+                if (e.exists != r.second)
+                    changed = true;
+                e.exists = r.second;
+                e.checked = now;
+            }
+
+            std::vector<std::function<void()>> callbacks;
+            callbacks.swap(self->m_pendingCallbacks);
+            if (changed)
+            {
+                for (auto& c: callbacks)
+                    c();
+            }
+        });
+    }
+
+    /// Drops callbacks passed to refresh() that weren't called yet
+    void forget_callbacks() { m_pendingCallbacks.clear(); }
+
+private:
+    typedef std::chrono::steady_clock clock;
+    static constexpr std::chrono::seconds MAX_AGE{60};
+    static constexpr std::chrono::seconds CHECK_TIMEOUT{5};
+
+    struct entry
+    {
+        bool exists = true;
+        clock::time_point checked;
+    };
+
+    std::map<wxString, entry> m_entries;
+    std::vector<std::function<void()>> m_pendingCallbacks;
+    bool m_checking = false;
+};
+
+typedef std::shared_ptr<existence_cache> existence_cache_ptr;
+
+
 #ifndef __WXOSX__
 
 class file_icons
@@ -300,10 +422,13 @@ public:
         }
     }
 
+    existence_cache_ptr GetExistenceCache() const { return m_existence; }
+
 private:
     menus_tracker<NSMenuItem> m_menus;
     NSMenu *m_recentMenu = nullptr;
     NSMenuItem *m_recentMenuItem = nullptr;
+    existence_cache_ptr m_existence = std::make_shared<existence_cache>();
 };
 
 #else // !__WXOSX__
@@ -316,23 +441,35 @@ class RecentFiles::impl
 public:
     impl()
         : m_icons_cache(new file_icons),
-          m_history(m_icons_cache)
+          m_existence(std::make_shared<existence_cache>()),
+          m_history(m_icons_cache, m_existence)
     {
         wxConfigBase *cfg = wxConfig::Get();
         cfg->SetPath("/");
         m_history.Load(*cfg);
     }
 
+    ~impl()
+    {
+        // menus must not be updated after destruction:
+        m_existence->forget_callbacks();
+    }
+
     void UseMenu(wxMenuItem *menuItem)
     {
         auto menu = menuItem->GetSubMenu();
         m_menus.add(menuItem, menu);
 
         RebuildMenu(menu);
+        CheckExistence();
 
         menu->Bind(wxEVT_MENU, [=](wxCommandEvent& e)
         {
-            auto f = GetRecentFiles()[e.GetId() - wxID_FILE1].GetFullPath();
+            auto& files = m_history.GetMenuFiles();
+            const size_t index = e.GetId() - wxID_FILE1;
+            if (index >= files.size())
+                return;
+            auto f = files[index].GetFullPath();
             if (!wxFileExists(f))
             {
                 wxLogError(_(L"File “%s” doesn’t exist."), f.c_str());
@@ -375,6 +512,7 @@ public:
     }
 
     file_icons_ptr GetIconsCache() const { return m_icons_cache; }
+    existence_cache_ptr GetExistenceCache() const { return m_existence; }
 
 protected:
     void RebuildMenu(wxMenu *menu)
@@ -395,10 +533,22 @@ protected:
 
     }
 
+    void RebuildAllMenus()
+    {
+        m_menus.for_all([=](wxMenu *menu){ RebuildMenu(menu); });
+    }
+
+    // Rebuilds the menus if checking files in the background finds any missing
+    void CheckExistence()
+    {
+        m_existence->refresh(m_history.GetRecentFiles(), [=]{ RebuildAllMenus(); });
+    }
+
     void UpdateAfterChange()
     {
         // Update all menus with visible history:
-        m_menus.for_all([=](wxMenu *menu){ RebuildMenu(menu); });
+        RebuildAllMenus();
+        CheckExistence();
 
         // Save the changes to persistent storage:
         wxConfigBase *cfg = wxConfig::Get();
@@ -410,23 +560,27 @@ protected:
     class MyHistory : public wxFileHistory
     {
     public:
-        MyHistory(file_icons_ptr icons_cache) : m_icons_cache(icons_cache) {}
+        MyHistory(file_icons_ptr icons_cache, existence_cache_ptr existence)
+            : m_icons_cache(icons_cache), m_existence(existence) {}
 
         std::vector<wxFileName> GetRecentFiles()
         {
             std::vector<wxFileName> files;
             files.reserve(m_fileHistory.size());
             for (auto& f : m_fileHistory)
-            {
-                if (wxFileName::FileExists(f))
-                    files.emplace_back(f);
-            }
+                files.emplace_back(f);
             return files;
         }
 
+        /// Files shown in menus by the last AddFilesToMenu() call
+        const std::vector<wxFileName>& GetMenuFiles() const { return m_menuFiles; }
+
         void AddFilesToMenu(wxMenu *menu) override
         {
-            auto files = GetRecentFiles();
+            // files known to be missing aren't shown, but existence is never
+            // checked here, because that could block the UI for a long time:
+            m_menuFiles = m_existence->filter(GetRecentFiles());
+            auto& files = m_menuFiles;
 
             std::map<wxString, int> nameUses;
             for (auto& f : files)
@@ -457,12 +611,15 @@ protected:
         }
 
         file_icons_ptr m_icons_cache;
+        existence_cache_ptr m_existence;
+        std::vector<wxFileName> m_menuFiles;
     };
 
 private:
     const wxWindowID m_idClear = wxNewId();
 
     file_icons_ptr m_icons_cache;
+    existence_cache_ptr m_existence;
     MyHistory m_history;
     menus_tracker<wxMenu> m_menus;
 };
@@ -512,7 +669,7 @@ void RecentFiles::NoteRecentFile(const wxFileName& fn)
 
 std::vector<wxFileName> RecentFiles::GetRecentFiles()
 {
-    return m_impl->GetRecentFiles();
+    return m_impl->GetExistenceCache()->filter(m_impl->GetRecentFiles());
 }
 
 
@@ -571,10 +728,27 @@ RecentFilesCtrl::RecentFilesCtrl(wxWindow *parent)
 }
 
 void RecentFilesCtrl::RefreshContent()
+{
+    // Checking that the files still exist can be slow (e.g. on network drives)
+    // and shouldn't delay showing the window, so show what is known right away
+    // and update the list if checking in the background finds missing files:
+    auto existence = RecentFiles::Get().m_impl->GetExistenceCache();
+    auto candidates = RecentFiles::Get().m_impl->GetRecentFiles();
+    ShowFiles(existence->filter(candidates));
+
+    wxWeakRef<RecentFilesCtrl> self(this);
+    existence->refresh(candidates, [=]
+    {
+        if (self)
+            self->ShowFiles(existence->filter(candidates));
+    });
+}
+
+void RecentFilesCtrl::ShowFiles(const std::vector<wxFileName>& files)
 {
     DeleteAllItems();
 
-    m_data->files = RecentFiles::Get().GetRecentFiles();
+    m_data->files = files;
     for (auto f : m_data->files)
     {
 #ifdef __WXOSX__
@@ -58,6 +58,8 @@ public:
     /// Record a file as being recently edited.
     void NoteRecentFile(const wxFileName& fn);
 
+    /// Returns recent files, except for those already known to not exist.
+    /// Their existence is only checked in the background.
     std::vector<wxFileName> GetRecentFiles();
 
 #ifdef __WXOSX__
@@ -85,6 +87,7 @@ public:
 
 private:
     void RefreshContent();
+    void ShowFiles(const std::vector<wxFileName>& files);
     void OnActivate(wxDataViewEvent& event);
 
     struct data;
@@ -108,20 +108,22 @@ SidebarBlock::SidebarBlock(Sidebar *parent, const wxString& label, int flags)
 void SidebarBlock::Show(bool show)
 {
     m_sizer->ShowItems(show);
+    m_shown = show;
 }
 
-void SidebarBlock::SetItem(const CatalogItemPtr& item)
+bool SidebarBlock::SetItem(const CatalogItemPtr& item)
 {
-    if (!item)
+    const bool use = item && ShouldShowForItem(item);
+    bool changed = use && Update(item);
+
+    // showing or hiding the items is costly, don't repeat it needlessly:
+    if (use != m_shown)
     {
-        Show(false);
-        return;
+        Show(use);
+        changed = true;
     }
 
-    bool use = ShouldShowForItem(item);
-    if (use)
-        Update(item);
-    Show(use);
+    return changed;
 }
 
 
@@ -145,9 +147,9 @@ public:
         return item->HasOldMsgid();
     }
 
-    void Update(const CatalogItemPtr& item) override
+    bool Update(const CatalogItemPtr& item) override
     {
-        m_text->SetAndWrapLabel(item->GetOldMsgid());
+        return m_text->SetAndWrapLabel(item->GetOldMsgid());
     }
 
 private:
@@ -171,7 +173,7 @@ public:
         return item->HasExtractedComments();
     }
 
-    void Update(const CatalogItemPtr& item) override
+    bool Update(const CatalogItemPtr& item) override
     {
         auto comment = wxJoin(item->GetExtractedComments(), '\n', '\0');
         if (comment.starts_with("TRANSLATORS:") || comment.starts_with("translators:"))
@@ -180,7 +182,7 @@ public:
             if (!comment.empty() && comment[0] == ' ')
                 comment.Remove(0, 1);
         }
-        m_comment->SetAndWrapLabel(comment);
+        return m_comment->SetAndWrapLabel(comment);
     }
 
 private:
@@ -204,11 +206,11 @@ public:
         return item->HasComment();
     }
 
-    void Update(const CatalogItemPtr& item) override
+    bool Update(const CatalogItemPtr& item) override
     {
         auto text = CommentDialog::RemoveStartHash(item->GetComment());
         text.Trim();
-        m_comment->SetAndWrapLabel(text);
+        return m_comment->SetAndWrapLabel(text);
     }
 
 private:
@@ -238,7 +240,7 @@ public:
         return m_parent->FileHasCapability(Catalog::Cap::UserComments);
     }
 
-    void Update(const CatalogItemPtr& item) override
+    bool Update(const CatalogItemPtr& item) override
     {
     #ifdef __WXMSW__
         auto add = _("Add comment");
@@ -247,7 +249,11 @@ public:
         auto add = _("Add Comment");
         auto edit = _("Edit Comment");
     #endif
-        m_btn->SetLabel(item->HasComment() ? edit : add);
+        auto label = item->HasComment() ? edit : add;
+        if (m_btn->GetLabel() == label)
+            return false;
+        m_btn->SetLabel(label);
+        return true;
     }
 
 private:
@@ -620,6 +626,9 @@ wxString SuggestionsSidebarBlock::GetTooltipForSuggestion(const Suggestion&) con
 
 void SuggestionsSidebarBlock::ClearMessage()
 {
+    if (!m_msgPresent)
+        return;
+
     m_msgPresent = false;
     m_msgText->SetAndWrapLabel("");
     UpdateVisibility();
@@ -830,12 +839,22 @@ bool SuggestionsSidebarBlock::ShouldShowForItem(const CatalogItemPtr&) const
            Config::UseTM();
 }
 
-void SuggestionsSidebarBlock::Update(const CatalogItemPtr& item)
+bool SuggestionsSidebarBlock::Update(const CatalogItemPtr& item)
 {
+    // any queries still running are for the previous item and can be dropped:
+    if (m_queryCancellation)
+    {
+        m_queryCancellation->cancel();
+        m_queryCancellation.reset();
+    }
+
     ClearMessage();
     ClearSuggestions();
 
     UpdateSuggestionsForItem(item);
+
+    // the block fills available space and lays out its own content
+    return false;
 }
 
 void SuggestionsSidebarBlock::UpdateSuggestionsForItem(CatalogItemPtr item)
@@ -893,12 +912,19 @@ void SuggestionsSidebarBlock::QueryAllProviders(const CatalogItemPtr& item)
 {
     auto thisQueryId = ++m_latestQueryId;
 
+    if (m_queryCancellation)
+        m_queryCancellation->cancel();
+    m_queryCancellation = std::make_shared<dispatch::cancellation_token>();
+
     // At this point, we know we're not interested in any older results, but some might have
     // arrived asynchronously in between ClearSuggestions() call and now. So make sure there
     // are no old suggestions present right after increasing the query ID:
     m_suggestions.clear();
 
-    QueryProvider(TranslationMemory::Get(), item, thisQueryId);
+    // all backends are queried concurrently and their results are shown as
+    // they arrive:
+    for (auto backend: SuggestionsProvider::GetBackends())
+        QueryProvider(*backend, item, thisQueryId);
 }
 
 void SuggestionsSidebarBlock::QueryProvider(SuggestionsBackend& backend, const CatalogItemPtr& item, uint64_t queryId)
@@ -916,7 +942,7 @@ void SuggestionsSidebarBlock::QueryProvider(SuggestionsBackend& backend, const C
         item->GetString().ToStdWstring()
     };
 
-    m_provider->SuggestTranslation(backend, std::move(query))
+    m_provider->SuggestTranslation(backend, std::move(query), m_queryCancellation)
     .then_on_main([weakSelf,queryId](SuggestionsList hits)
     {
         auto self = weakSelf.lock();
@@ -925,7 +951,10 @@ void SuggestionsSidebarBlock::QueryProvider(SuggestionsBackend& backend, const C
             return;
         self->UpdateSuggestions(hits);
         if (--self->m_pendingQueries == 0)
+        {
             self->OnQueriesFinished();
+            self->PrefetchUpcomingItems();
+        }
     })
     .catch_all([weakSelf,queryId,backendPtr](dispatch::exception_ptr e)
     {
@@ -940,6 +969,31 @@ void SuggestionsSidebarBlock::QueryProvider(SuggestionsBackend& backend, const C
 }
 
 
+void SuggestionsSidebarBlock::PrefetchUpcomingItems()
+{
+    // cancel previous prefetching, if still in progress, as it was for
+    // items further up in the list:
+    if (m_prefetchCancellation)
+        m_prefetchCancellation->cancel();
+    m_prefetchCancellation.reset();
+
+    auto& upcoming = m_parent->GetUpcomingItems();
+    if (upcoming.empty())
+        return;
+
+    m_prefetchCancellation = std::make_shared<dispatch::cancellation_token>();
+
+    auto srclang = m_parent->GetCurrentSourceLanguage();
+    auto lang = m_parent->GetCurrentLanguage();
+    for (auto& item: upcoming)
+    {
+        SuggestionQuery query {srclang, lang, item->GetString().ToStdWstring()};
+        // results are discarded, they end up in SuggestionsProvider's cache:
+        m_provider->SuggestTranslation(TranslationMemory::Get(), std::move(query), m_prefetchCancellation)
+                   .catch_all([](dispatch::exception_ptr){});
+    }
+}
+
 
 Sidebar::Sidebar(wxWindow *parent, wxMenu *suggestionsMenu)
     : wxWindow(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxTAB_TRAVERSAL | wxNO_BORDER | wxFULL_REPAINT_ON_RESIZE),
@@ -1002,10 +1056,12 @@ Sidebar::~Sidebar()
 }
 
 
-void Sidebar::SetSelectedItem(const CatalogPtr& catalog, const CatalogItemPtr& item)
+void Sidebar::SetSelectedItem(const CatalogPtr& catalog, const CatalogItemPtr& item,
+                              const std::vector<CatalogItemPtr>& upcoming)
 {
     m_catalog = catalog;
     m_selectedItem = item;
+    m_upcomingItems = upcoming;
     RefreshContent();
 }
 
@@ -1043,9 +1099,18 @@ void Sidebar::RefreshContent()
         item = nullptr;
 
     wxWindowUpdateLocker lock(this);
+
+    // Lay out everything just once, after all blocks were updated, and not
+    // at all if moving to another item didn't change anything visible (e.g.
+    // when going through items without comments):
+    bool needsLayout = false;
     for (auto& b: m_blocks)
-        b->SetItem(item);
-    Layout();
+    {
+        if (b->SetItem(item))
+            needsLayout = true;
+    }
+    if (needsLayout)
+        Layout();
 }
 
 void Sidebar::SetUpperHeight(int size)
@@ -63,11 +63,18 @@ public:
 
     virtual void Show(bool show);
 
-    void SetItem(const CatalogItemPtr& item);
+    /**
+        Shows @a item in the block or hides the block if it isn't relevant.
+
+        Returns true if the block's size may have changed, i.e. the sidebar
+        needs to be laid out again.
+     */
+    bool SetItem(const CatalogItemPtr& item);
 
     virtual bool ShouldShowForItem(const CatalogItemPtr& item) const = 0;
 
-    virtual void Update(const CatalogItemPtr& item) = 0;
+    /// Updates content for @a item; returns true if it changed in a way that affects layout.
+    virtual bool Update(const CatalogItemPtr& item) = 0;
 
     virtual bool IsGrowable() const { return false; }
 
@@ -84,6 +91,9 @@ protected:
     wxSizer *m_headerSizer;
     wxSizer *m_innerSizer;
     wxSizer *m_sizer;
+
+private:
+    bool m_shown = true;
 };
 
 
@@ -105,7 +115,7 @@ public:
     void Show(bool show) override;
     bool IsGrowable() const override { return true; }
     bool ShouldShowForItem(const CatalogItemPtr& item) const override;
-    void Update(const CatalogItemPtr& item) override;
+    bool Update(const CatalogItemPtr& item) override;
 
 protected:
     SuggestionsSidebarBlock(Sidebar *parent, wxMenu *menu);
@@ -135,6 +145,10 @@ protected:
     virtual void QueryAllProviders(const CatalogItemPtr& item);
     void QueryProvider(SuggestionsBackend& backend, const CatalogItemPtr& item, uint64_t queryId);
 
+    // Queries suggestions for items likely to be selected next in the
+    // background, so that they are cached by the time they are needed
+    void PrefetchUpcomingItems();
+
     // Handle showing of suggestions
     void UpdateSuggestionsForItem(CatalogItemPtr item);
     void OnDelayedShowSuggestionsForItem(wxTimerEvent& e);
@@ -162,6 +176,9 @@ protected:
     std::vector<wxMenuItem*> m_suggestionMenuItems;
     int m_pendingQueries;
     uint64_t m_latestQueryId;
+    // cancels outstanding queries when they are superseded by newer ones:
+    dispatch::cancellation_token_ptr m_queryCancellation;
+    dispatch::cancellation_token_ptr m_prefetchCancellation;
 
     // delayed showing of suggestions:
     long long m_lastUpdateTime;
@@ -181,14 +198,23 @@ public:
     Sidebar(wxWindow *parent, wxMenu *suggestionsMenu);
     ~Sidebar();
 
-    /// Update selected item, if there's a single one. May be nullptr.
-    void SetSelectedItem(const CatalogPtr& catalog, const CatalogItemPtr& item);
+    /**
+        Update selected item, if there's a single one. May be nullptr.
+
+        @param upcoming Items that follow @a item in the list's display order,
+                        i.e. those the user is likely to select next. Used to
+                        prefetch data (such as suggestions) for them.
+     */
+    void SetSelectedItem(const CatalogPtr& catalog, const CatalogItemPtr& item,
+                         const std::vector<CatalogItemPtr>& upcoming = std::vector<CatalogItemPtr>());
 
     /// Tell the sidebar there's multiple selection.
     void SetMultipleSelection();
 
     /// Returns currently selected item
     CatalogItemPtr GetSelectedItem() const { return m_selectedItem; }
+    /// Returns items likely to be selected next, see SetSelectedItem()
+    const std::vector<CatalogItemPtr>& GetUpcomingItems() const { return m_upcomingItems; }
     Language GetCurrentSourceLanguage() const;
     Language GetCurrentLanguage() const;
     CatalogPtr GetCatalog() const { return m_catalog; }
@@ -217,6 +243,7 @@ private:
 private:
     CatalogPtr m_catalog;
     CatalogItemPtr m_selectedItem;
+    std::vector<CatalogItemPtr> m_upcomingItems;
 
     std::vector<std::shared_ptr<SidebarBlock>> m_blocks;
 
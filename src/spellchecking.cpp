@@ -32,6 +32,11 @@
     extern "C" {
     #include <gtkspell/gtkspell.h>
     }
+    #include <set>
+    #include <string>
+    #ifdef HAVE_ENCHANT
+        #include <enchant.h>
+    #endif
 #endif
 
 #ifdef __WXMSW__
@@ -40,9 +45,15 @@
     #ifndef IMF_SPELLCHECKING
         #define IMF_SPELLCHECKING 0x0800
     #endif
+    #include <objbase.h>
+    #include <spellcheck.h>
 #endif
 
 #include "edapp.h"
+#include "unicode_helpers.h"
+
+#include <cwctype>
+#include <map>
 
 
 #ifdef __WXGTK__
@@ -75,13 +86,38 @@ bool InitTextCtrlSpellchecker(wxTextCtrl *text, bool enable, const Language& lan
 
     if (enable)
     {
+        // Loading a dictionary is slow, so languages known not to have one are
+        // remembered (for all windows) and not tried again:
+        static std::set<std::string> s_missingDictionaries;
+        const std::string code = lang.Code();
+        if (s_missingDictionaries.count(code))
+        {
+            if (spell)
+                gtk_spell_checker_detach(spell);
+            return false;
+        }
+
         if (!spell)
         {
             spell = gtk_spell_checker_new();
             gtk_spell_checker_attach(spell, textview);
         }
+        else
+        {
+            // don't reload the dictionary if it's already in use:
+            const char *current = gtk_spell_checker_get_language(spell);
+            if (current && code == current)
+                return true;
+        }
 
-        return gtk_spell_checker_set_language(spell, lang.Code().c_str(), nullptr);
+        if (!gtk_spell_checker_set_language(spell, code.c_str(), nullptr))
+        {
+            // as the UI says, spellchecking is disabled without a dictionary:
+            s_missingDictionaries.insert(code);
+            gtk_spell_checker_detach(spell);
+            return false;
+        }
+        return true;
     }
     else
     {
@@ -189,3 +225,323 @@ void ShowSpellcheckerHelp()
     wxGetApp().OpenPoeditWeb("/trac/wiki/Doc/" SPELL_HELP_PAGE);
 }
 #endif // !__WXMSW__
+
+
+
+// ----------------------------------------------------------------------------
+// SpellChecker
+// ----------------------------------------------------------------------------
+
+namespace
+{
+
+// Don't let the cache grow without bounds on huge files with rich vocabulary
+const size_t MAX_CACHED_WORDS = 200000;
+
+// Only words with letters are checked, not numbers or identifiers
+bool ShouldCheckWord(const std::wstring& word)
+{
+    if (word.length() < 2)
+        return false;
+
+    for (size_t i = 0; i < word.length(); ++i)
+    {
+        auto c = word[i];
+        if (std::iswdigit(c) || c == L'_')
+            return false;
+        // camelCase or ALLCAPS words are typically names or acronyms
+        if (i > 0 && std::iswupper(c))
+            return false;
+    }
+
+    return true;
+}
+
+// Break iterators are expensive to create, so reuse one per thread and language
+unicode::BreakIterator& GetWordIterator(const Language& lang)
+{
+    thread_local std::map<std::string, std::unique_ptr<unicode::BreakIterator>> iterators;
+    auto& bi = iterators[lang.Code()];
+    if (!bi)
+        bi.reset(new unicode::BreakIterator(UBRK_WORD, lang));
+    return *bi;
+}
+
+} // anonymous namespace
+
+
+#if defined(__WXGTK__) && defined(HAVE_ENCHANT)
+
+class SpellChecker::Backend
+{
+public:
+    static std::unique_ptr<Backend> Create(const Language& lang)
+    {
+        auto broker = enchant_broker_init();
+        if (!broker)
+            return nullptr;
+
+        for (auto& tag: {lang.Code(), lang.Lang()})
+        {
+            if (!enchant_broker_dict_exists(broker, tag.c_str()))
+                continue;
+            auto dict = enchant_broker_request_dict(broker, tag.c_str());
+            if (dict)
+                return std::unique_ptr<Backend>(new Backend(broker, dict));
+        }
+
+        enchant_broker_free(broker);
+        return nullptr;
+    }
+
+    ~Backend()
+    {
+        enchant_broker_free_dict(m_broker, m_dict);
+        enchant_broker_free(m_broker);
+    }
+
+    bool IsCorrect(const std::wstring& word)
+    {
+        auto utf8 = str::to_utf8(word);
+        return enchant_dict_check(m_dict, utf8.c_str(), utf8.length()) == 0;
+    }
+
+private:
+    Backend(EnchantBroker *broker, EnchantDict *dict) : m_broker(broker), m_dict(dict) {}
+
+    EnchantBroker *m_broker;
+    EnchantDict *m_dict;
+};
+
+#elif defined(__WXOSX__)
+
+class SpellChecker::Backend
+{
+public:
+    static std::unique_ptr<Backend> Create(const Language& lang)
+    {
+        @autoreleasepool
+        {
+            NSArray *available = [[NSSpellChecker sharedSpellChecker] availableLanguages];
+            for (auto& tag: {lang.LangAndCountry(), lang.Lang()})
+            {
+                NSString *nstag = str::to_NS(tag);
+                if ([available containsObject:nstag])
+                    return std::unique_ptr<Backend>(new Backend(nstag));
+            }
+        }
+        return nullptr;
+    }
+
+    bool IsCorrect(const std::wstring& word)
+    {
+        @autoreleasepool
+        {
+            NSRange misspelled = [[NSSpellChecker sharedSpellChecker] checkSpellingOfString:str::to_NS(word)
+                                                                                 startingAt:0
+                                                                                   language:m_lang
+                                                                                       wrap:NO
+                                                                     inSpellDocumentWithTag:0
+                                                                                  wordCount:nullptr];
+            return misspelled.location == NSNotFound;
+        }
+    }
+
+private:
+    Backend(NSString *lang) : m_lang(lang) {}
+
+    NSString *m_lang;
+};
+
+#elif defined(__WXMSW__)
+
+class SpellChecker::Backend
+{
+public:
+    static std::unique_ptr<Backend> Create(const Language& lang)
+    {
+        ComScope com;
+
+        ISpellCheckerFactory *factory = nullptr;
+        if (FAILED(CoCreateInstance(__uuidof(SpellCheckerFactory), nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory))))
+            return nullptr;
+
+        auto tag = str::to_wstring(lang.LanguageTag());
+        BOOL supported = FALSE;
+        ISpellChecker *checker = nullptr;
+        if (SUCCEEDED(factory->IsSupported(tag.c_str(), &supported)) && supported)
+            factory->CreateSpellChecker(tag.c_str(), &checker);
+        factory->Release();
+
+        if (!checker)
+            return nullptr;
+        return std::unique_ptr<Backend>(new Backend(checker));
+    }
+
+    ~Backend()
+    {
+        m_checker->Release();
+    }
+
+    bool IsCorrect(const std::wstring& word)
+    {
+        ComScope com;
+
+        IEnumSpellingError *errors = nullptr;
+        if (FAILED(m_checker->Check(word.c_str(), &errors)))
+            return true;
+
+        ISpellingError *error = nullptr;
+        const bool correct = errors->Next(&error) != S_OK;
+        if (error)
+            error->Release();
+        errors->Release();
+        return correct;
+    }
+
+private:
+    // worker threads may not have COM initialized yet
+    struct ComScope
+    {
+        ComScope() : ok(SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED))) {}
+        ~ComScope() { if (ok) CoUninitialize(); }
+        bool ok;
+    };
+
+    Backend(ISpellChecker *checker) : m_checker(checker) {}
+
+    ISpellChecker *m_checker;
+};
+
+#else
+
+// No spellchecker usable outside of text controls is available
+class SpellChecker::Backend
+{
+public:
+    static std::unique_ptr<Backend> Create(const Language&) { return nullptr; }
+    bool IsCorrect(const std::wstring&) { return true; }
+};
+
+#endif
+
+
+std::shared_ptr<SpellChecker> SpellChecker::GetFor(const Language& lang)
+{
+    if (!lang.IsValid() || !IsSpellcheckingAvailable())
+        return nullptr;
+
+    static std::mutex s_mutex;
+    static std::map<std::string, std::shared_ptr<SpellChecker>> s_checkers;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto found = s_checkers.find(lang.Code());
+    if (found != s_checkers.end())
+        return found->second;
+
+    // remember unavailable languages too, so that lookups aren't repeated
+    std::shared_ptr<SpellChecker> checker;
+    auto backend = Backend::Create(lang);
+    if (backend)
+        checker.reset(new SpellChecker(lang, std::move(backend)));
+    s_checkers.emplace(lang.Code(), checker);
+    return checker;
+}
+
+
+SpellChecker::SpellChecker(const Language& lang, std::unique_ptr<Backend>&& backend)
+    : m_lang(lang), m_backend(std::move(backend)),
+      m_cacheRegistration("spellchecker words",
+                          [this]
+                          {
+                              std::lock_guard<std::mutex> lock(m_mutex);
+                              size_t size = m_cache.bucket_count() * sizeof(void*);
+                              for (auto& w: m_cache)
+                                  size += sizeof(w) + 2 * sizeof(void*) + w.first.capacity() * sizeof(wchar_t);
+                              return size;
+                          },
+                          [this](CacheRegistry::Pressure pressure)
+                          {
+                              // words are relatively expensive to check again, so keep them unless necessary
+                              if (pressure != CacheRegistry::Pressure::Critical)
+                                  return;
+                              std::lock_guard<std::mutex> lock(m_mutex);
+                              m_cache = std::unordered_map<std::wstring, bool>();
+                          })
+{
+}
+
+SpellChecker::~SpellChecker()
+{
+}
+
+
+bool SpellChecker::IsCorrect(const std::wstring& word)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto found = m_cache.find(word);
+    if (found != m_cache.end())
+        return found->second;
+
+    const bool correct = m_backend->IsCorrect(word);
+    if (m_cache.size() >= MAX_CACHED_WORDS)
+        m_cache.clear();
+    m_cache.emplace(word, correct);
+    return correct;
+}
+
+
+bool SpellChecker::FindMisspelledWord(const wxString& text,
+                                      const wxString& source,
+                                      const SyntaxHighlighterPtr& highlighter,
+                                      wxString& word)
+{
+    if (text.empty())
+        return false;
+
+    // blank out placeholders, markup etc. so that they aren't seen as words
+    const auto original = text.ToStdWstring();
+    auto masked = original;
+    if (highlighter)
+    {
+        highlighter->Highlight(original, [&masked](int a, int b, SyntaxHighlighter::TextKind)
+        {
+            std::fill(masked.begin() + a, masked.begin() + b, L' ');
+        });
+    }
+
+    auto buf = str::to_icu(masked);
+    const UChar *data = buf;
+
+    auto& bi = GetWordIterator(m_lang);
+    bi.set_text(data);
+
+    bool misspelled = false;
+    int32_t start = bi.begin();
+    for (int32_t end = bi.next(); end != bi.end(); start = end, end = bi.next())
+    {
+        if (bi.rule() < UBRK_WORD_LETTER || bi.rule() >= UBRK_WORD_LETTER_LIMIT)
+            continue;
+
+        auto w = str::to_wx(data + start, end - start);
+        auto wstr = w.ToStdWstring();
+        if (!ShouldCheckWord(wstr))
+            continue;
+        // untranslated names and terms are often copied from the source
+        if (source.find(w) != wxString::npos)
+            continue;
+
+        if (!IsCorrect(wstr))
+        {
+            word = w;
+            misspelled = true;
+            break;
+        }
+    }
+
+    // don't keep pointer to the local buffer in the reused iterator
+    static const UChar empty[1] = {0};
+    bi.set_text(empty);
+    return misspelled;
+}
@@ -34,7 +34,14 @@
 
 #include <wx/textctrl.h>
 
+#include "cache_registry.h"
 #include "language.h"
+#include "syntaxhighlighter.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 inline bool IsSpellcheckingAvailable()
 {
@@ -63,4 +70,58 @@ bool InitTextCtrlSpellchecker(wxTextCtrl *text, bool enable, const Language& lan
 void ShowSpellcheckerHelp();
 #endif
 
+
+/**
+    Spellchecker for checking whole texts outside of text controls, e.g. for
+    checking all translations in a catalog in the background.
+
+    Uses the platform's spellchecker (Enchant on Linux). Results are cached
+    per word, so checking texts with repeated vocabulary is cheap. Instances
+    are thread-safe.
+ */
+class SpellChecker
+{
+public:
+    /**
+        Returns spellchecker for given language, or nullptr if spellchecking
+        whole texts isn't available for it (e.g. no dictionary is installed).
+
+        There's only one instance for any language. Thread-safe.
+     */
+    static std::shared_ptr<SpellChecker> GetFor(const Language& lang);
+
+    ~SpellChecker();
+
+    /**
+        Checks @a text and returns the first misspelled word in @a word.
+
+        Parts of the text highlighted by @a highlighter (placeholders, markup
+        etc.) are skipped, as are words that look like identifiers or are
+        contained in @a source, because those are usually left untranslated.
+
+        @return true if a misspelled word was found.
+     */
+    bool FindMisspelledWord(const wxString& text,
+                            const wxString& source,
+                            const SyntaxHighlighterPtr& highlighter,
+                            wxString& word);
+
+private:
+    class Backend;
+
+    SpellChecker(const Language& lang, std::unique_ptr<Backend>&& backend);
+
+    bool IsCorrect(const std::wstring& word);
+
+    Language m_lang;
+    std::unique_ptr<Backend> m_backend;
+
+    // cache of IsCorrect() results; also guards m_backend, which may not be
+    // thread-safe
+    std::mutex m_mutex;
+    std::unordered_map<std::wstring, bool> m_cache;
+
+    CacheRegistry::Registration m_cacheRegistration;
+};
+
 #endif // Poedit_spellchecking_h
@@ -26,11 +26,19 @@
 #ifndef Poedit_str_helpers_h
 #define Poedit_str_helpers_h
 
+#include <cstdint>
+#include <iterator>
 #include <string>
+#include <string_view>
 #include <utility>
 
 #include <boost/locale/encoding_utf.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define POEDIT_STR_HELPERS_SSE2
+#endif
+
 #ifdef __OBJC__
     #include <Foundation/NSString.h>
 #endif
@@ -56,18 +64,132 @@
         - to_wstring(...)
         - to_utf8(...)
         - to_NSString()
+
+    To reuse buffers in loops, use the variants that write into a
+    caller-provided string: to_utf8(in, out), to_wstring(in, out),
+    append_utf8(out, in) and append_wstring(out, in).
  */
 namespace str
 {
 
+namespace detail
+{
+
+// Returns length of the leading pure ASCII part of the string
+inline size_t ascii_prefix_length(const char *s, size_t len)
+{
+    size_t i = 0;
+#ifdef POEDIT_STR_HELPERS_SSE2
+    for (; i + 16 <= len; i += 16)
+    {
+        if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i))) != 0)
+            break;
+    }
+#endif
+    while (i < len && static_cast<unsigned char>(s[i]) < 0x80)
+        i++;
+    return i;
+}
+
+inline size_t ascii_prefix_length(const wchar_t *s, size_t len)
+{
+    size_t i = 0;
+    // check blocks of characters at once, compilers vectorize this:
+    for (; i + 8 <= len; i += 8)
+    {
+        uint32_t bits = 0;
+        for (size_t j = 0; j < 8; j++)
+            bits |= static_cast<uint32_t>(s[i + j]);
+        if (bits >= 0x80)
+            break;
+    }
+    while (i < len && static_cast<uint32_t>(s[i]) < 0x80)
+        i++;
+    return i;
+}
+
+// Converts between UTF encodings, ill-formed input is skipped (as with
+// boost::locale::conv::utf_to_utf()). ASCII text is just copied.
+template<typename CharOut, typename CharIn>
+inline void append_utf(std::basic_string<CharOut>& out, const CharIn *begin, const CharIn *end)
+{
+    using namespace boost::locale;
+
+    const size_t ascii = ascii_prefix_length(begin, end - begin);
+    const size_t start = out.size();
+    out.resize(start + ascii);
+    for (size_t i = 0; i < ascii; i++)
+        out[start + i] = static_cast<CharOut>(begin[i]);
+    begin += ascii;
+
+    if (begin == end)
+        return;
+
+    out.reserve(out.size() + (end - begin));
+    auto inserter = std::back_inserter(out);
+    while (begin != end)
+    {
+        if (static_cast<uint32_t>(*begin) < 0x80)
+        {
+            out.push_back(static_cast<CharOut>(*begin++));
+            continue;
+        }
+        auto c = utf::utf_traits<CharIn>::decode(begin, end);
+        if (c != utf::illegal && c != utf::incomplete)
+            utf::utf_traits<CharOut>::encode(c, inserter);
+    }
+}
+
+} // namespace detail
+
+/**
+    Appends UTF-8 representation of @a str to @a out.
+
+    Unlike to_utf8(), this doesn't allocate if @a out has enough capacity
+    and is intended for reusing buffers in loops.
+ */
+inline void append_utf8(std::string& out, std::wstring_view str)
+{
+    detail::append_utf(out, str.data(), str.data() + str.size());
+}
+
+/// Like append_utf8(), but replaces the content of @a out.
+inline void to_utf8(std::wstring_view str, std::string& out)
+{
+    out.clear();
+    append_utf8(out, str);
+}
+
+/**
+    Appends wide string representation of UTF-8 @a utf8str to @a out.
+
+    Unlike to_wstring(), this doesn't allocate if @a out has enough capacity
+    and is intended for reusing buffers in loops.
+ */
+inline void append_wstring(std::wstring& out, std::string_view utf8str)
+{
+    detail::append_utf(out, utf8str.data(), utf8str.data() + utf8str.size());
+}
+
+/// Like append_wstring(), but replaces the content of @a out.
+inline void to_wstring(std::string_view utf8str, std::wstring& out)
+{
+    out.clear();
+    append_wstring(out, utf8str);
+}
+
 inline std::string to_utf8(const std::wstring& str)
 {
-    return boost::locale::conv::utf_to_utf<char>(str);
+    std::string out;
+    append_utf8(out, str);
+    return out;
 }
 
 inline std::string to_utf8(const wchar_t *str)
 {
-    return boost::locale::conv::utf_to_utf<char>(str);
+    std::string out;
+    append_utf8(out, str);
+    return out;
 }
 
 inline std::string to_utf8(const unsigned char *str)
@@ -77,17 +199,21 @@ inline std::string to_utf8(const unsigned char *str)
 
 inline std::wstring to_wstring(const std::string& utf8str)
 {
-    return boost::locale::conv::utf_to_utf<wchar_t>(utf8str);
+    std::wstring out;
+    append_wstring(out, utf8str);
+    return out;
 }
 
 inline std::wstring to_wstring(const char *utf8str)
 {
-    return boost::locale::conv::utf_to_utf<wchar_t>(utf8str);
+    std::wstring out;
+    append_wstring(out, utf8str);
+    return out;
 }
 
 inline std::wstring to_wstring(const unsigned char *utf8str)
 {
-    return boost::locale::conv::utf_to_utf<wchar_t>(utf8str);
+    return to_wstring(reinterpret_cast<const char*>(utf8str));
 }
 
 inline std::string to_utf8(const wxString& str)
@@ -95,6 +221,16 @@ inline std::string to_utf8(const wxString& str)
     return str.utf8_string();
 }
 
+/// Converts @a str to UTF-8 into @a out, reusing its buffer.
+inline void to_utf8(const wxString& str, std::string& out)
+{
+#if wxUSE_UNICODE_WCHAR
+    to_utf8(std::wstring_view(str.wx_str(), str.length()), out);
+#else
+    out = str.utf8_string();
+#endif
+}
+
 #if wxUSE_STD_STRING && wxUSE_UNICODE_WCHAR && wxUSE_STL_BASED_WXSTRING
 typedef const std::wstring& wstring_conv_t;
 #else
@@ -29,19 +29,113 @@
 #include "str_helpers.h"
 
 #include <unicode/uchar.h>
-#include <regex>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cwchar>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
 
 namespace
 {
 
+// Cost accounting of individual highlighters, reported by SyntaxHighlighter::GetDiagnosticsReport()
+class HighlighterCosts
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::atomic<uint64_t> Counter;
+
+    struct Entry
+    {
+        explicit Entry(const char *name_) : name(name_) {}
+
+        const char *name;
+        Counter calls {0}, chars {0}, us {0}, maxUs {0};
+    };
+
+    static HighlighterCosts& Get()
+    {
+        static HighlighterCosts s_instance;
+        return s_instance;
+    }
+
+    /// Creates entry for highlighter @a name, the entry lives forever
+    Entry *Register(const char *name)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.emplace_back(new Entry(name));
+        return m_entries.back().get();
+    }
+
+    std::string Report() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(2);
+        for (auto& e: m_entries)
+        {
+            const uint64_t calls = e->calls, chars = e->chars, us = e->us;
+            ss << e->name << ": " << us / 1000.0 << " ms"
+               << ", calls " << calls
+               << ", avg " << (calls ? double(us) / calls : 0.0) << " us/call"
+               << ", " << (chars ? double(us) * 1000 / chars : 0.0) << " us/kchar"
+               << ", slowest " << e->maxUs / 1000.0 << " ms\n";
+        }
+        return ss.str();
+    }
+
+private:
+    HighlighterCosts() {}
+
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<Entry>> m_entries;
+};
+
+// Measures single Highlight() call and records it in HighlighterCosts when done.
+class CostTimer
+{
+public:
+    CostTimer(HighlighterCosts::Entry *entry, size_t chars)
+        : m_entry(entry), m_chars(chars), m_start(HighlighterCosts::Clock::now())
+    {}
+
+    ~CostTimer()
+    {
+        const uint64_t us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(HighlighterCosts::Clock::now() - m_start).count();
+        m_entry->calls++;
+        m_entry->chars += m_chars;
+        m_entry->us += us;
+        uint64_t prevMax = m_entry->maxUs;
+        while (us > prevMax && !m_entry->maxUs.compare_exchange_weak(prevMax, us)) {}
+    }
+
+private:
+    HighlighterCosts::Entry *m_entry;
+    size_t m_chars;
+    HighlighterCosts::Clock::time_point m_start;
+};
+
+
 class BasicSyntaxHighlighter : public SyntaxHighlighter
 {
 public:
+    BasicSyntaxHighlighter() : m_costs(HighlighterCosts::Get().Register("basic")) {}
+
     void Highlight(const std::wstring& s, const CallbackType& highlight) override
     {
         if (s.empty())
             return;
 
+        CostTimer timer(m_costs, s.length());
+
         const int length = int(s.length());
 
         // Leading whitespace:
@@ -119,6 +213,9 @@ public:
             }
         }
     }
+
+private:
+    HighlighterCosts::Entry *m_costs;
 };
 
 
@@ -141,166 +238,483 @@ private:
 
 
 
-/// Match regular expressions for highlighting
-class RegexSyntaxHighlighter : public SyntaxHighlighter
+// Highlighting is done with hand-written scanners instead of std::regex: they
+// are much faster, can't fail with error_complexity or error_stack on long
+// strings (as MSVC's implementation does) and behave the same everywhere.
+//
+// Each scanner is given a position where a token may start (i.e. one of its
+// trigger characters) and returns the end of the token found there or nullptr
+// if there's none. They match the same texts as the regular expressions
+// documented above each of them.
+
+typedef const wchar_t* (*ScanFunc)(const wchar_t *p, const wchar_t *end);
+
+inline bool is_digit(wchar_t c) { return c >= '0' && c <= '9'; }
+inline bool is_ascii_alnum(wchar_t c) { return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+inline bool is_word(wchar_t c) { return c == '_' || u_isalnum(c); }
+inline bool is_space(wchar_t c) { return u_isspace(c); }
+inline bool is_line_terminator(wchar_t c) { return c == '\n' || c == '\r' || c == 0x2028 || c == 0x2029; }
+inline bool is_one_of(wchar_t c, const wchar_t *chars) { return c != 0 && wcschr(chars, c) != nullptr; }
+
+// Skips characters matching the predicate, returns new position
+template<typename Pred>
+inline const wchar_t *skip_while(const wchar_t *p, const wchar_t *end, Pred pred)
 {
-public:
-    static const std::wregex::flag_type flags = std::regex_constants::ECMAScript | std::regex_constants::optimize;
+    while (p < end && pred(*p))
+        p++;
+    return p;
+}
+
+inline const wchar_t *skip_digits(const wchar_t *p, const wchar_t *end)
+{
+    return skip_while(p, end, is_digit);
+}
 
-    RegexSyntaxHighlighter(const wchar_t *regex, TextKind kind) : m_re(regex, flags), m_kind(kind) {}
-    RegexSyntaxHighlighter(const std::wregex& regex, TextKind kind) : m_re(regex), m_kind(kind) {}
+inline bool at_one_of(const wchar_t *p, const wchar_t *end, const wchar_t *chars)
+{
+    return p < end && is_one_of(*p, chars);
+}
 
-    void Highlight(const std::wstring& s, const CallbackType& highlight) override
+// Matches ($N)? i.e. optional positional argument index
+inline const wchar_t *scan_positional(const wchar_t *p, const wchar_t *end)
+{
+    auto q = skip_digits(p, end);
+    return (q != p && q < end && *q == '$') ? q + 1 : p;
+}
+
+// Matches (\d+|\*)?
+inline const wchar_t *scan_width(const wchar_t *p, const wchar_t *end)
+{
+    if (p < end && *p == '*')
+        return p + 1;
+    return skip_digits(p, end);
+}
+
+// Matches (\.(\d+|\*))?
+inline const wchar_t *scan_precision(const wchar_t *p, const wchar_t *end)
+{
+    if (p + 1 < end && *p == '.' && (p[1] == '*' || is_digit(p[1])))
+        return scan_width(p + 1, end);
+    return p;
+}
+
+inline const wchar_t *scan_conversion(const wchar_t *p, const wchar_t *end, const wchar_t *conversions)
+{
+    return at_one_of(p, end, conversions) ? p + 1 : nullptr;
+}
+
+
+// (<\/?[a-zA-Z0-9:-]+(\s+[-:\w]+(=([-:\w+]|"[^"]*"|'[^']*'))?)*\s*\/?>)|(&[^ ;]+;)
+const wchar_t *scan_html_markup(const wchar_t *p, const wchar_t *end)
+{
+    auto is_tag_char = [](wchar_t c){ return is_ascii_alnum(c) || c == ':' || c == '-'; };
+    auto is_attr_char = [](wchar_t c){ return is_word(c) || c == ':' || c == '-'; };
+
+    if (*p == '&')
+    {
+        auto q = skip_while(p + 1, end, [](wchar_t c){ return c != ' ' && c != ';'; });
+        return (q != p + 1 && q < end && *q == ';') ? q + 1 : nullptr;
+    }
+
+    // else: '<'
+    p++;
+    if (p < end && *p == '/')
+        p++;
+    auto q = skip_while(p, end, is_tag_char);
+    if (q == p)
+        return nullptr;
+    p = q;
+
+    for (;;)
     {
-        try
+        q = skip_while(p, end, is_space);
+        if (q == p || q == end || !is_attr_char(*q))
+            break;
+        p = skip_while(q, end, is_attr_char);
+        if (p < end && *p == '=' && p + 1 < end)
         {
-            std::wsregex_iterator next(s.begin(), s.end(), m_re);
-            std::wsregex_iterator end;
-            while (next != end)
+            const wchar_t c = p[1];
+            if (is_attr_char(c) || c == '+')
             {
-                auto match = *next++;
-                if (match.empty())
-                    continue;
-                int pos = static_cast<int>(match.position());
-                highlight(pos, pos + static_cast<int>(match.length()), m_kind);
+                p += 2;
             }
-        }
-        catch (std::regex_error& e)
-        {
-            switch (e.code())
+            else if (c == '"' || c == '\'')
             {
-                case std::regex_constants::error_complexity:
-                case std::regex_constants::error_stack:
-                    // MSVC version of std::regex in particular can fail to match
-                    // e.g. HTML regex with backreferences on insanely large strings;
-                    // in that case, don't highlight instead of failing outright.
-                    return;
-                default:
-                    throw;
+                auto closing = std::find(p + 2, end, c);
+                if (closing != end)
+                    p = closing + 1;
             }
         }
     }
 
-private:
-    std::wregex m_re;
-    TextKind m_kind;
-};
+    p = skip_while(p, end, is_space);
+    if (p < end && *p == '/' && p + 1 < end && p[1] == '>')
+        p++;
+    return (p < end && *p == '>') ? p + 1 : nullptr;
+}
+const wchar_t *HTML_MARKUP_TRIGGER_CHARS = L"<&";
+
+
+// variables expansion for various template languages:
+//
+// %[\w.-]+%|%?\{[\w.-]+\}|\{\{[\w.-]+\}\}
+//     |            |             |
+//     |            |             +------- {{var}}
+//     |            +--------------------- %{var} (Ruby) and {var}
+//     +---------------------------------- %var% (Twig)
+//
+const wchar_t *scan_common_placeholders(const wchar_t *p, const wchar_t *end)
+{
+    auto is_var_char = [](wchar_t c){ return is_word(c) || c == '.' || c == '-'; };
+
+    // matches `open` var `close` at p, where `close` is 1 or 2 characters long
+    auto var = [=](const wchar_t *q, wchar_t close, bool doubled) -> const wchar_t*
+    {
+        auto v = skip_while(q, end, is_var_char);
+        if (v == q || v == end || *v != close)
+            return nullptr;
+        if (!doubled)
+            return v + 1;
+        return (v + 1 < end && v[1] == close) ? v + 2 : nullptr;
+    };
+
+    if (*p == '%')
+    {
+        if (auto r = var(p + 1, '%', false))
+            return r;
+        if (p + 1 < end && p[1] == '{')
+            return var(p + 2, '}', false);
+        return nullptr;
+    }
 
+    // else: '{'
+    if (auto r = var(p + 1, '}', false))
+        return r;
+    if (p + 1 < end && p[1] == '{')
+        return var(p + 2, '}', true);
+    return nullptr;
+}
+const wchar_t *COMMON_PLACEHOLDERS_TRIGGER_CHARS = L"{%";
+
+
+// WebExtension-like $foo$ placeholders:
+// \$[A-Za-z0-9_]+\$
+const wchar_t *scan_dollar_placeholders(const wchar_t *p, const wchar_t *end)
+{
+    auto q = skip_while(p + 1, end, [](wchar_t c){ return is_ascii_alnum(c) || c == '_'; });
+    return (q != p + 1 && q < end && *q == '$') ? q + 1 : nullptr;
+}
+const wchar_t *DOLLAR_PLACEHOLDERS_TRIGGER_CHARS = L"$";
 
-std::wregex REOBJ_HTML_MARKUP(LR"((<\/?[a-zA-Z0-9:-]+(\s+[-:\w]+(=([-:\w+]|"[^"]*"|'[^']*'))?)*\s*\/?>)|(&[^ ;]+;))",
-                              RegexSyntaxHighlighter::flags);
 
-// variables expansion for various template languages
-std::wregex REOBJ_COMMON_PLACEHOLDERS(
-                //
-                //           |             |
-                LR"(%[\w.-]+%|%?\{[\w.-]+\}|\{\{[\w.-]+\}\})",
-                //      |    |      |      |        |
-                //      |           |               |
-                //      |           |               +----------------------- {{var}}
-                //      |           |
-                //      |           +--------------------------------------- %{var} (Ruby) and {var}
-                //      |
-                //      +--------------------------------------------------- %var% (Twig)
-                //
-                RegexSyntaxHighlighter::flags);
-const wchar_t* COMMON_PLACEHOLDERS_TRIGGER_CHARS = L"{%";
+// php-format per http://php.net/manual/en/function.sprintf.php plus positionals:
+// %(\d+\$)?[-+]{0,2}([ 0]|'.)?-?\d*(\..?\d+)?[%bcdeEfFgGosuxX]
+const wchar_t *scan_php_format(const wchar_t *p, const wchar_t *end)
+{
+    const wchar_t *CONVERSIONS = L"%bcdeEfFgGosuxX";
+
+    p = scan_positional(p + 1, end);
+    for (int i = 0; i < 2 && at_one_of(p, end, L"-+"); i++)
+        p++;
+    if (at_one_of(p, end, L" 0"))
+        p++;
+    else if (p + 1 < end && *p == '\'' && !is_line_terminator(p[1]))
+        p += 2;
+    if (p < end && *p == '-')
+        p++;
+    p = skip_digits(p, end);
+
+    if (p < end && *p == '.')
+    {
+        // the precision may be preceded by a custom padding character:
+        if (p + 1 < end && !is_line_terminator(p[1]))
+        {
+            auto q = skip_digits(p + 2, end);
+            if (q != p + 2)
+            {
+                if (auto r = scan_conversion(q, end, CONVERSIONS))
+                    return r;
+            }
+        }
+        auto q = skip_digits(p + 1, end);
+        if (q != p + 1)
+            return scan_conversion(q, end, CONVERSIONS);
+    }
 
-// WebExtension-like $foo$ placeholders
-std::wregex REOBJ_DOLLAR_PLACEHOLDERS(LR"(\$[A-Za-z0-9_]+\$)", RegexSyntaxHighlighter::flags);
+    return scan_conversion(p, end, CONVERSIONS);
+}
+const wchar_t *PHP_FORMAT_TRIGGER_CHARS = L"%";
 
-// php-format per http://php.net/manual/en/function.sprintf.php plus positionals
-const wchar_t* RE_PHP_FORMAT = LR"(%(\d+\$)?[-+]{0,2}([ 0]|'.)?-?\d*(\..?\d+)?[%bcdeEfFgGosuxX])";
 
 // c-format per http://en.cppreference.com/w/cpp/io/c/fprintf,
 //              http://pubs.opengroup.org/onlinepubs/9699919799/functions/fprintf.html
-#define RE_C_FORMAT_BASE LR"(%(\d+\$)?[-+ #0]{0,5}(\d+|\*)?(\.(\d+|\*))?(hh|ll|[hljztL])?[%csdioxXufFeEaAgGnp])"
-const wchar_t* RE_C_FORMAT = RE_C_FORMAT_BASE;
-const wchar_t* RE_OBJC_FORMAT =  L"%@|" RE_C_FORMAT_BASE;
-const wchar_t* RE_CXX20_FORMAT = LR"((\{\{)|(\}\})|(\{[^}]*\}))";
+// ruby-format per https://ruby-doc.org/core-2.7.1/Kernel.html#method-i-sprintf
+// %(\d+\$)?[-+ #0]{0,5}(\d+|\*)?(\.(\d+|\*))?(hh|ll|[hljztL])?[%csdioxXufFeEaAgGnp]
+const wchar_t *scan_c_format(const wchar_t *p, const wchar_t *end)
+{
+    p = scan_positional(p + 1, end);
+    for (int i = 0; i < 5 && at_one_of(p, end, L"-+ #0"); i++)
+        p++;
+    p = scan_width(p, end);
+    p = scan_precision(p, end);
+    if (p + 1 < end && (*p == 'h' || *p == 'l') && p[1] == *p)
+        p += 2;
+    else if (at_one_of(p, end, L"hljztL"))
+        p++;
+    return scan_conversion(p, end, L"%csdioxXufFeEaAgGnp");
+}
+const wchar_t *C_FORMAT_TRIGGER_CHARS = L"%";
+
+// %@|<c-format>
+const wchar_t *scan_objc_format(const wchar_t *p, const wchar_t *end)
+{
+    if (p + 1 < end && p[1] == '@')
+        return p + 2;
+    return scan_c_format(p, end);
+}
+const wchar_t *OBJC_FORMAT_TRIGGER_CHARS = L"%";
+
+
+// (\{\{)|(\}\})|(\{[^}]*\})
+const wchar_t *scan_cxx20_format(const wchar_t *p, const wchar_t *end)
+{
+    if (p + 1 < end && p[1] == *p)
+        return p + 2;
+    if (*p == '}')
+        return nullptr;
+    auto closing = std::find(p + 1, end, '}');
+    return closing != end ? closing + 1 : nullptr;
+}
+const wchar_t *CXX20_FORMAT_TRIGGER_CHARS = L"{}";
+
+
+// Python and Perl-libintl braces format (also covered by common placeholders above):
+// \{[\w.-:,]+\}
+// (note that ".-:" is a range that includes '/' and digits)
+const wchar_t *scan_braces(const wchar_t *p, const wchar_t *end)
+{
+    auto q = skip_while(p + 1, end, [](wchar_t c){ return is_word(c) || (c >= '.' && c <= ':') || c == ','; });
+    return (q != p + 1 && q < end && *q == '}') ? q + 1 : nullptr;
+}
+const wchar_t *BRACES_TRIGGER_CHARS = L"{";
 
-// Python and Perl-libintl braces format (also covered by common placeholders above)
-#define RE_BRACES LR"(\{[\w.-:,]+\})"
 
 // python-format old style https://docs.python.org/2/library/stdtypes.html#string-formatting
 //               new style https://docs.python.org/3/library/string.html#format-string-syntax
-const wchar_t* RE_PYTHON_FORMAT = LR"((%(\(\w+\))?[-+ #0]?(\d+|\*)?(\.(\d+|\*))?[hlL]?[diouxXeEfFgGcrs%]))" // old style
-                                  "|"
-                                  RE_BRACES; // new style
+// (%(\(\w+\))?[-+ #0]?(\d+|\*)?(\.(\d+|\*))?[hlL]?[diouxXeEfFgGcrs%])|<braces>
+const wchar_t *scan_python_format(const wchar_t *p, const wchar_t *end)
+{
+    if (*p == '{')
+        return scan_braces(p, end);
 
-// ruby-format per https://ruby-doc.org/core-2.7.1/Kernel.html#method-i-sprintf
-const wchar_t* RE_RUBY_FORMAT = LR"(%(\d+\$)?[-+ #0]{0,5}(\d+|\*)?(\.(\d+|\*))?(hh|ll|[hljztL])?[%csdioxXufFeEaAgGnp])";
+    p++;
+    if (p < end && *p == '(')
+    {
+        auto q = skip_while(p + 1, end, is_word);
+        if (q != p + 1 && q < end && *q == ')')
+            p = q + 1;
+    }
+    if (at_one_of(p, end, L"-+ #0"))
+        p++;
+    p = scan_width(p, end);
+    p = scan_precision(p, end);
+    if (at_one_of(p, end, L"hlL"))
+        p++;
+    return scan_conversion(p, end, L"diouxXeEfFgGcrs%");
+}
+const wchar_t *PYTHON_FORMAT_TRIGGER_CHARS = L"%{";
 
-// Qt and KDE formats
-const wchar_t* RE_QT_FORMAT = LR"(%L?(\d\d?|n))";
 
-// Lua
-const wchar_t* RE_LUA_FORMAT = LR"(%[- 0]*\d*(\.\d+)?[sqdiouXxAaEefGgc])";
+// Qt and KDE formats:
+// %L?(\d\d?|n)
+const wchar_t *scan_qt_format(const wchar_t *p, const wchar_t *end)
+{
+    p++;
+    if (p < end && *p == 'L')
+        p++;
+    if (p < end && *p == 'n')
+        return p + 1;
+    if (p < end && is_digit(*p))
+        return (p + 1 < end && is_digit(p[1])) ? p + 2 : p + 1;
+    return nullptr;
+}
+const wchar_t *QT_FORMAT_TRIGGER_CHARS = L"%";
+
+
+// Lua:
+// %[- 0]*\d*(\.\d+)?[sqdiouXxAaEefGgc]
+const wchar_t *scan_lua_format(const wchar_t *p, const wchar_t *end)
+{
+    p = skip_while(p + 1, end, [](wchar_t c){ return c == '-' || c == ' ' || c == '0'; });
+    p = skip_digits(p, end);
+    if (p + 1 < end && *p == '.' && is_digit(p[1]))
+        p = skip_digits(p + 1, end);
+    return scan_conversion(p, end, L"sqdiouXxAaEefGgc");
+}
+const wchar_t *LUA_FORMAT_TRIGGER_CHARS = L"%";
+
 
 // Pascal per https://www.freepascal.org/docs-html/rtl/sysutils/format.html
-const wchar_t* RE_PASCAL_FORMAT = LR"(%(\*:|\d*:)?-?(\*|\d+)?(\.\*|\.\d+)?[dDuUxXeEfFgGnNmMsSpP])";
+// %(\*:|\d*:)?-?(\*|\d+)?(\.\*|\.\d+)?[dDuUxXeEfFgGnNmMsSpP]
+const wchar_t *scan_pascal_format(const wchar_t *p, const wchar_t *end)
+{
+    p++;
+    if (p + 1 < end && *p == '*' && p[1] == ':')
+    {
+        p += 2;
+    }
+    else
+    {
+        auto q = skip_digits(p, end);
+        if (q < end && *q == ':')
+            p = q + 1;
+    }
+    if (p < end && *p == '-')
+        p++;
+    p = scan_width(p, end);
+    p = scan_precision(p, end);
+    return scan_conversion(p, end, L"dDuUxXeEfFgGnNmMsSpP");
+}
+const wchar_t *PASCAL_FORMAT_TRIGGER_CHARS = L"%";
 
 
-} // anonymous namespace
+/**
+    Finds the first token at or after @a pos.
+
+    Returns false if there's none, otherwise sets [start,end) to its range.
+ */
+bool find_token(ScanFunc scan, const wchar_t *triggerChars,
+                const std::wstring& s, size_t pos, size_t& start, size_t& end)
+{
+    const wchar_t *data = s.data();
+    const wchar_t *dataEnd = data + s.size();
+    for (pos = s.find_first_of(triggerChars, pos); pos != std::wstring::npos; pos = s.find_first_of(triggerChars, pos + 1))
+    {
+        if (auto tokenEnd = scan(data + pos, dataEnd))
+        {
+            start = pos;
+            end = size_t(tokenEnd - data);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool contains_token(ScanFunc scan, const wchar_t *triggerChars, const std::wstring& s)
+{
+    size_t start, end;
+    return find_token(scan, triggerChars, s, 0, start, end);
+}
 
 
-SyntaxHighlighterPtr SyntaxHighlighter::ForItem(const CatalogItem& item, int kindsMask, int flags)
+
+/// Highlights tokens found by a scanner function (see above)
+class ScannerSyntaxHighlighter : public SyntaxHighlighter
 {
-    auto fmt = item.GetFormatFlag();
-    if (fmt.empty())
-        fmt = item.GetInternalFormatFlag();
+public:
+    ScannerSyntaxHighlighter(const char *name, ScanFunc scan, const wchar_t *triggerChars, TextKind kind)
+        : m_scan(scan), m_triggerChars(triggerChars), m_kind(kind),
+          m_costs(HighlighterCosts::Get().Register(name)) {}
 
-    bool needsHTML = (kindsMask & Markup);
-    if (needsHTML)
+    void Highlight(const std::wstring& s, const CallbackType& highlight) override
     {
-        needsHTML = false;
+        CostTimer timer(m_costs, s.length());
+        size_t start, end;
+        for (size_t pos = 0; find_token(m_scan, m_triggerChars, s, pos, start, end); pos = end)
+            highlight(int(start), int(end), m_kind);
+    }
 
-        str::wstring_conv_t str1 = str::to_wstring(item.GetString());
-        if (str1.find(L"<") != std::wstring::npos && std::regex_search(str1, REOBJ_HTML_MARKUP))
+private:
+    ScanFunc m_scan;
+    const wchar_t *m_triggerChars;
+    TextKind m_kind;
+    HighlighterCosts::Entry *m_costs;
+};
+
+
+/// Remembers highlighting of recently seen texts for reuse when they are
+/// highlighted again, e.g. when moving back and forth between items in the UI
+class MemoizingSyntaxHighlighter : public SyntaxHighlighter
+{
+public:
+    MemoizingSyntaxHighlighter(SyntaxHighlighterPtr sub)
+        : m_sub(sub),
+          m_registration("highlighting",
+                         [this]{ std::lock_guard<std::mutex> lock(m_mutex); return m_bytes; },
+                         [this](CacheRegistry::Pressure)
+                         {
+                             std::lock_guard<std::mutex> lock(m_mutex);
+                             m_cache.clear();
+                             m_bytes = 0;
+                         })
+    {}
+
+    void Highlight(const std::wstring& s, const CallbackType& highlight) override
+    {
+        std::shared_ptr<const Spans> spans;
         {
-            needsHTML = true;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto i = m_cache.find(s);
+            if (i != m_cache.end())
+                spans = i->second;
         }
-        else if (item.HasPlural())
+
+        if (!spans)
         {
-            str::wstring_conv_t strp = str::to_wstring(item.GetString());
-            if (strp.find(L"<") != std::wstring::npos && std::regex_search(strp, REOBJ_HTML_MARKUP))
+            auto computed = std::make_shared<Spans>();
+            m_sub->Highlight(s, [&computed](int a, int b, TextKind kind){
+                computed->push_back({a, b, kind});
+            });
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // edited texts are never seen again, so keep the cache bounded in a simple way:
+            if (m_cache.size() >= MAX_CACHED_TEXTS)
             {
-                needsHTML = true;
+                m_cache.clear();
+                m_bytes = 0;
             }
+            if (m_cache.emplace(s, computed).second)
+                m_bytes += EntrySize(s, *computed);
+            spans = computed;
         }
+
+        for (auto& span: *spans)
+            highlight(span.start, span.end, span.kind);
     }
-    bool needsGenericPlaceholders = (kindsMask & Placeholder);
-    if (needsGenericPlaceholders)
+
+private:
+    static constexpr size_t MAX_CACHED_TEXTS = 256;
+
+    struct Span
     {
-        if ((flags & EnforceFormatTag) && !fmt.empty())
-        {
-            // only use generic placeholders if no explicit format was provided, see https://github.com/vslavik/poedit/issues/777
-            needsGenericPlaceholders = false;
-        }
-        else
-        {
-            needsGenericPlaceholders = false;
+        int start, end;
+        TextKind kind;
+    };
+    typedef std::vector<Span> Spans;
 
-            str::wstring_conv_t str1 = str::to_wstring(item.GetString());
-            if (str1.find_first_of(COMMON_PLACEHOLDERS_TRIGGER_CHARS) != std::wstring::npos && std::regex_search(str1, REOBJ_COMMON_PLACEHOLDERS))
-            {
-				needsGenericPlaceholders = true;
-			}
-            else if (item.HasPlural())
-            {
-                str::wstring_conv_t strp = str::to_wstring(item.GetString());
-                if (strp.find_first_of(COMMON_PLACEHOLDERS_TRIGGER_CHARS) != std::wstring::npos && std::regex_search(strp, REOBJ_COMMON_PLACEHOLDERS))
-                {
-                    needsGenericPlaceholders = true;
-                }
-            }
-        }
+    // approximate memory used by a cache entry
+    static size_t EntrySize(const std::wstring& s, const Spans& spans)
+    {
+        return sizeof(std::wstring) + s.capacity() * sizeof(wchar_t) + 4 * sizeof(void*) +
+               sizeof(Spans) + spans.capacity() * sizeof(Span);
     }
 
+    SyntaxHighlighterPtr m_sub;
+    std::mutex m_mutex;
+    std::unordered_map<std::wstring, std::shared_ptr<const Spans>> m_cache;
+    size_t m_bytes = 0;
+
+    CacheRegistry::Registration m_registration;
+};
+
+
+/// Creates highlighter for given configuration, see SyntaxHighlighter::ForItem()
+SyntaxHighlighterPtr CreateHighlighter(const std::string& fmt, int kindsMask, bool needsHTML, bool needsGenericPlaceholders)
+{
     static auto basic = std::make_shared<BasicSyntaxHighlighter>();
     if (!needsHTML && !needsGenericPlaceholders && fmt.empty())
     {
-        if (kindsMask & (LeadingWhitespace | Escape))
+        if (kindsMask & (SyntaxHighlighter::LeadingWhitespace | SyntaxHighlighter::Escape))
             return basic;
         else
             return nullptr;
@@ -311,79 +725,181 @@ SyntaxHighlighterPtr SyntaxHighlighter::ForItem(const CatalogItem& item, int kin
     // HTML goes first, has lowest priority than special-purpose stuff like format strings:
     if (needsHTML)
     {
-        static auto html = std::make_shared<RegexSyntaxHighlighter>(REOBJ_HTML_MARKUP, TextKind::Markup);
+        static auto html = std::make_shared<ScannerSyntaxHighlighter>("html", scan_html_markup, HTML_MARKUP_TRIGGER_CHARS, SyntaxHighlighter::Markup);
         all->Add(html);
     }
 
     if (needsGenericPlaceholders)
     {
         // If no format specified, heuristically apply highlighting of common variable markers
-        static auto placeholders = std::make_shared<RegexSyntaxHighlighter>(REOBJ_COMMON_PLACEHOLDERS, TextKind::Placeholder);
+        static auto placeholders = std::make_shared<ScannerSyntaxHighlighter>("placeholders", scan_common_placeholders, COMMON_PLACEHOLDERS_TRIGGER_CHARS, SyntaxHighlighter::Placeholder);
         all->Add(placeholders);
     }
 
-    if (!fmt.empty() && (kindsMask & Placeholder))
+    if (!fmt.empty() && (kindsMask & SyntaxHighlighter::Placeholder))
     {
         if (fmt == "php")
         {
-            static auto php_format = std::make_shared<RegexSyntaxHighlighter>(RE_PHP_FORMAT, TextKind::Placeholder);
+            static auto php_format = std::make_shared<ScannerSyntaxHighlighter>("php-format", scan_php_format, PHP_FORMAT_TRIGGER_CHARS, SyntaxHighlighter::Placeholder);
             all->Add(php_format);
         }
         else if (fmt == "c")
         {
-            static auto c_format = std::make_shared<RegexSyntaxHighlighter>(RE_C_FORMAT, TextKind::Placeholder);
+            static auto c_format = std::make_shared<ScannerSyntaxHighlighter>("c-format", scan_c_format, C_FORMAT_TRIGGER_CHARS, SyntaxHighlighter::Placeholder);
             all->Add(c_format);
         }
         else if (fmt == "c++")
         {
-            static auto cxx_format = std::make_shared<RegexSyntaxHighlighter>(RE_CXX20_FORMAT, TextKind::Placeholder);
+            static auto cxx_format = std::make_shared<ScannerSyntaxHighlighter>("cxx-format", scan_cxx20_format, CXX20_FORMAT_TRIGGER_CHARS, SyntaxHighlighter::Placeholder);
             all->Add(cxx_format);
         }
         else if (fmt == "python")
         {
-            static auto python_format = std::make_shared<RegexSyntaxHighlighter>(RE_PYTHON_FORMAT, TextKind::Placeholder);
+            static auto python_format = std::make_shared<ScannerSyntaxHighlighter>("python-format", scan_python_format, PYTHON_FORMAT_TRIGGER_CHARS, SyntaxHighlighter::Placeholder);
             all->Add(python_format);
         }
         else if (fmt == "ruby")
         {
-            static auto ruby_format = std::make_shared<RegexSyntaxHighlighter>(RE_RUBY_FORMAT, TextKind::Placeholder);
+            static auto ruby_format = std::make_shared<ScannerSyntaxHighlighter>("ruby-format", scan_c_format, C_FORMAT_TRIGGER_CHARS, SyntaxHighlighter::Placeholder);
             all->Add(ruby_format);
         }
         else if (fmt == "objc")
         {
-            static auto objc_format = std::make_shared<RegexSyntaxHighlighter>(RE_OBJC_FORMAT, TextKind::Placeholder);
+            static auto objc_format = std::make_shared<ScannerSyntaxHighlighter>("objc-format", scan_objc_format, OBJC_FORMAT_TRIGGER_CHARS, SyntaxHighlighter::Placeholder);
             all->Add(objc_format);
         }
         else if (fmt == "qt" || fmt == "qt-plural" || fmt == "kde" || fmt == "kde-kuit")
         {
-            static auto qt_format = std::make_shared<RegexSyntaxHighlighter>(RE_QT_FORMAT, TextKind::Placeholder);
+            static auto qt_format = std::make_shared<ScannerSyntaxHighlighter>("qt-format", scan_qt_format, QT_FORMAT_TRIGGER_CHARS, SyntaxHighlighter::Placeholder);
             all->Add(qt_format);
         }
         else if (fmt == "lua")
         {
-            static auto lua_format = std::make_shared<RegexSyntaxHighlighter>(RE_LUA_FORMAT, TextKind::Placeholder);
+            static auto lua_format = std::make_shared<ScannerSyntaxHighlighter>("lua-format", scan_lua_format, LUA_FORMAT_TRIGGER_CHARS, SyntaxHighlighter::Placeholder);
             all->Add(lua_format);
         }
         else if (fmt == "csharp" || fmt == "perl-brace" || fmt == "python-brace")
         {
-            static auto brace_format = std::make_shared<RegexSyntaxHighlighter>(RE_BRACES, TextKind::Placeholder);
+            static auto brace_format = std::make_shared<ScannerSyntaxHighlighter>("brace-format", scan_braces, BRACES_TRIGGER_CHARS, SyntaxHighlighter::Placeholder);
             all->Add(brace_format);
         }
         else if (fmt == "object-pascal")
         {
-            static auto pascal_format = std::make_shared<RegexSyntaxHighlighter>(RE_PASCAL_FORMAT, TextKind::Placeholder);
+            static auto pascal_format = std::make_shared<ScannerSyntaxHighlighter>("pascal-format", scan_pascal_format, PASCAL_FORMAT_TRIGGER_CHARS, SyntaxHighlighter::Placeholder);
             all->Add(pascal_format);
         }
         else if (fmt == "ph-dollars")
         {
-            static auto dollars_format = std::make_shared<RegexSyntaxHighlighter>(REOBJ_DOLLAR_PLACEHOLDERS, TextKind::Placeholder);
+            static auto dollars_format = std::make_shared<ScannerSyntaxHighlighter>("dollars-format", scan_dollar_placeholders, DOLLAR_PLACEHOLDERS_TRIGGER_CHARS, SyntaxHighlighter::Placeholder);
             all->Add(dollars_format);
         }
     }
 
     // basic highlighting has highest priority, so should come last in the order:
-    if (kindsMask & (LeadingWhitespace | Escape))
+    if (kindsMask & (SyntaxHighlighter::LeadingWhitespace | SyntaxHighlighter::Escape))
         all->Add(basic);
 
     return all;
 }
+
+
+} // anonymous namespace
+
+
+std::string SyntaxHighlighter::GetDiagnosticsReport()
+{
+    return HighlighterCosts::Get().Report();
+}
+
+
+SyntaxHighlighterPtr SyntaxHighlighter::ForItem(const CatalogItem& item, int kindsMask, int flags)
+{
+    auto fmt = item.GetFormatFlag();
+    if (fmt.empty())
+        fmt = item.GetInternalFormatFlag();
+
+    bool needsHTML = (kindsMask & Markup);
+    if (needsHTML)
+    {
+        needsHTML = false;
+
+        str::wstring_conv_t str1 = str::to_wstring(item.GetString());
+        if (contains_token(scan_html_markup, HTML_MARKUP_TRIGGER_CHARS, str1))
+        {
+            needsHTML = true;
+        }
+        else if (item.HasPlural())
+        {
+            str::wstring_conv_t strp = str::to_wstring(item.GetPluralString());
+            if (contains_token(scan_html_markup, HTML_MARKUP_TRIGGER_CHARS, strp))
+            {
+                needsHTML = true;
+            }
+        }
+    }
+    bool needsGenericPlaceholders = (kindsMask & Placeholder);
+    if (needsGenericPlaceholders)
+    {
+        if ((flags & EnforceFormatTag) && !fmt.empty())
+        {
+            // only use generic placeholders if no explicit format was provided, see https://github.com/vslavik/poedit/issues/777
+            needsGenericPlaceholders = false;
+        }
+        else
+        {
+            needsGenericPlaceholders = false;
+
+            str::wstring_conv_t str1 = str::to_wstring(item.GetString());
+            if (contains_token(scan_common_placeholders, COMMON_PLACEHOLDERS_TRIGGER_CHARS, str1))
+            {
+				needsGenericPlaceholders = true;
+			}
+            else if (item.HasPlural())
+            {
+                str::wstring_conv_t strp = str::to_wstring(item.GetPluralString());
+                if (contains_token(scan_common_placeholders, COMMON_PLACEHOLDERS_TRIGGER_CHARS, strp))
+                {
+                    needsGenericPlaceholders = true;
+                }
+            }
+        }
+    }
+
+    // Highlighters are stateless, so the one for a given configuration -- which
+    // only depends on the format and traits of the content found above -- is
+    // created once and shared by all items:
+    std::string key(fmt);
+    key += ':';
+    key += std::to_string(kindsMask);
+    key += needsHTML ? 'H' : '-';
+    key += needsGenericPlaceholders ? 'P' : '-';
+    key += (flags & Memoize) ? 'M' : '-';
+
+    static std::mutex cacheMutex;
+    static std::map<std::string, SyntaxHighlighterPtr> cache;
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    auto cached = cache.find(key);
+    if (cached != cache.end())
+        return cached->second;
+
+    auto syntax = CreateHighlighter(fmt, kindsMask, needsHTML, needsGenericPlaceholders);
+    if (syntax && (flags & Memoize))
+        syntax = std::make_shared<MemoizingSyntaxHighlighter>(syntax);
+    cache.emplace(key, syntax);
+    return syntax;
+}
+
+
+SyntaxHighlighterPtr SyntaxHighlighter::ForUnknownFormat()
+{
+    static SyntaxHighlighterPtr s_syntax = []
+    {
+        auto all = std::make_shared<CompositeSyntaxHighlighter>();
+        all->Add(std::make_shared<ScannerSyntaxHighlighter>("generic-html", scan_html_markup, HTML_MARKUP_TRIGGER_CHARS, Markup));
+        all->Add(std::make_shared<ScannerSyntaxHighlighter>("generic-placeholders", scan_common_placeholders, COMMON_PLACEHOLDERS_TRIGGER_CHARS, Placeholder));
+        all->Add(std::make_shared<ScannerSyntaxHighlighter>("generic-c-format", scan_c_format, C_FORMAT_TRIGGER_CHARS, Placeholder));
+        return all;
+    }();
+    return s_syntax;
+}
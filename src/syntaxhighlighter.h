@@ -58,7 +58,8 @@ public:
     // Flags for ForItem
     enum
     {
-        EnforceFormatTag   = 0x0001
+        EnforceFormatTag   = 0x0001,
+        Memoize            = 0x0002   // remember results for repeatedly highlighted texts (UI)
     };
 
     typedef std::function<void(int,int,TextKind)> CallbackType;
@@ -78,8 +79,28 @@ public:
         @param item      Translation item to highlight
         @param kindsMask Optionally specify only a subset of highlighters as TextKind or-combination
         @param flags     Optional flags modifying behavior, e.g. EnforceFormatTag
+
+        The returned highlighter is shared with other items that need the same
+        configuration and may be used from multiple threads.
      */
     static SyntaxHighlighterPtr ForItem(const CatalogItem& item, int kindsMask = 0xffff, int flags = 0);
+
+    /**
+        Return highlighter of placeholders and markup in texts of unknown format.
+
+        It recognizes HTML markup, common placeholders ({var}, %var% etc.) and
+        printf-style format strings, but no whitespace or escapes. Used where
+        texts aren't associated with any catalog item, e.g. in the translation
+        memory. Thread-safe.
+     */
+    static SyntaxHighlighterPtr ForUnknownFormat();
+
+    /**
+        Returns human-readable report of time spent in individual highlighters
+        (total, per call, per 1000 characters and the slowest call) since the
+        application started.
+     */
+    static std::string GetDiagnosticsReport();
 };
 
 #endif // Poedit_syntaxhighlighter_h
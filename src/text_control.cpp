@@ -55,10 +55,17 @@
 #include "str_helpers.h"
 #include "unicode_helpers.h"
 
+#include <algorithm>
+
 
 namespace
 {
 
+#ifdef __WXGTK__
+// Default limit of memory used by a control's undo history
+const size_t DEFAULT_UNDO_HISTORY_LIMIT = 256 * 1024;
+#endif
+
 #ifdef __WXOSX__
 
 inline NSTextView *TextView(const wxTextCtrl *ctrl)
@@ -315,7 +322,12 @@ CustomizedTextCtrl::CustomizedTextCtrl(wxWindow *parent, wxWindowID winid, long
     Bind(wxEVT_TEXT_PASTE, &CustomizedTextCtrl::OnPaste, this);
 
 #ifdef __WXGTK__
+    m_historyIndex = 0;
     m_historyLocks = 0;
+    m_historyStarted = false;
+    m_historyInsertionPoint = 0;
+    m_historySize = 0;
+    m_historyLimit = DEFAULT_UNDO_HISTORY_LIMIT;
     if (!(style & wxTE_READONLY))
         Bind(wxEVT_TEXT, &CustomizedTextCtrl::OnText, this);
 #endif
@@ -437,14 +449,67 @@ void CustomizedTextCtrl::EndUndoGrouping()
 
 void CustomizedTextCtrl::SaveSnapshot()
 {
+    const std::wstring value = GetValue().ToStdWstring();
+    const long insertionPoint = GetInsertionPoint();
+
+    if (!m_historyStarted)
+    {
+        m_historyStarted = true;
+        m_history.clear();
+        m_historyIndex = 0;
+        m_historySize = 0;
+        m_historyText = value;
+        m_historyInsertionPoint = insertionPoint;
+        return;
+    }
+
     // if we saved the snapshot in DoSetValue, OnText might still call this function again
     // therefore, we make sure to filter out duplicate entries
-    if (m_historyIndex && m_history[m_historyIndex - 1].text == GetValue())
+    if (value == m_historyText)
         return;
 
-    m_history.resize(m_historyIndex); // truncate the list
-    m_history.push_back({GetValue(), GetInsertionPoint()});
+    // truncate the list
+    while (m_history.size() > m_historyIndex)
+    {
+        m_historySize -= m_history.back().MemorySize();
+        m_history.pop_back();
+    }
+
+    // only store the changed part of the text, edits are typically small:
+    const auto& old = m_historyText;
+    const size_t common = std::min(old.length(), value.length());
+    size_t prefix = 0;
+    while (prefix < common && old[prefix] == value[prefix])
+        prefix++;
+    size_t suffix = 0;
+    while (suffix < common - prefix && old[old.length() - 1 - suffix] == value[value.length() - 1 - suffix])
+        suffix++;
+
+    UndoChange change;
+    change.from = prefix;
+    change.removed = old.substr(prefix, old.length() - prefix - suffix);
+    change.inserted = value.substr(prefix, value.length() - prefix - suffix);
+    change.insertionPointBefore = m_historyInsertionPoint;
+    change.insertionPointAfter = insertionPoint;
+
+    m_historySize += change.MemorySize();
+    m_history.push_back(std::move(change));
     m_historyIndex++;
+    m_historyText = value;
+    m_historyInsertionPoint = insertionPoint;
+
+    // forget the oldest changes if over the limit, but always keep the last one:
+    while (m_historySize > m_historyLimit && m_history.size() > 1)
+    {
+        m_historySize -= m_history.front().MemorySize();
+        m_history.pop_front();
+        m_historyIndex--;
+    }
+}
+
+void CustomizedTextCtrl::SetUndoHistoryLimit(size_t bytes)
+{
+    m_historyLimit = bytes;
 }
 
 void CustomizedTextCtrl::DoSetValue(const wxString& value, int flags)
@@ -455,7 +520,7 @@ void CustomizedTextCtrl::DoSetValue(const wxString& value, int flags)
     {
         // clear the history
         // m_history itself will be cleared when SaveSnapshot is called
-        m_historyIndex = 0;
+        m_historyStarted = false;
 
         // set the new value
         wxTextCtrl::DoSetValue(value, flags);
@@ -479,28 +544,36 @@ void CustomizedTextCtrl::OnText(wxCommandEvent& event)
 
 bool CustomizedTextCtrl::CanUndo() const
 {
-    return (m_historyIndex > 1);
+    return m_historyIndex > 0;
 }
 
 bool CustomizedTextCtrl::CanRedo() const
 {
-    return (m_historyIndex < m_history.size());
+    return m_historyIndex < m_history.size();
 }
 
 void CustomizedTextCtrl::Undo()
 {
-    // ChangeValue calls AnyTranslatableTextCtrl::DoSetValue, which calls CustomizedTextCtrl::DoSetValue
-    ChangeValue(m_history[m_historyIndex - 2].text);
-    SetInsertionPoint(m_history[m_historyIndex - 2].insertionPoint);
+    const auto& change = m_history[m_historyIndex - 1];
+    m_historyText.replace(change.from, change.inserted.length(), change.removed);
+    m_historyInsertionPoint = change.insertionPointBefore;
     m_historyIndex--;
+
+    // ChangeValue calls AnyTranslatableTextCtrl::DoSetValue, which calls CustomizedTextCtrl::DoSetValue
+    ChangeValue(m_historyText);
+    SetInsertionPoint(m_historyInsertionPoint);
 }
 
 void CustomizedTextCtrl::Redo()
 {
-    // ChangeValue calls AnyTranslatableTextCtrl::DoSetValue, which calls CustomizedTextCtrl::DoSetValue
-    ChangeValue(m_history[m_historyIndex].text);
-    SetInsertionPoint(m_history[m_historyIndex].insertionPoint);
+    const auto& change = m_history[m_historyIndex];
+    m_historyText.replace(change.from, change.removed.length(), change.inserted);
+    m_historyInsertionPoint = change.insertionPointAfter;
     m_historyIndex++;
+
+    // ChangeValue calls AnyTranslatableTextCtrl::DoSetValue, which calls CustomizedTextCtrl::DoSetValue
+    ChangeValue(m_historyText);
+    SetInsertionPoint(m_historyInsertionPoint);
 }
 #endif // __WXGTK__
 
@@ -578,9 +651,11 @@ AnyTranslatableTextCtrl::AnyTranslatableTextCtrl(wxWindow *parent, wxWindowID wi
 
     Bind(wxEVT_TEXT, [=](wxCommandEvent& e){
         e.Skip();
-        HighlightText();
+        HighlightChangedText();
     });
 
+    m_fullHighlightTimer.Bind(wxEVT_TIMER, [=](wxTimerEvent&){ HighlightText(); });
+
     m_language = Language::English();
 }
 
@@ -591,6 +666,7 @@ AnyTranslatableTextCtrl::~AnyTranslatableTextCtrl()
 void AnyTranslatableTextCtrl::SetLanguage(const Language& lang)
 {
     m_language = lang;
+    m_plainTextSource.clear();
 
     wxEventBlocker block(this, wxEVT_TEXT);
 
@@ -642,52 +718,97 @@ void AnyTranslatableTextCtrl::SetPlainText(const wxString& s)
 
 wxString AnyTranslatableTextCtrl::GetPlainText() const
 {
-    return UnescapePlainText(bidi::strip_pointless_control_chars(GetValue(), m_language.Direction()));
+    // This is called on every keystroke for all plural forms' controls, but
+    // usually only one of them changed, so don't unescape unchanged text:
+    auto value = GetValue();
+    if (value != m_plainTextSource || m_plainTextSource.empty())
+    {
+        m_plainTextSource = value;
+        m_plainText = UnescapePlainText(bidi::strip_pointless_control_chars(std::move(value), m_language.Direction()));
+    }
+    return m_plainText;
+}
+
+
+namespace
+{
+
+// Characters that EscapePlainText() escapes, including the leading \0
+const wchar_t ESCAPED_CHARS[] = L"\0\a\b\f\n\r\t\v\\";
+const size_t ESCAPED_CHARS_COUNT = sizeof(ESCAPED_CHARS) / sizeof(ESCAPED_CHARS[0]) - 1;
+
+inline std::wstring_view ToView(const wxString& s)
+{
+    return std::wstring_view(s.wx_str(), s.length());
 }
 
+} // anonymous namespace
+
 
 wxString AnyTranslatableTextCtrl::EscapePlainText(const wxString& s)
+{
+    auto view = ToView(s);
+    if (view.find_first_of(ESCAPED_CHARS, 0, ESCAPED_CHARS_COUNT) == std::wstring_view::npos)
+        return s; // nothing to escape, the common case
+
+    std::wstring out;
+    EscapePlainText(view, out);
+    return out;
+}
+
+void AnyTranslatableTextCtrl::EscapePlainText(std::wstring_view s, std::wstring& out)
 {
     // Note: the escapes used here should match with
     //       BasicSyntaxHighlighter::Highlight() ones
-    wxString s2;
-    s2.reserve(s.length());
-    for (auto i = s.begin(); i != s.end(); ++i)
+    out.clear();
+    out.reserve(s.length() + s.length() / 16 + 8);
+
+    size_t pos = 0;
+    for (;;)
     {
-        wchar_t c = *i;
+        // copy runs of ordinary characters at once:
+        auto next = s.find_first_of(ESCAPED_CHARS, pos, ESCAPED_CHARS_COUNT);
+        if (next == std::wstring_view::npos)
+        {
+            out.append(s.substr(pos));
+            return;
+        }
+        out.append(s.substr(pos, next - pos));
+        pos = next + 1;
+
+        const wchar_t c = s[next];
         switch (c)
         {
             case '\0':
-                s2 += "\\0";
+                out += L"\\0";
                 break;
             case '\a':
-                s2 += "\\a";
+                out += L"\\a";
                 break;
             case '\b':
-                s2 += "\\b";
+                out += L"\\b";
                 break;
             case '\f':
-                s2 += "\\f";
+                out += L"\\f";
                 break;
             case '\n':
-                s2 += "\\n\n";
+                out += L"\\n\n";
                 break;
             case '\r':
-                s2 += "\\r";
+                out += L"\\r";
                 break;
             case '\t':
-                s2 += "\\t";
+                out += L"\\t";
                 break;
             case '\v':
-                s2 += "\\v";
+                out += L"\\v";
                 break;
             case '\\':
             {
-                s2 += c;
-                auto peek = i + 1;
-                if ( peek != s.end() )
+                out += c;
+                if (pos < s.length())
                 {
-                    switch ((wchar_t)*peek)
+                    switch (s[pos])
                     {
                         case '0': case '\0':
                         case 'a': case '\a':
@@ -698,84 +819,93 @@ wxString AnyTranslatableTextCtrl::EscapePlainText(const wxString& s)
                         case 't': case '\t':
                         case 'v': case '\v':
                         case '\\':
-                            s2 += c; // escape problematic backslash
+                            out += c; // escape problematic backslash
                             break;
                     }
                 }
                 break;
             }
             default:
-                s2 += c;
+                out += c;
                 break;
         }
     }
-    return s2;
 }
 
 wxString AnyTranslatableTextCtrl::UnescapePlainText(const wxString& s)
 {
-    wxString s2;
-    s2.reserve(s.length());
-    for (auto i = s.begin(); i != s.end(); ++i)
+    auto view = ToView(s);
+    if (view.find(L'\\') == std::wstring_view::npos)
+        return s; // nothing to unescape, the common case
+
+    std::wstring out;
+    UnescapePlainText(view, out);
+    return out;
+}
+
+void AnyTranslatableTextCtrl::UnescapePlainText(std::wstring_view s, std::wstring& out)
+{
+    out.clear();
+    out.reserve(s.length());
+
+    size_t pos = 0;
+    for (;;)
     {
-        wchar_t c0 = *i;
-        if (c0 == '\\')
+        // copy runs of ordinary characters at once:
+        auto next = s.find(L'\\', pos);
+        if (next == std::wstring_view::npos)
         {
-            if ( ++i == s.end() )
-            {
-                s2 += '\\';
-                return s2;
-            }
-            wchar_t c = *i;
-            switch (c)
-            {
-                case '0':
-                    s2 += '\0';
-                    break;
-                case 'a':
-                    s2 += '\a';
-                    break;
-                case 'b':
-                    s2 += '\b';
-                    break;
-                case 'f':
-                    s2 += '\f';
-                    break;
-                case 'n':
-                {
-                    s2 += '\n';
-                    auto peek = i + 1;
-                    if ( peek != s.end() && *peek == '\n' )
-                    {
-                        // "\\n\n" should be treated as single newline
-                        i = peek;
-                    }
-                    break;
-                }
-                case 'r':
-                    s2 += '\r';
-                    break;
-                case 't':
-                    s2 += '\t';
-                    break;
-                case 'v':
-                    s2 += '\v';
-                    break;
-                case '\\':
-                    s2 += '\\';
-                    break;
-                default:
-                    s2 += '\\';
-                    s2 += c;
-                    break;
-            }
+            out.append(s.substr(pos));
+            return;
+        }
+        out.append(s.substr(pos, next - pos));
+        pos = next + 1;
+
+        if (pos == s.length())
+        {
+            out += '\\';
+            return;
         }
-        else
+
+        const wchar_t c = s[pos++];
+        switch (c)
         {
-            s2 += c0;
+            case '0':
+                out += '\0';
+                break;
+            case 'a':
+                out += '\a';
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'n':
+                out += '\n';
+                // "\\n\n" should be treated as single newline
+                if (pos < s.length() && s[pos] == '\n')
+                    pos++;
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'v':
+                out += '\v';
+                break;
+            case '\\':
+                out += '\\';
+                break;
+            default:
+                out += '\\';
+                out += c;
+                break;
         }
     }
-    return s2;
 }
 
 wxString AnyTranslatableTextCtrl::DoCopyText(long from, long to)
@@ -821,7 +951,7 @@ void AnyTranslatableTextCtrl::UpdateRTLStyle()
 }
 #endif // !__WXMSW__
 
-void AnyTranslatableTextCtrl::HighlightText()
+std::wstring AnyTranslatableTextCtrl::GetTextForHighlighting() const
 {
 #ifdef __WXOSX__
     // See the comment in DoGetValueForRange() for why GetValue() returns subtly
@@ -846,22 +976,116 @@ void AnyTranslatableTextCtrl::HighlightText()
         std::u16string utf16 = boost::locale::conv::utf_to_utf<char16_t>([traw UTF8String]);
         text = std::wstring(utf16.begin(), utf16.end());
     }
+    return text;
+#else
+    return GetValue().ToStdWstring();
+#endif
+}
 
-    NSRange fullRange = NSMakeRange(0, text.length());
-    NSLayoutManager *layout = [TextView(this) layoutManager];
-    [layout removeTemporaryAttribute:NSForegroundColorAttributeName forCharacterRange:fullRange];
-    [layout removeTemporaryAttribute:NSBackgroundColorAttributeName forCharacterRange:fullRange];
 
-    if (m_syntax)
+namespace
+{
+
+// Texts shorter than this are always highlighted in full, it's fast enough:
+const size_t INCREMENTAL_HIGHLIGHTING_MIN_LENGTH = 2000;
+
+// Delay after the last edit before long texts are highlighted in full:
+const int FULL_HIGHLIGHTING_DELAY_MS = 300;
+
+} // anonymous namespace
+
+
+void AnyTranslatableTextCtrl::HighlightText()
+{
+    m_fullHighlightTimer.Stop();
+
+    auto text = GetTextForHighlighting();
+    HighlightRange(text, 0, text.length());
+    m_highlightedText = std::move(text);
+}
+
+
+void AnyTranslatableTextCtrl::HighlightChangedText()
+{
+    auto text = GetTextForHighlighting();
+    const auto& old = m_highlightedText;
+
+    if (text.length() < INCREMENTAL_HIGHLIGHTING_MIN_LENGTH || old.empty())
     {
-        m_syntax->Highlight(text, [=](int a, int b, SyntaxHighlighter::TextKind kind){
-            [layout addTemporaryAttributes:m_attrs->For(kind) forCharacterRange:NSMakeRange(a, b-a)];
-        });
+        HighlightText();
+        return;
     }
 
-#else // !__WXOSX__
+    // Find the edited part of the text as the range between common prefix
+    // and suffix of the old and new version:
+    const size_t common = std::min(old.length(), text.length());
+    size_t prefix = 0;
+    while (prefix < common && old[prefix] == text[prefix])
+        prefix++;
+    size_t suffix = 0;
+    while (suffix < common - prefix && old[old.length() - 1 - suffix] == text[text.length() - 1 - suffix])
+        suffix++;
+
+    if (prefix == common && old.length() == text.length())
+        return; // no change in the text
+
+    // Styles of unchanged text are kept by the control, so only the edited
+    // lines need to be highlighted again:
+    size_t from = prefix;
+    size_t to = text.length() - suffix;
+    from = (from > 0) ? text.rfind(L'\n', from - 1) : std::wstring::npos;
+    from = (from == std::wstring::npos) ? 0 : from + 1;
+    to = text.find(L'\n', to);
+    to = (to == std::wstring::npos) ? text.length() : to + 1;
+
+    HighlightRange(text, from, to);
+    m_highlightedText = std::move(text);
+
+    // Highlighting of lines isn't necessarily the same as of the whole text,
+    // e.g. leading whitespace is only highlighted at the start of the text
+    // or markup may span lines, so fix it up when the user stops typing:
+    m_fullHighlightTimer.StartOnce(FULL_HIGHLIGHTING_DELAY_MS);
+}
+
+
+void AnyTranslatableTextCtrl::HighlightRange(const std::wstring& text, size_t from, size_t to)
+{
+    // Calls @a apply for all highlighted parts of the range:
+    auto forEachHighlight = [=,&text](const SyntaxHighlighter::CallbackType& apply)
+    {
+        if (!m_syntax)
+            return;
+
+        if (from == 0 && to == text.length())
+        {
+            m_syntax->Highlight(text, apply);
+            return;
+        }
+
+        const int offset = int(from);
+        const int length = int(to - from);
+        const bool atStart = (from == 0);
+        const bool atEnd = (to == text.length());
+        m_syntax->Highlight(text.substr(from, to - from), [&](int a, int b, SyntaxHighlighter::TextKind kind)
+        {
+            // leading/trailing whitespace of the range isn't that of the text:
+            if (kind == SyntaxHighlighter::LeadingWhitespace && ((a == 0 && !atStart) || (b == length && !atEnd)))
+                return;
+            apply(offset + a, offset + b, kind);
+        });
+    };
+
+#ifdef __WXOSX__
+    NSRange range = NSMakeRange(from, to - from);
+    NSLayoutManager *layout = [TextView(this) layoutManager];
+    [layout removeTemporaryAttribute:NSForegroundColorAttributeName forCharacterRange:range];
+    [layout removeTemporaryAttribute:NSBackgroundColorAttributeName forCharacterRange:range];
+
+    forEachHighlight([=](int a, int b, SyntaxHighlighter::TextKind kind){
+        [layout addTemporaryAttributes:m_attrs->For(kind) forCharacterRange:NSMakeRange(a, b-a)];
+    });
 
-    auto text = GetValue().ToStdWstring();
+#else // !__WXOSX__
 
     wxEventBlocker block(this, wxEVT_TEXT);
 
@@ -876,26 +1100,20 @@ void AnyTranslatableTextCtrl::HighlightText()
     {
         // If possible, use TOM interface to apply temporary styles, which is much
         // more efficient. Unfortunately, it's not possible to do with read-only controls.
-        SetTOMTmpStyle(doc, 0, text.length(), deflt);
+        SetTOMTmpStyle(doc, int(from), int(to), deflt);
 
-        if (m_syntax)
-        {
-            m_syntax->Highlight(text, [=](int a, int b, SyntaxHighlighter::TextKind kind){
-                SetTOMTmpStyle(doc, a, b, m_attrs->For(kind));
-            });
-        }
+        forEachHighlight([=](int a, int b, SyntaxHighlighter::TextKind kind){
+            SetTOMTmpStyle(doc, a, b, m_attrs->For(kind));
+        });
     }
     else
   #endif // __WXMSW___
     {
-        SetStyle(0, text.length(), deflt);
+        SetStyle(from, to, deflt);
 
-        if (m_syntax)
-        {
-            m_syntax->Highlight(text, [=](int a, int b, SyntaxHighlighter::TextKind kind){
-                SetStyle(a, b, m_attrs->For(kind));
-            });
-        }
+        forEachHighlight([=](int a, int b, SyntaxHighlighter::TextKind kind){
+            SetStyle(a, b, m_attrs->For(kind));
+        });
     }
 #endif // __WXOSX__/!__WXOSX__
 }
@@ -27,7 +27,11 @@
 #define Poedit_text_control_h
 
 #include <wx/textctrl.h>
+#include <wx/timer.h>
+#include <deque>
 #include <memory>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include "language.h"
@@ -58,6 +62,9 @@ public:
     void BeginUndoGrouping();
     void EndUndoGrouping();
     void SaveSnapshot();
+
+    /// Sets approximate limit of memory used by undo history; oldest changes are forgotten first.
+    void SetUndoHistoryLimit(size_t bytes);
 #endif
 
 #ifdef __WXMSW__
@@ -82,10 +89,16 @@ protected:
     virtual void DoPasteText(long from, long to, const wxString& s);
 
 #ifdef __WXGTK__
-    struct Snapshot
+    // Difference between two consecutive snapshots of the text
+    struct UndoChange
     {
-        wxString text;
-        long insertionPoint;
+        size_t from;            // where the texts start to differ
+        std::wstring removed;   // text of the older snapshot replaced by the change
+        std::wstring inserted;  // text of the newer snapshot
+        long insertionPointBefore, insertionPointAfter;
+
+        size_t MemorySize() const
+            { return sizeof(UndoChange) + (removed.length() + inserted.length()) * sizeof(wchar_t); }
     };
 
     void DoSetValue(const wxString& value, int flags) override;
@@ -95,9 +108,13 @@ protected:
     void Undo() override;
     void Redo() override;
 
-    std::vector<Snapshot> m_history;
-    size_t m_historyIndex; // where in the vector to insert the next snapshot
+    std::deque<UndoChange> m_history;
+    size_t m_historyIndex; // number of changes applied to get the current snapshot
     int m_historyLocks;
+    bool m_historyStarted;
+    std::wstring m_historyText; // text of the current snapshot
+    long m_historyInsertionPoint;
+    size_t m_historySize, m_historyLimit; // memory used by m_history and its limit
 #endif // __WXGTK__
 };
 
@@ -122,6 +139,10 @@ public:
     static wxString EscapePlainText(const wxString& s);
     static wxString UnescapePlainText(const wxString& s);
 
+    // Variants of the above that write into (and reuse) @a out buffer:
+    static void EscapePlainText(std::wstring_view s, std::wstring& out);
+    static void UnescapePlainText(std::wstring_view s, std::wstring& out);
+
 protected:
     wxString DoCopyText(long from, long to) override;
     void DoPasteText(long from, long to, const wxString& s) override;
@@ -133,12 +154,32 @@ protected:
 #endif // __WXMSW__
 
 protected:
+    /// Highlights the entire text
     void HighlightText();
 
+    /**
+        Updates highlighting after the user edited the text. In long texts,
+        only the edited lines are highlighted and the whole text is only
+        highlighted again after a short delay, after typing stops.
+     */
+    void HighlightChangedText();
+
+    /// Returns the control's text as indexed by the styling APIs
+    std::wstring GetTextForHighlighting() const;
+    /// Highlights range [from,to) of @a text, which must be whole lines
+    void HighlightRange(const std::wstring& text, size_t from, size_t to);
+
     class Attributes;
     SyntaxHighlighterPtr m_syntax;
     std::unique_ptr<Attributes> m_attrs;
     Language m_language;
+
+    // cached result of GetPlainText() for the value it was computed from:
+    mutable wxString m_plainTextSource, m_plainText;
+
+    // text as of the last highlighting, for finding what was edited:
+    std::wstring m_highlightedText;
+    wxTimer m_fullHighlightTimer;
 };
 
 
@@ -25,27 +25,308 @@
 
 #include "suggestions.h"
 
+#include "cache_registry.h"
 #include "concurrency.h"
 #include "transmem.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+
+namespace
+{
+
+/**
+    Bounded LRU cache of recent queries' results.
+
+    Shared by all SuggestionsProvider instances, so that e.g. other windows
+    with the same file (or just the same strings) benefit from it too.
+    Entries are only valid for the backend generation they were obtained
+    with.
+ */
+class SuggestionsCache
+{
+public:
+    static SuggestionsCache& Get()
+    {
+        static SuggestionsCache s_instance;
+        return s_instance;
+    }
+
+    static std::wstring MakeKey(const SuggestionsBackend& backend, const SuggestionQuery& q)
+    {
+        std::wstring key(std::to_wstring(reinterpret_cast<uintptr_t>(&backend)));
+        key += L'\x1f';
+        key += q.srclang.WCode();
+        key += L'\x1f';
+        key += q.lang.WCode();
+        key += L'\x1f';
+        key += q.source;
+        return key;
+    }
+
+    bool Lookup(const std::wstring& key, uint64_t generation, SuggestionsList& out)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto i = m_map.find(key);
+        if (i == m_map.end())
+            return false;
+
+        if (i->second->generation != generation)
+        {
+            m_bytes -= i->second->bytes;
+            m_lru.erase(i->second);
+            m_map.erase(i);
+            return false;
+        }
+
+        // move to the front of LRU list:
+        m_lru.splice(m_lru.begin(), m_lru, i->second);
+        out = i->second->results;
+        return true;
+    }
+
+    void Store(const std::wstring& key, uint64_t generation, const SuggestionsList& results)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto i = m_map.find(key);
+        if (i != m_map.end())
+        {
+            auto& e = *i->second;
+            m_bytes -= e.bytes;
+            e.generation = generation;
+            e.results = results;
+            e.bytes = EntrySize(e);
+            m_bytes += e.bytes;
+            m_lru.splice(m_lru.begin(), m_lru, i->second);
+            return;
+        }
+
+        m_lru.push_front({key, generation, results, 0});
+        m_lru.front().bytes = EntrySize(m_lru.front());
+        m_bytes += m_lru.front().bytes;
+        m_map.emplace(key, m_lru.begin());
+
+        Trim(MAX_ENTRIES);
+    }
+
+private:
+    SuggestionsCache()
+        : m_registration("suggestions",
+                         [this]{ std::lock_guard<std::mutex> lock(m_mutex); return m_bytes; },
+                         [this](CacheRegistry::Pressure pressure)
+                         {
+                             std::lock_guard<std::mutex> lock(m_mutex);
+                             Trim(pressure == CacheRegistry::Pressure::Critical ? 0 : m_lru.size() / 2);
+                         })
+    {}
+
+    // evicts least recently used entries; must be called with m_mutex locked
+    void Trim(size_t maxEntries)
+    {
+        while (m_lru.size() > maxEntries)
+        {
+            m_bytes -= m_lru.back().bytes;
+            m_map.erase(m_lru.back().key);
+            m_lru.pop_back();
+        }
+    }
+
+    static const size_t MAX_ENTRIES = 1000;
+
+    struct Entry
+    {
+        std::wstring key;
+        uint64_t generation;
+        SuggestionsList results;
+        size_t bytes;
+    };
+
+    // approximate memory used by the entry, including its m_map node
+    static size_t EntrySize(const Entry& e)
+    {
+        size_t size = sizeof(Entry) + 2 * (sizeof(std::wstring) + e.key.size() * sizeof(wchar_t)) + 4 * sizeof(void*);
+        size += e.results.capacity() * sizeof(Suggestion);
+        for (auto& r: e.results)
+            size += r.text.capacity() * sizeof(wchar_t) + r.id.capacity();
+        return size;
+    }
+
+    std::mutex m_mutex;
+    std::list<Entry> m_lru;
+    std::unordered_map<std::wstring, std::list<Entry>::iterator> m_map;
+    size_t m_bytes = 0;
+
+    CacheRegistry::Registration m_registration;
+};
+
+
+/**
+    Calls functions at given time on a dedicated thread.
+
+    Used for enforcing backends' deadlines without blocking worker threads
+    while waiting for them. The functions must be quick.
+ */
+class DeadlineTimer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static DeadlineTimer& Get()
+    {
+        static DeadlineTimer s_instance;
+        return s_instance;
+    }
+
+    void Schedule(Clock::time_point when, std::function<void()>&& func)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending.emplace(when, std::move(func));
+        }
+        m_cv.notify_one();
+    }
+
+private:
+    DeadlineTimer() : m_thread([this]{ ThreadMain(); }) {}
+
+    ~DeadlineTimer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        m_thread.join();
+    }
+
+    void ThreadMain()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stop)
+        {
+            if (m_pending.empty())
+            {
+                m_cv.wait(lock);
+                continue;
+            }
+
+            auto first = m_pending.begin();
+            if (first->first > Clock::now())
+            {
+                m_cv.wait_until(lock, first->first);
+                continue;
+            }
+
+            auto func = std::move(first->second);
+            m_pending.erase(first);
+            lock.unlock();
+            func();
+            lock.lock();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::multimap<Clock::time_point, std::function<void()>> m_pending;
+    bool m_stop = false;
+    std::thread m_thread;
+};
+
+
+// Returns future that is fulfilled with @a results, or with no suggestions if
+// they don't arrive within @a deadline
+dispatch::future<SuggestionsList> with_deadline(dispatch::future<SuggestionsList>&& results, std::chrono::milliseconds deadline)
+{
+    struct State
+    {
+        dispatch::promise<SuggestionsList> promise;
+        std::atomic<bool> done {false};
+    };
+    auto state = std::make_shared<State>();
+    auto future = dispatch::future<SuggestionsList>(state->promise.get_future());
+
+    DeadlineTimer::Get().Schedule(DeadlineTimer::Clock::now() + deadline, [state]
+    {
+        if (!state->done.exchange(true))
+            state->promise.set_value(SuggestionsList());
+    });
+
+    results.then([state](dispatch::future<SuggestionsList> r)
+    {
+        if (state->done.exchange(true))
+            return;
+        try
+        {
+            state->promise.set_value(r.get());
+        }
+        catch (...)
+        {
+            dispatch::set_current_exception(state->promise);
+        }
+    });
+
+    return future;
+}
+
+
+std::mutex gs_backendsMutex;
+std::vector<SuggestionsBackend*> gs_backends;
+
+} // anonymous namespace
+
 
 class SuggestionsProviderImpl
 {
 public:
     SuggestionsProviderImpl() {}
 
-    dispatch::future<SuggestionsList> SuggestTranslation(SuggestionsBackend& backend, const SuggestionQuery&& q)
+    dispatch::future<SuggestionsList> SuggestTranslation(SuggestionsBackend& backend, const SuggestionQuery&& q,
+                                                         dispatch::cancellation_token_ptr cancellationToken)
     {
         auto bck = &backend;
-        return dispatch::async([=]{
-            // don't bother asking the backend if the language or query is invalid:
-            if (!q.srclang.IsValid() || !q.lang.IsValid() || q.srclang == q.lang || q.source.empty())
+        return dispatch::async(dispatch::priority::interactive, [=]{
+            // don't bother asking the backend if the language or query is invalid
+            // or if the query was cancelled while it was waiting in the queue:
+            if (!q.srclang.IsValid() || !q.lang.IsValid() || q.srclang == q.lang || q.source.empty() ||
+                (cancellationToken && cancellationToken->is_cancelled()))
             {
                 return dispatch::make_ready_future(SuggestionsList());
             }
 
+            // use recent results if the backend's data didn't change since:
+            auto& cache = SuggestionsCache::Get();
+            auto key = SuggestionsCache::MakeKey(*bck, q);
+            auto generation = bck->GetGeneration();
+
+            SuggestionsList cached;
+            if (cache.Lookup(key, generation, cached))
+                return dispatch::make_ready_future(std::move(cached));
+
             // query the backend:
-            return bck->SuggestTranslation(std::move(q));
+            auto results = bck->SuggestTranslation(std::move(q), cancellationToken)
+                   .then([key,generation,cancellationToken](SuggestionsList results)
+                   {
+                       // results of cancelled queries may be incomplete, don't reuse them:
+                       if (!cancellationToken || !cancellationToken->is_cancelled())
+                           SuggestionsCache::Get().Store(key, generation, results);
+                       return results;
+                   });
+
+            // don't let slow backends delay the others; their results are
+            // still cached when they arrive:
+            auto deadline = bck->GetDeadline();
+            if (deadline.count() > 0)
+                return with_deadline(std::move(results), deadline);
+            return results;
         });
     }
 };
@@ -60,9 +341,30 @@ SuggestionsProvider::~SuggestionsProvider()
 {
 }
 
-dispatch::future<SuggestionsList> SuggestionsProvider::SuggestTranslation(SuggestionsBackend& backend, const SuggestionQuery&& q)
+dispatch::future<SuggestionsList> SuggestionsProvider::SuggestTranslation(SuggestionsBackend& backend, const SuggestionQuery&& q,
+                                                                         dispatch::cancellation_token_ptr cancellationToken)
+{
+    return m_impl->SuggestTranslation(backend, std::move(q), cancellationToken);
+}
+
+void SuggestionsProvider::RegisterBackend(SuggestionsBackend& backend)
+{
+    std::lock_guard<std::mutex> lock(gs_backendsMutex);
+    gs_backends.push_back(&backend);
+}
+
+void SuggestionsProvider::UnregisterBackend(SuggestionsBackend& backend)
+{
+    std::lock_guard<std::mutex> lock(gs_backendsMutex);
+    gs_backends.erase(std::remove(gs_backends.begin(), gs_backends.end(), &backend), gs_backends.end());
+}
+
+std::vector<SuggestionsBackend*> SuggestionsProvider::GetBackends()
 {
-    return m_impl->SuggestTranslation(backend, std::move(q));
+    std::vector<SuggestionsBackend*> all {&TranslationMemory::Get()};
+    std::lock_guard<std::mutex> lock(gs_backendsMutex);
+    all.insert(all.end(), gs_backends.begin(), gs_backends.end());
+    return all;
 }
 
 void SuggestionsProvider::Delete(const Suggestion& s)
@@ -26,10 +26,14 @@
 #ifndef Poedit_suggestions_h
 #define Poedit_suggestions_h
 
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "concurrency.h"
@@ -61,11 +65,11 @@ struct Suggestion
 
     /// Ctor
     Suggestion() : score(0.), localScore(0), source(Source::LocalTM) {}
-    Suggestion(const std::wstring& text_,
+    Suggestion(std::wstring text_,
                double score_,
                int localScore_ = 0,
                Source source_ = Source::LocalTM)
-        : text(text_), score(score_), localScore(localScore_), source(source_)
+        : text(std::move(text_)), score(score_), localScore(localScore_), source(source_)
     {}
 
     /// Text of the suggested translation
@@ -105,6 +109,14 @@ typedef std::vector<Suggestion> SuggestionsList;
     
     This is a relatively lightweight object and shouldn't be shared between
     users (e.g. opened documents/windows) -- create one instance per user.
+
+    Recently returned results are cached (the cache is shared by all
+    instances) until the backend's data changes.
+
+    Besides the local TM, additional backends (e.g. a team or cloud TM) can
+    be registered with RegisterBackend(); GetBackends() returns all of them
+    for querying them concurrently. Queries to backends with a deadline (see
+    SuggestionsBackend::GetDeadline()) don't wait for them longer than that.
  */
 class SuggestionsProvider
 {
@@ -120,16 +132,35 @@ public:
         callback, exactly once, from a worked thread.
 
         If no suggestions are found, @a onSuccess is called with an empty
-        list as its argument.
+        list as its argument. This is also the case if the backend doesn't
+        respond within its deadline; its results are still cached when they
+        arrive later, though.
 
         @param backend    Suggestions backend to use, e.g. TranslationMemory::Get().
         @param q          Source text and its metadata.
+        @param cancellationToken  Optional token for cancelling the query when its
+                                  results are no longer needed. Results of
+                                  cancelled queries may be incomplete.
      */
-    dispatch::future<SuggestionsList> SuggestTranslation(SuggestionsBackend& backend, const SuggestionQuery&& q);
+    dispatch::future<SuggestionsList> SuggestTranslation(SuggestionsBackend& backend, const SuggestionQuery&& q,
+                                                         dispatch::cancellation_token_ptr cancellationToken = dispatch::cancellation_token_ptr());
 
     /// Mark a suggestion as good. Called when a suggestion is used.
     static void Delete(const Suggestion& s);
 
+    /**
+        Registers an additional suggestions backend.
+
+        The backend must stay alive until UnregisterBackend() is called.
+     */
+    static void RegisterBackend(SuggestionsBackend& backend);
+
+    /// Unregisters backend added with RegisterBackend()
+    static void UnregisterBackend(SuggestionsBackend& backend);
+
+    /// Returns all backends to query, starting with the local TM.
+    static std::vector<SuggestionsBackend*> GetBackends();
+
 private:
     std::unique_ptr<SuggestionsProviderImpl> m_impl;
 };
@@ -147,8 +178,17 @@ private:
 class SuggestionsBackend
 {
 public:
+    SuggestionsBackend() : m_generation(0) {}
     virtual ~SuggestionsBackend() {}
 
+    /**
+        Returns counter that changes whenever the backend's data was modified.
+
+        Results obtained with a different generation may be out of date and
+        must not be reused from cache.
+     */
+    uint64_t GetGeneration() const { return m_generation.load(); }
+
     /**
         Query for suggested translations.
         
@@ -165,11 +205,29 @@ public:
         list as its argument.
         
         @param q     Source text and its metadata.
+        @param cancellationToken  Token for cancelling the query, may be null.
+                                  Implementations should check it periodically
+                                  and stop as soon as possible when cancelled.
      */
-    virtual dispatch::future<SuggestionsList> SuggestTranslation(const SuggestionQuery&& q) = 0;
+    virtual dispatch::future<SuggestionsList> SuggestTranslation(const SuggestionQuery&& q,
+                                                                 dispatch::cancellation_token_ptr cancellationToken) = 0;
+
+    /**
+        Returns maximum time SuggestionsProvider waits for results of this
+        backend, so that e.g. slow network backends don't delay showing of
+        other suggestions. Zero (the default) means no limit.
+     */
+    virtual std::chrono::milliseconds GetDeadline() const { return std::chrono::milliseconds(0); }
 
     /// Delete suggestion with given ID from the database
     virtual void Delete(const std::string& id) = 0;
+
+protected:
+    /// Must be called by implementations when their data change.
+    void NotifyDataChanged() { m_generation++; }
+
+private:
+    std::atomic<uint64_t> m_generation;
 };
 
 #endif // Poedit_suggestions_h
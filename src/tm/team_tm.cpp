@@ -0,0 +1,265 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2023 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "team_tm.h"
+
+#ifdef HAVE_HTTP_CLIENT
+
+#include "configuration.h"
+#include "errors.h"
+#include "http_client.h"
+#include "str_helpers.h"
+
+#include <wx/log.h>
+
+#include <algorithm>
+#include <mutex>
+#include <time.h>
+#include <vector>
+
+
+TeamTranslationMemory *TeamTranslationMemory::ms_instance = nullptr;
+
+
+class TeamTranslationMemory::impl : public std::enable_shared_from_this<TeamTranslationMemory::impl>
+{
+public:
+    impl(const std::string& serverURL) : m_api(serverURL)
+    {
+        // batching makes more parallel requests unnecessary:
+        m_api.set_max_concurrent_requests(2);
+    }
+
+    dispatch::future<SuggestionsList> Search(const SuggestionQuery& q, dispatch::cancellation_token_ptr cancellationToken)
+    {
+        auto promise = std::make_shared<dispatch::promise<SuggestionsList>>();
+        auto future = dispatch::future<SuggestionsList>(promise->get_future());
+
+        bool send;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queries.push_back({q, promise, cancellationToken});
+            send = !m_searchInProgress;
+            m_searchInProgress = true;
+        }
+        if (send)
+            SendQueries();
+
+        return future;
+    }
+
+    void Insert(json&& entry)
+    {
+        bool send;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_inserts.push_back(std::move(entry));
+            send = !m_insertInProgress;
+            m_insertInProgress = true;
+        }
+        if (send)
+            SendInserts();
+    }
+
+private:
+    static const size_t MAX_BATCH_SIZE = 100;
+
+    struct PendingQuery
+    {
+        SuggestionQuery query;
+        std::shared_ptr<dispatch::promise<SuggestionsList>> promise;
+        dispatch::cancellation_token_ptr cancellationToken;
+    };
+
+    // Sends queries collected so far, if any, in a single request and
+    // continues with the ones collected meanwhile when it finishes.
+    void SendQueries()
+    {
+        std::vector<PendingQuery> batch;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            while (!m_queries.empty() && batch.size() < MAX_BATCH_SIZE)
+            {
+                auto q = std::move(m_queries.front());
+                m_queries.erase(m_queries.begin());
+                if (q.cancellationToken && q.cancellationToken->is_cancelled())
+                    q.promise->set_value(SuggestionsList());
+                else
+                    batch.push_back(std::move(q));
+            }
+            if (batch.empty())
+            {
+                m_searchInProgress = false;
+                return;
+            }
+        }
+
+        json queries = json::array();
+        for (auto& q: batch)
+        {
+            queries.push_back({
+                {"srclang", q.query.srclang.Code()},
+                {"lang", q.query.lang.Code()},
+                {"source", str::to_utf8(q.query.source)}
+            });
+        }
+
+        auto self = shared_from_this();
+        auto sharedBatch = std::make_shared<std::vector<PendingQuery>>(std::move(batch));
+        m_api.post("/search", json_data({{"queries", queries}}))
+        .then([self,sharedBatch](json r)
+        {
+            auto& results = r.at("results");
+            for (size_t i = 0; i < sharedBatch->size(); i++)
+            {
+                SuggestionsList hits;
+                if (i < results.size())
+                {
+                    for (auto& h: results[i])
+                    {
+                        Suggestion s(str::to_wstring(h.at("text").get<std::string>()), h.value("score", 0.0));
+                        s.id = h.value("id", std::string());
+                        hits.push_back(std::move(s));
+                    }
+                }
+                (*sharedBatch)[i].promise->set_value(std::move(hits));
+            }
+            self->SendQueries();
+        })
+        .catch_all([self,sharedBatch](dispatch::exception_ptr e)
+        {
+            for (auto& q: *sharedBatch)
+            {
+                try { q.promise->set_exception(e); } catch (...) {} // already fulfilled from the above
+            }
+            self->SendQueries();
+        });
+    }
+
+    void SendInserts()
+    {
+        json entries = json::array();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_inserts.empty())
+            {
+                m_insertInProgress = false;
+                return;
+            }
+            const size_t count = std::min(m_inserts.size(), MAX_BATCH_SIZE);
+            for (size_t i = 0; i < count; i++)
+                entries.push_back(std::move(m_inserts[i]));
+            m_inserts.erase(m_inserts.begin(), m_inserts.begin() + count);
+        }
+
+        auto self = shared_from_this();
+        m_api.post("/insert", json_data({{"entries", entries}}))
+        .then([self](json)
+        {
+            self->SendInserts();
+        })
+        .catch_all([self](dispatch::exception_ptr e)
+        {
+            wxLogTrace("poedit.tm", "failed to send translations to team TM: %s", DescribeException(e));
+            self->SendInserts();
+        });
+    }
+
+    http_client m_api;
+
+    std::mutex m_mutex;  // guards all of the below
+    std::vector<PendingQuery> m_queries;
+    std::vector<json> m_inserts;
+    bool m_searchInProgress = false;
+    bool m_insertInProgress = false;
+};
+
+
+TeamTranslationMemory::TeamTranslationMemory(const std::string& serverURL)
+    : m_impl(std::make_shared<impl>(serverURL))
+{
+}
+
+TeamTranslationMemory::~TeamTranslationMemory()
+{
+}
+
+void TeamTranslationMemory::Init()
+{
+    if (ms_instance)
+        return;
+
+    auto server = Config::TeamTMServer();
+    if (server.empty())
+        return;
+
+    ms_instance = new TeamTranslationMemory(server);
+    SuggestionsProvider::RegisterBackend(*ms_instance);
+}
+
+void TeamTranslationMemory::CleanUp()
+{
+    if (!ms_instance)
+        return;
+
+    SuggestionsProvider::UnregisterBackend(*ms_instance);
+    delete ms_instance;
+    ms_instance = nullptr;
+}
+
+
+dispatch::future<SuggestionsList> TeamTranslationMemory::SuggestTranslation(const SuggestionQuery&& q,
+                                                                            dispatch::cancellation_token_ptr cancellationToken)
+{
+    return m_impl->Search(q, cancellationToken);
+}
+
+
+void TeamTranslationMemory::Insert(const Language& srclang, const Language& lang, const CatalogItemPtr& item)
+{
+    if (!srclang.IsValid() || !lang.IsValid() || srclang == lang)
+        return;
+    if (item->IsFuzzy() || !item->IsTranslated())
+        return;
+
+    auto add = [&](const wxString& source, const wxString& trans)
+    {
+        if (source.empty() || trans.empty())
+            return;
+        m_impl->Insert({
+            {"srclang", srclang.Code()},
+            {"lang", lang.Code()},
+            {"source", str::to_utf8(source)},
+            {"translation", str::to_utf8(trans)},
+            {"created", (long long)time(NULL)}
+        });
+    };
+
+    add(item->GetString(), item->GetTranslation());
+    if (item->HasPlural())
+        add(item->GetPluralString(), item->GetTranslation(1));
+}
+
+#endif // HAVE_HTTP_CLIENT
@@ -0,0 +1,103 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2023 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_team_tm_h
+#define Poedit_team_tm_h
+
+#ifdef HAVE_HTTP_CLIENT
+
+#include "catalog.h"
+#include "suggestions.h"
+
+#include <memory>
+#include <string>
+
+
+/**
+    Client of a translation memory server shared by a team.
+
+    The server's URL is configured with Config::TeamTMServer(); when set, the
+    client is registered as an additional SuggestionsProvider backend, so that
+    its suggestions are shown along with the local TM's ones, and translations
+    entered by the user are sent to the server too.
+
+    Requests are batched: queries (and inserts) made while a request is in
+    progress are collected and sent together in a single request when it
+    finishes. Results are cached by SuggestionsProvider.
+
+    The server implements this JSON-over-HTTP protocol:
+
+    - POST <server>/search with body
+      {"queries": [{"srclang": "en", "lang": "cs", "source": "..."}, ...]}
+      responds with {"results": [[{"text": "...", "score": 0.9, "id": "..."}, ...], ...]},
+      i.e. TranslationMemory::SearchBatch() results for each of the queries.
+
+    - POST <server>/insert with body
+      {"entries": [{"srclang": "en", "lang": "cs", "source": "...", "translation": "...", "created": 1690000000}, ...]}
+      inserts the entries as TranslationMemory::Writer::Insert() does.
+ */
+class TeamTranslationMemory : public SuggestionsBackend
+{
+public:
+    /// Returns the instance if team TM is configured or nullptr.
+    static TeamTranslationMemory *Get() { return ms_instance; }
+
+    /// Creates and registers the client if a server is configured.
+    static void Init();
+
+    /// Destroys the singleton, must be called (only) on app shutdown.
+    static void CleanUp();
+
+    dispatch::future<SuggestionsList> SuggestTranslation(const SuggestionQuery&& q,
+                                                         dispatch::cancellation_token_ptr cancellationToken) override;
+
+    /// The server is shared by others, so deleting entries isn't supported.
+    void Delete(const std::string& /*id*/) override {}
+
+    /// Network queries shouldn't delay showing of local TM's suggestions.
+    std::chrono::milliseconds GetDeadline() const override { return std::chrono::milliseconds(1500); }
+
+    /**
+        Sends the translation to the server, skipping fuzzy or untranslated
+        items like TranslationMemory::Writer::Insert() does.
+
+        Failures are only logged.
+     */
+    void Insert(const Language& srclang, const Language& lang, const CatalogItemPtr& item);
+
+private:
+    class impl;
+
+    TeamTranslationMemory(const std::string& serverURL);
+    ~TeamTranslationMemory();
+
+    std::unique_ptr<impl> m_impl;
+
+    static TeamTranslationMemory *ms_instance;
+};
+
+#endif // HAVE_HTTP_CLIENT
+
+#endif // Poedit_team_tm_h
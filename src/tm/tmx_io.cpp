@@ -32,9 +32,21 @@
 #endif
 
 #include <wx/translation.h>
+#include <wx/stdstream.h>
+#include <wx/wfstream.h>
+#include <wx/zstream.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include <map>
 
 #include "errors.h"
+#include "progressinfo.h"
 #include "pugixml.h"
+#include "str_helpers.h"
+#include "utility.h"
 #include "version.h"
 
 using namespace pugi;
@@ -72,13 +84,156 @@ std::wstring extract_seg(xml_node node)
     return pugi::as_wide(text);
 }
 
-} // anonymous namespace
+time_t parse_date(const std::string& date)
+{
+    if (date.empty())
+        return 0;
+
+    struct tm t {};
+    std::istringstream s(date.c_str());
+    s >> std::get_time(&t, "%Y%m%dT%H%M%SZ"); // YYYYMMDDThhmmssZ
+    if (s.fail())
+        return 0;
+    return timegm(&t);
+}
 
 
-void TMX::ImportFromFile(std::istream& file, TranslationMemory& tm)
+struct HeaderDefaults
+{
+    std::string srclang;
+    std::string date;
+};
+
+HeaderDefaults parse_header(xml_node root)
+{
+    HeaderDefaults h;
+    auto header = root.child("header");
+    if (header)
+    {
+        h.srclang = header.attribute("srclang").value();
+        if (h.srclang == "*all*")
+            h.srclang.clear();
+        h.date = extract_date(header);
+    }
+    return h;
+}
+
+
+// Imports a single <tu> element, returns number of translations inserted
+int import_tu(xml_node tu, const HeaderDefaults& defaults, TranslationMemory::IOInterface& writer)
 {
+    int counter = 0;
+
+    auto tuDate = extract_date(tu, defaults.date);
+    std::string tuSrclang = tu.attribute("srclang").value();
+    if (tuSrclang.empty())
+        tuSrclang = defaults.srclang;
+
+    std::wstring source;
+    for (auto tuv: tu.children("tuv"))
+    {
+        if (extract_lang(tuv) == tuSrclang)
+        {
+            source = extract_seg(tuv);
+            break;
+        }
+    }
+    if (source.empty())
+        return 0;
+
+    for (auto tuv: tu.children("tuv"))
+    {
+        auto tuvLang = extract_lang(tuv);
+        if (tuvLang == tuSrclang)
+            continue;
+
+        auto srclang = Language::TryParse(tuSrclang);
+        auto lang = Language::TryParse(tuvLang);
+        if (!srclang.IsValid() || !lang.IsValid())
+            continue;
+
+        auto trans = extract_seg(tuv);
+        if (trans.empty())
+            continue;
+
+        time_t creationTime = parse_date(extract_date(tu, tuDate));
+
+        writer.Insert(srclang, lang, source, trans, creationTime);
+        counter++;
+    }
+
+    return counter;
+}
+
+
+// Size of chunks the TMX file is read in when streaming
+const size_t STREAM_CHUNK_SIZE = 1024 * 1024;
+
+// Resolution of progress reporting (file sizes may not fit into int)
+const int PROGRESS_STEPS = 1000;
+
+
+// Only UTF-8 files can be split into chunks on raw bytes level. Others are
+// rare in practice, so they are loaded into memory in their entirety.
+bool can_stream_file(const std::string& start)
+{
+    if (start.find('\0') != std::string::npos)
+        return false; // UTF-16 or UTF-32
+
+    size_t pos = 0;
+    if (start.compare(0, 3, "\xEF\xBB\xBF") == 0)
+        pos = 3; // UTF-8 BOM
+
+    if (start.compare(pos, 5, "<?xml") != 0)
+        return true;
+
+    auto declEnd = start.find("?>", pos);
+    if (declEnd == std::string::npos)
+        return false;
+
+    std::string decl = start.substr(pos, declEnd - pos);
+    std::transform(decl.begin(), decl.end(), decl.begin(), [](char c){ return (char)std::tolower((unsigned char)c); });
+    auto enc = decl.find("encoding");
+    if (enc == std::string::npos)
+        return true;
+    return decl.find("utf-8", enc) != std::string::npos || decl.find("utf8", enc) != std::string::npos;
+}
+
+
+// Finds end of the last complete <tu> element in the buffer, returns 0 if there's none
+size_t find_end_of_last_tu(const std::string& buf, size_t from)
+{
+    size_t pos = buf.size();
+    while (pos > from)
+    {
+        pos = buf.rfind("</tu", pos - 1);
+        if (pos == std::string::npos || pos < from)
+            return 0;
+
+        size_t after = pos + 4;
+        if (after >= buf.size())
+            continue;
+        char c = buf[after];
+        if (c == '>' || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        {
+            auto close = buf.find('>', after);
+            if (close == std::string::npos)
+                continue;
+            return close + 1;
+        }
+    }
+    return 0;
+}
+
+
+// Loads the whole document into memory at once; @a buf contains already read
+// start of the file, the rest is read from @a file.
+void import_from_document(std::string& buf, std::istream& file, TranslationMemory& tm)
+{
+    buf.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
     xml_document doc;
-    auto result = doc.load(file);
+    auto result = doc.load_buffer(buf.data(), buf.size());
     if (!result)
         throw std::runtime_error(result.description());
 
@@ -86,72 +241,126 @@ void TMX::ImportFromFile(std::istream& file, TranslationMemory& tm)
     if (!root)
         throw Exception(_("The TMX file is malformed."));
 
-    std::string defaultSrclang;
-    std::string defaultDate;
-    auto header = root.child("header");
-    if (header)
-    {
-        defaultSrclang = header.attribute("srclang").value();
-        if (defaultSrclang == "*all*")
-            defaultSrclang.clear();
-        defaultDate = extract_date(header);
-    }
+    auto defaults = parse_header(root);
 
-    int counter = 0;
     auto body = root.child("body");
     if (!body)
         throw Exception(_("The TMX file is malformed."));
 
-    tm.ImportData([=,&counter,&body](auto& writer)
+    int counter = 0;
+    tm.ImportData([&](auto& writer)
     {
         for (auto tu: body.children("tu"))
+            counter += import_tu(tu, defaults, writer);
+    });
+
+    if (counter == 0)
+        throw Exception(_("No translations were found in the TMX file."));
+}
+
+} // anonymous namespace
+
+
+void TMX::ImportFromFile(std::istream& file, TranslationMemory& tm)
+{
+    // The file is processed in a streaming fashion, so that even huge TMX files
+    // can be imported with bounded memory use: the header is parsed first and
+    // then runs of complete <tu> elements are parsed as they are read, never
+    // keeping more than a chunk of the file in memory.
+
+    Progress progress(PROGRESS_STEPS);
+
+    file.seekg(0, std::ios::end);
+    const std::streamoff fileSize = file.tellg();
+    file.seekg(0, std::ios::beg);
+    if (!file || fileSize <= 0)
+    {
+        file.clear();
+        file.seekg(0, std::ios::beg);
+    }
+
+    std::string buf;
+    std::streamoff bytesRead = 0;
+    auto read_chunk = [&]() -> bool
+    {
+        if (!file)
+            return false;
+        const size_t oldSize = buf.size();
+        buf.resize(oldSize + STREAM_CHUNK_SIZE);
+        file.read(&buf[oldSize], STREAM_CHUNK_SIZE);
+        auto count = file.gcount();
+        buf.resize(oldSize + count);
+        bytesRead += count;
+        if (fileSize > 0)
+            progress.set(int(bytesRead * PROGRESS_STEPS / fileSize));
+        return count > 0;
+    };
+
+    read_chunk();
+    if (!can_stream_file(buf))
+    {
+        import_from_document(buf, file, tm);
+        return;
+    }
+
+    // Read and parse everything up to and including <body>:
+    size_t bodyStart;
+    for (;;)
+    {
+        bodyStart = buf.find("<body");
+        if (bodyStart != std::string::npos)
         {
-            auto tuDate = extract_date(tu, defaultDate);
-            std::string tuSrclang = tu.attribute("srclang").value();
-            if (tuSrclang.empty())
-                tuSrclang = defaultSrclang;
+            bodyStart = buf.find('>', bodyStart);
+            if (bodyStart != std::string::npos)
+                break;
+        }
+        if (!read_chunk())
+            throw Exception(_("The TMX file is malformed."));
+    }
+    bodyStart++;
 
-            std::wstring source;
-            for (auto tuv: tu.children("tuv"))
-            {
-                if (extract_lang(tuv) == tuSrclang)
-                {
-                    source = extract_seg(tuv);
-                    break;
-                }
-            }
-            if (source.empty())
-                continue;
+    HeaderDefaults defaults;
+    {
+        if (buf[bodyStart - 2] == '/')
+            throw Exception(_("No translations were found in the TMX file."));  // <body/>
+
+        std::string prolog = buf.substr(0, bodyStart) + "</body></tmx>";
+        xml_document doc;
+        auto result = doc.load_buffer(prolog.data(), prolog.size(), parse_default, encoding_utf8);
+        if (!result)
+            throw std::runtime_error(result.description());
+        auto root = doc.child("tmx");
+        if (!root)
+            throw Exception(_("The TMX file is malformed."));
+        defaults = parse_header(root);
+    }
+    buf.erase(0, bodyStart);
 
-            for (auto tuv: tu.children("tuv"))
+    int counter = 0;
+    tm.ImportData([&](auto& writer)
+    {
+        xml_document doc;
+        std::string fragment;
+        bool eof = false;
+        while (!eof)
+        {
+            auto end = find_end_of_last_tu(buf, 0);
+            if (end)
             {
-                auto tuvLang = extract_lang(tuv);
-                if (tuvLang == tuSrclang)
-                    continue;
-
-                auto srclang = Language::TryParse(tuSrclang);
-                auto lang = Language::TryParse(tuvLang);
-                if (!srclang.IsValid() || !lang.IsValid())
-                    continue;
-
-                auto trans = extract_seg(tuv);
-                if (trans.empty())
-                    continue;
-
-                time_t creationTime = 0;
-                auto tuvDate = extract_date(tu, tuDate);
-                if (!tuvDate.empty())
-                {
-                    struct tm t {};
-                    std::istringstream s(tuvDate.c_str());
-                    s >> std::get_time(&t, "%Y%m%dT%H%M%SZ"); // YYYYMMDDThhmmssZ
-                    if (!s.fail())
-                        creationTime = timegm(&t);
-                }
+                fragment.assign("<body>");
+                fragment.append(buf, 0, end);
+                fragment.append("</body>");
+                buf.erase(0, end);
+
+                auto result = doc.load_buffer(fragment.data(), fragment.size(), parse_default, encoding_utf8);
+                if (!result)
+                    throw std::runtime_error(result.description());
 
-                writer.Insert(srclang, lang, source, trans, creationTime);
-                counter++;
+                for (auto tu: doc.child("body").children("tu"))
+                    counter += import_tu(tu, defaults, writer);
             }
+
+            eof = !read_chunk();
         }
     });
 
@@ -162,24 +371,99 @@ void TMX::ImportFromFile(std::istream& file, TranslationMemory& tm)
 
 
 
+void TMX::ImportFromFile(const wxString& filename, TranslationMemory& tm)
+{
+    wxFileInputStream fileStream(filename);
+    if (!fileStream.IsOk())
+        throw Exception(wxString::Format(_(L"Couldn’t open file %s."), filename));
+
+    if (IsCompressedFileName(filename))
+    {
+        wxZlibInputStream zstream(fileStream, wxZLIB_GZIP);
+        wxStdInputStream in(zstream);
+        ImportFromFile(in, tm);
+    }
+    else
+    {
+        wxStdInputStream in(fileStream);
+        ImportFromFile(in, tm);
+    }
+}
+
+
+namespace
+{
+
+void write_escaped(std::ostream& out, const std::string& text, bool isAttribute)
+{
+    for (auto c: text)
+    {
+        switch (c)
+        {
+            case '&':
+                out << "&amp;";
+                break;
+            case '<':
+                out << "&lt;";
+                break;
+            case '>':
+                out << "&gt;";
+                break;
+            case '"':
+                if (isAttribute)
+                    out << "&quot;";
+                else
+                    out << c;
+                break;
+            case '\r':
+            case '\n':
+            case '\t':
+                if (isAttribute)
+                    out << "&#" << (int)c << ';';
+                else
+                    out << c;
+                break;
+            default:
+                // skip control characters not allowed in XML 1.0
+                if ((unsigned char)c >= 0x20)
+                    out << c;
+                break;
+        }
+    }
+}
+
+inline void write_attr(std::ostream& out, const char *name, const std::string& value)
+{
+    out << ' ' << name << "=\"";
+    write_escaped(out, value, true);
+    out << '"';
+}
+
+} // anonymous namespace
+
+
 void TMX::ExportToFile(TranslationMemory& tm, std::ostream& file)
 {
+    // The TMX output is written directly into the stream as entries are
+    // read from the TM, so that nothing has to be kept in memory.
+
     class Exporter : public TranslationMemory::IOInterface
     {
     public:
-        Exporter()
+        Exporter(std::ostream& out) : m_out(out)
         {
-            auto root = m_doc.append_child("tmx");
-            root.append_attribute("version") = "1.4";
-            auto header = root.append_child("header");
-            header.append_attribute("creationtool") = "Poedit";
-            header.append_attribute("creationtoolversion") = POEDIT_VERSION;
-            header.append_attribute("datatype") = "PlainText";
-            header.append_attribute("segtype") = "sentence";
-            header.append_attribute("adminlang") = "en";
-            header.append_attribute("srclang") = "en"; // reasonable default for gettext
-            header.append_attribute("o-tmf") = "PoeditTM";
-            m_body = root.append_child("body");
+            m_out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                  << "<tmx version=\"1.4\">\n"
+                  << "\t<header";
+            write_attr(m_out, "creationtool", "Poedit");
+            write_attr(m_out, "creationtoolversion", POEDIT_VERSION);
+            write_attr(m_out, "datatype", "PlainText");
+            write_attr(m_out, "segtype", "sentence");
+            write_attr(m_out, "adminlang", "en");
+            write_attr(m_out, "srclang", "en"); // reasonable default for gettext
+            write_attr(m_out, "o-tmf", "PoeditTM");
+            m_out << " />\n"
+                  << "\t<body>\n";
         }
 
         void Insert(const Language& srclang,
@@ -188,10 +472,11 @@ void TMX::ExportToFile(TranslationMemory& tm, std::ostream& file)
                     const std::wstring& trans,
                     time_t creationTime) override
         {
-            auto tu = m_body.append_child("tu");
+            m_out << "\t\t<tu";
+
             auto srctag = srclang.LanguageTag();
             if (srctag != "en")
-                tu.append_attribute("srclang") = srctag.c_str();
+                write_attr(m_out, "srclang", srctag);
 
             if (creationTime > 0)
             {
@@ -199,32 +484,321 @@ void TMX::ExportToFile(TranslationMemory& tm, std::ostream& file)
                 wxGmtime_r(&creationTime, &t);
                 std::ostringstream s;
                 s << std::put_time(&t, "%Y%m%dT%H%M%SZ"); // YYYYMMDDThhmmssZ
-                tu.append_attribute("creationdate") = s.str().c_str();
+                write_attr(m_out, "creationdate", s.str());
             }
+            m_out << ">\n";
 
+            WriteTUV(srctag, source);
+            WriteTUV(lang.LanguageTag(), trans);
+
+            m_out << "\t\t</tu>\n";
+
+            if (!m_out)
+                throw Exception(_("Error writing TMX file."));
+        }
+
+        void Finish()
+        {
+            m_out << "\t</body>\n"
+                  << "</tmx>\n";
+            m_out.flush();
+            if (!m_out)
+                throw Exception(_("Error writing TMX file."));
+        }
+
+    private:
+        void WriteTUV(const std::string& lang, const std::wstring& text)
+        {
+            m_out << "\t\t\t<tuv";
+            write_attr(m_out, "xml:lang", lang);
+            m_out << ">\n"
+                  << "\t\t\t\t<seg>";
+            write_escaped(m_out, pugi::as_utf8(text), false);
+            m_out << "</seg>\n"
+                  << "\t\t\t</tuv>\n";
+        }
+
+        std::ostream& m_out;
+    };
+
+    Exporter e(file);
+    tm.ExportData(e);
+    e.Finish();
+}
+
+
+void TMX::ExportToFile(TranslationMemory& tm, const wxString& filename)
+{
+    TempOutputFileFor tempfile(filename);
+    {
+        wxFileOutputStream fileStream(tempfile.FileName());
+        if (!fileStream.IsOk())
+            throw Exception(wxString::Format(_(L"Couldn’t save file %s."), filename));
+
+        if (IsCompressedFileName(filename))
+        {
+            wxZlibOutputStream zstream(fileStream, -1, wxZLIB_GZIP);
+            wxStdOutputStream out(zstream);
+            ExportToFile(tm, out);
+            out.flush();
+            if (!zstream.Close())
+                throw Exception(_("Error writing TMX file."));
+        }
+        else
+        {
+            wxStdOutputStream out(fileStream);
+            ExportToFile(tm, out);
+        }
+
+        if (!fileStream.Close())
+            throw Exception(_("Error writing TMX file."));
+    }
+
+    if (!tempfile.Commit())
+        throw Exception(wxString::Format(_(L"Couldn’t save file %s."), filename));
+}
+
+
+bool TMX::IsCompressedFileName(const wxString& filename)
+{
+    return filename.Lower().EndsWith(".gz");
+}
+
+
+
+// ----------------------------------------------------------------
+// TMBinary
+// ----------------------------------------------------------------
+
+namespace
+{
+
+const char BINARY_MAGIC[] = "PoeditTM";
+const uint64_t BINARY_VERSION = 1;
+
+enum BinaryRecord : unsigned char
+{
+    Record_End = 0,
+    Record_Language = 1,
+    Record_Entry = 2
+};
+
+// Guards against nonsensical lengths in corrupted files
+const uint64_t BINARY_MAX_STRING_LENGTH = 64 * 1024 * 1024;
+
+void write_varint(std::ostream& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.put(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.put(char(value));
+}
+
+void write_string(std::ostream& out, const std::string& s)
+{
+    write_varint(out, s.size());
+    out.write(s.data(), s.size());
+}
+
+[[noreturn]] void throw_invalid_binary()
+{
+    throw Exception(_("The translation memory file is damaged or in unsupported format."));
+}
+
+uint64_t read_varint(std::istream& in)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int c = in.get();
+        if (c == EOF)
+            throw_invalid_binary();
+        value |= uint64_t(c & 0x7f) << shift;
+        if ((c & 0x80) == 0)
+            return value;
+    }
+    throw_invalid_binary();
+}
+
+void read_string(std::istream& in, std::string& out)
+{
+    auto len = read_varint(in);
+    if (len > BINARY_MAX_STRING_LENGTH)
+        throw_invalid_binary();
+    out.resize(size_t(len));
+    if (len && !in.read(&out[0], std::streamsize(len)))
+        throw_invalid_binary();
+}
+
+} // anonymous namespace
+
+
+void TMBinary::ImportFromFile(std::istream& file, TranslationMemory& tm)
+{
+    char magic[sizeof(BINARY_MAGIC) - 1];
+    if (!file.read(magic, sizeof(magic)) || memcmp(magic, BINARY_MAGIC, sizeof(magic)) != 0)
+        throw_invalid_binary();
+    if (read_varint(file) != BINARY_VERSION)
+        throw_invalid_binary();
+
+    tm.ImportData([&](TranslationMemory::IOInterface& io)
+    {
+        std::vector<Language> languages;
+        std::string tag, source, trans;
+        for (;;)
+        {
+            const int record = file.get();
+            if (record == Record_End)
+                break;
+
+            switch (record)
             {
-                auto tuv = tu.append_child("tuv");
-                tuv.append_attribute("xml:lang") = srctag.c_str();
-                tuv.append_child("seg").text() = pugi::as_utf8(source).c_str();
-            }
-            {
-                auto tuv = tu.append_child("tuv");
-                tuv.append_attribute("xml:lang") = lang.LanguageTag().c_str();
-                tuv.append_child("seg").text() = pugi::as_utf8(trans).c_str();
+                case Record_Language:
+                    read_string(file, tag);
+                    languages.push_back(Language::TryParse(tag));
+                    break;
+
+                case Record_Entry:
+                {
+                    auto srclang = read_varint(file);
+                    auto lang = read_varint(file);
+                    const time_t created = (time_t)read_varint(file);
+                    if (srclang >= languages.size() || lang >= languages.size())
+                        throw_invalid_binary();
+                    read_string(file, source);
+                    read_string(file, trans);
+                    io.Insert(languages[srclang], languages[lang], str::to_wstring(source), str::to_wstring(trans), created);
+                    break;
+                }
+
+                default: // including EOF
+                    throw_invalid_binary();
             }
         }
+    });
+}
+
+
+void TMBinary::ImportFromFile(const wxString& filename, TranslationMemory& tm)
+{
+    wxFileInputStream fileStream(filename);
+    if (!fileStream.IsOk())
+        throw Exception(wxString::Format(_(L"Couldn’t open file %s."), filename));
+
+    if (TMX::IsCompressedFileName(filename))
+    {
+        wxZlibInputStream zstream(fileStream, wxZLIB_GZIP);
+        wxStdInputStream in(zstream);
+        ImportFromFile(in, tm);
+    }
+    else
+    {
+        wxStdInputStream in(fileStream);
+        ImportFromFile(in, tm);
+    }
+}
+
+
+void TMBinary::ExportToFile(TranslationMemory& tm, std::ostream& file)
+{
+    class Exporter : public TranslationMemory::IOInterface
+    {
+    public:
+        Exporter(std::ostream& out) : m_out(out)
+        {
+            m_out.write(BINARY_MAGIC, sizeof(BINARY_MAGIC) - 1);
+            write_varint(m_out, BINARY_VERSION);
+        }
+
+        void Insert(const Language& srclang,
+                    const Language& lang,
+                    const std::wstring& source,
+                    const std::wstring& trans,
+                    time_t creationTime) override
+        {
+            auto srcId = LanguageId(srclang);
+            auto langId = LanguageId(lang);
+
+            m_out.put(char(Record_Entry));
+            write_varint(m_out, srcId);
+            write_varint(m_out, langId);
+            write_varint(m_out, creationTime > 0 ? uint64_t(creationTime) : 0);
+            write_string(m_out, str::to_utf8(source));
+            write_string(m_out, str::to_utf8(trans));
+
+            if (!m_out)
+                throw Exception(_("Error writing translation memory file."));
+        }
 
-        void Save(std::ostream& f)
+        void Finish()
         {
-            m_doc.save(f);
+            m_out.put(char(Record_End));
+            m_out.flush();
+            if (!m_out)
+                throw Exception(_("Error writing translation memory file."));
         }
 
     private:
-        xml_document m_doc;
-        xml_node m_body;
+        uint64_t LanguageId(const Language& lang)
+        {
+            auto code = lang.Code();
+            auto i = m_languages.find(code);
+            if (i != m_languages.end())
+                return i->second;
+
+            m_out.put(char(Record_Language));
+            write_string(m_out, lang.Code());
+            const uint64_t id = m_languages.size();
+            m_languages.emplace(code, id);
+            return id;
+        }
+
+        std::ostream& m_out;
+        std::map<std::string, uint64_t> m_languages;
     };
 
-    Exporter e;
+    Exporter e(file);
     tm.ExportData(e);
-    e.Save(file);
+    e.Finish();
+}
+
+
+void TMBinary::ExportToFile(TranslationMemory& tm, const wxString& filename)
+{
+    TempOutputFileFor tempfile(filename);
+    {
+        wxFileOutputStream fileStream(tempfile.FileName());
+        if (!fileStream.IsOk())
+            throw Exception(wxString::Format(_(L"Couldn’t save file %s."), filename));
+
+        if (TMX::IsCompressedFileName(filename))
+        {
+            wxZlibOutputStream zstream(fileStream, -1, wxZLIB_GZIP);
+            wxStdOutputStream out(zstream);
+            ExportToFile(tm, out);
+            out.flush();
+            if (!zstream.Close())
+                throw Exception(_("Error writing translation memory file."));
+        }
+        else
+        {
+            wxStdOutputStream out(fileStream);
+            ExportToFile(tm, out);
+        }
+
+        if (!fileStream.Close())
+            throw Exception(_("Error writing translation memory file."));
+    }
+
+    if (!tempfile.Commit())
+        throw Exception(wxString::Format(_(L"Couldn’t save file %s."), filename));
+}
+
+
+bool TMBinary::IsBinaryFileName(const wxString& filename)
+{
+    auto f = filename.Lower();
+    return f.EndsWith(".poedittm") || f.EndsWith(".poedittm.gz");
 }
@@ -32,13 +32,60 @@
 #include <iostream>
 
 
+#include <wx/string.h>
+
+
 namespace TMX
 {
 
 void ImportFromFile(std::istream& file, TranslationMemory& tm);
 
+/// Imports from a file, which may be gzip-compressed (see IsCompressedFileName())
+void ImportFromFile(const wxString& filename, TranslationMemory& tm);
+
 void ExportToFile(TranslationMemory& tm, std::ostream& file);
 
+/// Exports into a file, gzip-compressed if IsCompressedFileName() is true for it
+void ExportToFile(TranslationMemory& tm, const wxString& filename);
+
+/// Returns true if the file name indicates gzip-compressed TMX (.tmx.gz)
+bool IsCompressedFileName(const wxString& filename);
+
 } // namespace TMX
 
+
+/**
+    Compact binary format for backups and transfers of the whole TM.
+
+    Unlike TMX, the format is length-prefixed and needs no parsing of XML or
+    dates, so it is much smaller and faster to export and import:
+
+      - "PoeditTM" magic followed by varint format version
+      - sequence of records, each starting with a tag byte:
+          1 = language definition: string (language code), gets the next ID
+          2 = entry: varint source language ID, varint language ID,
+              varint creation time, string source, string translation
+          0 = end of data
+
+    Varints are unsigned LEB128; strings are varint length followed by UTF-8
+    bytes. Files are gzip-compressed if IsCompressedFileName() is true for them.
+ */
+namespace TMBinary
+{
+
+void ImportFromFile(std::istream& file, TranslationMemory& tm);
+
+/// Imports from a file, which may be gzip-compressed (see TMX::IsCompressedFileName())
+void ImportFromFile(const wxString& filename, TranslationMemory& tm);
+
+void ExportToFile(TranslationMemory& tm, std::ostream& file);
+
+/// Exports into a file, gzip-compressed if TMX::IsCompressedFileName() is true for it
+void ExportToFile(TranslationMemory& tm, const wxString& filename);
+
+/// Returns true if the file name has extension of this format (.poedittm or .poedittm.gz)
+bool IsBinaryFileName(const wxString& filename);
+
+} // namespace TMBinary
+
 #endif // Poedit_tmx_io_h
@@ -26,20 +26,44 @@
 #include "transmem.h"
 
 #include "catalog.h"
+#include "configuration.h"
 #include "errors.h"
+#include "extractors/extractor.h"
+#include "json.h"
+#include "perf_trace.h"
+#include "progressinfo.h"
 #include "str_helpers.h"
+#include "syntaxhighlighter.h"
 #include "utility.h"
 
 #include <wx/stdpaths.h>
 #include <wx/utils.h>
 #include <wx/dir.h>
+#include <wx/ffile.h>
+#include <wx/file.h>
 #include <wx/filename.h>
 #include <wx/translation.h>
+#include <wx/log.h>
 
 #include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cwctype>
+#include <deque>
+#include <iomanip>
+#include <map>
 #include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <boost/algorithm/string/find.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/uuid/name_generator.hpp>
@@ -51,16 +75,24 @@
 #include <SerialMergeScheduler.h>
 #include <SimpleFSDirectory.h>
 #include <StandardAnalyzer.h>
+#include <PerFieldAnalyzerWrapper.h>
+#include <WhitespaceAnalyzer.h>
 #include <IndexWriter.h>
 #include <IndexSearcher.h>
 #include <IndexReader.h>
 #include <Document.h>
 #include <Field.h>
+#include <MapFieldSelector.h>
 #include <DateField.h>
+#include <DocIdSet.h>
+#include <DocIdSetIterator.h>
+#include <MatchAllDocsQuery.h>
 #include <PrefixQuery.h>
 #include <StringUtils.h>
 #include <TermQuery.h>
 #include <BooleanQuery.h>
+#include <CachingWrapperFilter.h>
+#include <QueryWrapperFilter.h>
 #include <PhraseQuery.h>
 #include <Term.h>
 #include <ScoreDoc.h>
@@ -96,6 +128,254 @@ namespace
     }
 
 
+// Collects performance statistics of TM queries for diagnostics purposes.
+//
+// Counters are cheap to update (relaxed atomics) and are always collected;
+// they can be inspected with TranslationMemory::GetDiagnosticsReport() and
+// are periodically dumped with wxLogTrace("poedit.tm").
+class QueryStats
+{
+public:
+    enum Phase
+    {
+        Phase_Exact,
+        Phase_Normalized,
+        Phase_Phrase,
+        Phase_Sloppy,
+        Phase_Terms,
+        Phase_Max
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    static QueryStats& Get()
+    {
+        static QueryStats s_instance;
+        return s_instance;
+    }
+
+    // Records one execution of search phase @a phase.
+    void RecordPhase(Phase phase, Clock::duration duration, size_t hits, size_t docsLoaded)
+    {
+        auto& p = m_phases[phase];
+        auto us = to_us(duration);
+        p.count++;
+        p.totalUs += us;
+        p.hits += hits;
+        p.docsLoaded += docsLoaded;
+        p.histogram[bucket_for(us)]++;
+    }
+
+    // Records completed query, @a hitPhase is the phase that produced results
+    // or Phase_Max if there were none.
+    void RecordQuery(Clock::duration duration, Phase hitPhase, bool cancelled)
+    {
+        m_queries++;
+        m_queriesTotalUs += to_us(duration);
+        if (cancelled)
+            m_queriesCancelled++;
+        else if (hitPhase == Phase_Max)
+            m_queriesMissed++;
+        else
+            m_phases[hitPhase].answered++;
+
+        if ((m_queries % TRACE_DUMP_INTERVAL) == 0)
+            TraceReport();
+    }
+
+    void RecordReaderReopen(Clock::duration duration)
+    {
+        m_reopens++;
+        m_reopensTotalUs += to_us(duration);
+    }
+
+    // Records writing of @a docs documents to the index (not committed yet).
+    void RecordInserts(size_t docs, Clock::duration duration)
+    {
+        m_insertedDocs += docs;
+        m_insertsTotalUs += to_us(duration);
+    }
+
+    void RecordCommit(Clock::duration duration)
+    {
+        m_commits++;
+        m_commitsTotalUs += to_us(duration);
+    }
+
+    void RecordSubstringSearch(Clock::duration duration)
+    {
+        m_substringSearches++;
+        m_substringSearchesTotalUs += to_us(duration);
+    }
+
+    std::string Report() const;
+
+    void TraceReport() const
+    {
+        if (!wxLog::IsAllowedTraceMask("poedit.tm"))
+            return;
+        std::istringstream ss(Report());
+        std::string line;
+        while (std::getline(ss, line))
+            wxLogTrace("poedit.tm", "%s", line);
+    }
+
+    static const char *PhaseName(Phase phase)
+    {
+        static const char *s_names[Phase_Max] = { "exact", "normalized", "phrase", "sloppy", "terms" };
+        return s_names[phase];
+    }
+
+    static uint64_t to_us(Clock::duration d)
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    }
+
+private:
+    QueryStats() {}
+
+    typedef std::atomic<uint64_t> Counter;
+
+    // latency histogram buckets' upper bounds, in microseconds; the last one is open
+    static constexpr int HISTOGRAM_BUCKETS = 7;
+    static constexpr uint64_t HISTOGRAM_BOUNDS[HISTOGRAM_BUCKETS - 1] = { 100, 500, 1000, 5000, 20000, 100000 };
+    static constexpr uint64_t TRACE_DUMP_INTERVAL = 500;
+
+    static int bucket_for(uint64_t us)
+    {
+        for (int i = 0; i < HISTOGRAM_BUCKETS - 1; i++)
+        {
+            if (us < HISTOGRAM_BOUNDS[i])
+                return i;
+        }
+        return HISTOGRAM_BUCKETS - 1;
+    }
+
+    struct PhaseStats
+    {
+        Counter count {0}, totalUs {0}, hits {0}, docsLoaded {0}, answered {0};
+        Counter histogram[HISTOGRAM_BUCKETS] = {};
+    };
+
+    // Returns upper bound of the histogram bucket containing the @a q quantile,
+    // formatted for display, e.g. "<5" (ms).
+    static std::string quantile_bound(const PhaseStats& p, double q);
+
+    PhaseStats m_phases[Phase_Max];
+    Counter m_queries {0}, m_queriesTotalUs {0}, m_queriesMissed {0}, m_queriesCancelled {0};
+    Counter m_reopens {0}, m_reopensTotalUs {0};
+    Counter m_insertedDocs {0}, m_insertsTotalUs {0};
+    Counter m_commits {0}, m_commitsTotalUs {0};
+    Counter m_substringSearches {0}, m_substringSearchesTotalUs {0};
+};
+
+constexpr uint64_t QueryStats::HISTOGRAM_BOUNDS[];
+
+std::string QueryStats::quantile_bound(const PhaseStats& p, double q)
+{
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+        total += (counts[b] = p.histogram[b]);
+    if (!total)
+        return "-";
+
+    const uint64_t rank = std::max<uint64_t>(1, uint64_t(std::ceil(q * total)));
+    uint64_t seen = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS - 1; b++)
+    {
+        seen += counts[b];
+        if (seen >= rank)
+        {
+            std::ostringstream ss;
+            ss << "<" << HISTOGRAM_BOUNDS[b] / 1000.0;
+            return ss.str();
+        }
+    }
+    std::ostringstream ss;
+    ss << ">=" << HISTOGRAM_BOUNDS[HISTOGRAM_BUCKETS - 2] / 1000.0;
+    return ss.str();
+}
+
+std::string QueryStats::Report() const
+{
+    auto avg_ms = [](uint64_t totalUs, uint64_t count)
+    {
+        return count ? double(totalUs) / count / 1000.0 : 0.0;
+    };
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2);
+
+    const uint64_t queries = m_queries;
+    ss << "queries: " << queries
+       << ", avg " << avg_ms(m_queriesTotalUs, queries) << " ms"
+       << ", without hits: " << m_queriesMissed
+       << ", cancelled: " << m_queriesCancelled << "\n";
+    ss << "reader reopens: " << m_reopens
+       << ", avg " << avg_ms(m_reopensTotalUs, m_reopens) << " ms\n";
+    const uint64_t insertsUs = m_insertsTotalUs;
+    ss << "inserted documents: " << m_insertedDocs
+       << ", " << (insertsUs ? uint64_t(m_insertedDocs * 1e6 / insertsUs) : 0) << " docs/s\n";
+    ss << "commits: " << m_commits
+       << ", avg " << avg_ms(m_commitsTotalUs, m_commits) << " ms\n";
+    ss << "substring searches: " << m_substringSearches
+       << ", avg " << avg_ms(m_substringSearchesTotalUs, m_substringSearches) << " ms\n";
+
+    ss << "latency histogram buckets (ms): <0.1 <0.5 <1 <5 <20 <100 >=100\n";
+    for (int i = 0; i < Phase_Max; i++)
+    {
+        auto& p = m_phases[i];
+        const uint64_t count = p.count;
+        ss << PhaseName(Phase(i)) << ": runs " << count
+           << ", answered " << p.answered
+           << ", avg " << avg_ms(p.totalUs, count) << " ms"
+           << ", hits " << p.hits
+           << ", docs loaded " << p.docsLoaded
+           << ", p50/p90/p99 " << quantile_bound(p, 0.5) << "/" << quantile_bound(p, 0.9) << "/" << quantile_bound(p, 0.99) << " ms"
+           << ", histogram [";
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+            ss << (b ? " " : "") << p.histogram[b];
+        ss << "]\n";
+    }
+
+    return ss.str();
+}
+
+// Number of documents loaded from the index by the current thread, used to
+// attribute loads to search phases in QueryStats.
+thread_local size_t tls_docsLoaded = 0;
+
+template<typename... Args>
+DocumentPtr load_doc(IndexSearcherPtr searcher, Args&&... args)
+{
+    tls_docsLoaded++;
+    return searcher->doc(std::forward<Args>(args)...);
+}
+
+// Measures single search phase and records it in QueryStats when done.
+class PhaseTimer
+{
+public:
+    PhaseTimer(QueryStats::Phase phase, const SuggestionsList& results)
+        : m_phase(phase), m_results(results),
+          m_start(QueryStats::Clock::now()), m_docsLoaded(tls_docsLoaded)
+    {}
+
+    ~PhaseTimer()
+    {
+        auto duration = QueryStats::Clock::now() - m_start;
+        QueryStats::Get().RecordPhase(m_phase, duration, m_results.size(), tls_docsLoaded - m_docsLoaded);
+    }
+
+private:
+    QueryStats::Phase m_phase;
+    const SuggestionsList& m_results;
+    QueryStats::Clock::time_point m_start;
+    size_t m_docsLoaded;
+};
+
+
 // Manages IndexReader and Searcher instances in multi-threaded environment.
 // Curiously, Lucene uses shared_ptr-based refcounting *and* explicit one as
 // well, with a crucial part not well protected.
@@ -105,30 +385,84 @@ namespace
 // class, see
 // http://blog.mikemccandless.com/2011/09/lucenes-searchermanager-simplifies.html
 // http://blog.mikemccandless.com/2011/11/near-real-time-readers-with-lucenes.html
+//
+// The manager is initially created either with a read-only reader opened
+// from the directory or with the near-real-time reader of IndexWriter. In
+// the former case, AttachWriter() must be called when the writer is opened
+// to switch to NRT readers.
+//
+// The current reader and searcher are published as an immutable snapshot
+// that is swapped atomically when the index changes (RCU-style): readers
+// only load the pointer and never block each other, and the reader of a
+// replaced snapshot is released when its last user is done with it. Only
+// Lucene's explicit refcounting of the readers, which is what LUCENE-3567
+// is about, is still serialized, but that happens once per index change.
 class SearcherManager
 {
 public:
-    SearcherManager(IndexWriterPtr writer)
+    SearcherManager(IndexReaderPtr reader)
+    {
+        std::atomic_store(&m_current, MakeSnapshot(reader));
+    }
+
+    void AttachWriter(IndexWriterPtr writer)
     {
-        m_reader = writer->getReader();
-        m_searcher = newLucene<IndexSearcher>(m_reader);
+        std::lock_guard<perf::InstrumentedMutex> guard(m_refreshMutex);
+        IndexReaderPtr reader;
+        {
+            std::lock_guard<perf::InstrumentedMutex> refGuard(m_refCountMutex);
+            reader = writer->getReader();
+        }
+        std::atomic_store(&m_current, MakeSnapshot(reader));
     }
 
     ~SearcherManager()
     {
-        m_searcher.reset();
-        m_reader->decRef();
+        std::atomic_store(&m_current, SnapshotPtr());
+    }
+
+private:
+    // Reader with the explicit Lucene reference owned by the snapshot and
+    // released when it is destroyed
+    struct Snapshot
+    {
+        Snapshot(IndexReaderPtr r, perf::InstrumentedMutex& m)
+            : reader(r), searcher(newLucene<IndexSearcher>(r)), refCountMutex(m) {}
+        ~Snapshot()
+        {
+            searcher.reset();
+            std::lock_guard<perf::InstrumentedMutex> guard(refCountMutex);
+            reader->decRef();
+        }
+
+        IndexReaderPtr   reader;
+        IndexSearcherPtr searcher;
+        perf::InstrumentedMutex& refCountMutex;
+    };
+    typedef std::shared_ptr<const Snapshot> SnapshotPtr;
+
+    SnapshotPtr MakeSnapshot(IndexReaderPtr reader)
+    {
+        ms_maxDoc = reader->maxDoc();
+        return std::make_shared<Snapshot>(reader, m_refCountMutex);
     }
 
-    // Safe, properly ref-counting (in Lucene way, not just shared_ptr) holder.
+public:
+    // Size of the most recently opened index, for memory usage estimates
+    static int32_t LastMaxDoc() { return ms_maxDoc; }
+
+private:
+    static std::atomic<int32_t> ms_maxDoc;
+
+public:
+    // Holder that keeps the snapshot, and so the reader, alive while in use.
     template<typename T>
     class SafeRef
     {
     public:
         typedef boost::shared_ptr<T> TPtr;
 
-        SafeRef(SafeRef&& other) : m_mng(other.m_mng) { std::swap(m_ptr, other.m_ptr); }
-        ~SafeRef() { if (m_ptr) m_mng.DecRef(m_ptr); }
+        SafeRef(SafeRef&& other) = default;
 
         TPtr ptr() { return m_ptr; }
         T* operator->() const { return m_ptr.get(); }
@@ -138,97 +472,431 @@ public:
 
     private:
         friend class SearcherManager;
-        explicit SafeRef(SearcherManager& m, TPtr ptr) : m_mng(m), m_ptr(ptr) {}
+        explicit SafeRef(SnapshotPtr snapshot, TPtr ptr) : m_snapshot(snapshot), m_ptr(ptr) {}
 
-        SearcherManager& m_mng;
-        boost::shared_ptr<T> m_ptr;
+        SnapshotPtr m_snapshot;
+        TPtr m_ptr;
     };
 
     SafeRef<IndexReader> Reader()
     {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        ReloadReaderIfNeeded();
-        m_reader->incRef();
-        return SafeRef<IndexReader>(*this, m_reader);
+        auto snapshot = CurrentSnapshot();
+        return SafeRef<IndexReader>(snapshot, snapshot->reader);
     }
 
     SafeRef<IndexSearcher> Searcher()
     {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        ReloadReaderIfNeeded();
-        m_searcher->getIndexReader()->incRef();
-        return SafeRef<IndexSearcher>(*this, m_searcher);
+        auto snapshot = CurrentSnapshot();
+        return SafeRef<IndexSearcher>(snapshot, snapshot->searcher);
     }
 
 private:
-    void ReloadReaderIfNeeded()
+    SnapshotPtr CurrentSnapshot()
     {
-        // contract: m_mutex is locked when this function is called
-        if (m_reader->isCurrent())
-            return; // nothing to do
+        auto snapshot = std::atomic_load(&m_current);
+        if (snapshot->reader->isCurrent())
+            return snapshot;
+
+        // Only one thread reopens the reader; others keep using the slightly
+        // outdated snapshot meanwhile rather than waiting for it:
+        std::unique_lock<perf::InstrumentedMutex> lock(m_refreshMutex, std::try_to_lock);
+        if (!lock.owns_lock())
+            return snapshot;
 
-        auto newReader = m_reader->reopen();
-        auto newSearcher = newLucene<IndexSearcher>(newReader);
+        // somebody else may have refreshed it before we got the lock:
+        snapshot = std::atomic_load(&m_current);
+        if (snapshot->reader->isCurrent())
+            return snapshot;
 
-        m_reader->decRef();
+        auto start = QueryStats::Clock::now();
+
+        IndexReaderPtr newReader;
+        {
+            std::lock_guard<perf::InstrumentedMutex> refGuard(m_refCountMutex);
+            newReader = snapshot->reader->reopen();
+        }
+        if (newReader != snapshot->reader)
+        {
+            snapshot = MakeSnapshot(newReader);
+            std::atomic_store(&m_current, snapshot);
+        }
 
-        m_reader = newReader;
-        m_searcher = newSearcher;
+        QueryStats::Get().RecordReaderReopen(QueryStats::Clock::now() - start);
+        return snapshot;
     }
 
-    void DecRef(IndexReaderPtr& r)
+    // accessed only with std::atomic_load() and std::atomic_store():
+    SnapshotPtr m_current;
+    // serializes replacing of m_current:
+    perf::InstrumentedMutex m_refreshMutex {"TM searcher refresh"};
+    // serializes changes to Lucene's explicit refcounts, see above:
+    perf::InstrumentedMutex m_refCountMutex {"TM reader refcount"};
+};
+
+std::atomic<int32_t> SearcherManager::ms_maxDoc {0};
+
+
+// Computes the key used for exact-match lookups. Note that it is a digest and
+// so in theory it could have collisions; matched documents must be verified.
+std::wstring exact_match_key(const std::wstring& srclang, const std::wstring& lang, const std::wstring& source)
+{
+    static const boost::uuids::uuid s_namespace =
+      boost::uuids::string_generator()("2f9b6a2e-5e0c-4d3a-8d8f-8f0e2b9e6a51");
+    boost::uuids::name_generator gen(s_namespace);
+
+    std::wstring key(srclang);
+    key += L'\x1f';
+    key += lang;
+    key += L'\x1f';
+    key += source;
+
+    return boost::uuids::to_wstring(gen(key));
+}
+
+
+// Character that replaces variable parts of texts in normalized form
+const wchar_t NORMALIZED_PART_MARKER = L'\xE000';
+
+// Text with its variable parts -- placeholders, markup and numbers -- masked,
+// so that texts differing only in them have the same normalized form.
+struct NormalizedText
+{
+    std::wstring text;                // variable parts replaced with NORMALIZED_PART_MARKER
+    std::vector<std::wstring> parts;  // the replaced parts, in order
+
+    // Is it useful to look up the text by its normalized form? That's not
+    // the case if nothing was masked or if nothing but the masked parts and
+    // punctuation is left.
+    bool is_useful() const
     {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        r->decRef();
+        return !parts.empty() && std::any_of(text.begin(), text.end(), [](wchar_t c){ return std::iswalpha(c); });
     }
-    void DecRef(IndexSearcherPtr& s)
+};
+
+NormalizedText normalize_variable_parts(const std::wstring& s)
+{
+    // placeholders and markup are recognized the same way they are highlighted
+    // in the UI, but without knowing the format, so all common kinds are used:
+    std::vector<std::pair<int, int>> spans;
+    SyntaxHighlighter::ForUnknownFormat()->Highlight(s, [&spans](int a, int b, SyntaxHighlighter::TextKind)
+    {
+        spans.emplace_back(a, b);
+    });
+    // highlighters may overlap, prefer the longest span starting at given position:
+    std::sort(spans.begin(), spans.end(), [](const auto& a, const auto& b)
+    {
+        return a.first < b.first || (a.first == b.first && a.second > b.second);
+    });
+
+    auto is_digit = [](wchar_t c){ return c >= '0' && c <= '9'; };
+
+    NormalizedText out;
+    out.text.reserve(s.size());
+    size_t pos = 0;
+
+    auto add_part = [&](size_t start, size_t end)
+    {
+        out.text += NORMALIZED_PART_MARKER;
+        out.parts.push_back(s.substr(start, end - start));
+        pos = end;
+    };
+
+    // copies text up to @a until, masking numbers (including e.g. "1,000.5") in it:
+    auto add_plain = [&](size_t until)
+    {
+        while (pos < until)
+        {
+            if (!is_digit(s[pos]))
+            {
+                out.text += s[pos++];
+                continue;
+            }
+            size_t end = pos;
+            while (end < until && (is_digit(s[end]) || ((s[end] == '.' || s[end] == ',') && end + 1 < until && is_digit(s[end + 1]))))
+                end++;
+            add_part(pos, end);
+        }
+    };
+
+    for (auto& span: spans)
     {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        s->getIndexReader()->decRef();
+        if (size_t(span.first) < pos)
+            continue;  // overlaps already masked part
+        add_plain(span.first);
+        add_part(span.first, span.second);
     }
+    add_plain(s.size());
 
-    IndexReaderPtr   m_reader;
-    IndexSearcherPtr m_searcher;
-    std::mutex       m_mutex;
-};
+    return out;
+}
 
+// Computes the key used for lookups of texts differing only in variable parts
+// (see NormalizedText) or returns empty string if the text doesn't need it.
+std::wstring normalized_match_key(const std::wstring& srclang, const std::wstring& lang, const NormalizedText& source)
+{
+    if (!source.is_useful())
+        return std::wstring();
+    return exact_match_key(srclang, lang, source.text);
+}
 
-struct SearchArguments
+// Adapts translation @a trans of text with variable parts @a from to text with
+// variable parts @a to, by replacing the parts in the translation. Returns
+// false if that can't be done reliably, e.g. if the translation doesn't use
+// all of the changed parts verbatim.
+bool reinject_variable_parts(const std::wstring& trans,
+                             const std::vector<std::wstring>& from,
+                             const std::vector<std::wstring>& to,
+                             std::wstring& out)
 {
-    QueryPtr srclang, lang;
-    QueryPtr query;
-    std::wstring exactSourceText;
+    if (from.size() != to.size())
+        return false;
 
-    void set_lang(const Language& srclang_, const Language& lang_)
+    std::map<std::wstring, std::wstring> replacements;
+    std::set<std::wstring> unused;
+    for (size_t i = 0; i < from.size(); i++)
     {
-        // TODO: query by srclang too!
-        this->srclang = newLucene<TermQuery>(newLucene<Term>(L"srclang", srclang_.WCode()));
+        auto r = replacements.emplace(from[i], to[i]);
+        if (!r.second && r.first->second != to[i])
+            return false;  // ambiguous, same part is replaced with different values
+        if (from[i] != to[i])
+            unused.insert(from[i]);
+    }
 
-        const Lucene::String fullLang = lang_.WCode();
-        const Lucene::String shortLang = StringUtils::toUnicode(lang_.Lang());
+    auto t = normalize_variable_parts(trans);
+    if ((size_t)std::count(t.text.begin(), t.text.end(), NORMALIZED_PART_MARKER) != t.parts.size())
+        return false;  // the marker character itself is present in the text
 
-        QueryPtr langPrimary = newLucene<TermQuery>(newLucene<Term>(L"lang", fullLang));
-        QueryPtr langSecondary;
-        if (fullLang == shortLang)
+    out.clear();
+    out.reserve(trans.size());
+    size_t part = 0;
+    for (auto c: t.text)
+    {
+        if (c != NORMALIZED_PART_MARKER)
+        {
+            out += c;
+            continue;
+        }
+        auto& p = t.parts[part++];
+        auto r = replacements.find(p);
+        if (r != replacements.end())
         {
-            // for e.g. 'cs', search also 'cs_*' (e.g. 'cs_CZ')
-            langSecondary = newLucene<PrefixQuery>(newLucene<Term>(L"lang", shortLang + L"_"));
+            out += r->second;
+            unused.erase(p);
         }
         else
         {
-            // search short variants of the language too
-            langSecondary = newLucene<TermQuery>(newLucene<Term>(L"lang", shortLang));
+            out += p;
         }
-        langSecondary->setBoost(0.85);
-        auto langQ = newLucene<BooleanQuery>();
-        langQ->add(langPrimary, BooleanClause::SHOULD);
-        langQ->add(langSecondary, BooleanClause::SHOULD);
+    }
+
+    return unused.empty();
+}
+
+
+// Counts tokens in the source text, as produced by the analyzer used for indexing.
+int count_tokens(AnalyzerPtr analyzer, const std::wstring& text)
+{
+    auto stream = analyzer->tokenStream(L"source", newLucene<StringReader>(text));
+    int count = 0;
+    while (stream->incrementToken())
+        count++;
+    return count;
+}
+
+// Returns stored token count of the document's source text or -1 if the document
+// doesn't have it (i.e. was stored by an older version and not migrated yet).
+int get_token_count(DocumentPtr doc)
+{
+    auto value = doc->get(L"srctokens");
+    if (value.empty())
+        return -1;
+    return StringUtils::toInt(value);
+}
+
+
+// Version of stored documents' schema, stored in the "v" field. Missing
+// version means pre-1.8 data, see get_text_field(). Version 2 added
+// "srctokens" and "srcgrams" fields, version 3 added "srcnkey".
+const wchar_t *DOCUMENT_VERSION = L"3";
+
+// Length of character n-grams indexed for substring search
+const size_t NGRAM_LENGTH = 3;
+
+// Returns (lowercased) character n-grams of @a text. Whitespace is replaced
+// with '_', so that the grams can be tokenized with WhitespaceAnalyzer.
+std::vector<std::wstring> ngrams_of(const std::wstring& text)
+{
+    std::wstring normalized;
+    normalized.reserve(text.size());
+    for (auto c: text)
+        normalized += std::iswspace(c) ? L'_' : (wchar_t)std::towlower(c);
+
+    std::vector<std::wstring> grams;
+    if (normalized.size() < NGRAM_LENGTH)
+        return grams;
+    grams.reserve(normalized.size() - NGRAM_LENGTH + 1);
+    for (size_t i = 0; i + NGRAM_LENGTH <= normalized.size(); i++)
+        grams.push_back(normalized.substr(i, NGRAM_LENGTH));
+    return grams;
+}
+
+// Value of the "srcgrams" field: space-separated n-grams of the source text.
+//
+// Unlike "source", which is tokenized into words, this allows finding
+// arbitrary substrings, including parts of words and text in scripts that
+// don't separate words with spaces (e.g. CJK).
+std::wstring make_ngrams(const std::wstring& text)
+{
+    std::wstring out;
+    for (auto& g: ngrams_of(text))
+    {
+        if (!out.empty())
+            out += L' ';
+        out += g;
+    }
+    return out;
+}
+
+
+// Queries and filter used to restrict search to given language pair
+struct LanguagePairQueries
+{
+    QueryPtr lang;     // language query, used in scoring
+    FilterPtr filter;  // filter restricting documents to the language pair
+};
+
+LanguagePairQueries create_language_pair_queries(const Language& srclang, const Language& lang)
+{
+    QueryPtr srclangQ = newLucene<TermQuery>(newLucene<Term>(L"srclang", srclang.WCode()));
+
+    const Lucene::String fullLang = lang.WCode();
+    const Lucene::String shortLang = StringUtils::toUnicode(lang.Lang());
+
+    QueryPtr langPrimary = newLucene<TermQuery>(newLucene<Term>(L"lang", fullLang));
+    QueryPtr langSecondary;
+    if (fullLang == shortLang)
+    {
+        // for e.g. 'cs', search also 'cs_*' (e.g. 'cs_CZ')
+        langSecondary = newLucene<PrefixQuery>(newLucene<Term>(L"lang", shortLang + L"_"));
+    }
+    else
+    {
+        // search short variants of the language too
+        langSecondary = newLucene<TermQuery>(newLucene<Term>(L"lang", shortLang));
+    }
+    langSecondary->setBoost(0.85);
+    auto langQ = newLucene<BooleanQuery>();
+    langQ->add(langPrimary, BooleanClause::SHOULD);
+    langQ->add(langSecondary, BooleanClause::SHOULD);
+
+    auto pairQ = newLucene<BooleanQuery>();
+    pairQ->add(srclangQ, BooleanClause::MUST);
+    pairQ->add(langQ, BooleanClause::MUST);
+
+    LanguagePairQueries q;
+    q.lang = langQ;
+    q.filter = newLucene<CachingWrapperFilter>(newLucene<QueryWrapperFilter>(pairQ));
+    return q;
+}
+
+// Returns (cached) queries for given language pair.
+//
+// Filters are used instead of mandatory query clauses, because they don't
+// need to be evaluated against the index for every query: CachingWrapperFilter
+// remembers the matching documents for each index segment, so that the cost
+// of finding them is only paid once per language pair and (new) segment.
+// The queries are shared too, so that nothing needs to be allocated for them
+// per search.
+LanguagePairQueries language_pair_queries(const Language& srclang, const Language& lang)
+{
+    static const size_t MAX_CACHED_FILTERS = 64;
+
+    static std::mutex s_mutex;
+    static std::unordered_map<std::wstring, LanguagePairQueries> s_cache;
+
+    // The filters' cached bitsets take one bit per document (for every
+    // segment, which adds up to the whole index). They are only needed
+    // for speed, so can be recomputed after critical memory pressure.
+    static CacheRegistry::Registration s_registration("TM language pair filters",
+        []
+        {
+            std::lock_guard<std::mutex> lock(s_mutex);
+            return s_cache.size() * (size_t(SearcherManager::LastMaxDoc()) / 8);
+        },
+        [](CacheRegistry::Pressure pressure)
+        {
+            if (pressure != CacheRegistry::Pressure::Critical)
+                return;
+            std::lock_guard<std::mutex> lock(s_mutex);
+            s_cache.clear();
+        });
+
+    const std::wstring key = srclang.WCode() + L'\x1f' + lang.WCode();
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    auto found = s_cache.find(key);
+    if (found != s_cache.end())
+        return found->second;
 
-        this->lang = langQ;
+    if (s_cache.size() >= MAX_CACHED_FILTERS)
+        s_cache.clear();
+
+    auto q = create_language_pair_queries(srclang, lang);
+    s_cache.emplace(key, q);
+    return q;
+}
+
+
+struct SearchArguments
+{
+    FilterPtr langFilter;
+    QueryPtr lang;
+    QueryPtr query;
+    std::wstring exactSourceText;
+    std::wstring srclangCode, langCode;
+    dispatch::cancellation_token_ptr cancellationToken;
+
+    bool is_cancelled() const { return cancellationToken && cancellationToken->is_cancelled(); }
+
+    void set_lang(const Language& srclang_, const Language& lang_)
+    {
+        this->srclangCode = srclang_.WCode();
+        this->langCode = lang_.WCode();
+
+        // Documents are restricted to the language pair by the filter, but the
+        // language query is still used in scoring, to prefer exact matches of
+        // the language over other variants of it:
+        auto q = language_pair_queries(srclang_, lang_);
+        this->lang = q.lang;
+        this->langFilter = q.filter;
     }
 };
 
 
+// Number used to pick the form stored as "the" plural translation in
+// languages with more than 2 plural forms
+const int TYPICAL_PLURAL_N = 5;
+
+// Returns index of the plural form used for TYPICAL_PLURAL_N in given
+// language (e.g. "many" in Slavic languages) or -1 if not known.
+int GetTypicalPluralForm(const Language& lang)
+{
+    static std::mutex s_mutex;
+    static std::unordered_map<std::string, int> s_cache;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto i = s_cache.find(lang.Code());
+    if (i != s_cache.end())
+        return i->second;
+
+    auto expr = lang.DefaultPluralFormsExpr();
+    const int form = expr ? expr.evaluate_for_n(TYPICAL_PLURAL_N) : -1;
+    s_cache.emplace(lang.Code(), form);
+    return form;
+}
+
+
 } // anonymous namespace
 
 // ----------------------------------------------------------------
@@ -246,36 +914,112 @@ public:
 
     TranslationMemoryImpl() { Init(); }
 
-    ~TranslationMemoryImpl()
-    {
-        m_mng.reset();
-        m_writer->close();
-    }
+    ~TranslationMemoryImpl();
 
     SuggestionsList Search(const Language& srclang, const Language& lang,
-                           const std::wstring& source);
+                           const std::wstring& source,
+                           dispatch::cancellation_token_ptr cancellationToken);
+
+    std::vector<SuggestionsList> SearchBatch(const Language& srclang, const Language& lang,
+                                             const std::vector<std::wstring>& sources);
+
+    void Warmup(const Language& srclang, const Language& lang);
 
     void ExportData(TranslationMemory::IOInterface& destination);
     void ImportData(std::function<void(TranslationMemory::IOInterface&)> source);
 
+    time_t ExportChanges(time_t since, std::ostream& out);
+    long ImportChanges(std::istream& in);
+
+    /// Records deletion of an entry for ExportChanges()
+    static void RecordDeletion(const std::wstring& uuid);
+    /// Records deletion of several entries at once for ExportChanges()
+    static void RecordDeletions(const std::vector<std::wstring>& uuids);
+    /// Forgets recorded deletions, e.g. when all data are deleted
+    static void ForgetDeletions();
+
     void SearchSubstring(TranslationMemory::IOInterface& destination,
                         const Language& srclang, const Language& lang, const std::wstring& sourcePhrase);
 
-    std::shared_ptr<TranslationMemory::Writer> GetWriter() { return m_writerAPI; }
+    /// Returns the writer, opening it first if it wasn't used yet
+    std::shared_ptr<TranslationMemory::Writer> GetWriter();
 
     void GetStats(long& numDocs, long& fileSize);
 
+    TranslationMemory::MaintenanceResult Maintain(const TranslationMemory::MaintenanceOptions& options);
+
+    /// Runs @a f in the background; the TM isn't closed before it finishes.
+    template<typename F>
+    auto RunInBackground(F&& f)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_backgroundMutex);
+            m_backgroundJobs++;
+        }
+        return dispatch::async([this, f{std::forward<F>(f)}]
+        {
+            struct JobScope
+            {
+                JobScope(TranslationMemoryImpl& tm) : m_tm(tm) {}
+                ~JobScope()
+                {
+                    std::lock_guard<std::mutex> lock(m_tm.m_backgroundMutex);
+                    if (--m_tm.m_backgroundJobs == 0)
+                        m_tm.m_backgroundDone.notify_all();
+                }
+                TranslationMemoryImpl& m_tm;
+            };
+            JobScope scope(*this);
+            return f();
+        });
+    }
+
     static std::wstring GetDatabaseDir();
 
 private:
+    // Deletions are logged into this file, because deleted documents
+    // can't be found in the index (see RecordDeletion())
+    static wxString GetDeletionsLogFile();
+    static std::mutex ms_deletionsMutex;
+
     void Init();
+    void OpenWriter();
+
+    // Runs maintenance in the background if it wasn't done for a while
+    void ScheduleMaintenanceIfNeeded();
+
+    // Re-creates documents stored by older versions (i.e. with older
+    // DOCUMENT_VERSION) in the background, so that they have all fields
+    void MigrateDocumentsIfNeeded();
+    void MigrateDocuments(const wxString& doneMarker);
+
+    SuggestionsList DoSearch(IndexSearcherPtr searcher, const SearchArguments& langArgs,
+                             const std::wstring& source);
+    SuggestionsList DoSearchPhases(IndexSearcherPtr searcher, const SearchArguments& langArgs,
+                                   const std::wstring& source, QueryStats::Phase& hitPhase);
 
 private:
+    DirectoryPtr     m_dir;
     AnalyzerPtr      m_analyzer;
     IndexWriterPtr   m_writer;
     std::shared_ptr<SearcherManager> m_mng;
 
+    // Writer is only opened on first use, because it is expensive to open and
+    // most uses of the TM are read-only. Protected by m_writerMutex.
     std::shared_ptr<TranslationMemory::Writer> m_writerAPI;
+    std::mutex m_writerMutex;
+
+    // Background jobs (see RunInBackground()) check m_backgroundCancelled and
+    // stop early when the TM is being closed.
+    std::atomic<bool> m_backgroundCancelled {false};
+    int m_backgroundJobs = 0;
+    std::mutex m_backgroundMutex;
+    std::condition_variable m_backgroundDone;
+
+    // Number of interactive searches in progress, batch searches yield to them
+    int m_interactiveSearches = 0;
+    std::mutex m_interactiveMutex;
+    std::condition_variable m_interactiveDone;
 };
 
 
@@ -313,6 +1057,15 @@ static const int MAX_RESULTS = 10;
 // a few hits regardless.
 static const int LUCENE_QUERY_MAX_DOCS = 500;
 
+// Max. number of documents queried for in ranked (fuzzy) search. Hits are
+// rescored using edit distance, which is much more reliable than Lucene's
+// score, so fewer candidates are needed than in LUCENE_QUERY_MAX_DOCS.
+static const int RANKED_QUERY_MAX_DOCS = 100;
+
+// Number of best hits (as scored by Lucene) that are rescored using edit
+// distance in ranked search; the rest is discarded.
+static const int EDIT_DISTANCE_CANDIDATES = 30;
+
 // Normalized score that must be met for a suggestion to be shown. This is
 // an empirical guess of what constitutes good matches.
 static const double QUALITY_THRESHOLD = 0.6;
@@ -320,6 +1073,10 @@ static const double QUALITY_THRESHOLD = 0.6;
 // Maximum allowed difference in phrase length, in #terms.
 static const int MAX_ALLOWED_LENGTH_DIFFERENCE = 2;
 
+// Maximum time a batch search waits for interactive searches to finish
+// before looking up the next string.
+static const int BATCH_MAX_YIELD_MS = 50;
+
 
 void AddOrUpdateResult(SuggestionsList& all, Suggestion&& r)
 {
@@ -329,6 +1086,9 @@ void AddOrUpdateResult(SuggestionsList& all, Suggestion&& r)
     //   "Open file" (Win) -> "Otevřít soubor"
     // So we can't keep the first score, but need to update it if a better match
     // with the same translation is found during the search.
+    //
+    // The list is short (bounded by the number of rescored candidates), so
+    // a linear scan is cheaper than maintaining a hash index on the side.
     auto found = std::find_if(all.begin(), all.end(),
                               [&r](const Suggestion& x){ return x.text == r.text; });
     if (found == all.end())
@@ -338,7 +1098,7 @@ void AddOrUpdateResult(SuggestionsList& all, Suggestion&& r)
     else
     {
         if (r.score > found->score)
-            *found = r;
+            *found = std::move(r);
     }
 }
 
@@ -361,26 +1121,261 @@ std::wstring get_text_field(DocumentPtr doc, const std::wstring& field)
 }
 
 
+// Field selector for loading only what is needed to construct a Suggestion
+// from a hit, skipping the token lists and other indexing-only fields.
+FieldSelectorPtr hit_selector()
+{
+    static FieldSelectorPtr s_selector;
+    static std::once_flag s_flag;
+    std::call_once(s_flag, []{
+        auto fields = Collection<Lucene::String>::newInstance();
+        fields.add(L"source");
+        fields.add(L"trans");
+        fields.add(L"uuid");
+        fields.add(L"created");
+        fields.add(L"v");
+        s_selector = newLucene<MapFieldSelector>(fields);
+    });
+    return s_selector;
+}
+
+
 void postprocess_results(SuggestionsList& results)
 {
     std::stable_sort(results.begin(), results.end());
-    results.resize(MAX_RESULTS);
+    if (results.size() > (size_t)MAX_RESULTS)
+        results.resize(MAX_RESULTS);
 }
 
 
-template<typename T>
-void PerformSearchWithBlock(IndexSearcherPtr searcher,
+// Looks up exact matches of the source text using the "srckey" field, which
+// is much faster than full phrase search, because it doesn't involve any
+// analysis or scoring and only a handful of documents are loaded.
+//
+// Note that documents stored by older versions don't have the key and will
+// only be found by regular search.
+bool PerformExactSearch(IndexSearcherPtr searcher,
+                        const SearchArguments& sa,
+                        SuggestionsList& results)
+{
+    auto key = exact_match_key(sa.srclangCode, sa.langCode, sa.exactSourceText);
+    auto query = newLucene<TermQuery>(newLucene<Term>(L"srckey", key));
+
+    auto hits = searcher->search(query, MAX_RESULTS);
+
+    for (int i = 0; i < hits->scoreDocs.size(); i++)
+    {
+        auto doc = load_doc(searcher, hits->scoreDocs[i]->doc, hit_selector());
+        if (get_text_field(doc, L"source") != sa.exactSourceText)
+            continue; // digest collision
+
+        time_t ts = DateField::stringToTime(doc->get(L"created"));
+        Suggestion r {get_text_field(doc, L"trans"), 1.0, int(ts)};
+        r.id = StringUtils::toUTF8(doc->get(L"uuid"));
+        AddOrUpdateResult(results, std::move(r));
+    }
+
+    postprocess_results(results);
+    return !results.empty();
+}
+
+
+// Score of matches found by PerformNormalizedSearch(); they aren't exact, but
+// only differ in parts that were adapted to the searched text:
+const double NORMALIZED_MATCH_SCORE = 0.95;
+
+// Looks up texts that differ from the source only in placeholders, markup or
+// numbers using the "srcnkey" field and adapts their translations to the
+// variable parts of the source. Just as cheap as PerformExactSearch().
+bool PerformNormalizedSearch(IndexSearcherPtr searcher,
+                             const SearchArguments& sa,
+                             SuggestionsList& results)
+{
+    auto normalized = normalize_variable_parts(sa.exactSourceText);
+    auto key = normalized_match_key(sa.srclangCode, sa.langCode, normalized);
+    if (key.empty())
+        return false;
+
+    auto query = newLucene<TermQuery>(newLucene<Term>(L"srcnkey", key));
+
+    auto hits = searcher->search(query, MAX_RESULTS);
+
+    for (int i = 0; i < hits->scoreDocs.size(); i++)
+    {
+        auto doc = load_doc(searcher, hits->scoreDocs[i]->doc, hit_selector());
+        auto found = normalize_variable_parts(get_text_field(doc, L"source"));
+        if (found.text != normalized.text)
+            continue; // digest collision
+
+        std::wstring trans;
+        if (!reinject_variable_parts(get_text_field(doc, L"trans"), found.parts, normalized.parts, trans))
+            continue;
+
+        time_t ts = DateField::stringToTime(doc->get(L"created"));
+        Suggestion r {trans, NORMALIZED_MATCH_SCORE, int(ts)};
+        r.id = StringUtils::toUTF8(doc->get(L"uuid"));
+        AddOrUpdateResult(results, std::move(r));
+    }
+
+    postprocess_results(results);
+    return !results.empty();
+}
+
+
+/**
+    Computes Levenshtein distance of texts to a fixed pattern.
+
+    Uses bit-parallel algorithm by Myers (1999), in the multi-word form
+    described by Hyyrö (2003), which processes 64 rows of the dynamic
+    programming matrix at once. Precomputed match vectors of the pattern
+    are reused for all compared texts.
+ */
+class EditDistance
+{
+public:
+    explicit EditDistance(const std::wstring& pattern)
+        : m_length((int)pattern.size()),
+          m_blocks((m_length + WORD_BITS - 1) / WORD_BITS)
+    {
+        for (int i = 0; i < m_length; i++)
+        {
+            auto& eq = m_peq[pattern[i]];
+            if (eq.empty())
+                eq.resize(m_blocks, 0);
+            eq[i / WORD_BITS] |= Word(1) << (i % WORD_BITS);
+        }
+    }
+
+    /// Returns edit distance between the pattern and @a text.
+    int Distance(const std::wstring& text) const
+    {
+        if (m_length == 0)
+            return (int)text.size();
+
+        std::vector<Word> pv(m_blocks, ~Word(0)), mv(m_blocks, 0);
+        const Word lastHighBit = Word(1) << ((m_length - 1) % WORD_BITS);
+        const std::vector<Word> noMatch(m_blocks, 0);
+
+        int score = m_length;
+        for (auto c: text)
+        {
+            auto found = m_peq.find(c);
+            auto& eq = (found != m_peq.end()) ? found->second : noMatch;
+
+            int carry = 1; // distance from empty pattern grows by 1 in every column
+            for (int b = 0; b < m_blocks; b++)
+            {
+                Word highBit = HIGH_BIT;
+                if (b == m_blocks - 1)
+                    highBit = lastHighBit;
+                carry = AdvanceBlock(pv[b], mv[b], eq[b], carry, highBit);
+            }
+            score += carry;
+        }
+
+        return score;
+    }
+
+    /// Returns similarity of @a text to the pattern, in the 0..1 range.
+    double Similarity(const std::wstring& text) const
+    {
+        int maxLength = std::max(m_length, (int)text.size());
+        if (maxLength == 0)
+            return 1.0;
+        return 1.0 - double(Distance(text)) / maxLength;
+    }
+
+private:
+    typedef uint64_t Word;
+    static const int WORD_BITS = 64;
+    static const Word HIGH_BIT = Word(1) << (WORD_BITS - 1);
+
+    // Computes one 64-row block of the column, given horizontal delta @a hin
+    // coming from the block above; returns delta at the block's @a highBit row.
+    static int AdvanceBlock(Word& pv, Word& mv, Word eq, int hin, Word highBit)
+    {
+        const Word hinNeg = (hin < 0) ? 1 : 0;
+        const Word hinPos = (hin > 0) ? 1 : 0;
+
+        Word xv = eq | mv;
+        eq |= hinNeg;
+        Word xh = (((eq & pv) + pv) ^ pv) | eq;
+        Word ph = mv | ~(xh | pv);
+        Word mh = pv & xh;
+
+        int hout = 0;
+        if (ph & highBit)
+            hout = 1;
+        else if (mh & highBit)
+            hout = -1;
+
+        ph = (ph << 1) | hinPos;
+        mh = (mh << 1) | hinNeg;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+
+        return hout;
+    }
+
+    int m_length, m_blocks;
+    std::unordered_map<wchar_t, std::vector<Word>> m_peq;
+};
+
+
+// Adjusts Lucene's (normalized) score of a hit with source text @a src
+double rescore_hit(const SearchArguments& sa, const std::wstring& src, double score, double scoreScaling)
+{
+    if (src == sa.exactSourceText)
+        return 1.0;
+
+    if (score == 1.0)
+    {
+        score = 0.95; // can't score non-exact thing as 100%:
+
+        // Check against too small queries having perfect hit in a large stored text.
+        // Do this by penalizing too large difference in lengths of the source strings.
+        double len1 = sa.exactSourceText.size();
+        double len2 = src.size();
+        score *= 1.0 - 0.4 * (std::abs(len1 - len2) / std::max(len1, len2));
+    }
+
+    return score * scoreScaling;
+}
+
+TopDocsPtr run_query(IndexSearcherPtr searcher, const SearchArguments& sa, int maxDocs = LUCENE_QUERY_MAX_DOCS)
+{
+    auto fullQuery = newLucene<BooleanQuery>();
+    fullQuery->add(sa.lang, BooleanClause::SHOULD);
+    fullQuery->add(sa.query, BooleanClause::MUST);
+
+    return searcher->search(fullQuery, sa.langFilter, maxDocs);
+}
+
+// Field selector for loading only what is needed for (re)scoring of hits,
+// without the (comparatively expensive) rest of the stored document.
+FieldSelectorPtr source_only_selector()
+{
+    static FieldSelectorPtr s_selector;
+    static std::once_flag s_flag;
+    std::call_once(s_flag, []{
+        auto fields = Collection<Lucene::String>::newInstance();
+        fields.add(L"source");
+        fields.add(L"srctokens");
+        fields.add(L"v");
+        s_selector = newLucene<MapFieldSelector>(fields);
+    });
+    return s_selector;
+}
+
+
+template<typename T>
+void PerformSearchWithBlock(IndexSearcherPtr searcher,
                             const SearchArguments& sa,
                             double scoreThreshold,
                             double scoreScaling,
                             T callback)
 {
-    auto fullQuery = newLucene<BooleanQuery>();
-    fullQuery->add(sa.srclang, BooleanClause::MUST);
-    fullQuery->add(sa.lang, BooleanClause::MUST);
-    fullQuery->add(sa.query, BooleanClause::MUST);
-
-    auto hits = searcher->search(fullQuery, LUCENE_QUERY_MAX_DOCS);
+    auto hits = run_query(searcher, sa);
 
     for (int i = 0; i < hits->scoreDocs.size(); i++)
     {
@@ -389,30 +1384,106 @@ void PerformSearchWithBlock(IndexSearcherPtr searcher,
         if (score < scoreThreshold)
             continue;
 
-        auto doc = searcher->doc(scoreDoc->doc);
-        auto src = get_text_field(doc, L"source");
-        if (src == sa.exactSourceText)
-        {
-            score = 1.0;
-        }
-        else
-        {
-            if (score == 1.0)
-            {
-                score = 0.95; // can't score non-exact thing as 100%:
+        auto doc = load_doc(searcher, scoreDoc->doc);
+        score = rescore_hit(sa, get_text_field(doc, L"source"), score, scoreScaling);
 
-                // Check against too small queries having perfect hit in a large stored text.
-                // Do this by penalizing too large difference in lengths of the source strings.
-                double len1 = sa.exactSourceText.size();
-                double len2 = src.size();
-                score *= 1.0 - 0.4 * (std::abs(len1 - len2) / std::max(len1, len2));
-            }
+        callback(doc, score);
+    }
+}
 
-            score *= scoreScaling;
-        }
 
-        callback(doc, score);
+/**
+    Performs search and adds the best hits to @a results.
+
+    Unlike PerformSearchWithBlock(), this is done in two phases: in the first one,
+    hits are ranked with only the source text loaded. Lucene's score is only
+    used to pick EDIT_DISTANCE_CANDIDATES best candidates, which are then scored
+    by edit distance similarity of their source text. Full documents are then
+    only loaded for as many of the best-ranked hits as needed to fill in
+    MAX_RESULTS unique suggestions.
+
+    Optional @a filter is called with the partially loaded document (see
+    source_only_selector()) and the source text of every candidate hit and can
+    reject it by returning false.
+ */
+template<typename TFilter>
+void PerformRankedSearch(IndexSearcherPtr searcher,
+                         const SearchArguments& sa,
+                         SuggestionsList& results,
+                         double scoreThreshold,
+                         double scoreScaling,
+                         TFilter filter)
+{
+    struct Candidate
+    {
+        int32_t doc;
+        double score;
+        std::wstring source;
+    };
+
+    auto by_score = [](const Candidate& a, const Candidate& b){ return a.score > b.score; };
+
+    auto hits = run_query(searcher, sa, RANKED_QUERY_MAX_DOCS);
+    auto selector = source_only_selector();
+
+    std::vector<Candidate> candidates;
+    for (int i = 0; i < hits->scoreDocs.size(); i++)
+    {
+        if (sa.is_cancelled())
+            return;
+
+        const auto& scoreDoc = hits->scoreDocs[i];
+        double score = scoreDoc->score / hits->maxScore;
+        if (score < scoreThreshold)
+            continue;
+
+        auto partialDoc = load_doc(searcher, scoreDoc->doc, selector);
+        auto src = get_text_field(partialDoc, L"source");
+        if (!filter(partialDoc, src))
+            continue;
+
+        candidates.push_back({scoreDoc->doc, rescore_hit(sa, src, score, scoreScaling), std::move(src)});
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(), by_score);
+    if (candidates.size() > (size_t)EDIT_DISTANCE_CANDIDATES)
+        candidates.resize(EDIT_DISTANCE_CANDIDATES);
+
+    EditDistance distance(sa.exactSourceText);
+    for (auto& c: candidates)
+    {
+        if (sa.is_cancelled())
+            return;
+        if (c.source == sa.exactSourceText)
+            continue; // already scored as 1.0
+
+        double similarity = distance.Similarity(c.source);
+        c.score = (similarity < scoreThreshold) ? -1.0 : similarity * scoreScaling;
+    }
+
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                    [](const Candidate& c){ return c.score < 0; }),
+                     candidates.end());
+    std::stable_sort(candidates.begin(), candidates.end(), by_score);
+
+    for (auto& c: candidates)
+    {
+        if (sa.is_cancelled())
+            break;
+
+        // candidates with the same score as the last one may still be preferred
+        // because of localScore, so stop only when the score gets strictly worse:
+        if (results.size() >= (size_t)MAX_RESULTS && c.score < results.back().score)
+            break;
+
+        auto doc = load_doc(searcher, c.doc, hit_selector());
+        time_t ts = DateField::stringToTime(doc->get(L"created"));
+        Suggestion r {get_text_field(doc, L"trans"), c.score, int(ts)};
+        r.id = StringUtils::toUTF8(doc->get(L"uuid"));
+        AddOrUpdateResult(results, std::move(r));
     }
+
+    postprocess_results(results);
 }
 
 void PerformSearch(IndexSearcherPtr searcher,
@@ -421,108 +1492,273 @@ void PerformSearch(IndexSearcherPtr searcher,
                    double scoreThreshold,
                    double scoreScaling)
 {
-    PerformSearchWithBlock
-    (
-        searcher, sa, scoreThreshold, scoreScaling,
-        [&results](DocumentPtr doc, double score)
-        {
-            auto t = get_text_field(doc, L"trans");
-            time_t ts = DateField::stringToTime(doc->get(L"created"));
-            Suggestion r {t, score, int(ts)};
-            r.id = StringUtils::toUTF8(doc->get(L"uuid"));
-            AddOrUpdateResult(results, std::move(r));
-        }
-    );
+    PerformRankedSearch(searcher, sa, results, scoreThreshold, scoreScaling,
+                        [](DocumentPtr, const std::wstring&){ return true; });
+}
+
+} // anonymous namespace
+
+SuggestionsList TranslationMemoryImpl::DoSearch(IndexSearcherPtr searcher,
+                                                const SearchArguments& langArgs,
+                                                const std::wstring& source)
+{
+    auto start = QueryStats::Clock::now();
+    auto hitPhase = QueryStats::Phase_Max;
+    SuggestionsList results = DoSearchPhases(searcher, langArgs, source, hitPhase);
+    auto duration = QueryStats::Clock::now() - start;
+
+    QueryStats::Get().RecordQuery(duration, hitPhase, langArgs.is_cancelled());
+    wxLogTrace("poedit.tm", "query \"%s\": %d hits (%s) in %.2f ms",
+               source, (int)results.size(),
+               hitPhase == QueryStats::Phase_Max ? "none" : QueryStats::PhaseName(hitPhase),
+               QueryStats::to_us(duration) / 1000.0);
+
+    return results;
+}
+
+
+SuggestionsList TranslationMemoryImpl::DoSearchPhases(IndexSearcherPtr searcher,
+                                                      const SearchArguments& langArgs,
+                                                      const std::wstring& source,
+                                                      QueryStats::Phase& hitPhase)
+{
+    SuggestionsList results;
+
+    const Lucene::String sourceField(L"source");
+    auto boolQ = newLucene<BooleanQuery>();
+    auto phraseQ = newLucene<PhraseQuery>();
+
+    auto stream = m_analyzer->tokenStream(sourceField, newLucene<StringReader>(source));
+    int sourceTokensCount = 0;
+    int sourceTokenPosition = -1;
+    while (stream->incrementToken())
+    {
+        sourceTokensCount++;
+        auto word = stream->getAttribute<TermAttribute>()->term();
+        sourceTokenPosition += stream->getAttribute<PositionIncrementAttribute>()->getPositionIncrement();
+        auto term = newLucene<Term>(sourceField, word);
+        boolQ->add(newLucene<TermQuery>(term), BooleanClause::SHOULD);
+        phraseQ->add(term, sourceTokenPosition);
+    }
+
+    SearchArguments sa(langArgs);
+    sa.exactSourceText = source;
+    sa.query = phraseQ;
+
+    // Exact matches are by far the most common and are cheap to look up:
+    {
+        PhaseTimer timer(QueryStats::Phase_Exact, results);
+        PerformExactSearch(searcher, sa, results);
+    }
+    if (!results.empty())
+    {
+        hitPhase = QueryStats::Phase_Exact;
+        return results;
+    }
+    if (sa.is_cancelled())
+        return results;
+
+    // Texts that differ only in numbers or placeholders are common too:
+    {
+        PhaseTimer timer(QueryStats::Phase_Normalized, results);
+        PerformNormalizedSearch(searcher, sa, results);
+    }
+    if (!results.empty())
+    {
+        hitPhase = QueryStats::Phase_Normalized;
+        return results;
+    }
+    if (sa.is_cancelled())
+        return results;
+
+    // Then try exact phrase:
+    {
+        PhaseTimer timer(QueryStats::Phase_Phrase, results);
+        PerformSearch(searcher, sa, results, QUALITY_THRESHOLD, /*scoreScaling=*/1.0);
+    }
+    if (!results.empty())
+    {
+        hitPhase = QueryStats::Phase_Phrase;
+        return results;
+    }
+    if (sa.is_cancelled())
+        return results;
+
+    // Then, if no matches were found, permit being a bit sloppy:
+    phraseQ->setSlop(1);
+    sa.query = phraseQ;
+    {
+        PhaseTimer timer(QueryStats::Phase_Sloppy, results);
+        PerformSearch(searcher, sa, results, QUALITY_THRESHOLD, /*scoreScaling=*/0.9);
+    }
+    if (!results.empty())
+    {
+        hitPhase = QueryStats::Phase_Sloppy;
+        return results;
+    }
+    if (sa.is_cancelled())
+        return results;
+
+    // As the last resort, try terms search. This will almost certainly
+    // produce low-quality results, but hopefully better than nothing.
+    boolQ->setMinimumNumberShouldMatch(std::max(1, boolQ->getClauses().size() - MAX_ALLOWED_LENGTH_DIFFERENCE));
+    sa.query = boolQ;
+    {
+        PhaseTimer timer(QueryStats::Phase_Terms, results);
+        PerformRankedSearch
+        (
+            searcher, sa, results, QUALITY_THRESHOLD, /*scoreScaling=*/0.8,
+            [=](DocumentPtr doc, const std::wstring& s)
+            {
+                int tokensCount2 = get_token_count(doc);
+                if (tokensCount2 == -1)
+                    tokensCount2 = count_tokens(m_analyzer, s); // not migrated yet
+
+                return std::abs(tokensCount2 - sourceTokensCount) <= MAX_ALLOWED_LENGTH_DIFFERENCE;
+            }
+        );
+    }
+    if (!results.empty())
+        hitPhase = QueryStats::Phase_Terms;
 
     postprocess_results(results);
+    return results;
 }
 
-} // anonymous namespace
 
 SuggestionsList TranslationMemoryImpl::Search(const Language& srclang,
                                               const Language& lang,
-                                              const std::wstring& source)
+                                              const std::wstring& source,
+                                              dispatch::cancellation_token_ptr cancellationToken)
 {
+    // let concurrently running SearchBatch() calls know they should yield:
+    struct InteractiveSearchScope
+    {
+        InteractiveSearchScope(TranslationMemoryImpl& tm) : m_tm(tm)
+        {
+            std::lock_guard<std::mutex> lock(m_tm.m_interactiveMutex);
+            m_tm.m_interactiveSearches++;
+        }
+        ~InteractiveSearchScope()
+        {
+            std::lock_guard<std::mutex> lock(m_tm.m_interactiveMutex);
+            if (--m_tm.m_interactiveSearches == 0)
+                m_tm.m_interactiveDone.notify_all();
+        }
+        TranslationMemoryImpl& m_tm;
+    };
+    InteractiveSearchScope interactiveScope(*this);
+
     try
     {
-        SuggestionsList results;
+        SearchArguments sa;
+        sa.set_lang(srclang, lang);
+        sa.cancellationToken = cancellationToken;
 
-        const Lucene::String sourceField(L"source");
-        auto boolQ = newLucene<BooleanQuery>();
-        auto phraseQ = newLucene<PhraseQuery>();
+        auto searcher = m_mng->Searcher();
+        return DoSearch(searcher.ptr(), sa, source);
+    }
+    catch (LuceneException&)
+    {
+        return SuggestionsList();
+    }
+}
 
-        auto stream = m_analyzer->tokenStream(sourceField, newLucene<StringReader>(source));
-        int sourceTokensCount = 0;
-        int sourceTokenPosition = -1;
-        while (stream->incrementToken())
-        {
-            sourceTokensCount++;
-            auto word = stream->getAttribute<TermAttribute>()->term();
-            sourceTokenPosition += stream->getAttribute<PositionIncrementAttribute>()->getPositionIncrement();
-            auto term = newLucene<Term>(sourceField, word);
-            boolQ->add(newLucene<TermQuery>(term), BooleanClause::SHOULD);
-            phraseQ->add(term, sourceTokenPosition);
-        }
 
+void TranslationMemoryImpl::Warmup(const Language& srclang, const Language& lang)
+{
+    // Number of the language pair's documents whose stored fields are read
+    static const int WARMUP_DOCS = 100;
+
+    perf::ScopedTimer timer("TM warmup");
+    try
+    {
         SearchArguments sa;
         sa.set_lang(srclang, lang);
-        sa.exactSourceText = source;
-        sa.query = phraseQ;
 
+        // Searching with the language pair's filter evaluates it for every
+        // segment of the index, which is then cached (see
+        // language_pair_queries()), and loads the language fields' postings.
+        // Reading some documents brings stored fields into the OS cache too.
         auto searcher = m_mng->Searcher();
+        auto hits = searcher->search(newLucene<MatchAllDocsQuery>(), sa.langFilter, WARMUP_DOCS);
+        for (int i = 0; i < hits->scoreDocs.size(); i++)
+            load_doc(searcher.ptr(), hits->scoreDocs[i]->doc, hit_selector());
+    }
+    catch (LuceneException&)
+    {
+        // not fatal, searches will just be slower
+    }
+}
+
 
-        // Try exact phrase first:
-        PerformSearch(searcher.ptr(), sa, results, QUALITY_THRESHOLD, /*scoreScaling=*/1.0);
-        if (!results.empty())
-            return results;
+std::vector<SuggestionsList> TranslationMemoryImpl::SearchBatch(const Language& srclang,
+                                                                const Language& lang,
+                                                                const std::vector<std::wstring>& sources)
+{
+    std::vector<SuggestionsList> results(sources.size());
+    if (sources.empty())
+        return results;
 
-        // Then, if no matches were found, permit being a bit sloppy:
-        phraseQ->setSlop(1);
-        sa.query = phraseQ;
-        PerformSearch(searcher.ptr(), sa, results, QUALITY_THRESHOLD, /*scoreScaling=*/0.9);
+    try
+    {
+        // Language queries are the same for all items in the batch and so is
+        // the searcher: acquire it only once, so that the whole batch is
+        // evaluated against a consistent snapshot of the index.
+        SearchArguments sa;
+        sa.set_lang(srclang, lang);
 
-        if (!results.empty())
-            return results;
+        auto searcher = m_mng->Searcher();
 
-        // As the last resort, try terms search. This will almost certainly
-        // produce low-quality results, but hopefully better than nothing.
-        boolQ->setMinimumNumberShouldMatch(std::max(1, boolQ->getClauses().size() - MAX_ALLOWED_LENGTH_DIFFERENCE));
-        sa.query = boolQ;
-        PerformSearchWithBlock
-        (
-            searcher.ptr(), sa, QUALITY_THRESHOLD, /*scoreScaling=*/0.8,
-            [=,&results](DocumentPtr doc, double score)
+        // Catalogs often contain the same text multiple times (e.g. in
+        // different contexts), don't query for it repeatedly:
+        std::unordered_map<std::wstring, size_t> seen;
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            auto& src = sources[i];
+            if (src.empty())
+                continue;
+
+            auto found = seen.find(src);
+            if (found != seen.end())
             {
-                auto s = get_text_field(doc, sourceField);
-                auto t = get_text_field(doc, L"trans");
-                auto stream2 = m_analyzer->tokenStream(sourceField, newLucene<StringReader>(s));
-                int tokensCount2 = 0;
-                while (stream2->incrementToken())
-                    tokensCount2++;
-
-                if (std::abs(tokensCount2 - sourceTokensCount) <= MAX_ALLOWED_LENGTH_DIFFERENCE)
-                {
-                    time_t ts = DateField::stringToTime(doc->get(L"created"));
-                    Suggestion r {t, score, int(ts)};
-                    r.id = StringUtils::toUTF8(doc->get(L"uuid"));
-                    AddOrUpdateResult(results, std::move(r));
-                }
+                results[i] = results[found->second];
+                continue;
             }
-        );
 
-        postprocess_results(results);
-        return results;
+            // let interactive searches (i.e. what the user is waiting for) go first,
+            // but don't wait forever if there's a steady stream of them:
+            {
+                std::unique_lock<std::mutex> lock(m_interactiveMutex);
+                m_interactiveDone.wait_for(lock, std::chrono::milliseconds(BATCH_MAX_YIELD_MS),
+                                           [=]{ return m_interactiveSearches == 0; });
+            }
+
+            try
+            {
+                results[i] = DoSearch(searcher.ptr(), sa, src);
+            }
+            catch (LuceneException&)
+            {
+                // treat as no hits, same as Search() does, and continue with the rest
+            }
+            seen.emplace(src, i);
+        }
     }
     catch (LuceneException&)
     {
-        return SuggestionsList();
+        // failure to obtain the searcher; return what we have, i.e. empty results
     }
+
+    return results;
 }
 
 
 void TranslationMemoryImpl::SearchSubstring(TranslationMemory::IOInterface& destination,
                                             const Language& srclang, const Language& lang, const std::wstring& sourcePhrase)
 {
+    perf::ScopedTimer timer("TM substring search");
+    auto start = QueryStats::Clock::now();
     try
     {
         const Lucene::String sourceField(L"source");
@@ -538,10 +1774,33 @@ void TranslationMemoryImpl::SearchSubstring(TranslationMemory::IOInterface& dest
             phraseQ->add(term, sourceTokenPosition);
         }
 
+        // Documents containing all n-grams of the phrase are candidates for
+        // containing it as substring; this is verified for each of them below.
+        // Documents stored by older versions don't have n-grams indexed, so
+        // look for phrase matches too.
+        auto anyQ = newLucene<BooleanQuery>();
+        anyQ->add(phraseQ, BooleanClause::SHOULD);
+
+        auto grams = ngrams_of(sourcePhrase);
+        if (!grams.empty())
+        {
+            static const size_t MAX_NGRAM_CLAUSES = 256;
+            std::unordered_set<std::wstring> uniqueGrams;
+            auto gramsQ = newLucene<BooleanQuery>();
+            for (auto& g: grams)
+            {
+                if (uniqueGrams.size() >= MAX_NGRAM_CLAUSES)
+                    break; // a subset of n-grams is still a valid prefilter
+                if (uniqueGrams.insert(g).second)
+                    gramsQ->add(newLucene<TermQuery>(newLucene<Term>(L"srcgrams", g)), BooleanClause::MUST);
+            }
+            anyQ->add(gramsQ, BooleanClause::SHOULD);
+        }
+
         SearchArguments sa;
         sa.set_lang(srclang, lang);
         sa.exactSourceText = sourcePhrase;
-        sa.query = phraseQ;
+        sa.query = anyQ;
 
         auto searcher = m_mng->Searcher();
 
@@ -566,6 +1825,8 @@ void TranslationMemoryImpl::SearchSubstring(TranslationMemory::IOInterface& dest
         );
     }
     CATCH_AND_RETHROW_EXCEPTION
+
+    QueryStats::Get().RecordSubstringSearch(QueryStats::Clock::now() - start);
 }
 
 
@@ -575,8 +1836,14 @@ void TranslationMemoryImpl::ExportData(TranslationMemory::IOInterface& destinati
     {
         auto reader = m_mng->Reader();
         int32_t numDocs = reader->maxDoc();
+
+        static const int32_t PROGRESS_GRANULARITY = 1000;
+        Progress progress(std::max(1, numDocs / PROGRESS_GRANULARITY));
+
         for (int32_t i = 0; i < numDocs; i++)
         {
+            if (i > 0 && i % PROGRESS_GRANULARITY == 0)
+                progress.increment();
             if (reader->isDeleted(i))
                 continue;
             auto doc = reader->document(i);
@@ -590,203 +1857,1099 @@ void TranslationMemoryImpl::ExportData(TranslationMemory::IOInterface& destinati
             );
         }
     }
-    CATCH_AND_RETHROW_EXCEPTION
+    CATCH_AND_RETHROW_EXCEPTION
+}
+
+
+// Version of the format written by ExportChanges()
+static const int CHANGES_FORMAT_VERSION = 1;
+
+std::mutex TranslationMemoryImpl::ms_deletionsMutex;
+
+wxString TranslationMemoryImpl::GetDeletionsLogFile()
+{
+    return wxString(GetDatabaseDir()) + wxFILE_SEP_PATH + "deletions.log";
+}
+
+
+void TranslationMemoryImpl::RecordDeletion(const std::wstring& uuid)
+{
+    // one "<time> <uuid>" line per deletion:
+    std::lock_guard<std::mutex> lock(ms_deletionsMutex);
+    wxFFile f(GetDeletionsLogFile(), "a");
+    if (f.IsOpened())
+        f.Write(wxString::Format("%lld %s\n", (long long)time(NULL), uuid));
+}
+
+
+void TranslationMemoryImpl::RecordDeletions(const std::vector<std::wstring>& uuids)
+{
+    if (uuids.empty())
+        return;
+
+    const long long now = time(NULL);
+    wxString lines;
+    for (auto& uuid: uuids)
+        lines += wxString::Format("%lld %s\n", now, uuid);
+
+    std::lock_guard<std::mutex> lock(ms_deletionsMutex);
+    wxFFile f(GetDeletionsLogFile(), "a");
+    if (f.IsOpened())
+        f.Write(lines);
+}
+
+
+void TranslationMemoryImpl::ForgetDeletions()
+{
+    std::lock_guard<std::mutex> lock(ms_deletionsMutex);
+    const auto filename = GetDeletionsLogFile();
+    if (wxFileExists(filename))
+        wxRemoveFile(filename);
+}
+
+
+time_t TranslationMemoryImpl::ExportChanges(time_t since, std::ostream& out)
+{
+    // Changes made during the export are included in the next one:
+    const time_t watermark = time(NULL);
+    long inserts = 0, deletes = 0;
+
+    json header = {{"poedit-tm-changes", CHANGES_FORMAT_VERSION}, {"since", (long long)since}, {"watermark", (long long)watermark}};
+    out << header.dump() << '\n';
+
+    std::unordered_set<std::wstring> existing;
+    try
+    {
+        auto reader = m_mng->Reader();
+        const int32_t numDocs = reader->maxDoc();
+
+        auto fields = Collection<Lucene::String>::newInstance();
+        for (auto f: {L"uuid", L"created", L"srclang", L"lang", L"source", L"trans", L"v"})
+            fields.add(f);
+        auto selector = newLucene<MapFieldSelector>(fields);
+
+        for (int32_t i = 0; i < numDocs; i++)
+        {
+            if (reader->isDeleted(i))
+                continue;
+            auto doc = reader->document(i, selector);
+            auto uuid = doc->get(L"uuid");
+            existing.insert(uuid);
+
+            const time_t created = DateField::stringToTime(doc->get(L"created"));
+            if (created < since)
+                continue;
+
+            json change = {
+                {"op", "insert"},
+                {"uuid", std::wstring(uuid)},
+                {"created", (long long)created},
+                {"srclang", std::wstring(doc->get(L"srclang"))},
+                {"lang", std::wstring(doc->get(L"lang"))},
+                {"source", get_text_field(doc, L"source")},
+                {"trans", get_text_field(doc, L"trans")}
+            };
+            out << change.dump() << '\n';
+            inserts++;
+        }
+    }
+    CATCH_AND_RETHROW_EXCEPTION
+
+    wxString log;
+    {
+        std::lock_guard<std::mutex> lock(ms_deletionsMutex);
+        wxFFile f(GetDeletionsLogFile(), "r");
+        if (f.IsOpened())
+            f.ReadAll(&log, wxConvUTF8);
+    }
+
+    for (auto& line: wxSplit(log, '\n', '\0'))
+    {
+        long long deleted;
+        if (!line.BeforeFirst(' ').ToLongLong(&deleted) || deleted < since)
+            continue;
+        auto uuid = line.AfterFirst(' ').ToStdWstring();
+        // entries inserted again after deletion must not be deleted:
+        if (uuid.empty() || existing.count(uuid))
+            continue;
+
+        json change = {{"op", "delete"}, {"uuid", uuid}, {"deleted", deleted}};
+        out << change.dump() << '\n';
+        deletes++;
+    }
+
+    if (!out)
+        throw Exception(_("Failed to write translation memory changes."));
+
+    wxLogTrace("poedit.tm", "exported changes since %lld: %ld inserts, %ld deletes", (long long)since, inserts, deletes);
+    return watermark;
+}
+
+
+long TranslationMemoryImpl::ImportChanges(std::istream& in)
+{
+    std::string line;
+    if (!std::getline(in, line))
+        throw Exception(_("Invalid translation memory changes file."));
+    try
+    {
+        auto header = json::parse(line);
+        if (header.value("poedit-tm-changes", 0) != CHANGES_FORMAT_VERSION)
+            throw Exception(_("Unsupported version of translation memory changes file."));
+    }
+    catch (json::exception&)
+    {
+        throw Exception(_("Invalid translation memory changes file."));
+    }
+
+    long applied = 0;
+    ImportData([&](TranslationMemory::IOInterface& io)
+    {
+        auto& writer = static_cast<TranslationMemory::Writer&>(io);
+        while (std::getline(in, line))
+        {
+            if (line.empty())
+                continue;
+            try
+            {
+                auto change = json::parse(line);
+                auto op = change.at("op").get<std::string>();
+                if (op == "insert")
+                {
+                    writer.Insert(Language::TryParse(change.at("srclang").get<std::wstring>()),
+                                  Language::TryParse(change.at("lang").get<std::wstring>()),
+                                  change.at("source").get<std::wstring>(),
+                                  change.at("trans").get<std::wstring>(),
+                                  (time_t)change.at("created").get<long long>());
+                }
+                else if (op == "delete")
+                {
+                    writer.Delete(change.at("uuid").get<std::string>());
+                }
+                else
+                {
+                    continue; // unknown changes from newer versions are skipped
+                }
+                applied++;
+            }
+            catch (json::exception&)
+            {
+                throw Exception(_("Invalid translation memory changes file."));
+            }
+        }
+    });
+
+    wxLogTrace("poedit.tm", "imported %ld changes", applied);
+    return applied;
+}
+
+
+void TranslationMemoryImpl::GetStats(long& numDocs, long& fileSize)
+{
+    try
+    {
+        auto reader = m_mng->Reader();
+        numDocs = reader->numDocs();
+        fileSize = wxDir::GetTotalSize(GetDatabaseDir()).GetValue();
+    }
+    CATCH_AND_RETHROW_EXCEPTION
+}
+
+// ----------------------------------------------------------------
+// TranslationMemoryWriterImpl
+// ----------------------------------------------------------------
+
+class TranslationMemoryWriterImpl : public TranslationMemory::Writer
+{
+public:
+    TranslationMemoryWriterImpl(IndexWriterPtr writer)
+        : m_writer(writer),
+          m_pendingDocs(0),
+          m_commitScheduled(false), m_shutdown(false)
+    {
+        m_committer = std::thread([this]{ BackgroundCommitterThread(); });
+    }
+
+    ~TranslationMemoryWriterImpl()
+    {
+        StopBackgroundCommits();
+    }
+
+    void Commit() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_commitMutex);
+            m_commitScheduled = false;
+            m_pendingDocs = 0;
+        }
+
+        try
+        {
+            perf::ScopedTimer timer("TM commit");
+            auto start = QueryStats::Clock::now();
+            m_writer->commit();
+            QueryStats::Get().RecordCommit(QueryStats::Clock::now() - start);
+        }
+        CATCH_AND_RETHROW_EXCEPTION
+
+        TranslationMemory::Get().NotifyDataChanged();
+    }
+
+    void ScheduleCommit() override
+    {
+        std::lock_guard<std::mutex> lock(m_commitMutex);
+        if (m_shutdown)
+            return;
+        m_commitScheduled = true;
+        m_commitCondition.notify_one();
+    }
+
+    /// Stops the background commits thread, committing any scheduled changes
+    void StopBackgroundCommits()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_commitMutex);
+            if (m_shutdown)
+                return;
+            m_shutdown = true;
+            m_commitCondition.notify_one();
+        }
+        if (m_committer.joinable())
+            m_committer.join();
+    }
+
+    void Rollback() override
+    {
+        try
+        {
+            m_writer->rollback();
+        }
+        CATCH_AND_RETHROW_EXCEPTION
+
+        m_epoch++;
+        TranslationMemory::Get().NotifyDataChanged();
+    }
+
+    void Insert(const Language& srclang, const Language& lang,
+                const std::wstring& source, const std::wstring& trans,
+                time_t creationTime) override
+    {
+        if (!lang.IsValid() || !srclang.IsValid() || lang == srclang)
+            return;
+
+        if (creationTime == 0)
+            creationTime = time(NULL);
+
+        {
+            std::lock_guard<std::mutex> lock(m_bulkMutex);
+            if (m_bulk)
+            {
+                m_bulk->pending.push_back({srclang.WCode(), lang.WCode(), source, trans, creationTime});
+                if (m_bulk->pending.size() >= BULK_BATCH_SIZE)
+                    SubmitBulkBatch();
+                return;
+            }
+        }
+
+        auto start = QueryStats::Clock::now();
+        auto itemUUID = ComputeUUID(srclang.WCode(), lang.WCode(), source, trans);
+        try
+        {
+            auto doc = CreateDocument(m_writer->getAnalyzer(), itemUUID, srclang.WCode(), lang.WCode(), source, trans, creationTime);
+            m_writer->updateDocument(newLucene<Term>(L"uuid", itemUUID), doc);
+        }
+        CATCH_AND_RETHROW_EXCEPTION
+        QueryStats::Get().RecordInserts(1, QueryStats::Clock::now() - start);
+
+        if (++m_pendingDocs >= COMMIT_MAX_PENDING_DOCS)
+            ScheduleCommit();
+    }
+
+    void BeginBulkImport() override
+    {
+        std::lock_guard<std::mutex> lock(m_bulkMutex);
+        if (m_bulk)
+        {
+            m_bulk->nesting++;
+            return;
+        }
+
+        try
+        {
+            m_bulk.reset(new BulkState);
+            m_bulk->ramBufferSize = m_writer->getRAMBufferSizeMB();
+            m_bulk->mergeFactor = m_writer->getMergeFactor();
+            // If the index is empty, there's nothing to replace and
+            // we can avoid the cost of delete+add in updateDocument():
+            m_bulk->appendOnly = (m_writer->numDocs() == 0);
+
+            m_writer->setRAMBufferSizeMB(BULK_RAM_BUFFER_SIZE_MB);
+            m_writer->setMergeFactor(BULK_MERGE_FACTOR);
+        }
+        CATCH_AND_RETHROW_EXCEPTION
+    }
+
+    void EndBulkImport() override
+    {
+        std::unique_ptr<BulkState> state;
+        {
+            std::lock_guard<std::mutex> lock(m_bulkMutex);
+            if (!m_bulk)
+                return;
+            if (m_bulk->nesting-- > 0)
+                return;
+
+            SubmitBulkBatch();
+            state = std::move(m_bulk);
+        }
+
+        // Wait for all outstanding work (that is also needed before restoring
+        // the settings), then rethrow the first error, if any:
+        std::exception_ptr error;
+        for (auto& f: state->inFlight)
+        {
+            try
+            {
+                f.get();
+            }
+            catch (...)
+            {
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+
+        try
+        {
+            m_writer->setRAMBufferSizeMB(state->ramBufferSize);
+            m_writer->setMergeFactor(state->mergeFactor);
+        }
+        CATCH_AND_RETHROW_EXCEPTION
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    void Optimize()
+    {
+        try
+        {
+            m_writer->optimize();
+            m_writer->commit();
+        }
+        CATCH_AND_RETHROW_EXCEPTION
+    }
+
+    void Insert(const Language& srclang, const Language& lang,
+                const std::wstring& source, const std::wstring& trans) override
+    {
+        Insert(srclang, lang, source, trans, 0);
+    }
+
+    void Insert(const Language& srclang, const Language& lang, const CatalogItemPtr& item) override
+    {
+        if (!lang.IsValid() || !srclang.IsValid())
+            return;
+
+        // ignore translations with errors in them
+        if (item->HasError())
+            return;
+
+        // ignore untranslated, pre-translated and non-revised or unfinished translations
+        if (item->IsFuzzy() || item->IsPreTranslated() || !item->IsTranslated())
+            return;
+
+        // don't rewrite documents if nothing changed since the item was last stored:
+        const size_t fingerprint = ComputeFingerprint(srclang, lang, item);
+        if (item->GetTMSyncFingerprint() == fingerprint)
+            return;
+
+        // always store at least the singular translation
+        Insert(srclang, lang, str::to_wstring(item->GetString()), str::to_wstring(item->GetTranslation()));
+
+        // for plurals, store translation for the English plural form:
+        if (item->HasPlural())
+        {
+            switch (lang.nplurals())
+            {
+                case 1:
+                    // e.g. Chinese, Japanese; store translation for both singular and plural
+                    Insert(srclang, lang, str::to_wstring(item->GetPluralString()), str::to_wstring(item->GetTranslation()));
+                    break;
+                case 2:
+                    // e.g. Germanic or Romanic languages, same 2 forms as English
+                    Insert(srclang, lang, str::to_wstring(item->GetPluralString()), str::to_wstring(item->GetTranslation(1)));
+                    break;
+                default:
+                {
+                    // e.g. Slavic or Arabic; there's no single equivalent, so use the form for
+                    // a typical number, which pre-translation uses as the basis for all forms
+                    const int form = GetTypicalPluralForm(lang);
+                    if (form > 0 && form < (int)item->GetNumberOfTranslations())
+                        Insert(srclang, lang, str::to_wstring(item->GetPluralString()), str::to_wstring(item->GetTranslation(form)));
+                    break;
+                }
+            }
+        }
+
+        item->SetTMSyncFingerprint(fingerprint);
+    }
+
+    void Insert(const CatalogPtr& cat) override
+    {
+        auto srclang = cat->GetSourceLanguage();
+        auto lang = cat->GetLanguage();
+        if (!lang.IsValid() || !srclang.IsValid())
+            return;
+
+        for (auto& item: cat->items())
+        {
+            // Note that dt.IsModified() is intentionally not checked - we
+            // want to save old entries in the TM too, so that we harvest as
+            // much useful translations as we can.
+            Insert(srclang, lang, item);
+        }
+    }
+
+    void Delete(const std::string& uuid) override
+    {
+        try
+        {
+            m_writer->deleteDocuments(newLucene<Term>(L"uuid", StringUtils::toUnicode(uuid)));
+        }
+        CATCH_AND_RETHROW_EXCEPTION
+
+        TranslationMemoryImpl::RecordDeletion(StringUtils::toUnicode(uuid));
+    }
+
+    void DeleteAll() override
+    {
+        try
+        {
+            m_writer->deleteAll();
+        }
+        CATCH_AND_RETHROW_EXCEPTION
+
+        TranslationMemoryImpl::ForgetDeletions();
+
+        m_epoch++;
+    }
+
+    long DeleteByQuery(const DeleteQuery& query) override
+    {
+        // Languages are indexed verbatim, so they can be matched by the query
+        // itself. Creation time isn't indexed and source text is only indexed
+        // tokenized, so these conditions must be checked on stored fields of
+        // the documents matched by the languages.
+        auto q = newLucene<BooleanQuery>();
+        if (query.srclang.IsValid())
+            q->add(newLucene<TermQuery>(newLucene<Term>(L"srclang", query.srclang.WCode())), BooleanClause::MUST);
+        if (query.lang.IsValid())
+            q->add(newLucene<TermQuery>(newLucene<Term>(L"lang", query.lang.WCode())), BooleanClause::MUST);
+        if (q->getClauses().empty())
+            q->add(newLucene<MatchAllDocsQuery>(), BooleanClause::MUST);
+
+        const bool checkStoredFields = query.createdFrom || query.createdTo || !query.sourcePrefix.empty();
+
+        std::vector<std::wstring> deleted;
+        try
+        {
+            auto fields = Collection<Lucene::String>::newInstance();
+            for (auto f: {L"uuid", L"created", L"source", L"v"})
+                fields.add(f);
+            auto selector = newLucene<MapFieldSelector>(fields);
+
+            // near-real-time reader, so that uncommitted entries are included too:
+            auto reader = m_writer->getReader();
+            auto toDelete = Collection<TermPtr>::newInstance();
+
+            auto docs = newLucene<QueryWrapperFilter>(q)->getDocIdSet(reader);
+            auto it = docs ? docs->iterator() : DocIdSetIteratorPtr();
+            for (int32_t i = it ? it->nextDoc() : DocIdSetIterator::NO_MORE_DOCS;
+                 i != DocIdSetIterator::NO_MORE_DOCS;
+                 i = it->nextDoc())
+            {
+                auto doc = reader->document(i, selector);
+                if (checkStoredFields)
+                {
+                    const time_t created = DateField::stringToTime(doc->get(L"created"));
+                    if (query.createdFrom && created < query.createdFrom)
+                        continue;
+                    if (query.createdTo && created >= query.createdTo)
+                        continue;
+                    if (!query.sourcePrefix.empty() &&
+                        get_text_field(doc, L"source").compare(0, query.sourcePrefix.length(), query.sourcePrefix) != 0)
+                    {
+                        continue;
+                    }
+                }
+
+                deleted.push_back(doc->get(L"uuid"));
+                if (checkStoredFields)
+                    toDelete.add(newLucene<Term>(L"uuid", deleted.back()));
+            }
+            reader->close();
+
+            if (deleted.empty())
+                return 0;
+
+            if (checkStoredFields)
+                m_writer->deleteDocuments(toDelete);
+            else
+                m_writer->deleteDocuments(q);
+        }
+        CATCH_AND_RETHROW_EXCEPTION
+
+        TranslationMemoryImpl::RecordDeletions(deleted);
+
+        m_epoch++;
+        Commit();
+
+        wxLogTrace("poedit.tm", "deleted %d entries by query", (int)deleted.size());
+        return (long)deleted.size();
+    }
+
+    /// Returns counter incremented whenever stored data are deleted or rolled back
+    size_t GetEpoch() const { return m_epoch; }
+
+private:
+    friend class TranslationMemoryImpl;
+
+    // Computes hash of all of the item's content that is stored in the TM.
+    // The epoch is included, because fingerprints are no longer valid after
+    // rollback or deletion of the data.
+    size_t ComputeFingerprint(const Language& srclang, const Language& lang, const CatalogItemPtr& item) const
+    {
+        std::wstring data(std::to_wstring(m_epoch.load()));
+        data += L'\x1f';
+        data += srclang.WCode();
+        data += L'\x1f';
+        data += lang.WCode();
+        data += L'\x1f';
+        data += str::to_wstring(item->GetString());
+        data += L'\x1f';
+        data += str::to_wstring(item->GetPluralString());
+        for (auto& t: item->GetTranslations())
+        {
+            data += L'\x1f';
+            data += str::to_wstring(t);
+        }
+
+        size_t fp = std::hash<std::wstring>()(data);
+        return fp ? fp : 1; // 0 is reserved for "not stored"
+    }
+
+    static std::wstring ComputeUUID(const std::wstring& srclang, const std::wstring& lang,
+                                    const std::wstring& source, const std::wstring& trans)
+    {
+        static const boost::uuids::uuid s_namespace =
+          boost::uuids::string_generator()("6e3f73c5-333f-4171-9d43-954c372a8a02");
+        boost::uuids::name_generator gen(s_namespace);
+
+        std::wstring itemId(srclang);
+        itemId += lang;
+        itemId += source;
+        itemId += trans;
+
+        return boost::uuids::to_wstring(gen(itemId));
+    }
+
+    static DocumentPtr CreateDocument(AnalyzerPtr analyzer,
+                                      const std::wstring& itemUUID,
+                                      const std::wstring& srclang, const std::wstring& lang,
+                                      const std::wstring& source, const std::wstring& trans,
+                                      time_t creationTime)
+    {
+        auto doc = newLucene<Document>();
+
+        doc->add(newLucene<Field>(L"uuid", itemUUID,
+                                  Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
+        doc->add(newLucene<Field>(L"v", DOCUMENT_VERSION,
+                                  Field::STORE_YES, Field::INDEX_NO));
+        doc->add(newLucene<Field>(L"created", DateField::timeToString(creationTime),
+                                  Field::STORE_YES, Field::INDEX_NO));
+        doc->add(newLucene<Field>(L"srclang", srclang,
+                                  Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
+        doc->add(newLucene<Field>(L"lang", lang,
+                                  Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
+        doc->add(newLucene<Field>(L"source", source,
+                                  Field::STORE_YES, Field::INDEX_ANALYZED));
+        doc->add(newLucene<Field>(L"srckey", exact_match_key(srclang, lang, source),
+                                  Field::STORE_NO, Field::INDEX_NOT_ANALYZED));
+        // used by normalized search, for texts with placeholders or numbers only:
+        auto nkey = normalized_match_key(srclang, lang, normalize_variable_parts(source));
+        if (!nkey.empty())
+        {
+            doc->add(newLucene<Field>(L"srcnkey", nkey,
+                                      Field::STORE_NO, Field::INDEX_NOT_ANALYZED));
+        }
+        // used by fuzzy search to filter hits by length without re-analyzing them:
+        doc->add(newLucene<Field>(L"srctokens", StringUtils::toString(count_tokens(analyzer, source)),
+                                  Field::STORE_YES, Field::INDEX_NO));
+        // used by substring search, see make_ngrams():
+        doc->add(newLucene<Field>(L"srcgrams", make_ngrams(source),
+                                  Field::STORE_NO, Field::INDEX_ANALYZED_NO_NORMS));
+        doc->add(newLucene<Field>(L"trans", trans,
+                                  Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
+
+        return doc;
+    }
+
+    // Background commits: Lucene commits are expensive (they fsync the index),
+    // so callers that don't need the data to be on disk right away can
+    // ScheduleCommit() instead. Such requests are coalesced and performed on
+    // a background thread after a short delay. Uncommitted changes are
+    // visible to searches in the meantime thanks to near-real-time readers.
+
+    static const int COMMIT_DELAY_MS = 2000;
+    static const int COMMIT_MAX_PENDING_DOCS = 1000;
+
+    void BackgroundCommitterThread()
+    {
+        std::unique_lock<std::mutex> lock(m_commitMutex);
+        for (;;)
+        {
+            m_commitCondition.wait(lock, [this]{ return m_commitScheduled || m_shutdown; });
+            if (m_shutdown)
+                break;
+
+            // wait a bit to give more changes a chance to coalesce into this commit:
+            m_commitCondition.wait_for(lock, std::chrono::milliseconds(COMMIT_DELAY_MS), [this]{ return m_shutdown; });
+            if (!m_commitScheduled)
+                continue; // explicitly committed in the meantime
+
+            lock.unlock();
+            try
+            {
+                Commit();
+            }
+            catch (const Exception& e)
+            {
+                wxLogWarning(_("Failed to update translation memory: %s"), e.What());
+            }
+            lock.lock();
+        }
+
+        // flush on shutdown; don't touch the TranslationMemory singleton anymore, it's being destroyed
+        if (m_commitScheduled)
+        {
+            m_commitScheduled = false;
+            try
+            {
+                m_writer->commit();
+            }
+            catch (...)
+            {
+                wxLogDebug("failed to commit TM on shutdown: %s", DescribeCurrentException());
+            }
+        }
+    }
+
+    // Bulk import support: inserted entries are collected into batches that are
+    // converted into Lucene documents and added to the index in parallel
+    // (IndexWriter is thread-safe), with indexing settings tuned for throughput.
+
+    static const size_t BULK_BATCH_SIZE = 1000;
+    static const size_t BULK_MAX_IN_FLIGHT = 8;
+    static constexpr double BULK_RAM_BUFFER_SIZE_MB = 128.0;
+    static const int BULK_MERGE_FACTOR = 30;
+
+    struct BulkEntry
+    {
+        std::wstring srclang, lang;
+        std::wstring source, trans;
+        time_t creationTime;
+    };
+
+    struct BulkState
+    {
+        int nesting = 0;
+        bool appendOnly = false;
+        double ramBufferSize = 0;
+        int mergeFactor = 0;
+
+        std::vector<BulkEntry> pending;
+        std::deque<dispatch::future<void>> inFlight;
+
+        // UUIDs added so far, used to avoid duplicates in appendOnly mode
+        std::mutex seenMutex;
+        std::unordered_set<std::wstring> seen;
+    };
+
+    void SubmitBulkBatch()
+    {
+        // contract: m_bulkMutex is locked when this function is called
+        if (m_bulk->pending.empty())
+            return;
+
+        auto batch = std::make_shared<std::vector<BulkEntry>>();
+        batch->swap(m_bulk->pending);
+        m_bulk->pending.reserve(BULK_BATCH_SIZE);
+
+        auto state = m_bulk.get();
+        auto writer = m_writer;
+        m_bulk->inFlight.push_back(dispatch::async(dispatch::priority::bulk, [batch, state, writer]
+        {
+            perf::ScopedTimer timer("TM bulk insert");
+            timer.SetItemsCount(batch->size());
+            auto start = QueryStats::Clock::now();
+            try
+            {
+                for (auto& e: *batch)
+                {
+                    auto itemUUID = ComputeUUID(e.srclang, e.lang, e.source, e.trans);
+                    auto doc = CreateDocument(writer->getAnalyzer(), itemUUID, e.srclang, e.lang, e.source, e.trans, e.creationTime);
+                    if (state->appendOnly)
+                    {
+                        {
+                            std::lock_guard<std::mutex> lock(state->seenMutex);
+                            if (!state->seen.insert(itemUUID).second)
+                                continue; // duplicate within the imported data
+                        }
+                        writer->addDocument(doc);
+                    }
+                    else
+                    {
+                        writer->updateDocument(newLucene<Term>(L"uuid", itemUUID), doc);
+                    }
+                }
+            }
+            CATCH_AND_RETHROW_EXCEPTION
+            QueryStats::Get().RecordInserts(batch->size(), QueryStats::Clock::now() - start);
+        }));
+
+        // limit the amount of work (and memory) queued up:
+        while (m_bulk->inFlight.size() > BULK_MAX_IN_FLIGHT)
+        {
+            auto oldest = std::move(m_bulk->inFlight.front());
+            m_bulk->inFlight.pop_front();
+            oldest.get();
+        }
+    }
+
+private:
+    IndexWriterPtr m_writer;
+    std::atomic<size_t> m_epoch {0};
+
+    std::thread m_committer;
+    std::mutex m_commitMutex;
+    std::condition_variable m_commitCondition;
+    std::atomic<int> m_pendingDocs;
+    bool m_commitScheduled, m_shutdown;
+
+    std::mutex m_bulkMutex;
+    std::unique_ptr<BulkState> m_bulk;
+};
+
+
+TranslationMemoryImpl::~TranslationMemoryImpl()
+{
+    m_backgroundCancelled = true;
+    {
+        std::unique_lock<std::mutex> lock(m_backgroundMutex);
+        m_backgroundDone.wait(lock, [=]{ return m_backgroundJobs == 0; });
+    }
+
+    if (m_writerAPI)
+        std::static_pointer_cast<TranslationMemoryWriterImpl>(m_writerAPI)->StopBackgroundCommits();
+    m_mng.reset();
+    if (m_writer)
+        m_writer->close();
 }
 
 
 void TranslationMemoryImpl::ImportData(std::function<void(TranslationMemory::IOInterface&)> source)
 {
-    auto writer = TranslationMemory::Get().GetWriter();
-    source(*writer);
+    auto writer = std::static_pointer_cast<TranslationMemoryWriterImpl>(GetWriter());
+
+    writer->BeginBulkImport();
+    try
+    {
+        source(*writer);
+    }
+    catch (...)
+    {
+        writer->EndBulkImport();
+        throw;
+    }
+    writer->EndBulkImport();
+
     writer->Commit();
+    writer->Optimize();
 }
 
 
-void TranslationMemoryImpl::GetStats(long& numDocs, long& fileSize)
+void TranslationMemoryImpl::Init()
 {
     try
     {
-        auto reader = m_mng->Reader();
-        numDocs = reader->numDocs();
-        fileSize = wxDir::GetTotalSize(GetDatabaseDir()).GetValue();
+        m_dir = newLucene<DirectoryType>(GetDatabaseDir());
+        auto analyzer = newLucene<PerFieldAnalyzerWrapper>(newLucene<StandardAnalyzer>(LuceneVersion::LUCENE_CURRENT));
+        analyzer->addAnalyzer(L"srcgrams", newLucene<WhitespaceAnalyzer>());
+        m_analyzer = analyzer;
+
+        if (IndexReader::indexExists(m_dir))
+        {
+            // searching doesn't need the writer, open it only when needed:
+            m_mng.reset(new SearcherManager(IndexReader::open(m_dir, /*readOnly=*/true)));
+        }
+        else
+        {
+            // there's nothing to read from yet, the writer must create the index first:
+            std::lock_guard<std::mutex> lock(m_writerMutex);
+            OpenWriter();
+        }
     }
     CATCH_AND_RETHROW_EXCEPTION
 }
 
-// ----------------------------------------------------------------
-// TranslationMemoryWriterImpl
-// ----------------------------------------------------------------
 
-class TranslationMemoryWriterImpl : public TranslationMemory::Writer
+void TranslationMemoryImpl::OpenWriter()
 {
-public:
-    TranslationMemoryWriterImpl(IndexWriterPtr writer) : m_writer(writer) {}
-
-    ~TranslationMemoryWriterImpl() {}
-
-    void Commit() override
+    // contract: m_writerMutex is locked when this function is called
+    try
     {
-        try
-        {
-            m_writer->commit();
-        }
-        CATCH_AND_RETHROW_EXCEPTION
-    }
+        m_writer = newLucene<IndexWriter>(m_dir, m_analyzer, IndexWriter::MaxFieldLengthLIMITED);
+        m_writer->setMergeScheduler(newLucene<SerialMergeScheduler>());
 
-    void Rollback() override
-    {
-        try
-        {
-            m_writer->rollback();
-        }
-        CATCH_AND_RETHROW_EXCEPTION
+        // switch to the associated realtime reader & searcher:
+        if (m_mng)
+            m_mng->AttachWriter(m_writer);
+        else
+            m_mng.reset(new SearcherManager(m_writer->getReader()));
     }
+    CATCH_AND_RETHROW_EXCEPTION
 
-    void Insert(const Language& srclang, const Language& lang,
-                const std::wstring& source, const std::wstring& trans,
-                time_t creationTime) override
-    {
-        if (!lang.IsValid() || !srclang.IsValid() || lang == srclang)
-            return;
+    m_writerAPI = std::make_shared<TranslationMemoryWriterImpl>(m_writer);
 
-        if (creationTime == 0)
-            creationTime = time(NULL);
+    MigrateDocumentsIfNeeded();
+    ScheduleMaintenanceIfNeeded();
+}
 
-        // Compute unique ID for the translation:
 
-        static const boost::uuids::uuid s_namespace =
-          boost::uuids::string_generator()("6e3f73c5-333f-4171-9d43-954c372a8a02");
-        boost::uuids::name_generator gen(s_namespace);
+std::shared_ptr<TranslationMemory::Writer> TranslationMemoryImpl::GetWriter()
+{
+    std::lock_guard<std::mutex> lock(m_writerMutex);
+    if (!m_writerAPI)
+        OpenWriter();
+    return m_writerAPI;
+}
 
-        std::wstring itemId(srclang.WCode());
-        itemId += lang.WCode();
-        itemId += source;
-        itemId += trans;
 
-        const std::wstring itemUUID = boost::uuids::to_wstring(gen(itemId));
+void TranslationMemoryImpl::MigrateDocumentsIfNeeded()
+{
+    const wxString doneMarker = wxString(GetDatabaseDir()) + wxFILE_SEP_PATH + "migrated-v" + wxString(DOCUMENT_VERSION);
+    if (wxFileName::FileExists(doneMarker))
+        return;
+
+    RunInBackground([=]{ MigrateDocuments(doneMarker); });
+}
+
 
-        try
+void TranslationMemoryImpl::MigrateDocuments(const wxString& doneMarker)
+{
+    auto writer = std::static_pointer_cast<TranslationMemoryWriterImpl>(m_writerAPI);
+    const auto epoch = writer->GetEpoch();
+    int migrated = 0;
+
+    try
+    {
+        auto reader = m_mng->Reader();
+        auto selector = source_only_selector();
+        int32_t maxDoc = reader->maxDoc();
+
+        for (int32_t i = 0; i < maxDoc; i++)
         {
-            // Then add a new document:
-            auto doc = newLucene<Document>();
-
-            doc->add(newLucene<Field>(L"uuid", itemUUID,
-                                      Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
-            doc->add(newLucene<Field>(L"v", L"1",
-                                      Field::STORE_YES, Field::INDEX_NO));
-            doc->add(newLucene<Field>(L"created", DateField::timeToString(creationTime),
-                                      Field::STORE_YES, Field::INDEX_NO));
-            doc->add(newLucene<Field>(L"srclang", srclang.WCode(),
-                                      Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
-            doc->add(newLucene<Field>(L"lang", lang.WCode(),
-                                      Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
-            doc->add(newLucene<Field>(L"source", source,
-                                      Field::STORE_YES, Field::INDEX_ANALYZED));
-            doc->add(newLucene<Field>(L"trans", trans,
-                                      Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
+            // stop if shutting down or if the data were deleted or rolled back
+            // in the meantime, so that we don't resurrect them from the snapshot:
+            if (m_backgroundCancelled || writer->GetEpoch() != epoch)
+                break;
+            if (reader->isDeleted(i))
+                continue;
+            if (reader->document(i, selector)->get(L"v") == DOCUMENT_VERSION)
+                continue;
 
-            m_writer->updateDocument(newLucene<Term>(L"uuid", itemUUID), doc);
+            // Re-create the document from scratch rather than patching it, so that
+            // it gets all the unstored fields added since it was written, too.
+            // Keep the original UUID, because that's what it is identified by.
+            auto doc = reader->document(i);
+            auto uuid = doc->get(L"uuid");
+            auto updated = TranslationMemoryWriterImpl::CreateDocument
+                           (
+                               m_analyzer, uuid,
+                               doc->get(L"srclang"), doc->get(L"lang"),
+                               get_text_field(doc, L"source"), get_text_field(doc, L"trans"),
+                               DateField::stringToTime(doc->get(L"created"))
+                           );
+            m_writer->updateDocument(newLucene<Term>(L"uuid", uuid), updated);
+            migrated++;
         }
-        CATCH_AND_RETHROW_EXCEPTION
-    }
 
-    void Insert(const Language& srclang, const Language& lang,
-                const std::wstring& source, const std::wstring& trans) override
-    {
-        Insert(srclang, lang, source, trans, 0);
+        if (!m_backgroundCancelled && writer->GetEpoch() == epoch)
+            wxFile().Create(doneMarker, /*overwrite=*/true);
     }
-
-    void Insert(const Language& srclang, const Language& lang, const CatalogItemPtr& item) override
+    catch (LuceneException& e)
     {
-        if (!lang.IsValid() || !srclang.IsValid())
-            return;
+        // not fatal, older documents are handled in search too
+        wxLogTrace("poedit.tm", "documents migration failed: %s", e.getError());
+    }
 
-        // ignore translations with errors in them
-        if (item->HasError())
-            return;
+    wxLogTrace("poedit.tm", "migrated %d documents to version %s", migrated, DOCUMENT_VERSION);
+    if (migrated)
+        writer->ScheduleCommit();
+}
 
-        // ignore untranslated, pre-translated and non-revised or unfinished translations
-        if (item->IsFuzzy() || item->IsPreTranslated() || !item->IsTranslated())
-            return;
 
-        // always store at least the singular translation
-        Insert(srclang, lang, str::to_wstring(item->GetString()), str::to_wstring(item->GetTranslation()));
+namespace
+{
 
-        // for plurals, try to support at least the simpler cases, with nplurals <= 2
-        if (item->HasPlural())
-        {
-            switch (lang.nplurals())
-            {
-                case 1:
-                    // e.g. Chinese, Japanese; store translation for both singular and plural
-                    Insert(srclang, lang, str::to_wstring(item->GetPluralString()), str::to_wstring(item->GetTranslation()));
-                    break;
-                case 2:
-                    // e.g. Germanic or Romanic languages, same 2 forms as English
-                    Insert(srclang, lang, str::to_wstring(item->GetPluralString()), str::to_wstring(item->GetTranslation(1)));
-                    break;
-                default:
-                    // not supported, only singular stored above
-                    break;
-            }
-        }
+// Removes whitespace and punctuation from the text, so that entries differing
+// only in them (e.g. trailing space or period) are considered duplicates.
+std::wstring normalize_for_dedup(const std::wstring& text)
+{
+    std::wstring out;
+    out.reserve(text.size());
+    for (auto c: text)
+    {
+        if (!std::iswspace(c) && !std::iswpunct(c))
+            out += c;
     }
+    return out;
+}
 
-    void Insert(const CatalogPtr& cat) override
-    {
-        auto srclang = cat->GetSourceLanguage();
-        auto lang = cat->GetLanguage();
-        if (!lang.IsValid() || !srclang.IsValid())
-            return;
+} // anonymous namespace
 
-        for (auto& item: cat->items())
-        {
-            // Note that dt.IsModified() is intentionally not checked - we
-            // want to save old entries in the TM too, so that we harvest as
-            // much useful translations as we can.
-            Insert(srclang, lang, item);
-        }
-    }
 
-    void Delete(const std::string& uuid) override
+void TranslationMemoryImpl::ScheduleMaintenanceIfNeeded()
+{
+    static const time_t MAINTENANCE_INTERVAL = 30 * 24 * 60 * 60;
+
+    auto now = time(NULL);
+    auto last = Config::TMLastMaintenance();
+    if (last == 0)
     {
-        try
-        {
-            m_writer->deleteDocuments(newLucene<Term>(L"uuid", StringUtils::toUnicode(uuid)));
-        }
-        CATCH_AND_RETHROW_EXCEPTION
+        // don't run it right after the TM was first used, start counting instead:
+        Config::TMLastMaintenance(now);
+        return;
     }
+    if (now < last + MAINTENANCE_INTERVAL)
+        return;
+    Config::TMLastMaintenance(now);
 
-    void DeleteAll() override
+    RunInBackground([=]
     {
         try
         {
-            m_writer->deleteAll();
+            Maintain(TranslationMemory::MaintenanceOptions());
         }
-        CATCH_AND_RETHROW_EXCEPTION
-    }
-
-private:
-    IndexWriterPtr m_writer;
-};
+        catch (...)
+        {
+            wxLogTrace("poedit.tm", "maintenance failed: %s", DescribeCurrentException());
+        }
+    });
+}
 
 
-void TranslationMemoryImpl::Init()
+TranslationMemory::MaintenanceResult TranslationMemoryImpl::Maintain(const TranslationMemory::MaintenanceOptions& options)
 {
+    TranslationMemory::MaintenanceResult result;
+
+    auto writer = std::static_pointer_cast<TranslationMemoryWriterImpl>(GetWriter());
+    const auto epoch = writer->GetEpoch();
+    const long long sizeBefore = wxDir::GetTotalSize(GetDatabaseDir()).GetValue();
+
+    struct Entry
+    {
+        std::wstring uuid;
+        time_t created;
+    };
+    std::unordered_map<boost::uuids::uuid, Entry, boost::hash<boost::uuids::uuid>> newest;
+
+    // Digests are used as keys instead of the normalized texts themselves to
+    // keep memory use reasonable for large TMs:
+    static const boost::uuids::uuid s_namespace =
+      boost::uuids::string_generator()("6b1c9e0e-2d36-4f55-9a0c-3f9f5d1e8c27");
+    boost::uuids::name_generator keygen(s_namespace);
+
     try
     {
-        auto dir = newLucene<DirectoryType>(GetDatabaseDir());
-        m_analyzer = newLucene<StandardAnalyzer>(LuceneVersion::LUCENE_CURRENT);
+        std::vector<std::wstring> toDelete;
+        {
+            auto reader = m_mng->Reader();
+            int32_t maxDoc = reader->maxDoc();
 
-        m_writer = newLucene<IndexWriter>(dir, m_analyzer, IndexWriter::MaxFieldLengthLIMITED);
-        m_writer->setMergeScheduler(newLucene<SerialMergeScheduler>());
+            for (int32_t i = 0; i < maxDoc; i++)
+            {
+                if (m_backgroundCancelled)
+                    return result;
+                if (reader->isDeleted(i))
+                    continue;
+
+                auto doc = reader->document(i);
+                auto uuid = doc->get(L"uuid");
+                time_t created = DateField::stringToTime(doc->get(L"created"));
+
+                if (options.removeOlderThan && created < options.removeOlderThan)
+                {
+                    toDelete.push_back(uuid);
+                    result.expiredRemoved++;
+                    continue;
+                }
+
+                if (!options.removeNearDuplicates)
+                    continue;
+
+                std::wstring key(doc->get(L"srclang"));
+                key += L'\x1f';
+                key += doc->get(L"lang");
+                key += L'\x1f';
+                key += normalize_for_dedup(get_text_field(doc, L"source"));
+                key += L'\x1f';
+                key += normalize_for_dedup(get_text_field(doc, L"trans"));
+
+                auto inserted = newest.emplace(keygen(key), Entry{uuid, created});
+                if (inserted.second)
+                    continue;
 
-        // get the associated realtime reader & searcher:
-        m_mng.reset(new SearcherManager(m_writer));
+                // keep the most recent of the duplicates:
+                auto& kept = inserted.first->second;
+                if (created > kept.created)
+                {
+                    toDelete.push_back(kept.uuid);
+                    kept = Entry{uuid, created};
+                }
+                else
+                {
+                    toDelete.push_back(uuid);
+                }
+                result.duplicatesRemoved++;
+            }
+        }
+
+        // don't delete anything based on outdated snapshot if the data were
+        // deleted or rolled back in the meantime:
+        if (m_backgroundCancelled || writer->GetEpoch() != epoch)
+            return TranslationMemory::MaintenanceResult();
+
+        for (auto& uuid: toDelete)
+            m_writer->deleteDocuments(newLucene<Term>(L"uuid", uuid));
+        writer->Commit();
 
-        m_writerAPI = std::make_shared<TranslationMemoryWriterImpl>(m_writer);
+        // merge segments, which also purges deleted documents from them:
+        writer->Optimize();
+
+        // reopen the reader, so that files of the old segments can be deleted:
+        m_mng->Reader();
     }
     CATCH_AND_RETHROW_EXCEPTION
+
+    const long long sizeAfter = wxDir::GetTotalSize(GetDatabaseDir()).GetValue();
+    result.bytesReclaimed = std::max(0LL, sizeBefore - sizeAfter);
+
+    wxLogTrace("poedit.tm", "maintenance: removed %ld duplicates and %ld expired entries, reclaimed %lld bytes",
+               result.duplicatesRemoved, result.expiredRemoved, result.bytesReclaimed);
+
+    return result;
 }
 
 
@@ -810,6 +2973,7 @@ void TranslationMemory::CleanUp()
 {
     if (ms_instance)
     {
+        QueryStats::Get().TraceReport();
         delete ms_instance;
         ms_instance = nullptr;
     }
@@ -836,18 +3000,29 @@ TranslationMemory::~TranslationMemory() { delete m_impl; }
 
 SuggestionsList TranslationMemory::Search(const Language& srclang,
                                           const Language& lang,
-                                          const std::wstring& source)
+                                          const std::wstring& source,
+                                          dispatch::cancellation_token_ptr cancellationToken)
+{
+    if (!m_impl)
+        std::rethrow_exception(m_error);
+    return m_impl->Search(srclang, lang, source, cancellationToken);
+}
+
+std::vector<SuggestionsList> TranslationMemory::SearchBatch(const Language& srclang,
+                                                            const Language& lang,
+                                                            const std::vector<std::wstring>& sources)
 {
     if (!m_impl)
         std::rethrow_exception(m_error);
-    return m_impl->Search(srclang, lang, source);
+    return m_impl->SearchBatch(srclang, lang, sources);
 }
 
-dispatch::future<SuggestionsList> TranslationMemory::SuggestTranslation(const SuggestionQuery&& q)
+dispatch::future<SuggestionsList> TranslationMemory::SuggestTranslation(const SuggestionQuery&& q,
+                                                                       dispatch::cancellation_token_ptr cancellationToken)
 {
     try
     {
-        return dispatch::make_ready_future(Search(q.srclang, q.lang, q.source));
+        return dispatch::make_ready_future(Search(q.srclang, q.lang, q.source, cancellationToken));
     }
     catch (...)
     {
@@ -869,6 +3044,20 @@ void TranslationMemory::ExportData(IOInterface& destination)
     return m_impl->ExportData(destination);
 }
 
+time_t TranslationMemory::ExportChanges(time_t since, std::ostream& out)
+{
+    if (!m_impl)
+        std::rethrow_exception(m_error);
+    return m_impl->ExportChanges(since, out);
+}
+
+long TranslationMemory::ImportChanges(std::istream& in)
+{
+    if (!m_impl)
+        std::rethrow_exception(m_error);
+    return m_impl->ImportChanges(in);
+}
+
 void TranslationMemory::ImportData(std::function<void(IOInterface&)> source)
 {
     if (!m_impl)
@@ -876,6 +3065,82 @@ void TranslationMemory::ImportData(std::function<void(IOInterface&)> source)
     return m_impl->ImportData(source);
 }
 
+int TranslationMemory::ImportFiles(const std::vector<wxString>& paths,
+                                   std::function<void(const wxString& filename, const wxString& error)> onError,
+                                   dispatch::cancellation_token_ptr cancellationToken)
+{
+    if (!m_impl)
+        std::rethrow_exception(m_error);
+
+    // collect all loadable files, expanding directories:
+    std::vector<wxString> files;
+    for (auto& path: paths)
+    {
+        if (!wxFileName::DirExists(path))
+        {
+            files.push_back(path);
+            continue;
+        }
+
+        SourceCodeSpec spec;
+        spec.BasePath = wxFileName::DirName(path).GetFullPath();
+        spec.SearchPaths.push_back(".");
+        auto loadable = [](const wxString& f){ return Catalog::CanLoadFile(wxFileName(f).GetExt()); };
+        for (auto& f: Extractor::CollectAllFiles(spec, loadable))
+            files.push_back(spec.BasePath + f);
+    }
+
+    wxLogTrace("poedit.tm", "importing %d files", (int)files.size());
+
+    // Parsing is the expensive part, so files are loaded in parallel on
+    // background threads, but only a bounded number of them at a time to keep
+    // memory use in check. Inserting happens on this thread, in file order,
+    // with the writer batching the inserts.
+    const size_t maxInFlight = std::max<size_t>(2, std::thread::hardware_concurrency());
+    Progress progress((int)files.size());
+    int imported = 0;
+
+    m_impl->ImportData([&](IOInterface& io)
+    {
+        auto& writer = static_cast<TranslationMemory::Writer&>(io);
+
+        std::deque<std::pair<wxString, dispatch::future<CatalogPtr>>> pending;
+        size_t next = 0;
+        while (next < files.size() || !pending.empty())
+        {
+            const bool cancelled = cancellationToken && cancellationToken->is_cancelled();
+            while (!cancelled && next < files.size() && pending.size() < maxInFlight)
+            {
+                auto filename = files[next++];
+                pending.emplace_back(filename, dispatch::async(dispatch::priority::bulk, [filename]{ return Catalog::Create(filename); }));
+            }
+
+            if (pending.empty())
+                break;
+
+            auto job = std::move(pending.front());
+            pending.pop_front();
+            try
+            {
+                auto cat = job.second.get();
+                if (!cancelled)
+                {
+                    writer.Insert(cat);
+                    imported++;
+                }
+            }
+            catch (...)
+            {
+                if (onError && !cancelled)
+                    onError(job.first, DescribeCurrentException());
+            }
+            progress.increment();
+        }
+    });
+
+    return imported;
+}
+
 std::shared_ptr<TranslationMemory::Writer> TranslationMemory::GetWriter()
 {
     if (!m_impl)
@@ -901,6 +3166,8 @@ void TranslationMemory::DeleteAllAndReset()
         std::swap(m_impl, impl);
         delete impl;
         m_error = nullptr;
+
+        NotifyDataChanged();
     }
 }
 
@@ -911,6 +3178,41 @@ void TranslationMemory::GetStats(long& numDocs, long& fileSize)
     m_impl->GetStats(numDocs, fileSize);
 }
 
+dispatch::future<void> TranslationMemory::Warmup(const Language& srclang, const Language& lang)
+{
+    try
+    {
+        if (!m_impl)
+            std::rethrow_exception(m_error);
+        auto impl = m_impl;
+        return impl->RunInBackground([=]{ impl->Warmup(srclang, lang); });
+    }
+    catch (...)
+    {
+        return dispatch::make_exceptional_future_from_current<void>();
+    }
+}
+
+dispatch::future<TranslationMemory::MaintenanceResult> TranslationMemory::Maintain(const MaintenanceOptions& options)
+{
+    try
+    {
+        if (!m_impl)
+            std::rethrow_exception(m_error);
+        auto impl = m_impl;
+        return impl->RunInBackground([=]{ return impl->Maintain(options); });
+    }
+    catch (...)
+    {
+        return dispatch::make_exceptional_future_from_current<MaintenanceResult>();
+    }
+}
+
+std::string TranslationMemory::GetDiagnosticsReport()
+{
+    return QueryStats::Get().Report();
+}
+
 void TranslationMemory::SearchSubstring(IOInterface& destination,
                                         const Language& srclang, const Language& lang, const std::wstring& sourcePhrase)
 {
@@ -28,6 +28,7 @@
 
 #include <exception>
 #include <functional>
+#include <iostream>
 #include <string>
 #include <vector>
 #include <memory>
@@ -57,15 +58,51 @@ public:
         @param srclang Language of the source text.
         @param lang    Language of the desired translation.
         @param source  Source text.
+        @param cancellationToken Optional token to abort the search with.
 
-        @return List of hits that were found, possibly empty.
+        Interactive searches done with this function take precedence over
+        SearchBatch() calls running at the same time.
+
+        @return List of hits that were found, possibly empty. If the search
+                was cancelled, the list may be incomplete.
      */
     SuggestionsList Search(const Language& srclang,
                            const Language& lang,
-                           const std::wstring& source);
+                           const std::wstring& source,
+                           dispatch::cancellation_token_ptr cancellationToken = dispatch::cancellation_token_ptr());
+
+    /**
+        Search translation memory for multiple strings at once.
+
+        This is considerably more efficient than calling Search() repeatedly,
+        because the index is only opened once for the whole batch and
+        duplicate source strings are only looked up once.
+
+        Batch searches are intended for background processing and yield to
+        interactive Search() calls.
+
+        @param srclang Language of the source texts.
+        @param lang    Language of the desired translations.
+        @param sources Source texts.
+
+        @return List of hits for each of @a sources, in the same order.
+     */
+    std::vector<SuggestionsList> SearchBatch(const Language& srclang,
+                                             const Language& lang,
+                                             const std::vector<std::wstring>& sources);
+
+    /**
+        Prepares the TM for searching in given language pair in the background,
+        so that the first Search() calls aren't slower than later ones.
+
+        The language pair's filter is computed and cached, and the index data
+        used by searches are loaded into memory, if they weren't already.
+     */
+    dispatch::future<void> Warmup(const Language& srclang, const Language& lang);
 
     /// SuggestionsBackend API implementation:
-    dispatch::future<SuggestionsList> SuggestTranslation(const SuggestionQuery&& q) override;
+    dispatch::future<SuggestionsList> SuggestTranslation(const SuggestionQuery&& q,
+                                                         dispatch::cancellation_token_ptr cancellationToken) override;
 
     void Delete(const std::string& id) override;
 
@@ -93,10 +130,59 @@ public:
         Imports data provided by the function into the database. The function
         must use the interface passed to it to write data.
 
+        Data are written in bulk import mode (see Writer::BeginBulkImport()),
+        committed and the index is optimized afterwards.
+
         May throw on error.
      */
     void ImportData(std::function<void(IOInterface&)> source);
 
+    /**
+        Imports translations from all files that Poedit can open (PO, XLIFF, ...)
+        found in given @a paths into the database. Directories are searched
+        recursively.
+
+        Files are loaded in parallel and written in bulk import mode (see
+        ImportData()). Files that can't be loaded are skipped and reported
+        to @a onError, which is called on the calling thread.
+
+        @return Number of successfully imported files.
+
+        May throw on error.
+     */
+    int ImportFiles(const std::vector<wxString>& paths,
+                    std::function<void(const wxString& filename, const wxString& error)> onError,
+                    dispatch::cancellation_token_ptr cancellationToken = {});
+
+    /**
+        Exports changes for incremental replication of the TM to another
+        machine: entries created (or updated) at or after @a since, as well
+        as entries deleted with Writer::Delete() since then.
+
+        The format is JSON Lines: a header line followed by one line per
+        change, either
+        {"op":"insert","uuid":...,"created":...,"srclang":...,"lang":...,"source":...,"trans":...}
+        or {"op":"delete","uuid":...,"deleted":...}. Entries are identified
+        by UUIDs that only depend on their content, so they are the same on
+        all machines.
+
+        @return Watermark to pass as @a since to the next export, so that
+                the changes exported now are (mostly) not exported again.
+
+        May throw on error.
+     */
+    time_t ExportChanges(time_t since, std::ostream& out);
+
+    /**
+        Applies changes exported by ExportChanges() (on any machine) in bulk
+        import mode. Applying the same changes more than once is harmless.
+
+        @return Number of applied changes.
+
+        May throw on error.
+     */
+    long ImportChanges(std::istream& in);
+
     void SearchSubstring(IOInterface& destination,
                          const Language& srclang, const Language& lang, const std::wstring& sourcePhrase);
 
@@ -164,9 +250,56 @@ public:
         /// Deletes everything from the TM.
         virtual void DeleteAll() = 0;
 
+        /// Criteria for DeleteByQuery(); entries matching all of them are deleted
+        struct DeleteQuery
+        {
+            /// If valid, only delete entries with this source language
+            Language srclang;
+            /// If valid, only delete entries with this translation language
+            Language lang;
+            /// If nonzero, only delete entries created at or after this time
+            time_t createdFrom = 0;
+            /// If nonzero, only delete entries created before this time
+            time_t createdTo = 0;
+            /// If not empty, only delete entries whose source text starts with it
+            std::wstring sourcePrefix;
+        };
+
+        /**
+            Deletes all entries matching @a query and commits the change.
+
+            This is much faster than deleting entries one by one. Deletions
+            are recorded for ExportChanges() as with Delete().
+
+            @return Number of deleted entries.
+         */
+        virtual long DeleteByQuery(const DeleteQuery& query) = 0;
+
+        /**
+            Switches the writer into bulk import mode, optimized for throughput
+            when inserting large amounts of data.
+
+            Inserts are processed in batches in the background and may not be
+            visible (or report errors) until EndBulkImport() is called. Calls
+            may be nested.
+         */
+        virtual void BeginBulkImport() = 0;
+
+        /// Finishes bulk import mode. Throws if any of the inserts failed.
+        virtual void EndBulkImport() = 0;
+
         /// Commits changes written so far.
         virtual void Commit() = 0;
 
+        /**
+            Schedules commit of changes written so far to happen soon on a
+            background thread, coalesced with other scheduled commits.
+            
+            Unlike Commit(), this is cheap and never blocks. Scheduled commits
+            are flushed on shutdown at the latest.
+         */
+        virtual void ScheduleCommit() = 0;
+
         /// Rolls back changes written so far.
         virtual void Rollback() = 0;
     };
@@ -180,10 +313,51 @@ public:
     /// Returns statistics about the TM
     void GetStats(long& numDocs, long& fileSize);
 
+    /// Options for Maintain()
+    struct MaintenanceOptions
+    {
+        /// Remove entries that differ from others only in whitespace or punctuation
+        bool removeNearDuplicates = true;
+        /// If nonzero, remove entries created before this time
+        time_t removeOlderThan = 0;
+    };
+
+    /// Results of Maintain()
+    struct MaintenanceResult
+    {
+        long duplicatesRemoved = 0;
+        long expiredRemoved = 0;
+        long long bytesReclaimed = 0;
+    };
+
+    /**
+        Performs database maintenance in the background: removes duplicate
+        and (optionally) old entries and optimizes the index, which purges
+        deleted documents and merges its segments.
+
+        Of near-duplicate entries, the most recent one is kept. Maintenance
+        is also done automatically every few weeks.
+
+        The returned future fails with Exception on error.
+     */
+    dispatch::future<MaintenanceResult> Maintain(const MaintenanceOptions& options);
+
+    /**
+        Returns human-readable report of performance statistics (per-phase
+        query latencies and their percentiles, hits, loaded documents, reader
+        reopens, insert throughput, commits and substring searches) collected
+        since the application started.
+
+        The same report is periodically logged with wxLogTrace("poedit.tm").
+     */
+    static std::string GetDiagnosticsReport();
+
 private:
     TranslationMemory();
     ~TranslationMemory();
 
+    friend class TranslationMemoryWriterImpl;
+
     TranslationMemoryImpl *m_impl;
     std::exception_ptr m_error;
     static TranslationMemory *ms_instance;
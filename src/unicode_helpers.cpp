@@ -27,6 +27,8 @@
 
 #include "str_helpers.h"
 
+#include <algorithm>
+
 #include <unicode/ubidi.h>
 
 
@@ -57,6 +59,23 @@ Collator::~Collator()
         ucol_close(m_coll);
 }
 
+Collator::sort_key_type Collator::sort_key(const UChar *s) const
+{
+    // The returned length includes terminating NUL, which isn't needed here.
+    // Most keys are short enough to fit into the stack buffer:
+    uint8_t buf[256];
+    int32_t len = ucol_getSortKey(m_coll, s, -1, buf, sizeof(buf));
+    if (len <= 0)
+        return sort_key_type();
+    if (len <= (int32_t)sizeof(buf))
+        return sort_key_type((const char*)buf, len - 1);
+
+    sort_key_type key(len, '\0');
+    ucol_getSortKey(m_coll, s, -1, (uint8_t*)&key[0], len);
+    key.resize(len - 1);
+    return key;
+}
+
 
 BreakIterator::BreakIterator(UBreakIteratorType type, const Language& lang)
 {
@@ -76,9 +95,56 @@ BreakIterator::BreakIterator(UBreakIteratorType type, const Language& lang)
 namespace bidi
 {
 
+namespace
+{
+
+// Hebrew is the first right-to-left script; characters before it are never
+// strong RTL characters and directional controls come after it too.
+const uint32_t FIRST_RTL_CHAR = 0x0590;
+
+// Returns true if the text consists only of characters that can't affect
+// its directionality, i.e. it is certainly LTR or neutral. This is the
+// case for the vast majority of texts, so it is checked first, without any
+// allocations, before using ICU.
+inline bool is_trivially_ltr(const wxString& text)
+{
+    const wchar_t *s = text.wx_str();
+    const size_t len = text.length();
+
+    size_t i = 0;
+    // check blocks of characters at once, compilers vectorize this:
+    for (; i + 8 <= len; i += 8)
+    {
+        uint32_t top = 0;
+        for (size_t j = 0; j < 8; j++)
+            top = std::max(top, static_cast<uint32_t>(s[i + j]));
+        if (top >= FIRST_RTL_CHAR)
+            return false;
+    }
+    for (; i < len; i++)
+    {
+        if (static_cast<uint32_t>(s[i]) >= FIRST_RTL_CHAR)
+            return false;
+    }
+    return true;
+}
+
+inline bool is_ltr_control_char(wchar_t c)
+{
+    return c == LRE || c == LRO || c == LRI || c == LRM;
+}
+
+inline bool is_rtl_control_char(wchar_t c)
+{
+    return c == RLE || c == RLO || c == RLI || c == RLM;
+}
+
+} // anonymous namespace
+
+
 TextDirection get_base_direction(const wxString& text)
 {
-    if (text.empty())
+    if (text.empty() || is_trivially_ltr(text))
         return TextDirection::LTR;
 
     auto s = str::to_icu(text);
@@ -97,72 +163,41 @@ TextDirection get_base_direction(const wxString& text)
 }
 
 
-wxString strip_pointless_control_chars(const wxString& text, TextDirection dir)
+wxString strip_pointless_control_chars(wxString text, TextDirection dir)
 {
     if (text.empty())
         return text;
 
-    const wchar_t first = *text.begin();
-    const wchar_t last = *text.rbegin();
-
     // POP DIRECTIONAL FORMATTING at the end is pointless (can happen on macOS
     // when editing RTL text under LTR locale:
-    if (last == PDF)
-    {
-        return strip_pointless_control_chars(text.substr(0, text.size() - 1), dir);
-    }
+    size_t end = text.length();
+    while (end > 0 && text[end - 1] == PDF)
+        end--;
+    if (end < text.length())
+        text.erase(end);
+    if (text.empty())
+        return text;
 
-    if (dir == TextDirection::LTR)
-    {
-        switch (first)
-        {
-            case LRE:
-            case LRO:
-            case LRI:
-            case LRM:
-                return text.substr(1);
-            default:
-                return text;
-        }
-    }
-    else if (dir == TextDirection::RTL)
+    const wchar_t first = *text.begin();
+    if ((dir == TextDirection::LTR && is_ltr_control_char(first)) ||
+        (dir == TextDirection::RTL && is_rtl_control_char(first)))
     {
-        switch (first)
-        {
-            case RLE:
-            case RLO:
-            case RLI:
-            case RLM:
-                return text.substr(1);
-            default:
-                return text;
-        }
+        text.erase(0, 1);
     }
 
     return text;
 }
 
 
-wxString strip_control_chars(const wxString& text)
+wxString strip_control_chars(wxString text)
 {
     if (text.empty())
         return text;
 
     const wchar_t first = *text.begin();
-    switch (first)
-    {
-        case LRE:
-        case LRO:
-        case LRI:
-        case LRM:
-        case RLE:
-        case RLO:
-        case RLI:
-        case RLM:
-            return text.substr(1);
-        default:
-            break;
-    }
+    if (is_ltr_control_char(first) || is_rtl_control_char(first))
+        text.erase(0, 1);
+
     return text;
 }
 
@@ -172,13 +207,20 @@ wxString mark_direction(const wxString& text, TextDirection dir)
     if (text.empty())
         return text;
 
-    wchar_t mark = (dir == TextDirection::LTR) ? LRE : RLE;
-    auto out = mark + text;
+    const wchar_t mark = (dir == TextDirection::LTR) ? LRE : RLE;
+
+    wxString out;
+    out.reserve(text.length() + 1);
+    out += mark;
+    out += text;
 #ifdef BIDI_NEEDS_DIRECTION_ON_EACH_LINE
-    wchar_t replacement[3] = {0};
-    replacement[0] = L'\n';
-    replacement[1] = mark;
-    out.Replace("\n", replacement);
+    if (text.find('\n') != wxString::npos)
+    {
+        wchar_t replacement[3] = {0};
+        replacement[0] = L'\n';
+        replacement[1] = mark;
+        out.Replace("\n", replacement);
+    }
 #endif
     return out;
 }
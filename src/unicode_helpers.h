@@ -32,6 +32,8 @@
 
 #include <wx/string.h>
 
+#include <string>
+
 #include <unicode/ucol.h>
 #include <unicode/ubrk.h>
 
@@ -98,6 +100,19 @@ public:
         return compare(a, b) == UCOL_LESS;
     }
 
+    /// Binary sort key, compared bytewise (e.g. with memcmp())
+    typedef std::string sort_key_type;
+
+    /**
+        Returns binary sort key for the string.
+
+        Comparing two keys bytewise gives the same result as compare() on
+        the strings, but is much faster. Use this when the same strings are
+        compared many times, e.g. when sorting.
+     */
+    sort_key_type sort_key(const UChar *s) const;
+    sort_key_type sort_key(const wxString& s) const { return sort_key(str::to_icu(s)); }
+
 private:
     UCollator *m_coll = nullptr;
 };
@@ -275,15 +290,18 @@ TextDirection get_base_direction(const wxString& text);
 
     This function exists primarily to solve issues with text controls when
     editing text in language different from the UI's language.
+
+    The text is taken by value and modified in place, so passing a temporary
+    doesn't copy it.
  */
-wxString strip_pointless_control_chars(const wxString& text, TextDirection dir);
+wxString strip_pointless_control_chars(wxString text, TextDirection dir);
 
 /**
     Remove leading directional control characters.
 
     For use if the text has known direction or can't have control characters. 
  */
-wxString strip_control_chars(const wxString& text);
+wxString strip_control_chars(wxString text);
 
 /**
     Prepend directional mark to text, for display purposes on platforms that
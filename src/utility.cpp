@@ -38,9 +38,14 @@
 #ifdef __WXOSX__
     #include <Foundation/Foundation.h>
 #endif
+#ifdef __WXMSW__
+    #include <windows.h>
+#endif
 #ifdef __UNIX__
     #include <sys/types.h>
     #include <sys/stat.h>
+    #include <sys/mman.h>
+    #include <fcntl.h>
     #include <unistd.h>
 #endif
 
@@ -190,7 +195,11 @@ wxString TempDirectory::CreateFileName(const wxString& suffix)
 {
     wxASSERT( !m_dir.empty() );
 
-    int counter = m_counters[suffix]++;
+    int counter;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        counter = m_counters[suffix]++;
+    }
 
     wxString s = wxString::Format("%s%c%s%s",
                                   m_dir.c_str(), wxFILE_SEP_PATH,
@@ -357,6 +366,60 @@ wxString CliSafeFileName(const wxString& fn)
 #endif // __WXMSW__
 
 
+// ----------------------------------------------------------------------
+// MappedFile
+// ----------------------------------------------------------------------
+
+MappedFile::MappedFile(const wxString& filename)
+{
+#ifdef __WXMSW__
+    HANDLE file = CreateFileW(filename.wc_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    m_file = file;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+        return;
+    m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping)
+        return;
+    m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (m_data)
+        m_size = (size_t)size.QuadPart;
+#else
+    m_fd = open(filename.fn_str(), O_RDONLY);
+    if (m_fd == -1)
+        return;
+    struct stat st;
+    if (fstat(m_fd, &st) != 0 || st.st_size == 0)
+        return;
+    void *addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (addr == MAP_FAILED)
+        return;
+    m_data = (const char*)addr;
+    m_size = (size_t)st.st_size;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef __WXMSW__
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file)
+        CloseHandle(m_file);
+#else
+    if (m_data)
+        munmap((void*)m_data, m_size);
+    if (m_fd != -1)
+        close(m_fd);
+#endif
+}
+
+
 // ----------------------------------------------------------------------
 // Helpers for persisting windows' state
 // ----------------------------------------------------------------------
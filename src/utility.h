@@ -33,6 +33,7 @@
 #endif
 
 #include <map>
+#include <mutex>
 
 #include <wx/arrstr.h>
 #include <wx/filename.h>
@@ -88,26 +89,48 @@ wxString EscapeMarkup(const wxString& str);
 
 // Encoding and decoding a string with C escape sequences:
 
+// Returns the escape letter for characters that need to be escaped as \<letter>,
+// '\\' or '"' for themselves and 0 for characters that don't need escaping.
+inline wchar_t CStringEscapeChar(wchar_t c)
+{
+    static const char letters[] = "abtnvfr"; // '\a' .. '\r'
+    if (c >= '\a' && c <= '\r')
+        return letters[c - '\a'];
+    if (c == '"' || c == '\\')
+        return c;
+    return 0;
+}
+
 template<typename T>
 inline void EscapeCStringInplace(T& str)
 {
-    for (typename T::iterator i = str.begin(); i != str.end(); ++i)
+    // Typical strings have nothing or very little to escape, so don't touch
+    // them at all in the former case and copy runs of characters between
+    // escapes in one go otherwise.
+    const T& in = str;
+    auto i = in.begin();
+    const auto end = in.end();
+    while (i != end && !CStringEscapeChar((wchar_t)*i))
+        ++i;
+    if (i == end)
+        return;
+
+    T out;
+    out.reserve(str.length() + 8);
+    auto run = in.begin();
+    for (; i != end; ++i)
     {
-        switch ((wchar_t)*i)
-        {
-            case '"' :           i = ++str.insert(i, '\\'); break;
-            case '\a': *i = 'a'; i = ++str.insert(i, '\\'); break;
-            case '\b': *i = 'b'; i = ++str.insert(i, '\\'); break;
-            case '\f': *i = 'f'; i = ++str.insert(i, '\\'); break;
-            case '\n': *i = 'n'; i = ++str.insert(i, '\\'); break;
-            case '\r': *i = 'r'; i = ++str.insert(i, '\\'); break;
-            case '\t': *i = 't'; i = ++str.insert(i, '\\'); break;
-            case '\v': *i = 'v'; i = ++str.insert(i, '\\'); break;
-            case '\\':           i = ++str.insert(i, '\\'); break;
-            default:
-                break;
-        }
+        const wchar_t esc = CStringEscapeChar((wchar_t)*i);
+        if (!esc)
+            continue;
+        out.append(run, i);
+        out += '\\';
+        out += (char)esc;
+        run = i;
+        ++run;
     }
+    out.append(run, end);
+    str.swap(out);
 }
 
 template<typename T>
@@ -126,45 +149,42 @@ inline T UnescapeCString(const T& str)
 
     T out;
     out.reserve(str.length());
-    for (auto i = str.begin(); i != str.end(); ++i)
+    auto run = str.begin();
+    const auto end = str.end();
+    for (auto i = str.begin(); i != end; ++i)
     {
-        wchar_t c = *i;
-        if (c == '\\')
+        if ((wchar_t)*i != '\\')
+            continue;
+
+        // copy everything up to the backslash verbatim:
+        out.append(run, i);
+        run = i;
+        if (++i == end)
+            break;  // trailing backslash is kept as-is
+
+        switch ((wchar_t)*i)
         {
-            if (++i != str.end())
-            {
-                switch ((wchar_t)*i)
-                {
-                    case 'a': out += '\a'; break;
-                    case 'b': out += '\b'; break;
-                    case 'f': out += '\f'; break;
-                    case 'n': out += '\n'; break;
-                    case 'r': out += '\r'; break;
-                    case 't': out += '\t'; break;
-                    case 'v': out += '\v'; break;
-                    case '\\':
-                    case '"':
-                    case '\'':
-                    case '?':
-                        out += *i;
-                        break;
-                    default:
-                        out += c;
-                        out += *i;
-                        break;
-                }
-            }
-            else
-            {
-                out += c;
+            case 'a': out += '\a'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'v': out += '\v'; break;
+            case '\\':
+            case '"':
+            case '\'':
+            case '?':
+                out += *i;
                 break;
-            }
-        }
-        else
-        {
-            out += c;
+            default:
+                // unknown escape, keep both characters
+                continue;
         }
+        run = i;
+        ++run;
     }
+    out.append(run, end);
     return out;
 }
 
@@ -216,7 +236,7 @@ public:
 
     bool IsOk() const { return !m_dir.empty(); }
 
-    // creates new file name in that directory
+    // creates new file name in that directory; may be called from any thread
     wxString CreateFileName(const wxString& suffix);
 
     /// Clears the temp directory (only safe if none of the files are open). Called by dtor.
@@ -226,6 +246,7 @@ public:
     static void KeepFiles(bool keep = true) { ms_keepFiles = keep; }
 
 private:
+    std::mutex m_mutex;
     std::map<wxString, int> m_counters;
     wxString m_dir;
 
@@ -272,6 +293,37 @@ inline wxString CliSafeFileName(const wxString& fn) { return fn; }
 #endif
 
 
+// ----------------------------------------------------------------------
+// MappedFile
+// ----------------------------------------------------------------------
+
+/// Read-only memory mapping of the entire file.
+class MappedFile
+{
+public:
+    /// Maps the file; check IsOk() for success (empty files are never mapped).
+    explicit MappedFile(const wxString& filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool IsOk() const { return m_data != nullptr; }
+    const char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+#ifdef __WXMSW__
+    void *m_file = nullptr;
+    void *m_mapping = nullptr;
+#else
+    int m_fd = -1;
+#endif
+};
+
+
 // ----------------------------------------------------------------------
 // Helpers for persisting windows' state
 // ----------------------------------------------------------------------